@@ -0,0 +1,160 @@
+/*=====================================================================
+CacheDirEviction.cpp
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "CacheDirEviction.h"
+
+
+#include <utils/FileUtils.h>
+#include <utils/StringUtils.h>
+#include <utils/Exception.h>
+#include <utils/ConPrint.h>
+#include <algorithm>
+
+
+namespace CacheDirEviction
+{
+
+
+struct CacheFile
+{
+	std::string filename;
+	uint64 size_B;
+	uint64 access_seq; // 0 if not accessed this session.
+};
+
+
+struct CacheFileAccessSeqLessThan
+{
+	bool operator () (const CacheFile& a, const CacheFile& b) const { return a.access_seq < b.access_seq; }
+};
+
+
+Results evictFiles(const std::string& cache_dir, const std::vector<std::string>& filenames, const std::unordered_map<std::string, uint64>& access_seqs, uint64 max_total_size_B)
+{
+	Results results;
+	results.num_evicted = 0;
+	results.evicted_size_B = 0;
+	results.total_present_size_B = 0;
+
+	std::vector<CacheFile> files;
+	files.reserve(filenames.size());
+	for(size_t i=0; i<filenames.size(); ++i)
+	{
+		if(filenames[i].find("_tmp_") != std::string::npos)
+			continue;
+
+		try
+		{
+			CacheFile file;
+			file.filename = filenames[i];
+			file.size_B = FileUtils::getFileSize(cache_dir + "/" + filenames[i]);
+			const auto res = access_seqs.find(filenames[i]);
+			file.access_seq = (res != access_seqs.end()) ? (res->second + 1) : 0;
+			files.push_back(file);
+
+			results.total_present_size_B += file.size_B;
+		}
+		catch(glare::Exception&)
+		{} // File may have been removed since it was listed.
+	}
+
+	std::stable_sort(files.begin(), files.end(), CacheFileAccessSeqLessThan());
+
+	for(size_t i=0; (i<files.size()) && (results.total_present_size_B > max_total_size_B); ++i)
+	{
+		try
+		{
+			FileUtils::deleteFile(cache_dir + "/" + files[i].filename);
+
+			results.num_evicted++;
+			results.evicted_size_B += files[i].size_B;
+			results.total_present_size_B -= files[i].size_B;
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("CacheDirEviction: failed to delete '" + files[i].filename + "': " + e.what());
+		}
+	}
+
+	return results;
+}
+
+
+} // end namespace CacheDirEviction
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+
+
+void CacheDirEviction::test()
+{
+	conPrint("CacheDirEviction::test()");
+
+	const std::string cache_dir = PlatformUtils::getTempDirPath() + "/cache_dir_eviction_test";
+	FileUtils::createDirIfDoesNotExist(cache_dir);
+
+	try
+	{
+		// Clear out any files from previous test runs.
+		{
+			const std::vector<std::string> filenames = FileUtils::getFilesInDir(cache_dir);
+			for(size_t i=0; i<filenames.size(); ++i)
+				FileUtils::deleteFile(cache_dir + "/" + filenames[i]);
+		}
+
+		const std::string data(1000, 'a');
+		const char* filenames[] = { "a.bin", "b.bin", "c.bin", "d.bin", "d.bin_tmp_0" };
+		for(size_t i=0; i<staticArrayNumElems(filenames); ++i)
+			FileUtils::writeEntireFile(cache_dir + "/" + filenames[i], data);
+
+		// c was used least recently this session, then a.  b and d weren't used this session.
+		std::unordered_map<std::string, uint64> access_seqs;
+		access_seqs["c.bin"] = 0;
+		access_seqs["a.bin"] = 1;
+
+		// Under budget: nothing should be evicted.
+		{
+			const Results results = evictFiles(cache_dir, FileUtils::getFilesInDir(cache_dir), access_seqs, /*max total size=*/4000);
+			testAssert(results.num_evicted == 0);
+			testAssert(results.total_present_size_B == 4000); // Temp file should not be counted.
+		}
+
+		// b and d should be evicted first, then c.
+		{
+			const Results results = evictFiles(cache_dir, FileUtils::getFilesInDir(cache_dir), access_seqs, /*max total size=*/1500);
+			testAssert(results.num_evicted == 3);
+			testAssert(results.evicted_size_B == 3000);
+			testAssert(results.total_present_size_B == 1000);
+			testAssert(FileUtils::fileExists(cache_dir + "/a.bin"));
+			testAssert(!FileUtils::fileExists(cache_dir + "/b.bin"));
+			testAssert(!FileUtils::fileExists(cache_dir + "/c.bin"));
+			testAssert(!FileUtils::fileExists(cache_dir + "/d.bin"));
+			testAssert(FileUtils::fileExists(cache_dir + "/d.bin_tmp_0"));
+		}
+
+		// A listed file that has since been deleted should be skipped.
+		{
+			std::vector<std::string> listed_filenames = FileUtils::getFilesInDir(cache_dir);
+			listed_filenames.push_back("b.bin");
+			const Results results = evictFiles(cache_dir, listed_filenames, access_seqs, /*max total size=*/0);
+			testAssert(results.num_evicted == 1);
+			testAssert(results.total_present_size_B == 0);
+			testAssert(!FileUtils::fileExists(cache_dir + "/a.bin"));
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("CacheDirEviction::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,44 @@
+/*=====================================================================
+CacheDirEviction.h
+------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/Platform.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+/*=====================================================================
+CacheDirEviction
+----------------
+Size-limited eviction for the single-directory on-disk caches
+(TextureDataCache and PhysicsShapeCache).
+
+These caches don't keep a persistent index, so the only access information
+is what has been recorded this session: entries not used this session are
+evicted first, then entries in order of least recent use.
+=====================================================================*/
+namespace CacheDirEviction
+{
+
+struct Results
+{
+	size_t num_evicted;
+	uint64 evicted_size_B;
+	uint64 total_present_size_B; // Total size of the files remaining after eviction.
+};
+
+// Deletes files from cache_dir until the total size of the files is <= max_total_size_B.
+// filenames should be the result of FileUtils::getFilesInDir(cache_dir), listed before access_seqs was taken, so that entries added in between aren't treated as unused.
+// access_seqs maps filename to a sequence number that increases with each access this session.
+// Temp files (containing '_tmp_') are left alone as they may be in the process of being written.
+// Failure to delete a file (e.g. if it is open on Windows) is logged and otherwise ignored.
+Results evictFiles(const std::string& cache_dir, const std::vector<std::string>& filenames, const std::unordered_map<std::string, uint64>& access_seqs, uint64 max_total_size_B);
+
+void test();
+
+} // end namespace CacheDirEviction
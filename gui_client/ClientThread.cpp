@@ -610,6 +610,7 @@ void ClientThread::readAndHandleMessage(const uint32 peer_protocol_version)
 					WorldObject* ob = res.getValue().ptr();
 
 					ob->model_url = new_model_url;
+					BitUtils::zeroBit(ob->flags, WorldObject::OPTIMISED_MODEL_FLAG); // The server sends a full object update instead if the new model has an optimised version.
 
 					ob->from_remote_model_url_dirty = true;
 					world_state->dirty_from_remote_objects.insert(ob);
@@ -803,6 +804,7 @@ void ClientThread::readAndHandleMessage(const uint32 peer_protocol_version)
 			{
 				::Lock lock(world_state->mutex);
 				world_state->parcels[parcel->id] = parcel;
+				world_state->parcel_index.insertOrUpdate(parcel);
 				world_state->dirty_from_remote_parcels.insert(parcel);
 			}
 			break;
@@ -841,6 +843,7 @@ void ClientThread::readAndHandleMessage(const uint32 peer_protocol_version)
 					Parcel* parcel = res->second.getPointer();
 					readFromNetworkStreamGivenID(msg_buffer, *parcel, peer_protocol_version);
 					read = true;
+					world_state->parcel_index.insertOrUpdate(res->second); // Parcel geometry may have changed.
 					parcel->from_remote_dirty = true;
 					world_state->dirty_from_remote_parcels.insert(parcel);
 				}
@@ -989,6 +992,7 @@ void ClientThread::readAndHandleMessage(const uint32 peer_protocol_version)
 			break;
 		}
 	case Protocol::LODChunkInitialSend:
+	case Protocol::LODChunkUpdatedMessage: // Sent when the server rebuilds a chunk due to objects in it changing.
 		{
 			LODChunkRef chunk = new LODChunk();
 			readLODChunkFromStream(msg_buffer, *chunk);
@@ -20,6 +20,10 @@ Copyright Glare Technologies Limited 2021 -
 #include <KillThreadMessage.h>
 #include <PlatformUtils.h>
 #include <FileOutStream.h>
+#include <SocketBufferOutStream.h>
+#include <Clock.h>
+#include <map>
+#include <cmath>
 
 
 DownloadResourcesThread::DownloadResourcesThread(ThreadSafeQueue<Reference<ThreadMessage> >* out_msg_queue_, Reference<ResourceManager> resource_manager_, const std::string& hostname_, int port_, 
@@ -112,6 +116,305 @@ void DownloadResourcesThread::killConnection()
 }
 
 
+// A resource being downloaded over a multiplexed download connection.
+struct InFlightDownload : public ThreadSafeRefCounted
+{
+	InFlightDownload() : priority(0), header_received(false), file_size(0), num_bytes_received(0), file(NULL) {}
+	~InFlightDownload() { delete file; }
+
+	std::string URL;
+	ResourceRef resource;
+	std::string path;
+	std::string partial_path; // Data is written to this path, then the file is moved to path when complete.  Kept if the download is interrupted, so it can be resumed.
+	SmallVector<DownloadQueuePosInfo, 4> pos_info;
+	float priority; // Last priority sent to the server.
+	bool header_received;
+	uint64 file_size;
+	uint64 num_bytes_received; // Including any data from a previous partial download.
+	FileOutStream* file;
+};
+
+typedef std::map<uint32, Reference<InFlightDownload>> InFlightDownloadMap;
+
+
+static void deletePartialFile(InFlightDownload* download)
+{
+	delete download->file;
+	download->file = NULL;
+	try
+	{
+		if(FileUtils::fileExists(download->partial_path))
+			FileUtils::deleteFile(download->partial_path);
+	}
+	catch(glare::Exception&)
+	{}
+}
+
+
+// Mark resources as not present so they can be requested again later.  Partial files are kept, so the downloads can be resumed.
+static void abortInFlightDownloads(InFlightDownloadMap& in_flight, ResourceManager& resource_manager, glare::AtomicInt* num_resources_downloading)
+{
+	for(auto it = in_flight.begin(); it != in_flight.end(); ++it)
+	{
+		InFlightDownload* download = it->second.ptr();
+		delete download->file;
+		download->file = NULL;
+		download->resource->setState(Resource::State_NotPresent);
+		resource_manager.markResourceAsChanged(download->resource);
+		(*num_resources_downloading)--;
+	}
+	in_flight.clear();
+}
+
+
+void DownloadResourcesThread::doMultiplexedDownloads()
+{
+	const size_t MAX_NUM_IN_FLIGHT = 8; // The server interleaves chunks of in-flight resources by priority, so a large resource doesn't block the others.
+	const uint64 MAX_FILE_SIZE = 1000000000;
+	const uint32 MAX_CHUNK_SIZE = 1 << 20;
+	const double PRIORITY_UPDATE_PERIOD = 0.5; // Send updated priorities for in-flight resources to the server this often, as the camera moves.
+
+	InFlightDownloadMap in_flight; // Map from request id to download
+	uint32 next_request_id = 0;
+	double last_priority_update_time = Clock::getCurTimeRealSec();
+	js::Vector<uint8, 16> temp_buf;
+	SocketBufferOutStream msg_buf(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+	try
+	{
+		while(1)
+		{
+			if(should_die || checkMessageQueue(getMessageQueue()))
+			{
+				abortInFlightDownloads(in_flight, *resource_manager, num_resources_downloading);
+				socket->writeUInt32(Protocol::CyberspaceGoodbye);
+				socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the server.
+				return;
+			}
+
+			//----------------------- Request more resources if we have room -----------------------
+			if(in_flight.size() < MAX_NUM_IN_FLIGHT)
+			{
+				// If nothing is in flight, wait until we have something to download.
+				download_queue->dequeueItemsWithTimeOut(/*wait_time_s=*/in_flight.empty() ? 0.1 : 0.0, /*max_num_items=*/MAX_NUM_IN_FLIGHT - in_flight.size(), queue_items);
+				if(!queue_items.empty())
+				{
+					const Vec3d campos = download_queue->getLastSortCamPos();
+					msg_buf.buf.clear();
+					for(size_t i=0; i<queue_items.size(); ++i)
+					{
+						const std::string& URL = queue_items[i].URL;
+						if(resource_manager->isInDownloadFailedURLs(URL)) // Don't try to re-download if we already failed to download this session.
+							continue;
+
+						ResourceRef resource = resource_manager->getOrCreateResourceForURL(URL);
+						if(resource->getState() != Resource::State_NotPresent) // If we already have the file or are downloading it:
+							continue;
+						resource->setState(Resource::State_Transferring);
+
+						Reference<InFlightDownload> download = new InFlightDownload();
+						download->URL = URL;
+						download->resource = resource;
+						download->path = resource_manager->getLocalAbsPathForResource(*resource);
+						download->partial_path = download->path + ".part";
+						download->pos_info = queue_items[i].pos_info;
+						download->priority = DownloadingResourceQueue::computePriority(download->pos_info, campos);
+
+						// If we have part of the file from an interrupted download, just request the rest of it.
+						uint64 start_offset = 0;
+						try
+						{
+							if(FileUtils::fileExists(download->partial_path))
+								start_offset = FileUtils::getFileSize(download->partial_path);
+						}
+						catch(glare::Exception&)
+						{}
+
+						const uint32 request_id = next_request_id++;
+						msg_buf.writeUInt32(Protocol::RequestResource);
+						msg_buf.writeUInt32(request_id);
+						msg_buf.writeStringLengthFirst(URL);
+						msg_buf.writeUInt64(start_offset);
+						msg_buf.writeFloat(download->priority);
+
+						in_flight[request_id] = download;
+						(*this->num_resources_downloading)++;
+					}
+
+					if(!msg_buf.buf.empty())
+						socket->writeData(msg_buf.buf.data(), msg_buf.buf.size());
+				}
+			}
+
+			//----------------------- Update priorities of in-flight resources -----------------------
+			const double cur_time = Clock::getCurTimeRealSec();
+			if(!in_flight.empty() && (cur_time - last_priority_update_time > PRIORITY_UPDATE_PERIOD))
+			{
+				last_priority_update_time = cur_time;
+
+				const Vec3d campos = download_queue->getLastSortCamPos();
+				msg_buf.buf.clear();
+				for(auto it = in_flight.begin(); it != in_flight.end(); )
+				{
+					InFlightDownload* download = it->second.ptr();
+					if(download->resource->getState() == Resource::State_Present) // If the resource was made present some other way (e.g. the user uploaded it), cancel the download.
+					{
+						msg_buf.writeUInt32(Protocol::CancelResourceRequest);
+						msg_buf.writeUInt32(it->first);
+
+						deletePartialFile(download);
+
+						(*this->num_resources_downloading)--;
+						it = in_flight.erase(it);
+						continue;
+					}
+
+					const float new_priority = DownloadingResourceQueue::computePriority(download->pos_info, campos);
+					if(std::fabs(new_priority - download->priority) > 0.05f * std::fabs(download->priority)) // Only send significant changes.
+					{
+						msg_buf.writeUInt32(Protocol::UpdateResourcePriority);
+						msg_buf.writeUInt32(it->first);
+						msg_buf.writeFloat(new_priority);
+						download->priority = new_priority;
+					}
+					++it;
+				}
+
+				if(!msg_buf.buf.empty())
+					socket->writeData(msg_buf.buf.data(), msg_buf.buf.size());
+			}
+
+			//----------------------- Read resource data from the server -----------------------
+			if(in_flight.empty() || !socket->readable(/*timeout (s)=*/0.05)) // Use a timeout so we can request more resources and check should_die occasionally.
+				continue;
+
+			const uint32 msg_type = socket->readUInt32();
+			InFlightDownload* completed_download = NULL;
+			uint32 completed_request_id = 0;
+			if(msg_type == Protocol::ResourceHeader)
+			{
+				const uint32 request_id = socket->readUInt32();
+				const uint32 result = socket->readUInt32();
+				const uint64 file_size = socket->readUInt64();
+				const uint64 start_offset = socket->readUInt64();
+
+				auto res = in_flight.find(request_id);
+				if(res == in_flight.end()) // Request was cancelled.
+					continue;
+				InFlightDownload* download = res->second.ptr();
+
+				if(result != 0)
+				{
+					resource_manager->addToDownloadFailedURLs(download->URL);
+					download->resource->setState(Resource::State_NotPresent);
+					out_msg_queue->enqueue(new LogMessage("Server couldn't send resource '" + download->URL + "' (resource not found)"));
+
+					(*this->num_resources_downloading)--;
+					in_flight.erase(res);
+					continue;
+				}
+
+				if(file_size > MAX_FILE_SIZE)
+					throw glare::Exception("downloaded file too large (len=" + toString(file_size) + ").");
+				if(start_offset > file_size)
+					throw glare::Exception("Invalid start offset from server.");
+
+				download->header_received = true;
+				download->file_size = file_size;
+				download->num_bytes_received = start_offset;
+				try
+				{
+					// If the server is not resuming from the offset we asked for, it will send the whole file.
+					download->file = new FileOutStream(download->partial_path, std::ios::binary | ((start_offset > 0) ? std::ios::app : std::ios::trunc));
+				}
+				catch(glare::Exception& e)
+				{
+					out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while writing file to disk: " + e.what()));
+					deletePartialFile(download); // Remaining chunks will be discarded.
+				}
+
+				completed_download = download;
+				completed_request_id = request_id;
+			}
+			else if(msg_type == Protocol::ResourceChunk)
+			{
+				const uint32 request_id = socket->readUInt32();
+				const uint32 chunk_size = socket->readUInt32();
+				if(chunk_size > MAX_CHUNK_SIZE)
+					throw glare::Exception("Invalid chunk size from server: " + toString(chunk_size));
+
+				temp_buf.resizeNoCopy(chunk_size);
+				socket->readData(temp_buf.data(), chunk_size);
+
+				auto res = in_flight.find(request_id);
+				if(res == in_flight.end()) // Request was cancelled.
+					continue;
+				InFlightDownload* download = res->second.ptr();
+
+				if(!download->header_received || (download->num_bytes_received + chunk_size > download->file_size))
+					throw glare::Exception("Invalid chunk from server.");
+
+				if(download->file)
+				{
+					try
+					{
+						download->file->writeData(temp_buf.data(), chunk_size);
+					}
+					catch(glare::Exception& e)
+					{
+						out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while writing file to disk: " + e.what()));
+						deletePartialFile(download); // Remaining chunks will be discarded.
+					}
+				}
+
+				download->num_bytes_received += chunk_size;
+
+				completed_download = download;
+				completed_request_id = request_id;
+			}
+			else
+				throw glare::Exception("Unexpected message type from server: " + toString(msg_type));
+
+			//----------------------- Finish download if we have received the whole file -----------------------
+			if(completed_download && (completed_download->num_bytes_received == completed_download->file_size))
+			{
+				bool succeeded = false;
+				if(completed_download->file)
+				{
+					try
+					{
+						completed_download->file->close(); // Manually call close, to check for any errors via failbit.
+						delete completed_download->file;
+						completed_download->file = NULL;
+
+						FileUtils::moveFile(completed_download->partial_path, completed_download->path);
+						succeeded = true;
+					}
+					catch(glare::Exception& e)
+					{
+						out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while writing file to disk: " + e.what()));
+						deletePartialFile(completed_download);
+					}
+				}
+
+				completed_download->resource->setState(succeeded ? Resource::State_Present : Resource::State_NotPresent);
+				resource_manager->markResourceAsChanged(completed_download->resource);
+				if(succeeded)
+					out_msg_queue->enqueue(new ResourceDownloadedMessage(completed_download->URL));
+
+				(*this->num_resources_downloading)--;
+				in_flight.erase(completed_request_id);
+			}
+		}
+	}
+	catch(glare::Exception&)
+	{
+		abortInFlightDownloads(in_flight, *resource_manager, num_resources_downloading);
+		throw;
+	}
+}
+
+
 void DownloadResourcesThread::doRun()
 {
 #if !EMSCRIPTEN // Emscripten uses EmscriptenResourceDownloader instead.
@@ -130,7 +433,6 @@ void DownloadResourcesThread::doRun()
 
 		socket->writeUInt32(Protocol::CyberspaceHello); // Write hello
 		socket->writeUInt32(Protocol::CyberspaceProtocolVersion); // Write protocol version
-		socket->writeUInt32(Protocol::ConnectionTypeDownloadResources); // Write connection type
 
 		// Read hello response from server
 		const uint32 hello_response = socket->readUInt32();
@@ -152,7 +454,17 @@ void DownloadResourcesThread::doRun()
 			throw glare::Exception("Invalid protocol version response from server: " + toString(protocol_response));
 
 		// Read server protocol version
-		/*const uint32 server_protocol_version =*/ socket->readUInt32();
+		const uint32 server_protocol_version = socket->readUInt32();
+
+		// The server reads the connection type after sending its protocol version, so we can choose the connection type based on the server version.
+		if(server_protocol_version >= 40) // ConnectionTypeDownloadResourcesMultiplexed was introduced in protocol version 40.
+		{
+			socket->writeUInt32(Protocol::ConnectionTypeDownloadResourcesMultiplexed); // Write connection type
+			doMultiplexedDownloads();
+			return;
+		}
+
+		socket->writeUInt32(Protocol::ConnectionTypeDownloadResources); // Write connection type
 
 		std::set<std::string> URLs_to_get; // Set of URLs that this thread will get from the server.
 
@@ -265,14 +577,14 @@ void DownloadResourcesThread::doRun()
 									} // End scope for FileOutStream
 
 									resource->setState(Resource::State_Present);
-									resource_manager->markAsChanged();
+									resource_manager->markResourceAsChanged(resource);
 
 									out_msg_queue->enqueue(new ResourceDownloadedMessage(URL));
 								}
 								catch(glare::Exception& e)
 								{
 									resource->setState(Resource::State_NotPresent);
-									resource_manager->markAsChanged();
+									resource_manager->markResourceAsChanged(resource);
 
 									//conPrint("DownloadResourcesThread: Error while writing file to disk: " + e.what());
 									out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while writing file to disk: " + e.what()));
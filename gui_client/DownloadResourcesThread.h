@@ -56,6 +56,8 @@ public:
 	void killConnection();
 
 private:
+	void doMultiplexedDownloads();
+
 	ThreadSafeQueue<Reference<ThreadMessage> >* out_msg_queue;
 	Reference<ResourceManager> resource_manager;
 	std::string hostname;
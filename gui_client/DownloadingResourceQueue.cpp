@@ -14,7 +14,8 @@ Copyright Glare Technologies Limited 2024 -
 
 
 DownloadingResourceQueue::DownloadingResourceQueue()
-:	begin_i(0)
+:	begin_i(0),
+	last_sort_campos(0.0)
 {}
 
 
@@ -81,6 +82,32 @@ struct QueueItemDistComparator
 };
 
 
+static inline float computePriorityForCamPos(const SmallVector<DownloadQueuePosInfo, 4>& pos_info, const Vec4f& campos_zero_w)
+{
+	assert(pos_info.size() >= 1);
+	float smallest_priority = campos_zero_w.getDist(maskWToZero(loadUnalignedVec4f(&pos_info[0].pos.x))) * pos_info[0].size_factor;
+	for(size_t z=1; z<pos_info.size(); ++z)
+	{
+		const float pos_info_z_priority = campos_zero_w.getDist(maskWToZero(loadUnalignedVec4f(&pos_info[z].pos.x))) * pos_info[z].size_factor;
+		smallest_priority = myMin(smallest_priority, pos_info_z_priority);
+	}
+	return smallest_priority;
+}
+
+
+float DownloadingResourceQueue::computePriority(const SmallVector<DownloadQueuePosInfo, 4>& pos_info, const Vec3d& campos)
+{
+	return computePriorityForCamPos(pos_info, Vec4f((float)campos.x, (float)campos.y, (float)campos.z, 0.f));
+}
+
+
+Vec3d DownloadingResourceQueue::getLastSortCamPos() const
+{
+	Lock lock(mutex);
+	return last_sort_campos;
+}
+
+
 void DownloadingResourceQueue::sortQueue(const Vec3d& campos_) // Sort queue
 {
 	// Sort download list by distance from camera
@@ -91,23 +118,14 @@ void DownloadingResourceQueue::sortQueue(const Vec3d& campos_) // Sort queue
 
 		Timer timer;
 
+		last_sort_campos = campos_;
+
 		QueueItemDistComparator comparator;
 
 		// Do pass over queue items to compute priority, store and use that for sorting.
 		const size_t items_size = items.size();
 		for(size_t i = begin_i; i < items_size; ++i)
-		{
-			const SmallVector<DownloadQueuePosInfo, 4>& pos_info = items[i]->pos_info;
-			assert(pos_info.size() >= 1);
-			float smallest_priority = campos_zero_w.getDist(maskWToZero(loadUnalignedVec4f(&pos_info[0].pos.x))) * pos_info[0].size_factor;
-			for(size_t z=1; z<pos_info.size(); ++z)
-			{
-				const float pos_info_z_priority = campos_zero_w.getDist(maskWToZero(loadUnalignedVec4f(&pos_info[z].pos.x))) * pos_info[z].size_factor;
-				smallest_priority = myMin(smallest_priority, pos_info_z_priority);
-			}
-
-			items[i]->priority = smallest_priority;
-		}
+			items[i]->priority = computePriorityForCamPos(items[i]->pos_info, campos_zero_w);
 
 		std::sort(items.begin() + begin_i, items.end(), comparator);
 
@@ -68,6 +68,11 @@ public:
 
 	void sortQueue(const Vec3d& campos); // Sort queue (approximately by item distance to camera)
 
+	Vec3d getLastSortCamPos() const; // Camera position passed to the last sortQueue() call.
+
+	// Lower values should be downloaded first.
+	static float computePriority(const SmallVector<DownloadQueuePosInfo, 4>& pos_info, const Vec3d& campos);
+
 	void dequeueItemsWithTimeOut(double wait_time_s, size_t max_num_items, std::vector<DownloadQueueItem>& items_out); // Blocks for up to wait_time_s
 
 	bool tryDequeueItem(DownloadQueueItem& item_out);
@@ -76,6 +81,7 @@ private:
 	mutable Mutex mutex;
 	Condition nonempty;
 	size_t begin_i										GUARDED_BY(mutex);
+	Vec3d last_sort_campos								GUARDED_BY(mutex);
 	js::Vector<DownloadQueueItem*, 16> items			GUARDED_BY(mutex);
 	std::unordered_map<std::string, DownloadQueueItem*> item_URL_map	GUARDED_BY(mutex); // Map from item URL to pointer to DownloadQueueItem in items.
 };
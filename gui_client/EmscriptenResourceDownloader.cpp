@@ -113,7 +113,7 @@ void EmscriptenResourceDownloader::onResourceLoad(Reference<CurrentlyDownloading
 		resource->file_size_B = 0;
 	}
 
-	resource_manager->markAsChanged();
+	resource_manager->markResourceAsChanged(resource);
 
 	out_msg_queue->enqueue(new ResourceDownloadedMessage(downloading_resource->URL)); // Send message back to GUIClient
 }
@@ -24,12 +24,15 @@ Copyright Glare Technologies Limited 2024 -
 #include "URLWhitelist.h"
 #include "URLParser.h"
 #include "LoadModelTask.h"
+#include "PhysicsShapeCache.h"
+#include "TextureDataCache.h"
 #include "BuildScatteringInfoTask.h"
 #include "LoadTextureTask.h"
 #include "LoadAudioTask.h"
 #include "../audio/MicReadThread.h"
 #include "MakeHypercardTextureTask.h"
 #include "SaveResourcesDBThread.h"
+#include "ResourceCacheEvictorThread.h"
 #include "BiomeManager.h"
 #include "WebViewData.h"
 #include "BrowserVidPlayer.h"
@@ -155,6 +158,8 @@ GUIClient::GUIClient(const std::string& base_dir_path_, const std::string& appda
 	url_parcel_uid(-1),
 	running_destructor(false),
 	biome_manager(NULL),
+	resource_access_update_in_progress(false),
+	resource_access_update_ob_i(0),
 	scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder),
 	frame_num(0),
 	axis_and_rot_obs_enabled(false),
@@ -310,6 +315,33 @@ void GUIClient::initialise(const std::string& cache_dir, SettingsStore* settings
 #if !defined(EMSCRIPTEN)
 	// With Emscripten we use an ephemeral virtual file system, so no point in saving resource manager state to it.
 	save_resources_db_thread_manager.addThread(new SaveResourcesDBThread(resource_manager, resources_db_path));
+
+	try
+	{
+		physics_shape_cache = new PhysicsShapeCache(cache_dir + "/physics_shapes");
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("WARNING: failed to create physics shape cache: " + e.what());
+	}
+
+	try
+	{
+		texture_data_cache = new TextureDataCache(cache_dir + "/texture_data");
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("WARNING: failed to create texture data cache: " + e.what());
+	}
+
+	// The texture data and physics shape caches are derived from resources, so give them a budget proportional to the resource budget.
+	const double max_resource_cache_size_GB = settings->getDoubleValue("setting/max_resource_cache_size_GB", /*default val=*/20.0);
+	if(max_resource_cache_size_GB > 0)
+	{
+		const uint64 max_resource_cache_size_B = (uint64)(max_resource_cache_size_GB * (1024.0 * 1024.0 * 1024.0));
+		save_resources_db_thread_manager.addThread(new ResourceCacheEvictorThread(resource_manager, resources_db_path, max_resource_cache_size_B,
+			texture_data_cache, /*max texture data cache size B=*/max_resource_cache_size_B / 4, physics_shape_cache, /*max physics shape cache size B=*/max_resource_cache_size_B / 16));
+	}
 #endif
 
 
@@ -1000,6 +1032,7 @@ void GUIClient::startLoadingTextureForLocalPath(const std::string& local_abs_tex
 			const bool used_by_terrain = this->terrain_system.nonNull() && this->terrain_system->isTextureUsedByTerrain(local_abs_tex_path);
 
 			Reference<LoadTextureTask> task = new LoadTextureTask(opengl_engine, resource_manager, &this->msg_queue, local_abs_tex_path, resource, tex_params, used_by_terrain);
+			task->texture_data_cache = texture_data_cache;
 
 			load_item_queue.enqueueItem(
 				resource->URL, // key
@@ -2082,7 +2115,7 @@ void GUIClient::loadModelForObject(WorldObject* ob, WorldStateLock& world_state_
 				ob->loading_or_loaded_model_lod_level = ob_model_lod_level;
 
 				bool added_opengl_ob = false;
-				const std::string lod_model_url = WorldObject::getLODModelURLForLevel(ob->model_url, ob_model_lod_level);
+				const std::string lod_model_url = ob->getModelURLForModelLODLevel(ob_model_lod_level); // Uses the optimised model made by the server for level 0, if there is one.
 
 				// print("Loading model for ob: UID: " + ob->uid.toString() + ", type: " + WorldObject::objectTypeString((WorldObject::ObjectType)ob->object_type) + ", lod_model_url: " + lod_model_url);
 
@@ -2114,6 +2147,7 @@ void GUIClient::loadModelForObject(WorldObject* ob, WorldStateLock& world_state_
 							load_model_task->unit_cube_shape = this->unit_cube_shape;
 							load_model_task->result_msg_queue = &this->msg_queue;
 							load_model_task->resource_manager = resource_manager;
+							load_model_task->physics_shape_cache = physics_shape_cache;
 							load_model_task->build_dynamic_physics_ob = ob->isDynamic();
 
 							load_item_queue.enqueueItem(/*key=*/lod_model_url, *ob, load_model_task, max_dist_for_ob_model_lod_level);
@@ -2421,6 +2455,7 @@ void GUIClient::loadModelForAvatar(Avatar* avatar)
 					load_model_task->unit_cube_shape = this->unit_cube_shape;
 					load_model_task->result_msg_queue = &this->msg_queue;
 					load_model_task->resource_manager = resource_manager;
+					load_model_task->physics_shape_cache = physics_shape_cache;
 
 					load_item_queue.enqueueItem(/*key=*/lod_model_url, *avatar, load_model_task, max_dist_for_ob_model_lod_level, our_avatar);
 				}
@@ -3429,6 +3464,59 @@ void GUIClient::checkForLODChanges()
 }
 
 
+bool GUIClient::markInUseResourcesAccessed()
+{
+	if(world_state.isNull())
+	{
+		resource_access_update_ob_i = 0;
+		resource_access_update_URLs.clear();
+		return true;
+	}
+
+	// Process just some of the objects each call, so we don't hold the world state lock for long in large worlds.
+	const size_t MAX_NUM_OBS_PER_CALL = 1000;
+	bool pass_done;
+	{
+		WorldStateLock lock(this->world_state->mutex);
+
+		// Objects may have been added or removed since the last call, in which case some objects may be missed this pass.  They will be processed next pass.
+		glare::FastIterMapValueInfo<UID, WorldObjectRef>* const objects_data = this->world_state->objects.vector.data();
+		const size_t objects_size                                            = this->world_state->objects.vector.size();
+		const size_t end_i = myMin(objects_size, resource_access_update_ob_i + MAX_NUM_OBS_PER_CALL);
+		for(size_t i=resource_access_update_ob_i; i<end_i; ++i)
+			objects_data[i].value->appendDependencyURLsForAllLODLevels(resource_access_update_URLs);
+		resource_access_update_ob_i = end_i;
+
+		pass_done = end_i == objects_size;
+		if(pass_done)
+		{
+			for(auto it = this->world_state->avatars.begin(); it != this->world_state->avatars.end(); ++it)
+				it->second->appendDependencyURLsForAllLODLevels(resource_access_update_URLs);
+		}
+	}
+
+	if(!pass_done)
+		return false;
+
+	// Terrain heightmaps, masks and detail maps
+	std::set<DependencyURL> world_settings_URLs;
+	connected_world_settings.getDependencyURLSet(world_settings_URLs);
+
+	std::vector<std::string> URLs;
+	URLs.reserve(resource_access_update_URLs.size() + world_settings_URLs.size());
+	for(size_t i=0; i<resource_access_update_URLs.size(); ++i)
+		URLs.push_back(resource_access_update_URLs[i].URL);
+	for(auto it = world_settings_URLs.begin(); it != world_settings_URLs.end(); ++it)
+		URLs.push_back(it->URL);
+
+	resource_manager->markResourcesAccessed(URLs, (uint64)Clock::getSecsSince1970());
+
+	resource_access_update_ob_i = 0;
+	resource_access_update_URLs.clear();
+	return true;
+}
+
+
 void GUIClient::checkForAudioRangeChanges()
 {
 	ZoneScoped; // Tracy profiler
@@ -4258,18 +4346,13 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 				{
 					script_evaluator->doOnTimerEvent(timer.onTimerEvent_ref, lock); // Execute the Lua timer event callback function
 
-					if(timer.repeating)
-					{
-						// Re-insert timer with updated trigger time
-						timer.tigger_time = cur_time + timer.period;
-						timer_queue.addTimer(cur_time, timer);
-					}
-					else // Else if timer was a one-shot timer, 'destroy' it.
-					{
+					// Repeating timers are re-added by TimerQueue::update().  If timer was a one-shot timer, 'destroy' it (unless the callback already did so).
+					if(!timer.repeating && (timer.timer_id == script_evaluator->timers[timer.timer_index].id))
 						script_evaluator->destroyTimer(timer.timer_index);
-					}
 				}
 			}
+			else // Else script evaluator has been destroyed, remove any repeating timer from the queue.
+				timer_queue.removeTimer(timer.queue_handle);
 		}
 	}
 
@@ -4447,6 +4530,16 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 
 	checkForLODChanges();
 
+#if !defined(EMSCRIPTEN)
+	// Update the access time of resources in use every now and then, so ResourceCacheEvictorThread doesn't evict them.
+	// Each pass is spread over multiple frames.
+	if(resource_access_update_in_progress || (resource_access_update_timer.elapsed() > 60.0))
+	{
+		resource_access_update_in_progress = !markInUseResourcesAccessed();
+		if(!resource_access_update_in_progress)
+			resource_access_update_timer.reset();
+	}
+#endif
 
 	
 	gesture_ui.think();
@@ -6007,6 +6100,7 @@ void GUIClient::updateParcelGraphics()
 						parcel->physics_object = NULL;
 					}
 
+					this->world_state->parcel_index.remove(parcel->id);
 					this->world_state->parcels.erase(parcel->id);
 				}
 				else
@@ -7640,8 +7734,9 @@ void GUIClient::handleMessages(double global_time, double cur_time)
 							const bool just_added = checkAddTextureToProcessingSet(tex_path); // If not being loaded already:
 							if(just_added)
 							{
-								load_item_queue.enqueueItem(/*key=*/URL, pos.toVec4fPoint(), size_factor, 
-									new LoadTextureTask(opengl_engine, resource_manager, &this->msg_queue, tex_path, resource, texture_params, used_by_terrain),
+								Reference<LoadTextureTask> task = new LoadTextureTask(opengl_engine, resource_manager, &this->msg_queue, tex_path, resource, texture_params, used_by_terrain);
+								task->texture_data_cache = texture_data_cache;
+								load_item_queue.enqueueItem(/*key=*/URL, pos.toVec4fPoint(), size_factor, task,
 									/*max task dist=*/std::numeric_limits<float>::infinity()); // NOTE: inf dist is a bit of a hack.
 							}
 							else
@@ -7676,6 +7771,7 @@ void GUIClient::handleMessages(double global_time, double cur_time)
 							load_model_task->unit_cube_shape = this->unit_cube_shape;
 							load_model_task->result_msg_queue = &this->msg_queue;
 							load_model_task->resource_manager = resource_manager;
+							load_model_task->physics_shape_cache = physics_shape_cache;
 							load_model_task->build_physics_ob = build_physics_ob;
 							load_model_task->build_dynamic_physics_ob = build_dynamic_physics_ob;
 
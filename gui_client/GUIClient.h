@@ -70,6 +70,8 @@ class ClientThread;
 class MySocket;
 class LogWindow;
 class ResourceManager;
+class PhysicsShapeCache;
+class TextureDataCache;
 struct ID3D11Device;
 struct IMFDXGIDeviceManager;
 class SettingsStore;
@@ -236,6 +238,7 @@ public:
 	void dropSelectedObject();
 
 	void checkForLODChanges();
+	bool markInUseResourcesAccessed(); // Updates the last access time of resources used by objects, avatars and terrain, so they aren't evicted from the resource cache.  Returns true when a pass is complete.
 	void checkForAudioRangeChanges();
 
 	int mouseOverAxisArrowOrRotArc(const Vec2f& pixel_coords, Vec4f& closest_seg_point_ws_out); // Returns closest axis arrow or -1 if no close.
@@ -394,6 +397,8 @@ public:
 	ParcelRef selected_parcel;
 
 	Reference<ResourceManager> resource_manager;
+	Reference<PhysicsShapeCache> physics_shape_cache; // NULL with Emscripten.
+	Reference<TextureDataCache> texture_data_cache; // NULL with Emscripten.
 
 
 	// NOTE: these object sets need to be cleared in connectToServer(), also when removing a dead object in ob->state == WorldObject::State_Dead case in timerEvent, the object needs to be removed
@@ -571,6 +576,10 @@ public:
 
 	DownloadingResourceQueue download_queue;
 	Timer download_queue_sort_timer;
+	Timer resource_access_update_timer;
+	bool resource_access_update_in_progress;
+	size_t resource_access_update_ob_i; // Index into world_state->objects of the next object to process in the current markInUseResourcesAccessed() pass.
+	std::vector<DependencyURL> resource_access_update_URLs; // Dependency URLs collected so far in the current markInUseResourcesAccessed() pass.
 	Timer load_item_queue_sort_timer;
 
 	LoadItemQueue load_item_queue;
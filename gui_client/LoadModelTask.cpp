@@ -9,6 +9,7 @@ Copyright Glare Technologies Limited 2021 -
 #include "LoadTextureTask.h"
 #include "ThreadMessages.h"
 #include "ModelLoading.h"
+#include "PhysicsShapeCache.h"
 #include "../shared/ResourceManager.h"
 #include <indigo/TextureServer.h>
 #include <opengl/OpenGLEngine.h>
@@ -89,13 +90,26 @@ void LoadModelTask::run(size_t thread_index)
 			// conPrint("LoadModelTask: loading mesh with URL '" + lod_model_url + "'.");
 			const std::string lod_model_path = resource_manager->pathForURL(lod_model_url);
 
+			// Try and restore the physics shape from the cache, to avoid building it.
+			bool build_physics_shape = build_physics_ob;
+			uint64 shape_cache_key = 0;
+			if(build_physics_ob && physics_shape_cache.nonNull())
+			{
+				shape_cache_key = PhysicsShapeCache::keyForModel(lod_model_url, FileUtils::getFileSize(lod_model_path), build_dynamic_physics_ob);
+				if(physics_shape_cache->getShape(shape_cache_key, physics_shape))
+					build_physics_shape = false;
+			}
+
 			gl_meshdata = ModelLoading::makeGLMeshDataAndBatchedMeshForModelPath(lod_model_path,
 				/*vert_buf_allocator=*/NULL, 
 				true, // skip_opengl_calls - we need to do these on the main thread.
-				build_physics_ob,
+				build_physics_shape,
 				build_dynamic_physics_ob,
 				opengl_engine->mem_allocator.ptr(),
 				/*physics shape out=*/physics_shape);
+
+			if(build_physics_shape && physics_shape_cache.nonNull())
+				physics_shape_cache->addShape(shape_cache_key, physics_shape);
 		}
 
 		// Send a ModelLoadedThreadMessage back to main window.
@@ -17,6 +17,7 @@ Copyright Glare Technologies Limited 2021 -
 class OpenGLEngine;
 class MeshManager;
 class ResourceManager;
+class PhysicsShapeCache;
 
 
 class ModelLoadedThreadMessage : public ThreadMessage
@@ -47,6 +48,9 @@ Builds the OpenGL mesh and Physics mesh for it.
 Once it's done, sends a ModelLoadedThreadMessage back to the main window
 via result_msg_queue.
 
+If physics_shape_cache is set, the physics shape for a model is restored from
+the cache if present, and added to the cache after being built otherwise.
+
 Note for making the OpenGL Mesh, data isn't actually loaded into OpenGL in this task,
 since that needs to be done on the main thread.
 =====================================================================*/
@@ -69,5 +73,6 @@ public:
 	PhysicsShape unit_cube_shape;
 	Reference<OpenGLEngine> opengl_engine;
 	Reference<ResourceManager> resource_manager;
+	Reference<PhysicsShapeCache> physics_shape_cache; // May be NULL.
 	ThreadSafeQueue<Reference<ThreadMessage> >* result_msg_queue;
 };
@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2019 -
 
 
 #include "ThreadMessages.h"
+#include "TextureDataCache.h"
 #include "../shared/ImageDecoding.h"
 #include "../shared/ResourceManager.h"
 #include <indigo/TextureServer.h>
@@ -17,6 +18,7 @@ Copyright Glare Technologies Limited 2019 -
 #include <graphics/TextureProcessing.h>
 #include <opengl/OpenGLEngine.h>
 #include <opengl/TextureAllocator.h>
+#include <FileUtils.h>
 #include <ConPrint.h>
 #include <PlatformUtils.h>
 #include <IncludeHalf.h>
@@ -39,12 +41,29 @@ void LoadTextureTask::run(size_t thread_index)
 
 		const std::string& key = this->path;
 
+		// Compressed texture data for textures without a server-side KTX version (e.g. PNGs and JPEGs) may be in the texture data cache.
+		// Don't use the cache for terrain maps, since the uncompressed map is needed for them.
+		const bool use_tex_data_cache = texture_data_cache.nonNull() && !is_terrain_map && opengl_engine->textureCompressionSupportedAndEnabled() && tex_params.allow_compression &&
+			!hasExtension(key, "gif") && !hasExtension(key, "ktx") && !hasExtension(key, "ktx2");
+		uint64 tex_data_cache_key = 0;
+		bool loaded_from_tex_data_cache = false;
+
 		// Load texture from disk and decode it.
 		Reference<Map2D> map;
-		if(hasExtension(key, "gif"))
-			map = GIFDecoder::decodeImageSequence(key, opengl_engine->mem_allocator.ptr());
-		else
-			map = ImageDecoding::decodeImage(".", key, opengl_engine->mem_allocator.ptr());
+		if(use_tex_data_cache)
+		{
+			tex_data_cache_key = TextureDataCache::keyForTexture(key, FileUtils::getFileSize(key), tex_params.use_mipmaps);
+			map = texture_data_cache->getTexture(tex_data_cache_key, opengl_engine->mem_allocator.ptr());
+			loaded_from_tex_data_cache = map.nonNull();
+		}
+
+		if(!loaded_from_tex_data_cache)
+		{
+			if(hasExtension(key, "gif"))
+				map = GIFDecoder::decodeImageSequence(key, opengl_engine->mem_allocator.ptr());
+			else
+				map = ImageDecoding::decodeImage(".", key, opengl_engine->mem_allocator.ptr());
+		}
 
 #if USE_TEXTURE_VIEWS // NOTE: USE_TEXTURE_VIEWS is defined in opengl/TextureAllocator.h
 		// Resize for texture view
@@ -79,6 +98,12 @@ void LoadTextureTask::run(size_t thread_index)
 		const bool do_compression = opengl_engine->textureCompressionSupportedAndEnabled() && tex_params.allow_compression && OpenGLTexture::areTextureDimensionsValidForCompression(*map);
 		Reference<TextureData> texture_data = TextureProcessing::buildTextureData(map.ptr(), opengl_engine->mem_allocator.ptr(), opengl_engine->getMainTaskManager(), do_compression, /*build_mipmaps=*/tex_params.use_mipmaps);
 
+		// If we compressed an 8-bit image, add the result to the cache.
+		// Images that buildTextureData() doesn't DXT compress (e.g. 1 or 2 channel images) and multi-frame textures aren't cached.
+		if(use_tex_data_cache && !loaded_from_tex_data_cache && do_compression && map.isType<ImageMapUInt8>() &&
+			TextureDataCache::isCacheableTextureData(map->getMapWidth(), map->getMapHeight(), *texture_data))
+			texture_data_cache->addTexture(tex_data_cache_key, map->getMapWidth(), map->getMapHeight(), *texture_data);
+
 		if(hasExtension(key, "gif") && texture_data->totalCPUMemUsage() > 100000000)
 		{
 			conPrint("Large gif texture data: " + toString(texture_data->totalCPUMemUsage()) + " B, " + key);
@@ -17,6 +17,7 @@ class TextureServer;
 class TextureData;
 class Map2D;
 class ResourceManager;
+class TextureDataCache;
 
 
 class TextureLoadedThreadMessage : public ThreadMessage
@@ -34,7 +35,11 @@ public:
 /*=====================================================================
 LoadTextureTask
 ---------------
+Loads and decodes a texture, and builds the texture data for it
+(compressing and building mipmaps if needed) ready for uploading to the GPU.
 
+If texture_data_cache is set, compressed texture data for non-KTX textures
+is loaded from the cache if present, and added to the cache after being built otherwise.
 =====================================================================*/
 class LoadTextureTask : public glare::Task
 {
@@ -51,4 +56,5 @@ public:
 	ResourceRef resource;
 	TextureParams tex_params;
 	bool is_terrain_map;
+	Reference<TextureDataCache> texture_data_cache; // May be NULL.
 };
@@ -164,14 +164,14 @@ void NetDownloadResourcesThread::doRun()
 								if(VERBOSE) conPrint("NetDownloadResourcesThread: Wrote downloaded file to '" + path + "'. (len=" + toString(data.size()) + ") ");
 
 								resource->setState(Resource::State_Present);
-								resource_manager->markAsChanged();
+								resource_manager->markResourceAsChanged(resource);
 
 								out_msg_queue->enqueue(new ResourceDownloadedMessage(url));
 							}
 							catch(FileUtils::FileUtilsExcep& e)
 							{
 								resource->setState(Resource::State_NotPresent);
-								resource_manager->markAsChanged();
+								resource_manager->markResourceAsChanged(resource);
 								if(VERBOSE) conPrint("NetDownloadResourcesThread: Error while writing file to disk: " + e.what());
 							}
 						}
@@ -181,7 +181,7 @@ void NetDownloadResourcesThread::doRun()
 					catch(glare::Exception& e)
 					{
 						resource->setState(Resource::State_NotPresent);
-						resource_manager->markAsChanged();
+						resource_manager->markResourceAsChanged(resource);
 						if(VERBOSE) conPrint("NetDownloadResourcesThread: Error while downloading file: " + e.what());
 					}
 				}
@@ -0,0 +1,324 @@
+/*=====================================================================
+PhysicsShapeCache.cpp
+---------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "PhysicsShapeCache.h"
+
+
+#include "PhysicsWorld.h"
+#include <utils/FileUtils.h>
+#include <utils/StringUtils.h>
+#include <utils/Exception.h>
+#include <utils/ConPrint.h>
+#include <utils/Lock.h>
+#include <utils/BufferOutStream.h>
+#include <utils/BufferViewInStream.h>
+#include <utils/IncludeXXHash.h>
+#include <cstring>
+
+
+static const uint32 SHAPE_MAGIC_NUMBER = 0x50534331; // 'PSC1'
+static const uint32 CACHE_FORMAT_VERSION = 1; // Bump to invalidate existing cache entries, e.g. when Jolt is updated and the shape binary format changes.
+
+
+PhysicsShapeCache::PhysicsShapeCache(const std::string& cache_dir_)
+:	cache_dir(cache_dir_),
+	next_temp_file_id(0),
+	next_access_seq(0)
+{
+	std::memset(&stats, 0, sizeof(stats));
+
+	FileUtils::createDirIfDoesNotExist(cache_dir);
+}
+
+
+PhysicsShapeCache::~PhysicsShapeCache()
+{}
+
+
+uint64 PhysicsShapeCache::keyForModel(const std::string& model_URL, uint64 model_file_size, bool dynamic_physics_shape)
+{
+	const uint64 params[2] = { model_file_size, dynamic_physics_shape ? 1u : 0u };
+	return XXH64(params, sizeof(params), /*seed=*/XXH64(model_URL.data(), model_URL.size(), /*seed=*/1));
+}
+
+
+std::string PhysicsShapeCache::filenameForKey(uint64 key) const
+{
+	return "shape_v" + toString(CACHE_FORMAT_VERSION) + "_" + toHexString(key) + ".bin";
+}
+
+
+std::string PhysicsShapeCache::pathForKey(uint64 key) const
+{
+	return cache_dir + "/" + filenameForKey(key);
+}
+
+
+bool PhysicsShapeCache::getShape(uint64 key, PhysicsShape& shape_out)
+{
+	const std::string path = pathForKey(key);
+	bool hit = false;
+	try
+	{
+		if(FileUtils::fileExists(path))
+		{
+			std::vector<uint8> data;
+			FileUtils::readEntireFile(path, data);
+
+			BufferViewInStream stream(ArrayRef<uint8>(data.data(), data.size()));
+			if(stream.readUInt32() != SHAPE_MAGIC_NUMBER)
+				throw glare::Exception("Invalid magic number");
+
+			const uint64 shape_data_size = stream.readUInt64();
+			const uint64 checksum = stream.readUInt64();
+			if(shape_data_size != data.size() - stream.getReadIndex())
+				throw glare::Exception("Invalid shape data size");
+
+			// Check the checksum before deserialising, as Jolt doesn't check shape data for consistency.
+			const uint8* shape_data = data.data() + stream.getReadIndex();
+			if(XXH64(shape_data, shape_data_size, /*seed=*/1) != checksum)
+				throw glare::Exception("Checksum mismatch");
+
+			shape_out = PhysicsWorld::deserialiseJoltShape(shape_data, shape_data_size);
+			hit = true;
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("PhysicsShapeCache: Error while reading '" + path + "': " + e.what());
+	}
+
+	Lock lock(mutex);
+	if(hit)
+	{
+		stats.hits++;
+		noteAccessed(key);
+	}
+	else
+		stats.misses++;
+	return hit;
+}
+
+
+void PhysicsShapeCache::addShape(uint64 key, const PhysicsShape& shape)
+{
+	try
+	{
+		js::Vector<uint8, 16> shape_data;
+		PhysicsWorld::serialiseJoltShape(shape, shape_data);
+
+		BufferOutStream stream;
+		stream.writeUInt32(SHAPE_MAGIC_NUMBER);
+		stream.writeUInt64(shape_data.size());
+		stream.writeUInt64(XXH64(shape_data.data(), shape_data.size(), /*seed=*/1));
+		stream.writeData(shape_data.data(), shape_data.size());
+
+		uint64 temp_file_id;
+		{
+			Lock lock(mutex);
+			temp_file_id = next_temp_file_id++;
+			stats.num_added++;
+			noteAccessed(key);
+		}
+
+		const std::string path = pathForKey(key);
+		const std::string temp_path = path + "_tmp_" + toString(temp_file_id);
+		FileUtils::writeEntireFile(temp_path, (const char*)stream.buf.data(), stream.buf.size());
+		FileUtils::moveFile(temp_path, path); // Rename so other threads never see a partially written file.
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("PhysicsShapeCache: Error while adding shape: " + e.what());
+	}
+}
+
+
+PhysicsShapeCache::Stats PhysicsShapeCache::getStats()
+{
+	Lock lock(mutex);
+	return stats;
+}
+
+
+void PhysicsShapeCache::noteAccessed(uint64 key)
+{
+	last_access_seq[key] = next_access_seq++;
+}
+
+
+CacheDirEviction::Results PhysicsShapeCache::evictEntries(uint64 max_total_size_B)
+{
+	// List the files before taking the access sequence numbers, so that entries added in between aren't treated as unused.
+	const std::vector<std::string> filenames = FileUtils::getFilesInDir(cache_dir);
+
+	std::unordered_map<std::string, uint64> access_seqs;
+	{
+		Lock lock(mutex);
+		access_seqs.reserve(last_access_seq.size());
+		for(auto it = last_access_seq.begin(); it != last_access_seq.end(); ++it)
+			access_seqs[filenameForKey(it->first)] = it->second;
+	}
+
+	// Files are deleted without holding the mutex, so load tasks aren't blocked.
+	return CacheDirEviction::evictFiles(cache_dir, filenames, access_seqs, max_total_size_B);
+}
+
+
+#if BUILD_TESTS
+
+
+#include "../graphics/BatchedMesh.h"
+#include "../graphics/FormatDecoderGLTF.h"
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+#include <utils/Timer.h>
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/Collision/Shape/Shape.h>
+
+
+static void checkShapesEqual(const PhysicsShape& a, const PhysicsShape& b)
+{
+	testAssert(a.jolt_shape->GetSubType() == b.jolt_shape->GetSubType());
+	testAssert(a.size_B == b.size_B);
+
+	const JPH::AABox a_bounds = a.jolt_shape->GetLocalBounds();
+	const JPH::AABox b_bounds = b.jolt_shape->GetLocalBounds();
+	testAssert(a_bounds.mMin == b_bounds.mMin && a_bounds.mMax == b_bounds.mMax);
+
+	JPH::Shape::VisitedShapes visited_a, visited_b;
+	testAssert(a.jolt_shape->GetStatsRecursive(visited_a).mNumTriangles == b.jolt_shape->GetStatsRecursive(visited_b).mNumTriangles);
+}
+
+
+void PhysicsShapeCache::test()
+{
+	conPrint("PhysicsShapeCache::test()");
+
+	const std::string cache_dir = PlatformUtils::getTempDirPath() + "/physics_shape_cache_test";
+	FileUtils::createDirIfDoesNotExist(cache_dir);
+
+	// Clear out any files from previous test runs.
+	{
+		const std::vector<std::string> paths = FileUtils::getFilesInDirWithExtensionFullPaths(cache_dir, "bin");
+		for(size_t i=0; i<paths.size(); ++i)
+			FileUtils::deleteFile(paths[i]);
+	}
+
+	try
+	{
+		testAssert(keyForModel("a.bmesh", 100, false) != keyForModel("a.bmesh", 100, true));
+		testAssert(keyForModel("a.bmesh", 100, false) != keyForModel("a.bmesh", 101, false));
+		testAssert(keyForModel("a.bmesh", 100, false) != keyForModel("b.bmesh", 100, false));
+
+		PhysicsShapeCache cache(cache_dir);
+
+		const std::string model_paths[] = {
+			TestUtils::getTestReposDir() + "/testfiles/gltf/2CylinderEngine.glb",
+			TestUtils::getTestReposDir() + "/testfiles/gltf/concept_bike.glb"
+		};
+
+		for(size_t i=0; i<staticArrayNumElems(model_paths); ++i)
+		{
+			GLTFLoadedData gltf_data;
+			BatchedMeshRef mesh = FormatDecoderGLTF::loadGLBFile(model_paths[i], gltf_data);
+			mesh->checkValidAndSanitiseMesh();
+
+			for(int dynamic=0; dynamic<2; ++dynamic)
+			{
+				const uint64 key = keyForModel(model_paths[i], FileUtils::getFileSize(model_paths[i]), dynamic != 0);
+
+				PhysicsShape shape;
+				testAssert(!cache.getShape(key, shape));
+
+				// Cold: build the shape from the mesh.
+				const int NUM_ITERS = 10;
+				double min_build_time = 1.0e10;
+				PhysicsShape built_shape;
+				for(int z=0; z<NUM_ITERS; ++z)
+				{
+					Timer timer;
+					built_shape = PhysicsWorld::createJoltShapeForBatchedMesh(*mesh, /*build_dynamic_physics_ob=*/dynamic != 0);
+					min_build_time = myMin(min_build_time, timer.elapsed());
+				}
+
+				cache.addShape(key, built_shape);
+
+				// Cached: restore the shape from the cache file.
+				double min_restore_time = 1.0e10;
+				PhysicsShape cached_shape;
+				for(int z=0; z<NUM_ITERS; ++z)
+				{
+					Timer timer;
+					testAssert(cache.getShape(key, cached_shape));
+					min_restore_time = myMin(min_restore_time, timer.elapsed());
+				}
+
+				checkShapesEqual(built_shape, cached_shape);
+
+				conPrint(FileUtils::getFilename(model_paths[i]) + (dynamic ? " (dynamic)" : " (static)") + ": build: " + doubleToStringNSigFigs(min_build_time * 1.0e3, 4) + " ms, restore from cache: " +
+					doubleToStringNSigFigs(min_restore_time * 1.0e3, 4) + " ms, speedup: " + doubleToStringNSigFigs(min_build_time / min_restore_time, 3) + "x");
+			}
+		}
+
+		// Test that a corrupted cache file is treated as a miss.
+		{
+			const uint64 key = keyForModel(model_paths[0], FileUtils::getFileSize(model_paths[0]), /*dynamic=*/false);
+			const std::string path = cache.pathForKey(key);
+			std::vector<uint8> data;
+			FileUtils::readEntireFile(path, data);
+			data[data.size() / 2] ^= 0xFF;
+			FileUtils::writeEntireFile(path, (const char*)data.data(), data.size());
+
+			PhysicsShape shape;
+			testAssert(!cache.getShape(key, shape));
+
+			// Truncated file
+			data.resize(data.size() / 2);
+			FileUtils::writeEntireFile(path, (const char*)data.data(), data.size());
+			testAssert(!cache.getShape(key, shape));
+		}
+
+		// Test deserialising truncated shape data directly.
+		{
+			GLTFLoadedData gltf_data;
+			BatchedMeshRef mesh = FormatDecoderGLTF::loadGLBFile(model_paths[0], gltf_data);
+			PhysicsShape shape = PhysicsWorld::createJoltShapeForBatchedMesh(*mesh, /*build_dynamic_physics_ob=*/false);
+
+			js::Vector<uint8, 16> shape_data;
+			PhysicsWorld::serialiseJoltShape(shape, shape_data);
+			for(size_t len=0; len<shape_data.size(); len += myMax<size_t>(1, shape_data.size() / 64))
+			{
+				try
+				{
+					PhysicsWorld::deserialiseJoltShape(shape_data.data(), len);
+					failTest("Expected exception");
+				}
+				catch(glare::Exception&)
+				{}
+			}
+		}
+
+		testAssert(cache.getStats().num_added == 4);
+
+		// Test eviction: the most recently accessed entry should be kept.
+		{
+			const uint64 key = keyForModel(model_paths[1], FileUtils::getFileSize(model_paths[1]), /*dynamic=*/false);
+			PhysicsShape shape;
+			testAssert(cache.getShape(key, shape));
+			const CacheDirEviction::Results results = cache.evictEntries(/*max total size B=*/FileUtils::getFileSize(cache.pathForKey(key)));
+			testAssert(results.num_evicted == 3);
+			testAssert(cache.getShape(key, shape));
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("PhysicsShapeCache::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,75 @@
+/*=====================================================================
+PhysicsShapeCache.h
+-------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "PhysicsObject.h"
+#include "CacheDirEviction.h"
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/Mutex.h>
+#include <utils/Platform.h>
+#include <string>
+#include <unordered_map>
+
+
+/*=====================================================================
+PhysicsShapeCache
+-----------------
+Persistent on-disk cache of built ('cooked') Jolt physics shapes for models,
+so that LoadModelTask doesn't have to rebuild the mesh shape BVH (or convex hull)
+each time a model is loaded.
+
+Entries are keyed by a hash of the model URL, model file size, and whether a
+dynamic (convex hull) or static (mesh) shape was built.
+Each entry is a single file, containing the serialised shape
+(see PhysicsWorld::serialiseJoltShape()) and a checksum, so a shape is restored
+with a single file read.
+
+Entries are written to a temp file then renamed, so concurrent load tasks
+can share the cache.  Threadsafe.
+
+The cache dir is size-limited by ResourceCacheEvictorThread calling evictEntries().
+=====================================================================*/
+class PhysicsShapeCache : public ThreadSafeRefCounted
+{
+public:
+	PhysicsShapeCache(const std::string& cache_dir);
+	~PhysicsShapeCache();
+
+	static uint64 keyForModel(const std::string& model_URL, uint64 model_file_size, bool dynamic_physics_shape);
+
+	// Returns false if not in cache, or the cache entry is invalid.
+	bool getShape(uint64 key, PhysicsShape& shape_out);
+
+	// Errors are logged and otherwise ignored.
+	void addShape(uint64 key, const PhysicsShape& shape);
+
+	struct Stats
+	{
+		size_t hits, misses, num_added;
+	};
+	Stats getStats();
+
+	// Deletes least recently used entries until the total size of the cache dir is <= max_total_size_B.
+	CacheDirEviction::Results evictEntries(uint64 max_total_size_B);
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(PhysicsShapeCache);
+
+	std::string filenameForKey(uint64 key) const;
+	std::string pathForKey(uint64 key) const;
+	void noteAccessed(uint64 key) REQUIRES(mutex);
+
+	std::string cache_dir;
+
+	Mutex mutex;
+	uint64 next_temp_file_id GUARDED_BY(mutex);
+	Stats stats GUARDED_BY(mutex);
+	uint64 next_access_seq GUARDED_BY(mutex);
+	std::unordered_map<uint64, uint64> last_access_seq GUARDED_BY(mutex); // Map from key to access sequence number, for entries accessed this session.
+};
@@ -1097,6 +1097,129 @@ PhysicsShape PhysicsWorld::createJoltShapeForBatchedMesh(const BatchedMesh& mesh
 }
 
 
+// Appends to a js::Vector, for serialising shapes.
+class VectorJoltStreamOut : public JPH::StreamOut
+{
+public:
+	VectorJoltStreamOut(js::Vector<uint8, 16>& data_) : data(data_) {}
+
+	virtual void WriteBytes(const void* inData, size_t inNumBytes) override
+	{
+		const size_t write_i = data.size();
+		data.resize(write_i + inNumBytes);
+		std::memcpy(data.data() + write_i, inData, inNumBytes);
+	}
+
+	virtual bool IsFailed() const override { return false; }
+
+	js::Vector<uint8, 16>& data;
+};
+
+
+// Reads from a buffer, for deserialising shapes.
+// Jolt checks IsEOF() after reading the last shape data, so only return true once a read past the end has been attempted, like std::istream.
+class BufferJoltStreamIn : public JPH::StreamIn
+{
+public:
+	BufferJoltStreamIn(const uint8* data_, size_t size_) : data(data_), size(size_), offset(0), read_past_end(false) {}
+
+	virtual void ReadBytes(void* outData, size_t inNumBytes) override
+	{
+		if(inNumBytes > size - offset)
+		{
+			read_past_end = true;
+			std::memset(outData, 0, inNumBytes);
+			return;
+		}
+		std::memcpy(outData, data + offset, inNumBytes);
+		offset += inNumBytes;
+	}
+
+	virtual bool IsEOF() const override { return read_past_end; }
+	virtual bool IsFailed() const override { return read_past_end; }
+
+	const uint8* data;
+	size_t size;
+	size_t offset;
+	bool read_past_end;
+};
+
+
+static const uint32 NULL_MATERIAL_INDEX = 0xFFFFFFFFu;
+
+
+void PhysicsWorld::serialiseJoltShape(const PhysicsShape& shape, js::Vector<uint8, 16>& data_out)
+{
+	JPH::ShapeList sub_shapes;
+	shape.jolt_shape->SaveSubShapeState(sub_shapes);
+	if(!sub_shapes.empty())
+		throw glare::Exception("Serialising shapes with sub-shapes is not supported.");
+
+	data_out.clear();
+	VectorJoltStreamOut stream(data_out);
+
+	stream.Write((uint64)shape.size_B);
+
+	// SubstrataPhysicsMaterial is not registered with Jolt, so can't be saved with the shape.  Just save the material indices.
+	JPH::PhysicsMaterialList materials;
+	shape.jolt_shape->SaveMaterialState(materials);
+	stream.Write((uint32)materials.size());
+	for(size_t i=0; i<materials.size(); ++i)
+	{
+		const SubstrataPhysicsMaterial* mat = dynamic_cast<const SubstrataPhysicsMaterial*>(materials[i].GetPtr());
+		stream.Write(mat ? mat->index : NULL_MATERIAL_INDEX);
+	}
+
+	shape.jolt_shape->SaveBinaryState(stream);
+}
+
+
+PhysicsShape PhysicsWorld::deserialiseJoltShape(const uint8* data, size_t data_size)
+{
+	BufferJoltStreamIn stream(data, data_size);
+
+	uint64 size_B;
+	stream.Read(size_B);
+
+	uint32 num_materials;
+	stream.Read(num_materials);
+	if(stream.IsFailed() || num_materials > 32)
+		throw glare::Exception("Invalid num materials.");
+
+	JPH::PhysicsMaterialList materials(num_materials);
+	for(uint32 i=0; i<num_materials; ++i)
+	{
+		uint32 index;
+		stream.Read(index);
+		if(index != NULL_MATERIAL_INDEX)
+			materials[i] = new SubstrataPhysicsMaterial(index);
+	}
+
+	// Check the shape type before Jolt uses it to look up the shape constructor.
+	if(stream.offset >= data_size || data[stream.offset] >= JPH::NumSubShapeTypes)
+		throw glare::Exception("Invalid shape type.");
+	const JPH::EShapeSubType sub_type = (JPH::EShapeSubType)data[stream.offset];
+	if(sub_type != JPH::EShapeSubType::Mesh && sub_type != JPH::EShapeSubType::ConvexHull)
+		throw glare::Exception("Unsupported shape type.");
+	if((sub_type == JPH::EShapeSubType::ConvexHull) && (num_materials != 1))
+		throw glare::Exception("Invalid num materials for convex hull shape.");
+
+	JPH::Shape::ShapeResult result = JPH::Shape::sRestoreFromBinaryState(stream);
+	if(result.HasError())
+		throw glare::Exception(std::string("Error restoring Jolt shape: ") + result.GetError().c_str());
+	if(stream.offset != data_size)
+		throw glare::Exception("Unexpected data after shape.");
+
+	JPH::Ref<JPH::Shape> jolt_shape = result.Get();
+	jolt_shape->RestoreMaterialState(materials.data(), (JPH::uint)materials.size());
+
+	PhysicsShape shape;
+	shape.jolt_shape = jolt_shape;
+	shape.size_B = (size_t)size_B;
+	return shape;
+}
+
+
 PhysicsShape PhysicsWorld::createJoltHeightFieldShape(int vert_res, const Array2D<float>& heightfield, float quad_w)
 {
 	const int block_size = 4;
@@ -131,6 +131,12 @@ public:
 
 	static PhysicsShape createScaledAndTranslatedShapeForShape(const PhysicsShape& shape, const Vec3f& translation, const Vec3f& scale);
 
+	// Serialise a mesh or convex hull shape made by createJoltShapeForBatchedMesh() or createJoltShapeForIndigoMesh(), for PhysicsShapeCache.
+	// Throws glare::Exception if the shape has sub-shapes.
+	static void serialiseJoltShape(const PhysicsShape& shape, js::Vector<uint8, 16>& data_out);
+	// Throws glare::Exception if the data is invalid.
+	static PhysicsShape deserialiseJoltShape(const uint8* data, size_t data_size);
+
 	void think(double dt);
 
 #if USE_JOLT
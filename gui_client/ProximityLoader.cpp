@@ -10,7 +10,7 @@ Copyright Glare Technologies Limited 2021 -
 #include <HashMapInsertOnly2.h>
 
 
-static const float CELL_WIDTH = 200.f; // NOTE: has to be the same value as in WorkerThread.cpp
+static const float CELL_WIDTH = 200.f; // NOTE: has to be the same value as ServerObjectGrid::CELL_WIDTH in server/ServerObjectGrid.cpp
 static bool VERBOSE = false;
 
 
@@ -0,0 +1,93 @@
+/*=====================================================================
+ResourceCacheEvictorThread.cpp
+------------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ResourceCacheEvictorThread.h"
+
+
+#include "TextureDataCache.h"
+#include "PhysicsShapeCache.h"
+#include "../shared/ResourceManager.h"
+#include <ConPrint.h>
+#include <Exception.h>
+#include <PlatformUtils.h>
+#include <StringUtils.h>
+#include <Clock.h>
+#include <Timer.h>
+#include <KillThreadMessage.h>
+
+
+const uint64 ResourceCacheEvictorThread::MIN_ACCESS_AGE_S;
+
+
+ResourceCacheEvictorThread::ResourceCacheEvictorThread(const Reference<ResourceManager>& resource_manager_, const std::string& resources_db_path_, uint64 max_total_size_B_,
+		const Reference<TextureDataCache>& texture_data_cache_, uint64 max_texture_data_cache_size_B_, const Reference<PhysicsShapeCache>& physics_shape_cache_, uint64 max_physics_shape_cache_size_B_)
+:	resource_manager(resource_manager_), resources_db_path(resources_db_path_), max_total_size_B(max_total_size_B_),
+	texture_data_cache(texture_data_cache_), max_texture_data_cache_size_B(max_texture_data_cache_size_B_),
+	physics_shape_cache(physics_shape_cache_), max_physics_shape_cache_size_B(max_physics_shape_cache_size_B_)
+{}
+
+
+static void printCacheDirEvictionResults(const std::string& cache_name, const CacheDirEviction::Results& results, const Timer& timer)
+{
+	if(results.num_evicted > 0)
+		conPrint("ResourceCacheEvictorThread: evicted " + toString(results.num_evicted) + " " + cache_name + " cache entries (" + getMBSizeString(results.evicted_size_B) + "), remaining total size: " + 
+			getMBSizeString(results.total_present_size_B) + " (elapsed: " + timer.elapsedStringNSigFigs(3) + ")");
+}
+
+
+ResourceCacheEvictorThread::~ResourceCacheEvictorThread()
+{}
+
+
+void ResourceCacheEvictorThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("ResourceCacheEvictorThread");
+
+	// Wait a while after startup before the first pass, so we don't compete with initial loading, and so GUIClient has had a chance to mark in-use resources as accessed.
+	double wait_time = 120.0;
+	while(1)
+	{
+		// Wait for N seconds or until we get a KillThreadMessage.
+		ThreadMessageRef message;
+		const bool got_message = getMessageQueue().dequeueWithTimeout(wait_time, message);
+		if(got_message)
+			if(dynamic_cast<KillThreadMessage*>(message.getPointer()))
+				return;
+
+		try
+		{
+			Timer timer;
+			const ResourceManager::EvictionResults results = resource_manager->evictLeastRecentlyUsedResources(max_total_size_B, MIN_ACCESS_AGE_S, (uint64)Clock::getSecsSince1970(), resources_db_path);
+			if(results.num_evicted > 0)
+				conPrint("ResourceCacheEvictorThread: evicted " + toString(results.num_evicted) + " resource(s) (" + getMBSizeString(results.evicted_size_B) + "), present resources total size: " + 
+					getMBSizeString(results.total_present_size_B) + " (elapsed: " + timer.elapsedStringNSigFigs(3) + ")");
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("WARNING: Resource cache eviction failed: " + e.what());
+		}
+
+		try
+		{
+			if(texture_data_cache.nonNull())
+			{
+				Timer timer;
+				printCacheDirEvictionResults("texture data", texture_data_cache->evictEntries(max_texture_data_cache_size_B), timer);
+			}
+
+			if(physics_shape_cache.nonNull())
+			{
+				Timer timer;
+				printCacheDirEvictionResults("physics shape", physics_shape_cache->evictEntries(max_physics_shape_cache_size_B), timer);
+			}
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("WARNING: Cache dir eviction failed: " + e.what());
+		}
+
+		wait_time = 600.0;
+	}
+}
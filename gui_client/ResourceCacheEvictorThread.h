@@ -0,0 +1,50 @@
+/*=====================================================================
+ResourceCacheEvictorThread.h
+----------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <MessageableThread.h>
+#include <Platform.h>
+#include <string>
+class ResourceManager;
+class TextureDataCache;
+class PhysicsShapeCache;
+
+
+/*=====================================================================
+ResourceCacheEvictorThread
+--------------------------
+Periodically deletes the least recently used downloaded resources from
+the resources dir, when their total size is over the disk budget.
+
+Resources used by currently loaded objects have their access time updated
+regularly by GUIClient, so are never evicted (see min_access_age_s).
+
+The resources DB is saved (under the resource manager mutex, as with
+SaveResourcesDBThread) before any files are deleted.
+
+Also size-limits the texture data cache and physics shape cache dirs, each
+with their own budget.  These caches may be NULL.
+=====================================================================*/
+class ResourceCacheEvictorThread : public MessageableThread
+{
+public:
+	ResourceCacheEvictorThread(const Reference<ResourceManager>& resource_manager, const std::string& resources_db_path, uint64 max_total_size_B,
+		const Reference<TextureDataCache>& texture_data_cache, uint64 max_texture_data_cache_size_B, const Reference<PhysicsShapeCache>& physics_shape_cache, uint64 max_physics_shape_cache_size_B);
+	virtual ~ResourceCacheEvictorThread();
+
+	virtual void doRun();
+
+	static const uint64 MIN_ACCESS_AGE_S = 3600; // Don't evict resources used in the last hour.
+private:
+	Reference<ResourceManager> resource_manager;
+	const std::string resources_db_path;
+	const uint64 max_total_size_B;
+	Reference<TextureDataCache> texture_data_cache;
+	const uint64 max_texture_data_cache_size_B;
+	Reference<PhysicsShapeCache> physics_shape_cache;
+	const uint64 max_physics_shape_cache_size_B;
+};
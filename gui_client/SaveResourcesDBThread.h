@@ -15,8 +15,8 @@ class ResourceManager;
 /*=====================================================================
 SaveResourcesDBThread
 ---------------------
-Saves resources list to resources database on disk, if the resource manager 
-has changed.
+Saves changed resources to the resources database on disk, if the resource
+manager has changed.
 =====================================================================*/
 class SaveResourcesDBThread : public MessageableThread
 {
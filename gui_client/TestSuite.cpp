@@ -8,12 +8,16 @@ Copyright Glare Technologies Limited 2023 -
 
 #include "ModelLoading.h"
 #include "PhysicsWorld.h"
+#include "PhysicsShapeCache.h"
 #include "TerrainTests.h"
+#include "TextureDataCache.h"
+#include "CacheDirEviction.h"
 #include "URLParser.h"
 #include "CameraController.h"
 #include "../shared/VoxelMeshBuilding.h"
 #include "../shared/LODGeneration.h"
 #include "../shared/ImageDecoding.h"
+#include "../shared/ResourceManager.h"
 #include "../physics/TreeTest.h"
 #include "../opengl/TextureLoading.h"
 #include "../opengl/OpenGLEngineTests.h"
@@ -185,6 +189,10 @@ void TestSuite::test()
 	runTest([&]() { LODGeneration::test(); });
 	runTest([&]() { MeshSimplification::test(); });
 	runTest([&]() { PhysicsWorld::test(); });
+	runTest([&]() { PhysicsShapeCache::test(); });
+	runTest([&]() { TextureDataCache::test(); });
+	runTest([&]() { CacheDirEviction::test(); });
+	runTest([&]() { ResourceManager::test(); });
 	runTest([&]() { FormatDecoderGLTF::test(); });
 	runTest([&]() { BatchedMeshTests::test(); });
 	runTest([&]() { EXRDecoder::test(); }, /*mem leak allowed=*/true); // OpenEXR leaks some minor stuff
@@ -0,0 +1,326 @@
+/*=====================================================================
+TextureDataCache.cpp
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "TextureDataCache.h"
+
+
+#include "../shared/ImageDecoding.h"
+#include <graphics/KTXDecoder.h>
+#include <graphics/DXTCompression.h>
+#include <graphics/CompressedImage.h>
+#include <opengl/TextureData.h>
+#include <utils/FileUtils.h>
+#include <utils/StringUtils.h>
+#include <utils/Exception.h>
+#include <utils/ConPrint.h>
+#include <utils/Lock.h>
+#include <utils/IncludeXXHash.h>
+#include <maths/mathstypes.h>
+#include <cstring>
+
+
+static const uint32 CACHE_FORMAT_VERSION = 1; // Bump to invalidate existing cache entries, e.g. when the DXT compressor changes.
+
+
+TextureDataCache::TextureDataCache(const std::string& cache_dir_)
+:	cache_dir(cache_dir_),
+	next_temp_file_id(0),
+	next_access_seq(0)
+{
+	std::memset(&stats, 0, sizeof(stats));
+
+	FileUtils::createDirIfDoesNotExist(cache_dir);
+}
+
+
+TextureDataCache::~TextureDataCache()
+{}
+
+
+uint64 TextureDataCache::keyForTexture(const std::string& tex_path, uint64 tex_file_size, bool use_mipmaps)
+{
+	const uint64 params[2] = { tex_file_size, use_mipmaps ? 1u : 0u };
+	return XXH64(params, sizeof(params), /*seed=*/XXH64(tex_path.data(), tex_path.size(), /*seed=*/1));
+}
+
+
+std::string TextureDataCache::filenameForKey(uint64 key) const
+{
+	return "tex_v" + toString(CACHE_FORMAT_VERSION) + "_" + toHexString(key) + ".ktx2";
+}
+
+
+std::string TextureDataCache::pathForKey(uint64 key) const
+{
+	return cache_dir + "/" + filenameForKey(key);
+}
+
+
+Reference<Map2D> TextureDataCache::getTexture(uint64 key, glare::Allocator* allocator)
+{
+	const std::string path = pathForKey(key);
+	Reference<Map2D> map;
+	try
+	{
+		if(FileUtils::fileExists(path))
+		{
+			map = ImageDecoding::decodeImage(".", path, allocator);
+			if(!dynamic_cast<CompressedImage*>(map.ptr()))
+				throw glare::Exception("Expected compressed image");
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("TextureDataCache: Error while reading '" + path + "': " + e.what());
+		map = NULL;
+	}
+
+	Lock lock(mutex);
+	if(map.nonNull())
+	{
+		stats.hits++;
+		noteAccessed(key);
+	}
+	else
+		stats.misses++;
+	return map;
+}
+
+
+static size_t levelCompressedSize(size_t W, size_t H, size_t k, size_t num_channels)
+{
+	const size_t level_W = myMax((size_t)1, W / ((size_t)1 << k));
+	const size_t level_H = myMax((size_t)1, H / ((size_t)1 << k));
+	return DXTCompression::getCompressedSizeBytes(level_W, level_H, num_channels);
+}
+
+
+bool TextureDataCache::isCacheableTextureData(size_t W, size_t H, const TextureData& texture_data)
+{
+	const size_t num_channels = texture_data.numChannels();
+	if(!(num_channels == 3 || num_channels == 4))
+		return false;
+	if(texture_data.frames.size() != 1 || texture_data.level_offsets.empty())
+		return false;
+
+	// Uncompressed data will be larger than the compressed mip chain.
+	const size_t mipmap_data_size = texture_data.frames[0].mipmap_data.size();
+	for(size_t k=0; k<texture_data.level_offsets.size(); ++k)
+		if(texture_data.level_offsets[k].offset + levelCompressedSize(W, H, k, num_channels) > mipmap_data_size)
+			return false;
+
+	const size_t last_k = texture_data.level_offsets.size() - 1;
+	return texture_data.level_offsets[last_k].offset + levelCompressedSize(W, H, last_k, num_channels) == mipmap_data_size;
+}
+
+
+void TextureDataCache::addTexture(uint64 key, size_t W, size_t H, const TextureData& texture_data)
+{
+	try
+	{
+		if(!isCacheableTextureData(W, H, texture_data))
+			throw glare::Exception("Texture data is not single-frame DXT compressed data");
+
+		const size_t num_channels = texture_data.numChannels();
+		const auto& mipmap_data = texture_data.frames[0].mipmap_data;
+
+		std::vector<std::vector<uint8> > level_image_data(texture_data.level_offsets.size());
+		for(size_t k=0; k<level_image_data.size(); ++k)
+		{
+			const size_t level_compressed_size = levelCompressedSize(W, H, k, num_channels);
+			level_image_data[k].resize(level_compressed_size);
+			std::memcpy(level_image_data[k].data(), &mipmap_data[texture_data.level_offsets[k].offset], level_compressed_size);
+		}
+
+		uint64 temp_file_id;
+		{
+			Lock lock(mutex);
+			temp_file_id = next_temp_file_id++;
+			stats.num_added++;
+			noteAccessed(key);
+		}
+
+		const std::string path = pathForKey(key);
+		const std::string temp_path = path + "_tmp_" + toString(temp_file_id);
+		KTXDecoder::writeKTX2File((num_channels == 3) ? KTXDecoder::Format_BC1 : KTXDecoder::Format_BC3, /*supercompress=*/false, (int)W, (int)H, level_image_data, temp_path);
+		FileUtils::moveFile(temp_path, path); // Rename so other threads never see a partially written file.
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("TextureDataCache: Error while adding texture: " + e.what());
+	}
+}
+
+
+TextureDataCache::Stats TextureDataCache::getStats()
+{
+	Lock lock(mutex);
+	return stats;
+}
+
+
+void TextureDataCache::noteAccessed(uint64 key)
+{
+	last_access_seq[key] = next_access_seq++;
+}
+
+
+CacheDirEviction::Results TextureDataCache::evictEntries(uint64 max_total_size_B)
+{
+	// List the files before taking the access sequence numbers, so that entries added in between aren't treated as unused.
+	const std::vector<std::string> filenames = FileUtils::getFilesInDir(cache_dir);
+
+	std::unordered_map<std::string, uint64> access_seqs;
+	{
+		Lock lock(mutex);
+		access_seqs.reserve(last_access_seq.size());
+		for(auto it = last_access_seq.begin(); it != last_access_seq.end(); ++it)
+			access_seqs[filenameForKey(it->first)] = it->second;
+	}
+
+	// Files are deleted without holding the mutex, so load tasks aren't blocked.
+	return CacheDirEviction::evictFiles(cache_dir, filenames, access_seqs, max_total_size_B);
+}
+
+
+#if BUILD_TESTS
+
+
+#include <graphics/TextureProcessing.h>
+#include <graphics/ImageMap.h>
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+#include <utils/GlareAllocator.h>
+#include <utils/Timer.h>
+
+
+static void checkTextureDataEqual(const TextureData& a, const TextureData& b)
+{
+	testAssert(a.numChannels() == b.numChannels());
+	testAssert(a.level_offsets.size() == b.level_offsets.size());
+	for(size_t i=0; i<a.level_offsets.size(); ++i)
+		testAssert(a.level_offsets[i].offset == b.level_offsets[i].offset);
+
+	testAssert(a.frames.size() == 1 && b.frames.size() == 1);
+	testAssert(a.frames[0].mipmap_data.size() == b.frames[0].mipmap_data.size());
+	testAssert(std::memcmp(a.frames[0].mipmap_data.data(), b.frames[0].mipmap_data.data(), a.frames[0].mipmap_data.size()) == 0);
+}
+
+
+void TextureDataCache::test()
+{
+	conPrint("TextureDataCache::test()");
+
+	const std::string cache_dir = PlatformUtils::getTempDirPath() + "/texture_data_cache_test";
+	FileUtils::createDirIfDoesNotExist(cache_dir);
+
+	// Clear out any files from previous test runs.
+	{
+		const std::vector<std::string> paths = FileUtils::getFilesInDirWithExtensionFullPaths(cache_dir, "ktx2");
+		for(size_t i=0; i<paths.size(); ++i)
+			FileUtils::deleteFile(paths[i]);
+	}
+
+	glare::MallocAllocator allocator;
+	allocator.incRefCount();
+
+	try
+	{
+		testAssert(keyForTexture("a.png", 100, false) != keyForTexture("a.png", 100, true));
+		testAssert(keyForTexture("a.png", 100, false) != keyForTexture("a.png", 101, false));
+		testAssert(keyForTexture("a.png", 100, false) != keyForTexture("b.png", 100, false));
+
+		TextureDataCache cache(cache_dir);
+
+		const std::string tex_paths[] = {
+			TestUtils::getTestReposDir() + "/testfiles/pngs/PngSuite-2013jan13/basn2c08.png", // RGB
+			TestUtils::getTestReposDir() + "/testfiles/pngs/PngSuite-2013jan13/basn6a08.png" // RGBA
+		};
+
+		for(size_t i=0; i<staticArrayNumElems(tex_paths); ++i)
+		{
+			for(int use_mipmaps=0; use_mipmaps<2; ++use_mipmaps)
+			{
+				const uint64 key = keyForTexture(tex_paths[i], FileUtils::getFileSize(tex_paths[i]), use_mipmaps != 0);
+				testAssert(cache.getTexture(key, &allocator).isNull());
+
+				// Cold: decode and compress the texture.
+				const int NUM_ITERS = 10;
+				double min_build_time = 1.0e10;
+				Reference<Map2D> map;
+				Reference<TextureData> built_data;
+				for(int z=0; z<NUM_ITERS; ++z)
+				{
+					Timer timer;
+					map = ImageDecoding::decodeImage(".", tex_paths[i], &allocator);
+					built_data = TextureProcessing::buildTextureData(map.ptr(), &allocator, /*task manager=*/NULL, /*allow compression=*/true, /*build mipmaps=*/use_mipmaps != 0);
+					min_build_time = myMin(min_build_time, timer.elapsed());
+				}
+
+				testAssert(isCacheableTextureData(map->getMapWidth(), map->getMapHeight(), *built_data));
+				cache.addTexture(key, map->getMapWidth(), map->getMapHeight(), *built_data);
+
+				// Cached: load the compressed image from the cache file.
+				double min_restore_time = 1.0e10;
+				Reference<TextureData> cached_data;
+				for(int z=0; z<NUM_ITERS; ++z)
+				{
+					Timer timer;
+					Reference<Map2D> cached_map = cache.getTexture(key, &allocator);
+					testAssert(cached_map.nonNull());
+					cached_data = TextureProcessing::buildTextureData(cached_map.ptr(), &allocator, /*task manager=*/NULL, /*allow compression=*/true, /*build mipmaps=*/use_mipmaps != 0);
+					min_restore_time = myMin(min_restore_time, timer.elapsed());
+				}
+
+				checkTextureDataEqual(*built_data, *cached_data);
+
+				conPrint(FileUtils::getFilename(tex_paths[i]) + (use_mipmaps ? " (mipmaps)" : " (no mipmaps)") + ": build: " + doubleToStringNSigFigs(min_build_time * 1.0e3, 4) + " ms, load from cache: " +
+					doubleToStringNSigFigs(min_restore_time * 1.0e3, 4) + " ms, speedup: " + doubleToStringNSigFigs(min_build_time / min_restore_time, 3) + "x");
+			}
+		}
+
+		// Uncompressed texture data should not be added.
+		{
+			Reference<Map2D> map = ImageDecoding::decodeImage(".", tex_paths[0], &allocator);
+			Reference<TextureData> data = TextureProcessing::buildTextureData(map.ptr(), &allocator, /*task manager=*/NULL, /*allow compression=*/false, /*build mipmaps=*/true);
+			testAssert(!isCacheableTextureData(map->getMapWidth(), map->getMapHeight(), *data));
+			const uint64 key = keyForTexture("uncompressed.png", 1, true);
+			cache.addTexture(key, map->getMapWidth(), map->getMapHeight(), *data);
+			testAssert(cache.getTexture(key, &allocator).isNull());
+			testAssert(cache.getStats().num_added == 4);
+		}
+
+		// Test that a truncated cache file is treated as a miss.
+		{
+			const uint64 key = keyForTexture(tex_paths[0], FileUtils::getFileSize(tex_paths[0]), /*use mipmaps=*/true);
+			const std::string path = cache.pathForKey(key);
+			std::vector<uint8> data;
+			FileUtils::readEntireFile(path, data);
+			data.resize(data.size() / 2);
+			FileUtils::writeEntireFile(path, (const char*)data.data(), data.size());
+			testAssert(cache.getTexture(key, &allocator).isNull());
+		}
+
+		// Test eviction: the most recently accessed entry should be kept.
+		{
+			const uint64 key = keyForTexture(tex_paths[1], FileUtils::getFileSize(tex_paths[1]), /*use mipmaps=*/false);
+			testAssert(cache.getTexture(key, &allocator).nonNull());
+			const CacheDirEviction::Results results = cache.evictEntries(/*max total size B=*/FileUtils::getFileSize(cache.pathForKey(key)));
+			testAssert(results.num_evicted == 3);
+			testAssert(cache.getTexture(key, &allocator).nonNull());
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	allocator.decRefCount();
+
+	conPrint("TextureDataCache::test() done.");
+}
+
+
+#endif // BUILD_TESTS
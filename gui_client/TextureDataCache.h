@@ -0,0 +1,84 @@
+/*=====================================================================
+TextureDataCache.h
+------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "CacheDirEviction.h"
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/Reference.h>
+#include <utils/Mutex.h>
+#include <utils/Platform.h>
+#include <string>
+#include <unordered_map>
+class Map2D;
+class TextureData;
+namespace glare { class Allocator; }
+
+
+/*=====================================================================
+TextureDataCache
+----------------
+Persistent on-disk cache of compressed (BC1/BC3) texture data built by
+LoadTextureTask, for textures that don't have a server-side KTX version.
+This means that when a texture is loaded again, e.g. when revisiting a world,
+the PNG/JPEG decode and DXT compression and mipmap generation can be skipped.
+
+Entries are keyed by a hash of the texture path, texture file size, and
+whether mipmaps were built.  Only compressed texture data is cached, so the
+key implicitly includes that compression was enabled.
+Each entry is stored as a KTX2 file containing the full mip chain,
+and is loaded back with the usual KTX decoding path as a CompressedImage,
+which TextureProcessing::buildTextureData() just copies.
+
+Entries are written to a temp file then renamed, so concurrent load tasks
+can share the cache.  Threadsafe.
+
+The cache dir is size-limited by ResourceCacheEvictorThread calling evictEntries().
+=====================================================================*/
+class TextureDataCache : public ThreadSafeRefCounted
+{
+public:
+	TextureDataCache(const std::string& cache_dir);
+	~TextureDataCache();
+
+	static uint64 keyForTexture(const std::string& tex_path, uint64 tex_file_size, bool use_mipmaps);
+
+	// Returns the cached compressed image, or NULL if not in cache or the cache entry is invalid.
+	Reference<Map2D> getTexture(uint64 key, glare::Allocator* allocator);
+
+	// Returns true if the texture data, with top-level dimensions W x H, is DXT (BC1 or BC3) compressed with a single frame, and so can be added to the cache.
+	static bool isCacheableTextureData(size_t W, size_t H, const TextureData& texture_data);
+
+	// Adds texture data with top-level dimensions W x H.  isCacheableTextureData() should be true for the texture data.
+	// Errors are logged and otherwise ignored.
+	void addTexture(uint64 key, size_t W, size_t H, const TextureData& texture_data);
+
+	struct Stats
+	{
+		size_t hits, misses, num_added;
+	};
+	Stats getStats();
+
+	// Deletes least recently used entries until the total size of the cache dir is <= max_total_size_B.
+	CacheDirEviction::Results evictEntries(uint64 max_total_size_B);
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(TextureDataCache);
+
+	std::string filenameForKey(uint64 key) const;
+	std::string pathForKey(uint64 key) const;
+	void noteAccessed(uint64 key) REQUIRES(mutex);
+
+	std::string cache_dir;
+
+	Mutex mutex;
+	uint64 next_temp_file_id GUARDED_BY(mutex);
+	Stats stats GUARDED_BY(mutex);
+	uint64 next_access_seq GUARDED_BY(mutex);
+	std::unordered_map<uint64, uint64> last_access_seq GUARDED_BY(mutex); // Map from key to access sequence number, for entries accessed this session.
+};
@@ -126,15 +126,8 @@ size_t WorldState::getTotalMemUsage() const
 
 Parcel* WorldState::getParcelPointIsIn(const Vec3d& p_)
 {
-	const Vec4f p = p_.toVec4fPoint();
+	if(parcel_index.numParcels() != parcels.size())
+		parcel_index.rebuild(parcels);
 
-	for(auto& it : parcels) // NOTE: fixme, crappy linear scan
-	{
-		Parcel* parcel = it.second.ptr();
-
-		if(parcel->aabb.contains(p))
-			return parcel;
-	}
-
-	return NULL;
+	return parcel_index.getParcelPointIsIn(p_.toVec4fPoint());
 }
@@ -12,6 +12,7 @@ Copyright Glare Technologies Limited 2022 -
 #include "../shared/GroundPatch.h"
 #include "../shared/WorldStateLock.h"
 #include "../shared/LODChunk.h"
+#include "../shared/ParcelSpatialIndex.h"
 #include <ThreadSafeRefCounted.h>
 #include <FastIterMap.h>
 #include <Mutex.h>
@@ -49,6 +50,7 @@ public:
 	std::unordered_set<WorldObjectRef, WorldObjectRefHash> dirty_from_local_objects GUARDED_BY(mutex);
 
 	std::map<ParcelID, ParcelRef> parcels GUARDED_BY(mutex);
+	ParcelSpatialIndex parcel_index GUARDED_BY(mutex); // Call parcel_index.insertOrUpdate() after changing parcel geometry.  Rebuilt in getParcelPointIsIn() if parcels have been added or removed.
 	std::unordered_set<ParcelRef, ParcelRefHash> dirty_from_remote_parcels GUARDED_BY(mutex);
 	std::unordered_set<ParcelRef, ParcelRefHash> dirty_from_local_parcels GUARDED_BY(mutex);
 
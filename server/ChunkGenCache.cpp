@@ -0,0 +1,365 @@
+/*=====================================================================
+ChunkGenCache.cpp
+-----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ChunkGenCache.h"
+
+
+#include <utils/FileUtils.h>
+#include <utils/StringUtils.h>
+#include <utils/Exception.h>
+#include <utils/ConPrint.h>
+#include <utils/Lock.h>
+#include <utils/BufferOutStream.h>
+#include <utils/BufferViewInStream.h>
+#include <utils/IncludeXXHash.h>
+#include <cstring>
+
+
+static const uint32 GEOMETRY_MAGIC_NUMBER = 0x43474731; // 'CGG1'
+static const uint32 TILE_MAGIC_NUMBER = 0x43475431; // 'CGT1'
+static const uint32 CACHE_FORMAT_VERSION = 1; // Bump to invalidate existing cache entries, e.g. if the simplification parameters change.
+
+static const uint32 MAX_NUM_ELEMS = 1 << 26; // Sanity limit on array sizes when reading cache files.
+
+
+ChunkGenCache::ChunkGenCache(const std::string& cache_dir_)
+:	cache_dir(cache_dir_),
+	next_temp_file_id(0)
+{
+	std::memset(&stats, 0, sizeof(stats));
+
+	FileUtils::createDirIfDoesNotExist(cache_dir);
+}
+
+
+ChunkGenCache::~ChunkGenCache()
+{}
+
+
+std::string ChunkGenCache::pathForKey(const std::string& prefix, uint64 key, const std::string& extension) const
+{
+	return cache_dir + "/" + prefix + "_v" + toString(CACHE_FORMAT_VERSION) + "_" + toHexString(key) + "." + extension;
+}
+
+
+void ChunkGenCache::writeFileAtomically(const std::string& path, const void* data, size_t size)
+{
+	uint64 temp_file_id;
+	{
+		Lock lock(mutex);
+		temp_file_id = next_temp_file_id++;
+	}
+
+	const std::string temp_path = path + "_tmp_" + toString(temp_file_id);
+	FileUtils::writeEntireFile(temp_path, (const char*)data, size);
+	FileUtils::moveFile(temp_path, path); // Rename so other threads never see a partially written file.
+}
+
+
+template <class T>
+static void writeArray(BufferOutStream& stream, const js::Vector<T, 16>& v)
+{
+	stream.writeUInt32((uint32)v.size());
+	stream.writeData(v.data(), v.dataSizeBytes());
+}
+
+
+template <class T>
+static void readArray(BufferViewInStream& stream, js::Vector<T, 16>& v)
+{
+	const uint32 size = stream.readUInt32();
+	if(size > MAX_NUM_ELEMS)
+		throw glare::Exception("Invalid array size");
+	v.resize(size);
+	stream.readData(v.data(), v.dataSizeBytes());
+}
+
+
+Reference<ChunkGenCache::SimplifiedGeometry> ChunkGenCache::getGeometry(uint64 key)
+{
+	const std::string path = pathForKey("geom", key, "bin");
+	Reference<SimplifiedGeometry> geom;
+	try
+	{
+		if(FileUtils::fileExists(path))
+		{
+			std::vector<uint8> data;
+			FileUtils::readEntireFile(path, data);
+
+			BufferViewInStream stream(ArrayRef<uint8>(data.data(), data.size()));
+			if(stream.readUInt32() != GEOMETRY_MAGIC_NUMBER)
+				throw glare::Exception("Invalid magic number");
+
+			geom = new SimplifiedGeometry();
+			readArray(stream, geom->positions);
+			readArray(stream, geom->packed_normals);
+			readArray(stream, geom->uvs);
+			readArray(stream, geom->indices);
+
+			const uint32 num_batches = stream.readUInt32();
+			if(num_batches > MAX_NUM_ELEMS)
+				throw glare::Exception("Invalid num batches");
+			geom->batches.resize(num_batches);
+			for(size_t i=0; i<geom->batches.size(); ++i)
+			{
+				stream.readData(&geom->batches[i], sizeof(GeometryBatch));
+				if((uint64)geom->batches[i].indices_start + geom->batches[i].num_indices > geom->indices.size())
+					throw glare::Exception("Invalid batch");
+			}
+
+			geom->voxel_scale = stream.readFloat();
+			geom->num_mats_referenced = stream.readUInt32();
+
+			// Check indices and attribute array sizes, so the cached geometry can be used without further checks.
+			const size_t num_verts = geom->positions.size();
+			if((!geom->packed_normals.empty() && geom->packed_normals.size() != num_verts) || (!geom->uvs.empty() && geom->uvs.size() != num_verts))
+				throw glare::Exception("Invalid attribute array size");
+			for(size_t i=0; i<geom->indices.size(); ++i)
+				if(geom->indices[i] >= num_verts)
+					throw glare::Exception("Invalid index");
+			for(size_t i=0; i<geom->batches.size(); ++i)
+				if(geom->batches[i].material_index >= geom->num_mats_referenced)
+					throw glare::Exception("Invalid material index");
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("ChunkGenCache: Error while reading '" + path + "': " + e.what());
+		geom = NULL;
+	}
+
+	Lock lock(mutex);
+	if(geom.nonNull())
+		stats.geometry_hits++;
+	else
+		stats.geometry_misses++;
+	return geom;
+}
+
+
+void ChunkGenCache::addGeometry(uint64 key, const SimplifiedGeometry& geom)
+{
+	try
+	{
+		BufferOutStream stream;
+		stream.writeUInt32(GEOMETRY_MAGIC_NUMBER);
+		writeArray(stream, geom.positions);
+		writeArray(stream, geom.packed_normals);
+		writeArray(stream, geom.uvs);
+		writeArray(stream, geom.indices);
+		stream.writeUInt32((uint32)geom.batches.size());
+		for(size_t i=0; i<geom.batches.size(); ++i)
+			stream.writeData(&geom.batches[i], sizeof(GeometryBatch));
+		stream.writeFloat(geom.voxel_scale);
+		stream.writeUInt32(geom.num_mats_referenced);
+
+		writeFileAtomically(pathForKey("geom", key, "bin"), stream.buf.data(), stream.buf.size());
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("ChunkGenCache: Error while writing geometry: " + e.what());
+	}
+}
+
+
+uint64 ChunkGenCache::textureTileKey(const std::string& tex_path)
+{
+	uint64 file_size = 0;
+	try
+	{
+		file_size = FileUtils::getFileSize(tex_path);
+	}
+	catch(glare::Exception&)
+	{}
+
+	const std::string key_str = tex_path + "_" + toString(file_size);
+	return XXH64(key_str.data(), key_str.size(), /*seed=*/1);
+}
+
+
+ImageMapUInt8Ref ChunkGenCache::getTextureTile(uint64 key)
+{
+	const std::string path = pathForKey("tile", key, "bin");
+	ImageMapUInt8Ref tile;
+	try
+	{
+		if(FileUtils::fileExists(path))
+		{
+			std::vector<uint8> data;
+			FileUtils::readEntireFile(path, data);
+
+			BufferViewInStream stream(ArrayRef<uint8>(data.data(), data.size()));
+			if(stream.readUInt32() != TILE_MAGIC_NUMBER)
+				throw glare::Exception("Invalid magic number");
+			const uint32 W = stream.readUInt32();
+			const uint32 H = stream.readUInt32();
+			const uint32 N = stream.readUInt32();
+			if(W > 4096 || H > 4096 || N > 4)
+				throw glare::Exception("Invalid tile dimensions");
+
+			tile = new ImageMapUInt8(W, H, N);
+			stream.readData(tile->getData(), (size_t)W * H * N);
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("ChunkGenCache: Error while reading '" + path + "': " + e.what());
+		tile = NULL;
+	}
+
+	Lock lock(mutex);
+	if(tile.nonNull())
+		stats.tile_hits++;
+	else
+		stats.tile_misses++;
+	return tile;
+}
+
+
+void ChunkGenCache::addTextureTile(uint64 key, const ImageMapUInt8& tile)
+{
+	try
+	{
+		BufferOutStream stream;
+		stream.writeUInt32(TILE_MAGIC_NUMBER);
+		stream.writeUInt32((uint32)tile.getWidth());
+		stream.writeUInt32((uint32)tile.getHeight());
+		stream.writeUInt32((uint32)tile.getN());
+		stream.writeData(tile.getData(), tile.getWidth() * tile.getHeight() * tile.getN());
+
+		writeFileAtomically(pathForKey("tile", key, "bin"), stream.buf.data(), stream.buf.size());
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("ChunkGenCache: Error while writing texture tile: " + e.what());
+	}
+}
+
+
+std::string ChunkGenCache::getArrayTexturePath(uint64 key)
+{
+	const std::string path = pathForKey("array", key, "basis");
+	const bool present = FileUtils::fileExists(path);
+
+	Lock lock(mutex);
+	if(present)
+		stats.array_hits++;
+	else
+		stats.array_misses++;
+	return present ? path : std::string();
+}
+
+
+void ChunkGenCache::addArrayTexture(uint64 key, const std::string& path)
+{
+	try
+	{
+		std::vector<uint8> data;
+		FileUtils::readEntireFile(path, data);
+		writeFileAtomically(pathForKey("array", key, "basis"), data.data(), data.size());
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("ChunkGenCache: Error while writing array texture: " + e.what());
+	}
+}
+
+
+ChunkGenCache::Stats ChunkGenCache::getStats()
+{
+	Lock lock(mutex);
+	return stats;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+
+
+void ChunkGenCache::test()
+{
+	conPrint("ChunkGenCache::test()");
+
+	const std::string cache_dir = PlatformUtils::getTempDirPath() + "/chunk_gen_cache_test";
+	FileUtils::createDirIfDoesNotExist(cache_dir);
+
+	// Clear out any files from previous test runs.
+	{
+		const std::vector<std::string> paths = FileUtils::getFilesInDirWithExtensionFullPaths(cache_dir, "bin");
+		for(size_t i=0; i<paths.size(); ++i)
+			FileUtils::deleteFile(paths[i]);
+	}
+
+	try
+	{
+		ChunkGenCache cache(cache_dir);
+
+		//------------------------ Test geometry ------------------------
+		testAssert(cache.getGeometry(123).isNull());
+
+		SimplifiedGeometry geom;
+		geom.positions.push_back(Vec3f(0, 0, 0));
+		geom.positions.push_back(Vec3f(1, 0, 0));
+		geom.positions.push_back(Vec3f(0, 1, 0));
+		geom.uvs.resize(3, Vec2f(0.5f, 0.25f));
+		geom.indices.push_back(0);
+		geom.indices.push_back(1);
+		geom.indices.push_back(2);
+		geom.batches.push_back(GeometryBatch({/*indices_start=*/0, /*num_indices=*/3, /*material_index=*/1}));
+		geom.voxel_scale = 2.f;
+		geom.num_mats_referenced = 2;
+		cache.addGeometry(123, geom);
+
+		Reference<SimplifiedGeometry> cached_geom = cache.getGeometry(123);
+		testAssert(cached_geom.nonNull());
+		testAssert(cached_geom->positions.size() == 3 && cached_geom->positions[1] == Vec3f(1, 0, 0));
+		testAssert(cached_geom->packed_normals.empty());
+		testAssert(cached_geom->uvs.size() == 3 && cached_geom->uvs[2] == Vec2f(0.5f, 0.25f));
+		testAssert(cached_geom->indices.size() == 3 && cached_geom->indices[2] == 2);
+		testAssert(cached_geom->batches.size() == 1 && cached_geom->batches[0].material_index == 1 && cached_geom->batches[0].num_indices == 3);
+		testAssert(cached_geom->voxel_scale == 2.f);
+		testAssert(cached_geom->num_mats_referenced == 2);
+
+		// Test that a corrupted cache file is treated as a miss.
+		{
+			const std::string path = cache.pathForKey("geom", 123, "bin");
+			std::vector<uint8> data;
+			FileUtils::readEntireFile(path, data);
+			data.resize(data.size() / 2);
+			FileUtils::writeEntireFile(path, (const char*)data.data(), data.size());
+			testAssert(cache.getGeometry(123).isNull());
+		}
+
+		//------------------------ Test texture tiles ------------------------
+		testAssert(cache.getTextureTile(456).isNull());
+
+		ImageMapUInt8 tile(4, 4, 3);
+		for(size_t i=0; i<4 * 4 * 3; ++i)
+			tile.getData()[i] = (uint8)i;
+		cache.addTextureTile(456, tile);
+
+		ImageMapUInt8Ref cached_tile = cache.getTextureTile(456);
+		testAssert(cached_tile.nonNull() && cached_tile->getWidth() == 4 && cached_tile->getHeight() == 4 && cached_tile->getN() == 3);
+		testAssert(std::memcmp(cached_tile->getData(), tile.getData(), 4 * 4 * 3) == 0);
+
+		testAssert(textureTileKey("a.png") != textureTileKey("b.png"));
+
+		const Stats stats = cache.getStats();
+		testAssert(stats.geometry_hits == 1 && stats.geometry_misses == 2);
+		testAssert(stats.tile_hits == 1 && stats.tile_misses == 1);
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ChunkGenCache::test() done.");
+}
+
+
+#endif // BUILD_TESTS
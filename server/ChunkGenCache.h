@@ -0,0 +1,95 @@
+/*=====================================================================
+ChunkGenCache.h
+---------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <graphics/ImageMap.h>
+#include <maths/vec2.h>
+#include <maths/vec3.h>
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/Reference.h>
+#include <utils/Vector.h>
+#include <utils/Mutex.h>
+#include <string>
+#include <vector>
+
+
+/*=====================================================================
+ChunkGenCache
+-------------
+Persistent on-disk cache of intermediate results for ChunkGenThread,
+so that rebuilding a chunk after a single object in it changes only has
+to recombine cached pieces, instead of reloading and simplifying every
+object model and re-encoding the whole array texture.
+
+Caches:
+* Simplified object geometry, keyed by a hash of the model (or voxel data)
+  and anything else the simplification depends on.
+  The geometry is stored in object space, so moving or rotating an object doesn't
+  invalidate its cache entry.
+* Downsampled texture tiles, keyed by a hash of the texture path.
+* Encoded array textures, keyed by a hash of the tile keys in the array.
+
+Entries are written to a temp file then renamed, so concurrent chunk builds
+can share the cache.  Threadsafe.
+=====================================================================*/
+class ChunkGenCache
+{
+public:
+	ChunkGenCache(const std::string& cache_dir);
+	~ChunkGenCache();
+
+	struct GeometryBatch
+	{
+		uint32 indices_start;
+		uint32 num_indices;
+		uint32 material_index;
+	};
+
+	struct SimplifiedGeometry : public ThreadSafeRefCounted
+	{
+		js::Vector<Vec3f, 16> positions; // Object space, with any skinning transform already applied.
+		js::Vector<uint32, 16> packed_normals; // Object space.  Empty if the source mesh did not have normals.
+		js::Vector<Vec2f, 16> uvs; // Empty if the source mesh did not have UVs.
+		js::Vector<uint32, 16> indices;
+		std::vector<GeometryBatch> batches;
+		float voxel_scale; // Extra object-space scale for voxel objects built with subsampling.
+		uint32 num_mats_referenced;
+	};
+
+	// Returns NULL if not in cache.
+	Reference<SimplifiedGeometry> getGeometry(uint64 key);
+	void addGeometry(uint64 key, const SimplifiedGeometry& geom);
+
+	static uint64 textureTileKey(const std::string& tex_path); // Depends on the path and file size.
+	ImageMapUInt8Ref getTextureTile(uint64 key); // Returns NULL if not in cache.
+	void addTextureTile(uint64 key, const ImageMapUInt8& tile);
+
+	std::string getArrayTexturePath(uint64 key); // Returns empty string if not in cache.
+	void addArrayTexture(uint64 key, const std::string& path); // Copies the file at path into the cache.
+
+	struct Stats
+	{
+		size_t geometry_hits, geometry_misses;
+		size_t tile_hits, tile_misses;
+		size_t array_hits, array_misses;
+	};
+	Stats getStats();
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(ChunkGenCache);
+
+	std::string pathForKey(const std::string& prefix, uint64 key, const std::string& extension) const;
+	void writeFileAtomically(const std::string& path, const void* data, size_t size);
+
+	std::string cache_dir;
+
+	Mutex mutex;
+	uint64 next_temp_file_id GUARDED_BY(mutex);
+	Stats stats GUARDED_BY(mutex);
+};
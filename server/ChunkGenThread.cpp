@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2024 -
 
 
 #include "ServerWorldState.h"
+#include "ChunkGenCache.h"
 #include "../shared/LODGeneration.h"
 #include "../shared/VoxelMeshBuilding.h"
 #include "../shared/ImageDecoding.h"
@@ -30,6 +31,10 @@ Copyright Glare Technologies Limited 2024 -
 #include <utils/RuntimeCheck.h>
 #include <utils/FileOutStream.h>
 #include <utils/FileUtils.h>
+#include <utils/Clock.h>
+#include <utils/KillThreadMessage.h>
+#include <utils/BufferOutStream.h>
+#include <utils/IncludeXXHash.h>
 #include <maths/matrix3.h>
 #if !GUI_CLIENT
 #include <encoder/basisu_comp.h>
@@ -38,8 +43,10 @@ Copyright Glare Technologies Limited 2024 -
 #include <FileChecksum.h>
 
 
-ChunkGenThread::ChunkGenThread(ServerAllWorldsState* all_worlds_state_)
-:	all_worlds_state(all_worlds_state_)
+ChunkGenThread::ChunkGenThread(ServerAllWorldsState* all_worlds_state_, const std::string& temp_dir_, const std::string& cache_dir_)
+:	all_worlds_state(all_worlds_state_),
+	temp_dir(temp_dir_),
+	cache_dir(cache_dir_)
 {
 }
 
@@ -173,10 +180,10 @@ inline static Vec4f transformSkinnedVertex(const Vec4f vert_pos, size_t joint_of
 
 // May return null mesh if there were no voxels or mesh was simplified away.
 // May also return mesh with zero indices.
-BatchedMeshRef loadAndSimplifyGeometry(const ObInfo& ob_info, Matrix4f& voxel_scale_matrix_out)
+static BatchedMeshRef loadAndSimplifyGeometry(const ObInfo& ob_info, float& voxel_scale_out)
 {
 	float voxel_scale = 1.f;
-	voxel_scale_matrix_out = Matrix4f::identity();
+	voxel_scale_out = 1.f;
 
 	BatchedMeshRef mesh;
 	if(ob_info.object_type == WorldObject::ObjectType_Generic)
@@ -208,7 +215,7 @@ BatchedMeshRef loadAndSimplifyGeometry(const ObInfo& ob_info, Matrix4f& voxel_sc
 
 			mesh = BatchedMesh::buildFromIndigoMesh(*indigo_mesh);
 
-			voxel_scale_matrix_out = Matrix4f::uniformScaleMatrix((float)subsample_factor);
+			voxel_scale_out = (float)subsample_factor;
 		}
 	}
 
@@ -246,7 +253,62 @@ BatchedMeshRef loadAndSimplifyGeometry(const ObInfo& ob_info, Matrix4f& voxel_sc
 }
 
 
-static void buildAndSaveArrayTexture(const std::vector<std::string>& used_tex_paths, glare::TaskManager& task_manager, int chunk_x, int chunk_y, std::map<std::string, int>& array_image_indices_out,
+static const int ARRAY_TEXTURE_TILE_W = 128;
+
+
+// Load the texture and downsize it to a 3-channel tile for the array texture.
+static ImageMapUInt8Ref makeTextureTile(const std::string& tex_path, glare::TaskManager& task_manager)
+{
+	conPrint("Loading '" + tex_path + "'...");
+	Reference<Map2D> map;
+	if(hasExtension(tex_path, "gif"))
+		map = GIFDecoder::decodeImageSequence(tex_path);
+	else
+		map = ImageDecoding::decodeImage(".", tex_path); // Load texture from disk and decode it.
+
+	// Process 8-bit textures (do DXT compression, mip-map computation etc..) in this thread.
+	const ImageMapUInt8* imagemap;
+	if(dynamic_cast<const ImageMapUInt8*>(map.ptr()))
+	{
+		imagemap = map.downcastToPtr<ImageMapUInt8>();
+	}
+	else if(dynamic_cast<const ImageMapSequenceUInt8*>(map.ptr()))
+	{
+		const ImageMapSequenceUInt8* imagemapseq = map.downcastToPtr<ImageMapSequenceUInt8>();
+		if(imagemapseq->images.empty())
+			throw glare::Exception("imagemapseq was empty");
+		imagemap = imagemapseq->images[0].ptr();
+	}
+	else
+		throw glare::Exception("Unhandled texture type.");
+
+
+	const int new_W = ARRAY_TEXTURE_TILE_W;
+
+	// Resize image down
+	Reference<Map2D> resized_map = imagemap->resizeMidQuality(new_W, new_W, &task_manager);
+
+	runtimeCheck(resized_map.isType<ImageMapUInt8>());
+	ImageMapUInt8Ref resized_map_uint8 = resized_map.downcast<ImageMapUInt8>();
+
+	if(resized_map_uint8->numChannels() > 3)
+		resized_map_uint8 = resized_map_uint8->extract3ChannelImage();
+
+	if(resized_map_uint8->numChannels() < 3)
+	{
+		ImageMapUInt8Ref new_map = new ImageMapUInt8(new_W, new_W, 3);
+		for(size_t i=0; i<new_W * new_W; ++i)
+			new_map->getPixel(i)[0] = new_map->getPixel(i)[1] = new_map->getPixel(i)[2] = resized_map_uint8->getPixel(i)[0];
+
+		resized_map_uint8 = new_map;
+	}
+
+	return resized_map_uint8;
+}
+
+
+// Texture tiles, and the encoded array texture, are taken from the cache if present (cache may be NULL).
+static void buildAndSaveArrayTexture(const std::vector<std::string>& used_tex_paths, glare::TaskManager& task_manager, ChunkGenCache* cache, int num_encoder_threads, const std::string& output_path, std::map<std::string, int>& array_image_indices_out,
 	std::string& combined_texture_path_out, uint64& combined_texture_hash_out)
 {
 	if(!used_tex_paths.empty())
@@ -254,62 +316,32 @@ static void buildAndSaveArrayTexture(const std::vector<std::string>& used_tex_pa
 		basisu::basisu_encoder_init(); // Can be called multiple times harmlessly.
 		basisu::basis_compressor_params params;
 
+		BufferOutStream array_key; // Key for the array texture in the cache: the keys of the tiles in it.
+
 		for(auto it = used_tex_paths.begin(); it != used_tex_paths.end(); ++it)
 		{
 			try
 			{
 				const std::string tex_path = *it;
 
-				conPrint("Loading '" + tex_path + "'...");
-				Reference<Map2D> map;
-				if(hasExtension(tex_path, "gif"))
-					map = GIFDecoder::decodeImageSequence(tex_path);
-				else
-					map = ImageDecoding::decodeImage(".", tex_path); // Load texture from disk and decode it.
-
-				// Process 8-bit textures (do DXT compression, mip-map computation etc..) in this thread.
-				const ImageMapUInt8* imagemap;
-				if(dynamic_cast<const ImageMapUInt8*>(map.ptr()))
-				{
-					imagemap = map.downcastToPtr<ImageMapUInt8>();
-				}
-				else if(dynamic_cast<const ImageMapSequenceUInt8*>(map.ptr()))
-				{
-					const ImageMapSequenceUInt8* imagemapseq = map.downcastToPtr<ImageMapSequenceUInt8>();
-					if(imagemapseq->images.empty())
-						throw glare::Exception("imagemapseq was empty");
-					imagemap = imagemapseq->images[0].ptr();
-				}
-				else
-					throw glare::Exception("Unhandled texture type.");
-
-
-				const int new_W = 128;
-
-				// Resize image down
-				Reference<Map2D> resized_map = imagemap->resizeMidQuality(new_W, new_W, &task_manager);
-
-				runtimeCheck(resized_map.isType<ImageMapUInt8>());
-				ImageMapUInt8Ref resized_map_uint8 = resized_map.downcast<ImageMapUInt8>();
-
-				if(resized_map_uint8->numChannels() > 3)
-					resized_map_uint8 = resized_map_uint8->extract3ChannelImage();
-
-				if(resized_map_uint8->numChannels() < 3)
+				const uint64 tile_key = ChunkGenCache::textureTileKey(tex_path);
+				ImageMapUInt8Ref tile;
+				if(cache)
+					tile = cache->getTextureTile(tile_key);
+				if(tile.isNull() || (tile->getWidth() != ARRAY_TEXTURE_TILE_W) || (tile->getHeight() != ARRAY_TEXTURE_TILE_W) || (tile->getN() != 3))
 				{
-					ImageMapUInt8Ref new_map = new ImageMapUInt8(new_W, new_W, 3);
-					for(size_t i=0; i<new_W * new_W; ++i)
-						new_map->getPixel(i)[0] = new_map->getPixel(i)[1] = new_map->getPixel(i)[2] = resized_map_uint8->getPixel(i)[0];
-
-					resized_map_uint8 = new_map;
+					tile = makeTextureTile(tex_path, task_manager);
+					if(cache)
+						cache->addTextureTile(tile_key, *tile);
 				}
 
-				basisu::image img(resized_map_uint8->getData(), (uint32)new_W, (uint32)new_W, (uint32)3);
+				basisu::image img(tile->getData(), (uint32)ARRAY_TEXTURE_TILE_W, (uint32)ARRAY_TEXTURE_TILE_W, (uint32)3);
 
 				//tex_info.array_image_index = params.m_source_images.size();
 				array_image_indices_out[tex_path] = params.m_source_images.size();
 
 				params.m_source_images.push_back(img);
+				array_key.writeUInt64(tile_key);
 			}
 			catch(glare::Exception& e)
 			{
@@ -320,6 +352,19 @@ static void buildAndSaveArrayTexture(const std::vector<std::string>& used_tex_pa
 
 		if(!params.m_source_images.empty())
 		{
+			// If the array texture with these tiles has already been encoded, just use that.
+			const uint64 array_cache_key = XXH64(array_key.buf.data(), array_key.buf.size(), /*seed=*/1);
+			if(cache)
+			{
+				const std::string cached_path = cache->getArrayTexturePath(array_cache_key);
+				if(!cached_path.empty())
+				{
+					combined_texture_path_out = cached_path;
+					combined_texture_hash_out = FileChecksum::fileChecksum(cached_path);
+					return;
+				}
+			}
+
 			Timer timer;
 
 			params.m_tex_type = basist::cBASISTexType2DArray;
@@ -327,7 +372,7 @@ static void buildAndSaveArrayTexture(const std::vector<std::string>& used_tex_pa
 			params.m_perceptual = true;
 	
 			params.m_write_output_basis_files = true;
-			params.m_out_filename = "d:/tempfiles/chunk_array_texture_" + toString(chunk_x) + "_" + toString(chunk_y) + ".basis";
+			params.m_out_filename = output_path;
 			params.m_create_ktx2_file = false;
 
 			params.m_mip_gen = true; // Generate mipmaps for each source image
@@ -339,7 +384,7 @@ static void buildAndSaveArrayTexture(const std::vector<std::string>& used_tex_pa
 			//params.m_max_endpoint_clusters = 16128;
 			//params.m_max_selector_clusters = 16128;
 
-			basisu::job_pool jpool(PlatformUtils::getNumLogicalProcessors());
+			basisu::job_pool jpool(myMax(1, num_encoder_threads));
 			params.m_pJob_pool = &jpool;
 
 			basisu::basis_compressor basisCompressor;
@@ -361,6 +406,9 @@ static void buildAndSaveArrayTexture(const std::vector<std::string>& used_tex_pa
 
 			combined_texture_path_out = params.m_out_filename;
 			combined_texture_hash_out = hash;
+
+			if(cache)
+				cache->addArrayTexture(array_cache_key, params.m_out_filename);
 		}
 		else
 			conPrint("Not writing texture array, no textures to process.");
@@ -370,7 +418,237 @@ static void buildAndSaveArrayTexture(const std::vector<std::string>& used_tex_pa
 }
 
 
-static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int chunk_x, int chunk_y, glare::TaskManager& task_manager)
+// Key for the simplified geometry of an object in the chunk gen cache.
+// Includes everything the simplified geometry depends on, apart from the object transform, which is applied when combining.
+static uint64 geometryCacheKey(const ObInfo& ob_info)
+{
+	BufferOutStream key;
+	key.writeUInt32(ob_info.object_type);
+	if(ob_info.object_type == WorldObject::ObjectType_Generic)
+	{
+		key.writeStringLengthFirst(ob_info.model_path);
+		uint64 file_size = 0;
+		try
+		{
+			file_size = FileUtils::getFileSize(ob_info.model_path);
+		}
+		catch(glare::Exception&)
+		{}
+		key.writeUInt64(file_size);
+	}
+	else
+	{
+		key.writeData(ob_info.compressed_voxels.data(), ob_info.compressed_voxels.size());
+		for(size_t i=0; i<ob_info.mat_info.size(); ++i) // Voxel mesh building depends on which materials are transparent.
+			key.writeUInt32(ob_info.mat_info[i].opacity < 1.f ? 1 : 0);
+	}
+	key.writeFloat(ob_info.ob_to_world_scale); // Simplification error threshold depends on the object scale.
+
+	return XXH64(key.buf.data(), key.buf.size(), /*seed=*/1);
+}
+
+
+// Loads and simplifies the object geometry, and converts it to the form stored in the chunk gen cache.
+// Returns geometry with no indices if there was no geometry or it was simplified away.
+static Reference<ChunkGenCache::SimplifiedGeometry> buildSimplifiedGeometry(const ObInfo& ob_info)
+{
+	Reference<ChunkGenCache::SimplifiedGeometry> geom = new ChunkGenCache::SimplifiedGeometry();
+	geom->voxel_scale = 1.f;
+	geom->num_mats_referenced = 0;
+
+	BatchedMeshRef mesh = loadAndSimplifyGeometry(ob_info, /*voxel_scale_out=*/geom->voxel_scale);
+	if(mesh.isNull() || (mesh->numIndices() == 0))
+		return geom;
+
+	// The WorldObject material array can be smaller than the number of materials referenced
+	// by the mesh.  In this case we need to add some default/dummy materials when combining.
+	// See also ModelLoading::makeGLObjectForMeshDataAndMaterials.
+	geom->num_mats_referenced = (uint32)mesh->numMaterialsReferenced();
+
+	const size_t num_verts = mesh->numVerts();
+	const size_t vert_stride_B = mesh->vertexSize();
+
+	// If mesh has joints and weights, take the skinning transform into account.
+	// NOTE: Code duplicated from PhysicsWorld::createJoltShapeForBatchedMesh().  Factor out?
+	const AnimationData& anim_data = mesh->animation_data;
+
+	const bool use_skin_transforms = mesh->findAttribute(BatchedMesh::VertAttribute_Joints) && mesh->findAttribute(BatchedMesh::VertAttribute_Weights) &&
+		!anim_data.joint_nodes.empty();
+
+	js::Vector<Matrix4f, 16> joint_matrices;
+
+	size_t joint_offset_B, weights_offset_B;
+	BatchedMesh::ComponentType joints_component_type, weights_component_type;
+	joint_offset_B = weights_offset_B = 0;
+	joints_component_type = weights_component_type = BatchedMesh::ComponentType_UInt8;
+	if(use_skin_transforms)
+	{
+		js::Vector<Matrix4f, 16> node_matrices;
+
+		const size_t num_nodes = anim_data.sorted_nodes.size();
+		node_matrices.resizeNoCopy(num_nodes);
+
+		for(size_t n=0; n<anim_data.sorted_nodes.size(); ++n)
+		{
+			const int node_i = anim_data.sorted_nodes[n];
+			runtimeCheck(node_i >= 0 && node_i < (int)anim_data.nodes.size()); // All these indices should have been bound checked in BatchedMesh::readFromData(), check again anyway.
+			const AnimationNodeData& node_data = anim_data.nodes[node_i];
+			const Vec4f trans = node_data.trans;
+			const Quatf rot = node_data.rot;
+			const Vec4f scale = node_data.scale;
+
+			const Matrix4f rot_mat = rot.toMatrix();
+			const Matrix4f TRS(
+				rot_mat.getColumn(0) * copyToAll<0>(scale),
+				rot_mat.getColumn(1) * copyToAll<1>(scale),
+				rot_mat.getColumn(2) * copyToAll<2>(scale),
+				setWToOne(trans));
+
+			runtimeCheck(node_data.parent_index >= -1 && node_data.parent_index < (int)node_matrices.size());
+			const Matrix4f node_transform = (node_data.parent_index == -1) ? TRS : (node_matrices[node_data.parent_index] * TRS);
+			node_matrices[node_i] = node_transform;
+		}
+
+		joint_matrices.resizeNoCopy(anim_data.joint_nodes.size());
+
+		for(size_t i=0; i<anim_data.joint_nodes.size(); ++i)
+		{
+			const int node_i = anim_data.joint_nodes[i];
+			runtimeCheck(node_i >= 0 && node_i < (int)node_matrices.size() && node_i >= 0 && node_i < (int)anim_data.nodes.size());
+			joint_matrices[i] = node_matrices[node_i] * anim_data.nodes[node_i].inverse_bind_matrix;
+		}
+
+		const BatchedMesh::VertAttribute& joints_attr = mesh->getAttribute(BatchedMesh::VertAttribute_Joints);
+		joint_offset_B = joints_attr.offset_B;
+		joints_component_type = joints_attr.component_type;
+		runtimeCheck(joints_component_type == BatchedMesh::ComponentType_UInt8 || joints_component_type == BatchedMesh::ComponentType_UInt16); // See BatchedMesh::checkValidAndSanitiseMesh().
+		runtimeCheck((num_verts - 1) * vert_stride_B + joint_offset_B + BatchedMesh::vertAttributeSize(joints_attr) <= mesh->vertex_data.size());
+
+		const BatchedMesh::VertAttribute& weights_attr = mesh->getAttribute(BatchedMesh::VertAttribute_Weights);
+		weights_offset_B = weights_attr.offset_B;
+		weights_component_type = weights_attr.component_type;
+		runtimeCheck(weights_component_type == BatchedMesh::ComponentType_UInt8 || weights_component_type == BatchedMesh::ComponentType_UInt16 || weights_component_type == BatchedMesh::ComponentType_Float); // See BatchedMesh::checkValidAndSanitiseMesh().
+		runtimeCheck((num_verts - 1) * vert_stride_B + weights_offset_B + BatchedMesh::vertAttributeSize(weights_attr) <= mesh->vertex_data.size());
+	}
+
+	//------------------------------------------ Copy vert indices ------------------------------------------
+	geom->indices.reserve(mesh->numIndices());
+	for(size_t b=0; b<mesh->batches.size(); ++b)
+	{
+		const BatchedMesh::IndicesBatch& batch = mesh->batches[b];
+
+		ChunkGenCache::GeometryBatch geom_batch;
+		geom_batch.indices_start = (uint32)geom->indices.size();
+		geom_batch.num_indices = batch.num_indices;
+		geom_batch.material_index = batch.material_index;
+		runtimeCheck(batch.material_index < geom->num_mats_referenced);
+
+		if(mesh->index_type == BatchedMesh::ComponentType_UInt8)
+		{
+			for(size_t z = batch.indices_start; z < batch.indices_start + batch.num_indices; ++z)
+				geom->indices.push_back(((const uint8*)mesh->index_data.data())[z]);
+		}
+		else if(mesh->index_type == BatchedMesh::ComponentType_UInt16)
+		{
+			for(size_t z = batch.indices_start; z < batch.indices_start + batch.num_indices; ++z)
+				geom->indices.push_back(((const uint16*)mesh->index_data.data())[z]);
+		}
+		else if(mesh->index_type == BatchedMesh::ComponentType_UInt32)
+		{
+			for(size_t z = batch.indices_start; z < batch.indices_start + batch.num_indices; ++z)
+				geom->indices.push_back(((const uint32*)mesh->index_data.data())[z]);
+		}
+		else
+			throw glare::Exception("unhandled index_type");
+
+		geom->batches.push_back(geom_batch);
+	}
+
+	//------------------------------------------ Copy vertex positions ------------------------------------------
+	const BatchedMesh::VertAttribute& pos = mesh->getAttribute(BatchedMesh::VertAttribute_Position);
+	if(pos.component_type != BatchedMesh::ComponentType_Float)
+		throw glare::Exception("unhandled pos component type");
+
+	const uint8* const src_vertex_data = mesh->vertex_data.data();
+	geom->positions.resize(num_verts);
+	for(size_t i = 0; i < num_verts; ++i)
+	{
+		runtimeCheck(vert_stride_B * i + pos.offset_B + sizeof(Vec3f) <= mesh->vertex_data.size());
+
+		Vec3f v;
+		std::memcpy(&v, &mesh->vertex_data[vert_stride_B * i + pos.offset_B], sizeof(Vec3f));
+
+		Vec4f v_os = v.toVec4fPoint();
+		if(use_skin_transforms)
+			v_os = transformSkinnedVertex(v_os, joint_offset_B, weights_offset_B, joints_component_type, weights_component_type, joint_matrices, src_vertex_data, vert_stride_B, i);
+
+		geom->positions[i] = Vec3f(v_os[0], v_os[1], v_os[2]);
+	}
+
+	//------------------------------------------ Copy vertex normals ------------------------------------------
+	const BatchedMesh::VertAttribute* normal_attr = mesh->findAttribute(BatchedMesh::VertAttribute_Normal);
+	if(normal_attr)
+	{
+		if(normal_attr->component_type != BatchedMesh::ComponentType_PackedNormal)
+			throw glare::Exception("unhandled normal component type");
+
+		geom->packed_normals.resize(num_verts);
+		for(size_t i = 0; i < num_verts; ++i)
+		{
+			runtimeCheck(vert_stride_B * i + normal_attr->offset_B + sizeof(uint32) <= mesh->vertex_data.size());
+
+			uint32 packed_normal;
+			std::memcpy(&packed_normal, &mesh->vertex_data[vert_stride_B * i + normal_attr->offset_B], sizeof(uint32));
+
+			if(use_skin_transforms)
+			{
+				// TEMP: just use to-world matrix instead of inverse transpose.
+				const Vec4f n = transformSkinnedVertex(batchedMeshUnpackNormal(packed_normal), joint_offset_B, weights_offset_B, joints_component_type, weights_component_type, joint_matrices, src_vertex_data, vert_stride_B, i);
+				packed_normal = batchedMeshPackNormal(normalise(n));
+			}
+
+			geom->packed_normals[i] = packed_normal;
+		}
+	}
+	// else if no shading normal attribute is present in source mesh, geometric normals are computed when combining.
+
+	//------------------------------------------ Copy vertex UV0s ------------------------------------------
+	const BatchedMesh::VertAttribute* uv0_attr = mesh->findAttribute(BatchedMesh::VertAttribute_UV_0);
+	if(uv0_attr)
+	{
+		geom->uvs.resize(num_verts);
+		if(uv0_attr->component_type == BatchedMesh::ComponentType_Float)
+		{
+			for(size_t i = 0; i < num_verts; ++i)
+			{
+				runtimeCheck(vert_stride_B * i + uv0_attr->offset_B + sizeof(Vec2f) <= mesh->vertex_data.size());
+
+				std::memcpy(&geom->uvs[i], &mesh->vertex_data[vert_stride_B * i + uv0_attr->offset_B], sizeof(Vec2f));
+			}
+		}
+		else if(uv0_attr->component_type == BatchedMesh::ComponentType_Half)
+		{
+			for(size_t i = 0; i < num_verts; ++i)
+			{
+				runtimeCheck(vert_stride_B * i + uv0_attr->offset_B + sizeof(half) * 2 <= mesh->vertex_data.size());
+
+				half uv[2];
+				std::memcpy(&uv, &mesh->vertex_data[vert_stride_B * i + uv0_attr->offset_B], sizeof(half) * 2);
+
+				geom->uvs[i] = Vec2f(uv[0], uv[1]);
+			}
+		}
+		else
+			throw glare::Exception("unhandled uv0 component type");
+	}
+
+	return geom;
+}
+
+
+// Writes output files to paths starting with output_path_prefix.
+// Simplified object geometry, texture tiles and the encoded array texture are taken from the cache if present (cache may be NULL).
+static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, const std::string& output_path_prefix, glare::TaskManager& task_manager, ChunkGenCache* cache, int num_encoder_threads)
 {
 	ChunkBuildResults results;
 
@@ -414,16 +692,24 @@ static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int
 
 		try
 		{
-			Matrix4f voxel_scale_matrix;
-			BatchedMeshRef mesh = loadAndSimplifyGeometry(ob_info, /*voxel_scale_matrix_out=*/voxel_scale_matrix);
+			// Get the simplified object geometry from the cache, or build it and add to the cache.
+			const uint64 cache_key = cache ? geometryCacheKey(ob_info) : 0;
+			Reference<ChunkGenCache::SimplifiedGeometry> geom;
+			if(cache)
+				geom = cache->getGeometry(cache_key);
+			if(geom.isNull())
+			{
+				geom = buildSimplifiedGeometry(ob_info);
+				if(cache)
+					cache->addGeometry(cache_key, *geom);
+			}
 			
-			if(mesh.nonNull() && (mesh->numIndices() > 0))
+			if(!geom->indices.empty())
 			{
 				// The WorldObject material array can be smaller than the number of materials referenced
 				// by the mesh.  In this case we need to add some default/dummy materials.
 				// See also ModelLoading::makeGLObjectForMeshDataAndMaterials.
-				const size_t num_mats_referenced = mesh->numMaterialsReferenced();
-				if(ob_info.mat_info.size() < num_mats_referenced)
+				if(ob_info.mat_info.size() < geom->num_mats_referenced)
 				{
 					MatInfo dummy;
 					dummy.colour_rgb = Colour3f(0.7f);
@@ -431,7 +717,7 @@ static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int
 					dummy.roughness = 0.5f;
 					dummy.metallic = 0;
 					dummy.opacity = 0;
-					ob_info.mat_info.resize(num_mats_referenced, dummy);
+					ob_info.mat_info.resize(geom->num_mats_referenced, dummy);
 				}
 
 				const int object_combined_mat_infos_offset = (int)combined_mat_infos.size();
@@ -440,76 +726,9 @@ static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int
 					combined_mat_infos.push_back(ob_info.mat_info[m]);
 
 
-				const size_t num_verts = mesh->numVerts();
-				const size_t vert_stride_B = mesh->vertexSize();
-
-				// If mesh has joints and weights, take the skinning transform into account.
-				// NOTE: Code duplicated from PhysicsWorld::createJoltShapeForBatchedMesh().  Factor out?
-				const AnimationData& anim_data = mesh->animation_data;
-
-				const bool use_skin_transforms = mesh->findAttribute(BatchedMesh::VertAttribute_Joints) && mesh->findAttribute(BatchedMesh::VertAttribute_Weights) &&
-					!anim_data.joint_nodes.empty();
-
-				js::Vector<Matrix4f, 16> joint_matrices;
-
-				size_t joint_offset_B, weights_offset_B;
-				BatchedMesh::ComponentType joints_component_type, weights_component_type;
-				joint_offset_B = weights_offset_B = 0;
-				joints_component_type = weights_component_type = BatchedMesh::ComponentType_UInt8;
-				if(use_skin_transforms)
-				{
-					js::Vector<Matrix4f, 16> node_matrices;
-
-					const size_t num_nodes = anim_data.sorted_nodes.size();
-					node_matrices.resizeNoCopy(num_nodes);
-
-					for(size_t n=0; n<anim_data.sorted_nodes.size(); ++n)
-					{
-						const int node_i = anim_data.sorted_nodes[n];
-						runtimeCheck(node_i >= 0 && node_i < (int)anim_data.nodes.size()); // All these indices should have been bound checked in BatchedMesh::readFromData(), check again anyway.
-						const AnimationNodeData& node_data = anim_data.nodes[node_i];
-						const Vec4f trans = node_data.trans;
-						const Quatf rot = node_data.rot;
-						const Vec4f scale = node_data.scale;
-
-						const Matrix4f rot_mat = rot.toMatrix();
-						const Matrix4f TRS(
-							rot_mat.getColumn(0) * copyToAll<0>(scale),
-							rot_mat.getColumn(1) * copyToAll<1>(scale),
-							rot_mat.getColumn(2) * copyToAll<2>(scale),
-							setWToOne(trans));
-
-						runtimeCheck(node_data.parent_index >= -1 && node_data.parent_index < (int)node_matrices.size());
-						const Matrix4f node_transform = (node_data.parent_index == -1) ? TRS : (node_matrices[node_data.parent_index] * TRS);
-						node_matrices[node_i] = node_transform;
-					}
-
-					joint_matrices.resizeNoCopy(anim_data.joint_nodes.size());
-
-					for(size_t i=0; i<anim_data.joint_nodes.size(); ++i)
-					{
-						const int node_i = anim_data.joint_nodes[i];
-						runtimeCheck(node_i >= 0 && node_i < (int)node_matrices.size() && node_i >= 0 && node_i < (int)anim_data.nodes.size());
-						joint_matrices[i] = node_matrices[node_i] * anim_data.nodes[node_i].inverse_bind_matrix;
-					}
-
-					const BatchedMesh::VertAttribute& joints_attr = mesh->getAttribute(BatchedMesh::VertAttribute_Joints);
-					joint_offset_B = joints_attr.offset_B;
-					joints_component_type = joints_attr.component_type;
-					runtimeCheck(joints_component_type == BatchedMesh::ComponentType_UInt8 || joints_component_type == BatchedMesh::ComponentType_UInt16); // See BatchedMesh::checkValidAndSanitiseMesh().
-					runtimeCheck((num_verts - 1) * vert_stride_B + joint_offset_B + BatchedMesh::vertAttributeSize(joints_attr) <= mesh->vertex_data.size());
-
-					const BatchedMesh::VertAttribute& weights_attr = mesh->getAttribute(BatchedMesh::VertAttribute_Weights);
-					weights_offset_B = weights_attr.offset_B;
-					weights_component_type = weights_attr.component_type;
-					runtimeCheck(weights_component_type == BatchedMesh::ComponentType_UInt8 || weights_component_type == BatchedMesh::ComponentType_UInt16 || weights_component_type == BatchedMesh::ComponentType_Float); // See BatchedMesh::checkValidAndSanitiseMesh().
-					runtimeCheck((num_verts - 1) * vert_stride_B + weights_offset_B + BatchedMesh::vertAttributeSize(weights_attr) <= mesh->vertex_data.size());
-				}
-
-
+				const size_t num_verts = geom->positions.size();
 
-
-				const Matrix4f ob_to_world = ob_info.ob_to_world * voxel_scale_matrix;
+				const Matrix4f ob_to_world = ob_info.ob_to_world * Matrix4f::uniformScaleMatrix(geom->voxel_scale);
 				Matrix4f ob_normals_to_world;
 				const bool invertible = ob_to_world.getUpperLeftInverseTranspose(ob_normals_to_world);
 				if(!invertible)
@@ -520,29 +739,21 @@ static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int
 
 				// Allocate room for new verts
 				const size_t write_i_B = combined_mesh->vertex_data.size();
-				combined_mesh->vertex_data.resize(write_i_B + mesh->numVerts() * combined_mesh_vert_size);
-
-				const BatchedMesh::VertAttribute& pos = mesh->getAttribute(BatchedMesh::VertAttribute_Position);
-				if(pos.component_type != BatchedMesh::ComponentType_Float)
-					throw glare::Exception("unhandled pos component type");
-
-				
+				combined_mesh->vertex_data.resize(write_i_B + num_verts * combined_mesh_vert_size);
 
 				//------------------------------------------ Copy vert indices ------------------------------------------
 				const uint32 vert_offset = (uint32)(write_i_B / combined_mesh_vert_size);
 
-				const size_t num_indices = mesh->numIndices();
-
 				// We need to know what material is assigned to each vertex, for the 'original material index' vertex attribute.
 				// We will compute this by splatting the material assignment for each vert.  Note that multiple batches with different materials may share the same vertex.
 				std::vector<uint32> vert_combined_mat_index(num_verts);
 
 				std::vector<uint32> new_combined_indices;
-				new_combined_indices.reserve(num_indices);
+				new_combined_indices.reserve(geom->indices.size());
 
-				for(size_t b=0; b<mesh->batches.size(); ++b)
+				for(size_t b=0; b<geom->batches.size(); ++b)
 				{
-					const BatchedMesh::IndicesBatch& batch = mesh->batches[b];
+					const ChunkGenCache::GeometryBatch& batch = geom->batches[b];
 
 					const bool mat_opaque = ob_info.mat_info[batch.material_index].opacity == 1.f;
 
@@ -550,44 +761,15 @@ static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int
 
 					const uint32 combined_mat_index = object_combined_mat_infos_offset + batch.material_index;
 
-					if(mesh->index_type == BatchedMesh::ComponentType_UInt8)
+					for(size_t z = batch.indices_start; z < batch.indices_start + batch.num_indices; ++z)
 					{
-						for(size_t z = batch.indices_start; z < batch.indices_start + batch.num_indices; ++z)
-						{
-							const uint32 vert_index = ((const uint8*)mesh->index_data.data())[z]; // Index of the vertex in mesh
-							
-							vert_combined_mat_index[vert_index] = combined_mat_index;
-
-							dest_combined_indices.push_back(vert_offset + vert_index);
-							new_combined_indices.push_back(vert_offset + vert_index);
-						}
-					}
-					else if(mesh->index_type == BatchedMesh::ComponentType_UInt16)
-					{
-						for(size_t z = batch.indices_start; z < batch.indices_start + batch.num_indices; ++z)
-						{
-							const uint32 vert_index = ((const uint16*)mesh->index_data.data())[z]; // Index of the vertex in mesh
-
-							vert_combined_mat_index[vert_index] = combined_mat_index;
-
-							dest_combined_indices.push_back(vert_offset + vert_index);
-							new_combined_indices.push_back(vert_offset + vert_index);
-						}
-					}
-					else if(mesh->index_type == BatchedMesh::ComponentType_UInt32)
-					{
-						for(size_t z = batch.indices_start; z < batch.indices_start + batch.num_indices; ++z)
-						{
-							const uint32 vert_index = ((const uint32*)mesh->index_data.data())[z]; // Index of the vertex in mesh
+						const uint32 vert_index = geom->indices[z]; // Index of the vertex in geom
 
-							vert_combined_mat_index[vert_index] = combined_mat_index;
+						vert_combined_mat_index[vert_index] = combined_mat_index;
 
-							dest_combined_indices.push_back(vert_offset + vert_index);
-							new_combined_indices.push_back(vert_offset + vert_index);
-						}
+						dest_combined_indices.push_back(vert_offset + vert_index);
+						new_combined_indices.push_back(vert_offset + vert_index);
 					}
-					else
-						throw glare::Exception("unhandled index_type");
 				}
 
 				//------------------------------------------ Set material index vertex attribute values ------------------------------------------
@@ -599,20 +781,10 @@ static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int
 				}
 				
 				//------------------------------------------ Copy vertex positions ------------------------------------------
-				const uint8* const src_vertex_data = mesh->vertex_data.data();
 				for(size_t i = 0; i < num_verts; ++i)
 				{
-					runtimeCheck(vert_stride_B * i + pos.offset_B + sizeof(Vec3f) <= mesh->vertex_data.size());
-
-					Vec3f v;
-					std::memcpy(&v, &mesh->vertex_data[vert_stride_B * i + pos.offset_B], sizeof(Vec3f));
-
-					Vec4f v_os = v.toVec4fPoint();
-					if(use_skin_transforms)
-						v_os = transformSkinnedVertex(v_os, joint_offset_B, weights_offset_B, joints_component_type, weights_component_type, joint_matrices, src_vertex_data, vert_stride_B, i);
-
 					// Compute world-space vertex position
-					const Vec4f new_v_vec4f = ob_to_world * v_os;
+					const Vec4f new_v_vec4f = ob_to_world * geom->positions[i].toVec4fPoint();
 
 					aabb_os.enlargeToHoldPoint(new_v_vec4f);
 
@@ -620,33 +792,18 @@ static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int
 				}
 
 				//------------------------------------------ Copy or compute vertex normals ------------------------------------------
-				const BatchedMesh::VertAttribute* normal_attr = mesh->findAttribute(BatchedMesh::VertAttribute_Normal);
-				if(normal_attr)
+				if(!geom->packed_normals.empty())
 				{
-					if(normal_attr->component_type == BatchedMesh::ComponentType_PackedNormal)
+					for(size_t i = 0; i < num_verts; ++i)
 					{
-						for(size_t i = 0; i < num_verts; ++i)
-						{
-							runtimeCheck(vert_stride_B * i + normal_attr->offset_B + sizeof(uint32) <= mesh->vertex_data.size());
+						const Vec4f n = batchedMeshUnpackNormal(geom->packed_normals[i]);
 
-							uint32 packed_normal;
-							std::memcpy(&packed_normal, &mesh->vertex_data[vert_stride_B * i + normal_attr->offset_B], sizeof(uint32));
+						const Vec4f new_n = normalise(ob_normals_to_world * n);
 
-							Vec4f n = batchedMeshUnpackNormal(packed_normal);
+						const uint32 new_packed_normal = batchedMeshPackNormal(new_n);
 
-							if(use_skin_transforms)
-								// TEMP: just use to-world matrix instead of inverse transpose.
-								n = transformSkinnedVertex(n, joint_offset_B, weights_offset_B, joints_component_type, weights_component_type, joint_matrices, src_vertex_data, vert_stride_B, i);
-
-							const Vec4f new_n = normalise(ob_normals_to_world * n);
-
-							const uint32 new_packed_normal = batchedMeshPackNormal(new_n);
-
-							std::memcpy(&combined_mesh->vertex_data[write_i_B + combined_mesh_vert_size * i + combined_mesh_normal_offset_B], &new_packed_normal, sizeof(uint32));
-						}
+						std::memcpy(&combined_mesh->vertex_data[write_i_B + combined_mesh_vert_size * i + combined_mesh_normal_offset_B], &new_packed_normal, sizeof(uint32));
 					}
-					else
-						throw glare::Exception("unhandled normal component type");
 				}
 				else
 				{
@@ -660,10 +817,6 @@ static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int
 						const uint32 v2 = new_combined_indices[i + 2];
 
 						// Read transformed vertex positions
-						runtimeCheck(combined_mesh_vert_size * v0 + sizeof(Vec3f) <= combined_mesh->vertex_data.size());
-						runtimeCheck(combined_mesh_vert_size * v1 + sizeof(Vec3f) <= combined_mesh->vertex_data.size());
-						runtimeCheck(combined_mesh_vert_size * v2 + sizeof(Vec3f) <= combined_mesh->vertex_data.size());
-
 						Vec3f v0pos, v1pos, v2pos;
 						std::memcpy(&v0pos, &combined_mesh->vertex_data[combined_mesh_vert_size * v0], sizeof(Vec3f));
 						std::memcpy(&v1pos, &combined_mesh->vertex_data[combined_mesh_vert_size * v1], sizeof(Vec3f));
@@ -674,10 +827,6 @@ static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int
 						const uint32 new_packed_normal = batchedMeshPackNormal(new_n.toVec4fVector());
 
 						// Write the new geometric normal for the vertices v0, v1, v2
-						runtimeCheck(combined_mesh_vert_size * v0 + combined_mesh_normal_offset_B + sizeof(Vec3f) <= combined_mesh->vertex_data.size());
-						runtimeCheck(combined_mesh_vert_size * v1 + combined_mesh_normal_offset_B + sizeof(Vec3f) <= combined_mesh->vertex_data.size());
-						runtimeCheck(combined_mesh_vert_size * v2 + combined_mesh_normal_offset_B + sizeof(Vec3f) <= combined_mesh->vertex_data.size());
-										
 						std::memcpy(&combined_mesh->vertex_data[combined_mesh_vert_size * v0 + combined_mesh_normal_offset_B], &new_packed_normal, sizeof(uint32));
 						std::memcpy(&combined_mesh->vertex_data[combined_mesh_vert_size * v1 + combined_mesh_normal_offset_B], &new_packed_normal, sizeof(uint32));
 						std::memcpy(&combined_mesh->vertex_data[combined_mesh_vert_size * v2 + combined_mesh_normal_offset_B], &new_packed_normal, sizeof(uint32));
@@ -685,50 +834,16 @@ static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int
 				}
 
 				//------------------------------------------ Copy vertex UV0s ------------------------------------------
-				const BatchedMesh::VertAttribute* uv0_attr = mesh->findAttribute(BatchedMesh::VertAttribute_UV_0);
-				if(uv0_attr)
-				{
-					if(uv0_attr->component_type == BatchedMesh::ComponentType_Float)
-					{
-						for(size_t i = 0; i < num_verts; ++i)
-						{
-							runtimeCheck(vert_stride_B * i + uv0_attr->offset_B + sizeof(Vec2f) <= mesh->vertex_data.size());
-
-							std::memcpy(
-								/*dest=*/&combined_mesh->vertex_data[write_i_B + combined_mesh_vert_size * i + combined_mesh_uv0_offset_B], 
-								/*src=*/&mesh->vertex_data[vert_stride_B * i + uv0_attr->offset_B], 
-								/*size=*/sizeof(Vec2f));
-						}
-					}
-					else if(uv0_attr->component_type == BatchedMesh::ComponentType_Half)
-					{
-						for(size_t i = 0; i < num_verts; ++i)
-						{
-							runtimeCheck(vert_stride_B * i + uv0_attr->offset_B + sizeof(half) * 2 <= mesh->vertex_data.size());
-
-							half uv[2];
-							std::memcpy(&uv, &mesh->vertex_data[vert_stride_B * i + uv0_attr->offset_B], sizeof(half) * 2);
-
-							const Vec2f new_uv(uv[0], uv[1]);
-							std::memcpy(&combined_mesh->vertex_data[write_i_B + combined_mesh_vert_size * i + combined_mesh_uv0_offset_B], &new_uv, sizeof(Vec2f));
-						}
-					}
-					else
-						throw glare::Exception("unhandled uv0 component type");
-				}
-				else // else UV0 was not present in source mesh, so just write out (0,0) uvs.
+				for(size_t i = 0; i < num_verts; ++i)
 				{
-					for(size_t i = 0; i < num_verts; ++i)
-					{
-						const Vec2f new_uv(0.f, 0.f);
-						std::memcpy(&combined_mesh->vertex_data[write_i_B + combined_mesh_vert_size * i + combined_mesh_uv0_offset_B], &new_uv, sizeof(Vec2f));
-					}
+					const Vec2f new_uv = geom->uvs.empty() ? Vec2f(0.f, 0.f) : geom->uvs[i]; // If UV0 was not present in source mesh, just write out (0,0) uvs.
+					std::memcpy(&combined_mesh->vertex_data[write_i_B + combined_mesh_vert_size * i + combined_mesh_uv0_offset_B], &new_uv, sizeof(Vec2f));
 				}
 
 				num_obs_combined++;
-				num_batches_combined += mesh->batches.size();
+				num_batches_combined += geom->batches.size();
 
-			} // end if(mesh.nonNull())
+			} // end if(!geom->indices.empty())
 		}
 		catch(glare::Exception& e)
 		{
@@ -823,7 +938,7 @@ static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int
 		std::map<std::string, int> array_image_indices; // Index of texture in texture array.
 		// There will be no entry in the map for the path if the texture could not be loaded.
 
-		buildAndSaveArrayTexture(used_tex_paths, task_manager, chunk_x, chunk_y, 
+		buildAndSaveArrayTexture(used_tex_paths, task_manager, cache, num_encoder_threads, /*output path=*/output_path_prefix + "_array_texture.basis", 
 			array_image_indices, // array_image_indices_out
 			results.combined_texture_path, // combined_texture_path_out
 			results.combined_texture_hash // combined_texture_hash_out
@@ -865,7 +980,7 @@ static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int
 
 		// Write combined mesh to disk
 		conPrint("Writing combined mesh to disk...");
-		const std::string path = "d:/tempfiles/chunk_256_" + toString(chunk_x) + "_" + toString(chunk_y) + ".bmesh";
+		const std::string path = output_path_prefix + ".bmesh";
 		combined_mesh->writeToFile(path);
 
 		printVar(num_obs_combined);
@@ -881,7 +996,7 @@ static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int
 		if(true)
 		{
 			conPrint("Writing mat info to disk...");
-			FileOutStream file("d:/tempfiles/mat_info_" + toString(chunk_x) + "_" + toString(chunk_y) + ".bin");
+			FileOutStream file(output_path_prefix + "_mat_info.bin");
 
 			for(size_t i=0; i<output_mat_infos.size(); ++i)
 				file.writeData(&output_mat_infos[i], sizeof(OutputMatInfo));
@@ -896,281 +1011,361 @@ static ChunkBuildResults buildChunkForObInfo(std::vector<ObInfo>& ob_infos, int
 }
 
 
-static ChunkBuildResults buildChunk(ServerAllWorldsState* world_state, Reference<ServerWorldState> world, const js::AABBox chunk_aabb, int chunk_x, int chunk_y, glare::TaskManager& task_manager)
+// Get info about the objects in the chunk that we need to build the chunk mesh and texture.
+// Uses the world's LOD chunk object index, so we don't need to iterate over all objects in the world.
+static void getObInfosForChunk(ServerAllWorldsState* world_state, ServerWorldState* world, const Vec3i& chunk_coords, std::vector<ObInfo>& ob_infos_out, WorldStateLock& lock)
 {
-	conPrint("================================= Building chunk " + toString(chunk_x) + ", " + toString(chunk_y) + " =================================");
-	std::vector<ObInfo> ob_infos;
+	const std::unordered_set<WorldObject*>* chunk_obs = world->getLODChunkObjectIndex(lock).getObjectsInChunk(chunk_coords);
+	if(!chunk_obs)
+		return;
 
+	for(auto it = chunk_obs->begin(); it != chunk_obs->end(); ++it)
 	{
-		WorldStateLock lock(world_state->mutex);
-		ServerWorldState::ObjectMapType& objects = world->getObjects(lock);
-		for(auto it = objects.begin(); it != objects.end(); ++it)
+		WorldObject* ob = *it;
+
+		bool have_mesh = false;
+		if(ob->object_type == WorldObject::ObjectType_Generic)
 		{
-			WorldObjectRef ob = it->second;
-			if(chunk_aabb.contains(ob->getCentroidWS())) // ob->pos.toVec4fPoint()))
+			if(!ob->model_url.empty())
 			{
-				bool have_mesh = false;
-				if(ob->object_type == WorldObject::ObjectType_Generic)
-				{
-					if(!ob->model_url.empty())
-					{
-						const std::string model_path = world_state->resource_manager->pathForURL(ob->model_url);
-						if(FileUtils::fileExists(model_path))
-							have_mesh = true;
-					}
-				}
-				else if(ob->object_type == WorldObject::ObjectType_VoxelGroup)
-				{
-					if(ob->getCompressedVoxels().size() > 0)
-						have_mesh = true;
-				}
+				const std::string model_path = world_state->resource_manager->pathForURL(ob->model_url);
+				if(FileUtils::fileExists(model_path))
+					have_mesh = true;
+			}
+		}
+		else if(ob->object_type == WorldObject::ObjectType_VoxelGroup)
+		{
+			if(ob->getCompressedVoxels().size() > 0)
+				have_mesh = true;
+		}
+
+
+		if(have_mesh)
+		{
+			if(!isFinite(ob->angle))
+				ob->angle = 0;
 
+			if(/*!isFinite(ob->angle) || */!ob->axis.isFinite())
+			{
+				//	throw glare::Exception("Invalid angle or axis");
+			}
+			else
+			{
+				ObInfo ob_info;
+
+				if(!ob->model_url.empty())
+					ob_info.model_path = world_state->resource_manager->pathForURL(ob->model_url);
+				
+				ob_info.compressed_voxels = ob->getCompressedVoxels();
 
-				if(have_mesh)
+				ob_info.ob_to_world = obToWorldMatrix(*ob);
+				ob_info.ob_to_world_scale = myMax(ob->scale.x, ob->scale.y, ob->scale.z);
+				ob_info.object_type = ob->object_type;
+				ob_info.aabb_ws = ob->getAABBWS();
+
+				ob_info.mat_info.resize(ob->materials.size());
+				
+				for(size_t i=0; i<ob->materials.size(); ++i)
 				{
-					if(!isFinite(ob->angle))
-						ob->angle = 0;
+					WorldMaterial* mat = ob->materials[i].ptr();
 
-					if(/*!isFinite(ob->angle) || */!ob->axis.isFinite())
-					{
-						//	throw glare::Exception("Invalid angle or axis");
-					}
-					else
+					ob_info.mat_info[i].tex_matrix = mat->tex_matrix;
+
+					if(!mat->colour_texture_url.empty())
 					{
-						ObInfo ob_info;
-
-						if(!ob->model_url.empty())
-							ob_info.model_path = world_state->resource_manager->pathForURL(ob->model_url);
-						
-						ob_info.compressed_voxels = ob->getCompressedVoxels();
-
-						ob_info.ob_to_world = obToWorldMatrix(*ob);
-						ob_info.ob_to_world_scale = myMax(ob->scale.x, ob->scale.y, ob->scale.z);
-						ob_info.object_type = ob->object_type;
-						ob_info.aabb_ws = ob->getAABBWS();
-
-						ob_info.mat_info.resize(ob->materials.size());
-						
-						for(size_t i=0; i<ob->materials.size(); ++i)
-						{
-							WorldMaterial* mat = ob->materials[i].ptr();
-
-							ob_info.mat_info[i].tex_matrix = mat->tex_matrix;
-
-							if(!mat->colour_texture_url.empty())
-							{
-								const std::string tex_path = world_state->resource_manager->pathForURL(mat->colour_texture_url);
-								ob_info.mat_info[i].tex_path = tex_path;
-							}
-
-							ob_info.mat_info[i].emission_lum_flux_or_lum = mat->emission_lum_flux_or_lum;
-							ob_info.mat_info[i].roughness = mat->roughness.val;
-							ob_info.mat_info[i].metallic = mat->metallic_fraction.val;
-							ob_info.mat_info[i].colour_rgb = mat->colour_rgb;
-							ob_info.mat_info[i].opacity = mat->opacity.val;
-							//ob_info.mat_info[i].flags = OpenGLEngine::matFlags(*mat);
-						}
-
-
-						ob_infos.push_back(ob_info);
+						const std::string tex_path = world_state->resource_manager->pathForURL(mat->colour_texture_url);
+						ob_info.mat_info[i].tex_path = tex_path;
 					}
+
+					ob_info.mat_info[i].emission_lum_flux_or_lum = mat->emission_lum_flux_or_lum;
+					ob_info.mat_info[i].roughness = mat->roughness.val;
+					ob_info.mat_info[i].metallic = mat->metallic_fraction.val;
+					ob_info.mat_info[i].colour_rgb = mat->colour_rgb;
+					ob_info.mat_info[i].opacity = mat->opacity.val;
+					//ob_info.mat_info[i].flags = OpenGLEngine::matFlags(*mat);
 				}
-			}
-		}
-	} // End lock scope.
 
 
-	ChunkBuildResults results = buildChunkForObInfo(ob_infos, chunk_x, chunk_y, task_manager);
-	conPrint("================================= chunk " + toString(chunk_x) + ", " + toString(chunk_y) + " built. =================================");
-	return results;
+				ob_infos_out.push_back(ob_info);
+			}
+		}
+	}
 }
 
 
-static const float chunk_w = 128;
-
-static void addNewChunksIfNeeded(ServerAllWorldsState* all_worlds_state, const std::string& world_name, ServerWorldState* world_state, WorldStateLock& lock)
+// Builds a single chunk.  Chunks are independent of each other so can be built in parallel.
+class ChunkBuildTask : public glare::Task
 {
-	conPrint("ChunkGenThread::addNewChunksIfNeeded(), world_name: '" + world_name + "'");
-	int num_new_chunks_added = 0;
-	Timer timer;
-
-	ServerWorldState::ObjectMapType& objects = world_state->getObjects(lock);
-	for(auto it = objects.begin(); it != objects.end(); ++it)
+public:
+	virtual void run(size_t thread_index)
 	{
-		const WorldObject* ob = it->second.ptr();
-		const Vec4f centroid = ob->getCentroidWS();
-		const int chunk_x = Maths::floorToInt(centroid[0] / chunk_w);
-		const int chunk_y = Maths::floorToInt(centroid[1] / chunk_w);
-		const Vec3i chunk_coords(chunk_x, chunk_y, 0);
-		if(world_state->getLODChunks(lock).count(chunk_coords) == 0)
+		try
 		{
-			// Need new chunk
-			conPrint("Adding new LODChunk with coords " + chunk_coords.toString());
+			conPrint("================================= Building chunk " + chunk->coords.toString() + " (" + toString(ob_infos.size()) + " object(s)) =================================");
+			Timer timer;
 
-			LODChunkRef chunk = new LODChunk();
-			chunk->coords = chunk_coords;
-			chunk->needs_rebuild = true;
+			results = buildChunkForObInfo(ob_infos, output_path_prefix, *inner_task_manager, cache, num_encoder_threads);
 
-			// Add to world state, mark as db-dirty so gets saved to disk.
-			world_state->getLODChunks(lock).insert(std::make_pair(chunk_coords, chunk));
-			world_state->addLODChunkAsDBDirty(chunk, lock);
-			all_worlds_state->markAsChanged();
+			conPrint("================================= chunk " + chunk->coords.toString() + " built in " + timer.elapsedStringNSigFigs(4) + ". =================================");
+			succeeded = true;
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("ChunkGenThread: Error while building chunk " + chunk->coords.toString() + ": " + e.what());
+		}
+		catch(std::bad_alloc&)
+		{
+			conPrint("ChunkGenThread: Caught std::bad_alloc while building chunk " + chunk->coords.toString());
 		}
 	}
 
-	conPrint("ChunkGenThread::addNewChunksIfNeeded() done.  Added " + toString(num_new_chunks_added) + " new chunks.  Elapsed: " + timer.elapsedStringMSWIthNSigFigs(4));
-}
+	LODChunkRef chunk;
+	Reference<ServerWorldState> world_state;
+	std::vector<ObInfo> ob_infos;
+	std::string output_path_prefix;
+	glare::TaskManager* inner_task_manager; // Used for removeInvisibleTriangles and texture resizing.  Separate from the task manager running this task.
+	ChunkGenCache* cache;
+	int num_encoder_threads;
+
+	ChunkBuildResults results;
+	bool succeeded;
+};
 
 
-void ChunkGenThread::doRun()
+// Copy the built chunk files into the resource system, and update the chunk object if it has changed.
+static void processBuiltChunk(ServerAllWorldsState* all_worlds_state, ChunkBuildTask& task)
 {
-	PlatformUtils::setCurrentThreadName("ChunkGenThread");
+	const ChunkBuildResults& results = task.results;
+	LODChunk* chunk = task.chunk.ptr();
+
+	//------------ Build compressed mat_info ------------
+	js::Vector<uint8> compressed_data(ZSTD_compressBound(results.output_mat_infos.dataSizeBytes()));
+
+	const size_t compressed_size = ZSTD_compress(/*dest=*/compressed_data.data(), /*dest capacity=*/compressed_data.size(), /*src=*/results.output_mat_infos.data(), /*src size=*/results.output_mat_infos.dataSizeBytes(),
+		ZSTD_CLEVEL_DEFAULT // compression level  TODO: use higher level? test a few.
+	);
+	if(ZSTD_isError(compressed_size))
+		throw glare::Exception(std::string("Compression failed: ") + ZSTD_getErrorName(compressed_size));
+	compressed_data.resize(compressed_size);
+	//---------------------------------------------------
+
+	// Copy combined mesh and texture array files into resource system.
+	std::string mesh_URL;
+	if(!results.combined_mesh_path.empty())
+	{
+		mesh_URL = ResourceManager::URLForPathAndHash(results.combined_mesh_path, results.combined_mesh_hash);
+		if(!all_worlds_state->resource_manager->isFileForURLPresent(mesh_URL))
+		{
+			all_worlds_state->resource_manager->copyLocalFileToResourceDir(results.combined_mesh_path, mesh_URL);
+			all_worlds_state->addResourcesAsDBDirty(all_worlds_state->resource_manager->getOrCreateResourceForURL(mesh_URL));
+		}
+	}
+
+	std::string tex_URL;
+	if(!results.combined_texture_path.empty())
+	{
+		tex_URL = ResourceManager::URLForPathAndHash(results.combined_texture_path, results.combined_texture_hash);
+		if(!all_worlds_state->resource_manager->isFileForURLPresent(tex_URL))
+		{
+			all_worlds_state->resource_manager->copyLocalFileToResourceDir(results.combined_texture_path, tex_URL);
+			all_worlds_state->addResourcesAsDBDirty(all_worlds_state->resource_manager->getOrCreateResourceForURL(tex_URL));
+		}
+	}
 
-	glare::TaskManager task_manager;
+	// Update the chunk object if it has changed.  Mark chunk as db-dirty so it gets saved to disk, and queue it to be sent to clients.
+	{
+		WorldStateLock lock(all_worlds_state->mutex);
+		
+		const bool chunk_changed = 
+			(chunk->mesh_url != mesh_URL) || 
+			(chunk->combined_array_texture_url != tex_URL) ||
+			(chunk->compressed_mat_info != compressed_data);
 
-	Timer timer;
+		chunk->needs_rebuild = false;
+		chunk->db_dirty = true;
 
+		if(chunk_changed)
+		{
+			chunk->mesh_url = mesh_URL;
+			chunk->combined_array_texture_url = tex_URL;
+			chunk->compressed_mat_info = compressed_data;
 
-	struct ChunkToBuild
-	{
-		LODChunkRef chunk;
-		Reference<ServerWorldState> world_state;
-	};
+			task.world_state->getLODChunksToSend(lock).insert(chunk->coords); // The main server thread will send a LODChunkUpdatedMessage to clients.
+		}
 
-	try
+		task.world_state->addLODChunkAsDBDirty(chunk, lock);
+		all_worlds_state->markAsChanged();
+	}
+}
+
+
+// Marks the chunk as needing a rebuild, creating it if it doesn't exist, and adds it to chunks_to_build.
+static void addChunkToBuild(ServerAllWorldsState* all_worlds_state, Reference<ServerWorldState> world_state, const Vec3i& chunk_coords, std::vector<ChunkGenThread::ChunkToBuild>& chunks_to_build, WorldStateLock& lock)
+{
+	LODChunkRef chunk;
+	auto res = world_state->getLODChunks(lock).find(chunk_coords);
+	if(res == world_state->getLODChunks(lock).end())
 	{
-#if 0
-		{
-			Reference<ServerWorldState> root_world_state = all_worlds_state->getRootWorldState();
-			
-			//for(int x=-4; x<4; ++x)
-			//for(int y=-4; y<4; ++y)
-			int x = 0;
-			int y = 0;
-			{
-				// Compute chunk AABB
-				const js::AABBox chunk_aabb(
-					Vec4f(x * chunk_w, y * chunk_w, -1000.f, 1.f), // min
-					Vec4f((x + 1) * chunk_w, (y + 1) * chunk_w, 1000.f, 1.f) // max
-				);
+		if(!world_state->getLODChunkObjectIndex(lock).getObjectsInChunk(chunk_coords))
+			return; // Don't create chunks with no objects in them.
 
-				buildChunk(all_worlds_state, root_world_state, chunk_aabb, x, y, task_manager);
-			}
+		conPrint("Adding new LODChunk with coords " + chunk_coords.toString());
 
-			conPrint("ChunkGenThread: Done. (Elapsed: " + timer.elapsedStringNSigFigs(4));
+		chunk = new LODChunk();
+		chunk->coords = chunk_coords;
+		world_state->getLODChunks(lock).insert(std::make_pair(chunk_coords, chunk));
+	}
+	else
+		chunk = res->second;
 
-			return; // Just run once for now.
-		}
-#endif
+	if(!chunk->needs_rebuild)
+	{
+		// Mark as db-dirty so the needs_rebuild flag gets saved to disk, and the chunk will be rebuilt even if the server is restarted before building it.
+		chunk->needs_rebuild = true;
+		world_state->addLODChunkAsDBDirty(chunk, lock);
+		all_worlds_state->markAsChanged();
+	}
 
+	chunks_to_build.push_back({chunk, world_state});
+}
 
-		while(1)
-		{
-			
-			std::vector<ChunkToBuild> dirty_chunks;
 
-			{
-				WorldStateLock lock(all_worlds_state->mutex);
-				for(auto it = all_worlds_state->world_states.begin(); it != all_worlds_state->world_states.end(); ++it)
-				{
-					ServerWorldState* world_state = it->second.ptr();
+void ChunkGenThread::buildChunks(const std::vector<ChunkToBuild>& chunks_to_build, glare::TaskManager& chunk_task_manager, glare::TaskManager& inner_task_manager, ChunkGenCache& cache)
+{
+	if(chunks_to_build.empty())
+		return;
 
-					addNewChunksIfNeeded(all_worlds_state, it->first, world_state, lock);
+	conPrint("ChunkGenThread: Building " + toString(chunks_to_build.size()) + " chunk(s) with " + toString(chunk_task_manager.getNumThreads()) + " thread(s)...");
+	Timer timer;
 
+	const int num_encoder_threads = (int)myMax<size_t>(1, PlatformUtils::getNumLogicalProcessors() / chunk_task_manager.getNumThreads());
 
-					for(auto chunk_it = world_state->getLODChunks(lock).begin(); chunk_it != world_state->getLODChunks(lock).end(); ++chunk_it)
-					{
-						LODChunk* chunk = chunk_it->second.ptr();
+	// Get the objects in each chunk
+	std::vector<Reference<ChunkBuildTask>> tasks(chunks_to_build.size());
+	{
+		WorldStateLock lock(all_worlds_state->mutex);
+		for(size_t i=0; i<chunks_to_build.size(); ++i)
+		{
+			tasks[i] = new ChunkBuildTask();
+			tasks[i]->chunk = chunks_to_build[i].chunk;
+			tasks[i]->world_state = chunks_to_build[i].world_state;
+			tasks[i]->output_path_prefix = temp_dir + "/chunk_" + toString(i) + "_" + toString(chunks_to_build[i].chunk->coords.x) + "_" + toString(chunks_to_build[i].chunk->coords.y);
+			tasks[i]->inner_task_manager = &inner_task_manager;
+			tasks[i]->cache = &cache;
+			tasks[i]->num_encoder_threads = num_encoder_threads;
+			tasks[i]->succeeded = false;
+
+			getObInfosForChunk(all_worlds_state, chunks_to_build[i].world_state.ptr(), chunks_to_build[i].chunk->coords, tasks[i]->ob_infos, lock);
+		}
+	}
 
-						//if(it->first == "")// && chunk->coords == Vec3i(0, 0, 0)) // if main world
-						//	chunk->needs_rebuild = true;
+	for(size_t i=0; i<tasks.size(); ++i)
+		chunk_task_manager.addTask(tasks[i]);
+	chunk_task_manager.waitForTasksToComplete();
 
-						if(chunk->needs_rebuild)
-							dirty_chunks.push_back({chunk, world_state});
-					}
-				}
+	size_t num_built = 0;
+	for(size_t i=0; i<tasks.size(); ++i)
+	{
+		if(tasks[i]->succeeded)
+		{
+			// Catch exceptions here, so that an error processing one chunk doesn't stop the other chunks being processed, or stop this thread.
+			try
+			{
+				processBuiltChunk(all_worlds_state, *tasks[i]);
+				num_built++;
+			}
+			catch(glare::Exception& e)
+			{
+				conPrint("ChunkGenThread: Error while processing built chunk " + tasks[i]->chunk->coords.toString() + ": " + e.what());
 			}
+			catch(std::bad_alloc&)
+			{
+				conPrint("ChunkGenThread: Caught std::bad_alloc while processing built chunk " + tasks[i]->chunk->coords.toString());
+			}
+		}
+	}
 
+	const ChunkGenCache::Stats stats = cache.getStats();
+	conPrint("ChunkGenThread: Built " + toString(num_built) + " / " + toString(chunks_to_build.size()) + " chunk(s) in " + timer.elapsedStringNSigFigs(4) + 
+		".  Cache totals: geometry " + toString(stats.geometry_hits) + " hits / " + toString(stats.geometry_misses) + " misses, texture tiles " + toString(stats.tile_hits) + " / " + toString(stats.tile_misses) + 
+		", array textures " + toString(stats.array_hits) + " / " + toString(stats.array_misses));
+}
 
-			for(size_t i=0; i<dirty_chunks.size(); ++i)
-			{
-				LODChunkRef chunk = dirty_chunks[i].chunk;
-				const int x = chunk->coords.x;
-				const int y = chunk->coords.y;
 
-				// Compute chunk AABB
-				const js::AABBox chunk_aabb(
-					Vec4f(x       * chunk_w, y       * chunk_w, -10000.f, 1.f), // min
-					Vec4f((x + 1) * chunk_w, (y + 1) * chunk_w,  10000.f, 1.f) // max
-				);
+// Returns true if we got a kill message.
+static bool waitForKillMessage(ThreadSafeQueue<ThreadMessageRef>& queue, double wait_time_s)
+{
+	ThreadMessageRef msg;
+	const bool got_msg = queue.dequeueWithTimeout(wait_time_s, msg);
+	return got_msg && dynamic_cast<KillThreadMessage*>(msg.ptr());
+}
 
-				const ChunkBuildResults results = buildChunk(all_worlds_state, dirty_chunks[i].world_state, chunk_aabb, x, y, task_manager);
 
+void ChunkGenThread::doRun()
+{
+	PlatformUtils::setCurrentThreadName("ChunkGenThread");
 
-				//------------ Build compressed mat_info ------------
-				js::Vector<uint8> compressed_data(ZSTD_compressBound(results.output_mat_infos.dataSizeBytes()));
+	// Chunk builds use a lot of memory and the texture encoder is multithreaded, so only build a few chunks at once.
+	glare::TaskManager chunk_task_manager("ChunkGenThread chunk task manager", myClamp<size_t>(PlatformUtils::getNumLogicalProcessors() / 4, 1, 4));
+	glare::TaskManager inner_task_manager("ChunkGenThread task manager");
+	ChunkGenCache cache(cache_dir);
 
-				const size_t compressed_size = ZSTD_compress(/*dest=*/compressed_data.data(), /*dest capacity=*/compressed_data.size(), /*src=*/results.output_mat_infos.data(), /*src size=*/results.output_mat_infos.dataSizeBytes(),
-					ZSTD_CLEVEL_DEFAULT // compression level  TODO: use higher level? test a few.
-				);
-				if(ZSTD_isError(compressed_size))
-					throw glare::Exception(std::string("Compression failed: ") + ZSTD_getErrorName(compressed_size));
-				compressed_data.resize(compressed_size);
-				//---------------------------------------------------
+	const double POLL_PERIOD = 2.0; // How often to check for dirty chunks (s)
+	const double SETTLE_TIME = 5.0; // Wait until a chunk hasn't changed for this long before rebuilding it, so we don't rebuild on every step of e.g. an object being dragged around.
+	const double MAX_WAIT_TIME = 60.0; // Rebuild chunks with continuously changing objects at least this often.
 
-				// Copy combined mesh and texture array files into resource system.
-				std::string mesh_URL;
-				if(!results.combined_mesh_path.empty())
-				{
-					mesh_URL = ResourceManager::URLForPathAndHash(results.combined_mesh_path, results.combined_mesh_hash);
-					if(!all_worlds_state->resource_manager->isFileForURLPresent(mesh_URL))
-					{
-						all_worlds_state->resource_manager->copyLocalFileToResourceDir(results.combined_mesh_path, mesh_URL);
-						all_worlds_state->addResourcesAsDBDirty(all_worlds_state->resource_manager->getOrCreateResourceForURL(mesh_URL));
-					}
-				}
+	try
+	{
+		FileUtils::createDirIfDoesNotExist(temp_dir);
 
-				std::string tex_URL;
-				if(!results.combined_texture_path.empty())
+		// At startup, create any missing chunks, and rebuild any chunks that were marked as needing a rebuild before the server was restarted.
+		{
+			Timer timer;
+			std::vector<ChunkToBuild> chunks_to_build;
+			{
+				WorldStateLock lock(all_worlds_state->mutex);
+				for(auto it = all_worlds_state->world_states.begin(); it != all_worlds_state->world_states.end(); ++it)
 				{
-					tex_URL = ResourceManager::URLForPathAndHash(results.combined_texture_path, results.combined_texture_hash);
-					if(!all_worlds_state->resource_manager->isFileForURLPresent(tex_URL))
-					{
-						all_worlds_state->resource_manager->copyLocalFileToResourceDir(results.combined_texture_path, tex_URL);
-						all_worlds_state->addResourcesAsDBDirty(all_worlds_state->resource_manager->getOrCreateResourceForURL(mesh_URL));
-					}
+					Reference<ServerWorldState> world_state = it->second;
+
+					for(auto chunk_it = world_state->getLODChunks(lock).begin(); chunk_it != world_state->getLODChunks(lock).end(); ++chunk_it)
+						if(chunk_it->second->needs_rebuild)
+							chunks_to_build.push_back({chunk_it->second, world_state});
+
+					std::vector<Vec3i> non_empty_chunks;
+					world_state->getLODChunkObjectIndex(lock).getNonEmptyChunks(non_empty_chunks);
+					for(size_t i=0; i<non_empty_chunks.size(); ++i)
+						if(world_state->getLODChunks(lock).count(non_empty_chunks[i]) == 0)
+							addChunkToBuild(all_worlds_state, world_state, non_empty_chunks[i], chunks_to_build, lock);
 				}
+			}
+			conPrint("ChunkGenThread: " + toString(chunks_to_build.size()) + " chunk(s) to build at startup (found in " + timer.elapsedStringMSWIthNSigFigs(4) + ")");
 
-				// Update the chunk object if it has changed.  Mark chunk as db-dirty so it gets saved to disk.
-				{
-					WorldStateLock lock(all_worlds_state->mutex);
-					
-					const bool chunk_changed = 
-						(chunk->mesh_url != mesh_URL) || 
-						(chunk->combined_array_texture_url != tex_URL) ||
-						(chunk->compressed_mat_info != compressed_data);
-
-					if(chunk_changed)
-					{
-						chunk->mesh_url = mesh_URL;
-						chunk->combined_array_texture_url = tex_URL;
-						chunk->compressed_mat_info = compressed_data;
+			buildChunks(chunks_to_build, chunk_task_manager, inner_task_manager, cache);
+		}
 
-						chunk->needs_rebuild = false;
-						chunk->db_dirty = true;
+		// Rebuild chunks as objects in them change.
+		while(1)
+		{
+			if(waitForKillMessage(getMessageQueue(), POLL_PERIOD))
+				return;
 
-						dirty_chunks[i].world_state->addLODChunkAsDBDirty(chunk, lock);
+			std::vector<ChunkToBuild> chunks_to_build;
+			{
+				WorldStateLock lock(all_worlds_state->mutex);
+				const double cur_time = Clock::getCurTimeRealSec();
+				for(auto it = all_worlds_state->world_states.begin(); it != all_worlds_state->world_states.end(); ++it)
+				{
+					Reference<ServerWorldState> world_state = it->second;
 
-						all_worlds_state->markAsChanged();
-					}
+					std::vector<Vec3i> dirty_chunks;
+					world_state->getLODChunkObjectIndex(lock).takeDirtyChunks(cur_time, SETTLE_TIME, MAX_WAIT_TIME, dirty_chunks);
+					for(size_t i=0; i<dirty_chunks.size(); ++i)
+						addChunkToBuild(all_worlds_state, world_state, dirty_chunks[i], chunks_to_build, lock);
 				}
-				
-
-				// Send out a chunk-updated message to clients
 			}
 
-
-			PlatformUtils::Sleep(30*1000);
+			buildChunks(chunks_to_build, chunk_task_manager, inner_task_manager, cache);
 		}
 	}
 	catch(glare::Exception& e)
@@ -6,8 +6,14 @@ Copyright Glare Technologies Limited 2024 -
 #pragma once
 
 
+#include "../shared/LODChunk.h"
 #include <MessageableThread.h>
+#include <string>
+#include <vector>
 class ServerAllWorldsState;
+class ServerWorldState;
+class ChunkGenCache;
+namespace glare { class TaskManager; }
 
 
 /*=====================================================================
@@ -15,16 +21,34 @@ ChunkGenThread
 --------------
 Computes world LOD chunks - combines object meshes into one mesh, combines
 textures into an array texture.  Simplifies meshes.
+
+At startup, creates chunks for any chunk cells containing objects that don't have
+a chunk yet, and builds chunks marked as needing a rebuild.
+After that, rebuilds chunks when objects in them change, using the dirty chunk
+tracking in each world's LODChunkObjectIndex, building independent chunks in parallel.
+Simplified object geometry and texture tiles are cached on disk (see ChunkGenCache),
+so a rebuild mostly just recombines cached pieces.
+Rebuilt chunks are sent to clients by the main server thread.
 =====================================================================*/
 class ChunkGenThread : public MessageableThread
 {
 public:
-	ChunkGenThread(ServerAllWorldsState* all_worlds_state);
+	ChunkGenThread(ServerAllWorldsState* all_worlds_state, const std::string& temp_dir, const std::string& cache_dir); // Intermediate chunk files are written to temp_dir.  See ChunkGenCache for cache_dir.
 
 	virtual ~ChunkGenThread();
 
 	virtual void doRun();
 
+	struct ChunkToBuild
+	{
+		LODChunkRef chunk;
+		Reference<ServerWorldState> world_state;
+	};
+
 private:
+	void buildChunks(const std::vector<ChunkToBuild>& chunks_to_build, glare::TaskManager& chunk_task_manager, glare::TaskManager& inner_task_manager, ChunkGenCache& cache);
+
 	ServerAllWorldsState* all_worlds_state;
+	std::string temp_dir;
+	std::string cache_dir;
 };
@@ -0,0 +1,79 @@
+/*=====================================================================
+DatabaseSaveThread.cpp
+----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "DatabaseSaveThread.h"
+
+
+#include "ServerWorldState.h"
+#include <ConPrint.h>
+#include <Exception.h>
+#include <PlatformUtils.h>
+#include <KillThreadMessage.h>
+#include <Timer.h>
+
+
+DatabaseSaveThread::DatabaseSaveThread(ServerAllWorldsState* world_state_)
+:	world_state(world_state_)
+{
+}
+
+
+DatabaseSaveThread::~DatabaseSaveThread()
+{
+}
+
+
+void DatabaseSaveThread::doRun()
+{
+	PlatformUtils::setCurrentThreadName("DatabaseSaveThread");
+
+	try
+	{
+		while(1)
+		{
+			// Block until we have a message
+			ThreadMessageRef msg;
+			getMessageQueue().dequeue(msg);
+
+			if(dynamic_cast<DatabaseWriteBatchMessage*>(msg.ptr()))
+			{
+				const DatabaseWriteBatchMessage* batch_msg = static_cast<DatabaseWriteBatchMessage*>(msg.ptr());
+
+				Timer timer;
+				bool succeeded = false;
+				try
+				{
+					world_state->writeBatchToDatabase(*batch_msg->batch);
+					succeeded = true;
+				}
+				catch(glare::Exception& e)
+				{
+					conPrint("DatabaseSaveThread: Warning: saving world state to disk failed: " + e.what());
+				}
+
+				{
+					WorldStateLock lock(world_state->mutex);
+					world_state->recordDatabaseSaveStats(*batch_msg->batch, /*write time=*/timer.elapsed(), succeeded, lock);
+				}
+
+				world_state->db_save_in_progress = 0;
+			}
+			else if(dynamic_cast<KillThreadMessage*>(msg.ptr()))
+			{
+				return;
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("DatabaseSaveThread: glare::Exception: " + e.what());
+	}
+	catch(std::exception& e) // catch std::bad_alloc etc..
+	{
+		conPrint(std::string("DatabaseSaveThread: Caught std::exception: ") + e.what());
+	}
+
+	world_state->db_save_in_progress = 0;
+}
@@ -0,0 +1,40 @@
+/*=====================================================================
+DatabaseSaveThread.h
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "DatabaseWriteBatch.h"
+#include <MessageableThread.h>
+class ServerAllWorldsState;
+
+
+class DatabaseWriteBatchMessage : public ThreadMessage
+{
+public:
+	DatabaseWriteBatchRef batch;
+};
+
+
+/*=====================================================================
+DatabaseSaveThread
+------------------
+Writes batches of serialised records to the world state database, and flushes the database to disk.
+This means the world state mutex doesn't have to be held while the database file is written and synced.
+
+ServerAllWorldsState::db_save_in_progress is set by the main thread when a batch is enqueued,
+and cleared by this thread when the batch has been written.
+=====================================================================*/
+class DatabaseSaveThread : public MessageableThread
+{
+public:
+	DatabaseSaveThread(ServerAllWorldsState* world_state);
+	virtual ~DatabaseSaveThread();
+
+	virtual void doRun() override;
+
+private:
+	ServerAllWorldsState* world_state;
+};
@@ -0,0 +1,58 @@
+/*=====================================================================
+DatabaseWriteBatch.h
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <ThreadSafeRefCounted.h>
+#include <DatabaseKey.h>
+#include <Vector.h>
+#include <vector>
+#include <string>
+#include <cstring>
+
+
+/*=====================================================================
+DatabaseWriteBatch
+------------------
+Serialised database records to write, and database records to delete.
+
+Built by ServerAllWorldsState::serialiseDirtyDataToBatch() while holding the world state mutex,
+then written to the database by ServerAllWorldsState::writeBatchToDatabase(), usually on the DatabaseSaveThread.
+=====================================================================*/
+class DatabaseWriteBatch : public ThreadSafeRefCounted
+{
+public:
+	DatabaseWriteBatch() : serialise_time(0) {}
+
+	void addRecord(DatabaseKey key, const uint8* record_data, size_t len)
+	{
+		RecordInfo info;
+		info.key = key;
+		info.offset = data.size();
+		info.len = len;
+		records.push_back(info);
+
+		data.resize(info.offset + len);
+		if(len > 0)
+			std::memcpy(&data[info.offset], record_data, len);
+	}
+
+	struct RecordInfo
+	{
+		DatabaseKey key;
+		size_t offset; // Offset of record data in data.
+		size_t len;
+	};
+
+	std::vector<DatabaseKey> keys_to_delete; // These are deleted before the records are written.
+	std::vector<RecordInfo> records;
+	js::Vector<uint8, 16> data;
+
+	std::string summary; // Description of what was serialised, e.g. "10 object(s), 1 user(s)"
+	double serialise_time; // Time taken to build the batch, in seconds.
+};
+
+typedef Reference<DatabaseWriteBatch> DatabaseWriteBatchRef;
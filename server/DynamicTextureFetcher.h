@@ -0,0 +1,144 @@
+/*=====================================================================
+DynamicTextureFetcher.h
+-----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/RateLimiter.h"
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/Reference.h>
+#include <utils/Platform.h>
+#include <map>
+#include <string>
+#include <vector>
+namespace glare { class TaskManager; }
+
+
+/*=====================================================================
+DynamicTextureFetcher
+---------------------
+Downloads the source images for dynamic textures, for DynamicTextureUpdaterThread.
+
+The time of the last fetch of the current content is kept per source URL, and sent
+as If-Modified-Since on the next check, so an unchanged image usually comes back as a
+body-less 304 response.  (HTTPClient doesn't expose response headers, so ETag and
+Last-Modified validators can't be used.)  If the body is downloaded anyway, it is
+hashed and compared with the hash of the last content, so unchanged images are
+detected without being written or processed again.
+
+URLs are fetched concurrently, with a bounded number of threads, and requests
+to each host are rate-limited with a RateLimiter.
+
+The HTTP requests are done by a Transport, which can be replaced by a local
+stand-in in tests.
+
+Not threadsafe, should be used from a single thread.
+=====================================================================*/
+class DynamicTextureFetcher
+{
+public:
+	struct Response
+	{
+		int response_code;
+		std::string response_message;
+		std::string mime_type;
+	};
+
+	class Transport : public ThreadSafeRefCounted
+	{
+	public:
+		virtual ~Transport() {}
+
+		// Does a GET request for URL.  If if_modified_since is non-zero, the request is made conditional on the resource being modified after
+		// that time (in seconds since 1970).  Called from multiple threads concurrently.
+		// Throws glare::Exception on failure.
+		virtual void doGet(const std::string& URL, uint64 if_modified_since, Response& response_out, std::vector<uint8>& data_out) = 0;
+	};
+
+	// Uses HTTPClient.
+	class HTTPClientTransport : public Transport
+	{
+	public:
+		virtual void doGet(const std::string& URL, uint64 if_modified_since, Response& response_out, std::vector<uint8>& data_out);
+	};
+
+	DynamicTextureFetcher(const Reference<Transport>& transport, size_t num_threads, double rate_limit_period, size_t max_requests_per_host_in_period);
+	~DynamicTextureFetcher();
+
+	enum FetchStatus
+	{
+		FetchStatus_NotModified, // Server returned 304 Not Modified.
+		FetchStatus_SameContent, // Body was downloaded, but has the same hash as the current content.
+		FetchStatus_NewContent, // Body was downloaded, and is new content.
+		FetchStatus_RateLimited, // Request was not made, as too many requests have been made to the host recently.
+		FetchStatus_Failed
+	};
+
+	struct FetchResult
+	{
+		std::string URL;
+		FetchStatus status;
+		std::string substrata_URL; // Resource URL of the current content, for FetchStatus_NotModified and FetchStatus_SameContent.
+
+		// For FetchStatus_NewContent:
+		std::vector<uint8> data;
+		std::string mime_type;
+		uint64 hash; // XXH64 hash of data.
+
+		std::string error_msg; // For FetchStatus_Failed.
+	};
+
+	// Fetches each URL, using conditional requests where possible.  Duplicate URLs are only fetched once.
+	// cur_time is in seconds since 1970, and is used for rate limiting and If-Modified-Since.
+	// URLs that are rate limited are not fetched, and can be fetched again after getRateLimitPeriod() seconds.
+	void fetchURLs(const std::vector<std::string>& URLs, uint64 cur_time, std::vector<FetchResult>& results_out);
+
+	// Call once the content of a FetchStatus_NewContent result has been added as a resource.
+	// Following requests for the URL will be made conditional, and can return FetchStatus_NotModified or FetchStatus_SameContent with this substrata_URL.
+	void setCurrentContent(const std::string& URL, uint64 hash, const std::string& substrata_URL);
+
+	struct Stats
+	{
+		uint64 num_requests;
+		uint64 num_not_modified;
+		uint64 num_same_content;
+		uint64 num_new_content;
+		uint64 num_rate_limited;
+		uint64 num_failed;
+		uint64 bytes_downloaded;
+	};
+	const Stats& getStats() const { return stats; }
+
+	double getRateLimitPeriod() const { return rate_limit_period; }
+
+	static std::string getHostForURL(const std::string& URL); // Returns lower-case host, without port or user info.
+	static std::string formatHTTPDate(uint64 secs_since_1970); // e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(DynamicTextureFetcher);
+
+	struct URLState
+	{
+		URLState() : hash(0), last_fetch_time(0), pending_hash(0), pending_fetch_time(0) {}
+
+		uint64 hash; // Hash of current content.
+		std::string substrata_URL; // Resource URL of current content.  Empty if there is no current content.
+		uint64 last_fetch_time; // Time the current content was last fetched, in seconds since 1970.
+
+		// Hash and fetch time of the last new content, which become current when setCurrentContent() is called.
+		uint64 pending_hash;
+		uint64 pending_fetch_time;
+	};
+
+	Reference<Transport> transport;
+	glare::TaskManager* task_manager;
+	std::map<std::string, URLState> url_states;
+	std::map<std::string, Reference<RateLimiter>> host_rate_limiters;
+	double rate_limit_period;
+	size_t max_requests_per_host_in_period;
+	Stats stats;
+};
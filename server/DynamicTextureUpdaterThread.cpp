@@ -11,6 +11,7 @@ Copyright Glare Technologies Limited 2023 -
 #include "ServerSideScripting.h"
 #include "MeshLODGenThread.h"
 #include "../shared/ImageDecoding.h"
+#include "../shared/TimeStamp.h"
 #include <ConPrint.h>
 #include <Exception.h>
 #include <Lock.h>
@@ -19,14 +20,13 @@ Copyright Glare Technologies Limited 2023 -
 #include <Timer.h>
 #include <TaskManager.h>
 #include <FileUtils.h>
-#include <IncludeXXHash.h>
-#include <HTTPClient.h>
 #include <KillThreadMessage.h>
 #include <graphics/ImageMap.h>
 
 
 DynamicTextureUpdaterThread::DynamicTextureUpdaterThread(Server* server_, ServerAllWorldsState* world_state_)
-:	server(server_), world_state(world_state_)
+:	server(server_), world_state(world_state_),
+	fetcher(new DynamicTextureFetcher::HTTPClientTransport(), /*num threads=*/4, /*rate limit period=*/600.0, /*max requests per host in period=*/20)
 {
 }
 
@@ -94,109 +94,127 @@ struct DynTextureFetchResults
 };
 
 
-// Returns substrata URL of resource for the downloaded file.
-static std::string fetchFileForURLAndAddAsResource(const std::string& base_URL, ServerAllWorldsState* world_state)
+// Adds the newly downloaded image data as a resource.  Returns substrata URL of the resource.
+static std::string addFetchedFileAsResource(const std::string& base_URL, const DynamicTextureFetcher::FetchResult& fetch_result, ServerAllWorldsState* world_state)
 {
-	HTTPClient http_client;
-	http_client.setAsNotIndependentlyHeapAllocated();
-	http_client.max_data_size			= 32 * 1024 * 1024; // 32 MB
-	http_client.max_socket_buffer_size	= 32 * 1024 * 1024; // 32 MB
+	const std::vector<uint8>& data = fetch_result.data;
 
-	std::vector<uint8> data;
-	HTTPClient::ResponseInfo response = http_client.downloadFile(base_URL, data);
+	conPrint("\tDynamicTextureUpdaterThread: Got new content, file size: " + ::getNiceByteSize(data.size()));
 
-	if(response.response_code >= 200 && response.response_code < 300)
+	// If original URL didn't have a file extension in it, pick one based on MIME type
+	std::string use_extension = sanitiseString(::getExtension(base_URL));
+	if(use_extension.empty())
 	{
-		conPrint("\tDynamicTextureUpdaterThread: Got HTTP " + toString(response.response_code) + " response, file size: " + ::getNiceByteSize(data.size()));
+		// Work out extension to use - see https://developer.mozilla.org/en-US/docs/Web/HTTP/Basics_of_HTTP/MIME_types
+		if(fetch_result.mime_type == "image/gif")
+			use_extension = "gif";
+		else if(fetch_result.mime_type == "image/jpeg")
+			use_extension = "jpg";
+		else if(fetch_result.mime_type == "image/png")
+			use_extension = "png";
+		else
+			throw glare::Exception("Unknown MIME type for image or unsupported MIME type: '" + fetch_result.mime_type + "'");
+	}
 
-		// If original URL didn't have a file extension in it, pick one based on MIME type
-		std::string use_extension = sanitiseString(::getExtension(base_URL));
-		if(use_extension.empty())
-		{
-			// Work out extension to use - see https://developer.mozilla.org/en-US/docs/Web/HTTP/Basics_of_HTTP/MIME_types
-			if(response.mime_type == "image/gif")
-				use_extension = "gif";
-			else if(response.mime_type == "image/jpeg")
-				use_extension = "jpg";
-			else if(response.mime_type == "image/png")
-				use_extension = "png";
-			else
-				throw glare::Exception("Unknown MIME type for image or unsupported MIME type: '" + response.mime_type + "'");
-		}
+	if(!ImageDecoding::isSupportedImageExtension(use_extension))
+		throw glare::Exception("Image type extension not supported: '" + use_extension + "'.");
 
-		if(!ImageDecoding::isSupportedImageExtension(use_extension))
-			throw glare::Exception("Image type extension not supported: '" + use_extension + "'.");
+	if(!ImageDecoding::areMagicBytesValid(data.data(), data.size(), use_extension))
+		throw glare::Exception("Image magic bytes are not valid for extension '" + use_extension + "'.");
 
-		if(!ImageDecoding::areMagicBytesValid(data.data(), data.size(), use_extension))
-			throw glare::Exception("Image magic bytes are not valid for extension '" + use_extension + "'.");
+	const uint64 hash = fetch_result.hash;
 
-		const uint64 hash = XXH64(data.data(), data.size(), /*seed=*/1);
+	const std::string URL = ResourceManager::URLForNameAndExtensionAndHash(::removeDotAndExtension(base_URL), use_extension, hash);
 
-		const std::string URL = ResourceManager::URLForNameAndExtensionAndHash(::removeDotAndExtension(base_URL), use_extension, hash);
+	conPrint("\tDynamicTextureUpdaterThread: current/new URL: " + URL + "");
 
-		conPrint("\tDynamicTextureUpdaterThread: current/new URL: " + URL + "");
+	if(URL.size() > WorldObject::MAX_URL_SIZE)
+		throw glare::Exception("URL too long.");
 
-		if(URL.size() > WorldObject::MAX_URL_SIZE)
-			throw glare::Exception("URL too long.");
+	{
+		Lock lock(world_state->mutex);
 
+		if(!world_state->resource_manager->isFileForURLPresent(URL))
 		{
-			Lock lock(world_state->mutex);
+			conPrint("\tDynamicTextureUpdaterThread: Resource not already present, adding to resource_manager...");
 
-			if(!world_state->resource_manager->isFileForURLPresent(URL))
-			{
-				conPrint("\tDynamicTextureUpdaterThread: Resource not already present, adding to resource_manager...");
+			const std::string local_abs_path = world_state->resource_manager->pathForURL(URL);
+
+			FileUtils::writeEntireFile(local_abs_path, data);
 
-				const std::string local_abs_path = world_state->resource_manager->pathForURL(URL);
+			world_state->resource_manager->setResourceAsLocallyPresentForURL(URL);
 
-				FileUtils::writeEntireFile(local_abs_path, data);
+			ResourceRef resource = world_state->resource_manager->getExistingResourceForURL(URL);
+			world_state->addResourcesAsDBDirty(resource);
+		}
+		else
+		{
+			conPrint("\tDynamicTextureUpdaterThread: texture is already present as a resource.");
+		}
+	} // End lock scope
+
+	return URL;
+}
 
-				world_state->resource_manager->setResourceAsLocallyPresentForURL(URL);
 
-				ResourceRef resource = world_state->resource_manager->getExistingResourceForURL(URL);
-				world_state->addResourcesAsDBDirty(resource);
+// Gets the substrata URL for each fetched URL, adding newly downloaded images as resources.
+// Rate-limited URLs are not added to fetch_results_map, but are appended to rate_limited_URLs_out instead.
+static void processFetchResults(std::vector<DynamicTextureFetcher::FetchResult>& results, DynamicTextureFetcher& fetcher, ServerAllWorldsState* world_state, std::map<std::string, DynTextureFetchResults>& fetch_results_map,
+	std::vector<std::string>& rate_limited_URLs_out)
+{
+	for(size_t i=0; i<results.size(); ++i)
+	{
+		DynamicTextureFetcher::FetchResult& result = results[i];
+		std::string substrata_URL;
+		switch(result.status)
+		{
+		case DynamicTextureFetcher::FetchStatus_NotModified:
+			conPrint("\tDynamicTextureUpdaterThread: URL '" + result.URL + "': not modified.");
+			substrata_URL = result.substrata_URL;
+			break;
+		case DynamicTextureFetcher::FetchStatus_SameContent:
+			conPrint("\tDynamicTextureUpdaterThread: URL '" + result.URL + "': content hash unchanged.");
+			substrata_URL = result.substrata_URL;
+			break;
+		case DynamicTextureFetcher::FetchStatus_NewContent:
+			try
+			{
+				substrata_URL = addFetchedFileAsResource(result.URL, result, world_state);
+				fetcher.setCurrentContent(result.URL, result.hash, substrata_URL);
 			}
-			else
+			catch(glare::Exception& e)
 			{
-				conPrint("\tDynamicTextureUpdaterThread: texture is already present as a resource.");
+				conPrint("\tDynamicTextureUpdaterThread: Excep processing file from URL '" + result.URL + "': " + e.what());
 			}
-		} // End lock scope
+			result.data.clear();
+			break;
+		case DynamicTextureFetcher::FetchStatus_RateLimited:
+			conPrint("\tDynamicTextureUpdaterThread: URL '" + result.URL + "': rate limited, will retry later.");
+			rate_limited_URLs_out.push_back(result.URL);
+			continue;
+		case DynamicTextureFetcher::FetchStatus_Failed:
+			conPrint("\tDynamicTextureUpdaterThread: Excep fetching URL '" + result.URL + "': " + result.error_msg);
+			break;
+		}
 
-		return URL;
+		fetch_results_map[result.URL] = DynTextureFetchResults({substrata_URL});
 	}
-	else
-		throw glare::Exception("Non 200 HTTP return code: " + toString(response.response_code) + ", msg: '" + response.response_message + "'"); 
-
 }
 
 
-static void checkDynamicTexture(const ObWithDynamicTexture& ob_with_dyn_tex, ServerAllWorldsState* world_state, Server* server, std::map<std::string, DynTextureFetchResults>& fetch_results_map)
+static void checkDynamicTexture(const ObWithDynamicTexture& ob_with_dyn_tex, ServerAllWorldsState* world_state, Server* server, const std::map<std::string, DynTextureFetchResults>& fetch_results_map)
 {
 	const std::string base_URL = ob_with_dyn_tex.script->base_image_URL;
 
 	const auto fetch_it = fetch_results_map.find(base_URL);
 	if(fetch_it == fetch_results_map.end())
-	{
-		conPrint("\tDynamicTextureUpdaterThread: Requesting file at URL '" + ob_with_dyn_tex.script->base_image_URL + "'...");
-
-		try
-		{
-			const std::string substrata_URL = fetchFileForURLAndAddAsResource(base_URL, world_state);
+		return;
 
-			fetch_results_map[base_URL] = DynTextureFetchResults({substrata_URL});
-		}
-		catch(glare::Exception& e)
-		{
-			conPrint("\tDynamicTextureUpdaterThread: Excep fetching URL '" + base_URL + "': " + e.what());
-			fetch_results_map[base_URL] = DynTextureFetchResults({""});
-		}
-	}
-
-	assert(fetch_results_map.count(base_URL) > 0);
-	DynTextureFetchResults fetch_results = fetch_results_map[base_URL];
+	const DynTextureFetchResults& fetch_results = fetch_it->second;
 
 	if(fetch_results.substrata_URL.empty())
 	{
-		// We already tried to fetch from this URL, and it failed.
+		// The fetch from this URL failed.
 		conPrint("\tDynamicTextureUpdaterThread: Fetch for URL '" + base_URL + "' failed, skipping");
 	}
 	else
@@ -260,6 +278,20 @@ static void checkDynamicTexture(const ObWithDynamicTexture& ob_with_dyn_tex, Ser
 }
 
 
+// Returns true if we got a kill message.
+static bool waitForKillMessage(ThreadSafeQueue<ThreadMessageRef>& queue, double wait_time_s)
+{
+	Timer timer;
+	while(timer.elapsed() < wait_time_s)
+	{
+		ThreadMessageRef msg;
+		if(queue.dequeueWithTimeout(/*wait_time_seconds=*/myMax(0.0, wait_time_s - timer.elapsed()), msg) && dynamic_cast<KillThreadMessage*>(msg.ptr()))
+			return true;
+	}
+	return false;
+}
+
+
 void DynamicTextureUpdaterThread::doRun()
 {
 	PlatformUtils::setCurrentThreadName("DynamicTextureUpdaterThread");
@@ -323,24 +355,54 @@ void DynamicTextureUpdaterThread::doRun()
 			conPrint("DynamicTextureUpdaterThread: Iterating over objects took " + timer.elapsedStringNSigFigs(4) + ", obs_with_dyn_textures: " + toString(obs_with_dyn_textures.size()));
 			//----------------------------------------------------------------------------------------------------------------------------------------------------
 
-			//-------------------------------------------  Check each dynamic texture, without holding the world lock -------------------------------------------
+			//-------------------------------------------  Fetch each dynamic texture URL concurrently, without holding the world lock -------------------------------------------
 			conPrint("DynamicTextureUpdaterThread: Checking for image updates...");
 			timer.reset();
 
-			std::map<std::string, DynTextureFetchResults> fetch_results_map;
-
+			std::vector<std::string> URLs(obs_with_dyn_textures.size());
 			for(size_t i=0; i<obs_with_dyn_textures.size(); ++i)
+				URLs[i] = obs_with_dyn_textures[i].script->base_image_URL;
+
+			// URLs that are rate limited are fetched again once the rate limit period has passed, so that all URLs for a host get checked,
+			// not just the first few in object order.
+			while(!URLs.empty())
 			{
-				const ObWithDynamicTexture& ob_with_dyn_tex = obs_with_dyn_textures[i];
-				try
+				std::vector<DynamicTextureFetcher::FetchResult> fetch_results;
+				fetcher.fetchURLs(URLs, TimeStamp::currentTime().time, fetch_results);
+
+				std::map<std::string, DynTextureFetchResults> fetch_results_map;
+				std::vector<std::string> rate_limited_URLs;
+				processFetchResults(fetch_results, fetcher, world_state, fetch_results_map, rate_limited_URLs);
+
+				const DynamicTextureFetcher::Stats& stats = fetcher.getStats();
+				conPrint("DynamicTextureUpdaterThread: Fetched " + toString(fetch_results.size()) + " URL(s) in " + timer.elapsedStringNSigFigs(4) + ".  Totals: requests: " + toString(stats.num_requests) +
+					", not modified: " + toString(stats.num_not_modified) + ", same content: " + toString(stats.num_same_content) + ", new content: " + toString(stats.num_new_content) +
+					", rate limited: " + toString(stats.num_rate_limited) + ", failed: " + toString(stats.num_failed) + ", downloaded: " + getNiceByteSize(stats.bytes_downloaded));
+
+				//-------------------------------------------  Update objects -------------------------------------------
+				for(size_t i=0; i<obs_with_dyn_textures.size(); ++i)
 				{
-					conPrint("DynamicTextureUpdaterThread: Checking dynamic texture for URL '" + ob_with_dyn_tex.script->base_image_URL + "'");
+					const ObWithDynamicTexture& ob_with_dyn_tex = obs_with_dyn_textures[i];
+					if(fetch_results_map.count(ob_with_dyn_tex.script->base_image_URL) == 0) // If URL was not fetched in this batch (e.g. was rate limited):
+						continue;
+					try
+					{
+						conPrint("DynamicTextureUpdaterThread: Checking dynamic texture for URL '" + ob_with_dyn_tex.script->base_image_URL + "'");
 
-					checkDynamicTexture(ob_with_dyn_tex, world_state, server, fetch_results_map);
+						checkDynamicTexture(ob_with_dyn_tex, world_state, server, fetch_results_map);
+					}
+					catch(glare::Exception& e)
+					{
+						conPrint("\tDynamicTextureUpdaterThread: glare::Exception while checking dynamic texture changes: " + e.what());
+					}
 				}
-				catch(glare::Exception& e)
+
+				URLs.swap(rate_limited_URLs);
+				if(!URLs.empty())
 				{
-					conPrint("\tDynamicTextureUpdaterThread: glare::Exception while checking dynamic texture changes: " + e.what());
+					conPrint("DynamicTextureUpdaterThread: " + toString(URLs.size()) + " URL(s) were rate limited, fetching again in " + doubleToStringNSigFigs(fetcher.getRateLimitPeriod(), 4) + " s...");
+					if(waitForKillMessage(getMessageQueue(), fetcher.getRateLimitPeriod()))
+						return;
 				}
 			}
 			conPrint("DynamicTextureUpdaterThread: Done checking for image updates textures. (Elapsed: " + timer.elapsedStringNSigFigs(4) + ")");
@@ -6,6 +6,7 @@ Copyright Glare Technologies Limited 2023 -
 #pragma once
 
 
+#include "DynamicTextureFetcher.h"
 #include "../shared/UID.h"
 #include <MessageableThread.h>
 class Server;
@@ -20,6 +21,13 @@ These scripts download an image from a fixed URL periodically,
 and if the image changes, add it as a resource to the substrata server,
 and assign the image to the specified object material.
 
+The images are fetched with a DynamicTextureFetcher, which makes conditional
+requests, and detects unchanged images by hash, so unchanged images aren't
+downloaded or processed again.
+
+Requests are rate limited per host.  URLs that are rate limited are fetched again
+later in the same scan, once the rate limit period has passed.
+
 Note that this code runs on the server, so we have to be a bit careful with it.
 =====================================================================*/
 class DynamicTextureUpdaterThread : public MessageableThread
@@ -34,4 +42,5 @@ public:
 private:
 	Server* server;
 	ServerAllWorldsState* world_state;
+	DynamicTextureFetcher fetcher; // Kept between scans, as it stores the fetch times and content hashes for each URL.
 };
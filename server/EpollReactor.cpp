@@ -0,0 +1,613 @@
+/*=====================================================================
+EpollReactor.cpp
+----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "EpollReactor.h"
+
+
+#include "WorkerThread.h"
+#include "Server.h"
+#include <networking/MySocket.h>
+#include <networking/TLSSocket.h>
+#include <utils/ConPrint.h>
+#include <utils/Exception.h>
+#include <utils/Lock.h>
+#include <utils/StringUtils.h>
+#include <utils/PlatformUtils.h>
+#include <utils/BufferInStream.h>
+#include <openssl/err.h>
+#include <tls.h>
+#include <cstring>
+#include <algorithm>
+#if defined(_WIN32) || defined(OSX)
+#else
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+
+static const size_t READ_CHUNK_SIZE = 1 << 16;
+static const size_t MAX_READ_PER_EVENT = 1 << 18; // Max amount of data to read from a connection before handling events for other connections.
+static const size_t MAX_OUTBOUND_SIZE = 1 << 27; // If more than this much data is waiting to be sent to a client, close the connection.
+static const size_t MAX_MSG_LEN = 1000000; // Same limit as in WorkerThread::doRun().
+
+
+struct EpollReactorIOThread::Connection
+{
+	Reference<WorkerThread> worker;
+	Reference<MySocket> plain_socket;
+	int fd;
+	struct tls* tls_context; // NULL for non-TLS connections.  Owned by the WorkerThread socket.
+
+	js::Vector<uint8, 16> inbound; // Data read from the socket that has not been handled yet.
+	size_t inbound_size;
+
+	js::Vector<uint8, 16> outbound; // Data to write to the socket.
+	size_t outbound_offset; // Data before this offset has been written already.
+
+	uint32 epoll_events; // Events currently registered with epoll.
+	bool read_wants_pollout; // Last tls_read() returned TLS_WANT_POLLOUT, so retry the read when the socket is writable.
+	bool write_wants_pollin; // Last tls_write() returned TLS_WANT_POLLIN.
+	bool more_to_read;
+	bool closed;
+};
+
+
+EpollReactorIOThread::EpollReactorIOThread(EpollReactor* reactor_, Server* server_)
+:	reactor(reactor_),
+	server(server_),
+	epoll_fd(-1),
+	wakeup_fd(-1),
+	num_connections(0),
+	should_quit(0)
+{
+#if defined(_WIN32) || defined(OSX)
+	throw glare::Exception("EpollReactorIOThread is not supported on this platform.");
+#else
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(epoll_fd == -1)
+		throw glare::Exception("epoll_create1 failed: " + PlatformUtils::getLastErrorString());
+
+	wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(wakeup_fd == -1)
+	{
+		close(epoll_fd);
+		throw glare::Exception("eventfd failed: " + PlatformUtils::getLastErrorString());
+	}
+
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL; // A NULL pointer indicates the wakeup fd.
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &ev) == -1)
+	{
+		close(wakeup_fd);
+		close(epoll_fd);
+		throw glare::Exception("epoll_ctl failed: " + PlatformUtils::getLastErrorString());
+	}
+#endif
+}
+
+
+EpollReactorIOThread::~EpollReactorIOThread()
+{
+#if defined(_WIN32) || defined(OSX)
+#else
+	if(wakeup_fd != -1)
+		close(wakeup_fd);
+	if(epoll_fd != -1)
+		close(epoll_fd);
+#endif
+}
+
+
+void EpollReactorIOThread::addConnection(const Reference<WorkerThread>& worker)
+{
+	{
+		Lock lock(pending_mutex);
+		pending_new_connections.push_back(worker);
+	}
+	wakeup();
+}
+
+
+void EpollReactorIOThread::connectionHasDataToSend(WorkerThread* worker)
+{
+	{
+		Lock lock(pending_mutex);
+		pending_send_connections.push_back(worker);
+	}
+	wakeup();
+}
+
+
+void EpollReactorIOThread::kill()
+{
+	should_quit = 1;
+	wakeup();
+}
+
+
+#if defined(_WIN32) || defined(OSX)
+
+
+void EpollReactorIOThread::wakeup() {}
+void EpollReactorIOThread::registerNewConnections() {}
+bool EpollReactorIOThread::readFromConnection(Connection* conn) { return false; }
+void EpollReactorIOThread::flushConnection(Connection* conn) {}
+void EpollReactorIOThread::updateEpollEvents(Connection* conn) {}
+void EpollReactorIOThread::closeConnection(Connection* conn, const std::string& reason) {}
+void EpollReactorIOThread::destroyClosedConnections() {}
+void EpollReactorIOThread::doRun() {}
+
+
+#else // else if Linux:
+
+
+void EpollReactorIOThread::wakeup()
+{
+	const uint64 val = 1;
+	if(write(wakeup_fd, &val, sizeof(val)) != sizeof(val))
+	{
+		// The eventfd counter would only overflow after a huge number of writes without reads, in which case the thread will be woken up anyway.
+	}
+}
+
+
+void EpollReactorIOThread::registerNewConnections()
+{
+	{
+		Lock lock(pending_mutex);
+		temp_connections.swap(pending_new_connections);
+	}
+
+	for(size_t i=0; i<temp_connections.size(); ++i)
+	{
+		Connection* conn = new Connection();
+		conn->worker = temp_connections[i];
+		conn->plain_socket = conn->worker->getPlainSocket();
+		conn->fd = (int)conn->plain_socket->getSocketHandle();
+		conn->tls_context = conn->worker->getTLSContext();
+		conn->inbound_size = 0;
+		conn->outbound_offset = 0;
+		conn->epoll_events = EPOLLIN;
+		conn->read_wants_pollout = false;
+		conn->write_wants_pollin = false;
+		conn->more_to_read = false;
+		conn->closed = false;
+
+		connections[conn->worker.ptr()] = conn;
+		num_connections.increment();
+
+		try
+		{
+			// Make the socket non-blocking.
+			const int flags = fcntl(conn->fd, F_GETFL, 0);
+			if(flags == -1 || fcntl(conn->fd, F_SETFL, flags | O_NONBLOCK) == -1)
+				throw glare::Exception("fcntl failed: " + PlatformUtils::getLastErrorString());
+
+			struct epoll_event ev;
+			ev.events = conn->epoll_events;
+			ev.data.ptr = conn;
+			if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) == -1)
+				throw glare::Exception("epoll_ctl failed: " + PlatformUtils::getLastErrorString());
+
+			conn->worker->setReactorIOThread(this); // Will notify us if there is already data to send.
+
+			// libtls may have buffered data read from the socket while the WorkerThread was reading the handshake messages, which epoll won't tell us about, so try reading now.
+			if(!readFromConnection(conn))
+				closeConnection(conn, "Client closed connection.");
+			else
+				flushConnection(conn);
+		}
+		catch(glare::Exception& e)
+		{
+			closeConnection(conn, "glare::Exception: " + e.what());
+		}
+		catch(std::exception& e)
+		{
+			closeConnection(conn, std::string("Caught std::exception: ") + e.what());
+		}
+	}
+
+	temp_connections.clear();
+}
+
+
+bool EpollReactorIOThread::readFromConnection(Connection* conn)
+{
+	conn->more_to_read = false;
+
+	size_t total_read = 0;
+	while(1)
+	{
+		if(total_read >= MAX_READ_PER_EVENT)
+		{
+			// Stop reading from this connection for now so we don't starve the other connections.  There may be more data buffered by libtls, so we need to come back to this connection.
+			conn->more_to_read = true;
+			connections_with_more_to_read.push_back(conn);
+			break;
+		}
+
+		if(conn->inbound.size() < conn->inbound_size + READ_CHUNK_SIZE)
+			conn->inbound.resize(conn->inbound_size + READ_CHUNK_SIZE);
+
+		ssize_t num_read;
+		if(conn->tls_context)
+		{
+			num_read = tls_read(conn->tls_context, &conn->inbound[conn->inbound_size], READ_CHUNK_SIZE);
+			if(num_read == TLS_WANT_POLLIN)
+				break;
+			else if(num_read == TLS_WANT_POLLOUT)
+			{
+				conn->read_wants_pollout = true;
+				break;
+			}
+			else if(num_read < 0)
+				throw glare::Exception("tls_read failed: " + getTLSErrorString(conn->tls_context));
+		}
+		else
+		{
+			num_read = recv(conn->fd, &conn->inbound[conn->inbound_size], READ_CHUNK_SIZE, 0);
+			if(num_read < 0)
+			{
+				if(errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
+				else if(errno == EINTR)
+					continue;
+				else
+					throw glare::Exception("recv failed: " + PlatformUtils::getLastErrorString());
+			}
+		}
+
+		if(num_read == 0)
+			return false; // Connection was closed.
+
+		conn->inbound_size += (size_t)num_read;
+		total_read += (size_t)num_read;
+	}
+
+	// Handle any complete messages
+	size_t offset = 0;
+	while((conn->inbound_size - offset >= sizeof(uint32) * 2) && !conn->worker->shouldCloseConnection())
+	{
+		uint32 msg_type_and_len[2];
+		std::memcpy(msg_type_and_len, &conn->inbound[offset], sizeof(uint32) * 2);
+		const uint32 msg_type = msg_type_and_len[0];
+		const uint32 msg_len = msg_type_and_len[1]; // Length of message, including the message type and length fields.
+
+		if((msg_len < sizeof(uint32) * 2) || (msg_len > MAX_MSG_LEN))
+			throw glare::Exception("Invalid message size: " + toString(msg_len));
+
+		if(conn->inbound_size - offset < msg_len)
+			break; // Don't have the entire message yet.
+
+		BufferInStream& msg_buffer = conn->worker->getMsgBuffer();
+		msg_buffer.buf.resizeNoCopy(msg_len);
+		std::memcpy(msg_buffer.buf.data(), &conn->inbound[offset], msg_len);
+		msg_buffer.read_index = sizeof(uint32) * 2;
+
+		offset += msg_len;
+
+		conn->worker->handleUpdatesMessage(msg_type);
+	}
+
+	// Move any remaining partial message to the start of the inbound buffer.
+	if(offset > 0)
+	{
+		if(conn->inbound_size > offset)
+			std::memmove(&conn->inbound[0], &conn->inbound[offset], conn->inbound_size - offset);
+		conn->inbound_size -= offset;
+	}
+
+	return true;
+}
+
+
+void EpollReactorIOThread::flushConnection(Connection* conn)
+{
+	conn->worker->appendDataToSend(conn->outbound);
+
+	if(conn->outbound.size() - conn->outbound_offset > MAX_OUTBOUND_SIZE)
+		throw glare::Exception("Too much data queued to send to client.");
+
+	conn->write_wants_pollin = false;
+
+	while(conn->outbound_offset < conn->outbound.size())
+	{
+		const size_t len = conn->outbound.size() - conn->outbound_offset;
+
+		ssize_t num_written;
+		if(conn->tls_context)
+		{
+			num_written = tls_write(conn->tls_context, &conn->outbound[conn->outbound_offset], len);
+			if(num_written == TLS_WANT_POLLOUT)
+				break;
+			else if(num_written == TLS_WANT_POLLIN)
+			{
+				conn->write_wants_pollin = true;
+				break;
+			}
+			else if(num_written < 0)
+				throw glare::Exception("tls_write failed: " + getTLSErrorString(conn->tls_context));
+		}
+		else
+		{
+			num_written = send(conn->fd, &conn->outbound[conn->outbound_offset], len, MSG_NOSIGNAL);
+			if(num_written < 0)
+			{
+				if(errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
+				else if(errno == EINTR)
+					continue;
+				else
+					throw glare::Exception("send failed: " + PlatformUtils::getLastErrorString());
+			}
+		}
+
+		conn->outbound_offset += (size_t)num_written;
+	}
+
+	if(conn->outbound_offset == conn->outbound.size())
+	{
+		conn->outbound.clear();
+		conn->outbound_offset = 0;
+
+		if(conn->worker->shouldCloseConnection()) // If the client said goodbye, close the connection now we have sent everything.
+		{
+			closeConnection(conn, "Client said goodbye.");
+			return;
+		}
+	}
+
+	conn->worker->updateBotContactTimeIfNeeded();
+
+	updateEpollEvents(conn);
+}
+
+
+void EpollReactorIOThread::updateEpollEvents(Connection* conn)
+{
+	// We always want to know when the socket is readable.  We want to know when it is writable if we have pending data to send, or if TLS needs to write for a read.
+	const bool want_pollout = ((conn->outbound.size() > conn->outbound_offset) && !conn->write_wants_pollin) || conn->read_wants_pollout;
+	const uint32 events = EPOLLIN | (want_pollout ? EPOLLOUT : 0);
+
+	if(events != conn->epoll_events)
+	{
+		struct epoll_event ev;
+		ev.events = events;
+		ev.data.ptr = conn;
+		if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) == -1)
+			throw glare::Exception("epoll_ctl failed: " + PlatformUtils::getLastErrorString());
+		conn->epoll_events = events;
+	}
+}
+
+
+void EpollReactorIOThread::closeConnection(Connection* conn, const std::string& reason)
+{
+	if(conn->closed)
+		return;
+
+	if(!conn->worker->fuzzing)
+		conPrint("EpollReactorIOThread: closing connection: " + reason);
+
+	conn->closed = true;
+	connections_to_close.push_back(conn);
+}
+
+
+void EpollReactorIOThread::destroyClosedConnections()
+{
+	for(size_t i=0; i<connections_to_close.size(); ++i)
+	{
+		Connection* conn = connections_to_close[i];
+
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL); // May fail if the connection was never added, which is fine.
+
+		if(conn->more_to_read)
+			connections_with_more_to_read.erase(std::remove(connections_with_more_to_read.begin(), connections_with_more_to_read.end(), conn), connections_with_more_to_read.end());
+
+		// Remove from reactor connections before calling reactorConnectionClosed(), so the main thread doesn't try to send to it.
+		reactor->connectionClosed(conn->worker.ptr());
+
+		conn->worker->reactorConnectionClosed(); // Removes client from server and marks avatar as dead.  Releases the sockets.
+
+		connections.erase(conn->worker.ptr());
+		num_connections.decrement();
+
+		delete conn; // Closes the socket.
+	}
+	connections_to_close.clear();
+}
+
+
+void EpollReactorIOThread::doRun()
+{
+	PlatformUtils::setCurrentThreadName("EpollReactorIOThread");
+
+	const int MAX_EVENTS = 256;
+	struct epoll_event events[MAX_EVENTS];
+	std::vector<Connection*> temp_more_to_read;
+
+	while(!should_quit)
+	{
+		const int timeout_ms = connections_with_more_to_read.empty() ? 1000 : 0;
+		const int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+		if(num_events < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			conPrint("EpollReactorIOThread: epoll_wait failed: " + PlatformUtils::getLastErrorString());
+			break;
+		}
+
+		for(int i=0; i<num_events; ++i)
+		{
+			if(events[i].data.ptr == NULL)
+			{
+				// Wakeup fd was signalled, reset it by reading from it.
+				uint64 val;
+				if(read(wakeup_fd, &val, sizeof(val)) != sizeof(val))
+				{}
+				continue;
+			}
+
+			Connection* conn = (Connection*)events[i].data.ptr;
+			if(conn->closed)
+				continue;
+
+			try
+			{
+				const uint32 ev = events[i].events;
+				if((ev & (EPOLLIN | EPOLLHUP | EPOLLERR)) || ((ev & EPOLLOUT) && conn->read_wants_pollout))
+				{
+					conn->read_wants_pollout = false;
+					if(!readFromConnection(conn))
+					{
+						closeConnection(conn, "Client closed connection.");
+						continue;
+					}
+				}
+
+				flushConnection(conn);
+			}
+			catch(glare::Exception& e)
+			{
+				closeConnection(conn, "glare::Exception: " + e.what());
+			}
+			catch(std::exception& e) // catch std::bad_alloc etc..
+			{
+				closeConnection(conn, std::string("Caught std::exception: ") + e.what());
+			}
+		}
+
+		// Continue reading from connections where we stopped reading before
+		temp_more_to_read.swap(connections_with_more_to_read);
+		connections_with_more_to_read.clear();
+		for(size_t i=0; i<temp_more_to_read.size(); ++i)
+		{
+			Connection* conn = temp_more_to_read[i];
+			if(conn->closed || !conn->more_to_read)
+				continue;
+			try
+			{
+				if(!readFromConnection(conn))
+					closeConnection(conn, "Client closed connection.");
+				else
+					flushConnection(conn);
+			}
+			catch(glare::Exception& e)
+			{
+				closeConnection(conn, "glare::Exception: " + e.what());
+			}
+			catch(std::exception& e)
+			{
+				closeConnection(conn, std::string("Caught std::exception: ") + e.what());
+			}
+		}
+		temp_more_to_read.clear();
+
+		registerNewConnections();
+
+		// Send data enqueued by other threads.
+		{
+			Lock lock(pending_mutex);
+			temp_connections.swap(pending_send_connections);
+		}
+		for(size_t i=0; i<temp_connections.size(); ++i)
+		{
+			auto res = connections.find(temp_connections[i].ptr());
+			if(res != connections.end() && !res->second->closed)
+			{
+				try
+				{
+					flushConnection(res->second);
+				}
+				catch(glare::Exception& e)
+				{
+					closeConnection(res->second, "glare::Exception: " + e.what());
+				}
+				catch(std::exception& e)
+				{
+					closeConnection(res->second, std::string("Caught std::exception: ") + e.what());
+				}
+			}
+		}
+		temp_connections.clear();
+
+		destroyClosedConnections();
+	}
+
+	// Close all connections
+	registerNewConnections();
+	for(auto it = connections.begin(); it != connections.end(); ++it)
+		closeConnection(it->second, "IO thread terminating.");
+	destroyClosedConnections();
+
+	// Remove thread-local OpenSSL error state, to avoid leaking it.
+	ERR_remove_thread_state(/*thread id=*/NULL);
+}
+
+
+#endif // end if Linux
+
+
+EpollReactor::EpollReactor(Server* server, int num_io_threads)
+:	next_io_thread_index(0)
+{
+	for(int i=0; i<myMax(1, num_io_threads); ++i)
+	{
+		Reference<EpollReactorIOThread> io_thread = new EpollReactorIOThread(this, server);
+		io_threads.push_back(io_thread);
+		thread_manager.addThread(io_thread);
+	}
+}
+
+
+EpollReactor::~EpollReactor()
+{
+	thread_manager.killThreadsBlocking();
+}
+
+
+bool EpollReactor::isSupported()
+{
+#if defined(_WIN32) || defined(OSX)
+	return false;
+#else
+	return true;
+#endif
+}
+
+
+void EpollReactor::addConnection(const Reference<WorkerThread>& worker)
+{
+	{
+		Lock lock(mutex);
+		worker->handled_by_reactor = 1;
+		connections.insert(worker.ptr());
+	}
+
+	// Assign connections to IO threads round-robin.
+	const size_t index = (size_t)((uint32)next_io_thread_index.increment() % (uint32)io_threads.size());
+	io_threads[index]->addConnection(worker);
+}
+
+
+void EpollReactor::connectionClosed(WorkerThread* worker)
+{
+	Lock lock(mutex);
+	connections.erase(worker);
+}
+
+
+size_t EpollReactor::getNumConnections()
+{
+	Lock lock(mutex);
+	return connections.size();
+}
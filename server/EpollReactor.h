@@ -0,0 +1,119 @@
+/*=====================================================================
+EpollReactor.h
+--------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/MessageableThread.h>
+#include <utils/ThreadManager.h>
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/Reference.h>
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+#include <utils/AtomicInt.h>
+#include <set>
+#include <unordered_map>
+#include <string>
+#include <vector>
+class WorkerThread;
+class Server;
+class EpollReactor;
+
+
+/*=====================================================================
+EpollReactorIOThread
+--------------------
+Handles reading from and writing to a set of client updates connections,
+using non-blocking sockets and epoll.
+
+Messages read from a client are handled by calling WorkerThread::handleUpdatesMessage()
+on this thread.  Data enqueued to send to the client with WorkerThread::enqueueDataToSend()
+is appended to the connection outbound buffer, and written when the socket is writable.
+
+TLS connections use libtls directly on the non-blocking socket (tls_read and tls_write
+return TLS_WANT_POLLIN / TLS_WANT_POLLOUT instead of blocking).
+
+Only supported on Linux.
+=====================================================================*/
+class EpollReactorIOThread : public MessageableThread
+{
+public:
+	EpollReactorIOThread(EpollReactor* reactor, Server* server);
+	virtual ~EpollReactorIOThread();
+
+	virtual void doRun() override;
+
+	virtual void kill() override;
+
+	void addConnection(const Reference<WorkerThread>& worker); // threadsafe
+	void connectionHasDataToSend(WorkerThread* worker); // threadsafe
+
+	size_t getNumConnections() const { return (size_t)num_connections; }
+
+	struct Connection;
+private:
+	void wakeup();
+	void registerNewConnections();
+	bool readFromConnection(Connection* conn); // Returns false if the client closed the connection.
+	void flushConnection(Connection* conn);
+	void updateEpollEvents(Connection* conn);
+	void closeConnection(Connection* conn, const std::string& reason); // Marks connection as closed, it is actually closed in destroyClosedConnections().
+	void destroyClosedConnections();
+
+	EpollReactor* reactor;
+	Server* server;
+	int epoll_fd;
+	int wakeup_fd; // eventfd used to wake the thread from epoll_wait().
+
+	Mutex pending_mutex;
+	std::vector<Reference<WorkerThread>> pending_new_connections	GUARDED_BY(pending_mutex);
+	std::vector<Reference<WorkerThread>> pending_send_connections	GUARDED_BY(pending_mutex);
+	std::vector<Reference<WorkerThread>> temp_connections;
+
+	std::unordered_map<WorkerThread*, Connection*> connections; // Owns the Connection objects.
+	std::vector<Connection*> connections_with_more_to_read; // Connections where we stopped reading before the socket would block.
+	std::vector<Connection*> connections_to_close;
+
+	glare::AtomicInt num_connections;
+	glare::AtomicInt should_quit;
+};
+
+
+/*=====================================================================
+EpollReactor
+------------
+Optional networking mode for client updates connections (enabled with the
+use_epoll_reactor server config option).
+
+A small pool of EpollReactorIOThreads owns all updates connections, instead
+of each connection having its own WorkerThread blocking on its socket.
+The initial connection handshake is still done on a WorkerThread, which then
+hands the connection off with addConnection() and terminates.
+Websocket connections are not handed off.
+=====================================================================*/
+class EpollReactor : public ThreadSafeRefCounted
+{
+public:
+	EpollReactor(Server* server, int num_io_threads);
+	~EpollReactor();
+
+	static bool isSupported(); // Is epoll available on this platform?
+
+	void addConnection(const Reference<WorkerThread>& worker); // threadsafe
+	void connectionClosed(WorkerThread* worker); // Called from IO threads.
+
+	size_t getNumIOThreads() const { return io_threads.size(); }
+	size_t getNumConnections(); // threadsafe
+
+	// All connections handled by the reactor.  Lock mutex when accessing.
+	// Connections are removed before the WorkerThread is released by the IO thread, so pointers are valid while the mutex is held.
+	Mutex mutex;
+	std::set<WorkerThread*> connections GUARDED_BY(mutex);
+
+private:
+	ThreadManager thread_manager;
+	std::vector<Reference<EpollReactorIOThread>> io_threads;
+	glare::AtomicInt next_io_thread_index;
+};
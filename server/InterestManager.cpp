@@ -0,0 +1,397 @@
+/*=====================================================================
+InterestManager.cpp
+-------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "InterestManager.h"
+
+
+#include <maths/mathstypes.h>
+#include <cmath>
+#include <cstring>
+
+
+InterestManager::InterestManager()
+:	interest_radius(500.0),
+	distant_update_period(10)
+{}
+
+
+InterestManager::~InterestManager()
+{}
+
+
+double InterestManager::cellWidth() const
+{
+	return myMax(interest_radius, 1.0);
+}
+
+
+void InterestManager::getCellCoords(const Vec3d& pos, int& x_out, int& y_out) const
+{
+	const double recip_cell_w = 1.0 / cellWidth();
+	x_out = (int)myClamp(std::floor(pos.x * recip_cell_w), -1.0e9, 1.0e9);
+	y_out = (int)myClamp(std::floor(pos.y * recip_cell_w), -1.0e9, 1.0e9);
+}
+
+
+void InterestManager::addTransformUpdate(const UID& uid, bool is_avatar, const Vec3d& pos, const SocketBufferOutStream& packet)
+{
+	if(packet.buf.empty())
+		return;
+
+	Update update;
+	update.pos = pos;
+	update.offset = data.size();
+	update.len = packet.buf.size();
+	data.append((const char*)packet.buf.data(), packet.buf.size());
+
+	if(pos.isFinite())
+	{
+		int x, y;
+		getCellCoords(pos, x, y);
+		cell_updates[cellKey(x, y)].push_back(update);
+	}
+	else
+		non_finite_updates.push_back(update);
+
+	// Replace any older pending distant update for this entity.
+	PendingDistantUpdate& pending = pending_distant_updates[entityKey(uid, is_avatar)];
+	pending.pos = pos;
+	pending.msg.assign((const char*)packet.buf.data(), packet.buf.size());
+}
+
+
+void InterestManager::removePendingDistantUpdate(const UID& uid, bool is_avatar)
+{
+	pending_distant_updates.erase(entityKey(uid, is_avatar));
+}
+
+
+void InterestManager::prepareForClientUpdates(bool distant_update_iteration)
+{
+	distant_cells.clear();
+
+	if(distant_update_iteration)
+	{
+		for(auto it = pending_distant_updates.begin(); it != pending_distant_updates.end(); ++it)
+		{
+			const PendingDistantUpdate& pending = it->second;
+			if(!pending.pos.isFinite()) // Updates with a non-finite position are sent to all clients every iteration, so don't need to be sent as distant updates.
+				continue;
+
+			int x, y;
+			getCellCoords(pending.pos, x, y);
+			DistantCell& cell = distant_cells[cellKey(x, y)];
+
+			Update update;
+			update.pos = pending.pos;
+			update.offset = cell.data.size();
+			update.len = pending.msg.size();
+			cell.data += pending.msg;
+			cell.updates.push_back(update);
+		}
+	}
+}
+
+
+void InterestManager::appendUpdatesForClient(const Vec3d* client_pos, bool distant_update_iteration, std::string& data_out) const
+{
+	if(!client_pos || !client_pos->isFinite())
+	{
+		// Client position is not known, so send all updates.
+		data_out += data;
+		return;
+	}
+
+	const double r2 = interest_radius * interest_radius;
+
+	// Since the cell width is >= interest_radius, all entities within interest_radius of the client are in the 3x3 block of cells around the client cell.
+	int client_x, client_y;
+	getCellCoords(*client_pos, client_x, client_y);
+
+	// Send updates for nearby entities every iteration.
+	for(int y=client_y - 1; y<=client_y + 1; ++y)
+	for(int x=client_x - 1; x<=client_x + 1; ++x)
+	{
+		auto res = cell_updates.find(cellKey(x, y));
+		if(res != cell_updates.end())
+		{
+			const std::vector<Update>& updates = res->second;
+			for(size_t i=0; i<updates.size(); ++i)
+			{
+				const Update& update = updates[i];
+				if(update.pos.getDist2(*client_pos) <= r2)
+					data_out.append(data, update.offset, update.len);
+			}
+		}
+	}
+
+	for(size_t i=0; i<non_finite_updates.size(); ++i)
+		data_out.append(data, non_finite_updates[i].offset, non_finite_updates[i].len);
+
+	// Send the latest updates for distant entities at a lower rate.
+	if(distant_update_iteration)
+	{
+		for(auto it = distant_cells.begin(); it != distant_cells.end(); ++it)
+		{
+			const int cell_x = (int)(int32)(uint32)(it->first >> 32);
+			const int cell_y = (int)(int32)(uint32)it->first;
+			const DistantCell& cell = it->second;
+
+			if(std::abs(cell_x - client_x) <= 1 && std::abs(cell_y - client_y) <= 1)
+			{
+				// Cell is next to the client cell, so check the distance to each entity.
+				for(size_t i=0; i<cell.updates.size(); ++i)
+					if(cell.updates[i].pos.getDist2(*client_pos) > r2)
+						data_out.append(cell.data, cell.updates[i].offset, cell.updates[i].len);
+			}
+			else
+				data_out += cell.data; // All entities in the cell are further than interest_radius from the client.
+		}
+	}
+}
+
+
+void InterestManager::endIteration(bool distant_update_iteration)
+{
+	data.clear();
+	cell_updates.clear();
+	non_finite_updates.clear();
+
+	if(distant_update_iteration)
+	{
+		pending_distant_updates.clear();
+		distant_cells.clear();
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include "../shared/Protocol.h"
+#include "../shared/MessageUtils.h"
+#include <maths/PCG32.h>
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <limits>
+
+
+static void makeTransformUpdatePacket(const UID& uid, const Vec3d& pos, SocketBufferOutStream& packet)
+{
+	// Same layout as the AvatarTransformUpdate messages built in the server main loop.
+	MessageUtils::initPacket(packet, Protocol::AvatarTransformUpdate);
+	writeToStream(uid, packet);
+	packet.writeDouble(pos.x);
+	packet.writeDouble(pos.y);
+	packet.writeDouble(pos.z);
+	packet.writeFloat(0.f); packet.writeFloat(0.f); packet.writeFloat(0.f); // rotation
+	packet.writeUInt32(0); // anim_state
+	MessageUtils::updatePacketLengthField(packet);
+}
+
+
+void InterestManager::test()
+{
+	conPrint("InterestManager::test()");
+
+	SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+	//------------------------ Basic tests ------------------------
+	{
+		InterestManager manager;
+		manager.setInterestRadius(100.0);
+		manager.setDistantUpdatePeriod(4);
+
+		testAssert(manager.isDistantUpdateIteration(0));
+		testAssert(!manager.isDistantUpdateIteration(1));
+		testAssert(manager.isDistantUpdateIteration(4));
+
+		makeTransformUpdatePacket(UID(1), Vec3d(10, 0, 0), packet);
+		const size_t msg_size = packet.buf.size();
+		manager.addTransformUpdate(UID(1), /*is avatar=*/true, Vec3d(10, 0, 0), packet);
+		manager.prepareForClientUpdates(/*distant_update_iteration=*/false);
+
+		// Near client gets the update
+		const Vec3d near_pos(0, 0, 0);
+		std::string data_out;
+		manager.appendUpdatesForClient(&near_pos, /*distant_update_iteration=*/false, data_out);
+		testAssert(data_out.size() == msg_size);
+
+		// Far client does not, on a non-distant update iteration.
+		const Vec3d far_pos(1000, 0, 0);
+		data_out.clear();
+		manager.appendUpdatesForClient(&far_pos, /*distant_update_iteration=*/false, data_out);
+		testAssert(data_out.empty());
+
+		// Client with unknown position gets the update.
+		data_out.clear();
+		manager.appendUpdatesForClient(NULL, /*distant_update_iteration=*/false, data_out);
+		testAssert(data_out.size() == msg_size);
+
+		manager.endIteration(/*distant_update_iteration=*/false);
+		testAssert(manager.numPendingDistantUpdates() == 1);
+
+		// Add another update for the same entity, and an update for an object with the same UID value.
+		makeTransformUpdatePacket(UID(1), Vec3d(20, 0, 0), packet);
+		manager.addTransformUpdate(UID(1), /*is avatar=*/true, Vec3d(20, 0, 0), packet);
+		manager.addTransformUpdate(UID(1), /*is avatar=*/false, Vec3d(20, 0, 0), packet);
+		testAssert(manager.numPendingDistantUpdates() == 2);
+		manager.prepareForClientUpdates(/*distant_update_iteration=*/true);
+
+		// On a distant update iteration, the far client gets just the latest update for each entity.
+		data_out.clear();
+		manager.appendUpdatesForClient(&far_pos, /*distant_update_iteration=*/true, data_out);
+		testAssert(data_out.size() == msg_size * 2);
+		testAssert(std::memcmp(data_out.data(), packet.buf.data(), msg_size) == 0);
+
+		// The near client gets the updates for this iteration, but not the distant updates.
+		data_out.clear();
+		manager.appendUpdatesForClient(&near_pos, /*distant_update_iteration=*/true, data_out);
+		testAssert(data_out.size() == msg_size * 2);
+
+		manager.endIteration(/*distant_update_iteration=*/true);
+		testAssert(manager.numPendingDistantUpdates() == 0);
+
+		manager.prepareForClientUpdates(/*distant_update_iteration=*/true);
+		data_out.clear();
+		manager.appendUpdatesForClient(&far_pos, /*distant_update_iteration=*/true, data_out);
+		testAssert(data_out.empty());
+	}
+
+	//------------------------ Test removal of pending distant updates ------------------------
+	{
+		InterestManager manager;
+		manager.setInterestRadius(100.0);
+
+		makeTransformUpdatePacket(UID(1), Vec3d(10, 0, 0), packet);
+		manager.addTransformUpdate(UID(1), /*is avatar=*/false, Vec3d(10, 0, 0), packet);
+		manager.addTransformUpdate(UID(2), /*is avatar=*/false, Vec3d(10, 0, 0), packet);
+		manager.prepareForClientUpdates(/*distant_update_iteration=*/false);
+		manager.endIteration(/*distant_update_iteration=*/false);
+		testAssert(manager.numPendingDistantUpdates() == 2);
+
+		// A full update for object 1 is sent, so the pending transform update for it should not be sent to distant clients.
+		manager.removePendingDistantUpdate(UID(1), /*is avatar=*/false);
+		manager.removePendingDistantUpdate(UID(2), /*is avatar=*/true); // Avatar with same UID value, should not remove object 2 update.
+		testAssert(manager.numPendingDistantUpdates() == 1);
+
+		manager.prepareForClientUpdates(/*distant_update_iteration=*/true);
+		const Vec3d far_pos(1000, 0, 0);
+		std::string data_out;
+		manager.appendUpdatesForClient(&far_pos, /*distant_update_iteration=*/true, data_out);
+		testAssert(data_out.size() == packet.buf.size());
+		manager.endIteration(/*distant_update_iteration=*/true);
+	}
+
+	//------------------------ Test distance filtering across cell boundaries ------------------------
+	{
+		InterestManager manager;
+		manager.setInterestRadius(100.0);
+
+		// Entities in the cell next to the client cell, one within the interest radius, one not.
+		makeTransformUpdatePacket(UID(1), Vec3d(-10, 0, 0), packet);
+		const size_t msg_size = packet.buf.size();
+		manager.addTransformUpdate(UID(1), /*is avatar=*/false, Vec3d(-10, 0, 0), packet);
+		manager.addTransformUpdate(UID(2), /*is avatar=*/false, Vec3d(-150, 0, 0), packet);
+		// Entity several cells away
+		manager.addTransformUpdate(UID(3), /*is avatar=*/false, Vec3d(-1000, -1000, 0), packet);
+		// Entity with a non-finite position, should be sent to everyone.
+		manager.addTransformUpdate(UID(4), /*is avatar=*/false, Vec3d(std::numeric_limits<double>::quiet_NaN(), 0, 0), packet);
+		manager.prepareForClientUpdates(/*distant_update_iteration=*/true);
+
+		const Vec3d client_pos(10, 0, 0);
+		std::string data_out;
+		manager.appendUpdatesForClient(&client_pos, /*distant_update_iteration=*/false, data_out);
+		testAssert(data_out.size() == msg_size * 2); // Entities 1 and 4
+
+		data_out.clear();
+		manager.appendUpdatesForClient(&client_pos, /*distant_update_iteration=*/true, data_out);
+		testAssert(data_out.size() == msg_size * 4); // Entities 1 and 4 as nearby updates, 2 and 3 as distant updates.
+		manager.endIteration(/*distant_update_iteration=*/true);
+	}
+
+	//------------------------ Stress scenario: measure egress bytes per client ------------------------
+	// Clients spread over a large world, each with a moving avatar, plus some moving dynamic objects.
+	{
+		const int NUM_CLIENTS = 300;
+		const int NUM_OBJECTS = 1000;
+		const int NUM_ITERS = 100; // 10 s at 100 ms per main loop iteration.
+		const double WORLD_W = 4000.0;
+
+		PCG32 rng(1);
+		std::vector<Vec3d> avatar_positions(NUM_CLIENTS);
+		for(int i=0; i<NUM_CLIENTS; ++i)
+			avatar_positions[i] = Vec3d((rng.unitRandom() - 0.5) * WORLD_W, (rng.unitRandom() - 0.5) * WORLD_W, 2.0);
+
+		std::vector<Vec3d> object_positions(NUM_OBJECTS);
+		for(int i=0; i<NUM_OBJECTS; ++i)
+			object_positions[i] = Vec3d((rng.unitRandom() - 0.5) * WORLD_W, (rng.unitRandom() - 0.5) * WORLD_W, 2.0);
+
+		InterestManager manager; // Use default radius and period.
+
+		uint64 broadcast_bytes = 0; // Total bytes sent to all clients with world-wide fan-out.
+		uint64 interest_managed_bytes = 0;
+		double total_append_time = 0;
+		std::string data_out;
+
+		for(int iter=0; iter<NUM_ITERS; ++iter)
+		{
+			size_t iter_update_bytes = 0;
+
+			// Every avatar moves each iteration.
+			for(int i=0; i<NUM_CLIENTS; ++i)
+			{
+				avatar_positions[i] += Vec3d((rng.unitRandom() - 0.5) * 2.0, (rng.unitRandom() - 0.5) * 2.0, 0);
+				makeTransformUpdatePacket(UID(i), avatar_positions[i], packet);
+				manager.addTransformUpdate(UID(i), /*is avatar=*/true, avatar_positions[i], packet);
+				iter_update_bytes += packet.buf.size();
+			}
+
+			// About 20% of objects move each iteration.
+			for(int i=0; i<NUM_OBJECTS; ++i)
+				if(rng.unitRandom() < 0.2f)
+				{
+					object_positions[i] += Vec3d((rng.unitRandom() - 0.5) * 2.0, (rng.unitRandom() - 0.5) * 2.0, 0);
+					makeTransformUpdatePacket(UID(i), object_positions[i], packet);
+					manager.addTransformUpdate(UID(i), /*is avatar=*/false, object_positions[i], packet);
+					iter_update_bytes += packet.buf.size();
+				}
+
+			broadcast_bytes += (uint64)iter_update_bytes * NUM_CLIENTS;
+
+			const bool distant_iter = manager.isDistantUpdateIteration(iter);
+			Timer timer;
+			manager.prepareForClientUpdates(distant_iter);
+			for(int i=0; i<NUM_CLIENTS; ++i)
+			{
+				data_out.clear();
+				manager.appendUpdatesForClient(&avatar_positions[i], distant_iter, data_out);
+				interest_managed_bytes += data_out.size();
+			}
+			total_append_time += timer.elapsed();
+
+			manager.endIteration(distant_iter);
+		}
+
+		const double sim_time = NUM_ITERS * 0.1;
+		const double broadcast_B_per_client_s = broadcast_bytes / (sim_time * NUM_CLIENTS);
+		const double interest_B_per_client_s = interest_managed_bytes / (sim_time * NUM_CLIENTS);
+
+		conPrint("Stress scenario: " + toString(NUM_CLIENTS) + " clients, " + toString(NUM_OBJECTS) + " objects, " + toString(NUM_ITERS) + " iterations:");
+		conPrint("World-wide broadcast egress:  " + doubleToStringNSigFigs(broadcast_B_per_client_s / 1024, 4) + " KB/s per client");
+		conPrint("Interest-managed egress:      " + doubleToStringNSigFigs(interest_B_per_client_s / 1024, 4) + " KB/s per client");
+		conPrint("Reduction factor:             " + doubleToStringNSigFigs(broadcast_B_per_client_s / interest_B_per_client_s, 4));
+		conPrint("appendUpdatesForClient time:  " + doubleToStringNSigFigs(total_append_time * 1.0e3 / NUM_ITERS, 4) + " ms per iteration (all clients)");
+
+		testAssert(interest_managed_bytes < broadcast_bytes);
+	}
+
+	conPrint("InterestManager::test() done.");
+}
+
+
+#endif // BUILD_TESTS
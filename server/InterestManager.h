@@ -0,0 +1,104 @@
+/*=====================================================================
+InterestManager.h
+-----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/UID.h"
+#include <maths/vec3.h>
+#include <SocketBufferOutStream.h>
+#include <unordered_map>
+#include <vector>
+#include <string>
+
+
+/*=====================================================================
+InterestManager
+---------------
+Area-of-interest filtering of transform updates for a single world.
+
+Transform updates (avatar and object transform updates) generated in a server main loop iteration are
+added with addTransformUpdate().  Each client then gets the updates for entities within interest_radius
+of the client's position every iteration.
+Updates for entities further away than interest_radius are only sent every distant_update_period iterations,
+and only the most recent update for each entity is sent.
+
+Clients with an unknown position get all updates every iteration.
+
+Updates are bucketed into a 2d grid of cells in the x-y plane, with cell width interest_radius, so that
+appendUpdatesForClient() only needs to check individual updates in the cells around the client.
+
+Not threadsafe, only used by the main server thread.
+=====================================================================*/
+class InterestManager
+{
+public:
+	InterestManager();
+	~InterestManager();
+
+	void setInterestRadius(double r) { interest_radius = r; }
+	void setDistantUpdatePeriod(int period) { distant_update_period = period; }
+
+	// Add a transform update message (with length field already set) for an entity at position pos.
+	// is_avatar distinguishes avatar UIDs from object UIDs.
+	void addTransformUpdate(const UID& uid, bool is_avatar, const Vec3d& pos, const SocketBufferOutStream& packet);
+
+	// Remove any pending distant update for the entity.  Should be called when a full update or destroyed message is sent for the entity,
+	// so that distant clients don't receive an older transform after the newer state.
+	void removePendingDistantUpdate(const UID& uid, bool is_avatar);
+
+	bool isDistantUpdateIteration(uint64 loop_iter) const { return (distant_update_period <= 1) || ((loop_iter % distant_update_period) == 0); }
+
+	// Called after all updates for this iteration have been added, and before appendUpdatesForClient() is called.
+	// On distant update iterations, buckets the pending distant updates by cell.
+	void prepareForClientUpdates(bool distant_update_iteration);
+
+	// Append the updates that should be sent to a client to data_out.  client_pos may be NULL if the client position is not known.
+	void appendUpdatesForClient(const Vec3d* client_pos, bool distant_update_iteration, std::string& data_out) const;
+
+	// Called after updates have been appended for all clients.  Clears updates for this iteration, and the pending distant updates if they were sent.
+	void endIteration(bool distant_update_iteration);
+
+	size_t numPendingDistantUpdates() const { return pending_distant_updates.size(); }
+
+	static void test();
+
+private:
+	struct Update
+	{
+		Vec3d pos;
+		size_t offset; // Offset of the message in data.
+		size_t len;
+	};
+
+	struct PendingDistantUpdate
+	{
+		Vec3d pos;
+		std::string msg;
+	};
+
+	// Pending distant updates in a cell, with the messages concatenated so that a distant cell can be appended with a single append.
+	struct DistantCell
+	{
+		std::string data;
+		std::vector<Update> updates;
+	};
+
+	static uint64 entityKey(const UID& uid, bool is_avatar) { return (uid.value() << 1) | (is_avatar ? 1 : 0); }
+	double cellWidth() const;
+	void getCellCoords(const Vec3d& pos, int& x_out, int& y_out) const;
+	static uint64 cellKey(int x, int y) { return ((uint64)(uint32)x << 32) | (uint32)y; }
+
+	double interest_radius;
+	int distant_update_period; // In main loop iterations.
+
+	std::string data; // Messages for the updates this iteration.
+	std::unordered_map<uint64, std::vector<Update>> cell_updates; // Updates this iteration with a finite position, keyed by cell key.
+	std::vector<Update> non_finite_updates; // Updates this iteration with a non-finite position.  These are sent to all clients.
+
+	std::unordered_map<uint64, PendingDistantUpdate> pending_distant_updates; // Most recent update for each entity, keyed by entity key.
+
+	std::unordered_map<uint64, DistantCell> distant_cells; // Pending distant updates bucketed by cell key, built by prepareForClientUpdates().
+};
@@ -0,0 +1,225 @@
+/*=====================================================================
+LODChunkObjectIndex.cpp
+-----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "LODChunkObjectIndex.h"
+
+
+#include <maths/mathstypes.h>
+#include <utils/Clock.h>
+#include <cmath>
+
+
+const float LODChunkObjectIndex::CHUNK_WIDTH = 128.f;
+
+
+LODChunkObjectIndex::LODChunkObjectIndex()
+{}
+
+
+LODChunkObjectIndex::~LODChunkObjectIndex()
+{}
+
+
+bool LODChunkObjectIndex::chunkCoordsForObject(const WorldObject* ob, Vec3i& coords_out)
+{
+	const Vec4f centroid = ob->getCentroidWS();
+	if(!(isFinite(centroid[0]) && isFinite(centroid[1])))
+		return false;
+
+	const float MAX_CHUNK_COORD = 1.0e8f;
+	coords_out = Vec3i(
+		(int)myClamp(std::floor(centroid[0] / CHUNK_WIDTH), -MAX_CHUNK_COORD, MAX_CHUNK_COORD),
+		(int)myClamp(std::floor(centroid[1] / CHUNK_WIDTH), -MAX_CHUNK_COORD, MAX_CHUNK_COORD),
+		0
+	);
+	return true;
+}
+
+
+void LODChunkObjectIndex::markChunkDirty(const Vec3i& coords)
+{
+	const double cur_time = Clock::getCurTimeRealSec();
+
+	auto res = dirty_chunks.find(coords);
+	if(res == dirty_chunks.end())
+		dirty_chunks.insert(std::make_pair(coords, DirtyInfo({cur_time, cur_time})));
+	else
+		res->second.last_dirty_time = cur_time;
+}
+
+
+void LODChunkObjectIndex::objectChanged(WorldObject* ob)
+{
+	Vec3i new_coords(0, 0, 0);
+	const bool in_chunk = chunkCoordsForObject(ob, new_coords);
+
+	auto res = ob_chunk.find(ob);
+	if(res != ob_chunk.end())
+	{
+		const Vec3i old_coords = res->second;
+		if(in_chunk && (old_coords == new_coords))
+		{
+			markChunkDirty(new_coords);
+			return;
+		}
+
+		// Remove from old chunk
+		auto chunk_res = chunks.find(old_coords);
+		if(chunk_res != chunks.end())
+		{
+			chunk_res->second.erase(ob);
+			if(chunk_res->second.empty())
+				chunks.erase(chunk_res);
+		}
+		markChunkDirty(old_coords);
+		ob_chunk.erase(res);
+	}
+
+	if(in_chunk)
+	{
+		chunks[new_coords].insert(ob);
+		ob_chunk.insert(std::make_pair(ob, new_coords));
+		markChunkDirty(new_coords);
+	}
+}
+
+
+void LODChunkObjectIndex::objectRemoved(WorldObject* ob)
+{
+	auto res = ob_chunk.find(ob);
+	if(res != ob_chunk.end())
+	{
+		const Vec3i coords = res->second;
+		auto chunk_res = chunks.find(coords);
+		if(chunk_res != chunks.end())
+		{
+			chunk_res->second.erase(ob);
+			if(chunk_res->second.empty())
+				chunks.erase(chunk_res);
+		}
+		markChunkDirty(coords);
+		ob_chunk.erase(res);
+	}
+}
+
+
+const std::unordered_set<WorldObject*>* LODChunkObjectIndex::getObjectsInChunk(const Vec3i& coords) const
+{
+	auto res = chunks.find(coords);
+	return (res != chunks.end()) ? &res->second : NULL;
+}
+
+
+void LODChunkObjectIndex::getNonEmptyChunks(std::vector<Vec3i>& coords_out) const
+{
+	for(auto it = chunks.begin(); it != chunks.end(); ++it)
+		coords_out.push_back(it->first);
+}
+
+
+void LODChunkObjectIndex::takeDirtyChunks(double cur_time, double settle_time, double max_wait_time, std::vector<Vec3i>& coords_out)
+{
+	for(auto it = dirty_chunks.begin(); it != dirty_chunks.end(); )
+	{
+		const DirtyInfo& info = it->second;
+		if((cur_time - info.last_dirty_time >= settle_time) || (cur_time - info.first_dirty_time >= max_wait_time))
+		{
+			coords_out.push_back(it->first);
+			it = dirty_chunks.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+
+void LODChunkObjectIndex::clearDirtyChunks()
+{
+	dirty_chunks.clear();
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <algorithm>
+
+
+static WorldObjectRef makeTestObject(const UID& uid, const Vec3d& pos)
+{
+	WorldObjectRef ob = new WorldObject();
+	ob->uid = uid;
+	ob->pos = pos;
+	ob->scale = Vec3f(1.f);
+	ob->axis = Vec3f(0, 0, 1);
+	ob->angle = 0;
+	ob->setAABBOS(js::AABBox(Vec4f(0,0,0,1), Vec4f(1,1,1,1)));
+	return ob;
+}
+
+
+void LODChunkObjectIndex::test()
+{
+	conPrint("LODChunkObjectIndex::test()");
+
+	const double t = Clock::getCurTimeRealSec();
+
+	{
+		LODChunkObjectIndex index;
+
+		WorldObjectRef ob_a = makeTestObject(UID(1), Vec3d(10, 10, 0));
+		WorldObjectRef ob_b = makeTestObject(UID(2), Vec3d(-10, 10, 0));
+
+		index.objectChanged(ob_a.ptr());
+		index.objectChanged(ob_b.ptr());
+		testAssert(index.numObjects() == 2);
+
+		Vec3i coords_a, coords_b;
+		testAssert(chunkCoordsForObject(ob_a.ptr(), coords_a) && coords_a == Vec3i(0, 0, 0));
+		testAssert(chunkCoordsForObject(ob_b.ptr(), coords_b) && coords_b == Vec3i(-1, 0, 0));
+
+		testAssert(index.getObjectsInChunk(coords_a) && index.getObjectsInChunk(coords_a)->count(ob_a.ptr()) == 1);
+		testAssert(index.getObjectsInChunk(Vec3i(5, 5, 0)) == NULL);
+		testAssert(index.numDirtyChunks() == 2);
+
+		// Chunks are not taken until they have settled.
+		std::vector<Vec3i> dirty;
+		index.takeDirtyChunks(t, /*settle time=*/1000.0, /*max wait time=*/1000.0, dirty);
+		testAssert(dirty.empty());
+
+		index.takeDirtyChunks(t + 2000.0, /*settle time=*/1000.0, /*max wait time=*/1000.0, dirty);
+		testAssert(dirty.size() == 2);
+		testAssert(index.numDirtyChunks() == 0);
+
+		// Move object a into chunk (2, 0).  Both chunks should be marked dirty.
+		ob_a->pos = Vec3d(300, 10, 0);
+		ob_a->transformChanged(); // Update centroid
+		index.objectChanged(ob_a.ptr());
+		testAssert(index.getObjectsInChunk(Vec3i(0, 0, 0)) == NULL);
+		testAssert(index.getObjectsInChunk(Vec3i(2, 0, 0)) && index.getObjectsInChunk(Vec3i(2, 0, 0))->count(ob_a.ptr()) == 1);
+
+		dirty.clear();
+		index.takeDirtyChunks(t + 2000.0, 1000.0, 1000.0, dirty);
+		std::sort(dirty.begin(), dirty.end());
+		testAssert(dirty.size() == 2 && dirty[0] == Vec3i(0, 0, 0) && dirty[1] == Vec3i(2, 0, 0));
+
+		// Remove object b
+		index.objectRemoved(ob_b.ptr());
+		testAssert(index.numObjects() == 1);
+		testAssert(index.getObjectsInChunk(Vec3i(-1, 0, 0)) == NULL);
+		testAssert(index.numDirtyChunks() == 1);
+
+		std::vector<Vec3i> non_empty;
+		index.getNonEmptyChunks(non_empty);
+		testAssert(non_empty.size() == 1 && non_empty[0] == Vec3i(2, 0, 0));
+	}
+
+	conPrint("LODChunkObjectIndex::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,77 @@
+/*=====================================================================
+LODChunkObjectIndex.h
+---------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "ServerObjectGrid.h"
+#include "../shared/WorldObject.h"
+#include <maths/vec3.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+/*=====================================================================
+LODChunkObjectIndex
+-------------------
+Tracks which objects are in each LOD chunk of a world, and which chunks
+are dirty (need rebuilding) due to objects in them being added, removed or changed.
+
+An object is in the chunk containing its world space AABB centroid.
+
+The world state calls objectChanged() and objectRemoved() when objects change,
+so ChunkGenThread doesn't need to scan all objects to find dirty chunks or
+the objects in a chunk.
+
+Stores raw pointers to objects, so objects must be removed before they are destroyed.
+Not threadsafe, access is guarded by the world state mutex.
+=====================================================================*/
+class LODChunkObjectIndex
+{
+public:
+	LODChunkObjectIndex();
+	~LODChunkObjectIndex();
+
+	static const float CHUNK_WIDTH;
+
+	static bool chunkCoordsForObject(const WorldObject* ob, Vec3i& coords_out); // Returns false if the object centroid is not finite.
+
+	// Inserts the object if not already inserted, and moves it to a new chunk if needed.  Marks the old and new chunks as dirty.
+	void objectChanged(WorldObject* ob);
+	void objectRemoved(WorldObject* ob); // Marks the chunk the object was in as dirty.
+
+	// Returns NULL if there are no objects in the chunk.
+	const std::unordered_set<WorldObject*>* getObjectsInChunk(const Vec3i& coords) const;
+
+	void getNonEmptyChunks(std::vector<Vec3i>& coords_out) const;
+
+	// Removes dirty chunks that are ready to be rebuilt from the dirty set, and appends their coords to coords_out.
+	// A chunk is ready if it has not been marked dirty for settle_time seconds, or if it was first marked dirty more than max_wait_time seconds ago
+	// (so chunks with continuously moving objects still get rebuilt occasionally).
+	void takeDirtyChunks(double cur_time, double settle_time, double max_wait_time, std::vector<Vec3i>& coords_out);
+
+	void clearDirtyChunks();
+	size_t numDirtyChunks() const { return dirty_chunks.size(); }
+
+	size_t numObjects() const { return ob_chunk.size(); }
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(LODChunkObjectIndex);
+
+	void markChunkDirty(const Vec3i& coords);
+
+	struct DirtyInfo
+	{
+		double first_dirty_time;
+		double last_dirty_time;
+	};
+
+	std::unordered_map<Vec3i, std::unordered_set<WorldObject*>, ServerObjectGridCellHash> chunks;
+	std::unordered_map<const WorldObject*, Vec3i> ob_chunk; // Chunk each inserted object is in.
+	std::unordered_map<Vec3i, DirtyInfo, ServerObjectGridCellHash> dirty_chunks;
+};
@@ -88,9 +88,9 @@ void ListenerThread::doRun()
 
 				// Create TLSSocket (tls_context) for worker thread/socket if this is configured as a TLS connection.
 				SocketInterfaceRef use_socket = plain_worker_sock;
+				struct tls* worker_tls_context = NULL;
 				if(tls_context)
 				{
-					struct tls* worker_tls_context = NULL;
 					if(tls_accept_socket(tls_context, &worker_tls_context, (int)plain_worker_sock->getSocketHandle()) != 0)
 						throw glare::Exception("tls_accept_socket failed: " + getTLSErrorString(tls_context));
 
@@ -104,6 +104,9 @@ void ListenerThread::doRun()
 					server
 				);
 
+				// So the connection can be handed off to the epoll reactor, if enabled.
+				worker_thread->setPlainSocketAndTLSContext(plain_worker_sock, worker_tls_context);
+
 				server->worker_thread_manager.addThread(worker_thread);
 			}
 			catch(glare::Exception& e)
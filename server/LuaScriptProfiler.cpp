@@ -0,0 +1,117 @@
+/*=====================================================================
+LuaScriptProfiler.cpp
+---------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "LuaScriptProfiler.h"
+
+
+#include <maths/mathstypes.h>
+#include <utils/Lock.h>
+#include <algorithm>
+
+
+LuaScriptProfiler::LuaScriptProfiler()
+:	enabled(0)
+{}
+
+
+LuaScriptProfiler::~LuaScriptProfiler()
+{}
+
+
+void LuaScriptProfiler::addExecution(const UID& ob_uid, const std::string& func_name, double exec_time)
+{
+	Lock lock(mutex);
+
+	auto res = func_stats.find(std::make_pair(ob_uid, func_name));
+	if(res == func_stats.end())
+	{
+		FuncStats stats;
+		stats.ob_uid = ob_uid;
+		stats.func_name = func_name;
+		stats.total_time = 0;
+		stats.max_time = 0;
+		stats.num_calls = 0;
+		res = func_stats.insert(std::make_pair(std::make_pair(ob_uid, func_name), stats)).first;
+	}
+
+	FuncStats& stats = res->second;
+	stats.total_time += exec_time;
+	stats.max_time = myMax(stats.max_time, exec_time);
+	stats.num_calls++;
+}
+
+
+static bool funcStatsGreaterTotalTime(const LuaScriptProfiler::FuncStats& a, const LuaScriptProfiler::FuncStats& b)
+{
+	return a.total_time > b.total_time;
+}
+
+
+void LuaScriptProfiler::getMostExpensiveFunctions(size_t max_num_results, std::vector<FuncStats>& stats_out)
+{
+	stats_out.clear();
+	{
+		Lock lock(mutex);
+		stats_out.reserve(func_stats.size());
+		for(auto it = func_stats.begin(); it != func_stats.end(); ++it)
+			stats_out.push_back(it->second);
+	}
+
+	std::sort(stats_out.begin(), stats_out.end(), funcStatsGreaterTotalTime);
+	if(stats_out.size() > max_num_results)
+		stats_out.resize(max_num_results);
+}
+
+
+void LuaScriptProfiler::clear()
+{
+	Lock lock(mutex);
+	func_stats.clear();
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+
+
+void LuaScriptProfiler::test()
+{
+	conPrint("LuaScriptProfiler::test()");
+
+	{
+		LuaScriptProfiler profiler;
+		testAssert(!profiler.isEnabled());
+		profiler.setEnabled(true);
+		testAssert(profiler.isEnabled());
+
+		profiler.addExecution(UID(1), "onTimerEvent", 0.001);
+		profiler.addExecution(UID(1), "onTimerEvent", 0.003);
+		profiler.addExecution(UID(1), "onUserUsedObject", 0.002);
+		profiler.addExecution(UID(2), "onTimerEvent", 0.010);
+
+		std::vector<FuncStats> stats;
+		profiler.getMostExpensiveFunctions(/*max num results=*/10, stats);
+		testAssert(stats.size() == 3);
+		testAssert(stats[0].ob_uid == UID(2) && stats[0].func_name == "onTimerEvent" && stats[0].num_calls == 1);
+		testAssert(stats[1].ob_uid == UID(1) && stats[1].func_name == "onTimerEvent" && stats[1].num_calls == 2);
+		testAssert(epsEqual(stats[1].total_time, 0.004) && epsEqual(stats[1].max_time, 0.003));
+		testAssert(stats[2].ob_uid == UID(1) && stats[2].func_name == "onUserUsedObject");
+
+		profiler.getMostExpensiveFunctions(/*max num results=*/1, stats);
+		testAssert(stats.size() == 1 && stats[0].ob_uid == UID(2));
+
+		profiler.clear();
+		profiler.getMostExpensiveFunctions(/*max num results=*/10, stats);
+		testAssert(stats.empty());
+	}
+
+	conPrint("LuaScriptProfiler::test() done.");
+}
+
+
+#endif // BUILD_TESTS
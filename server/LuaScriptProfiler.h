@@ -0,0 +1,63 @@
+/*=====================================================================
+LuaScriptProfiler.h
+-------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/UID.h"
+#include <utils/Mutex.h>
+#include <utils/AtomicInt.h>
+#include <utils/Platform.h>
+#include <map>
+#include <string>
+#include <vector>
+
+
+/*=====================================================================
+LuaScriptProfiler
+-----------------
+Attributes server-side Lua execution time to the object the script belongs to,
+and the Lua function that was called (event handler, timer callback etc.)
+
+Disabled by default, enabled from the admin page.  When disabled, the only cost
+per script execution is checking the enabled flag.
+
+Threadsafe.
+=====================================================================*/
+class LuaScriptProfiler
+{
+public:
+	LuaScriptProfiler();
+	~LuaScriptProfiler();
+
+	void setEnabled(bool enabled_) { enabled = enabled_ ? 1 : 0; }
+	bool isEnabled() const { return enabled != 0; }
+
+	void addExecution(const UID& ob_uid, const std::string& func_name, double exec_time);
+
+	struct FuncStats
+	{
+		UID ob_uid;
+		std::string func_name;
+		double total_time; // Total execution time (s)
+		double max_time; // Longest single execution (s)
+		uint64 num_calls;
+	};
+
+	// Get the functions with the largest total execution time, most expensive first.
+	void getMostExpensiveFunctions(size_t max_num_results, std::vector<FuncStats>& stats_out);
+
+	void clear();
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(LuaScriptProfiler);
+
+	glare::AtomicInt enabled;
+
+	Mutex mutex;
+	std::map<std::pair<UID, std::string>, FuncStats> func_stats GUARDED_BY(mutex);
+};
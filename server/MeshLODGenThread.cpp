@@ -18,11 +18,18 @@ Copyright Glare Technologies Limited 2022 -
 #include <TaskManager.h>
 #include <FileUtils.h>
 #include <KillThreadMessage.h>
+#include <Clock.h>
 #include <graphics/ImageMap.h>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <algorithm>
+#include <limits>
 
 
-MeshLODGenThread::MeshLODGenThread(ServerAllWorldsState* world_state_)
-:	world_state(world_state_)
+MeshLODGenThread::MeshLODGenThread(ServerAllWorldsState* world_state_, const std::string& manifest_path_)
+:	world_state(world_state_),
+	manifest_path(manifest_path_)
 {
 }
 
@@ -48,6 +55,16 @@ struct LODMeshToGen
 };
 
 
+struct OptimisedMeshToGen
+{
+	std::string model_URL; // URL of the source model.
+	std::string model_abs_path;
+	std::string optimised_model_abs_path;
+	std::string optimised_URL;
+	UserID owner_id;
+};
+
+
 struct LODTextureToGen
 {
 	std::string source_tex_abs_path; // Absolute base texture path, to read texture from.
@@ -78,7 +95,8 @@ struct MeshLODGenThreadTexInfo
 
 
 // Set object world space AABB if not set yet, or if it's incorrect.
-static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob)
+// Returns true if the AABB was checked successfully, in which case aabb_os_out is set to the computed object-space AABB.
+static bool checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, js::AABBox& aabb_os_out)
 {
 	try
 	{
@@ -160,6 +178,8 @@ static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldS
 				world->addWorldObjectAsDBDirty(ob, lock);
 			}
 		}
+		aabb_os_out = aabb_os;
+		return true;
 	}
 	catch(glare::Exception& e)
 	{
@@ -169,10 +189,12 @@ static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldS
 	{
 		conPrint(std::string("MeshLODGenThread: Caught std::exception: ") + e.what());
 	}
+	return false;
 }
 
 
-static void checkForLODMeshesToGenerate(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, std::unordered_set<std::string>& lod_URLs_considered, std::vector<LODMeshToGen>& meshes_to_gen)
+static void checkForLODMeshesToGenerate(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, const std::unordered_set<std::string>& processed_URLs, std::unordered_set<std::string>& lod_URLs_considered, 
+	std::vector<LODMeshToGen>& meshes_to_gen)
 {
 	try
 	{
@@ -202,7 +224,7 @@ static void checkForLODMeshesToGenerate(ServerAllWorldsState* world_state, Serve
 						const std::string lod_abs_path = WorldObject::getLODModelURLForLevel(model_abs_path, lvl);
 						const std::string lod_URL  = WorldObject::getLODModelURLForLevel(ob->model_url, lvl);
 
-						if(lod_URLs_considered.count(lod_URL) == 0)
+						if(lod_URLs_considered.count(lod_URL) == 0 && processed_URLs.count(lod_URL) == 0)
 						{
 							lod_URLs_considered.insert(lod_URL);
 
@@ -262,6 +284,71 @@ static void checkForLODMeshesToGenerate(ServerAllWorldsState* world_state, Serve
 }
 
 
+// Save the object and send the new flags to clients, after the server has changed ob->flags.
+static void objectFlagsChanged(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, WorldStateLock& lock)
+{
+	ob->from_remote_flags_dirty = true;
+	world->addWorldObjectAsDBDirty(ob, lock);
+	world->getDirtyFromRemoteObjects(lock).insert(ob);
+	world_state->markAsChanged();
+}
+
+
+// Make a task for generating the optimised bmesh version of the object model (see WorldObject::getOptimisedModelURL()), if needed.
+// Also checks that WorldObject::OPTIMISED_MODEL_FLAG is correct for the object, sets or clears if not.
+static void checkForOptimisedMeshToGenerate(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, const std::unordered_set<std::string>& processed_URLs, std::unordered_set<std::string>& lod_URLs_considered, 
+	std::vector<OptimisedMeshToGen>& meshes_to_gen)
+{
+	try
+	{
+		if(ob->object_type == WorldObject::ObjectType_Generic)
+		{
+			{
+				WorldStateLock lock(world_state->mutex);
+				if(ob->updateOptimisedModelFlag(*world_state->resource_manager))
+				{
+					conPrint("MeshLODGenThread: Updated OPTIMISED_MODEL_FLAG for object " + ob->uid.toString());
+					objectFlagsChanged(world_state, world, ob, lock);
+				}
+			}
+
+			if(!ob->model_url.empty() && WorldObject::modelURLCanHaveOptimisedVersion(ob->model_url))
+			{
+				const std::string optimised_URL = WorldObject::getOptimisedModelURL(ob->model_url);
+
+				const ResourceRef model_resource = world_state->resource_manager->getExistingResourceForURL(ob->model_url);
+
+				// Wait until the source model has been uploaded, otherwise we would add the optimised model URL to the manifest without generating it.
+				if(model_resource.nonNull() && world_state->resource_manager->isFileForURLPresent(ob->model_url) && 
+					lod_URLs_considered.count(optimised_URL) == 0 && processed_URLs.count(optimised_URL) == 0)
+				{
+					lod_URLs_considered.insert(optimised_URL);
+
+					if(!world_state->resource_manager->isFileForURLPresent(optimised_URL))
+					{
+						OptimisedMeshToGen mesh_to_gen;
+						mesh_to_gen.model_URL = ob->model_url;
+						mesh_to_gen.model_abs_path = world_state->resource_manager->getLocalAbsPathForResource(*model_resource);
+						mesh_to_gen.optimised_model_abs_path = world_state->resource_manager->pathForURL(optimised_URL);
+						mesh_to_gen.optimised_URL = optimised_URL;
+						mesh_to_gen.owner_id = model_resource->owner_id;
+						meshes_to_gen.push_back(mesh_to_gen);
+					}
+				}
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("MeshLODGenThread: glare::Exception: " + e.what());
+	}
+	catch(std::exception& e) // catch std::bad_alloc etc..
+	{
+		conPrint(std::string("MeshLODGenThread: Caught std::exception: ") + e.what());
+	}
+}
+
+
 static void checkMaterialFlags(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, std::map<std::string, MeshLODGenThreadTexInfo>& tex_info)
 {
 	for(size_t z=0; z<ob->materials.size(); ++z)
@@ -330,7 +417,7 @@ static void checkMaterialFlags(ServerAllWorldsState* world_state, ServerWorldSta
 
 
 // Make tasks for generating LOD level textures.
-static void checkForLODTexturesToGenerate(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, std::unordered_set<std::string>& lod_URLs_considered, //std::map<std::string, MeshLODGenThreadTexInfo>& tex_info,
+static void checkForLODTexturesToGenerate(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, const std::unordered_set<std::string>& processed_URLs, std::unordered_set<std::string>& lod_URLs_considered, //std::map<std::string, MeshLODGenThreadTexInfo>& tex_info,
 	std::vector<LODTextureToGen>& textures_to_gen)
 {
 	for(size_t z=0; z<ob->materials.size(); ++z)
@@ -364,7 +451,7 @@ static void checkForLODTexturesToGenerate(ServerAllWorldsState* world_state, Ser
 
 						if(lod_URL != texture_URL) // We don't do LOD for some texture types.
 						{
-							if(lod_URLs_considered.count(lod_URL) == 0)
+							if(lod_URLs_considered.count(lod_URL) == 0 && processed_URLs.count(lod_URL) == 0)
 							{
 								lod_URLs_considered.insert(lod_URL);
 
@@ -392,7 +479,7 @@ static void checkForLODTexturesToGenerate(ServerAllWorldsState* world_state, Ser
 
 
 // Make tasks for generating KTX level textures.
-static void checkForKTXTexturesToGenerate(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, std::unordered_set<std::string>& lod_URLs_considered,
+static void checkForKTXTexturesToGenerate(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, const std::unordered_set<std::string>& processed_URLs, std::unordered_set<std::string>& lod_URLs_considered,
 	std::vector<KTXTextureToGen>& ktx_textures_to_gen)
 {
 	for(size_t z=0; z<ob->materials.size(); ++z)
@@ -420,7 +507,7 @@ static void checkForKTXTexturesToGenerate(ServerAllWorldsState* world_state, Ser
 						{
 							const std::string ktx_lod_URL = ::eatExtension(lod_URL) + "ktx2";
 
-							if(lod_URLs_considered.count(ktx_lod_URL) == 0)
+							if(lod_URLs_considered.count(ktx_lod_URL) == 0 && processed_URLs.count(ktx_lod_URL) == 0)
 							{
 								lod_URLs_considered.insert(ktx_lod_URL);
 
@@ -449,11 +536,279 @@ static void checkForKTXTexturesToGenerate(ServerAllWorldsState* world_state, Ser
 }
 
 
+enum LODGenStage
+{
+	Stage_LODMesh = 0,
+	Stage_OptimisedMesh,
+	Stage_LODTexture,
+	Stage_KTXTexture,
+	NUM_STAGES
+};
+
+static const char* stage_names[NUM_STAGES] = { "LOD meshes", "optimised meshes", "LOD textures", "KTX textures" };
+
+
+// Generates a single LOD mesh, optimised mesh, LOD texture or KTX texture, then adds it to the resource manager.
+class LODGenTask : public glare::Task
+{
+public:
+	LODGenTask() : world_state(NULL), resize_task_managers(NULL), stage(Stage_LODMesh), lod_level(0), base_lod_level(0), input_size(0), output_size(0), succeeded(false), cant_generate(false), start_time(0), end_time(0) {}
+
+	virtual void run(size_t thread_index)
+	{
+		start_time = Clock::getCurTimeRealSec();
+		try
+		{
+			if(stage == Stage_LODMesh)
+			{
+				conPrint("MeshLODGenThread: Generating LOD mesh with URL " + output_URL);
+				LODGeneration::generateLODModel(source_abs_path, lod_level, output_abs_path);
+			}
+			else if(stage == Stage_OptimisedMesh)
+			{
+				conPrint("MeshLODGenThread: Generating optimised mesh with URL " + output_URL);
+				if(!LODGeneration::generateOptimisedModel(source_abs_path, output_abs_path))
+				{
+					conPrint("MeshLODGenThread: Model " + source_URL + " can't have an optimised version (VRM model), skipping.");
+					cant_generate = true;
+					end_time = Clock::getCurTimeRealSec();
+					return;
+				}
+			}
+			else if(stage == Stage_LODTexture)
+			{
+				conPrint("MeshLODGenThread: Generating LOD texture with URL " + output_URL);
+				LODGeneration::generateLODTexture(source_abs_path, lod_level, output_abs_path, getResizeTaskManager(thread_index));
+			}
+			else if(stage == Stage_KTXTexture)
+			{
+// NOTE: Disable KTX texture generation currently, since basis universal has lots of compile warnings which clutter up the build output, and we don't use basisu KTX files currently.
+#if 0
+				conPrint("MeshLODGenThread: Generating KTX texture with URL " + output_URL);
+				LODGeneration::generateKTXTexture(source_abs_path, base_lod_level, lod_level, output_abs_path, getResizeTaskManager(thread_index));
+#else
+				throw glare::Exception("KTX texture generation is disabled.");
+#endif
+			}
+
+			output_size = FileUtils::getFileSize(output_abs_path);
+
+			// Now that we have generated the LOD resource, add it to resources.
+			{ // lock scope
+				Lock lock(world_state->mutex);
+
+				const std::string raw_path = FileUtils::getFilename(output_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
+
+				ResourceRef resource = new Resource(
+					output_URL, // URL
+					raw_path, // raw local path
+					Resource::State_Present, // state
+					owner_id
+				);
+
+				world_state->addResourcesAsDBDirty(resource);
+				world_state->resource_manager->addResource(resource);
+
+			} // End lock scope
+
+			succeeded = true;
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("\tMeshLODGenThread: excep while generating " + std::string(stage_names[stage]) + " (URL " + output_URL + "): " + e.what());
+		}
+		catch(std::exception& e) // catch std::bad_alloc etc..
+		{
+			conPrint("\tMeshLODGenThread: Caught std::exception while generating " + std::string(stage_names[stage]) + " (URL " + output_URL + "): " + e.what());
+		}
+		end_time = Clock::getCurTimeRealSec();
+	}
+
+	// Texture resizing waits for all tasks on the resize task manager to complete, so each job thread has its own resize task manager,
+	// so that a job doesn't wait on resize tasks from jobs running on other threads.
+	glare::TaskManager& getResizeTaskManager(size_t thread_index) { return *(*resize_task_managers)[thread_index % resize_task_managers->size()]; }
+
+	ServerAllWorldsState* world_state;
+	const std::vector<std::unique_ptr<glare::TaskManager>>* resize_task_managers; // Used for resizing textures, indexed by job thread index.  Separate from the task manager running this task.
+
+	LODGenStage stage;
+	std::string source_URL; // Only set for Stage_OptimisedMesh currently.
+	std::string source_abs_path;
+	std::string output_abs_path;
+	std::string output_URL;
+	int lod_level;
+	int base_lod_level;
+	UserID owner_id;
+
+	// Results
+	uint64 input_size; // Size of source file (B)
+	uint64 output_size; // Size of generated file (B)
+	bool succeeded;
+	bool cant_generate; // True if the output can never be generated from the source, e.g. an optimised mesh for a VRM model.  The output URL is added to the manifest so the task isn't retried.
+	double start_time;
+	double end_time;
+};
+
+
+static uint64 getFileSizeOrZero(const std::string& path)
+{
+	try
+	{
+		return FileUtils::getFileSize(path);
+	}
+	catch(glare::Exception&)
+	{
+		return 0;
+	}
+}
+
+
+static std::string formatThroughput(double count, double bytes, double elapsed)
+{
+	const double safe_elapsed = myMax(elapsed, 1.0e-6);
+	return doubleToStringNSigFigs(count / safe_elapsed, 4) + " jobs/s, " + doubleToStringNSigFigs(bytes / (1024 * 1024) / safe_elapsed, 4) + " MB/s";
+}
+
+
+// Print jobs/s and bytes/s for each stage.
+// Stages run concurrently, so the throughput for each stage is computed over the time from the start of the first job in the stage to the end of the last job.
+static void printStageStats(const std::vector<Reference<LODGenTask>>& tasks, double total_elapsed)
+{
+	for(int s=0; s<NUM_STAGES; ++s)
+	{
+		size_t num_jobs = 0;
+		size_t num_failed = 0;
+		uint64 input_bytes = 0;
+		uint64 output_bytes = 0;
+		double begin_time = std::numeric_limits<double>::infinity();
+		double end_time = -std::numeric_limits<double>::infinity();
+		for(size_t i=0; i<tasks.size(); ++i)
+		{
+			const LODGenTask* task = tasks[i].ptr();
+			if(task->stage == s)
+			{
+				num_jobs++;
+				if(!task->succeeded && !task->cant_generate)
+					num_failed++;
+				input_bytes += task->input_size;
+				output_bytes += task->output_size;
+				begin_time = myMin(begin_time, task->start_time);
+				end_time = myMax(end_time, task->end_time);
+			}
+		}
+
+		if(num_jobs > 0)
+		{
+			const double stage_elapsed = end_time - begin_time;
+			conPrint("MeshLODGenThread: " + std::string(stage_names[s]) + ": " + toString(num_jobs) + " jobs (" + toString(num_failed) + " failed) in " + doubleToStringNSigFigs(stage_elapsed, 4) + " s: " +
+				formatThroughput((double)num_jobs, (double)input_bytes, stage_elapsed) + " in, " + doubleToStringNSigFigs(output_bytes / (1024.0 * 1024.0) / myMax(stage_elapsed, 1.0e-6), 4) + " MB/s out");
+		}
+	}
+
+	conPrint("MeshLODGenThread: All stages: " + toString(tasks.size()) + " jobs in " + doubleToStringNSigFigs(total_elapsed, 4) + " s");
+}
+
+
+void MeshLODGenThread::loadManifest()
+{
+	processed_URLs.clear();
+	model_AABBs.clear();
+
+	if(manifest_path.empty() || !FileUtils::fileExists(manifest_path))
+		return;
+
+	try
+	{
+		const std::string contents = FileUtils::readEntireFileTextMode(manifest_path);
+		const std::vector<std::string> lines = ::split(contents, '\n');
+		for(size_t i=0; i<lines.size(); ++i)
+		{
+			if(lines[i].empty())
+				continue;
+
+			// Model AABB lines have the form "URL\tmin_x min_y min_z max_x max_y max_z".
+			const size_t tab_pos = lines[i].find('\t');
+			if(tab_pos == std::string::npos)
+				processed_URLs.insert(lines[i]);
+			else
+			{
+				std::istringstream stream(lines[i].substr(tab_pos + 1));
+				float v[6];
+				for(int z=0; z<6; ++z)
+					stream >> v[z];
+				if(stream)
+					model_AABBs[lines[i].substr(0, tab_pos)] = js::AABBox(Vec4f(v[0], v[1], v[2], 1), Vec4f(v[3], v[4], v[5], 1));
+			}
+		}
+
+		conPrint("MeshLODGenThread: Loaded " + toString(processed_URLs.size()) + " processed URLs and " + toString(model_AABBs.size()) + " model AABBs from manifest '" + manifest_path + "'.");
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("MeshLODGenThread: Error while loading manifest: " + e.what());
+	}
+}
+
+
+void MeshLODGenThread::addToManifest(const std::vector<std::string>& URLs)
+{
+	std::vector<std::string> new_URLs;
+	for(size_t i=0; i<URLs.size(); ++i)
+		if(processed_URLs.insert(URLs[i]).second)
+			new_URLs.push_back(URLs[i]);
+
+	if(manifest_path.empty() || new_URLs.empty())
+		return;
+
+	// Append to the manifest file, so we don't need to rewrite the whole file each time.
+	std::ofstream stream(manifest_path.c_str(), std::ofstream::out | std::ofstream::app | std::ofstream::binary);
+	if(!stream)
+	{
+		conPrint("MeshLODGenThread: Failed to open manifest '" + manifest_path + "' for writing.");
+		return;
+	}
+	for(size_t i=0; i<new_URLs.size(); ++i)
+		stream << new_URLs[i] << '\n';
+}
+
+
+void MeshLODGenThread::addModelAABBsToManifest(const std::vector<std::string>& model_URLs)
+{
+	if(manifest_path.empty() || model_URLs.empty())
+		return;
+
+	std::ofstream stream(manifest_path.c_str(), std::ofstream::out | std::ofstream::app | std::ofstream::binary);
+	if(!stream)
+	{
+		conPrint("MeshLODGenThread: Failed to open manifest '" + manifest_path + "' for writing.");
+		return;
+	}
+	stream.precision(std::numeric_limits<float>::max_digits10);
+	for(size_t i=0; i<model_URLs.size(); ++i)
+	{
+		auto res = model_AABBs.find(model_URLs[i]);
+		if(res != model_AABBs.end())
+		{
+			const js::AABBox& aabb = res->second;
+			stream << model_URLs[i] << '\t' << aabb.min_.x[0] << ' ' << aabb.min_.x[1] << ' ' << aabb.min_.x[2] << ' ' << aabb.max_.x[0] << ' ' << aabb.max_.x[1] << ' ' << aabb.max_.x[2] << '\n';
+		}
+	}
+}
+
+
 void MeshLODGenThread::doRun()
 {
 	PlatformUtils::setCurrentThreadName("MeshLODGenThread");
 
-	glare::TaskManager task_manager("MeshLODGenThread task manager");
+	// Jobs are run on job_task_manager.  Idle threads take the next job from the shared queue, so a few slow jobs don't hold up the rest.
+	// Texture resizing within a job is done on the resize task manager for the job thread.  (Tasks on job_task_manager can't wait on tasks on the same task manager)
+	const size_t num_job_threads = myClamp<size_t>(PlatformUtils::getNumLogicalProcessors() / 2, 1, 8);
+	glare::TaskManager job_task_manager("MeshLODGenThread job task manager", num_job_threads);
+	std::vector<std::unique_ptr<glare::TaskManager>> resize_task_managers(job_task_manager.getNumThreads());
+	for(size_t i=0; i<resize_task_managers.size(); ++i)
+		resize_task_managers[i].reset(new glare::TaskManager("MeshLODGenThread resize task manager " + toString(i), myMax<size_t>(1, PlatformUtils::getNumLogicalProcessors() / resize_task_managers.size())));
+
+	loadManifest();
 
 	// When this thread starts, we will do a full scan over all objects.
 	// After that we will wait for CheckGenResourcesForObject messages, which instructs this thread to just scan a single object.
@@ -488,10 +843,14 @@ void MeshLODGenThread::doRun()
 			// Set object max_lod_level if it is a generic model or a voxel model.
 			// Compute list of LOD meshes we need to generate.
 			std::vector<LODMeshToGen> meshes_to_gen;
+			std::vector<OptimisedMeshToGen> optimised_meshes_to_gen;
 			std::vector<LODTextureToGen> lod_textures_to_gen;
 			std::vector<KTXTextureToGen> ktx_textures_to_gen;
 			std::unordered_set<std::string> lod_URLs_considered;
 			std::map<std::string, MeshLODGenThreadTexInfo> tex_info; // Cached info about textures
+			std::vector<std::string> newly_processed_URLs; // URLs to add to the manifest.
+			std::vector<std::string> new_model_AABB_URLs; // Model URLs with newly computed AABBs, to add to the manifest.
+			size_t num_AABB_checks_skipped = 0;
 
 			conPrint("MeshLODGenThread: Iterating over world object(s)...");
 			Timer timer;
@@ -510,15 +869,31 @@ void MeshLODGenThread::doRun()
 							WorldObject* ob = it->second.ptr();
 							try
 							{
-								if(true)
-									checkObjectSpaceAABB(world_state, world, ob);
+								// The AABB check loads the model, so skip it if we already know the AABB of the model, and the object AABB matches it.
+								const bool is_model_ob = (ob->object_type == WorldObject::ObjectType_Generic) && !ob->model_url.empty();
+								auto model_AABB_res = is_model_ob ? model_AABBs.find(ob->model_url) : model_AABBs.end();
+								if(model_AABB_res != model_AABBs.end() && 
+									approxEq(model_AABB_res->second.min_, ob->getAABBOS().min_) && approxEq(model_AABB_res->second.max_, ob->getAABBOS().max_))
+									num_AABB_checks_skipped++;
+								else
+								{
+									js::AABBox aabb_os;
+									const bool AABB_ok = checkObjectSpaceAABB(world_state, world, ob, aabb_os);
+									if(AABB_ok && is_model_ob && !aabb_os.isEmpty())
+									{
+										if(model_AABBs.count(ob->model_url) == 0)
+											new_model_AABB_URLs.push_back(ob->model_url);
+										model_AABBs[ob->model_url] = aabb_os;
+									}
+								}
 
 								if(false)
 									checkMaterialFlags(world_state, world, ob, tex_info);
 
-								checkForLODMeshesToGenerate(world_state, world, ob, lod_URLs_considered, meshes_to_gen);
-								checkForLODTexturesToGenerate(world_state, world, ob, lod_URLs_considered, lod_textures_to_gen);
-								checkForKTXTexturesToGenerate(world_state, world, ob, lod_URLs_considered, ktx_textures_to_gen);
+								checkForLODMeshesToGenerate(world_state, world, ob, processed_URLs, lod_URLs_considered, meshes_to_gen);
+								checkForOptimisedMeshToGenerate(world_state, world, ob, processed_URLs, lod_URLs_considered, optimised_meshes_to_gen);
+								checkForLODTexturesToGenerate(world_state, world, ob, processed_URLs, lod_URLs_considered, lod_textures_to_gen);
+								checkForKTXTexturesToGenerate(world_state, world, ob, processed_URLs, lod_URLs_considered, ktx_textures_to_gen);
 							}
 							catch(glare::Exception& e)
 							{
@@ -540,9 +915,10 @@ void MeshLODGenThread::doRun()
 							WorldObject* ob = res->second.ptr();
 							try
 							{
-								checkForLODMeshesToGenerate(world_state, world, ob, lod_URLs_considered, meshes_to_gen);
-								checkForLODTexturesToGenerate(world_state, world, ob, lod_URLs_considered, lod_textures_to_gen);
-								checkForKTXTexturesToGenerate(world_state, world, ob, lod_URLs_considered, ktx_textures_to_gen);
+								checkForLODMeshesToGenerate(world_state, world, ob, processed_URLs, lod_URLs_considered, meshes_to_gen);
+								checkForOptimisedMeshToGenerate(world_state, world, ob, processed_URLs, lod_URLs_considered, optimised_meshes_to_gen);
+								checkForLODTexturesToGenerate(world_state, world, ob, processed_URLs, lod_URLs_considered, lod_textures_to_gen);
+								checkForKTXTexturesToGenerate(world_state, world, ob, processed_URLs, lod_URLs_considered, ktx_textures_to_gen);
 							}
 							catch(glare::Exception& e)
 							{
@@ -553,133 +929,116 @@ void MeshLODGenThread::doRun()
 				}
 			} // End lock scope
 
-			conPrint("MeshLODGenThread: Iterating over objects took " + timer.elapsedStringNSigFigs(4) + ", meshes_to_gen: " + toString(meshes_to_gen.size()) + ", lod_textures_to_gen: " + toString(lod_textures_to_gen.size()) + 
-				", ktx_textures_to_gen: " + toString(ktx_textures_to_gen.size()));
+			conPrint("MeshLODGenThread: Iterating over objects took " + timer.elapsedStringNSigFigs(4) + ", meshes_to_gen: " + toString(meshes_to_gen.size()) + ", optimised_meshes_to_gen: " + toString(optimised_meshes_to_gen.size()) + ", lod_textures_to_gen: " + toString(lod_textures_to_gen.size()) + 
+				", ktx_textures_to_gen: " + toString(ktx_textures_to_gen.size()) + ", AABB checks skipped (model AABB known): " + toString(num_AABB_checks_skipped));
 
 
-			//-------------------------------------------  Generate each mesh, without holding the world lock -------------------------------------------
-			conPrint("MeshLODGenThread: Generating LOD meshes...");
-			timer.reset();
+			//------------------------------------------- Make a task for each LOD mesh and texture to generate -------------------------------------------
+			std::vector<Reference<LODGenTask>> tasks;
+			std::unordered_set<std::string> job_URLs;
 
 			for(size_t i=0; i<meshes_to_gen.size(); ++i)
 			{
-				const LODMeshToGen& mesh_to_gen = meshes_to_gen[i];
-				try
-				{
-					conPrint("MeshLODGenThread: Generating LOD mesh with URL " + mesh_to_gen.lod_URL);
-
-					LODGeneration::generateLODModel(mesh_to_gen.model_abs_path, mesh_to_gen.lod_level, mesh_to_gen.LOD_model_abs_path);
-
-					// Now that we have generated the LOD model, add it to resources.
-					{ // lock scope
-						Lock lock(world_state->mutex);
-
-						const std::string raw_path = FileUtils::getFilename(mesh_to_gen.LOD_model_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
-
-						ResourceRef resource = new Resource(
-							mesh_to_gen.lod_URL, // URL
-							raw_path, // raw local path
-							Resource::State_Present, // state
-							mesh_to_gen.owner_id
-						);
-
-						world_state->addResourcesAsDBDirty(resource);
-						world_state->resource_manager->addResource(resource);
-						
-					} // End lock scope
-				}
-				catch(glare::Exception& e)
-				{
-					conPrint("\tMeshLODGenThread: glare::Exception while generating LOD model: " + e.what());
-				}
+				Reference<LODGenTask> task = new LODGenTask();
+				task->stage = Stage_LODMesh;
+				task->source_abs_path = meshes_to_gen[i].model_abs_path;
+				task->output_abs_path = meshes_to_gen[i].LOD_model_abs_path;
+				task->output_URL = meshes_to_gen[i].lod_URL;
+				task->lod_level = meshes_to_gen[i].lod_level;
+				task->owner_id = meshes_to_gen[i].owner_id;
+				tasks.push_back(task);
 			}
 
-			conPrint("MeshLODGenThread: Done generating LOD meshes. (Elapsed: " + timer.elapsedStringNSigFigs(4) + ")");
-
-
-			//------------------------------------------- Generate each texture, without holding the world lock -------------------------------------------
-			conPrint("MeshLODGenThread: Generating LOD textures...");
-			timer.reset();
+			for(size_t i=0; i<optimised_meshes_to_gen.size(); ++i)
+			{
+				Reference<LODGenTask> task = new LODGenTask();
+				task->stage = Stage_OptimisedMesh;
+				task->source_URL = optimised_meshes_to_gen[i].model_URL;
+				task->source_abs_path = optimised_meshes_to_gen[i].model_abs_path;
+				task->output_abs_path = optimised_meshes_to_gen[i].optimised_model_abs_path;
+				task->output_URL = optimised_meshes_to_gen[i].optimised_URL;
+				task->owner_id = optimised_meshes_to_gen[i].owner_id;
+				tasks.push_back(task);
+			}
 
 			for(size_t i=0; i<lod_textures_to_gen.size(); ++i)
 			{
-				const LODTextureToGen& tex_to_gen = lod_textures_to_gen[i];
-				try
-				{
-					conPrint("MeshLODGenThread:  (LOD tex " + toString(i) + " / " + toString(lod_textures_to_gen.size()) + "): Generating LOD texture with URL " + tex_to_gen.lod_URL);
-
-					LODGeneration::generateLODTexture(tex_to_gen.source_tex_abs_path, tex_to_gen.lod_level, tex_to_gen.LOD_tex_abs_path, task_manager);
-
-					// Now that we have generated the LOD model, add it to resources.
-					{ // lock scope
-						Lock lock(world_state->mutex);
-
-						const std::string raw_path = FileUtils::getFilename(tex_to_gen.LOD_tex_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
-
-						ResourceRef resource = new Resource(
-							tex_to_gen.lod_URL, // URL
-							raw_path, // raw local path
-							Resource::State_Present, // state
-							tex_to_gen.owner_id
-						);
+				Reference<LODGenTask> task = new LODGenTask();
+				task->stage = Stage_LODTexture;
+				task->source_abs_path = lod_textures_to_gen[i].source_tex_abs_path;
+				task->output_abs_path = lod_textures_to_gen[i].LOD_tex_abs_path;
+				task->output_URL = lod_textures_to_gen[i].lod_URL;
+				task->lod_level = lod_textures_to_gen[i].lod_level;
+				task->owner_id = lod_textures_to_gen[i].owner_id;
+				tasks.push_back(task);
+			}
 
-						world_state->addResourcesAsDBDirty(resource);
-						world_state->resource_manager->addResource(resource);
+			// KTX textures are generated from LOD textures, so would need to be generated after the LOD textures.
+			// KTX texture generation is disabled currently (see LODGenTask::run()), so don't make tasks for them.
 
-					} // End lock scope
-				}
-				catch(glare::Exception& e)
-				{
-					conPrint("\tMeshLODGenThread: excep while generating LOD texture: " + e.what());
-				}
+			for(size_t i=0; i<tasks.size(); ++i)
+			{
+				tasks[i]->world_state = world_state;
+				tasks[i]->resize_task_managers = &resize_task_managers;
+				tasks[i]->input_size = getFileSizeOrZero(tasks[i]->source_abs_path);
+				job_URLs.insert(tasks[i]->output_URL);
 			}
 
-			conPrint("MeshLODGenThread: Done generating LOD textures. (Elapsed: " + timer.elapsedStringNSigFigs(4));
-
-			//------------------------------------------- Generate each KTX texture, without holding the world lock -------------------------------------------
-// NOTE: Disable KTX texture generation currently, since basis universal has lots of compile warnings which clutter up the build output, and we don't use basisu KTX files currently.
-#if 0
-			conPrint("MeshLODGenThread: Generating KTX textures...");
-			timer.reset();
+			// LOD URLs that were considered, but that we don't need to generate, are already present.
+			for(auto it = lod_URLs_considered.begin(); it != lod_URLs_considered.end(); ++it)
+				if(job_URLs.count(*it) == 0 && !hasExtension(*it, "ktx2"))
+					newly_processed_URLs.push_back(*it);
 
-			for(size_t i=0; i<ktx_textures_to_gen.size(); ++i)
+			//------------------------------------------- Run the tasks, without holding the world lock -------------------------------------------
+			if(!tasks.empty())
 			{
-				const KTXTextureToGen& tex_to_gen = ktx_textures_to_gen[i];
-				try
-				{
-					conPrint("MeshLODGenThread: (ktx " + toString(i) + " / " + toString(ktx_textures_to_gen.size()) + "): Generating KTX texture with URL " + tex_to_gen.ktx_URL);
+				conPrint("MeshLODGenThread: Generating " + toString(tasks.size()) + " LOD meshes and textures with " + toString(job_task_manager.getNumThreads()) + " threads...");
+				timer.reset();
 
-					LODGeneration::generateKTXTexture(tex_to_gen.source_tex_abs_path, 
-						tex_to_gen.base_lod_level, tex_to_gen.lod_level, tex_to_gen.ktx_tex_abs_path, 
-						task_manager);
+				// Start the biggest jobs first, so that a big job started last doesn't leave the other threads idle at the end.
+				std::vector<Reference<LODGenTask>> sorted_tasks = tasks;
+				std::stable_sort(sorted_tasks.begin(), sorted_tasks.end(), [](const Reference<LODGenTask>& a, const Reference<LODGenTask>& b) { return a->input_size > b->input_size; });
 
-					// Now that we have generated the LOD model, add it to resources.
-					{ // lock scope
-						Lock lock(world_state->mutex);
+				for(size_t i=0; i<sorted_tasks.size(); ++i)
+					job_task_manager.addTask(sorted_tasks[i]);
 
-						const std::string raw_path = FileUtils::getFilename(tex_to_gen.ktx_tex_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
+				job_task_manager.waitForTasksToComplete();
 
-						ResourceRef resource = new Resource(
-							tex_to_gen.ktx_URL, // URL
-							raw_path, // raw local path
-							Resource::State_Present, // state
-							tex_to_gen.owner_id
-						);
+				printStageStats(tasks, timer.elapsed());
 
-						world_state->addResourcesAsDBDirty(resource);
-						world_state->resource_manager->addResource(resource);
+				for(size_t i=0; i<tasks.size(); ++i)
+					if(tasks[i]->succeeded || tasks[i]->cant_generate)
+						newly_processed_URLs.push_back(tasks[i]->output_URL);
 
-					} // End lock scope
-				}
-				catch(glare::Exception& e)
+				// Now that the optimised meshes are present, set OPTIMISED_MODEL_FLAG on the objects using them, so that clients will load the optimised meshes.
 				{
-					conPrint("\tMeshLODGenThread: excep while generating KTX texture: " + e.what());
+					WorldStateLock lock(world_state->mutex);
+					for(size_t i=0; i<tasks.size(); ++i)
+						if(tasks[i]->succeeded && (tasks[i]->stage == Stage_OptimisedMesh))
+						{
+							for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
+							{
+								ServerWorldState* world = world_it->second.ptr();
+
+								std::vector<UID> ob_uids;
+								world->getResourceURLObjectIndex(lock).getObjectsUsingURL(tasks[i]->source_URL, ob_uids);
+								for(size_t z=0; z<ob_uids.size(); ++z)
+								{
+									auto res = world->getObjects(lock).find(ob_uids[z]);
+									if(res != world->getObjects(lock).end())
+									{
+										WorldObject* ob = res->second.ptr();
+										if(ob->updateOptimisedModelFlag(*world_state->resource_manager))
+											objectFlagsChanged(world_state, world, ob, lock);
+									}
+								}
+							}
+						}
 				}
 			}
 
-			conPrint("MeshLODGenThread: Done generating KTX textures. (Elapsed: " + timer.elapsedStringNSigFigs(4) + ")");
-#endif
-			//------------------------------------------- End Generate each KTX texture  -------------------------------------------
+			addToManifest(newly_processed_URLs);
+			addModelAABBsToManifest(new_model_AABB_URLs);
 		}
 	}
 	catch(glare::Exception& e)
@@ -8,6 +8,11 @@ Copyright Glare Technologies Limited 2022 -
 
 #include "../shared/UID.h"
 #include <MessageableThread.h>
+#include <physics/jscol_aabbox.h>
+#include <unordered_set>
+#include <unordered_map>
+#include <string>
+#include <vector>
 class ServerAllWorldsState;
 
 
@@ -23,17 +28,38 @@ MeshLODGenThread
 ----------------
 Does generation of LOD meshes, also LOD textures and KTX textures.
 
+Also generates optimised bmesh versions of non-bmesh models (glb, obj etc.),
+which clients load instead of the source model, so they don't need to parse and
+optimise the model themselves.  Sets WorldObject::OPTIMISED_MODEL_FLAG on objects
+once the optimised model is present.
+
+The LOD meshes and textures to generate are found by scanning objects, and are then
+generated in parallel on a task manager.
+
+URLs of generated or already present LOD resources are stored in a manifest file, so they
+don't need to be checked again on restart.  The manifest also stores the object-space AABB of
+each model that has been loaded for an object AABB check, so that the model only needs to be
+loaded again for objects whose stored AABB differs.  Delete the manifest file to force a full rescan.
+
 Lightmap LOD generation is done by LightMapperBot.
 =====================================================================*/
 class MeshLODGenThread : public MessageableThread
 {
 public:
-	MeshLODGenThread(ServerAllWorldsState* world_state);
+	// manifest_path may be empty, in which case no manifest is used.
+	MeshLODGenThread(ServerAllWorldsState* world_state, const std::string& manifest_path);
 
 	virtual ~MeshLODGenThread();
 
 	virtual void doRun();
 
 private:
+	void loadManifest();
+	void addToManifest(const std::vector<std::string>& URLs); // Adds to processed_URLs and appends new URLs to the manifest file.
+	void addModelAABBsToManifest(const std::vector<std::string>& model_URLs); // Appends model AABBs (from model_AABBs) to the manifest file.
+
 	ServerAllWorldsState* world_state;
+	std::string manifest_path;
+	std::unordered_set<std::string> processed_URLs;
+	std::unordered_map<std::string, js::AABBox> model_AABBs; // Object-space AABB for model URLs, computed by loading the model.
 };
@@ -0,0 +1,167 @@
+/*=====================================================================
+ResourceDownloadScheduler.cpp
+-----------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ResourceDownloadScheduler.h"
+
+
+#include <maths/mathstypes.h>
+
+
+const uint64 ResourceDownloadScheduler::MAX_CHUNK_SIZE;
+
+
+ResourceDownloadScheduler::ResourceDownloadScheduler()
+:	next_seq(0)
+{}
+
+
+ResourceDownloadScheduler::~ResourceDownloadScheduler()
+{}
+
+
+void ResourceDownloadScheduler::addRequest(const Reference<Request>& request)
+{
+	request->seq = next_seq++;
+	requests[request->request_id] = request;
+}
+
+
+bool ResourceDownloadScheduler::updatePriority(uint32 request_id, float priority)
+{
+	auto res = requests.find(request_id);
+	if(res == requests.end())
+		return false;
+	res->second->priority = priority;
+	return true;
+}
+
+
+bool ResourceDownloadScheduler::cancelRequest(uint32 request_id)
+{
+	return requests.erase(request_id) > 0;
+}
+
+
+ResourceDownloadScheduler::Request* ResourceDownloadScheduler::getNextChunk(uint64& chunk_size_out)
+{
+	// There are only a small number of requests in flight per connection, so just do a linear scan.
+	Request* best = NULL;
+	for(auto it = requests.begin(); it != requests.end(); ++it)
+	{
+		Request* request = it->second.ptr();
+		if(request->next_offset >= request->resource.size)
+			continue;
+
+		if(!best || (request->priority < best->priority) || ((request->priority == best->priority) && (request->seq < best->seq)))
+			best = request;
+	}
+
+	if(best)
+		chunk_size_out = myMin(MAX_CHUNK_SIZE, best->resource.size - best->next_offset);
+	return best;
+}
+
+
+void ResourceDownloadScheduler::chunkSent(Request* request, uint64 chunk_size)
+{
+	request->next_offset += chunk_size;
+	if(request->next_offset >= request->resource.size)
+	{
+		const uint32 request_id = request->request_id; // Copy, as erasing will destroy the request.
+		requests.erase(request_id);
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+
+
+static Reference<ResourceDownloadScheduler::Request> makeTestRequest(uint32 id, float priority, uint64 size)
+{
+	Reference<ResourceDownloadScheduler::Request> request = new ResourceDownloadScheduler::Request();
+	request->request_id = id;
+	request->priority = priority;
+	request->next_offset = 0;
+	request->resource.size = size;
+	return request;
+}
+
+
+void ResourceDownloadScheduler::test()
+{
+	conPrint("ResourceDownloadScheduler::test()");
+
+	{
+		ResourceDownloadScheduler scheduler;
+		uint64 chunk_size;
+		testAssert(scheduler.getNextChunk(chunk_size) == NULL);
+
+		// A large resource is requested first, then a small more important one.
+		scheduler.addRequest(makeTestRequest(/*id=*/1, /*priority=*/10.f, /*size=*/MAX_CHUNK_SIZE * 10));
+
+		Request* request = scheduler.getNextChunk(chunk_size);
+		testAssert(request && request->request_id == 1 && chunk_size == MAX_CHUNK_SIZE);
+		scheduler.chunkSent(request, chunk_size);
+
+		scheduler.addRequest(makeTestRequest(/*id=*/2, /*priority=*/1.f, /*size=*/100));
+		request = scheduler.getNextChunk(chunk_size);
+		testAssert(request && request->request_id == 2 && chunk_size == 100);
+		scheduler.chunkSent(request, chunk_size);
+		testAssert(scheduler.numRequests() == 1); // Request 2 is complete, so should have been removed.
+
+		// Back to request 1
+		request = scheduler.getNextChunk(chunk_size);
+		testAssert(request && request->request_id == 1 && request->next_offset == MAX_CHUNK_SIZE);
+
+		// Add request 3 with lower importance, then make it the most important.
+		scheduler.addRequest(makeTestRequest(/*id=*/3, /*priority=*/20.f, /*size=*/MAX_CHUNK_SIZE + 1));
+		request = scheduler.getNextChunk(chunk_size);
+		testAssert(request && request->request_id == 1);
+
+		testAssert(scheduler.updatePriority(3, 0.5f));
+		testAssert(!scheduler.updatePriority(100, 0.5f));
+		request = scheduler.getNextChunk(chunk_size);
+		testAssert(request && request->request_id == 3 && chunk_size == MAX_CHUNK_SIZE);
+		scheduler.chunkSent(request, chunk_size);
+		request = scheduler.getNextChunk(chunk_size);
+		testAssert(request && request->request_id == 3 && chunk_size == 1);
+		scheduler.chunkSent(request, chunk_size);
+
+		// Ties are broken by request order.
+		scheduler.addRequest(makeTestRequest(/*id=*/4, /*priority=*/10.f, /*size=*/10));
+		request = scheduler.getNextChunk(chunk_size);
+		testAssert(request && request->request_id == 1);
+
+		// Cancel request 1
+		testAssert(scheduler.cancelRequest(1));
+		testAssert(!scheduler.cancelRequest(1));
+		request = scheduler.getNextChunk(chunk_size);
+		testAssert(request && request->request_id == 4);
+		scheduler.chunkSent(request, chunk_size);
+		testAssert(scheduler.numRequests() == 0);
+		testAssert(scheduler.getNextChunk(chunk_size) == NULL);
+	}
+
+	// Range resume: a request starting part way through a resource just sends the remaining data.
+	{
+		ResourceDownloadScheduler scheduler;
+		Reference<Request> resumed = makeTestRequest(/*id=*/1, /*priority=*/1.f, /*size=*/MAX_CHUNK_SIZE * 2);
+		resumed->next_offset = MAX_CHUNK_SIZE + 10;
+		scheduler.addRequest(resumed);
+
+		uint64 chunk_size;
+		Request* request = scheduler.getNextChunk(chunk_size);
+		testAssert(request && chunk_size == MAX_CHUNK_SIZE - 10);
+	}
+
+	conPrint("ResourceDownloadScheduler::test() done.");
+}
+
+
+#endif // BUILD_TESTS
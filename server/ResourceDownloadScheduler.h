@@ -0,0 +1,66 @@
+/*=====================================================================
+ResourceDownloadScheduler.h
+---------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "ResourceSendCache.h"
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/Reference.h>
+#include <utils/Platform.h>
+#include <map>
+
+
+/*=====================================================================
+ResourceDownloadScheduler
+-------------------------
+Chooses which chunk of which resource to send next on a multiplexed
+resource download connection (Protocol::ConnectionTypeDownloadResourcesMultiplexed).
+
+Each request has a client-supplied priority, which can be updated while the
+resource is being sent.  The next chunk is always taken from the request with the
+lowest priority value (most important), with ties broken by the order the
+requests were added, so a large resource doesn't block smaller, more important
+resources requested after it.
+
+Used by a single WorkerThread, so not threadsafe.
+=====================================================================*/
+class ResourceDownloadScheduler
+{
+public:
+	ResourceDownloadScheduler();
+	~ResourceDownloadScheduler();
+
+	static const uint64 MAX_CHUNK_SIZE = 1 << 16;
+
+	struct Request : public ThreadSafeRefCounted
+	{
+		uint32 request_id;
+		float priority; // Lower values are sent first.
+		uint64 seq; // Order the request was added in.  Set by addRequest().
+		uint64 next_offset; // Offset in the resource of the next byte to send.
+		ResourceSendCache::OpenResource resource;
+	};
+
+	void addRequest(const Reference<Request>& request); // Replaces any existing request with the same id.
+	bool updatePriority(uint32 request_id, float priority); // Returns false if there is no such request.
+	bool cancelRequest(uint32 request_id); // Returns false if there is no such request.
+
+	// Returns the request to send the next chunk from, or NULL if there are no requests with data remaining.
+	// The chunk is [request->next_offset, request->next_offset + chunk_size_out).
+	Request* getNextChunk(uint64& chunk_size_out);
+
+	void chunkSent(Request* request, uint64 chunk_size); // Advances the request offset, and removes the request if it is complete.
+
+	size_t numRequests() const { return requests.size(); }
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(ResourceDownloadScheduler);
+
+	std::map<uint32, Reference<Request>> requests;
+	uint64 next_seq;
+};
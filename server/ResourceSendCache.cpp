@@ -0,0 +1,335 @@
+/*=====================================================================
+ResourceSendCache.cpp
+---------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ResourceSendCache.h"
+
+
+#include <networking/MySocket.h>
+#include <utils/OutStream.h>
+#include <utils/MemMappedFile.h>
+#include <utils/FileUtils.h>
+#include <utils/Exception.h>
+#include <utils/Lock.h>
+#include <utils/PlatformUtils.h>
+#include <utils/StringUtils.h>
+#include <maths/mathstypes.h>
+#if !(defined(_WIN32) || defined(OSX))
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+
+ResourceSendCache::OpenResource::OpenResource()
+:	size(0),
+	fd(-1)
+{}
+
+
+ResourceSendCache::OpenResource::~OpenResource()
+{
+#if !(defined(_WIN32) || defined(OSX))
+	if(fd != -1)
+		close(fd);
+#endif
+}
+
+
+ResourceSendCache::ResourceSendCache(size_t max_cache_size_B_, size_t max_cached_resource_size_B_, bool use_sendfile_)
+:	max_cache_size_B(max_cache_size_B_),
+	max_cached_resource_size_B(max_cached_resource_size_B_),
+	use_sendfile(use_sendfile_),
+	cache_size_B(0)
+{
+	stats.cache_hits = 0;
+	stats.cache_misses = 0;
+	stats.cache_size_B = 0;
+	stats.num_cached_resources = 0;
+	stats.bytes_sent_from_cache = 0;
+	stats.bytes_sent_with_sendfile = 0;
+	stats.bytes_sent_from_mapped_file = 0;
+}
+
+
+ResourceSendCache::~ResourceSendCache()
+{}
+
+
+void ResourceSendCache::openResource(const std::string& local_path, OpenResource& resource_out)
+{
+	resource_out.local_path = local_path;
+
+	// See if resource is in the cache already
+	{
+		Lock lock(mutex);
+		auto res = cache.find(local_path);
+		if(res != cache.end())
+		{
+			LRU_list.splice(LRU_list.begin(), LRU_list, res->second.LRU_it); // Move to front of LRU list
+			resource_out.cached = res->second.resource;
+			resource_out.size = resource_out.cached->data.size();
+			stats.cache_hits++;
+			return;
+		}
+		stats.cache_misses++;
+	}
+
+	const uint64 file_size = FileUtils::getFileSize(local_path); // Throws glare::Exception if file not found.
+
+	if(file_size <= max_cached_resource_size_B && file_size <= max_cache_size_B)
+	{
+		// Load into memory and add to cache.
+		Reference<CachedResource> cached = new CachedResource();
+		FileUtils::readEntireFile(local_path, cached->data);
+
+		{
+			Lock lock(mutex);
+			auto res = cache.find(local_path);
+			if(res == cache.end()) // Another thread may have added it in the meantime.
+			{
+				LRU_list.push_front(local_path);
+				CacheItem item;
+				item.resource = cached;
+				item.LRU_it = LRU_list.begin();
+				cache.insert(std::make_pair(local_path, item));
+				cache_size_B += cached->data.size();
+
+				evictResourcesIfNeeded();
+			}
+		}
+
+		resource_out.cached = cached;
+		resource_out.size = cached->data.size();
+		return;
+	}
+
+	resource_out.size = file_size;
+
+#if !(defined(_WIN32) || defined(OSX))
+	if(use_sendfile)
+	{
+		resource_out.fd = open(local_path.c_str(), O_RDONLY | O_CLOEXEC);
+		if(resource_out.fd == -1)
+			throw glare::Exception("Failed to open file '" + local_path + "': " + PlatformUtils::getLastErrorString());
+
+		// Use the size of the file we actually opened, in case it was changed since getFileSize().
+		struct stat st;
+		if(fstat(resource_out.fd, &st) != 0)
+			throw glare::Exception("fstat failed for '" + local_path + "': " + PlatformUtils::getLastErrorString());
+		resource_out.size = (uint64)st.st_size;
+
+		posix_fadvise(resource_out.fd, 0, 0, POSIX_FADV_SEQUENTIAL); // Hint for more aggressive readahead.
+	}
+#endif
+}
+
+
+void ResourceSendCache::sendResourceData(const OpenResource& resource, uint64 offset, uint64 len, OutStream& socket)
+{
+	if(offset > resource.size || len > resource.size - offset)
+		throw glare::Exception("Invalid resource data range");
+
+	if(len == 0)
+		return;
+
+	if(resource.cached.nonNull())
+	{
+		socket.writeData(resource.cached->data.data() + offset, len);
+
+		Lock lock(mutex);
+		stats.bytes_sent_from_cache += len;
+		return;
+	}
+
+#if !(defined(_WIN32) || defined(OSX))
+	MySocket* plain_socket = dynamic_cast<MySocket*>(&socket); // Will be NULL for TLS sockets.
+	if((resource.fd != -1) && plain_socket)
+	{
+		const int socket_fd = (int)plain_socket->getSocketHandle();
+		off_t file_offset = (off_t)offset;
+		uint64 remaining = len;
+		while(remaining > 0)
+		{
+			const size_t chunk_size = (size_t)myMin<uint64>(remaining, 1ull << 30);
+			const ssize_t num_sent = sendfile(socket_fd, resource.fd, &file_offset, chunk_size);
+			if(num_sent < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				throw MySocketExcep("sendfile failed: " + PlatformUtils::getLastErrorString());
+			}
+			if(num_sent == 0)
+				throw MySocketExcep("sendfile failed: file '" + resource.local_path + "' was truncated.");
+
+			remaining -= (uint64)num_sent;
+		}
+
+		Lock lock(mutex);
+		stats.bytes_sent_with_sendfile += len;
+		return;
+	}
+#endif
+
+	// Fall back to memory mapping the file and writing it to the socket.
+	MemMappedFile file(resource.local_path);
+	if(offset + len > file.fileSize())
+		throw glare::Exception("File '" + resource.local_path + "' was truncated.");
+
+	socket.writeData((const uint8*)file.fileData() + offset, len);
+
+	Lock lock(mutex);
+	stats.bytes_sent_from_mapped_file += len;
+}
+
+
+void ResourceSendCache::invalidateResource(const std::string& local_path)
+{
+	Lock lock(mutex);
+	auto res = cache.find(local_path);
+	if(res != cache.end())
+	{
+		cache_size_B -= res->second.resource->data.size();
+		LRU_list.erase(res->second.LRU_it);
+		cache.erase(res);
+	}
+}
+
+
+void ResourceSendCache::evictResourcesIfNeeded()
+{
+	while((cache_size_B > max_cache_size_B) && !LRU_list.empty())
+	{
+		auto res = cache.find(LRU_list.back());
+		assert(res != cache.end());
+		cache_size_B -= res->second.resource->data.size();
+		cache.erase(res);
+		LRU_list.pop_back();
+	}
+}
+
+
+ResourceSendCache::Stats ResourceSendCache::getStats()
+{
+	Lock lock(mutex);
+	Stats res = stats;
+	res.cache_size_B = cache_size_B;
+	res.num_cached_resources = cache.size();
+	return res;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/BufferOutStream.h>
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+
+
+static void writeTestFile(const std::string& path, size_t size, uint8 val)
+{
+	std::vector<uint8> data(size);
+	for(size_t i=0; i<size; ++i)
+		data[i] = (uint8)(val + i);
+	FileUtils::writeEntireFile(path, (const char*)data.data(), data.size());
+}
+
+
+void ResourceSendCache::test()
+{
+	conPrint("ResourceSendCache::test()");
+
+	try
+	{
+		const std::string dir = PlatformUtils::getTempDirPath() + "/resource_send_cache_test";
+		FileUtils::createDirIfDoesNotExist(dir);
+
+		const std::string small_a = dir + "/small_a.bin";
+		const std::string small_b = dir + "/small_b.bin";
+		const std::string large   = dir + "/large.bin";
+		writeTestFile(small_a, 1000, 1);
+		writeTestFile(small_b, 1000, 2);
+		writeTestFile(large, 100000, 3);
+
+		ResourceSendCache cache(/*max cache size=*/1500, /*max cached resource size=*/10000, /*use sendfile=*/true);
+
+		// Small resource should be cached
+		{
+			OpenResource resource;
+			cache.openResource(small_a, resource);
+			testAssert(resource.cached.nonNull() && resource.size == 1000);
+
+			BufferOutStream out;
+			cache.sendResourceData(resource, 10, 20, out);
+			testAssert(out.buf.size() == 20 && out.buf[0] == (uint8)(1 + 10));
+		}
+		{
+			OpenResource resource;
+			cache.openResource(small_a, resource);
+			testAssert(cache.getStats().cache_hits == 1);
+		}
+
+		// Adding small_b should evict small_a, since both don't fit in the cache budget.
+		{
+			OpenResource resource;
+			cache.openResource(small_b, resource);
+			testAssert(resource.cached.nonNull());
+			testAssert(cache.getStats().num_cached_resources == 1);
+			testAssert(cache.getStats().cache_size_B == 1000);
+		}
+
+		// Large resource is not cached.  The BufferOutStream is not a MySocket, so the memory mapped file fallback is used.
+		{
+			OpenResource resource;
+			cache.openResource(large, resource);
+			testAssert(resource.cached.isNull() && resource.size == 100000);
+
+			BufferOutStream out;
+			cache.sendResourceData(resource, 0, resource.size, out);
+			testAssert(out.buf.size() == 100000 && out.buf[99999] == (uint8)(3 + 99999));
+			testAssert(cache.getStats().bytes_sent_from_mapped_file == 100000);
+
+			// Invalid ranges
+			try
+			{
+				cache.sendResourceData(resource, 99990, 11, out);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+
+		// Invalidation
+		writeTestFile(small_b, 500, 4);
+		cache.invalidateResource(small_b);
+		testAssert(cache.getStats().num_cached_resources == 0);
+		{
+			OpenResource resource;
+			cache.openResource(small_b, resource);
+			testAssert(resource.size == 500 && resource.cached->data[0] == 4);
+		}
+
+		// Missing file
+		try
+		{
+			OpenResource resource;
+			cache.openResource(dir + "/not_a_file.bin", resource);
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ResourceSendCache::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,104 @@
+/*=====================================================================
+ResourceSendCache.h
+-------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/Reference.h>
+#include <utils/Mutex.h>
+#include <utils/Platform.h>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+class OutStream;
+
+
+/*=====================================================================
+ResourceSendCache
+-----------------
+Sends resource file data to sockets, for resource downloads over the
+Substrata protocol (GetFiles) and HTTP /resource requests.
+
+Small resources (thumbnails, low LOD level meshes and textures etc.) are kept
+in an in-memory LRU cache with a byte budget, so hot resources don't need to be
+read from disk for each request.
+
+Other resources are sent with sendfile() when the socket is a plain TCP socket
+(e.g. when running behind a TLS terminator), which avoids copying the file data
+through user space.  For TLS sockets, or on platforms without sendfile(), the file
+is memory mapped and written to the socket.
+
+Threadsafe.
+=====================================================================*/
+class ResourceSendCache : public ThreadSafeRefCounted
+{
+public:
+	ResourceSendCache(size_t max_cache_size_B, size_t max_cached_resource_size_B, bool use_sendfile);
+	~ResourceSendCache();
+
+	struct CachedResource : public ThreadSafeRefCounted
+	{
+		std::vector<uint8> data;
+	};
+
+	class OpenResource
+	{
+	public:
+		OpenResource();
+		~OpenResource(); // Closes file descriptor, if open.
+
+		std::string local_path;
+		uint64 size;
+		Reference<CachedResource> cached; // Non-null if the resource data is in memory.
+		int fd; // File descriptor to sendfile() from, or -1.
+	private:
+		GLARE_DISABLE_COPY(OpenResource);
+	};
+
+	// Gets the resource from the cache, or opens the file at local_path.  Throws glare::Exception if the file could not be opened.
+	void openResource(const std::string& local_path, OpenResource& resource_out);
+
+	// Writes bytes [offset, offset + len) of the resource to the socket.  sendfile() is used if socket is a plain MySocket.  Throws glare::Exception on failure.
+	void sendResourceData(const OpenResource& resource, uint64 offset, uint64 len, OutStream& socket);
+
+	void invalidateResource(const std::string& local_path); // Call when the file at local_path is overwritten, e.g. by an upload.
+
+	struct Stats
+	{
+		uint64 cache_hits;
+		uint64 cache_misses;
+		uint64 cache_size_B;
+		uint64 num_cached_resources;
+		uint64 bytes_sent_from_cache;
+		uint64 bytes_sent_with_sendfile;
+		uint64 bytes_sent_from_mapped_file;
+	};
+	Stats getStats();
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(ResourceSendCache);
+
+	void evictResourcesIfNeeded() REQUIRES(mutex);
+
+	struct CacheItem
+	{
+		Reference<CachedResource> resource;
+		std::list<std::string>::iterator LRU_it;
+	};
+
+	const size_t max_cache_size_B;
+	const size_t max_cached_resource_size_B;
+	const bool use_sendfile;
+
+	Mutex mutex;
+	std::unordered_map<std::string, CacheItem> cache GUARDED_BY(mutex);
+	std::list<std::string> LRU_list GUARDED_BY(mutex); // Most recently used at front.
+	size_t cache_size_B GUARDED_BY(mutex);
+	Stats stats GUARDED_BY(mutex);
+};
@@ -0,0 +1,159 @@
+/*=====================================================================
+ResourceURLObjectIndex.cpp
+--------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ResourceURLObjectIndex.h"
+
+
+#include <algorithm>
+
+
+ResourceURLObjectIndex::ResourceURLObjectIndex()
+{}
+
+
+ResourceURLObjectIndex::~ResourceURLObjectIndex()
+{}
+
+
+void ResourceURLObjectIndex::removeObjectFromURLs(const UID& uid, const std::vector<std::string>& URLs)
+{
+	for(size_t i=0; i<URLs.size(); ++i)
+	{
+		auto res = URL_to_obs.find(URLs[i]);
+		if(res != URL_to_obs.end())
+		{
+			res->second.erase(uid);
+			if(res->second.empty())
+				URL_to_obs.erase(res);
+		}
+	}
+}
+
+
+void ResourceURLObjectIndex::objectChanged(const WorldObject* ob)
+{
+	temp_dependency_URLs.clear();
+	ob->appendDependencyURLsForAllLODLevels(temp_dependency_URLs);
+
+	temp_URLs.resize(temp_dependency_URLs.size());
+	for(size_t i=0; i<temp_dependency_URLs.size(); ++i)
+		temp_URLs[i] = temp_dependency_URLs[i].URL;
+	std::sort(temp_URLs.begin(), temp_URLs.end());
+	temp_URLs.erase(std::unique(temp_URLs.begin(), temp_URLs.end()), temp_URLs.end());
+
+	auto res = ob_URLs.find(ob->uid);
+	if(res != ob_URLs.end())
+	{
+		if(res->second == temp_URLs) // Most object changes (e.g. transform changes) don't change the URLs, so early out in that case.
+			return;
+
+		removeObjectFromURLs(ob->uid, res->second);
+		ob_URLs.erase(res);
+	}
+
+	if(!temp_URLs.empty())
+	{
+		for(size_t i=0; i<temp_URLs.size(); ++i)
+			URL_to_obs[temp_URLs[i]].insert(ob->uid);
+
+		ob_URLs.insert(std::make_pair(ob->uid, temp_URLs));
+	}
+}
+
+
+void ResourceURLObjectIndex::objectRemoved(const WorldObject* ob)
+{
+	auto res = ob_URLs.find(ob->uid);
+	if(res != ob_URLs.end())
+	{
+		removeObjectFromURLs(ob->uid, res->second);
+		ob_URLs.erase(res);
+	}
+}
+
+
+void ResourceURLObjectIndex::getObjectsUsingURL(const std::string& URL, std::vector<UID>& uids_out) const
+{
+	auto res = URL_to_obs.find(URL);
+	if(res != URL_to_obs.end())
+		uids_out.insert(uids_out.end(), res->second.begin(), res->second.end());
+}
+
+
+size_t ResourceURLObjectIndex::numObjectsUsingURL(const std::string& URL) const
+{
+	auto res = URL_to_obs.find(URL);
+	return (res != URL_to_obs.end()) ? res->second.size() : 0;
+}
+
+
+#if BUILD_TESTS
+
+
+#include "../shared/WorldMaterial.h"
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+
+
+void ResourceURLObjectIndex::test()
+{
+	conPrint("ResourceURLObjectIndex::test()");
+
+	{
+		ResourceURLObjectIndex index;
+
+		WorldObjectRef ob_a = new WorldObject();
+		ob_a->uid = UID(1);
+		ob_a->model_url = "model_a.bmesh";
+		ob_a->materials.push_back(new WorldMaterial());
+		ob_a->materials[0]->colour_texture_url = "tex.jpg";
+
+		WorldObjectRef ob_b = new WorldObject();
+		ob_b->uid = UID(2);
+		ob_b->model_url = "model_b.bmesh";
+		ob_b->materials.push_back(new WorldMaterial());
+		ob_b->materials[0]->colour_texture_url = "tex.jpg";
+
+		index.objectChanged(ob_a.ptr());
+		index.objectChanged(ob_b.ptr());
+		testAssert(index.numObjects() == 2);
+
+		testAssert(index.numObjectsUsingURL("model_a.bmesh") == 1);
+		testAssert(index.numObjectsUsingURL("model_b.bmesh") == 1);
+		testAssert(index.numObjectsUsingURL("tex.jpg") == 2);
+		testAssert(!index.isURLUsed("other.jpg"));
+
+		std::vector<UID> uids;
+		index.getObjectsUsingURL("tex.jpg", uids);
+		std::sort(uids.begin(), uids.end());
+		testAssert(uids.size() == 2 && uids[0] == UID(1) && uids[1] == UID(2));
+
+		// Change the model URL of object a.  Calling objectChanged again with no URL changes should do nothing.
+		ob_a->model_url = "model_c.bmesh";
+		index.objectChanged(ob_a.ptr());
+		index.objectChanged(ob_a.ptr());
+		testAssert(!index.isURLUsed("model_a.bmesh"));
+		testAssert(index.numObjectsUsingURL("model_c.bmesh") == 1);
+		testAssert(index.numObjectsUsingURL("tex.jpg") == 2);
+
+		// Remove object b
+		index.objectRemoved(ob_b.ptr());
+		testAssert(index.numObjects() == 1);
+		testAssert(!index.isURLUsed("model_b.bmesh"));
+		testAssert(index.numObjectsUsingURL("tex.jpg") == 1);
+
+		// Remove all URLs from object a
+		ob_a->model_url = "";
+		ob_a->materials.clear();
+		index.objectChanged(ob_a.ptr());
+		testAssert(index.numObjects() == 0);
+		testAssert(index.numURLs() == 0);
+	}
+
+	conPrint("ResourceURLObjectIndex::test() done.");
+}
+
+
+#endif // BUILD_TESTS
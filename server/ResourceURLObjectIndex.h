@@ -0,0 +1,58 @@
+/*=====================================================================
+ResourceURLObjectIndex.h
+------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/WorldObject.h"
+#include "../shared/UID.h"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+/*=====================================================================
+ResourceURLObjectIndex
+----------------------
+Reverse index from resource URL to the UIDs of the objects in a world that
+depend on it (model, textures, lightmap, audio, including LOD level URLs),
+as returned by WorldObject::appendDependencyURLsForAllLODLevels().
+
+The world state calls objectChanged() and objectRemoved() when objects change,
+so finding the objects that use a newly uploaded resource, or checking if a
+resource is used by any object, doesn't need a scan over all objects.
+
+Not threadsafe, access is guarded by the world state mutex.
+=====================================================================*/
+class ResourceURLObjectIndex
+{
+public:
+	ResourceURLObjectIndex();
+	~ResourceURLObjectIndex();
+
+	void objectChanged(const WorldObject* ob); // Call when an object is added, or any of its dependency URLs may have changed.
+	void objectRemoved(const WorldObject* ob);
+
+	void getObjectsUsingURL(const std::string& URL, std::vector<UID>& uids_out) const; // Appends UIDs of objects using URL to uids_out.
+	size_t numObjectsUsingURL(const std::string& URL) const;
+	bool isURLUsed(const std::string& URL) const { return URL_to_obs.count(URL) > 0; }
+
+	size_t numURLs() const { return URL_to_obs.size(); }
+	size_t numObjects() const { return ob_URLs.size(); }
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(ResourceURLObjectIndex);
+
+	void removeObjectFromURLs(const UID& uid, const std::vector<std::string>& URLs);
+
+	std::unordered_map<std::string, std::unordered_set<UID, UIDHasher>> URL_to_obs;
+	std::unordered_map<UID, std::vector<std::string>, UIDHasher> ob_URLs; // Sorted, unique URLs for each object.  Objects with no dependency URLs are not stored.
+
+	std::vector<DependencyURL> temp_dependency_URLs;
+	std::vector<std::string> temp_URLs;
+};
@@ -7,14 +7,17 @@ Copyright Glare Technologies Limited 2023 -
 
 
 #include "ListenerThread.h"
+#include "EpollReactor.h"
 #include "UDPHandlerThread.h"
 #include "MeshLODGenThread.h"
 #include "DynamicTextureUpdaterThread.h"
-//#include "ChunkGenThread.h"
+#include "DatabaseSaveThread.h"
+#include "ChunkGenThread.h"
 #include "WorkerThread.h"
 #include "ServerTestSuite.h"
 #include "WorldCreation.h"
 #include "LuaHTTPRequestManager.h"
+#include "InterestManager.h"
 #include "../shared/Protocol.h"
 #include "../shared/Version.h"
 #include "../shared/MessageUtils.h"
@@ -148,6 +151,45 @@ static void enqueueMessageToBroadcast(SocketBufferOutStream& packet_buffer, std:
 }
 
 
+// A client connection and its avatar position, copied while holding the world state lock, so that packets for the client can be built and enqueued after releasing the lock.
+struct ClientUpdateInfo
+{
+	Reference<WorkerThread> worker;
+	std::string world_name;
+	bool client_pos_valid;
+	Vec3d client_pos;
+};
+
+
+// Runs Lua callbacks for any timers in timer_queue that have triggered by cur_time.
+static void processLuaTimers(TimerQueue& timer_queue, std::vector<TimerQueueTimer>& temp_triggered_timers, double cur_time, WorldStateLock& lock)
+{
+	timer_queue.update(cur_time, /*triggered_timers_out=*/temp_triggered_timers);
+
+	for(size_t i=0; i<temp_triggered_timers.size(); ++i)
+	{
+		TimerQueueTimer& timer = temp_triggered_timers[i];
+			
+		LuaScriptEvaluator* script_evaluator = timer.lua_script_evaluator.getPtrIfAlive();
+		if(script_evaluator)
+		{
+			// Check timer is still valid (has not been destroyed by destroyTimer), by checking the timer id with the same index is still equal to our timer id.
+			assert(timer.timer_index >= 0 && timer.timer_index <= LuaScriptEvaluator::MAX_NUM_TIMERS);
+			if(timer.timer_id == script_evaluator->timers[timer.timer_index].id)
+			{
+				script_evaluator->doOnTimerEvent(timer.onTimerEvent_ref, lock); // Execute the Lua timer event callback function
+
+				// Repeating timers are re-added by TimerQueue::update().  If timer was a one-shot timer, 'destroy' it (unless the callback already did so).
+				if(!timer.repeating && (timer.timer_id == script_evaluator->timers[timer.timer_index].id))
+					script_evaluator->destroyTimer(timer.timer_index);
+			}
+		}
+		else // Else script evaluator has been destroyed, remove any repeating timer from the queue.
+			timer_queue.removeTimer(timer.queue_handle);
+	}
+}
+
+
 // Throws glare::Exception on failure.
 static ServerCredentials parseServerCredentials(const std::string& server_state_dir)
 {
@@ -190,6 +232,19 @@ static ServerConfig parseServerConfig(const std::string& config_path)
 	config.tls_private_key_path			= XMLParseUtils::parseStringWithDefault(root_elem, "tls_private_key_path", /*default val=*/"");
 	config.allow_light_mapper_bot_full_perms = XMLParseUtils::parseBoolWithDefault(root_elem, "allow_light_mapper_bot_full_perms", /*default val=*/false);
 	config.update_parcel_sales			= XMLParseUtils::parseBoolWithDefault(root_elem, "update_parcel_sales", /*default val=*/false);
+	config.interest_radius				= XMLParseUtils::parseDoubleWithDefault(root_elem, "interest_radius", /*default val=*/500.0);
+	config.distant_update_period		= XMLParseUtils::parseIntWithDefault(root_elem, "distant_update_period", /*default val=*/10);
+	config.use_epoll_reactor			= XMLParseUtils::parseBoolWithDefault(root_elem, "use_epoll_reactor", /*default val=*/false);
+	config.num_reactor_io_threads		= XMLParseUtils::parseIntWithDefault(root_elem, "num_reactor_io_threads", /*default val=*/4);
+	config.voice_audible_radius			= XMLParseUtils::parseDoubleWithDefault(root_elem, "voice_audible_radius", /*default val=*/100.0);
+	config.num_udp_handler_threads		= XMLParseUtils::parseIntWithDefault(root_elem, "num_udp_handler_threads", /*default val=*/2);
+	config.enable_LOD_chunk_gen			= XMLParseUtils::parseBoolWithDefault(root_elem, "enable_LOD_chunk_gen", /*default val=*/false);
+	config.resource_cache_size_MB		= XMLParseUtils::parseIntWithDefault(root_elem, "resource_cache_size_MB", /*default val=*/256);
+	config.resource_cache_max_resource_size_KB = XMLParseUtils::parseIntWithDefault(root_elem, "resource_cache_max_resource_size_KB", /*default val=*/512);
+	config.use_sendfile_for_resources	= XMLParseUtils::parseBoolWithDefault(root_elem, "use_sendfile_for_resources", /*default val=*/true);
+	config.per_world_lua_vms			= XMLParseUtils::parseBoolWithDefault(root_elem, "per_world_lua_vms", /*default val=*/false);
+	config.web_page_cache_size_MB		= XMLParseUtils::parseIntWithDefault(root_elem, "web_page_cache_size_MB", /*default val=*/64);
+	config.web_page_cache_max_age_s		= XMLParseUtils::parseDoubleWithDefault(root_elem, "web_page_cache_max_age_s", /*default val=*/30.0);
 	return config;
 }
 
@@ -309,6 +364,15 @@ int main(int argc, char *argv[])
 		FileUtils::createDirIfDoesNotExist(server_resource_dir);
 
 		server.world_state->resource_manager = new ResourceManager(server_resource_dir);
+		server.world_state->resource_send_cache = new ResourceSendCache(
+			/*max cache size=*/(size_t)myMax(0, server_config.resource_cache_size_MB) * 1024 * 1024,
+			/*max cached resource size=*/(size_t)myMax(0, server_config.resource_cache_max_resource_size_KB) * 1024,
+			server_config.use_sendfile_for_resources
+		);
+		server.world_state->web_page_cache = new WebPageCache(
+			/*max cache size=*/(size_t)myMax(0, server_config.web_page_cache_size_MB) * 1024 * 1024,
+			/*max page age=*/server_config.web_page_cache_max_age_s
+		);
 
 
 		// Copy default avatar model into resource dir
@@ -492,6 +556,17 @@ int main(int argc, char *argv[])
 		if(tls_config_set_key_file(tls_configuration, tls_private_key_path.c_str()) != 0) // set private key
 			throw glare::Exception("tls_config_set_key_file failed: " + getTLSConfigErrorString(tls_configuration));
 
+		if(server_config.use_epoll_reactor)
+		{
+			if(EpollReactor::isSupported())
+			{
+				conPrint("Creating epoll reactor with " + toString(server_config.num_reactor_io_threads) + " IO thread(s)...");
+				server.reactor = new EpollReactor(&server, server_config.num_reactor_io_threads);
+			}
+			else
+				conPrint("WARNING: use_epoll_reactor is set but epoll is not supported on this platform, using a thread per connection.");
+		}
+
 		conPrint("Launching ListenerThread...");
 
 		ThreadManager thread_manager;
@@ -500,14 +575,21 @@ int main(int argc, char *argv[])
 		conPrint("Done.");
 		//----------------------------------------------- End launch substrata protocol server -----------------------------------------------
 
-		server.mesh_lod_gen_thread_manager.addThread(new MeshLODGenThread(server.world_state.ptr()));
+		server.mesh_lod_gen_thread_manager.addThread(new MeshLODGenThread(server.world_state.ptr(), /*manifest path=*/server_state_dir + "/mesh_lod_gen_manifest.txt"));
 
-		//thread_manager.addThread(new ChunkGenThread(server.world_state.ptr()));
+		if(server_config.enable_LOD_chunk_gen)
+			server.chunk_gen_thread_manager.addThread(new ChunkGenThread(server.world_state.ptr(), /*temp dir=*/server_state_dir + "/chunk_gen_temp", /*cache dir=*/server_state_dir + "/chunk_gen_cache"));
 
-		server.udp_handler_thread_manager.addThread(new UDPHandlerThread(&server));
+		{
+			const int num_udp_handler_threads = UDPHandlerThread::supportsMultipleThreads() ? myMax(1, server_config.num_udp_handler_threads) : 1;
+			for(int i=0; i<num_udp_handler_threads; ++i)
+				server.udp_handler_thread_manager.addThread(new UDPHandlerThread(&server, /*reuse_port=*/num_udp_handler_threads > 1));
+		}
 
 		server.dyn_tex_updater_thread_manager.addThread(new DynamicTextureUpdaterThread(&server, server.world_state.ptr()));
 
+		server.database_save_thread_manager.addThread(new DatabaseSaveThread(server.world_state.ptr()));
+
 		server.lua_http_manager = new LuaHTTPRequestManager(&server);
 
 		//----------------------------------------------- Create any Lua scripts for objects -----------------------------------------------
@@ -527,7 +609,7 @@ int main(int argc, char *argv[])
 					{
 						try
 						{
-							ob->lua_script_evaluator = new LuaScriptEvaluator(server.lua_vm.ptr(), /*script output handler=*/&server, ob->script, ob, world_state.ptr(), lock);
+							ob->lua_script_evaluator = new LuaScriptEvaluator(server.getLuaVMForWorld(world_state.ptr(), lock), /*script output handler=*/&server, ob->script, ob, world_state.ptr(), lock);
 						}
 						catch(LuaScriptExcepWithLocation& e)
 						{
@@ -552,6 +634,15 @@ int main(int argc, char *argv[])
 		// A map from world name to a vector of packets to send to clients connected to that world.
 		std::map<std::string, std::vector<std::string>> broadcast_packets;
 
+		// A map from world name to the interest manager for that world, which filters transform updates by distance to each client.
+		std::map<std::string, InterestManager> world_interest_managers;
+		const bool use_interest_management = server_config.interest_radius > 0;
+
+		std::string worker_data; // Data to send to a worker thread in a main loop iteration.
+		std::vector<ClientUpdateInfo> client_update_infos;
+
+		std::vector<Reference<ServerWorldState>> temp_script_context_worlds; // Worlds with their own Lua VM and timer queue, when server_config.per_world_lua_vms is true.
+
 		// Main server loop
 		uint64 loop_iter = 0;
 		while(!should_quit)
@@ -561,40 +652,33 @@ int main(int argc, char *argv[])
 			// Do Lua timer callbacks
 			if(BitUtils::isBitSet(server.world_state->feature_flag_info.feature_flags, ServerAllWorldsState::SERVER_SCRIPT_EXEC_FEATURE_FLAG))
 			{
+				const double cur_time = server.total_timer.elapsed();
 				{
 					WorldStateLock lock(server.world_state->mutex);
 
-					const double cur_time = server.total_timer.elapsed();
-					server.timer_queue.update(cur_time, /*triggered_timers_out=*/server.temp_triggered_timers);
+					processLuaTimers(server.timer_queue, server.temp_triggered_timers, cur_time, lock);
 
-					for(size_t i=0; i<server.temp_triggered_timers.size(); ++i)
+					if(server.config.per_world_lua_vms)
 					{
-						TimerQueueTimer& timer = server.temp_triggered_timers[i];
-			
-						LuaScriptEvaluator* script_evaluator = timer.lua_script_evaluator.getPtrIfAlive();
-						if(script_evaluator)
-						{
-							// Check timer is still valid (has not been destroyed by destroyTimer), by checking the timer id with the same index is still equal to our timer id.
-							assert(timer.timer_index >= 0 && timer.timer_index <= LuaScriptEvaluator::MAX_NUM_TIMERS);
-							if(timer.timer_id == script_evaluator->timers[timer.timer_index].id)
-							{
-								script_evaluator->doOnTimerEvent(timer.onTimerEvent_ref, lock); // Execute the Lua timer event callback function
-
-								if(timer.repeating)
-								{
-									// Re-insert timer with updated trigger time
-									timer.tigger_time = cur_time + timer.period;
-									server.timer_queue.addTimer(cur_time, timer);
-								}
-								else // Else if timer was a one-shot timer, 'destroy' it.
-								{
-									script_evaluator->destroyTimer(timer.timer_index);
-								}
-							}
-						}
+						temp_script_context_worlds.clear();
+						for(auto it = server.world_state->world_states.begin(); it != server.world_state->world_states.end(); ++it)
+							if(it->second->script_context.nonNull())
+								temp_script_context_worlds.push_back(it->second);
 					}
 				}
 
+				// Run the timers for each world with its own script context as a separate batch, releasing the world state lock in between,
+				// so that other threads aren't blocked for the total script execution time over all worlds.
+				// Note that this thread still runs the batches one after another, so a slow script in one world still delays the other worlds.
+				for(size_t i=0; i<temp_script_context_worlds.size(); ++i)
+				{
+					WorldStateLock lock(server.world_state->mutex);
+
+					WorldScriptContext* script_context = temp_script_context_worlds[i]->script_context.ptr();
+					processLuaTimers(script_context->timer_queue, script_context->temp_triggered_timers, cur_time, lock);
+				}
+				temp_script_context_worlds.clear();
+
 				if(BitUtils::isBitSet(server.world_state->feature_flag_info.feature_flags, ServerAllWorldsState::LUA_HTTP_REQUESTS_FEATURE_FLAG))
 					server.lua_http_manager->think();
 			}
@@ -718,6 +802,10 @@ int main(int argc, char *argv[])
 
 					std::vector<std::string>& world_packets = broadcast_packets[world_it->first];
 
+					InterestManager& interest_manager = world_interest_managers[world_it->first];
+					interest_manager.setInterestRadius(server_config.interest_radius);
+					interest_manager.setDistantUpdatePeriod(server_config.distant_update_period);
+
 					// Generate packets for avatar changes
 					const ServerWorldState::AvatarMapType& avatars = world_state->getAvatars(lock);
 					for(auto i = avatars.begin(); i != avatars.end();)
@@ -733,6 +821,9 @@ int main(int argc, char *argv[])
 
 								enqueueMessageToBroadcast(scratch_packet, world_packets);
 
+								// The full update includes the transform, so don't send an older transform update to distant clients after it.
+								interest_manager.removePendingDistantUpdate(avatar->uid, /*is avatar=*/true);
+
 								avatar->other_dirty = false;
 								avatar->transform_dirty = false;
 								i++;
@@ -759,6 +850,8 @@ int main(int argc, char *argv[])
 
 								enqueueMessageToBroadcast(scratch_packet, world_packets);
 
+								interest_manager.removePendingDistantUpdate(avatar->uid, /*is avatar=*/true);
+
 								// Remove avatar from avatar map
 								auto old_avatar_iterator = i;
 								i++;
@@ -782,7 +875,13 @@ int main(int argc, char *argv[])
 								writeToStream(avatar->rotation, scratch_packet);
 								scratch_packet.writeUInt32(avatar->anim_state);
 
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
+								if(use_interest_management)
+								{
+									MessageUtils::updatePacketLengthField(scratch_packet);
+									interest_manager.addTransformUpdate(avatar->uid, /*is avatar=*/true, avatar->pos, scratch_packet);
+								}
+								else
+									enqueueMessageToBroadcast(scratch_packet, world_packets);
 
 								avatar->transform_dirty = false;
 							}
@@ -812,6 +911,8 @@ int main(int argc, char *argv[])
 
 								enqueueMessageToBroadcast(scratch_packet, world_packets);
 
+								interest_manager.removePendingDistantUpdate(ob->uid, /*is avatar=*/false);
+
 								ob->from_remote_other_dirty = false;
 								ob->from_remote_transform_dirty = false; // transform is sent in full packet also.
 								server.world_state->markAsChanged();
@@ -836,6 +937,8 @@ int main(int argc, char *argv[])
 
 								enqueueMessageToBroadcast(scratch_packet, world_packets);
 
+								interest_manager.removePendingDistantUpdate(ob->uid, /*is avatar=*/false);
+
 								// Remove from dirty-set, so it's not updated in DB.
 								world_state->getDBDirtyWorldObjects(lock).erase(ob);
 
@@ -843,7 +946,7 @@ int main(int argc, char *argv[])
 								server.world_state->db_records_to_delete.insert(ob->database_key);
 
 								// Remove ob from object map
-								world_state->getObjects(lock).erase(ob->uid);
+								world_state->removeObject(ob->uid, lock);
 
 								conPrint("Removed object from world_state->objects");
 								server.world_state->markAsChanged();
@@ -870,7 +973,13 @@ int main(int argc, char *argv[])
 
 								scratch_packet.writeUInt32(ob->last_transform_update_avatar_uid);
 
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
+								if(use_interest_management)
+								{
+									MessageUtils::updatePacketLengthField(scratch_packet);
+									interest_manager.addTransformUpdate(ob->uid, /*is avatar=*/false, ob->pos, scratch_packet);
+								}
+								else
+									enqueueMessageToBroadcast(scratch_packet, world_packets);
 
 								ob->from_remote_transform_dirty = false;
 								server.world_state->markAsChanged();
@@ -896,7 +1005,13 @@ int main(int argc, char *argv[])
 								scratch_packet.writeUInt32(ob->last_transform_update_avatar_uid);
 								scratch_packet.writeDouble(ob->last_transform_client_time);
 
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
+								if(use_interest_management)
+								{
+									MessageUtils::updatePacketLengthField(scratch_packet);
+									interest_manager.addTransformUpdate(ob->uid, /*is avatar=*/false, ob->pos, scratch_packet);
+								}
+								else
+									enqueueMessageToBroadcast(scratch_packet, world_packets);
 
 								ob->from_remote_transform_dirty = false;
 								server.world_state->markAsChanged();
@@ -953,6 +1068,21 @@ int main(int argc, char *argv[])
 					}
 
 					dirty_from_remote_objects.clear();
+
+					// Send LODChunkUpdatedMessages for any chunks rebuilt by ChunkGenThread.
+					std::set<Vec3i>& lod_chunks_to_send = world_state->getLODChunksToSend(lock);
+					for(auto it = lod_chunks_to_send.begin(); it != lod_chunks_to_send.end(); ++it)
+					{
+						auto chunk_res = world_state->getLODChunks(lock).find(*it);
+						if(chunk_res != world_state->getLODChunks(lock).end())
+						{
+							MessageUtils::initPacket(scratch_packet, Protocol::LODChunkUpdatedMessage);
+							chunk_res->second->writeToStream(scratch_packet);
+
+							enqueueMessageToBroadcast(scratch_packet, world_packets);
+						}
+					}
+					lod_chunks_to_send.clear();
 				} // End for each server world
 
 
@@ -965,30 +1095,72 @@ int main(int argc, char *argv[])
 					scratch_packet.writeStringLengthFirst(server.world_state->server_admin_message);
 					MessageUtils::updatePacketLengthField(scratch_packet);
 
-					Lock lock3(server.worker_thread_manager.getMutex());
-					for(auto i = server.worker_thread_manager.getThreads().begin(); i != server.worker_thread_manager.getThreads().end(); ++i)
-					{
-						assert(dynamic_cast<WorkerThread*>(i->getPointer()));
-						static_cast<WorkerThread*>(i->getPointer())->enqueueDataToSend(scratch_packet);
-					}
+					server.forEachClientConnection([&](WorkerThread* worker) { worker->enqueueDataToSend(scratch_packet); });
 
 					server.world_state->server_admin_message_changed = false;
 				}
 
+				// Copy the connected clients and their avatar positions, so we can build and enqueue the packets for each client after releasing the world state lock.
+				client_update_infos.clear();
+				server.forEachClientConnection([&](WorkerThread* worker)
+				{
+					client_update_infos.push_back(ClientUpdateInfo());
+					ClientUpdateInfo& info = client_update_infos.back();
+					info.worker = worker;
+					info.world_name = worker->connected_world_name;
+					info.client_pos_valid = false;
+
+					if(worker->connected_avatar_uid.valid() && (world_interest_managers.count(worker->connected_world_name) > 0))
+					{
+						auto world_res = server.world_state->world_states.find(worker->connected_world_name);
+						if(world_res != server.world_state->world_states.end())
+						{
+							const ServerWorldState::AvatarMapType& avatars = world_res->second->getAvatars(lock);
+							auto avatar_res = avatars.find(worker->connected_avatar_uid);
+							if(avatar_res != avatars.end())
+							{
+								info.client_pos_valid = true;
+								info.client_pos = avatar_res->second->pos;
+							}
+						}
+					}
+				});
+
+				server.updateVoiceRoutingTable(lock);
+
 			} // End scope for world_state->mutex lock
 
 			// Enqueue packets to worker threads to send
 			// For each connected client, get packets for the world the client is connected to, and send to them.
+			// Transform updates are filtered by the distance from the client avatar, by the interest manager for the world.
+			// broadcast_packets and the interest managers are only accessed by this thread, so this is done without holding the world state lock.
 			{
-				Lock lock2(server.worker_thread_manager.getMutex());
-				for(auto i = server.worker_thread_manager.getThreads().begin(); i != server.worker_thread_manager.getThreads().end(); ++i)
+				const bool distant_update_iteration = (server_config.distant_update_period <= 1) || ((loop_iter % server_config.distant_update_period) == 0);
+
+				for(auto it = world_interest_managers.begin(); it != world_interest_managers.end(); ++it)
+					it->second.prepareForClientUpdates(distant_update_iteration);
+
+				for(size_t i=0; i<client_update_infos.size(); ++i)
 				{
-					WorkerThread* worker = static_cast<WorkerThread*>(i->getPointer());
-					std::vector<std::string>& packets = broadcast_packets[worker->connected_world_name];
+					const ClientUpdateInfo& info = client_update_infos[i];
+					const std::vector<std::string>& packets = broadcast_packets[info.world_name];
 
+					worker_data.clear();
 					for(size_t z=0; z<packets.size(); ++z)
-						worker->enqueueDataToSend(packets[z]);
+						worker_data += packets[z];
+
+					auto interest_res = world_interest_managers.find(info.world_name);
+					if(interest_res != world_interest_managers.end())
+						interest_res->second.appendUpdatesForClient(info.client_pos_valid ? &info.client_pos : NULL, distant_update_iteration, worker_data);
+
+					if(!worker_data.empty())
+						info.worker->enqueueDataToSend(worker_data);
 				}
+
+				for(auto it = world_interest_managers.begin(); it != world_interest_managers.end(); ++it)
+					it->second.endIteration(distant_update_iteration);
+
+				client_update_infos.clear(); // Release the worker references.
 			}
 
 			// Clear broadcast_packets vectors of packets.
@@ -1002,12 +1174,7 @@ int main(int argc, char *argv[])
 				scratch_packet.writeDouble(server.getCurrentGlobalTime());
 				MessageUtils::updatePacketLengthField(scratch_packet);
 
-				Lock lock3(server.worker_thread_manager.getMutex());
-				for(auto i = server.worker_thread_manager.getThreads().begin(); i != server.worker_thread_manager.getThreads().end(); ++i)
-				{
-					assert(dynamic_cast<WorkerThread*>(i->getPointer()));
-					static_cast<WorkerThread*>(i->getPointer())->enqueueDataToSend(scratch_packet);
-				}
+				server.forEachClientConnection([&](WorkerThread* worker) { worker->enqueueDataToSend(scratch_packet); });
 			}
 
 #if USE_GLARE_PARCEL_AUCTION_CODE
@@ -1038,16 +1205,24 @@ int main(int argc, char *argv[])
 			}
 #endif
 
-			if(server.world_state->hasChanged() && (save_state_timer.elapsed() > 10.0))
+			// Save world state to disk.  Only start a new save if the previous save has finished.
+			if(server.world_state->hasChanged() && (save_state_timer.elapsed() > 10.0) && (server.world_state->db_save_in_progress == 0))
 			{
 				try
 				{
-					// Save world state to disk
-					WorldStateLock lock(server.world_state->mutex);
+					// Serialise dirty data while holding the lock, then write it to disk on the DatabaseSaveThread.
+					Reference<DatabaseWriteBatchMessage> batch_msg = new DatabaseWriteBatchMessage();
+					{
+						WorldStateLock lock(server.world_state->mutex);
+
+						batch_msg->batch = server.world_state->serialiseDirtyDataToBatch(lock);
+
+						server.world_state->clearChangedFlag();
+					}
 
-					server.world_state->serialiseToDisk(lock);
+					server.world_state->db_save_in_progress = 1;
+					server.database_save_thread_manager.enqueueMessage(batch_msg);
 
-					server.world_state->clearChangedFlag();
 					save_state_timer.reset();
 				}
 				catch(glare::Exception& e)
@@ -1064,6 +1239,9 @@ int main(int argc, char *argv[])
 
 		// Save world state to disk before terminating.
 		conPrint("Saving world state to disk before program quits...");
+
+		// Wait for any save in progress on the DatabaseSaveThread to complete.
+		server.database_save_thread_manager.killThreadsBlocking();
 		try
 		{
 			// Save world state to disk
@@ -1110,10 +1288,13 @@ Server::~Server()
 	conPrint("Stopping Server threads...");
 
 	// Stop any threads that may refer to other data members first
+	database_save_thread_manager.killThreadsBlocking();
 	dyn_tex_updater_thread_manager.killThreadsBlocking();
 	udp_handler_thread_manager.killThreadsBlocking();
+	chunk_gen_thread_manager.killThreadsBlocking();
 	mesh_lod_gen_thread_manager.killThreadsBlocking();
 	worker_thread_manager.killThreadsBlocking();
+	reactor = nullptr; // Kill reactor IO threads, closing any connections they are handling.
 
 	lua_http_manager = nullptr;
 
@@ -1208,7 +1389,7 @@ void Server::enqueueLuaHTTPRequest(Reference<LuaHTTPRequest> request)
 }
 
 
-void Server::clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_addr, UID client_avatar_id)
+void Server::clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_addr, UID client_avatar_id, const std::string& world_name)
 {
 	conPrint("Server::clientUDPPortOpen(): worker_thread: 0x" + toHexString((uint64)worker_thread) + ", ip_addr: " + ip_addr.toString());// + ", port: " + toString(client_UDP_port));
 
@@ -1217,8 +1398,7 @@ void Server::clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_
 		if(connected_clients.count(worker_thread) == 0)
 		{
 			connected_clients.insert(std::make_pair(worker_thread, 
-				ServerConnectedClientInfo({ip_addr, client_avatar_id, /*client_UDP_port=*/-1})));
-			connected_clients_changed = 1;
+				ServerConnectedClientInfo({ip_addr, client_avatar_id, world_name, /*client_UDP_port=*/-1})));
 		}
 	}
 }
@@ -1234,11 +1414,19 @@ void Server::clientUDPPortBecameKnown(UID client_avatar_uid, const IPAddress& ip
 			ServerConnectedClientInfo& info = it->second;
 			if(info.client_avatar_id == client_avatar_uid)
 			{
-				if(it->second.client_UDP_port != client_UDP_port)
+				// The UDP packet is not authenticated, and avatar UIDs are public, so only accept the packet if it came from the IP address of the
+				// client TCP connection.  Otherwise anyone could redirect the client's relayed voice packets to themselves.
+				if(!(info.ip_addr == ip_addr))
 				{
-					it->second.client_UDP_port = client_UDP_port;
+					conPrint("Server::clientUDPPortBecameKnown(): ignoring packet for client_avatar_uid " + client_avatar_uid.toString() + " from ip_addr " + ip_addr.toString() + 
+						", does not match client ip_addr " + info.ip_addr.toString());
+					continue;
+				}
+
+				if(info.client_UDP_port != client_UDP_port)
+				{
+					info.client_UDP_port = client_UDP_port;
 					change_made = true;
-					
 				}
 			}
 		}
@@ -1246,13 +1434,41 @@ void Server::clientUDPPortBecameKnown(UID client_avatar_uid, const IPAddress& ip
 
 	if(change_made)
 	{
-		connected_clients_changed = 1;
-
 		conPrint("Server::clientUDPPortBecameKnown(): client with client_avatar_uid " + client_avatar_uid.toString() + ", ip_addr: " + ip_addr.toString() + ", has port: " + toString(client_UDP_port));
 	}
 }
 
 
+static void forEachWorkerThread(ThreadManager& worker_thread_manager, const std::function<void(WorkerThread*)>& func)
+{
+	Lock lock(worker_thread_manager.getMutex());
+	for(auto i = worker_thread_manager.getThreads().begin(); i != worker_thread_manager.getThreads().end(); ++i)
+	{
+		assert(dynamic_cast<WorkerThread*>(i->getPointer()));
+		WorkerThread* worker = static_cast<WorkerThread*>(i->getPointer());
+		if(!worker->isHandledByReactor()) // The thread may not have terminated yet after handing off the connection, in which case the connection is in reactor->connections.
+			func(worker);
+	}
+}
+
+
+void Server::forEachClientConnection(const std::function<void(WorkerThread*)>& func)
+{
+	if(reactor.nonNull())
+	{
+		// Hold the reactor mutex while iterating over the worker threads as well, so a connection that is being handed off to the reactor is visited exactly once.
+		Lock lock(reactor->mutex);
+
+		forEachWorkerThread(worker_thread_manager, func);
+
+		for(auto it = reactor->connections.begin(); it != reactor->connections.end(); ++it)
+			func(*it);
+	}
+	else
+		forEachWorkerThread(worker_thread_manager, func);
+}
+
+
 void Server::clientDisconnected(WorkerThread* worker_thread)
 {
 	conPrint("Server::clientDisconnected(): worker_thread: 0x" + toHexString((uint64)worker_thread));
@@ -1260,6 +1476,60 @@ void Server::clientDisconnected(WorkerThread* worker_thread)
 	{
 		Lock lock(connected_clients_mutex);
 		connected_clients.erase(worker_thread);
-		connected_clients_changed = 1;
 	}
 }
+
+
+void Server::updateVoiceRoutingTable(WorldStateLock& world_state_lock)
+{
+	Reference<VoiceRoutingTable> table = new VoiceRoutingTable(config.voice_audible_radius);
+
+	{
+		Lock lock(connected_clients_mutex);
+
+		std::map<std::string, int> world_indices;
+		for(auto it = connected_clients.begin(); it != connected_clients.end(); ++it)
+		{
+			const ServerConnectedClientInfo& info = it->second;
+			if(info.client_UDP_port > 0) // If remote UDP port is known:
+			{
+				auto world_res = world_state->world_states.find(info.world_name);
+				if(world_res != world_state->world_states.end())
+				{
+					const ServerWorldState::AvatarMapType& avatars = world_res->second->getAvatars(world_state_lock);
+					auto avatar_res = avatars.find(info.client_avatar_id);
+					if(avatar_res != avatars.end())
+					{
+						auto index_res = world_indices.insert(std::make_pair(info.world_name, (int)world_indices.size()));
+						table->addClient(info.ip_addr, info.client_UDP_port, info.client_avatar_id, /*world index=*/index_res.first->second, avatar_res->second->pos);
+					}
+				}
+			}
+		}
+	}
+
+	table->build();
+
+	{
+		Lock lock(voice_routing_table_mutex);
+		voice_routing_table = table;
+	}
+}
+
+
+Reference<VoiceRoutingTable> Server::getVoiceRoutingTable()
+{
+	Lock lock(voice_routing_table_mutex);
+	return voice_routing_table;
+}
+
+
+SubstrataLuaVM* Server::getLuaVMForWorld(ServerWorldState* world, WorldStateLock& /*world_state_lock*/)
+{
+	if(!config.per_world_lua_vms)
+		return lua_vm.ptr();
+
+	if(world->script_context.isNull())
+		world->script_context = new WorldScriptContext(this);
+	return world->script_context->lua_vm.ptr();
+}
@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2016 -
 
 
 #include "ServerWorldState.h"
+#include "VoiceRoutingTable.h"
 #include "ThreadManager.h"
 #include "../shared/ResourceManager.h"
 #include "../shared/LuaScriptEvaluator.h"
@@ -14,7 +15,9 @@ Copyright Glare Technologies Limited 2016 -
 #include <IPAddress.h>
 #include <utils/UniqueRef.h>
 #include <utils/Timer.h>
+#include <functional>
 class WorkerThread;
+class EpollReactor;
 class SubstrataLuaVM;
 class LuaHTTPRequestManager;
 class LuaHTTPRequest;
@@ -23,7 +26,7 @@ class LuaHTTPRequest;
 class ServerConfig
 {
 public:
-	ServerConfig() : allow_light_mapper_bot_full_perms(false), update_parcel_sales(false) {}
+	ServerConfig() : allow_light_mapper_bot_full_perms(false), update_parcel_sales(false), interest_radius(500.0), distant_update_period(10), use_epoll_reactor(false), num_reactor_io_threads(4), voice_audible_radius(100.0), num_udp_handler_threads(2), enable_LOD_chunk_gen(false), resource_cache_size_MB(256), resource_cache_max_resource_size_KB(512), use_sendfile_for_resources(true), per_world_lua_vms(false), web_page_cache_size_MB(64), web_page_cache_max_age_s(30.0) {}
 	
 	std::string webserver_fragments_dir; // empty string = use default.
 	std::string webserver_public_files_dir; // empty string = use default.
@@ -35,13 +38,34 @@ public:
 	bool allow_light_mapper_bot_full_perms; // Allow lightmapper bot (User account with name "lightmapperbot" to have full write permissions.
 
 	bool update_parcel_sales; // Should we run auctions?
+
+	double interest_radius; // Clients get avatar and object transform updates every main loop iteration for entities within this distance (m).  <= 0 to disable interest management.
+	int distant_update_period; // Transform updates for entities further away than interest_radius are sent every distant_update_period main loop iterations.
+
+	bool use_epoll_reactor; // Handle client updates connections with a pool of epoll IO threads, instead of a thread per connection.  Linux only.
+	int num_reactor_io_threads;
+
+	double voice_audible_radius; // Voice packets are relayed to clients in the same world with avatars within this distance (m) of the speaker.  <= 0 to relay to all clients in the world.
+	int num_udp_handler_threads; // Number of threads reading from the UDP port, sharing it with SO_REUSEPORT.  Linux only, other platforms use a single thread.
+
+	bool enable_LOD_chunk_gen; // Run ChunkGenThread, which builds LOD chunks and rebuilds them as objects change.
+
+	int resource_cache_size_MB; // Byte budget for the in-memory cache of small resources served to clients.  0 to disable.
+	int resource_cache_max_resource_size_KB; // Resources larger than this are not cached in memory.
+	bool use_sendfile_for_resources; // Send uncached resources with sendfile() on plain TCP connections (e.g. behind a TLS terminator).  Linux only.
+
+	bool per_world_lua_vms; // Give each world with scripted objects its own Lua VM and timer queue, instead of sharing Server::lua_vm.  Scripts still all run on the main thread, so this doesn't isolate script latency between worlds.
+
+	int web_page_cache_size_MB; // Byte budget for cached web pages (root page, parcel pages etc.) served to users who are not logged in.  0 to disable.
+	double web_page_cache_max_age_s; // Cached web pages are re-rendered after this long, even if the data they show hasn't changed.  <= 0 to disable.
 };
 
 
 struct ServerConnectedClientInfo
 {
-	IPAddress ip_addr;
+	IPAddress ip_addr; // Address of the client TCP connection.  UDP packets registering the client UDP port must come from this address.
 	UID client_avatar_id;
+	std::string world_name; // Name of the world the client is connected to.
 	int client_UDP_port; // UDP port on client end
 };
 
@@ -129,24 +153,43 @@ public:
 
 
 	// Called from off main thread
-	void clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_addr, UID client_avatar_id/*, int client_UDP_port*/);
+	void clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_addr, UID client_avatar_id, const std::string& world_name);
 	void clientDisconnected(WorkerThread* worker_thread);
 
 	// Called when we receive a UDP packet from a client, which allows the client remote UDP port to be known.
 	void clientUDPPortBecameKnown(UID client_avatar_uid, const IPAddress& ip_addr, int client_UDP_port);
 
+	// Calls func for each connected client: each WorkerThread, and each connection handled by the epoll reactor.
+	// Holds the worker thread manager mutex and reactor mutex while doing so.
+	void forEachClientConnection(const std::function<void(WorkerThread*)>& func);
+
+	// Rebuild the voice routing table from connected_clients and the current avatar positions.  Called by the main server thread with the world state lock held.
+	void updateVoiceRoutingTable(WorldStateLock& world_state_lock);
+
+	Reference<VoiceRoutingTable> getVoiceRoutingTable(); // threadsafe
+
+	// Returns the Lua VM that scripts for objects in the given world should be created in.
+	// If config.per_world_lua_vms is true, this is the world's own VM, which is created if needed.
+	SubstrataLuaVM* getLuaVMForWorld(ServerWorldState* world, WorldStateLock& world_state_lock);
+
 
 	Reference<ServerAllWorldsState> world_state;
 
 	// Connected client worker threads
 	ThreadManager worker_thread_manager;
 
+	Reference<EpollReactor> reactor; // Non-null if config.use_epoll_reactor is true.  Handles client updates connections after the initial handshake.
+
 	ThreadManager mesh_lod_gen_thread_manager;
 
+	ThreadManager chunk_gen_thread_manager;
+
 	ThreadManager udp_handler_thread_manager;
 
 	ThreadManager dyn_tex_updater_thread_manager;
 
+	ThreadManager database_save_thread_manager;
+
 	ThreadSafeQueue<Reference<ThreadMessage> > message_queue; // Contains messages from worker threads to the main server thread.
 
 	std::string screenshot_dir;
@@ -155,7 +198,9 @@ public:
 
 	Mutex connected_clients_mutex;
 	std::map<WorkerThread*, ServerConnectedClientInfo> connected_clients;
-	glare::AtomicInt connected_clients_changed;
+
+	Mutex voice_routing_table_mutex;
+	Reference<VoiceRoutingTable> voice_routing_table GUARDED_BY(voice_routing_table_mutex); // Snapshot used by the UDPHandlerThreads for relaying voice packets.
 
 	UniqueRef<SubstrataLuaVM> lua_vm;
 
@@ -22,6 +22,7 @@ Copyright Glare Technologies Limited 2024 -
 #include <utils/ConPrint.h>
 #include <utils/StringUtils.h>
 #include <utils/TestUtils.h>
+#include <utils/Timer.h>
 #include <utils/TestExceptionUtils.h>
 #include <lualib.h>
 
@@ -77,8 +78,8 @@ void ServerLuaScriptTests::test()
 		ParcelRef parcel = new Parcel();
 		parcel->id = ParcelID(789);
 
-		main_world_state->getObjects(lock)[world_ob->uid] = world_ob;
-		main_world_state->getObjects(lock)[world_ob2->uid] = world_ob2;
+		main_world_state->addObject(world_ob, lock);
+		main_world_state->addObject(world_ob2, lock);
 		main_world_state->getAvatars(lock)[avatar->uid] = avatar;
 		
 
@@ -330,7 +331,7 @@ void ServerLuaScriptTests::test()
 
 			WorldObjectRef temp_world_ob = new WorldObject();
 			temp_world_ob->uid = UID(200);
-			main_world_state->getObjects(lock)[temp_world_ob->uid] = temp_world_ob;
+			main_world_state->addObject(temp_world_ob, lock);
 
 			output_handler.buf.clear();
 			server.timer_queue.clear();
@@ -347,7 +348,7 @@ void ServerLuaScriptTests::test()
 			testAssert(triggered_timers[0].lua_script_evaluator.getPtrIfAlive() == temp_world_ob->lua_script_evaluator.ptr());
 
 			// Delete the ob
-			main_world_state->getObjects(lock).erase(temp_world_ob->uid);
+			main_world_state->removeObject(temp_world_ob->uid, lock);
 			temp_world_ob = nullptr;
 
 			// Test the weak reference notices that the object and its lua_script_evaluator has been destroyed
@@ -374,6 +375,103 @@ void ServerLuaScriptTests::test()
 			testAssert(output_handler.buf == "onTimerEvent");
 		}
 
+		// Test destroying a repeating timer removes it from the timer queue
+		{
+			const std::string script_src = 
+				"function onTimerEvent(ob : Object)								\n"
+				"end															\n"
+				"local t = createTimer(onTimerEvent, 0.1, true)					\n"
+				"destroyTimer(t)												\n";
+
+			server.timer_queue.clear();
+			Reference<LuaScriptEvaluator> lua_script_evaluator = new LuaScriptEvaluator(&vm, &output_handler, script_src, world_ob.ptr(), main_world_state.ptr(), lock);
+			testAssert(!lua_script_evaluator->hit_error);
+			testAssert(lua_script_evaluator->timers[0].id == -1);
+			testAssert(server.timer_queue.numTimers() == 0);
+		}
+
+		// Test a world with its own script context (per-world Lua VMs).  Timers should be added to the world timer queue, and execution time recorded for the world.
+		{
+			Reference<ServerWorldState> other_world_state = new ServerWorldState();
+			server.world_state->world_states["other"] = other_world_state;
+			other_world_state->script_context = new WorldScriptContext(&server);
+
+			WorldObjectRef other_world_ob = new WorldObject();
+			other_world_ob->uid = UID(300);
+			other_world_state->addObject(other_world_ob, lock);
+
+			const std::string script_src = 
+				"function onTimerEvent(ob : Object)		\n"
+				"		print('onTimerEvent')			\n"
+				"end									\n"
+				"createTimer(onTimerEvent, 0.1, false)	";
+
+			server.timer_queue.clear();
+
+			other_world_ob->lua_script_evaluator = new LuaScriptEvaluator(other_world_state->script_context->lua_vm.ptr(), &output_handler, script_src, other_world_ob.ptr(), other_world_state.ptr(), lock);
+			testAssert(!other_world_ob->lua_script_evaluator->hit_error);
+			testAssert(other_world_state->script_stats.num_executions == 1);
+
+			std::vector<TimerQueueTimer> triggered_timers;
+			server.timer_queue.update(/*cur time=*/server.total_timer.elapsed() + 1.0, triggered_timers);
+			testAssert(triggered_timers.empty());
+
+			other_world_state->script_context->timer_queue.update(/*cur time=*/server.total_timer.elapsed() + 1.0, triggered_timers);
+			testAssert(triggered_timers.size() == 1);
+			testAssert(triggered_timers[0].lua_script_evaluator.getPtrIfAlive() == other_world_ob->lua_script_evaluator.ptr());
+
+			output_handler.buf.clear();
+			other_world_ob->lua_script_evaluator->doOnTimerEvent(triggered_timers[0].onTimerEvent_ref, lock);
+			testAssert(output_handler.buf == "onTimerEvent");
+			testAssert(other_world_state->script_stats.num_executions == 2);
+			testAssert(other_world_state->script_stats.total_exec_time >= other_world_state->script_stats.max_exec_time);
+
+			// Remove the object before the world, so the script evaluator is destroyed before the world Lua VM.
+			other_world_state->removeObject(other_world_ob->uid, lock);
+			other_world_ob = nullptr;
+			server.world_state->world_states.erase("other");
+		}
+
+		// Test the script execution time budget.  Callbacks should be skipped while the script is over budget, and the script disabled if it stays over budget.
+		{
+			const std::string script_src = 
+				"function onTimerEvent(ob : Object)		\n"
+				"		print('onTimerEvent')			\n"
+				"end									\n";
+
+			Reference<LuaScriptEvaluator> lua_script_evaluator = new LuaScriptEvaluator(&vm, &output_handler, script_src, world_ob.ptr(), main_world_state.ptr(), lock);
+			const LuaUtils::LuaFuncRefAndPtr func_info = LuaUtils::getRefToFunction(lua_script_evaluator->lua_script->thread_state, "onTimerEvent");
+			testAssert(!lua_script_evaluator->isOverExecTimeBudget());
+
+			// Profile a timer event
+			server.world_state->lua_script_profiler.clear();
+			server.world_state->lua_script_profiler.setEnabled(true);
+
+			output_handler.buf.clear();
+			lua_script_evaluator->doOnTimerEvent(func_info.ref, lock);
+			testAssert(output_handler.buf == "onTimerEvent");
+
+			server.world_state->lua_script_profiler.setEnabled(false);
+			std::vector<LuaScriptProfiler::FuncStats> func_stats;
+			server.world_state->lua_script_profiler.getMostExpensiveFunctions(/*max num results=*/10, func_stats);
+			testAssert(func_stats.size() == 1 && func_stats[0].ob_uid == world_ob->uid && func_stats[0].func_name == "onTimerEvent (line 1)" && func_stats[0].num_calls == 1);
+
+			// Simulate a long script execution
+			lua_script_evaluator->addExecTime(1.0);
+			testAssert(lua_script_evaluator->isOverExecTimeBudget());
+
+			output_handler.buf.clear();
+			lua_script_evaluator->doOnTimerEvent(func_info.ref, lock);
+			testAssert(output_handler.buf.empty()); // Timer event should have been skipped.
+			testAssert(!lua_script_evaluator->hit_error);
+
+			// Simulate being over budget for too many consecutive windows
+			lua_script_evaluator->num_consecutive_over_budget_windows = LuaScriptEvaluator::MAX_NUM_OVER_BUDGET_WINDOWS - 1;
+			lua_script_evaluator->addExecTime(1.0);
+			testAssert(lua_script_evaluator->hit_error);
+			testAssert(hasPrefix(output_handler.buf, "Script disabled"));
+		}
+
 		// Test destroying the timer inside the timer event handler for it
 		{
 			const std::string script_src = 
@@ -620,7 +718,7 @@ void ServerLuaScriptTests::test()
 
 			WorldObjectRef temp_world_ob = new WorldObject();
 			temp_world_ob->uid = UID(200);
-			main_world_state->getObjects(lock)[temp_world_ob->uid] = temp_world_ob;
+			main_world_state->addObject(temp_world_ob, lock);
 
 			temp_world_ob->lua_script_evaluator = new LuaScriptEvaluator(&vm, &output_handler, script_src, temp_world_ob.ptr(), main_world_state.ptr(), lock);
 
@@ -633,7 +731,7 @@ void ServerLuaScriptTests::test()
 			testEqual(output_handler.buf, std::string("Avatar 456 touched object 124")); // NOTE: saying touched 124 here (world_ob2)
 
 			// Delete the ob
-			main_world_state->getObjects(lock).erase(temp_world_ob->uid);
+			main_world_state->removeObject(temp_world_ob->uid, lock);
 			temp_world_ob = nullptr;
 
 			// Try and execute the event handler again.  This time the handler should be removed as the referenced object is dead.
@@ -976,6 +1074,82 @@ void ServerLuaScriptTests::test()
 			},
 			"was not a string"
 		);
+
+
+		//-------------------------------- Test object handles  --------------------------------
+		{
+			// The object handle should not be visible to scripts through the array part of the table.
+			const std::string script_src = 
+				"function onTimerEvent(ob : Object)		\n"
+				"	local other = getObjectForUID(124)	\n"
+				"	assert(rawget(other, 1) == nil)		\n"
+				"	assert(rawget(other, 2) == nil)		\n"
+				"	assert(#other == 0)					\n"
+				"	assert(other.uid == 124)			\n"
+				"	other.angle = 0.5					\n"
+				"	assert(other.angle == 0.5)			\n"
+				"end									\n";
+
+			Reference<LuaScriptEvaluator> lua_script_evaluator = new LuaScriptEvaluator(&vm, &output_handler, script_src, world_ob.ptr(), main_world_state.ptr(), lock);
+			lua_script_evaluator->doOnTimerEvent(LuaUtils::getRefToFunction(lua_script_evaluator->lua_script->thread_state, "onTimerEvent").ref, lock);
+			testAssert(!lua_script_evaluator->hit_error);
+			testAssert(world_ob2->angle == 0.5f);
+		}
+
+
+		//-------------------------------- WorldObject property get/set micro-benchmarks  --------------------------------
+		{
+			const std::string script_src = 
+				"function getAngleBench(ob : Object)			\n"
+				"	local other = getObjectForUID(124)		\n"
+				"	local sum = 0							\n"
+				"	for i=1,1000 do							\n"
+				"		sum += other.angle					\n"
+				"	end										\n"
+				"end										\n"
+				"function setAngleBench(ob : Object)			\n"
+				"	local other = getObjectForUID(124)		\n"
+				"	for i=1,1000 do							\n"
+				"		other.angle = i						\n"
+				"	end										\n"
+				"end										\n";
+
+			Reference<LuaScriptEvaluator> lua_script_evaluator = new LuaScriptEvaluator(&vm, &output_handler, script_src, world_ob.ptr(), main_world_state.ptr(), lock);
+			testAssert(!lua_script_evaluator->hit_error);
+
+			const int NUM_CALLS = 100;
+			const int NUM_ACCESSES_PER_CALL = 1000;
+			{
+				const int func_ref = LuaUtils::getRefToFunction(lua_script_evaluator->lua_script->thread_state, "getAngleBench").ref;
+				Timer timer;
+				for(int i=0; i<NUM_CALLS; ++i)
+				{
+					lua_script_evaluator->exec_time_in_window = 0; // Don't let the execution time budget skip callbacks.
+					lua_script_evaluator->doOnTimerEvent(func_ref, lock);
+				}
+				const double elapsed = timer.elapsed();
+				testAssert(!lua_script_evaluator->hit_error);
+				conPrint("WorldObject property get: " + doubleToStringNSigFigs(elapsed * 1.0e9 / (NUM_CALLS * NUM_ACCESSES_PER_CALL), 4) + " ns / get");
+			}
+			{
+				main_world_state->getDirtyFromRemoteObjects(lock).clear();
+
+				const int func_ref = LuaUtils::getRefToFunction(lua_script_evaluator->lua_script->thread_state, "setAngleBench").ref;
+				Timer timer;
+				for(int i=0; i<NUM_CALLS; ++i)
+				{
+					lua_script_evaluator->exec_time_in_window = 0; // Don't let the execution time budget skip callbacks.
+					lua_script_evaluator->doOnTimerEvent(func_ref, lock);
+				}
+				const double elapsed = timer.elapsed();
+				testAssert(!lua_script_evaluator->hit_error);
+				conPrint("WorldObject property set: " + doubleToStringNSigFigs(elapsed * 1.0e9 / (NUM_CALLS * NUM_ACCESSES_PER_CALL), 4) + " ns / set");
+
+				testAssert(world_ob2->angle == (float)NUM_ACCESSES_PER_CALL);
+				testAssert(main_world_state->getDirtyFromRemoteObjects(lock).size() == 1); // Object updates should have been batched.
+				testAssert(lua_script_evaluator->modified_objects.empty());
+			}
+		}
 	}
 	catch(LuaScriptExcepWithLocation& e)
 	{
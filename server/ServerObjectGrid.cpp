@@ -0,0 +1,395 @@
+/*=====================================================================
+ServerObjectGrid.cpp
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ServerObjectGrid.h"
+
+
+#include <maths/mathstypes.h>
+#include <cmath>
+
+
+const float ServerObjectGrid::CELL_WIDTH = 200.f;
+
+
+// Clamp cell coordinates so that the conversion to int is well-defined for large position values.
+static const double MAX_CELL_COORD = 1.0e8;
+
+
+ServerObjectGrid::ServerObjectGrid()
+{}
+
+
+ServerObjectGrid::~ServerObjectGrid()
+{}
+
+
+bool ServerObjectGrid::cellForPos(const Vec3d& pos, Vec3i& cell_out)
+{
+	if(!pos.isFinite())
+		return false;
+
+	const double recip_cell_w = 1.0 / CELL_WIDTH;
+	cell_out = Vec3i(
+		(int)myClamp(std::floor(pos.x * recip_cell_w), -MAX_CELL_COORD, MAX_CELL_COORD),
+		(int)myClamp(std::floor(pos.y * recip_cell_w), -MAX_CELL_COORD, MAX_CELL_COORD),
+		(int)myClamp(std::floor(pos.z * recip_cell_w), -MAX_CELL_COORD, MAX_CELL_COORD)
+	);
+	return true;
+}
+
+
+void ServerObjectGrid::insert(WorldObject* ob)
+{
+	if(ob_info.count(ob) != 0)
+		return;
+
+	ObInfo info;
+	info.in_cell = cellForPos(ob->pos, info.cell);
+	info.index = 0;
+	if(info.in_cell)
+	{
+		std::vector<WorldObject*>& cell_obs = cells[info.cell];
+		info.index = cell_obs.size();
+		cell_obs.push_back(ob);
+	}
+
+	ob_info.insert(std::make_pair(ob, info));
+}
+
+
+void ServerObjectGrid::removeFromCell(WorldObject* ob, const Vec3i& cell, size_t index)
+{
+	auto cell_res = cells.find(cell);
+	assert(cell_res != cells.end());
+	if(cell_res == cells.end())
+		return;
+
+	std::vector<WorldObject*>& cell_obs = cell_res->second;
+	assert(index < cell_obs.size() && cell_obs[index] == ob);
+
+	// Swap-remove: move the last object in the cell into the removed object's slot, and update its index.
+	WorldObject* last_ob = cell_obs.back();
+	cell_obs[index] = last_ob;
+	cell_obs.pop_back();
+	if(last_ob != ob)
+		ob_info[last_ob].index = index;
+
+	if(cell_obs.empty())
+		cells.erase(cell_res);
+}
+
+
+void ServerObjectGrid::remove(WorldObject* ob)
+{
+	auto res = ob_info.find(ob);
+	if(res == ob_info.end())
+		return;
+
+	const ObInfo info = res->second;
+	ob_info.erase(res);
+
+	if(info.in_cell)
+		removeFromCell(ob, info.cell, info.index);
+}
+
+
+void ServerObjectGrid::objectTransformChanged(WorldObject* ob)
+{
+	auto res = ob_info.find(ob);
+	if(res == ob_info.end())
+	{
+		insert(ob);
+		return;
+	}
+
+	Vec3i new_cell;
+	const bool new_in_cell = cellForPos(ob->pos, new_cell);
+
+	ObInfo& info = res->second;
+	if(new_in_cell == info.in_cell && (!new_in_cell || new_cell == info.cell))
+		return; // Object is still in the same cell, nothing to do.
+
+	if(info.in_cell)
+		removeFromCell(ob, info.cell, info.index);
+
+	// NOTE: removeFromCell() may have modified ob_info entries for other objects, but not rehashed the map, so 'res' is still valid.
+	info.in_cell = new_in_cell;
+	info.cell = new_cell;
+	info.index = 0;
+	if(new_in_cell)
+	{
+		std::vector<WorldObject*>& cell_obs = cells[new_cell];
+		info.index = cell_obs.size();
+		cell_obs.push_back(ob);
+	}
+}
+
+
+void ServerObjectGrid::clear()
+{
+	cells.clear();
+	ob_info.clear();
+}
+
+
+const std::vector<WorldObject*>* ServerObjectGrid::getObjectsInCell(const Vec3i& cell) const
+{
+	auto res = cells.find(cell);
+	return (res == cells.end()) ? NULL : &res->second;
+}
+
+
+static inline void appendObsInAABB(const std::vector<WorldObject*>& cell_obs, const js::AABBox& aabb, std::vector<WorldObject*>& obs_out)
+{
+	for(size_t i=0; i<cell_obs.size(); ++i)
+	{
+		WorldObject* ob = cell_obs[i];
+		if(aabb.contains(ob->pos.toVec4fPoint()))
+			obs_out.push_back(ob);
+	}
+}
+
+
+void ServerObjectGrid::getObjectsInAABB(const js::AABBox& aabb, std::vector<WorldObject*>& obs_out) const
+{
+	if(!aabb.min_.isFinite() || !aabb.max_.isFinite())
+		return;
+
+	// Object positions are converted to float for the AABB containment test, so an object just outside of a cell range (in double precision)
+	// may still be in the AABB.  So pad the AABB a little to handle this.
+	const Vec3d aabb_min(aabb.min_[0], aabb.min_[1], aabb.min_[2]);
+	const Vec3d aabb_max(aabb.max_[0], aabb.max_[1], aabb.max_[2]);
+	const Vec3d min_pad(std::fabs(aabb_min.x) * 1.0e-6 + 1.0e-3, std::fabs(aabb_min.y) * 1.0e-6 + 1.0e-3, std::fabs(aabb_min.z) * 1.0e-6 + 1.0e-3);
+	const Vec3d max_pad(std::fabs(aabb_max.x) * 1.0e-6 + 1.0e-3, std::fabs(aabb_max.y) * 1.0e-6 + 1.0e-3, std::fabs(aabb_max.z) * 1.0e-6 + 1.0e-3);
+
+	Vec3i begin, end;
+	cellForPos(aabb_min - min_pad, begin);
+	cellForPos(aabb_max + max_pad, end);
+	if(begin.x > end.x || begin.y > end.y || begin.z > end.z)
+		return;
+
+	const double num_query_cells = ((double)end.x - begin.x + 1) * ((double)end.y - begin.y + 1) * ((double)end.z - begin.z + 1);
+	if(num_query_cells <= (double)cells.size())
+	{
+		// Look up each cell overlapping the AABB.
+		for(int z=begin.z; z<=end.z; ++z)
+		for(int y=begin.y; y<=end.y; ++y)
+		for(int x=begin.x; x<=end.x; ++x)
+		{
+			auto res = cells.find(Vec3i(x, y, z));
+			if(res != cells.end())
+				appendObsInAABB(res->second, aabb, obs_out);
+		}
+	}
+	else
+	{
+		// The query AABB covers more cells than there are non-empty cells, so just iterate over the non-empty cells.
+		for(auto it = cells.begin(); it != cells.end(); ++it)
+		{
+			const Vec3i& cell = it->first;
+			if(cell.x >= begin.x && cell.x <= end.x && cell.y >= begin.y && cell.y <= end.y && cell.z >= begin.z && cell.z <= end.z)
+				appendObsInAABB(it->second, aabb, obs_out);
+		}
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <maths/PCG32.h>
+#include <algorithm>
+
+
+// Reference implementation: iterate over all objects.
+static void bruteForceGetObjectsInAABB(const std::vector<WorldObjectRef>& obs, const js::AABBox& aabb, std::vector<WorldObject*>& obs_out)
+{
+	for(size_t i=0; i<obs.size(); ++i)
+	{
+		const Vec4f pos = obs[i]->pos.toVec4fPoint();
+		if(pos.isFinite() && aabb.contains(pos))
+			obs_out.push_back(obs[i].ptr());
+	}
+}
+
+
+static void checkQueryMatchesBruteForce(const ServerObjectGrid& grid, const std::vector<WorldObjectRef>& obs, const js::AABBox& aabb)
+{
+	std::vector<WorldObject*> grid_res, ref_res;
+	grid.getObjectsInAABB(aabb, grid_res);
+	bruteForceGetObjectsInAABB(obs, aabb, ref_res);
+
+	std::sort(grid_res.begin(), grid_res.end());
+	std::sort(ref_res.begin(), ref_res.end());
+	testAssert(grid_res == ref_res);
+}
+
+
+void ServerObjectGrid::test()
+{
+	conPrint("ServerObjectGrid::test()");
+
+	//------------------- Test basic insertion, moving and removal -------------------
+	{
+		ServerObjectGrid grid;
+
+		WorldObjectRef ob = new WorldObject();
+		ob->pos = Vec3d(10, 10, 10);
+		grid.insert(ob.ptr());
+		grid.insert(ob.ptr()); // Inserting twice should do nothing.
+		testAssert(grid.numObjects() == 1);
+		testAssert(grid.getObjectsInCell(Vec3i(0, 0, 0)) && grid.getObjectsInCell(Vec3i(0, 0, 0))->size() == 1);
+
+		ob->pos = Vec3d(-10, 250, 10);
+		grid.objectTransformChanged(ob.ptr());
+		testAssert(grid.getObjectsInCell(Vec3i(0, 0, 0)) == NULL);
+		testAssert(grid.getObjectsInCell(Vec3i(-1, 1, 0)) && grid.getObjectsInCell(Vec3i(-1, 1, 0))->size() == 1);
+
+		// Objects with non-finite positions are tracked but not in any cell.
+		ob->pos = Vec3d(std::numeric_limits<double>::quiet_NaN(), 0, 0);
+		grid.objectTransformChanged(ob.ptr());
+		testAssert(grid.numObjects() == 1);
+		testAssert(grid.numNonEmptyCells() == 0);
+
+		ob->pos = Vec3d(1.0e30, 0, 0); // Very large positions should be clamped.
+		grid.objectTransformChanged(ob.ptr());
+		testAssert(grid.numNonEmptyCells() == 1);
+
+		grid.remove(ob.ptr());
+		grid.remove(ob.ptr()); // Removing twice should do nothing.
+		testAssert(grid.numObjects() == 0);
+		testAssert(grid.numNonEmptyCells() == 0);
+	}
+
+	//------------------- Test swap-removal keeps indices consistent -------------------
+	{
+		ServerObjectGrid grid;
+		std::vector<WorldObjectRef> obs;
+		for(int i=0; i<10; ++i)
+		{
+			WorldObjectRef ob = new WorldObject();
+			ob->pos = Vec3d(i, i, 0);
+			obs.push_back(ob);
+			grid.insert(ob.ptr());
+		}
+		testAssert(grid.getObjectsInCell(Vec3i(0, 0, 0))->size() == 10);
+
+		grid.remove(obs[0].ptr());
+		grid.remove(obs[5].ptr());
+		obs[9]->pos = Vec3d(1000, 0, 0);
+		grid.objectTransformChanged(obs[9].ptr());
+		grid.remove(obs[9].ptr());
+		testAssert(grid.getObjectsInCell(Vec3i(0, 0, 0))->size() == 7);
+		testAssert(grid.numObjects() == 7);
+
+		for(int i=1; i<9; ++i)
+			if(i != 5)
+				grid.remove(obs[i].ptr());
+		testAssert(grid.numObjects() == 0);
+		testAssert(grid.numNonEmptyCells() == 0);
+	}
+
+	//------------------- Test queries against brute force, and measure query latency with lots of objects -------------------
+	{
+		const int NUM_OBS = 200000;
+		const float WORLD_HALF_W = 5000.f;
+
+		PCG32 rng(1);
+		std::vector<WorldObjectRef> obs(NUM_OBS);
+		ServerObjectGrid grid;
+		{
+			Timer timer;
+			for(int i=0; i<NUM_OBS; ++i)
+			{
+				obs[i] = new WorldObject();
+				obs[i]->pos = Vec3d((rng.unitRandom() * 2 - 1) * WORLD_HALF_W, (rng.unitRandom() * 2 - 1) * WORLD_HALF_W, rng.unitRandom() * 100);
+				grid.insert(obs[i].ptr());
+			}
+			conPrint("Inserting " + toString(NUM_OBS) + " objects took " + timer.elapsedStringNSigFigs(4));
+		}
+
+		// Move some objects around
+		{
+			Timer timer;
+			const int NUM_MOVES = 100000;
+			for(int i=0; i<NUM_MOVES; ++i)
+			{
+				WorldObject* ob = obs[myMin(NUM_OBS - 1, (int)(rng.unitRandom() * NUM_OBS))].ptr();
+				ob->pos += Vec3d((rng.unitRandom() * 2 - 1) * 300, (rng.unitRandom() * 2 - 1) * 300, 0);
+				grid.objectTransformChanged(ob);
+			}
+			conPrint("Moving objects took " + doubleToStringNSigFigs(timer.elapsed() / NUM_MOVES * 1.0e9, 4) + " ns / move");
+		}
+
+		for(int i=0; i<100; ++i)
+		{
+			const Vec4f centre((rng.unitRandom() * 2 - 1) * WORLD_HALF_W, (rng.unitRandom() * 2 - 1) * WORLD_HALF_W, 0, 1);
+			const float half_w = rng.unitRandom() * 1500.f;
+			checkQueryMatchesBruteForce(grid, obs, js::AABBox(centre - Vec4f(half_w, half_w, half_w, 0), centre + Vec4f(half_w, half_w, half_w, 0)));
+		}
+
+		// Query with an AABB that contains everything (exercises the iterate-over-all-cells path)
+		checkQueryMatchesBruteForce(grid, obs, js::AABBox(Vec4f(-1.0e20f, -1.0e20f, -1.0e20f, 1), Vec4f(1.0e20f, 1.0e20f, 1.0e20f, 1)));
+
+		// Measure QueryObjectsInAABB-style query latency: 2km x 2km query around a random point.
+		{
+			const int NUM_QUERIES = 100;
+			std::vector<WorldObject*> res;
+			size_t total_num_res = 0;
+
+			Timer timer;
+			for(int i=0; i<NUM_QUERIES; ++i)
+			{
+				const Vec4f centre((rng.unitRandom() * 2 - 1) * WORLD_HALF_W, (rng.unitRandom() * 2 - 1) * WORLD_HALF_W, 0, 1);
+				res.clear();
+				grid.getObjectsInAABB(js::AABBox(centre - Vec4f(1000, 1000, 1000, 0), centre + Vec4f(1000, 1000, 1000, 0)), res);
+				total_num_res += res.size();
+			}
+			const double grid_time = timer.elapsed() / NUM_QUERIES;
+
+			timer.reset();
+			for(int i=0; i<NUM_QUERIES; ++i)
+			{
+				const Vec4f centre((rng.unitRandom() * 2 - 1) * WORLD_HALF_W, (rng.unitRandom() * 2 - 1) * WORLD_HALF_W, 0, 1);
+				res.clear();
+				bruteForceGetObjectsInAABB(obs, js::AABBox(centre - Vec4f(1000, 1000, 1000, 0), centre + Vec4f(1000, 1000, 1000, 0)), res);
+			}
+			const double brute_force_time = timer.elapsed() / NUM_QUERIES;
+
+			conPrint("AABB query (" + toString(NUM_OBS) + " obs, av " + toString(total_num_res / NUM_QUERIES) + " results): grid: " + doubleToStringNSigFigs(grid_time * 1.0e6, 4) +
+				" us, brute force: " + doubleToStringNSigFigs(brute_force_time * 1.0e6, 4) + " us");
+		}
+
+		// Measure QueryObjects-style query latency: look up a single cell.
+		{
+			const int NUM_QUERIES = 10000;
+			size_t total_num_res = 0;
+
+			Timer timer;
+			for(int i=0; i<NUM_QUERIES; ++i)
+			{
+				const Vec3i cell((int)(rng.unitRandom() * 50) - 25, (int)(rng.unitRandom() * 50) - 25, 0);
+				const std::vector<WorldObject*>* cell_obs = grid.getObjectsInCell(cell);
+				if(cell_obs)
+					total_num_res += cell_obs->size();
+			}
+			conPrint("Cell query (" + toString(NUM_OBS) + " obs, av " + toString(total_num_res / NUM_QUERIES) + " results): " + doubleToStringNSigFigs(timer.elapsed() / NUM_QUERIES * 1.0e9, 4) + " ns");
+		}
+
+		for(int i=0; i<NUM_OBS; ++i)
+			grid.remove(obs[i].ptr());
+		testAssert(grid.numObjects() == 0);
+		testAssert(grid.numNonEmptyCells() == 0);
+	}
+
+	conPrint("ServerObjectGrid::test() done");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,79 @@
+/*=====================================================================
+ServerObjectGrid.h
+------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/WorldObject.h"
+#include <maths/vec3.h>
+#include <physics/jscol_aabbox.h>
+#include <unordered_map>
+#include <vector>
+
+
+struct ServerObjectGridCellHash
+{
+	size_t operator() (const Vec3i& v) const
+	{
+		return (size_t)(((uint32)v.x * 73856093u) ^ ((uint32)v.y * 19349663u) ^ ((uint32)v.z * 83492791u));
+	}
+};
+
+
+/*=====================================================================
+ServerObjectGrid
+----------------
+Spatial index of the objects in a world, for the server.
+
+Objects are bucketed by position into cells of width CELL_WIDTH, which is the same grid
+that the client uses for QueryObjects (see gui_client/ProximityLoader.cpp).
+This allows QueryObjects and QueryObjectsInAABB to just look at objects in the queried cells,
+instead of iterating over every object in the world.
+
+Stores raw pointers to objects, so objects must be removed from the grid before they are destroyed.
+Not threadsafe, access is guarded by the world state mutex.
+=====================================================================*/
+class ServerObjectGrid
+{
+public:
+	ServerObjectGrid();
+	~ServerObjectGrid();
+
+	static const float CELL_WIDTH; // NOTE: has to be the same value as in gui_client/ProximityLoader.cpp.
+
+	void insert(WorldObject* ob); // Does nothing if object is already inserted.
+	void remove(WorldObject* ob); // Does nothing if object is not inserted.
+	void objectTransformChanged(WorldObject* ob); // Moves the object to a new cell if needed.  Inserts the object if not already inserted.
+	void clear();
+
+	bool isInserted(const WorldObject* ob) const { return ob_info.count(ob) != 0; }
+	size_t numObjects() const { return ob_info.size(); }
+	size_t numNonEmptyCells() const { return cells.size(); }
+
+	// Returns NULL if there are no objects in the cell.
+	const std::vector<WorldObject*>* getObjectsInCell(const Vec3i& cell) const;
+
+	// Appends objects with a finite position in the given AABB to obs_out.
+	void getObjectsInAABB(const js::AABBox& aabb, std::vector<WorldObject*>& obs_out) const;
+
+	static bool cellForPos(const Vec3d& pos, Vec3i& cell_out); // Returns false if pos is not finite.
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(ServerObjectGrid);
+
+	void removeFromCell(WorldObject* ob, const Vec3i& cell, size_t index);
+
+	struct ObInfo
+	{
+		Vec3i cell;
+		size_t index; // Index in the cell object vector.
+		bool in_cell; // False if the object position is not finite, in which case it is not in any cell.
+	};
+
+	std::unordered_map<Vec3i, std::vector<WorldObject*>, ServerObjectGridCellHash> cells;
+	std::unordered_map<const WorldObject*, ObInfo> ob_info;
+};
@@ -8,6 +8,21 @@ Copyright Glare Technologies Limited 2023 -
 
 #include "AccountHandlers.h"
 #include "ServerLuaScriptTests.h"
+#include "ServerObjectGrid.h"
+#include "ResourceURLObjectIndex.h"
+#include "ResourceSendCache.h"
+#include "WebPageCache.h"
+#include "ResourceDownloadScheduler.h"
+#include "DynamicTextureFetcher.h"
+#include "WorldObjectHandleTable.h"
+#include "LuaScriptProfiler.h"
+#include "../shared/ParcelSpatialIndex.h"
+#include "../shared/TimerQueue.h"
+#include "LODChunkObjectIndex.h"
+#include "ChunkGenCache.h"
+#include "InterestManager.h"
+#include "ServerWorldState.h"
+#include "VoiceRoutingTable.h"
 #include "../shared/WorldObject.h"
 #include "../shared/LODGeneration.h"
 #include "../ethereum/RLP.h"
@@ -93,6 +108,21 @@ void ServerTestSuite::test()
 	runTest([&]() { URL::test();														});
 	runTest([&]() { LuaSerialisation::test();											});
 	runTest([&]() { ReferenceTest::run();												});
+	runTest([&]() { ServerObjectGrid::test(); });
+	runTest([&]() { LODChunkObjectIndex::test(); });
+	runTest([&]() { ResourceURLObjectIndex::test(); });
+	runTest([&]() { WorldObjectHandleTable::test(); });
+	runTest([&]() { ResourceSendCache::test(); });
+	runTest([&]() { WebPageCache::test(); });
+	runTest([&]() { ResourceDownloadScheduler::test(); });
+	runTest([&]() { DynamicTextureFetcher::test(); });
+	runTest([&]() { ChunkGenCache::test(); });
+	runTest([&]() { InterestManager::test(); });
+	runTest([&]() { ServerAllWorldsState::test(); });
+	runTest([&]() { VoiceRoutingTable::test(); });
+	runTest([&]() { ParcelSpatialIndex::test(); });
+	runTest([&]() { TimerQueue::test(); });
+	runTest([&]() { LuaScriptProfiler::test(); });
 	runTest([&]() { ServerLuaScriptTests::test(); });
 	runTest([&]() { LuaUtils::test(); });
 	runTest([&]() { LuaTests::test(); });
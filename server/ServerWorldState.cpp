@@ -19,9 +19,56 @@ Generated at 2016-01-12 12:22:34 +1300
 #include <Database.h>
 #include <BufferOutStream.h>
 #include <BufferViewInStream.h>
+#include <TaskManager.h>
 #include "../shared/LODChunk.h"
 
 
+void ServerWorldState::addObject(const WorldObjectRef& ob, WorldStateLock& /*world_state_lock*/)
+{
+	auto res = objects.find(ob->uid);
+	if(res != objects.end())
+	{
+		if(res->second.ptr() != ob.ptr())
+		{
+			object_grid.remove(res->second.ptr()); // Remove existing object with the same UID from the grid.
+			lod_chunk_index.objectRemoved(res->second.ptr());
+			resource_URL_index.objectRemoved(res->second.ptr());
+			object_handles.removeObject(res->second->script_handle);
+			res->second->script_handle = 0;
+		}
+		res->second = ob;
+	}
+	else
+		objects.insert(std::make_pair(ob->uid, ob));
+
+	if(object_handles.getObject(ob->script_handle) != ob.ptr())
+		ob->script_handle = object_handles.addObject(ob.ptr());
+
+	object_grid.insert(ob.ptr());
+	lod_chunk_index.objectChanged(ob.ptr());
+	resource_URL_index.objectChanged(ob.ptr());
+}
+
+
+void ServerWorldState::removeObject(const UID& uid, WorldStateLock& lock)
+{
+	auto res = objects.find(uid);
+	if(res != objects.end())
+		removeObject(res, lock);
+}
+
+
+ServerWorldState::ObjectMapType::iterator ServerWorldState::removeObject(ObjectMapType::iterator it, WorldStateLock& /*world_state_lock*/)
+{
+	object_grid.remove(it->second.ptr());
+	lod_chunk_index.objectRemoved(it->second.ptr());
+	resource_URL_index.objectRemoved(it->second.ptr());
+	object_handles.removeObject(it->second->script_handle);
+	it->second->script_handle = 0;
+	return objects.erase(it);
+}
+
+
 ServerAllWorldsState::ServerAllWorldsState()
 {
 	next_avatar_uid = UID(0);
@@ -31,6 +78,10 @@ ServerAllWorldsState::ServerAllWorldsState()
 
 	world_states[""] = new ServerWorldState();
 
+	resource_send_cache = new ResourceSendCache(/*max cache size=*/64 * 1024 * 1024, /*max cached resource size=*/512 * 1024, /*use sendfile=*/true); // Replaced with one using the server config settings in Server.cpp
+
+	web_page_cache = new WebPageCache(/*max cache size=*/64 * 1024 * 1024, /*max page age=*/30.0); // Replaced with one using the server config settings in Server.cpp
+
 	last_parcel_update_info.last_parcel_sale_update_hour = 0;
 	last_parcel_update_info.last_parcel_sale_update_day = 0;
 	last_parcel_update_info.last_parcel_sale_update_year = 0;
@@ -45,6 +96,11 @@ ServerAllWorldsState::ServerAllWorldsState()
 	read_only_mode = false;
 
 	force_dyn_tex_update = false;
+
+	db_save_in_progress = 0;
+
+	num_object_initial_send_cache_hits = 0;
+	num_object_initial_send_cache_misses = 0;
 }
 
 
@@ -66,6 +122,7 @@ void ServerAllWorldsState::createNewDatabase(const std::string& path)
 	conPrint("Creating new world state database at '" + path + "'...");
 
 	Lock lock(mutex);
+	Lock db_lock(database_mutex);
 
 	database.openAndMakeOrClearDatabase(path);
 }
@@ -103,11 +160,123 @@ static const uint32 OBJECT_STORAGE_ITEM_VERSION = 1;
 static const uint32 USER_SECRET_VERSION = 1;
 
 
+namespace
+{
+
+struct RecordToDecode
+{
+	DatabaseKey database_key;
+	const uint8* data;
+	size_t len;
+};
+
+
+// Results of decoding a range of records, in database key order.
+struct DecodedRecords
+{
+	std::vector<std::pair<std::string, WorldObjectRef>> objects; // (world name, object) pairs.
+	std::vector<std::pair<std::string, ParcelRef>> parcels; // (world name, parcel) pairs.
+	std::vector<std::pair<std::string, LODChunkRef>> lod_chunks; // (world name, LOD chunk) pairs.
+	std::vector<UserRef> users;
+
+	std::string error_msg; // Set if an exception was thrown while decoding.
+};
+
+
+// Decodes object, user, parcel and LOD chunk records.  Doesn't access the world state, so can be run in parallel.
+class DecodeRecordsTask : public glare::Task
+{
+public:
+	virtual void run(size_t /*thread_index*/) override
+	{
+		try
+		{
+			for(size_t i=begin; i<end; ++i)
+				decodeRecord((*records)[i]);
+		}
+		catch(glare::Exception& e)
+		{
+			results.error_msg = e.what();
+		}
+		catch(std::exception& e) // catch std::bad_alloc etc..
+		{
+			results.error_msg = std::string("Caught std::exception while decoding records: ") + e.what();
+		}
+	}
+
+	void decodeRecord(const RecordToDecode& record)
+	{
+		BufferViewInStream stream(ArrayRef<uint8>(record.data, record.len));
+
+		const uint32 chunk = stream.readUInt32();
+		if(chunk == WORLD_OBJECT_CHUNK)
+		{
+			// Read world name
+			const std::string world_name = stream.readStringLengthFirst(10000);
+
+			// Deserialise object
+			WorldObjectRef world_ob = new WorldObject();
+			readWorldObjectFromStream(stream, *world_ob);
+
+			//TEMP HACK: clear lightmap needed flag
+			BitUtils::zeroBit(world_ob->flags, WorldObject::LIGHTMAP_NEEDS_COMPUTING_FLAG);
+
+			world_ob->database_key = record.database_key;
+			results.objects.push_back(std::make_pair(world_name, world_ob));
+		}
+		else if(chunk == USER_CHUNK)
+		{
+			// Deserialise user
+			UserRef user = new User();
+			readUserFromStream(stream, *user);
+
+			user->database_key = record.database_key;
+			results.users.push_back(user);
+		}
+		else if(chunk == PARCEL_CHUNK)
+		{
+			// Read world name
+			const std::string world_name = stream.readStringLengthFirst(10000);
+
+			// Deserialise parcel
+			ParcelRef parcel = new Parcel();
+			readFromStream(stream, *parcel);
+
+			parcel->database_key = record.database_key;
+			results.parcels.push_back(std::make_pair(world_name, parcel));
+		}
+		else if(chunk == LOD_CHUNK_CHUNK)
+		{
+			// Read world name
+			const std::string world_name = stream.readStringLengthFirst(10000);
+
+			LODChunkRef lod_chunk = new LODChunk();
+			readLODChunkFromStream(stream, *lod_chunk);
+
+			lod_chunk->database_key = record.database_key;
+			results.lod_chunks.push_back(std::make_pair(world_name, lod_chunk));
+		}
+		else
+		{
+			assert(0);
+		}
+	}
+
+	const std::vector<RecordToDecode>* records;
+	size_t begin, end; // Range of records to decode.
+
+	DecodedRecords results;
+};
+
+} // end anonymous namespace
+
+
 void ServerAllWorldsState::readFromDisk(const std::string& path)
 {
 	conPrint("Reading world state from '" + path + "'...");
 
 	WorldStateLock lock(mutex);
+	Lock db_lock(database_mutex);
 
 	Timer timer;
 
@@ -124,6 +293,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 	size_t num_object_storage_items = 0;
 	size_t num_user_secrets = 0;
 	size_t num_lod_chunks = 0;
+	size_t num_records = 0;
 
 	bool is_pre_database_format = false;
 	{
@@ -139,6 +309,9 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 		// Using database
 		database.startReadingFromDisk(path);
 
+		std::vector<RecordToDecode> records_to_decode;
+		records_to_decode.reserve(database.getRecordMap().size());
+
 		for(auto it = database.getRecordMap().begin(); it != database.getRecordMap().end(); ++it)
 		{
 			const DatabaseKey database_key = it->first;
@@ -146,6 +319,8 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 
 			if(record.isRecordValid())
 			{
+				num_records++;
+
 				BufferViewInStream stream(ArrayRef<uint8>(database.getInitialRecordData(record), record.len));
 
 				// Now deserialise from our temp buffer
@@ -154,54 +329,14 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				{
 					// Not doing anything wtih this chunk.  Instead the world name is saved with each object and parcel.
 				}
-				else if(chunk == WORLD_OBJECT_CHUNK)
-				{
-					// Read world name
-					const std::string world_name = stream.readStringLengthFirst(10000);
-
-					// Create ServerWorldState for world name if needed
-					if(world_states.count(world_name) == 0) 
-						world_states[world_name] = new ServerWorldState();
-
-					// Deserialise object
-					WorldObjectRef world_ob = new WorldObject();
-					readWorldObjectFromStream(stream, *world_ob);
-
-					//TEMP HACK: clear lightmap needed flag
-					BitUtils::zeroBit(world_ob->flags, WorldObject::LIGHTMAP_NEEDS_COMPUTING_FLAG);
-
-					world_ob->database_key = database_key;
-					world_states[world_name]->getObjects(lock)[world_ob->uid] = world_ob; // Add to object map
-					num_obs++;
-
-					next_object_uid = UID(myMax(world_ob->uid.value() + 1, next_object_uid.value()));
-				}
-				else if(chunk == USER_CHUNK)
+				else if(chunk == WORLD_OBJECT_CHUNK || chunk == USER_CHUNK || chunk == PARCEL_CHUNK || chunk == LOD_CHUNK_CHUNK)
 				{
-					// Deserialise user
-					UserRef user = new User();
-					readUserFromStream(stream, *user);
-
-					user->database_key = database_key;
-					user_id_to_users[user->id] = user; // Add to user map
-					name_to_users[user->name] = user; // Add to user map
-				}
-				else if(chunk == PARCEL_CHUNK)
-				{
-					// Read world name
-					const std::string world_name = stream.readStringLengthFirst(10000);
-
-					// Create ServerWorldState for world name if needed
-					if(world_states.count(world_name) == 0) 
-						world_states[world_name] = new ServerWorldState();
-
-					// Deserialise parcel
-					ParcelRef parcel = new Parcel();
-					readFromStream(stream, *parcel);
-
-					parcel->database_key = database_key;
-					world_states[world_name]->getParcels(lock)[parcel->id] = parcel; // Add to parcel map
-					num_parcels++;
+					// These are the most numerous record types, decode them in parallel below.
+					RecordToDecode record_to_decode;
+					record_to_decode.database_key = database_key;
+					record_to_decode.data = database.getInitialRecordData(record);
+					record_to_decode.len = record.len;
+					records_to_decode.push_back(record_to_decode);
 				}
 				else if(chunk == WORLD_SETTINGS_CHUNK)
 				{
@@ -416,34 +551,104 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 
 					num_tiles_read = num_tiles;
 				}
-				else if(chunk == LOD_CHUNK_CHUNK)
+				else if(chunk == EOS_CHUNK)
 				{
-					// Read world name
-					const std::string world_name = stream.readStringLengthFirst(10000);
+					break;
+				}
+				else
+				{
+					throw glare::Exception("Unknown chunk type '" + toString(chunk) + "'");
+				}
+			}
+		}
+
+
+		// Decode object, user, parcel and LOD chunk records in parallel.
+		// Records are split into contiguous ranges (in database key order), which are decoded by separate tasks.
+		// The results are then merged in the same order, so if there are multiple records for the same object etc., the last one is used, as before.
+		{
+			Timer decode_timer;
+
+			glare::TaskManager task_manager("readFromDisk task manager");
+
+			const size_t MIN_RECORDS_PER_TASK = 1024;
+			const size_t num_tasks = myMax<size_t>(1, myMin(task_manager.getNumThreads() * 4, records_to_decode.size() / MIN_RECORDS_PER_TASK));
+			const size_t records_per_task = Maths::roundedUpDivide(records_to_decode.size(), num_tasks);
+
+			std::vector<Reference<DecodeRecordsTask>> tasks;
+			for(size_t i=0; i<num_tasks; ++i)
+			{
+				Reference<DecodeRecordsTask> task = new DecodeRecordsTask();
+				task->records = &records_to_decode;
+				task->begin = myMin(records_to_decode.size(), i * records_per_task);
+				task->end   = myMin(records_to_decode.size(), (i + 1) * records_per_task);
+				tasks.push_back(task);
+				task_manager.addTask(task);
+			}
+
+			task_manager.waitForTasksToComplete();
+
+			const double decode_time = decode_timer.elapsed();
+
+			// Merge results
+			for(size_t i=0; i<tasks.size(); ++i)
+			{
+				const DecodedRecords& results = tasks[i]->results;
+				if(!results.error_msg.empty())
+					throw glare::Exception(results.error_msg);
+
+				for(size_t z=0; z<results.objects.size(); ++z)
+				{
+					const std::string& world_name = results.objects[z].first;
+					const WorldObjectRef& world_ob = results.objects[z].second;
 
 					// Create ServerWorldState for world name if needed
 					if(world_states.count(world_name) == 0) 
 						world_states[world_name] = new ServerWorldState();
 
-					Reference<LODChunk> lod_chunk = new LODChunk();
+					world_states[world_name]->addObject(world_ob, lock); // Add to object map
+					num_obs++;
 
-					readLODChunkFromStream(stream, *lod_chunk);
-					
-					lod_chunk->database_key = database_key;
-					world_states[world_name]->getLODChunks(lock)[lod_chunk->coords] = lod_chunk;
-					num_lod_chunks++;
+					next_object_uid = UID(myMax(world_ob->uid.value() + 1, next_object_uid.value()));
 				}
-				else if(chunk == EOS_CHUNK)
+
+				for(size_t z=0; z<results.users.size(); ++z)
 				{
-					break;
+					const UserRef& user = results.users[z];
+					user_id_to_users[user->id] = user; // Add to user map
+					name_to_users[user->name] = user; // Add to user map
 				}
-				else
+
+				for(size_t z=0; z<results.parcels.size(); ++z)
 				{
-					throw glare::Exception("Unknown chunk type '" + toString(chunk) + "'");
+					const std::string& world_name = results.parcels[z].first;
+					const ParcelRef& parcel = results.parcels[z].second;
+
+					// Create ServerWorldState for world name if needed
+					if(world_states.count(world_name) == 0) 
+						world_states[world_name] = new ServerWorldState();
+
+					world_states[world_name]->getParcels(lock)[parcel->id] = parcel; // Add to parcel map
+					num_parcels++;
+				}
+
+				for(size_t z=0; z<results.lod_chunks.size(); ++z)
+				{
+					const std::string& world_name = results.lod_chunks[z].first;
+					const LODChunkRef& lod_chunk = results.lod_chunks[z].second;
+
+					// Create ServerWorldState for world name if needed
+					if(world_states.count(world_name) == 0) 
+						world_states[world_name] = new ServerWorldState();
+
+					world_states[world_name]->getLODChunks(lock)[lod_chunk->coords] = lod_chunk;
+					num_lod_chunks++;
 				}
 			}
-		}
 
+			conPrint("Decoded " + toString(records_to_decode.size()) + " object/user/parcel/LOD chunk record(s) with " + toString(num_tasks) + " task(s) in " + 
+				doubleToStringNSigFigs(decode_time, 4) + " s, merged in " + doubleToStringNSigFigs(decode_timer.elapsed() - decode_time, 4) + " s");
+		}
 
 		database.finishReadingFromDisk();
 	}
@@ -484,7 +689,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				//TEMP HACK: clear lightmap needed flag
 				BitUtils::zeroBit(world_ob->flags, WorldObject::LIGHTMAP_NEEDS_COMPUTING_FLAG);
 
-				current_world->getObjects(lock)[world_ob->uid] = world_ob; // Add to object map
+				current_world->addObject(world_ob, lock); // Add to object map
 				num_obs++;
 
 				next_object_uid = UID(myMax(world_ob->uid.value() + 1, next_object_uid.value()));
@@ -638,6 +843,10 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 
 	denormaliseData();
 
+	// Objects just loaded from disk haven't changed, so don't need their LOD chunks rebuilt.  ChunkGenThread creates any missing chunks at startup.
+	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
+		world_it->second->getLODChunkObjectIndex(lock).clearDirtyChunks();
+
 	// Compress voxel data if needed.
 	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 	{
@@ -660,6 +869,8 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 		toString(num_sub_eth_transactions) + " sub eth transaction(s), " + toString(num_tiles_read) + " tiles, " + toString(num_world_settings) + " world settings, " + 
 		toString(num_news_posts) + " news posts, " + toString(num_object_storage_items) + " object storage item(s), " + toString(num_user_secrets) + " user secret(s), " + 
 		toString(num_lod_chunks) + " lod chunk(s) in " + timer.elapsedStringNSigFigs(4));
+	if(num_records > 0)
+		conPrint("Read " + toString(num_records) + " database record(s) (" + doubleToStringNSigFigs(num_records / timer.elapsed(), 4) + " records/s)");
 }
 
 
@@ -668,36 +879,36 @@ void ServerAllWorldsState::addEverythingToDirtySets()
 	WorldStateLock lock(mutex);
 
 	for(auto it = resource_manager->getResourcesForURL().begin(); it != resource_manager->getResourcesForURL().end(); ++it)
-		db_dirty_resources.insert(it->second);
+		addResourcesAsDBDirty(it->second);
 
 	for(auto it = user_id_to_users.begin(); it != user_id_to_users.end(); ++it)
-		db_dirty_users.insert(it->second);
+		addUserAsDBDirty(it->second);
 
 	for(auto it = orders.begin(); it != orders.end(); ++it)
-		db_dirty_orders.insert(it->second);
+		addOrderAsDBDirty(it->second);
 
 	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 	{
 		Reference<ServerWorldState> world_state = world_it->second;
 
 		for(auto it = world_state->getObjects(lock).begin(); it != world_state->getObjects(lock).end(); ++it)
-			world_state->getDBDirtyWorldObjects(lock).insert(it->second);
+			world_state->addWorldObjectAsDBDirty(it->second, lock);
 
 		for(auto it = world_state->getParcels(lock).begin(); it != world_state->getParcels(lock).end(); ++it)
-			world_state->getDBDirtyParcels(lock).insert(it->second);
+			world_state->addParcelAsDBDirty(it->second, lock);
 	}
 
 	for(auto it = user_web_sessions.begin(); it != user_web_sessions.end(); ++it)
-		db_dirty_userwebsessions.insert(it->second);
+		addUserWebSessionAsDBDirty(it->second);
 
 	for(auto it = parcel_auctions.begin(); it != parcel_auctions.end(); ++it)
-		db_dirty_parcel_auctions.insert(it->second);
+		addParcelAuctionAsDBDirty(it->second);
 
 	for(auto it = screenshots.begin(); it != screenshots.end(); ++it)
-		db_dirty_screenshots.insert(it->second);
+		addScreenshotAsDBDirty(it->second);
 
 	for(auto it = sub_eth_transactions.begin(); it != sub_eth_transactions.end(); ++it)
-		db_dirty_sub_eth_transactions.insert(it->second);
+		addSubEthTransactionAsDBDirty(it->second);
 
 	map_tile_info.db_dirty = true;
 
@@ -801,7 +1012,7 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 				parcel->minting_transaction_id = std::numeric_limits<uint64>::max();
 				parcel->parcel_auction_ids.clear();
 
-				world_state->getDBDirtyParcels(lock).insert(parcel); // Mark parcel as dirty
+				world_state->addParcelAsDBDirty(parcel, lock); // Mark parcel as dirty
 			}
 		}
 
@@ -820,7 +1031,7 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 
 				user->setNewPasswordAndSalt("aaaaaaaa"); // Set to (the hash of) a known password, so we can log in as e.g. user 0 for testing.
 
-				db_dirty_users.insert(user); // Mark as dirty
+				addUserAsDBDirty(user); // Mark as dirty
 
 				i++;
 			}
@@ -846,7 +1057,7 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 				order->coinbase_charge_code = "";
 				order->coinbase_status = "";
 
-				db_dirty_orders.insert(order);
+				addOrderAsDBDirty(order);
 			}
 		}
 
@@ -912,10 +1123,27 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 {
 	conPrint("Saving world state to disk...");
 
+	DatabaseWriteBatchRef batch = serialiseDirtyDataToBatch(lock);
+
 	Timer timer;
+	writeBatchToDatabase(*batch);
+
+	recordDatabaseSaveStats(*batch, /*write time=*/timer.elapsed(), /*succeeded=*/true, lock);
+}
+
+
+// Serialise any changed data (objects in dirty set) into a batch of database writes.  Mutex should be held already.
+// Note that database keys for new records are allocated here, so that they can be assigned to the objects while we hold the mutex.
+DatabaseWriteBatchRef ServerAllWorldsState::serialiseDirtyDataToBatch(WorldStateLock& lock)
+{
+	Timer timer;
+
+	DatabaseWriteBatchRef batch = new DatabaseWriteBatch();
 
 	try
 	{
+		Lock db_lock(database_mutex);
+
 		// Number of various type of objects that were dirty and saved.
 		size_t num_obs = 0;
 		size_t num_parcels = 0;
@@ -937,7 +1165,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 		for(auto it = db_records_to_delete.begin(); it != db_records_to_delete.end(); ++it)
 		{
 			const DatabaseKey key = *it;
-			database.deleteRecord(key);
+			batch->keys_to_delete.push_back(key);
 		}
 		db_records_to_delete.clear();
 
@@ -965,7 +1193,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 					if(!ob->database_key.valid())
 						ob->database_key = database.allocUnusedKey(); // Get a new key
 
-					database.updateRecord(ob->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+					batch->addRecord(ob->database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 					num_obs++;
 				}
@@ -986,7 +1214,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 					if(!parcel->database_key.valid())
 						parcel->database_key = database.allocUnusedKey(); // Get a new key
 
-					database.updateRecord(parcel->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+					batch->addRecord(parcel->database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 					num_parcels++;
 				}
@@ -1007,7 +1235,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 					if(!chunk->database_key.valid())
 						chunk->database_key = database.allocUnusedKey(); // Get a new key
 
-					database.updateRecord(chunk->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+					batch->addRecord(chunk->database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 					num_lod_chunks++;
 				}
@@ -1027,7 +1255,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 				if(!world_state->world_settings.database_key.valid())
 					world_state->world_settings.database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(world_state->world_settings.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecord(world_state->world_settings.database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 				world_state->world_settings.db_dirty = false;
 
@@ -1047,7 +1275,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 				if(!user->database_key.valid())
 					user->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(user->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecord(user->database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 				num_users++;
 			}
@@ -1067,7 +1295,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 				if(!resource->database_key.valid())
 					resource->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(resource->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecord(resource->database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 				num_resources++;
 			}
@@ -1087,7 +1315,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 				if(!order->database_key.valid())
 					order->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(order->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecord(order->database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 				num_orders++;
 			}
@@ -1107,7 +1335,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 				if(!session->database_key.valid())
 					session->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(session->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecord(session->database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 				num_sessions++;
 			}
@@ -1127,7 +1355,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 				if(!auction->database_key.valid())
 					auction->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(auction->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecord(auction->database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 				num_auctions++;
 			}
@@ -1147,7 +1375,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 				if(!shot->database_key.valid())
 					shot->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(shot->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecord(shot->database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 				num_screenshots++;
 			}
@@ -1167,7 +1395,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 				if(!trans->database_key.valid())
 					trans->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(trans->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecord(trans->database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 				num_sub_eth_transactions++;
 			}
@@ -1187,7 +1415,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 				if(!post->database_key.valid())
 					post->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(post->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecord(post->database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 				num_news_posts++;
 			}
@@ -1214,7 +1442,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 				if(!item->database_key.valid())
 					item->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(item->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecord(item->database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 				num_object_storage_items++;
 			}
@@ -1240,7 +1468,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 				if(!secret->database_key.valid())
 					secret->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(secret->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecord(secret->database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 				num_user_secrets++;
 			}
@@ -1276,7 +1504,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 			if(!map_tile_info.database_key.valid())
 				map_tile_info.database_key = database.allocUnusedKey(); // Get a new key
 
-			database.updateRecord(map_tile_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			batch->addRecord(map_tile_info.database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 			map_tile_info.db_dirty = false;
 
@@ -1296,7 +1524,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 			if(!last_parcel_update_info.database_key.valid())
 				last_parcel_update_info.database_key = database.allocUnusedKey(); // Get a new key
 
-			database.updateRecord(last_parcel_update_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			batch->addRecord(last_parcel_update_info.database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 			last_parcel_update_info.db_dirty = false;
 		}
@@ -1312,7 +1540,7 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 			if(!eth_info.database_key.valid())
 				eth_info.database_key = database.allocUnusedKey(); // Get a new key
 
-			database.updateRecord(eth_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			batch->addRecord(eth_info.database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 			eth_info.db_dirty = false;
 		}
@@ -1328,14 +1556,12 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 			if(!feature_flag_info.database_key.valid())
 				feature_flag_info.database_key = database.allocUnusedKey(); // Get a new key
 
-			database.updateRecord(feature_flag_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			batch->addRecord(feature_flag_info.database_key, temp_buf.buf.data(), temp_buf.buf.size());
 
 			feature_flag_info.db_dirty = false;
 		}
 
-		database.flush();
-
-		std::string msg = "Saved ";
+		std::string msg;
 		if(num_obs > 0)                   msg += toString(num_obs) +   " object(s), ";
 		if(num_users > 0)                 msg += toString(num_users) + " user(s), ";
 		if(num_parcels > 0)               msg += toString(num_parcels) + " parcels(s), ";
@@ -1352,8 +1578,34 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 		if(num_user_secrets > 0)          msg += toString(num_user_secrets) + " user secret(s), ";
 		if(num_lod_chunks > 0)            msg += toString(num_lod_chunks) + " LOD chunk(s), ";
 		removeSuffixInPlace(msg, ", ");
-		msg += " in " + timer.elapsedStringNSigFigs(4);
-		conPrint(msg);
+		batch->summary = msg;
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
+
+	batch->serialise_time = timer.elapsed();
+	return batch;
+}
+
+
+void ServerAllWorldsState::writeBatchToDatabase(const DatabaseWriteBatch& batch)
+{
+	try
+	{
+		Lock db_lock(database_mutex);
+
+		for(size_t i=0; i<batch.keys_to_delete.size(); ++i)
+			database.deleteRecord(batch.keys_to_delete[i]);
+
+		for(size_t i=0; i<batch.records.size(); ++i)
+		{
+			const DatabaseWriteBatch::RecordInfo& record = batch.records[i];
+			database.updateRecord(record.key, ArrayRef<uint8>(batch.data.data() + record.offset, record.len));
+		}
+
+		database.flush();
 	}
 	catch(FileUtils::FileUtilsExcep& e)
 	{
@@ -1362,6 +1614,24 @@ void ServerAllWorldsState::serialiseToDisk(WorldStateLock& lock)
 }
 
 
+void ServerAllWorldsState::recordDatabaseSaveStats(const DatabaseWriteBatch& batch, double write_time, bool succeeded, WorldStateLock& /*lock*/)
+{
+	db_save_stats.num_saves++;
+	if(!succeeded)
+		db_save_stats.num_failed_saves++;
+	db_save_stats.last_serialise_time = batch.serialise_time;
+	db_save_stats.last_write_time = write_time;
+	db_save_stats.max_serialise_time = myMax(db_save_stats.max_serialise_time, batch.serialise_time);
+	db_save_stats.max_write_time = myMax(db_save_stats.max_write_time, write_time);
+	db_save_stats.last_num_bytes = batch.data.size();
+	db_save_stats.total_num_bytes += batch.data.size();
+
+	if(succeeded)
+		conPrint("Saved " + (batch.summary.empty() ? std::string("nothing") : batch.summary) + " (" + getNiceByteSize(batch.data.size()) + "), serialise time: " + 
+			doubleToStringNSigFigs(batch.serialise_time, 4) + " s, write time: " + doubleToStringNSigFigs(write_time, 4) + " s");
+}
+
+
 std::string ServerAllWorldsState::getCredential(const std::string& key) // Throws glare::Exception if not found
 {
 	Lock lock(mutex);
@@ -1504,3 +1774,122 @@ FeatureFlagInfo::FeatureFlagInfo()
 	),
 	db_dirty(false) 
 {}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+#include <maths/PCG32.h>
+
+
+// Writes a database with lots of objects, parcels and users, then reads it back, reporting the number of records read per second.
+void ServerAllWorldsState::test()
+{
+	conPrint("ServerAllWorldsState::test()");
+
+	try
+	{
+		const std::string db_path = PlatformUtils::getTempDirPath() + "/server_world_state_test.bin";
+		if(FileUtils::fileExists(db_path))
+			FileUtils::deleteFile(db_path);
+
+		const int NUM_OBJECTS = 100000;
+		const int NUM_PARCELS = 2000;
+		const int NUM_USERS = 2000;
+
+		{
+			Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+			world_state->resource_manager = new ResourceManager(PlatformUtils::getTempDirPath());
+			world_state->createNewDatabase(db_path);
+
+			WorldStateLock lock(world_state->mutex);
+
+			PCG32 rng(1);
+			for(int i=0; i<NUM_OBJECTS; ++i)
+			{
+				WorldObjectRef ob = new WorldObject();
+				ob->uid = UID(i);
+				ob->model_url = "model_" + toString(i) + ".bmesh";
+				ob->pos = Vec3d((rng.unitRandom() - 0.5) * 4000.0, (rng.unitRandom() - 0.5) * 4000.0, 0);
+				ob->scale = Vec3f(1.f);
+				ob->axis = Vec3f(0, 0, 1);
+				ob->angle = 0;
+
+				const std::string world_name = (i % 10 == 0) ? "personal_world" : "";
+				if(world_state->world_states.count(world_name) == 0)
+					world_state->world_states[world_name] = new ServerWorldState();
+
+				world_state->world_states[world_name]->addObject(ob, lock);
+				world_state->world_states[world_name]->addWorldObjectAsDBDirty(ob, lock);
+			}
+
+			for(int i=0; i<NUM_PARCELS; ++i)
+			{
+				ParcelRef parcel = new Parcel();
+				parcel->id = ParcelID(i);
+				parcel->description = "parcel " + toString(i);
+				world_state->getRootWorldState()->getParcels(lock)[parcel->id] = parcel;
+				world_state->getRootWorldState()->addParcelAsDBDirty(parcel, lock);
+			}
+
+			for(int i=0; i<NUM_USERS; ++i)
+			{
+				UserRef user = new User();
+				user->id = UserID(i);
+				user->name = "user_" + toString(i);
+				world_state->user_id_to_users[user->id] = user;
+				world_state->name_to_users[user->name] = user;
+				world_state->addUserAsDBDirty(user);
+			}
+
+			world_state->serialiseToDisk(lock);
+		}
+
+		// Read the database back
+		{
+			Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+			world_state->resource_manager = new ResourceManager(PlatformUtils::getTempDirPath());
+
+			Timer timer;
+			world_state->readFromDisk(db_path);
+			const double elapsed = timer.elapsed();
+
+			const int num_records = NUM_OBJECTS + NUM_PARCELS + NUM_USERS;
+			conPrint("Read " + toString(num_records) + " records in " + doubleToStringNSigFigs(elapsed, 4) + " s (" + doubleToStringNSigFigs(num_records / elapsed, 4) + " records/s)");
+
+			WorldStateLock lock(world_state->mutex);
+
+			testAssert(world_state->world_states.count("personal_world") == 1);
+			testAssert(world_state->getRootWorldState()->getObjects(lock).size() + world_state->world_states["personal_world"]->getObjects(lock).size() == NUM_OBJECTS);
+			testAssert(world_state->getRootWorldState()->getParcels(lock).size() == NUM_PARCELS);
+			testAssert(world_state->user_id_to_users.size() == NUM_USERS);
+			testAssert(world_state->name_to_users.size() == NUM_USERS);
+
+			auto res = world_state->getRootWorldState()->getObjects(lock).find(UID(1234));
+			testAssert(res != world_state->getRootWorldState()->getObjects(lock).end());
+			testAssert(res->second->model_url == "model_1234.bmesh");
+			testAssert(res->second->database_key.valid());
+
+			testAssert(world_state->getRootWorldState()->getObjectGrid(lock).numObjects() == world_state->getRootWorldState()->getObjects(lock).size());
+
+			testAssert(world_state->getRootWorldState()->getParcels(lock)[ParcelID(10)]->description == "parcel 10");
+			testAssert(world_state->user_id_to_users[UserID(10)]->name == "user_10");
+
+			// Next object UID should be past all loaded objects.
+			testAssert(world_state->getNextObjectUID().value() >= (uint64)NUM_OBJECTS);
+		}
+
+		FileUtils::deleteFile(db_path);
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ServerAllWorldsState::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -13,6 +13,7 @@ Copyright Glare Technologies Limited 2024 -
 #include "../shared/WorldSettings.h"
 #include "../shared/WorldStateLock.h"
 #include "../shared/LODChunk.h"
+#include "../shared/ParcelSpatialIndex.h"
 #include "NewsPost.h"
 #include "User.h"
 #include "Order.h"
@@ -20,12 +21,22 @@ Copyright Glare Technologies Limited 2024 -
 #include "ParcelAuction.h"
 #include "Screenshot.h"
 #include "SubEthTransaction.h"
+#include "ServerObjectGrid.h"
+#include "LODChunkObjectIndex.h"
+#include "ResourceURLObjectIndex.h"
+#include "WorldObjectHandleTable.h"
+#include "ResourceSendCache.h"
+#include "WebPageCache.h"
+#include "WorldScriptContext.h"
+#include "LuaScriptProfiler.h"
+#include "DatabaseWriteBatch.h"
 #include <ThreadSafeRefCounted.h>
 #include <Platform.h>
 #include <Mutex.h>
 #include <Database.h>
 #include <CircularBuffer.h>
 #include <map>
+#include <set>
 #include <unordered_set>
 class ServerWorldState;
 class WebDataStore;
@@ -207,10 +218,15 @@ members private and having accessor methods that take a WorldStateLock argument.
 class ServerWorldState : public ThreadSafeRefCounted
 {
 public:
-	void addParcelAsDBDirty     (const ParcelRef parcel,  WorldStateLock& /*world_state_lock*/) { db_dirty_parcels.insert(parcel); }
-	void addWorldObjectAsDBDirty(const WorldObjectRef ob, WorldStateLock& /*world_state_lock*/) { db_dirty_world_objects.insert(ob); }
+	void addParcelAsDBDirty     (const ParcelRef parcel,  WorldStateLock& /*world_state_lock*/) { db_dirty_parcels.insert(parcel); parcel_index.insertOrUpdate(parcel); WebPageCache::invalidate(WebPageCache::Dependency_Parcels); } // Parcel geometry may have changed, so update the parcel index as well.  Cached web pages showing parcels are stale too.
+	void addWorldObjectAsDBDirty(const WorldObjectRef ob, WorldStateLock& /*world_state_lock*/) { db_dirty_world_objects.insert(ob); ob->invalidateCachedNetworkMessages(); lod_chunk_index.objectChanged(ob.ptr()); resource_URL_index.objectChanged(ob.ptr()); } // Object state has changed, so cached network messages, the LOD chunk the object is in, and the object resource URLs are stale as well.
 	void addLODChunkAsDBDirty   (const LODChunkRef ob,    WorldStateLock& /*world_state_lock*/) { db_dirty_lod_chunks.insert(ob); }
 
+	// Non-null if this world has its own Lua VM and timer queue (ServerConfig::per_world_lua_vms).
+	// Declared before the object map so it is destroyed after the objects, whose script evaluators reference the Lua VM.
+	Reference<WorldScriptContext> script_context;
+	WorldScriptStats script_stats;
+
 	WorldSettings world_settings;
 
 	typedef std::map<UID, Reference<Avatar>> AvatarMapType;
@@ -226,6 +242,25 @@ public:
 	
 	ParcelMapType parcels; // TODO: make private.  Lots of compile errors to fix when doing so.
 
+	// Objects should be added and removed with these methods, so the object grid is kept up to date.
+	void addObject(const WorldObjectRef& ob, WorldStateLock& /*world_state_lock*/); // Adds to objects map and object grid.  Replaces any existing object with the same UID.
+	void removeObject(const UID& uid, WorldStateLock& /*world_state_lock*/); // Removes from objects map and object grid.
+	ObjectMapType::iterator removeObject(ObjectMapType::iterator it, WorldStateLock& /*world_state_lock*/); // Returns iterator to the next object.
+	void objectTransformChanged(WorldObject* ob, WorldStateLock& /*world_state_lock*/) { object_grid.objectTransformChanged(ob); lod_chunk_index.objectChanged(ob); } // Call after changing ob->pos.
+
+	const ServerObjectGrid& getObjectGrid(WorldStateLock& /*world_state_lock*/) const { return object_grid; }
+	LODChunkObjectIndex& getLODChunkObjectIndex(WorldStateLock& /*world_state_lock*/) { return lod_chunk_index; }
+	const ResourceURLObjectIndex& getResourceURLObjectIndex(WorldStateLock& /*world_state_lock*/) const { return resource_URL_index; }
+
+	// Resolves a WorldObject::script_handle.  Returns NULL if the handle is stale.
+	WorldObject* getObjectForScriptHandle(uint64 handle, WorldStateLock& /*world_state_lock*/) const { return object_handles.getObject(handle); }
+
+	// Spatial index of parcels, for parcel permission checks.  Parcels added to the parcel map directly (e.g. when loading) are picked up by rebuilding the index here.
+	const ParcelSpatialIndex& getParcelIndex(WorldStateLock& /*world_state_lock*/) { if(parcel_index.numParcels() != parcels.size()) parcel_index.rebuild(parcels); return parcel_index; }
+
+	// LOD chunks that have been rebuilt by ChunkGenThread, and need to be sent to clients with a LODChunkUpdatedMessage.
+	std::set<Vec3i>& getLODChunksToSend(WorldStateLock& /*world_state_lock*/) { return lod_chunks_to_send; }
+
 	DirtyFromRemoteObjectSetType&                           getDirtyFromRemoteObjects(WorldStateLock& /*world_state_lock*/) { return dirty_from_remote_objects; }
 	std::unordered_set<WorldObjectRef, WorldObjectRefHash>& getDBDirtyWorldObjects(WorldStateLock& /*world_state_lock*/) { return db_dirty_world_objects; }
 	std::unordered_set<ParcelRef, ParcelRefHash>&           getDBDirtyParcels(WorldStateLock& /*world_state_lock*/) { return db_dirty_parcels; }
@@ -233,9 +268,15 @@ public:
 
 private:
 	ObjectMapType objects;
+	ServerObjectGrid object_grid; // Spatial index of objects, for QueryObjects etc.
+	LODChunkObjectIndex lod_chunk_index; // Objects in each LOD chunk, and which LOD chunks need rebuilding.
+	ResourceURLObjectIndex resource_URL_index; // Objects using each resource URL.
+	WorldObjectHandleTable object_handles; // Handles for the objects in this world, for Lua scripts.
+	ParcelSpatialIndex parcel_index;
 	DirtyFromRemoteObjectSetType dirty_from_remote_objects; // TODO: could just use vector for this, and avoid duplicates by checking object dirty flag.
 	AvatarMapType avatars;
 	LODChunkMapType lod_chunks;
+	std::set<Vec3i> lod_chunks_to_send;
 
 	std::unordered_set<WorldObjectRef, WorldObjectRefHash>	db_dirty_world_objects;
 	std::unordered_set<ParcelRef, ParcelRefHash>			db_dirty_parcels;
@@ -254,9 +295,15 @@ public:
 	ServerAllWorldsState();
 	~ServerAllWorldsState();
 
-	void readFromDisk(const std::string& path);
+	void readFromDisk(const std::string& path); // Object, user, parcel and LOD chunk records are decoded in parallel.
 	void createNewDatabase(const std::string& path);
 	void serialiseToDisk(WorldStateLock& lock) REQUIRES(mutex); // Write any changed data (objects in dirty set) to disk.  Mutex should be held already.
+
+	// Serialise any changed data (objects in dirty sets etc.) into a batch of database writes, and clear the dirty sets.  Mutex should be held already.
+	// The batch can then be written with writeBatchToDatabase() without holding the mutex.
+	DatabaseWriteBatchRef serialiseDirtyDataToBatch(WorldStateLock& lock) REQUIRES(mutex);
+	void writeBatchToDatabase(const DatabaseWriteBatch& batch); // Writes records and flushes the database to disk.  Locks database_mutex.
+	void recordDatabaseSaveStats(const DatabaseWriteBatch& batch, double write_time, bool succeeded, WorldStateLock& lock) REQUIRES(mutex);
 	void denormaliseData(); // Build/update cached/denormalised fields like creator_name.
 
 	// Removes sensitive information from the database, such as user passwords, email addresses, billing information, web sessions etc.
@@ -282,16 +329,18 @@ public:
 	void setUserWebMessage(const UserID& user_id, const std::string& s);
 	std::string getAndRemoveUserWebMessage(const UserID& user_id); // returns empty string if no message or user
 
+	static void test();
+
 	Reference<ServerWorldState> getRootWorldState(); // Guaranteed to return a non-null reference
 
 	void addResourcesAsDBDirty(const ResourceRef resource)					REQUIRES(mutex) { db_dirty_resources.insert(resource); changed = 1; }
-	void addSubEthTransactionAsDBDirty(const SubEthTransactionRef trans)	REQUIRES(mutex) { db_dirty_sub_eth_transactions.insert(trans); changed = 1; }
+	void addSubEthTransactionAsDBDirty(const SubEthTransactionRef trans)	REQUIRES(mutex) { db_dirty_sub_eth_transactions.insert(trans); changed = 1; WebPageCache::invalidate(WebPageCache::Dependency_SubEthTransactions); }
 	void addOrderAsDBDirty(const OrderRef order)							REQUIRES(mutex) { db_dirty_orders.insert(order); changed = 1; }
-	void addParcelAuctionAsDBDirty(const ParcelAuctionRef parcel_auction)	REQUIRES(mutex) { db_dirty_parcel_auctions.insert(parcel_auction); changed = 1; }
+	void addParcelAuctionAsDBDirty(const ParcelAuctionRef parcel_auction)	REQUIRES(mutex) { db_dirty_parcel_auctions.insert(parcel_auction); changed = 1; WebPageCache::invalidate(WebPageCache::Dependency_ParcelAuctions); }
 	void addUserWebSessionAsDBDirty(const UserWebSessionRef screenshot)		REQUIRES(mutex) { db_dirty_userwebsessions.insert(screenshot); changed = 1; }
-	void addScreenshotAsDBDirty(const ScreenshotRef screenshot)				REQUIRES(mutex) { db_dirty_screenshots.insert(screenshot); changed = 1; }
-	void addUserAsDBDirty(const UserRef user)								REQUIRES(mutex) { db_dirty_users.insert(user); changed = 1; }
-	void addNewsPostAsDBDirty(const NewsPostRef post)						REQUIRES(mutex) { db_dirty_news_posts.insert(post); changed = 1; }
+	void addScreenshotAsDBDirty(const ScreenshotRef screenshot)				REQUIRES(mutex) { db_dirty_screenshots.insert(screenshot); changed = 1; WebPageCache::invalidate(WebPageCache::Dependency_Screenshots); }
+	void addUserAsDBDirty(const UserRef user)								REQUIRES(mutex) { db_dirty_users.insert(user); changed = 1; WebPageCache::invalidate(WebPageCache::Dependency_Users); }
+	void addNewsPostAsDBDirty(const NewsPostRef post)						REQUIRES(mutex) { db_dirty_news_posts.insert(post); changed = 1; WebPageCache::invalidate(WebPageCache::Dependency_NewsPosts); }
 
 	void addEverythingToDirtySets();
 
@@ -300,6 +349,11 @@ public:
 	void clearAndReset(); // Just for fuzzing
 
 	Reference<ResourceManager> resource_manager;
+	Reference<ResourceSendCache> resource_send_cache; // For sending resource data to clients.
+
+	Reference<WebPageCache> web_page_cache; // Rendered web pages for users who are not logged in.
+
+	LuaScriptProfiler lua_script_profiler; // Enabled from the admin page.
 
 	std::map<UserID, Reference<User>> user_id_to_users GUARDED_BY(mutex);  // User id to user
 	std::map<std::string, Reference<User>> name_to_users GUARDED_BY(mutex); // Username to user
@@ -357,6 +411,28 @@ public:
 	// Ephemeral state - do we want to force the DynamicTextureUpdaterThread to do a run?
 	bool force_dyn_tex_update GUARDED_BY(mutex);
 
+	// Ephemeral state - database save statistics.  Times are in seconds.
+	struct DatabaseSaveStats
+	{
+		DatabaseSaveStats() : num_saves(0), num_failed_saves(0), last_serialise_time(0), last_write_time(0), max_serialise_time(0), max_write_time(0), last_num_bytes(0), total_num_bytes(0) {}
+
+		uint64 num_saves;
+		uint64 num_failed_saves;
+		double last_serialise_time; // Time spent serialising dirty data, while holding the world state mutex.
+		double last_write_time; // Time spent writing the batch to the database and flushing, on the DatabaseSaveThread.
+		double max_serialise_time;
+		double max_write_time;
+		uint64 last_num_bytes; // Number of bytes of records written in the last save.
+		uint64 total_num_bytes;
+	};
+	DatabaseSaveStats db_save_stats GUARDED_BY(mutex);
+
+	glare::AtomicInt db_save_in_progress; // Non-zero while a batch is being written by the DatabaseSaveThread.
+
+	// Ephemeral state - diagnostics for the cached ObjectInitialSend messages (WorldObject::cached_initial_send_msg).
+	uint64 num_object_initial_send_cache_hits GUARDED_BY(mutex);
+	uint64 num_object_initial_send_cache_misses GUARDED_BY(mutex);
+
 	// Ephemeral state:
 	std::map<UserID, Reference<UserScriptLog> > user_script_log GUARDED_BY(mutex);
 
@@ -391,5 +467,6 @@ private:
 	uint64 next_order_uid GUARDED_BY(mutex);
 	uint64 next_sub_eth_transaction_uid GUARDED_BY(mutex);
 
-	Database database GUARDED_BY(mutex);
+	Mutex database_mutex; // Protects database.  If both are locked, mutex must be locked before database_mutex.
+	Database database GUARDED_BY(database_mutex);
 };
@@ -8,17 +8,34 @@ Copyright Glare Technologies Limited 2023 -
 
 #include "ServerWorldState.h"
 #include "Server.h"
+#include "VoiceRoutingTable.h"
 #include <ConPrint.h>
 #include <StringUtils.h>
 #include <PlatformUtils.h>
+#include <Lock.h>
+#include <Exception.h>
+#if defined(_WIN32) || defined(OSX)
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
 
 
 static const int server_UDP_port = 7601;
 
 
-UDPHandlerThread::UDPHandlerThread(Server* server_)
-:	server(server_)
+UDPHandlerThread::UDPHandlerThread(Server* server_, bool reuse_port_)
+:	server(server_),
+	reuse_port(reuse_port_),
+	num_packets_rcvd(0),
+	should_quit(0)
 {
+#if defined(_WIN32) || defined(OSX)
+#else
+	socket_fd = -1;
+#endif
 }
 
 
@@ -27,74 +44,63 @@ UDPHandlerThread::~UDPHandlerThread()
 }
 
 
-void UDPHandlerThread::doRun()
+bool UDPHandlerThread::supportsMultipleThreads()
 {
-	PlatformUtils::setCurrentThreadNameIfTestsEnabled("UDPHandlerThread");
-
-	try
-	{
-		conPrint("UDPHandlerThread: Listening on UDP port " + toString(server_UDP_port) + "...");
-		udp_socket = new UDPSocket();
-		udp_socket->bindToPort(server_UDP_port, /*reuse_address=*/true);
+#if defined(_WIN32) || defined(OSX)
+	return false;
+#else
+	return true;
+#endif
+}
 
-		conPrint("UDPHandlerThread: Bound to port " + toString(server_UDP_port));
 
-		std::vector<uint8> packet_buf(4096);
-		uint64 num_packets_rcvd = 0;
+bool UDPHandlerThread::processPacket(const uint8* packet, size_t packet_len, const IPAddress& sender_ip_addr, int sender_port, const VoiceRoutingTable* routing_table, std::vector<int>& recipients_out)
+{
+	num_packets_rcvd++;
+	if(num_packets_rcvd % 512 == 0) // Log occasional packets:
+		conPrint("UDPHandlerThread: Received packet (packet " + toString(num_packets_rcvd) + ") of length " + toString(packet_len) + " from " + sender_ip_addr.toString() + ", port " + toString(sender_port));
 
-		while(1)
+	if(packet_len >= sizeof(uint32))
+	{
+		uint32 type;
+		std::memcpy(&type, packet, 4);
+		if(type == 1) // If packet has voice type:
 		{
-			IPAddress sender_ip_addr;
-			int sender_port;
-			const size_t packet_len = udp_socket->readPacket(packet_buf.data(), (int)packet_buf.size(), sender_ip_addr, sender_port);
-
-			num_packets_rcvd++;
-			if(num_packets_rcvd % 512 == 0) // Log occasional packets:
-				conPrint("UDPHandlerThread: Received packet (packet " + toString(num_packets_rcvd) + ") of length " + toString(packet_len) + " from " + sender_ip_addr.toString() + ", port " + toString(sender_port));
-
-			if(packet_len >= sizeof(uint32))
+			// Voice packet layout: type (uint32), speaker avatar id (uint32), sequence number (uint32), encoded data.
+			if(packet_len >= sizeof(uint32) * 3 && routing_table)
 			{
-				uint32 type;
-				std::memcpy(&type, packet_buf.data(), 4);
-				if(type == 1) // If packet has voice type:
-				{
-					if(server->connected_clients_changed != 0)
-					{
-						// Rebuild our connected_clients vector.
-						connected_clients.clear();
+				uint32 speaker_avatar_id;
+				std::memcpy(&speaker_avatar_id, packet + 4, sizeof(uint32));
 
-						{
-							Lock lock(server->connected_clients_mutex);
-
-							for(auto it = server->connected_clients.begin(); it != server->connected_clients.end(); ++it)
-								if(it->second.client_UDP_port > 0) // If remote UDP port is known:
-									connected_clients.push_back(ConnectedClientInfo({it->second.ip_addr, it->second.client_UDP_port}));
+				return routing_table->getRecipients(speaker_avatar_id, sender_ip_addr, sender_port, recipients_out) && !recipients_out.empty();
+			}
+		}
+		else if(type == 2)
+		{
+			if(packet_len >= sizeof(uint32) + sizeof(UID))
+			{
+				UID client_avatar_uid;
+				std::memcpy(&client_avatar_uid, packet + 4, sizeof(UID));
 
-							server->connected_clients_changed = 0;
-						}
-					}
+				server->clientUDPPortBecameKnown(client_avatar_uid, sender_ip_addr, sender_port);
+			}
+		}
+	}
+	return false;
+}
 
-					// Broadcast packet to clients
-					for(size_t i=0; i<connected_clients.size(); ++i)
-					{
-						if(num_packets_rcvd % 512 == 0) // Log occasional packets:
-							conPrint("UDPHandlerThread: Sending packet to " + connected_clients[i].ip_addr.toString() + ", port " + toString(connected_clients[i].client_UDP_port) + " ...");
 
-						udp_socket->sendPacket(packet_buf.data(), packet_len, connected_clients[i].ip_addr, connected_clients[i].client_UDP_port);
-					}
-				}
-				else if(type == 2)
-				{
-					if(packet_len >= sizeof(uint32) + sizeof(UID))
-					{
-						UID client_avatar_uid;
-						std::memcpy(&client_avatar_uid, packet_buf.data() + 4, sizeof(UID));
+void UDPHandlerThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("UDPHandlerThread");
 
-						server->clientUDPPortBecameKnown(client_avatar_uid, sender_ip_addr, sender_port);
-					}
-				}
-			}
-		}
+	try
+	{
+#if defined(_WIN32) || defined(OSX)
+		doRunUDPSocket();
+#else
+		doRunBatched();
+#endif
 	}
 	catch(glare::Exception& e)
 	{
@@ -105,15 +111,220 @@ void UDPHandlerThread::doRun()
 		conPrint("UDPHandlerThread: Caught std::bad_alloc.");
 	}
 
+#if defined(_WIN32) || defined(OSX)
 	udp_socket = NULL;
+#else
+	{
+		Lock lock(socket_mutex);
+		if(socket_fd >= 0)
+			close(socket_fd);
+		socket_fd = -1;
+	}
+#endif
 
 	conPrint("UDPHandlerThread: terminating.");
 }
 
 
+#if defined(_WIN32) || defined(OSX)
+
+
+void UDPHandlerThread::doRunUDPSocket()
+{
+	conPrint("UDPHandlerThread: Listening on UDP port " + toString(server_UDP_port) + "...");
+	udp_socket = new UDPSocket();
+	udp_socket->bindToPort(server_UDP_port, /*reuse_address=*/true);
+
+	conPrint("UDPHandlerThread: Bound to port " + toString(server_UDP_port));
+
+	std::vector<uint8> packet_buf(4096);
+	std::vector<int> recipients;
+
+	while(!should_quit)
+	{
+		IPAddress sender_ip_addr;
+		int sender_port;
+		const size_t packet_len = udp_socket->readPacket(packet_buf.data(), (int)packet_buf.size(), sender_ip_addr, sender_port);
+
+		Reference<VoiceRoutingTable> routing_table = server->getVoiceRoutingTable();
+
+		if(processPacket(packet_buf.data(), packet_len, sender_ip_addr, sender_port, routing_table.ptr(), recipients))
+		{
+			// Relay voice packet to recipients
+			for(size_t i=0; i<recipients.size(); ++i)
+			{
+				const VoiceRoutingTable::Client& client = routing_table->getClient(recipients[i]);
+				udp_socket->sendPacket(packet_buf.data(), packet_len, client.ip_addr, client.UDP_port);
+			}
+		}
+	}
+}
+
+
 void UDPHandlerThread::kill()
 {
+	should_quit = 1;
+
 	Reference<UDPSocket> udp_socket_ = udp_socket;
 	if(udp_socket_.nonNull())
 		udp_socket_->ungracefulShutdown();
 }
+
+
+#else // else if Linux:
+
+
+static int getPortFromSockAddr(const sockaddr_storage& addr)
+{
+	if(addr.ss_family == AF_INET6)
+		return ntohs(((const sockaddr_in6&)addr).sin6_port);
+	else if(addr.ss_family == AF_INET)
+		return ntohs(((const sockaddr_in&)addr).sin_port);
+	else
+		return 0;
+}
+
+
+static void sendBatch(int fd, mmsghdr* msgs, int num_msgs)
+{
+	int i = 0;
+	while(i < num_msgs)
+	{
+		const int num_sent = sendmmsg(fd, msgs + i, num_msgs - i, 0);
+		if(num_sent < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			i++; // The error is for the first message (e.g. unreachable destination).  Skip it and keep sending the rest.
+		}
+		else
+			i += num_sent;
+	}
+}
+
+
+void UDPHandlerThread::doRunBatched()
+{
+	conPrint("UDPHandlerThread: Listening on UDP port " + toString(server_UDP_port) + (reuse_port ? " (with SO_REUSEPORT)" : "") + "...");
+
+	// Create a dual-stack IPv6 socket, so we can receive from IPv4 and IPv6 clients.
+	const int fd = socket(AF_INET6, SOCK_DGRAM, 0);
+	if(fd < 0)
+		throw glare::Exception("socket() failed: " + PlatformUtils::getLastErrorString());
+	{
+		Lock lock(socket_mutex);
+		socket_fd = fd;
+	}
+
+	const int on = 1;
+	const int off = 0;
+	if(setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) != 0)
+		throw glare::Exception("setsockopt(IPV6_V6ONLY) failed: " + PlatformUtils::getLastErrorString());
+	if(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0)
+		throw glare::Exception("setsockopt(SO_REUSEADDR) failed: " + PlatformUtils::getLastErrorString());
+	if(reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) // Allow multiple threads to bind to the port.  The kernel distributes packets between them by source address.
+		throw glare::Exception("setsockopt(SO_REUSEPORT) failed: " + PlatformUtils::getLastErrorString());
+
+	sockaddr_in6 bind_addr;
+	std::memset(&bind_addr, 0, sizeof(bind_addr));
+	bind_addr.sin6_family = AF_INET6;
+	bind_addr.sin6_addr = in6addr_any;
+	bind_addr.sin6_port = htons(server_UDP_port);
+	if(bind(fd, (const sockaddr*)&bind_addr, sizeof(bind_addr)) != 0)
+		throw glare::Exception("Failed to bind to UDP port " + toString(server_UDP_port) + ": " + PlatformUtils::getLastErrorString());
+
+	conPrint("UDPHandlerThread: Bound to port " + toString(server_UDP_port));
+
+	const int RECV_BATCH_SIZE = 64;
+	const int MAX_PACKET_SIZE = 4096;
+	const int SEND_BATCH_SIZE = 1024;
+
+	std::vector<uint8> recv_buf(RECV_BATCH_SIZE * MAX_PACKET_SIZE);
+	std::vector<mmsghdr> recv_msgs(RECV_BATCH_SIZE);
+	std::vector<iovec> recv_iovecs(RECV_BATCH_SIZE);
+	std::vector<sockaddr_storage> recv_addrs(RECV_BATCH_SIZE);
+
+	std::vector<mmsghdr> send_msgs(SEND_BATCH_SIZE);
+	std::vector<iovec> send_iovecs(SEND_BATCH_SIZE);
+	std::vector<sockaddr_storage> send_addrs(SEND_BATCH_SIZE);
+	int num_sends = 0;
+
+	std::vector<int> recipients;
+
+	while(!should_quit)
+	{
+		for(int i=0; i<RECV_BATCH_SIZE; ++i)
+		{
+			recv_iovecs[i].iov_base = &recv_buf[i * MAX_PACKET_SIZE];
+			recv_iovecs[i].iov_len = MAX_PACKET_SIZE;
+			std::memset(&recv_msgs[i], 0, sizeof(mmsghdr));
+			recv_msgs[i].msg_hdr.msg_iov = &recv_iovecs[i];
+			recv_msgs[i].msg_hdr.msg_iovlen = 1;
+			recv_msgs[i].msg_hdr.msg_name = &recv_addrs[i];
+			recv_msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+		}
+
+		// Block until at least one packet is available, then return all packets available, up to RECV_BATCH_SIZE.
+		const int num_rcvd = recvmmsg(fd, recv_msgs.data(), RECV_BATCH_SIZE, MSG_WAITFORONE, /*timeout=*/NULL);
+		if(num_rcvd < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			if(should_quit)
+				break;
+			throw glare::Exception("recvmmsg failed: " + PlatformUtils::getLastErrorString());
+		}
+
+		Reference<VoiceRoutingTable> routing_table = server->getVoiceRoutingTable();
+
+		for(int i=0; i<num_rcvd; ++i)
+		{
+			const uint8* packet = &recv_buf[i * MAX_PACKET_SIZE];
+			const size_t packet_len = recv_msgs[i].msg_len;
+			const IPAddress sender_ip_addr(*(const sockaddr*)&recv_addrs[i]);
+			const int sender_port = getPortFromSockAddr(recv_addrs[i]);
+
+			if(processPacket(packet, packet_len, sender_ip_addr, sender_port, routing_table.ptr(), recipients))
+			{
+				for(size_t z=0; z<recipients.size(); ++z)
+				{
+					const VoiceRoutingTable::Client& client = routing_table->getClient(recipients[z]);
+
+					client.ip_addr.fillOutSockAddr(send_addrs[num_sends], client.UDP_port);
+					send_iovecs[num_sends].iov_base = (void*)packet;
+					send_iovecs[num_sends].iov_len = packet_len;
+					std::memset(&send_msgs[num_sends], 0, sizeof(mmsghdr));
+					send_msgs[num_sends].msg_hdr.msg_iov = &send_iovecs[num_sends];
+					send_msgs[num_sends].msg_hdr.msg_iovlen = 1;
+					send_msgs[num_sends].msg_hdr.msg_name = &send_addrs[num_sends];
+					send_msgs[num_sends].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+					num_sends++;
+
+					if(num_sends == SEND_BATCH_SIZE)
+					{
+						sendBatch(fd, send_msgs.data(), num_sends);
+						num_sends = 0;
+					}
+				}
+			}
+		}
+
+		// Send any remaining packets before the receive buffers are reused.
+		sendBatch(fd, send_msgs.data(), num_sends);
+		num_sends = 0;
+	}
+}
+
+
+void UDPHandlerThread::kill()
+{
+	should_quit = 1;
+
+	// Shutting down the socket wakes up the thread if it is blocked in recvmmsg.
+	Lock lock(socket_mutex);
+	if(socket_fd >= 0)
+		shutdown(socket_fd, SHUT_RDWR);
+}
+
+
+#endif
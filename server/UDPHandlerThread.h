@@ -9,34 +9,52 @@ Copyright Glare Technologies Limited 2023 -
 #include <MessageableThread.h>
 #include <UDPSocket.h>
 #include <IPAddress.h>
+#include <Mutex.h>
+#include <AtomicInt.h>
 #include <vector>
 class Server;
-
-
-struct ConnectedClientInfo
-{
-	IPAddress ip_addr;
-	int client_UDP_port;
-};
+class VoiceRoutingTable;
 
 
 /*=====================================================================
 UDPHandlerThread
 ----------------
-Handles UDP messages from clients, sends back to connected clients.
+Handles UDP messages from clients.
+
+Voice packets are relayed to the clients in the same world as the speaker,
+within the audible radius of the speaker avatar, as given by the server
+voice routing table.
+
+On Linux, packets are received and sent in batches with recvmmsg and sendmmsg,
+and multiple UDPHandlerThreads can share the UDP port with SO_REUSEPORT.
 =====================================================================*/
 class UDPHandlerThread : public MessageableThread
 {
 public:
-	UDPHandlerThread(Server* server);
+	UDPHandlerThread(Server* server, bool reuse_port);
 	~UDPHandlerThread();
 
 	void doRun() override;
 
 	virtual void kill() override;
 
+	static bool supportsMultipleThreads(); // Can multiple threads share the UDP port?
+
 private:
-	std::vector<ConnectedClientInfo> connected_clients;
+	// Handles a packet from a client.  If the packet is a voice packet that should be relayed, returns true and sets recipients_out.
+	bool processPacket(const uint8* packet, size_t packet_len, const IPAddress& sender_ip_addr, int sender_port, const VoiceRoutingTable* routing_table, std::vector<int>& recipients_out);
+
+#if defined(_WIN32) || defined(OSX)
+	void doRunUDPSocket();
 	Reference<UDPSocket> udp_socket;
+#else
+	void doRunBatched();
+	Mutex socket_mutex;
+	int socket_fd GUARDED_BY(socket_mutex);
+#endif
+
 	Server* server;
+	bool reuse_port;
+	uint64 num_packets_rcvd;
+	glare::AtomicInt should_quit;
 };
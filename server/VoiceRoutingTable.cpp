@@ -0,0 +1,217 @@
+/*=====================================================================
+VoiceRoutingTable.cpp
+---------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "VoiceRoutingTable.h"
+
+
+#include <algorithm>
+#include <cmath>
+
+
+VoiceRoutingTable::VoiceRoutingTable(double audible_radius_)
+:	audible_radius(audible_radius_)
+{}
+
+
+VoiceRoutingTable::~VoiceRoutingTable()
+{}
+
+
+void VoiceRoutingTable::addClient(const IPAddress& ip_addr, int UDP_port, const UID& avatar_uid, int world_index, const Vec3d& pos)
+{
+	if(!pos.isFinite())
+		return;
+
+	Client client;
+	client.ip_addr = ip_addr;
+	client.UDP_port = UDP_port;
+	client.avatar_id = (uint32)avatar_uid.value(); // Voice packets use the lower 32 bits of the avatar UID.
+	client.world_index = world_index;
+	client.pos = pos;
+	clients.push_back(client);
+}
+
+
+int VoiceRoutingTable::cellCoord(double x) const
+{
+	if(audible_radius <= 0)
+		return 0;
+
+	const double c = std::floor(x / audible_radius);
+	return (int)myClamp(c, -8388608.0, 8388607.0); // Clamp to 24 bits.
+}
+
+
+uint64 VoiceRoutingTable::cellKey(int world_index, int cell_x, int cell_y) const
+{
+	return ((uint64)world_index << 48) | ((uint64)((uint32)cell_x & 0xFFFFFFu) << 24) | (uint64)((uint32)cell_y & 0xFFFFFFu);
+}
+
+
+void VoiceRoutingTable::build()
+{
+	std::vector<std::pair<uint64, int>> keys(clients.size());
+	for(size_t i=0; i<clients.size(); ++i)
+		keys[i] = std::make_pair(cellKey(clients[i].world_index, cellCoord(clients[i].pos.x), cellCoord(clients[i].pos.y)), (int)i);
+
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<Client> sorted_clients(clients.size());
+	for(size_t i=0; i<keys.size(); ++i)
+		sorted_clients[i] = clients[keys[i].second];
+	clients.swap(sorted_clients);
+
+	cells.clear();
+	avatar_id_to_client_index.clear();
+	for(size_t i=0; i<keys.size(); ++i)
+	{
+		if(i == 0 || keys[i].first != keys[i - 1].first)
+			cells[keys[i].first] = CellRange({(int)i, (int)i + 1});
+		else
+			cells[keys[i].first].end = (int)i + 1;
+
+		avatar_id_to_client_index[clients[i].avatar_id] = (int)i;
+	}
+}
+
+
+bool VoiceRoutingTable::getRecipients(uint32 speaker_avatar_id, const IPAddress& sender_ip_addr, int sender_port, std::vector<int>& recipients_out) const
+{
+	recipients_out.clear();
+
+	auto res = avatar_id_to_client_index.find(speaker_avatar_id);
+	if(res == avatar_id_to_client_index.end())
+		return false;
+
+	const int speaker_index = res->second;
+	const Client& speaker = clients[speaker_index];
+	if(!(speaker.ip_addr == sender_ip_addr) || (speaker.UDP_port != sender_port))
+		return false;
+
+	const double r2 = audible_radius * audible_radius;
+	const int cx = cellCoord(speaker.pos.x);
+	const int cy = cellCoord(speaker.pos.y);
+	const int cell_r = (audible_radius <= 0) ? 0 : 1;
+
+	for(int y=cy - cell_r; y<=cy + cell_r; ++y)
+	for(int x=cx - cell_r; x<=cx + cell_r; ++x)
+	{
+		auto cell_res = cells.find(cellKey(speaker.world_index, x, y));
+		if(cell_res != cells.end())
+		{
+			for(int i=cell_res->second.begin; i<cell_res->second.end; ++i)
+				if((i != speaker_index) && ((audible_radius <= 0) || (clients[i].pos.getDist2(speaker.pos) <= r2)))
+					recipients_out.push_back(i);
+		}
+	}
+
+	return true;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <maths/PCG32.h>
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <limits>
+
+
+void VoiceRoutingTable::test()
+{
+	conPrint("VoiceRoutingTable::test()");
+
+	const IPAddress ip_a("1.2.3.4");
+	const IPAddress ip_b("5.6.7.8");
+
+	//------------------------ Basic tests ------------------------
+	{
+		VoiceRoutingTable table(/*audible radius=*/100.0);
+		table.addClient(ip_a, 1000, UID(1), /*world index=*/0, Vec3d(0, 0, 0));
+		table.addClient(ip_a, 1001, UID(2), /*world index=*/0, Vec3d(50, 0, 0)); // Near, same world
+		table.addClient(ip_b, 1000, UID(3), /*world index=*/0, Vec3d(150, 0, 0)); // Far, same world, adjacent cell to client 2
+		table.addClient(ip_b, 1001, UID(4), /*world index=*/1, Vec3d(1, 0, 0)); // Near, different world
+		table.addClient(ip_b, 1002, UID(5), /*world index=*/0, Vec3d(-99, 0, 0)); // Near, negative cell coord
+		table.addClient(ip_b, 1003, UID(6), /*world index=*/0, Vec3d(std::numeric_limits<double>::quiet_NaN(), 0, 0)); // Ignored
+		table.build();
+		testAssert(table.numClients() == 5);
+
+		std::vector<int> recipients;
+		testAssert(table.getRecipients(1, ip_a, 1000, recipients));
+		std::vector<uint32> ids;
+		for(size_t i=0; i<recipients.size(); ++i)
+			ids.push_back(table.getClient(recipients[i]).avatar_id);
+		std::sort(ids.begin(), ids.end());
+		testAssert(ids.size() == 2 && ids[0] == 2 && ids[1] == 5);
+
+		testAssert(table.getRecipients(2, ip_a, 1001, recipients));
+		ids.clear();
+		for(size_t i=0; i<recipients.size(); ++i)
+			ids.push_back(table.getClient(recipients[i]).avatar_id);
+		std::sort(ids.begin(), ids.end());
+		testAssert(ids.size() == 2 && ids[0] == 1 && ids[1] == 3);
+
+		testAssert(table.getRecipients(4, ip_b, 1001, recipients));
+		testAssert(recipients.empty());
+
+		// Sender address does not match the speaker avatar.
+		testAssert(!table.getRecipients(1, ip_b, 1000, recipients));
+		testAssert(!table.getRecipients(1, ip_a, 1001, recipients));
+
+		// Unknown speaker
+		testAssert(!table.getRecipients(6, ip_b, 1003, recipients));
+		testAssert(!table.getRecipients(100, ip_a, 1000, recipients));
+	}
+
+	// Test with no radius limit
+	{
+		VoiceRoutingTable table(/*audible radius=*/0.0);
+		table.addClient(ip_a, 1000, UID(1), /*world index=*/0, Vec3d(0, 0, 0));
+		table.addClient(ip_a, 1001, UID(2), /*world index=*/0, Vec3d(1.0e6, 0, 0));
+		table.addClient(ip_a, 1002, UID(3), /*world index=*/1, Vec3d(0, 0, 0));
+		table.build();
+
+		std::vector<int> recipients;
+		testAssert(table.getRecipients(1, ip_a, 1000, recipients));
+		testAssert(recipients.size() == 1 && table.getClient(recipients[0]).avatar_id == 2);
+	}
+
+	//------------------------ Measure number of packets sent with proximity routing vs broadcast to all clients ------------------------
+	{
+		const int NUM_CLIENTS = 1000;
+		const int NUM_WORLDS = 4;
+		const double WORLD_W = 2000.0;
+
+		PCG32 rng(1);
+		Timer build_timer;
+		VoiceRoutingTable table(/*audible radius=*/100.0);
+		for(int i=0; i<NUM_CLIENTS; ++i)
+			table.addClient(ip_a, 1000 + i, UID(i), /*world index=*/i % NUM_WORLDS, Vec3d((rng.unitRandom() - 0.5) * WORLD_W, (rng.unitRandom() - 0.5) * WORLD_W, 2.0));
+		table.build();
+		const double build_time = build_timer.elapsed();
+
+		Timer timer;
+		uint64 num_packets = 0;
+		std::vector<int> recipients;
+		for(int i=0; i<NUM_CLIENTS; ++i)
+		{
+			testAssert(table.getRecipients(i, ip_a, 1000 + i, recipients));
+			num_packets += recipients.size();
+		}
+		const double lookup_time = timer.elapsed();
+
+		conPrint(toString(NUM_CLIENTS) + " speakers: broadcast packets: " + toString((uint64)NUM_CLIENTS * NUM_CLIENTS) + ", proximity-routed packets: " + toString(num_packets));
+		conPrint("build time: " + doubleToStringNSigFigs(build_time * 1.0e3, 4) + " ms, getRecipients time: " + doubleToStringNSigFigs(lookup_time * 1.0e9 / NUM_CLIENTS, 4) + " ns per speaker");
+		testAssert(num_packets < (uint64)NUM_CLIENTS * NUM_CLIENTS / 10);
+	}
+
+	conPrint("VoiceRoutingTable::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,81 @@
+/*=====================================================================
+VoiceRoutingTable.h
+-------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/UID.h"
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <IPAddress.h>
+#include <maths/vec3.h>
+#include <unordered_map>
+#include <vector>
+
+
+/*=====================================================================
+VoiceRoutingTable
+-----------------
+Snapshot of the clients that can receive voice packets over UDP, with their
+world and avatar position.
+
+Built by the main server thread every main loop iteration, and then used
+read-only by the UDPHandlerThreads to decide which clients a voice packet
+from a speaker is relayed to: clients in the same world as the speaker,
+with avatars within audible_radius of the speaker avatar.
+
+Clients are bucketed into a uniform grid per world, with cell width
+audible_radius, so looking up the recipients for a speaker only needs to
+consider the 3x3 cells around the speaker.
+=====================================================================*/
+class VoiceRoutingTable : public ThreadSafeRefCounted
+{
+public:
+	// If audible_radius <= 0, voice is relayed to all clients in the same world.
+	VoiceRoutingTable(double audible_radius);
+	~VoiceRoutingTable();
+
+	struct Client
+	{
+		IPAddress ip_addr;
+		int UDP_port;
+		uint32 avatar_id;
+		int world_index; // Index of the world the client is connected to.
+		Vec3d pos; // Avatar position
+	};
+
+	// Add a client.  Clients with a non-finite avatar position are ignored.  Call build() after all clients have been added.
+	void addClient(const IPAddress& ip_addr, int UDP_port, const UID& avatar_uid, int world_index, const Vec3d& pos);
+
+	void build();
+
+	// Get the indices of the clients a voice packet from the speaker avatar should be sent to.  Doesn't include the speaker.
+	// Returns false if the speaker is not known, or if the sender address does not match the address registered for the speaker avatar
+	// (so clients can't send voice packets as other avatars).
+	bool getRecipients(uint32 speaker_avatar_id, const IPAddress& sender_ip_addr, int sender_port, std::vector<int>& recipients_out) const;
+
+	const Client& getClient(int i) const { return clients[i]; }
+	size_t numClients() const { return clients.size(); }
+
+	static void test();
+
+private:
+	uint64 cellKey(int world_index, int cell_x, int cell_y) const;
+	int cellCoord(double x) const;
+
+	double audible_radius;
+	std::vector<Client> clients; // Sorted by cell key after build().
+	std::unordered_map<uint32, int> avatar_id_to_client_index;
+
+	struct CellRange
+	{
+		int begin;
+		int end;
+	};
+	std::unordered_map<uint64, CellRange> cells; // Map from cell key to range of clients in that cell.
+};
+
+
+typedef Reference<VoiceRoutingTable> VoiceRoutingTableRef;
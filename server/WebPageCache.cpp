@@ -0,0 +1,318 @@
+/*=====================================================================
+WebPageCache.cpp
+----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "WebPageCache.h"
+
+
+#include <webserver/RequestInfo.h>
+#include <webserver/ResponseUtils.h>
+#include <utils/Exception.h>
+#include <utils/Lock.h>
+#include <zlib.h>
+#include <zstd.h>
+
+
+glare::AtomicInt WebPageCache::dependency_versions[WebPageCache::NUM_DEPENDENCIES];
+
+
+static const char* PAGE_CONTENT_TYPE = "text/html; charset=UTF-8";
+
+
+WebPageCache::WebPageCache(size_t max_cache_size_B_, double max_page_age_s_)
+:	max_cache_size_B(max_cache_size_B_),
+	max_page_age_s(max_page_age_s_),
+	cache_size_B(0),
+	hits(0),
+	misses(0)
+{}
+
+
+WebPageCache::~WebPageCache()
+{}
+
+
+void WebPageCache::invalidate(uint32 dependencies)
+{
+	for(int i=0; i<NUM_DEPENDENCIES; ++i)
+		if(dependencies & (1u << i))
+			dependency_versions[i].increment();
+}
+
+
+void WebPageCache::getDependencyVersions(DependencyVersions& versions_out)
+{
+	for(int i=0; i<NUM_DEPENDENCIES; ++i)
+		versions_out.versions[i] = dependency_versions[i];
+}
+
+
+bool WebPageCache::isCacheableRequest(const web::RequestInfo& request)
+{
+	// See LoginHandlers::getLoggedInUser().  We don't check the session is valid, since that requires the world state mutex.
+	for(size_t i=0; i<request.cookies.size(); ++i)
+		if(request.cookies[i].key == "site-b" && !request.cookies[i].value.empty())
+			return false;
+	return true;
+}
+
+
+bool WebPageCache::isPageValid(const CachedPage& page, double cur_time) const
+{
+	if(cur_time >= page.expiry_time)
+		return false;
+
+	for(int i=0; i<NUM_DEPENDENCIES; ++i)
+		if((page.dependencies & (1u << i)) && (page.dependency_versions.versions[i] != (glare::atomic_int)dependency_versions[i]))
+			return false;
+	return true;
+}
+
+
+Reference<WebPageCache::CachedPage> WebPageCache::getPage(const std::string& key)
+{
+	const double cur_time = timer.elapsed();
+
+	Lock lock(mutex);
+	auto res = cache.find(key);
+	if(res != cache.end())
+	{
+		if(isPageValid(*res->second.page, cur_time))
+		{
+			LRU_list.splice(LRU_list.begin(), LRU_list, res->second.LRU_it); // Move to front of LRU list
+			hits++;
+			return res->second.page;
+		}
+		else
+			removePage(res);
+	}
+
+	misses++;
+	return NULL;
+}
+
+
+bool WebPageCache::writeCachedPage(const std::string& key, const web::RequestInfo& request, web::ReplyInfo& reply_info)
+{
+	if(max_cache_size_B == 0 || max_page_age_s <= 0)
+		return false;
+
+	Reference<CachedPage> page = getPage(key);
+	if(page.isNull())
+		return false;
+
+	if(request.zstd_accept_encoding && !page->zstd_compressed_data.empty())
+		web::ResponseUtils::writeHTTPOKHeaderWithCacheControlAndContentEncoding(reply_info, page->zstd_compressed_data.data(), page->zstd_compressed_data.size(), PAGE_CONTENT_TYPE, "no-cache", "zstd");
+	else if(request.deflate_accept_encoding && !page->deflate_compressed_data.empty())
+		web::ResponseUtils::writeHTTPOKHeaderWithCacheControlAndContentEncoding(reply_info, page->deflate_compressed_data.data(), page->deflate_compressed_data.size(), PAGE_CONTENT_TYPE, "no-cache", "deflate");
+	else
+		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, page->uncompressed_data);
+	return true;
+}
+
+
+static void compressPage(WebPageCache::CachedPage& page)
+{
+	// Do deflate compression.  Use the default compression levels, as this is done while handling the request.
+	{
+		const uLong bound = compressBound((uLong)page.uncompressed_data.size());
+		page.deflate_compressed_data.resizeNoCopy(bound);
+		uLong dest_len = bound;
+
+		const int result = ::compress2(page.deflate_compressed_data.data(), &dest_len, (const Bytef*)page.uncompressed_data.data(), (uLong)page.uncompressed_data.size(), Z_DEFAULT_COMPRESSION);
+		if(result != Z_OK)
+			throw glare::Exception("Compression failed.");
+
+		page.deflate_compressed_data.resize(dest_len);
+	}
+
+	// Do zstd compression
+	{
+		page.zstd_compressed_data.resizeNoCopy(ZSTD_compressBound(page.uncompressed_data.size()));
+
+		const size_t compressed_size = ZSTD_compress(
+			/*dest=*/page.zstd_compressed_data.data(), /*dest capacity=*/page.zstd_compressed_data.size(),
+			/*src=*/page.uncompressed_data.data(), /*src size=*/page.uncompressed_data.size(),
+			ZSTD_CLEVEL_DEFAULT
+		);
+		if(ZSTD_isError(compressed_size))
+			throw glare::Exception(std::string("Compression failed: ") + ZSTD_getErrorName(compressed_size));
+
+		page.zstd_compressed_data.resize(compressed_size);
+	}
+}
+
+
+void WebPageCache::addPage(const std::string& key, const std::string& page_data, uint32 dependencies, const DependencyVersions& versions_before_render)
+{
+	if(max_cache_size_B == 0 || max_page_age_s <= 0)
+		return;
+
+	Reference<CachedPage> page = new CachedPage();
+	page->uncompressed_data = page_data;
+	page->dependencies = dependencies | Dependency_WebData;
+	page->dependency_versions = versions_before_render;
+	page->expiry_time = timer.elapsed() + max_page_age_s;
+
+	try
+	{
+		compressPage(*page);
+	}
+	catch(glare::Exception&)
+	{
+		// Just serve the uncompressed page.
+		page->deflate_compressed_data.resize(0);
+		page->zstd_compressed_data.resize(0);
+	}
+
+	const size_t page_size_B = key.size() + page->uncompressed_data.size() + page->deflate_compressed_data.size() + page->zstd_compressed_data.size();
+	if(page_size_B > max_cache_size_B)
+		return;
+
+	Lock lock(mutex);
+
+	auto res = cache.find(key);
+	if(res != cache.end())
+		removePage(res);
+
+	LRU_list.push_front(key);
+	CacheItem item;
+	item.page = page;
+	item.size_B = page_size_B;
+	item.LRU_it = LRU_list.begin();
+	cache.insert(std::make_pair(key, item));
+	cache_size_B += page_size_B;
+
+	evictPagesIfNeeded();
+}
+
+
+void WebPageCache::removePage(CacheMapType::iterator it)
+{
+	cache_size_B -= it->second.size_B;
+	LRU_list.erase(it->second.LRU_it);
+	cache.erase(it);
+}
+
+
+void WebPageCache::evictPagesIfNeeded()
+{
+	while((cache_size_B > max_cache_size_B) && !LRU_list.empty())
+	{
+		auto res = cache.find(LRU_list.back());
+		assert(res != cache.end());
+		removePage(res);
+	}
+}
+
+
+void WebPageCache::clear()
+{
+	Lock lock(mutex);
+	cache.clear();
+	LRU_list.clear();
+	cache_size_B = 0;
+}
+
+
+WebPageCache::Stats WebPageCache::getStats()
+{
+	Lock lock(mutex);
+	Stats stats;
+	stats.hits = hits;
+	stats.misses = misses;
+	stats.num_pages = cache.size();
+	stats.cache_size_B = cache_size_B;
+	return stats;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/PlatformUtils.h>
+#include <utils/StringUtils.h>
+
+
+void WebPageCache::test()
+{
+	conPrint("WebPageCache::test()");
+
+	{
+		WebPageCache cache(/*max cache size=*/1000000, /*max page age=*/1000.0);
+
+		testAssert(cache.getPage("/").isNull());
+		testAssert(cache.getStats().misses == 1);
+
+		DependencyVersions versions;
+		getDependencyVersions(versions);
+		const std::string root_page(1000, 'a');
+		cache.addPage("/", root_page, Dependency_Parcels, versions);
+		cache.addPage("/news", "news", Dependency_NewsPosts, versions);
+		testAssert(cache.getStats().num_pages == 2);
+
+		Reference<CachedPage> page = cache.getPage("/");
+		testAssert(page.nonNull() && page->uncompressed_data == root_page);
+		testAssert(!page->deflate_compressed_data.empty() && page->deflate_compressed_data.size() < root_page.size());
+		testAssert(!page->zstd_compressed_data.empty() && page->zstd_compressed_data.size() < root_page.size());
+		testAssert(cache.getStats().hits == 1);
+
+		// Changing news posts should invalidate the news page but not the root page.
+		invalidate(Dependency_NewsPosts);
+		testAssert(cache.getPage("/news").isNull());
+		testAssert(cache.getPage("/").nonNull());
+		testAssert(cache.getStats().num_pages == 1); // Stale page should have been removed.
+
+		// Changing parcels should invalidate the root page.
+		invalidate(Dependency_Parcels | Dependency_Users);
+		testAssert(cache.getPage("/").isNull());
+
+		// A change made while the page was being rendered should make the page stale.
+		getDependencyVersions(versions);
+		invalidate(Dependency_Parcels);
+		cache.addPage("/", root_page, Dependency_Parcels, versions);
+		testAssert(cache.getPage("/").isNull());
+
+		// All pages depend on web data
+		getDependencyVersions(versions);
+		cache.addPage("/", root_page, Dependency_Parcels, versions);
+		testAssert(cache.getPage("/").nonNull());
+		invalidate(Dependency_WebData);
+		testAssert(cache.getPage("/").isNull());
+	}
+
+	// Test expiry
+	{
+		WebPageCache cache(/*max cache size=*/1000000, /*max page age=*/0.01);
+		DependencyVersions versions;
+		getDependencyVersions(versions);
+		cache.addPage("/", "page", Dependency_Parcels, versions);
+		testAssert(cache.getPage("/").nonNull());
+		PlatformUtils::Sleep(20);
+		testAssert(cache.getPage("/").isNull());
+	}
+
+	// Test eviction
+	{
+		WebPageCache cache(/*max cache size=*/5000, /*max page age=*/1000.0);
+		DependencyVersions versions;
+		getDependencyVersions(versions);
+		for(int i=0; i<100; ++i)
+			cache.addPage("/parcel/" + toString(i), "parcel " + toString(i), Dependency_Parcels, versions);
+		testAssert(cache.getStats().cache_size_B <= 5000);
+		testAssert(cache.getStats().num_pages < 100);
+		testAssert(cache.getPage("/parcel/99").nonNull()); // Most recently added page should still be cached.
+		testAssert(cache.getPage("/parcel/0").isNull());
+
+		cache.clear();
+		testAssert(cache.getStats().num_pages == 0 && cache.getStats().cache_size_B == 0);
+	}
+
+	conPrint("WebPageCache::test() done.");
+}
+
+
+#endif // BUILD_TESTS
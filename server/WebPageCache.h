@@ -0,0 +1,139 @@
+/*=====================================================================
+WebPageCache.h
+--------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/Reference.h>
+#include <utils/Mutex.h>
+#include <utils/AtomicInt.h>
+#include <utils/Vector.h>
+#include <utils/Timer.h>
+#include <utils/Platform.h>
+#include <list>
+#include <string>
+#include <unordered_map>
+namespace web
+{
+class RequestInfo;
+class ReplyInfo;
+}
+
+
+/*=====================================================================
+WebPageCache
+------------
+Caches rendered HTML pages for the web tier (root page, parcel pages, map page etc.),
+so that repeated views by users who are not logged in are served without taking
+the world state mutex or rebuilding the page.
+
+Only pages rendered for requests without a session cookie are cached, since pages
+for logged-in users contain user-specific content.  Pages are keyed by URL path.
+
+Each page records which kinds of data it was built from, as a set of Dependency
+flags, along with the version of each dependency from just before the page was
+rendered.  The versions are incremented by invalidate(), which is called when
+objects are added to the DB dirty sets (addParcelAsDBDirty() etc.), so a page is
+stale as soon as any data it depends on changes.  Pages also expire after a maximum
+age, for content that changes over time, such as running auctions.
+
+zstd and deflate compressed versions of each page are stored, and the best encoding
+that the client accepts is sent.
+
+Threadsafe.
+=====================================================================*/
+class WebPageCache : public ThreadSafeRefCounted
+{
+public:
+	WebPageCache(size_t max_cache_size_B, double max_page_age_s); // max_cache_size_B or max_page_age_s = 0 disables the cache.
+	~WebPageCache();
+
+	enum Dependency
+	{
+		Dependency_Parcels				= 1 << 0,
+		Dependency_ParcelAuctions		= 1 << 1,
+		Dependency_Screenshots			= 1 << 2,
+		Dependency_Users				= 1 << 3,
+		Dependency_NewsPosts			= 1 << 4,
+		Dependency_SubEthTransactions	= 1 << 5,
+		Dependency_WebData				= 1 << 6 // Fragment files, main.css hash etc. from WebDataStore.  All pages depend on this.
+	};
+	static const int NUM_DEPENDENCIES = 7;
+
+	// Makes cached pages that depend on any of the given dependencies stale.  Doesn't lock anything.
+	static void invalidate(uint32 dependencies);
+
+	struct DependencyVersions
+	{
+		glare::atomic_int versions[NUM_DEPENDENCIES];
+	};
+	// Call before rendering a page, and pass the versions to addPage(), so that any changes made while rendering make the page stale.
+	static void getDependencyVersions(DependencyVersions& versions_out);
+
+	// Returns true if the request has no session cookie, in which case the page can be served from (and added to) the cache.
+	static bool isCacheableRequest(const web::RequestInfo& request);
+
+	class CachedPage : public ThreadSafeRefCounted
+	{
+	public:
+		std::string uncompressed_data;
+		js::Vector<uint8, 16> deflate_compressed_data;
+		js::Vector<uint8, 16> zstd_compressed_data;
+		uint32 dependencies;
+		DependencyVersions dependency_versions;
+		double expiry_time;
+	};
+
+	// Returns NULL if there is no page for key, or if the page is stale.
+	Reference<CachedPage> getPage(const std::string& key);
+
+	// If there is a valid cached page for key, writes it to the reply and returns true.  Otherwise returns false.
+	bool writeCachedPage(const std::string& key, const web::RequestInfo& request, web::ReplyInfo& reply_info);
+
+	// Compresses the page and adds it to the cache.  Replaces any existing page for key.
+	void addPage(const std::string& key, const std::string& page, uint32 dependencies, const DependencyVersions& versions_before_render);
+
+	void clear();
+
+	struct Stats
+	{
+		uint64 hits;
+		uint64 misses;
+		uint64 num_pages;
+		uint64 cache_size_B;
+	};
+	Stats getStats();
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(WebPageCache);
+
+	struct CacheItem
+	{
+		Reference<CachedPage> page;
+		size_t size_B;
+		std::list<std::string>::iterator LRU_it;
+	};
+	typedef std::unordered_map<std::string, CacheItem> CacheMapType;
+
+	bool isPageValid(const CachedPage& page, double cur_time) const;
+	void removePage(CacheMapType::iterator it) REQUIRES(mutex);
+	void evictPagesIfNeeded() REQUIRES(mutex);
+
+	static glare::AtomicInt dependency_versions[NUM_DEPENDENCIES];
+
+	const size_t max_cache_size_B;
+	const double max_page_age_s;
+	Timer timer; // For page expiry
+
+	Mutex mutex;
+	CacheMapType cache GUARDED_BY(mutex);
+	std::list<std::string> LRU_list GUARDED_BY(mutex); // Most recently used at front.
+	size_t cache_size_B GUARDED_BY(mutex);
+	uint64 hits GUARDED_BY(mutex);
+	uint64 misses GUARDED_BY(mutex);
+};
@@ -11,6 +11,8 @@ Copyright Glare Technologies Limited 2018 -
 #include "Screenshot.h"
 #include "SubEthTransaction.h"
 #include "MeshLODGenThread.h"
+#include "EpollReactor.h"
+#include "ResourceDownloadScheduler.h"
 #include "../webserver/LoginHandlers.h"
 #include "../shared/Protocol.h"
 #include "../shared/ProtocolStructs.h"
@@ -37,12 +39,12 @@ Copyright Glare Technologies Limited 2018 -
 #include <KillThreadMessage.h>
 #include <Parser.h>
 #include <FileUtils.h>
-#include <MemMappedFile.h>
 #include <FileOutStream.h>
 #include <networking/RecordingSocket.h>
 #include <maths/CheckedMaths.h>
 #include <openssl/err.h>
 #include <algorithm>
+#include <limits>
 #include <RuntimeCheck.h>
 #include <Timer.h>
 
@@ -53,8 +55,17 @@ static const bool CAPTURE_TRACES = false; // If true, records a trace of data re
 
 
 WorkerThread::WorkerThread(const Reference<SocketInterface>& socket_, Server* server_)
-:	socket(socket_),
+:	handled_by_reactor(0),
+	socket(socket_),
 	server(server_),
+	reactor_io_thread(NULL),
+	reactor_send_notified(false),
+	tls_context(NULL),
+	client_avatar_uid(0),
+	client_user_id(UserID::invalidUserID()),
+	client_user_flags(0),
+	logged_in_user_is_lightmapper_bot(false),
+	client_protocol_version(0),
 	scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder),
 	fuzzing(false),
 	write_trace(false)
@@ -105,31 +116,12 @@ void WorkerThread::sendGetFileMessageIfNeeded(const std::string& resource_URL)
 }
 
 
-static void writeErrorMessageToClient(SocketInterfaceRef& socket, const std::string& msg)
-{
-	SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-	MessageUtils::initPacket(packet, Protocol::ErrorMessageID);
-	packet.writeStringLengthFirst(msg);
-	MessageUtils::updatePacketLengthField(packet);
-
-	socket->writeData(packet.buf.data(), packet.buf.size());
-	socket->flush();
-}
-
-
-// Enqueues packet to all WorkerThreads to send to all clients connected to the server.
+// Enqueues packet to all WorkerThreads (and connections handled by the epoll reactor) to send to all clients connected to the server.
 static void enqueuePacketToBroadcast(const SocketBufferOutStream& packet_buffer, Server* server)
 {
 	assert(packet_buffer.buf.size() > 0);
 	if(packet_buffer.buf.size() > 0)
-	{
-		Lock lock(server->worker_thread_manager.getMutex());
-		for(auto i = server->worker_thread_manager.getThreads().begin(); i != server->worker_thread_manager.getThreads().end(); ++i)
-		{
-			assert(dynamic_cast<WorkerThread*>(i->getPointer()));
-			static_cast<WorkerThread*>(i->getPointer())->enqueueDataToSend(packet_buffer);
-		}
-	}
+		server->forEachClientConnection([&](WorkerThread* worker) { worker->enqueueDataToSend(packet_buffer); });
 }
 
 
@@ -277,6 +269,8 @@ void WorkerThread::handleResourceUploadConnection()
 		resource->owner_id = client_user_id;
 		resource->setState(Resource::State_Present);
 
+		server->world_state->resource_send_cache->invalidateResource(local_path); // In case the file was uploaded before and is cached.
+
 		{
 			Lock lock(server->world_state->mutex);
 			server->world_state->addResourcesAsDBDirty(resource);
@@ -298,23 +292,7 @@ void WorkerThread::handleResourceUploadConnection()
 			{
 				WorldStateLock lock(server->world_state->mutex);
 				for(auto world_it = server->world_state->world_states.begin(); world_it != server->world_state->world_states.end(); ++world_it)
-				{
-					ServerWorldState* world = world_it->second.ptr();
-
-					std::set<DependencyURL> URLs;
-					const ServerWorldState::ObjectMapType& objects = world->getObjects(lock);
-					for(auto it = objects.begin(); it != objects.end(); ++it)
-					{
-						const WorldObject* ob = it->second.ptr();
-						URLs.clear();
-						ob->getDependencyURLSetForAllLODLevels(URLs);
-
-						if(URLs.count(DependencyURL(URL)) > 0) // If the object uses the resource with this URL:
-						{
-							ob_uids.push_back(ob->uid);
-						}
-					}
-				}
+					world_it->second->getResourceURLObjectIndex(lock).getObjectsUsingURL(URL, ob_uids);
 			}
 
 			for(size_t i=0; i<ob_uids.size(); ++i)
@@ -391,16 +369,13 @@ void WorkerThread::handleResourceDownloadConnection()
 
 							// conPrint("\tlocal path: '" + local_path + "'");
 
+							// Get resource from the cache, or open it for sending.
+							ResourceSendCache::OpenResource open_resource;
+							bool opened = false;
 							try
 							{
-								// Load resource off disk
-								MemMappedFile file(local_path);
-								// conPrint("\tSending file to client.");
-								socket->writeUInt32(0); // write OK msg to client
-								socket->writeUInt64(file.fileSize()); // Write file size
-								socket->writeData(file.fileData(), file.fileSize()); // Write file data
-
-								conPrintIfNotFuzzing("\tSent file '" + local_path + "' to client. (" + toString(file.fileSize()) + " B)");
+								server->world_state->resource_send_cache->openResource(local_path, open_resource);
+								opened = true;
 							}
 							catch(glare::Exception& e)
 							{
@@ -408,6 +383,19 @@ void WorkerThread::handleResourceDownloadConnection()
 
 								socket->writeUInt32(1); // write error msg to client
 							}
+
+							if(opened)
+							{
+								// conPrint("\tSending file to client.");
+								socket->writeUInt32(0); // write OK msg to client
+								socket->writeUInt64(open_resource.size); // Write file size
+
+								// Write file data.  Uses sendfile() if this is a plain TCP connection.
+								// Any error after this point leaves the stream in an unknown state, so the exception is not caught here and the connection is closed.
+								server->world_state->resource_send_cache->sendResourceData(open_resource, /*offset=*/0, open_resource.size, *socket);
+
+								conPrintIfNotFuzzing("\tSent file '" + local_path + "' to client. (" + toString(open_resource.size) + " B)");
+							}
 						}
 					}
 				}
@@ -443,6 +431,128 @@ void WorkerThread::handleResourceDownloadConnection()
 }
 
 
+// Resource requests are queued in a ResourceDownloadScheduler, and resources are sent in chunks, interleaved by priority.
+// The client may update priorities or cancel requests while resources are being sent, so between each chunk we handle any messages from the client.
+void WorkerThread::handleMultiplexedResourceDownloadConnection()
+{
+	conPrintIfNotFuzzing("handleMultiplexedResourceDownloadConnection()");
+
+	const size_t MAX_NUM_REQUESTS = 1024; // Limit on number of requests in flight per connection.
+
+	try
+	{
+		ResourceDownloadScheduler scheduler;
+		SocketBufferOutStream header_buf(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+		while(!should_quit)
+		{
+			// Handle any messages from the client.  If there is nothing to send, block (with a timeout so we can check should_quit) until there is a message.
+			while(socket->readable(/*timeout (s)=*/(scheduler.numRequests() == 0) ? 0.1 : 0.0))
+			{
+				const uint32 msg_type = socket->readUInt32();
+				if(msg_type == Protocol::RequestResource)
+				{
+					const uint32 request_id = socket->readUInt32();
+					const std::string URL = socket->readStringLengthFirst(MAX_STRING_LEN);
+					const uint64 start_offset = socket->readUInt64();
+					const float priority = socket->readFloat();
+
+					Reference<ResourceDownloadScheduler::Request> request = new ResourceDownloadScheduler::Request();
+					request->request_id = request_id;
+					request->priority = isFinite(priority) ? priority : std::numeric_limits<float>::max();
+					request->next_offset = 0;
+
+					bool opened = false;
+					if(ResourceManager::isValidURL(URL) && (scheduler.numRequests() < MAX_NUM_REQUESTS))
+					{
+						const ResourceRef resource = server->world_state->resource_manager->getExistingResourceForURL(URL);
+						if(resource.nonNull() && (resource->getState() == Resource::State_Present))
+						{
+							try
+							{
+								server->world_state->resource_send_cache->openResource(server->world_state->resource_manager->getLocalAbsPathForResource(*resource), request->resource);
+								opened = true;
+							}
+							catch(glare::Exception& e)
+							{
+								conPrintIfNotFuzzing("\tException while trying to load file for URL: " + e.what());
+							}
+						}
+					}
+
+					if(opened && (start_offset <= request->resource.size))
+						request->next_offset = start_offset; // Resume partial download.
+
+					header_buf.buf.clear();
+					header_buf.writeUInt32(Protocol::ResourceHeader);
+					header_buf.writeUInt32(request_id);
+					header_buf.writeUInt32(opened ? 0 : 1); // Result
+					header_buf.writeUInt64(opened ? request->resource.size : 0);
+					header_buf.writeUInt64(request->next_offset);
+					socket->writeData(header_buf.buf.data(), header_buf.buf.size());
+
+					if(opened && (request->next_offset < request->resource.size))
+						scheduler.addRequest(request);
+				}
+				else if(msg_type == Protocol::UpdateResourcePriority)
+				{
+					const uint32 request_id = socket->readUInt32();
+					const float priority = socket->readFloat();
+					scheduler.updatePriority(request_id, isFinite(priority) ? priority : std::numeric_limits<float>::max()); // Request may have completed already, so ignore unknown ids.
+				}
+				else if(msg_type == Protocol::CancelResourceRequest)
+				{
+					const uint32 request_id = socket->readUInt32();
+					scheduler.cancelRequest(request_id);
+				}
+				else if(msg_type == Protocol::CyberspaceGoodbye)
+				{
+					socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
+					socket->waitForGracefulDisconnect(); // Wait for a FIN packet from the client.
+					return;
+				}
+				else
+				{
+					conPrintIfNotFuzzing("handleMultiplexedResourceDownloadConnection(): Unhandled msg type: " + toString(msg_type));
+					return;
+				}
+			}
+
+			// Send the next chunk
+			uint64 chunk_size;
+			ResourceDownloadScheduler::Request* request = scheduler.getNextChunk(chunk_size);
+			if(request)
+			{
+				header_buf.buf.clear();
+				header_buf.writeUInt32(Protocol::ResourceChunk);
+				header_buf.writeUInt32(request->request_id);
+				header_buf.writeUInt32((uint32)chunk_size);
+				socket->writeData(header_buf.buf.data(), header_buf.buf.size());
+
+				server->world_state->resource_send_cache->sendResourceData(request->resource, /*offset=*/request->next_offset, /*len=*/chunk_size, *socket);
+
+				scheduler.chunkSent(request, chunk_size);
+			}
+		}
+	}
+	catch(MySocketExcep& e)
+	{
+		if(e.excepType() == MySocketExcep::ExcepType_ConnectionClosedGracefully)
+			conPrint("Resource download client from " + IPAddress::formatIPAddressAndPort(socket->getOtherEndIPAddress(), socket->getOtherEndPort()) + " closed connection gracefully.");
+		else
+			conPrint("Socket error: " + e.what());
+	}
+	catch(glare::Exception& e)
+	{
+		conPrintIfNotFuzzing("glare::Exception: " + e.what());
+	}
+	catch(std::bad_alloc&)
+	{
+		conPrint("WorkerThread: Caught std::bad_alloc.");
+	}
+}
+
+
 void WorkerThread::handleScreenshotBotConnection()
 {
 	conPrintIfNotFuzzing("handleScreenshotBotConnection()");
@@ -729,13 +839,12 @@ static bool objectIsInParcelForWhichLoggedInUserHasWritePerms(const WorldObject&
 
 	const Vec4f ob_pos = ob.pos.toVec4fPoint();
 
-	ServerWorldState::ParcelMapType& parcels = world_state.getParcels(lock);
-	for(ServerWorldState::ParcelMapType::iterator it = parcels.begin(); it != parcels.end(); ++it)
-	{
-		const Parcel* parcel = it->second.ptr();
-		if(parcel->pointInParcel(ob_pos) && parcel->userHasWritePerms(user_id))
+	// Use the parcel index to just check parcels whose bounds contain the object position, instead of every parcel in the world.
+	std::vector<Parcel*> parcels;
+	world_state.getParcelIndex(lock).getParcelsContainingPoint(ob_pos, parcels);
+	for(size_t i=0; i<parcels.size(); ++i)
+		if(parcels[i]->userHasWritePerms(user_id))
 			return true;
-	}
 
 	return false;
 }
@@ -780,1944 +889,1957 @@ static bool userHasParcelWritePermissions(const Parcel& parcel, const UserID& us
 }
 
 
-static float maxAudioVolumeForObject(const WorldObject& ob, const UserID& user_id, const std::string& user_name, const std::string& connected_world_name)
+// Append an ObjectInitialSend message for the object to packet.
+// The serialised message is cached on the object, so it only needs to be rebuilt after the object has changed.
+static void writeObjectInitialSendMessage(WorldObject* ob, SocketBufferOutStream& packet, SocketBufferOutStream& scratch_packet, ServerAllWorldsState& world_state, WorldStateLock& /*lock*/)
 {
-	return userConnectedToTheirPersonalWorldOrGodUser(user_id, user_name, connected_world_name) ? 1000.f : 4.f;
+	if(ob->cached_initial_send_msg.empty())
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
+		ob->writeToNetworkStream(scratch_packet);
+		MessageUtils::updatePacketLengthField(scratch_packet);
+
+		ob->cached_initial_send_msg.resize(scratch_packet.buf.size());
+		std::memcpy(ob->cached_initial_send_msg.data(), scratch_packet.buf.data(), scratch_packet.buf.size());
+
+		world_state.num_object_initial_send_cache_misses++;
+	}
+	else
+		world_state.num_object_initial_send_cache_hits++;
+
+	packet.writeData(ob->cached_initial_send_msg.data(), ob->cached_initial_send_msg.size());
 }
 
 
-void WorkerThread::doRun()
+static float maxAudioVolumeForObject(const WorldObject& ob, const UserID& user_id, const std::string& user_name, const std::string& connected_world_name)
 {
-	PlatformUtils::setCurrentThreadNameIfTestsEnabled("WorkerThread");
-
+	return userConnectedToTheirPersonalWorldOrGodUser(user_id, user_name, connected_world_name) ? 1000.f : 4.f;
+}
 
-	if(CAPTURE_TRACES)
-		socket.downcastToPtr<RecordingSocket>()->clearRecordBuf();
 
+// Handles a message received from the client on an updates connection.
+// The entire message, including the type and length fields, has been read into msg_buffer, and msg_buffer.read_index is just past the type and length fields.
+// Called from doRun(), or from an EpollReactorIOThread if the connection is handled by the epoll reactor.
+void WorkerThread::handleUpdatesMessage(uint32 msg_type)
+{
 	ServerAllWorldsState* world_state = server->world_state.getPointer();
 
-	UID client_avatar_uid(0);
-	UserID client_user_id = UserID::invalidUserID(); // Will be an invalid reference if client is not logged in, otherwise will refer to the user account the client is logged in to.
-	std::string client_user_name;
-	AvatarSettings client_user_avatar_settings;
-	uint32 client_user_flags = 0;
+	switch(msg_type)
+	{
+	case Protocol::CyberspaceGoodbye:
+		{
+			if(handled_by_reactor)
+			{
+				// The reactor will close the connection after sending any pending data.
+				conPrintIfNotFuzzing("WorkerThread: received CyberspaceGoodbye, closing connection..");
+			}
+			else
+			{
+				conPrintIfNotFuzzing("WorkerThread: received CyberspaceGoodbye, starting graceful shutdown..");
+				socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
+				socket->waitForGracefulDisconnect(); // Wait for a FIN packet from the client. (indicated by recv() returning 0).  We can then close the socket without going into a wait state.
+				conPrintIfNotFuzzing("WorkerThread: waitForGracefulDisconnect done.");
+			}
+			should_quit = 1;
+			break;
+		}
+	case Protocol::ClientUDPSocketOpen:
+		{
+			conPrint("WorkerThread: received Protocol::ClientUDPSocketOpen");
+			//const uint32 client_UDP_port = msg_buffer.readUInt32();
+			server->clientUDPPortOpen(this, socket->getOtherEndIPAddress(), client_avatar_uid, connected_world_name);
+			break;
+		}
+	case Protocol::AudioStreamToServerStarted:
+		{
+			const uint32 sampling_rate = msg_buffer.readUInt32();
+			const uint32 flags         = msg_buffer.readUInt32();
+			const uint32 stream_id     = msg_buffer.readUInt32();
 
-	Reference<ServerWorldState> cur_world_state; // World the client is connected to.
-	bool logged_in_user_is_lightmapper_bot = false; // Just for updating the last_lightmapper_bot_contact_time.
+			if(!BitUtils::isBitSet(flags, 0x1u)) // If renew flag is not set:
+				conPrint("WorkerThread: received Protocol::AudioStreamToServerStarted without renew flag");
 
-	try
-	{
-		// Read hello bytes
-		const uint32 hello = socket->readUInt32();
-		if(hello != Protocol::CyberspaceHello)
-			throw glare::Exception("Received invalid hello message (" + toString(hello) + ") from client.");
-		
-		// Write hello response
-		socket->writeUInt32(Protocol::CyberspaceHello);
+			// Send message to all clients
+			{
+				MessageUtils::initPacket(scratch_packet, Protocol::AudioStreamToServerStarted);
+				writeToStream(client_avatar_uid, scratch_packet); // Send client avatar UID as well.
+				scratch_packet.writeUInt32(sampling_rate);
+				scratch_packet.writeUInt32(flags);
+				scratch_packet.writeUInt32(stream_id);
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-		// Read protocol version
-		const uint32 client_protocol_version = socket->readUInt32();
-		conPrintIfNotFuzzing("client protocol version: " + toString(client_protocol_version));
-		if(client_protocol_version < 38) // We can't handle protocol versions < 38
-		{
-			socket->writeUInt32(Protocol::ClientProtocolTooOld);
-			socket->writeStringLengthFirst("Sorry, your Substrata client is too old. Please download and install an updated client from https://substrata.info/.");
+				enqueuePacketToBroadcast(scratch_packet, server);
+			}
 
-			//socket->writeStringLengthFirst("Sorry, your client protocol version (" + toString(client_protocol_version) + ") is too old, require version " + 
-			//	toString(Protocol::CyberspaceProtocolVersion) + ".  Please install an updated client from https://substrata.info/.");
+			break;
 		}
-		else
+	case Protocol::AudioStreamToServerEnded:
 		{
-			// For versions newer than our current version, consider them OK.  We will send back our current version below, which will then be used by the client.
+			conPrint("WorkerThread: received Protocol::AudioStreamToServerEnded");
 
-			socket->writeUInt32(Protocol::ClientProtocolOK);
-		}
+			// Send message to all clients
+			{
+				MessageUtils::initPacket(scratch_packet, Protocol::AudioStreamToServerEnded);
+				writeToStream(client_avatar_uid, scratch_packet); // Send client avatar UID as well.
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-		socket->writeUInt32(Protocol::CyberspaceProtocolVersion);
+				enqueuePacketToBroadcast(scratch_packet, server);
+			}
 
-		const uint32 connection_type = socket->readUInt32();
-	
-		if(connection_type == Protocol::ConnectionTypeUploadResource)
-		{
-			handleResourceUploadConnection();
+			break;
 		}
-		else if(connection_type == Protocol::ConnectionTypeDownloadResources)
+	case Protocol::AvatarTransformUpdate:
 		{
-			handleResourceDownloadConnection();
+			//conPrint("AvatarTransformUpdate");
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
+			const Vec3d pos = readVec3FromStream<double>(msg_buffer);
+			const Vec3f rotation = readVec3FromStream<float>(msg_buffer);
+			const uint32 anim_state = msg_buffer.readUInt32();
+
+			// Look up existing avatar in world state
+			{
+				WorldStateLock lock(world_state->mutex);
+				const ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
+				auto res = avatars.find(avatar_uid);
+				if(res != avatars.end())
+				{
+					Avatar* avatar = res->second.getPointer();
+					avatar->pos = pos;
+					avatar->rotation = rotation;
+					avatar->anim_state = anim_state;
+					avatar->transform_dirty = true;
+
+					//conPrint("updated avatar transform");
+				}
+			}
+			break;
 		}
-		else if(connection_type == Protocol::ConnectionTypeScreenshotBot)
+	case Protocol::AvatarPerformGesture:
 		{
-			handleScreenshotBotConnection();
+			//conPrint("AvatarPerformGesture");
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
+			const std::string gesture_name = msg_buffer.readStringLengthFirst(10000);
+
+			//conPrint("Received AvatarPerformGesture: '" + gesture_name + "'");
+
+			//if(!client_user_id.valid())
+			//{
+			//	writeErrorMessageToClient("You must be logged in to perform a gesture.");
+			//}
+			//else
+			//{
+				// Enqueue AvatarPerformGesture messages to worker threads to send
+				MessageUtils::initPacket(scratch_packet, Protocol::AvatarPerformGesture);
+				writeToStream(avatar_uid, scratch_packet);
+				scratch_packet.writeStringLengthFirst(gesture_name);
+				MessageUtils::updatePacketLengthField(scratch_packet);
+
+				enqueuePacketToBroadcast(scratch_packet, server);
+			//}
+			break;
 		}
-		else if(connection_type == Protocol::ConnectionTypeEthBot)
+	case Protocol::AvatarStopGesture:
 		{
-			handleEthBotConnection();
+			//conPrint("AvatarStopGesture");
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
+
+			//if(!client_user_id.valid())
+			//{
+			//	writeErrorMessageToClient("You must be logged in to stop a gesture.");
+			//}
+			//else
+			//{
+				// Enqueue AvatarStopGesture messages to worker threads to send
+				MessageUtils::initPacket(scratch_packet, Protocol::AvatarStopGesture);
+				writeToStream(avatar_uid, scratch_packet);
+				MessageUtils::updatePacketLengthField(scratch_packet);
+
+				enqueuePacketToBroadcast(scratch_packet, server);
+			//}
+			break;
 		}
-		else if(connection_type == Protocol::ConnectionTypeUpdates)
+	case Protocol::AvatarFullUpdate:
 		{
-			if(CAPTURE_TRACES)
-				this->write_trace = true;
+			conPrintIfNotFuzzing("Protocol::AvatarFullUpdate");
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
 
-			// Read name of world to connect to
-			const std::string world_name = socket->readStringLengthFirst(1000);
-			conPrintIfNotFuzzing("Client connecting to world '" + world_name + "'...");
-			
+			Avatar temp_avatar;
+			readAvatarFromNetworkStreamGivenUID(msg_buffer, temp_avatar); // Read message data before grabbing lock
 
+			// Look up existing avatar in world state
 			{
-				Lock lock(world_state->mutex);
-				// Create world if didn't exist before.
-				// For now only the main world ("") and personal worlds are allowed
-				if(world_name == "")
-				{}
-				else if(world_state->name_to_users.find(world_name) != world_state->name_to_users.end()) // Else if world_name is a user name, it's valid
-				{}
-				else
-					throw glare::Exception("Invalid world name '" + world_name + "'.");
+				WorldStateLock lock(world_state->mutex);
+				const ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
+				auto res = avatars.find(avatar_uid);
+				if(res != avatars.end())
+				{
+					Avatar* avatar = res->second.getPointer();
+					avatar->copyNetworkStateFrom(temp_avatar);
+					avatar->other_dirty = true;
 
-				if(world_state->world_states[world_name].isNull())
-					world_state->world_states[world_name] = new ServerWorldState();
-				cur_world_state = world_state->world_states[world_name];
+
+					// Store avatar settings in the user data
+					if(client_user_id.valid())
+					{
+						const bool avatar_settings_changed = !(client_user_avatar_settings == avatar->avatar_settings);
+
+						if(avatar_settings_changed && !world_state->isInReadOnlyMode())
+						{
+							client_user_avatar_settings = avatar->avatar_settings;
+
+							auto res2 = world_state->user_id_to_users.find(client_user_id);
+							if(res2 != world_state->user_id_to_users.end())
+							{
+								Reference<User> client_user = res2->second;
+								client_user->avatar_settings = avatar->avatar_settings;
+								world_state->addUserAsDBDirty(client_user);
+
+								conPrintIfNotFuzzing("Updated user avatar settings.  model_url: " + client_user->avatar_settings.model_url);
+							}
+						}
+					}
+
+					//conPrint("updated avatar transform");
+				}
 			}
 
-			this->connected_world_name = world_name;
+			if(!temp_avatar.avatar_settings.model_url.empty())
+				sendGetFileMessageIfNeeded(temp_avatar.avatar_settings.model_url);
 
-			// Write avatar UID assigned to the connected client.
-			client_avatar_uid = world_state->getNextAvatarUID();
-			writeToStream(client_avatar_uid, *socket);
+			// Process resources
+			std::set<DependencyURL> URLs;
+			temp_avatar.getDependencyURLSetForAllLODLevels(URLs);
+			for(auto it = URLs.begin(); it != URLs.end(); ++it)
+				sendGetFileMessageIfNeeded(it->URL);
 
-			// If the client connected via a websocket, they can be logged in with a session cookie.
-			// Note that this may only work if the websocket connects over TLS.
+			break;
+		}
+	case Protocol::CreateAvatar:
+		{
+			conPrintIfNotFuzzing("received Protocol::CreateAvatar");
+			// Note: name will come from user account
+			// will use the client_avatar_uid that we assigned to the client
+		
+			Avatar temp_avatar;
+			temp_avatar.uid = readUIDFromStream(msg_buffer); // Will be replaced.
+			readAvatarFromNetworkStreamGivenUID(msg_buffer, temp_avatar); // Read message data before grabbing lock
+
+			temp_avatar.name = client_user_id.valid() ? client_user_name : "Anonymous";
+
+			const UID use_avatar_uid = client_avatar_uid;
+			temp_avatar.uid = use_avatar_uid;
+
+			// Look up existing avatar in world state
 			{
-				Lock lock(world_state->mutex);
-				User* cookie_logged_in_user = LoginHandlers::getLoggedInUser(*world_state, this->websocket_request_info);
-	
-				if(cookie_logged_in_user != NULL)
+				WorldStateLock lock(world_state->mutex);
+				ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
+				auto res = avatars.find(use_avatar_uid);
+				if(res == avatars.end())
 				{
-					client_user_id = cookie_logged_in_user->id;
-					client_user_name = cookie_logged_in_user->name;
-					client_user_avatar_settings = cookie_logged_in_user->avatar_settings; // TODO: clone materials?
-					client_user_flags = cookie_logged_in_user->flags;
+					// Avatar for UID not already created, create it now.
+					AvatarRef avatar = new Avatar();
+					avatar->uid = use_avatar_uid;
+					avatar->copyNetworkStateFrom(temp_avatar);
+					avatar->state = Avatar::State_JustCreated;
+					avatar->other_dirty = true;
+					avatars.insert(std::make_pair(use_avatar_uid, avatar));
+
+					conPrintIfNotFuzzing("created new avatar");
 				}
 			}
 
-			if(client_user_id.valid())
-			{
-				// Send logged-in message to client
-				MessageUtils::initPacket(scratch_packet, Protocol::LoggedInMessageID);
-				writeToStream(client_user_id, scratch_packet);
-				scratch_packet.writeStringLengthFirst(client_user_name);
-				writeAvatarSettingsToStream(client_user_avatar_settings, scratch_packet);
-				scratch_packet.writeUInt32(client_user_flags);
-				MessageUtils::updatePacketLengthField(scratch_packet);
+			if(!temp_avatar.avatar_settings.model_url.empty())
+				sendGetFileMessageIfNeeded(temp_avatar.avatar_settings.model_url);
 
-				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-				socket->flush();
-			}
+			// Process resources
+			std::set<DependencyURL> URLs;
+			temp_avatar.getDependencyURLSetForAllLODLevels(URLs);
+			for(auto it = URLs.begin(); it != URLs.end(); ++it)
+				sendGetFileMessageIfNeeded(it->URL);
 
-			// Send TimeSyncMessage packet to client
+			conPrintIfNotFuzzing("New Avatar creation: username: '" + temp_avatar.name + "', model_url: '" + temp_avatar.avatar_settings.model_url + "'");
+
+			break;
+		}
+	case Protocol::AvatarDestroyed:
+		{
+			conPrintIfNotFuzzing("AvatarDestroyed");
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
+
+			// Mark avatar as dead
 			{
-				MessageUtils::initPacket(scratch_packet, Protocol::TimeSyncMessage);
-				scratch_packet.writeDouble(server->getCurrentGlobalTime());
-				MessageUtils::updatePacketLengthField(scratch_packet);
-				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+				WorldStateLock lock(world_state->mutex);
+				const ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
+				auto res = avatars.find(avatar_uid);
+				if(res != avatars.end())
+				{
+					Avatar* avatar = res->second.getPointer();
+					avatar->state = Avatar::State_Dead;
+					avatar->other_dirty = true;
+				}
 			}
+			break;
+		}
+	case Protocol::AvatarEnteredVehicle:
+		{
+			conPrintIfNotFuzzing("AvatarEnteredVehicle");
 
-			// Send a ServerAdminMessage to client if we have a non-empty message.
-			std::string server_admin_msg;
-			{ // Lock scope
-				Lock lock(world_state->mutex);
-				server_admin_msg = world_state->server_admin_message;
-			} // End lock scope
-			if(!server_admin_msg.empty())
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
+			const UID vehicle_ob_uid = readUIDFromStream(msg_buffer);
+			const uint32 seat_index = msg_buffer.readUInt32();
+			const uint32 flags = msg_buffer.readUInt32();
+
+			// Mark avatar as in vehicle and execute any onUserEnteredVehicle event handlers.
 			{
-				MessageUtils::initPacket(scratch_packet, Protocol::ServerAdminMessageID);
-				scratch_packet.writeStringLengthFirst(server_admin_msg);
-				MessageUtils::updatePacketLengthField(scratch_packet);
+				WorldStateLock lock(world_state->mutex);
+				const ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
+				auto res = avatars.find(avatar_uid);
+				if(res != avatars.end())
+				{
+					Avatar* avatar = res->second.getPointer();
+					if(!avatar->vehicle_inside_uid.valid()) // If avatar wasn't in a vehicle before:
+					{
+						avatar->vehicle_inside_uid = vehicle_ob_uid;
 
-				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-				socket->flush();
+						// Execute event handlers in any scripts that are listening for the onUserEnteredVehicle event from this object.
+						auto ob_res = cur_world_state->getObjects(lock).find(vehicle_ob_uid); // Look up vehicle object
+						if(ob_res != cur_world_state->getObjects(lock).end())
+						{
+							WorldObject* vehicle_ob = ob_res->second.ptr();
+							if(vehicle_ob->event_handlers)
+								vehicle_ob->event_handlers->executeOnUserEnteredVehicleHandlers(avatar_uid, vehicle_ob_uid, lock);
+						}
+					}
+				}
 			}
+			
+			// Enqueue AvatarEnteredVehicle messages to worker threads to send
+			MessageUtils::initPacket(scratch_packet, Protocol::AvatarEnteredVehicle);
+			writeToStream(avatar_uid, scratch_packet);
+			writeToStream(vehicle_ob_uid, scratch_packet);
+			scratch_packet.writeUInt32(seat_index);
+			scratch_packet.writeUInt32(flags);
+			MessageUtils::updatePacketLengthField(scratch_packet);
+			enqueuePacketToBroadcast(scratch_packet, server);
 
-			// Send world settings to client
-			{
-				MessageUtils::initPacket(scratch_packet, Protocol::WorldSettingsInitialSendMessage);
+			break;
+		}
+	case Protocol::AvatarExitedVehicle:
+		{
+			conPrintIfNotFuzzing("AvatarExitedVehicle");
+
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
 
+			// Mark avatar as not in vehicle and execute any onUserExitedVehicle event handlers.
+			{
+				WorldStateLock lock(world_state->mutex);
+				const ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
+				auto res = avatars.find(avatar_uid);
+				if(res != avatars.end())
 				{
-					Lock lock(world_state->mutex);
-					cur_world_state->world_settings.writeToStream(scratch_packet);
-				}
+					Avatar* avatar = res->second.getPointer();
+					if(avatar->vehicle_inside_uid.valid()) // If avatar was in a vehicle before:
+					{
+						// Execute event handlers in any scripts that are listening for the onUserExitedVehicle event from this object.
+						auto ob_res = cur_world_state->getObjects(lock).find(avatar->vehicle_inside_uid); // Look up vehicle object
+						if(ob_res != cur_world_state->getObjects(lock).end())
+						{
+							WorldObject* vehicle_ob = ob_res->second.ptr();
+							if(vehicle_ob->event_handlers)
+								vehicle_ob->event_handlers->executeOnUserExitedVehicleHandlers(avatar_uid, avatar->vehicle_inside_uid, lock);
+						}
 
-				MessageUtils::updatePacketLengthField(scratch_packet);
-				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+						avatar->vehicle_inside_uid = UID::invalidUID();
+					}
+				}
 			}
 
+			// Enqueue AvatarExitedVehicle messages to worker threads to send
+			MessageUtils::initPacket(scratch_packet, Protocol::AvatarExitedVehicle);
+			writeToStream(avatar_uid, scratch_packet);
+			MessageUtils::updatePacketLengthField(scratch_packet);
+			enqueuePacketToBroadcast(scratch_packet, server);
 
-			// Send all current avatar state data to client
+			break;
+		}
+	case Protocol::ObjectTransformUpdate:
+		{
+			//conPrint("received ObjectTransformUpdate");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+			const Vec3d pos = readVec3FromStream<double>(msg_buffer);
+			const Vec3f axis = readVec3FromStream<float>(msg_buffer);
+			const float angle = msg_buffer.readFloat();
+			const Vec3f scale = readVec3FromStream<float>(msg_buffer);
+
+			// If client is not logged in, refuse object modification.
+			if(!client_user_id.valid())
 			{
-				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-
-				{ // Lock scope
+				writeErrorMessageToClient("You must be logged in to modify an object.");
+			}
+			else if(world_state->isInReadOnlyMode())
+			{
+				writeErrorMessageToClient("Server is in read-only mode, you can't modify an object right now.");
+			}
+			else
+			{
+				std::string err_msg_to_client;
+				// Look up existing object in world state
+				{
 					WorldStateLock lock(world_state->mutex);
-					const ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
-					for(auto it = avatars.begin(); it != avatars.end(); ++it)
+					auto res = cur_world_state->getObjects(lock).find(object_uid);
+					if(res != cur_world_state->getObjects(lock).end())
 					{
-						const Avatar* avatar = it->second.getPointer();
+						WorldObject* ob = res->second.getPointer();
 
-						// Write AvatarIsHere message
-						MessageUtils::initPacket(scratch_packet, Protocol::AvatarIsHere);
-						writeAvatarToNetworkStream(*avatar, scratch_packet);
-						MessageUtils::updatePacketLengthField(scratch_packet);
+						// See if the user has permissions to alter this object:
+						if(!userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms, lock))
+							err_msg_to_client = "You must be the owner of this object to change it.";
+						else
+						{
+							ob->pos = pos;
+							ob->axis = axis;
+							ob->angle = angle;
+							ob->scale = scale;
+							ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
+							ob->last_modified_time = TimeStamp::currentTime();
+
+							ob->from_remote_transform_dirty = true;
+							cur_world_state->objectTransformChanged(ob, lock);
+							cur_world_state->addWorldObjectAsDBDirty(ob, lock);
+							cur_world_state->getDirtyFromRemoteObjects(lock).insert(ob);
+
+							world_state->markAsChanged();
+						}
 
-						packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+						//conPrint("updated object transform");
 					}
 				} // End lock scope
 
-				socket->writeData(packet.buf.data(), packet.buf.size());
+				if(!err_msg_to_client.empty())
+					writeErrorMessageToClient(err_msg_to_client);
 			}
 
-			// Send all current object data to client
-			/*{
-				Lock lock(world_state->mutex);
-				for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
-				{
-					const WorldObject* ob = it->second.getPointer();
-
-					// Send ObjectCreated packet
-					SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-					packet.writeUInt32(Protocol::ObjectCreated);
-					ob->writeToNetworkStream(packet);
-					socket->writeData(packet.buf.data(), packet.buf.size());
-				}
-			}*/
+			break;
+		}
+	case Protocol::SummonObject:
+		{
+			conPrint("received SummonObject");
+			SummonObjectMessageClientToServer summon_msg;
+			msg_buffer.readData(&summon_msg, sizeof(SummonObjectMessageClientToServer));
 
-			// Send all current parcel data to client
+			// If client is not logged in, refuse object modification.
+			if(!client_user_id.valid())
 			{
-				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-
-				{ // Lock scope
+				writeErrorMessageToClient("You must be logged in to summon an object.");
+			}
+			else if(world_state->isInReadOnlyMode())
+			{
+				writeErrorMessageToClient("Server is in read-only mode, you can't modify an object right now.");
+			}
+			else
+			{
+				std::string err_msg_to_client;
+				bool send_summon_object_msg = false;
+				{
 					WorldStateLock lock(world_state->mutex);
-					for(auto it = cur_world_state->getParcels(lock).begin(); it != cur_world_state->getParcels(lock).end(); ++it)
+					auto res = cur_world_state->getObjects(lock).find(summon_msg.object_uid); // Look up existing object in world state
+					if(res != cur_world_state->getObjects(lock).end())
 					{
-						const Parcel* parcel = it->second.getPointer();
+						WorldObject* ob = res->second.getPointer();
 
-						// Send ParcelCreated message
-						MessageUtils::initPacket(scratch_packet, Protocol::ParcelCreated);
-						writeToNetworkStream(*parcel, scratch_packet, client_protocol_version);
-						MessageUtils::updatePacketLengthField(scratch_packet);
+						if(client_user_id != ob->creator_id)
+							err_msg_to_client = "You must be the owner of this object to summon it.";
+						else
+						{
+							// TODO: check that this object is the only vehicle object that can be summoned.
+							if(!BitUtils::isBitSet(ob->flags, WorldObject::SUMMONED_FLAG))
+								err_msg_to_client = "Object must have summoned flag set to summon it.";
+							else
+							{
+								ob->pos   = summon_msg.pos;
+								ob->axis  = summon_msg.axis;
+								ob->angle = summon_msg.angle;
+								ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
+								ob->last_modified_time = TimeStamp::currentTime();
 
-						packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+								cur_world_state->objectTransformChanged(ob, lock);
+								cur_world_state->addWorldObjectAsDBDirty(ob, lock); // Object state has changed, so save to DB.
+								world_state->markAsChanged();
+
+								send_summon_object_msg = true;
+							}
+						}
 					}
 				} // End lock scope
 
-				socket->writeData(packet.buf.data(), packet.buf.size());
-				socket->flush();
-			}
-
-			// Send a message saying we have sent all initial state
-			/*{
-				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-				packet.writeUInt32(Protocol::InitialStateSent);
-				socket->writeData(packet.buf.data(), packet.buf.size());
-			}*/
+				if(!err_msg_to_client.empty())
+					writeErrorMessageToClient(err_msg_to_client);
 
+				if(send_summon_object_msg)
+				{
+					// Enqueue SummonObject messages to worker threads to send
+					conPrint("Broadcasting SummonObject message");
+					MessageUtils::initPacket(scratch_packet, Protocol::SummonObject);
+					scratch_packet.writeData(&summon_msg, sizeof(SummonObjectMessageClientToServer));
+					scratch_packet.writeUInt32((uint32)client_avatar_uid.value()); // Write last_transform_update_avatar_uid
+					MessageUtils::updatePacketLengthField(scratch_packet);
+					enqueuePacketToBroadcast(scratch_packet, server);
+				}
+			}
 
-			assert(cur_world_state.nonNull());
+			break;
+		}
+	case Protocol::ObjectPhysicsTransformUpdate:
+		{
+			//conPrint("received ObjectPhysicsTransformUpdate");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+			const Vec3d pos = readVec3FromStream<double>(msg_buffer);
+		
+			Quatf rot;
+			msg_buffer.readData(rot.v.x, sizeof(float) * 4);
 
+			Vec4f linear_vel(0.f);
+			Vec4f angular_vel(0.f);
+			msg_buffer.readData(linear_vel.x, sizeof(float) * 3);
+			msg_buffer.readData(angular_vel.x, sizeof(float) * 3);
 
-			socket->setNoDelayEnabled(true); // We want to send out lots of little packets with low latency.  So disable Nagle's algorithm, e.g. send coalescing.
+			const double client_cur_time = msg_buffer.readDouble();
 
-			while(!should_quit) // write to / read from socket loop
+			// If client is not logged in, refuse object modification.
+			/*if(!client_user_id.valid())
 			{
-				// See if we have any pending data to send in the data_to_send queue, and if so, send all pending data.
-				if(VERBOSE) conPrint("WorkerThread: checking for pending data to send...");
-
-				// We don't want to do network writes while holding the data_to_send_mutex.  So copy to temp_data_to_send.
+				writeErrorMessageToClient("You must be logged in to modify an object.");
+			}
+			*/
+			if(world_state->isInReadOnlyMode())
+			{
+				writeErrorMessageToClient("Server is in read-only mode, you can't modify an object right now.");
+			}
+			else
+			{
+				std::string err_msg_to_client;
+				// Look up existing object in world state
 				{
-					Lock lock(data_to_send_mutex);
-					temp_data_to_send = data_to_send;
-					data_to_send.clear();
-				}
+					WorldStateLock lock(world_state->mutex);
+					auto res = cur_world_state->getObjects(lock).find(object_uid);
+					if(res != cur_world_state->getObjects(lock).end())
+					{
+						WorldObject* ob = res->second.getPointer();
 
-				if(temp_data_to_send.nonEmpty())
-				{
-					socket->writeData(temp_data_to_send.data(), temp_data_to_send.size());
-					socket->flush();
-					temp_data_to_send.clear();
-				}
+						// See if the user has permissions to alter this object:
+						//if(!userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms))
+						//	err_msg_to_client = "You must be the owner of this object to change it.";
+						if(ob->isDynamic()) // We will only allow clients to apply PhysicsTransformUpdates to objects it the object is a dynamic object.
+						{
+							ob->pos = pos;
+							Vec4f axis;
+							float angle;
+							rot.toAxisAndAngle(axis, angle);
+							ob->axis = Vec3f(axis);
+							ob->angle = angle;
 
+							ob->linear_vel = linear_vel;
+							ob->angular_vel = angular_vel;
 
-				if(logged_in_user_is_lightmapper_bot)
-				{
-					Lock lock(server->world_state->mutex);
-					server->world_state->last_lightmapper_bot_contact_time = TimeStamp::currentTime(); // bit of a hack
-				}
+							ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
+							ob->last_transform_client_time = client_cur_time;
 
+							ob->last_modified_time = TimeStamp::currentTime();
 
-#if defined(_WIN32) || defined(OSX)
-				if(socket->readable(0.05)) // If socket has some data to read from it:
-#else
-				if(socket->readable(event_fd)) // Block until either the socket is readable or the event fd is signalled, which means we have data to write.
-#endif
-				{
-					// Read msg type and length
-					uint32 msg_type_and_len[2];
-					socket->readData(msg_type_and_len, sizeof(uint32) * 2);
-					const uint32 msg_type = msg_type_and_len[0];
-					const uint32 msg_len = msg_type_and_len[1]; // Length of message, including the message type and length fields.
+							ob->from_remote_physics_transform_dirty = true;
+							cur_world_state->objectTransformChanged(ob, lock);
+							cur_world_state->addWorldObjectAsDBDirty(ob, lock);
+							cur_world_state->getDirtyFromRemoteObjects(lock).insert(ob);
 
-					if((msg_len < sizeof(uint32) * 2) || (msg_len > 1000000))
-						throw glare::Exception("Invalid message size: " + toString(msg_len));
+							world_state->markAsChanged();
+						}
+					}
+				} // End lock scope
 
-					// conPrint("WorkerThread: Read message header: id: " + toString(msg_type) + ", len: " + toString(msg_len));
+				if(!err_msg_to_client.empty())
+					writeErrorMessageToClient(err_msg_to_client);
+			}
 
-					// Read entire message
-					msg_buffer.buf.resizeNoCopy(msg_len);
-					msg_buffer.read_index = sizeof(uint32) * 2;
+			break;
+		}
+	case Protocol::ObjectFullUpdate:
+		{
+			//conPrint("received ObjectFullUpdate");
+			const UID object_uid = readUIDFromStream(msg_buffer);
 
-					socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2); // Read rest of message, store in msg_buffer.
+			WorldObject temp_ob;
+			readWorldObjectFromNetworkStreamGivenUID(msg_buffer, temp_ob); // Read rest of ObjectFullUpdate message.
 
-					switch(msg_type)
+			// If client is not logged in, refuse object modification.
+			if(!client_user_id.valid())
+			{
+				writeErrorMessageToClient("You must be logged in to modify an object.");
+			}
+			else if(world_state->isInReadOnlyMode())
+			{
+				writeErrorMessageToClient("Server is in read-only mode, you can't modify an object right now.");
+			}
+			else
+			{
+				// Look up existing object in world state
+				bool send_must_be_owner_msg = false;
+				{
+					WorldStateLock lock(world_state->mutex);
+					auto res = cur_world_state->getObjects(lock).find(object_uid);
+					if(res != cur_world_state->getObjects(lock).end())
 					{
-					case Protocol::CyberspaceGoodbye:
-						{
-							conPrintIfNotFuzzing("WorkerThread: received CyberspaceGoodbye, starting graceful shutdown..");
-							socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
-							socket->waitForGracefulDisconnect(); // Wait for a FIN packet from the client. (indicated by recv() returning 0).  We can then close the socket without going into a wait state.
-							conPrintIfNotFuzzing("WorkerThread: waitForGracefulDisconnect done.");
-							should_quit = 1;
-							break;
-						}
-					case Protocol::ClientUDPSocketOpen:
+						WorldObject* ob = res->second.getPointer();
+
+						// See if the user has permissions to alter this object:
+						if(!userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms, lock))
 						{
-							conPrint("WorkerThread: received Protocol::ClientUDPSocketOpen");
-							//const uint32 client_UDP_port = msg_buffer.readUInt32();
-							server->clientUDPPortOpen(this, socket->getOtherEndIPAddress(), client_avatar_uid);
-							break;
+							send_must_be_owner_msg = true;
 						}
-					case Protocol::AudioStreamToServerStarted:
+						else
 						{
-							const uint32 sampling_rate = msg_buffer.readUInt32();
-							const uint32 flags         = msg_buffer.readUInt32();
-							const uint32 stream_id     = msg_buffer.readUInt32();
-
-							if(!BitUtils::isBitSet(flags, 0x1u)) // If renew flag is not set:
-								conPrint("WorkerThread: received Protocol::AudioStreamToServerStarted without renew flag");
-
-							// Send message to all clients
-							{
-								MessageUtils::initPacket(scratch_packet, Protocol::AudioStreamToServerStarted);
-								writeToStream(client_avatar_uid, scratch_packet); // Send client avatar UID as well.
-								scratch_packet.writeUInt32(sampling_rate);
-								scratch_packet.writeUInt32(flags);
-								scratch_packet.writeUInt32(stream_id);
-								MessageUtils::updatePacketLengthField(scratch_packet);
-
-								enqueuePacketToBroadcast(scratch_packet, server);
-							}
+							ob->copyNetworkStateFrom(temp_ob);
+							ob->updateOptimisedModelFlag(*world_state->resource_manager); // OPTIMISED_MODEL_FLAG is set by the server, don't trust the client value.
+							cur_world_state->objectTransformChanged(ob, lock); // Full update may change the object position.
+							
+							// Clamp volume to the max allowed level
+							ob->audio_volume = myClamp(ob->audio_volume, 0.f, maxAudioVolumeForObject(*ob, client_user_id, client_user_name, this->connected_world_name));
 
-							break;
-						}
-					case Protocol::AudioStreamToServerEnded:
-						{
-							conPrint("WorkerThread: received Protocol::AudioStreamToServerEnded");
+							ob->last_modified_time = TimeStamp::currentTime();
 
-							// Send message to all clients
-							{
-								MessageUtils::initPacket(scratch_packet, Protocol::AudioStreamToServerEnded);
-								writeToStream(client_avatar_uid, scratch_packet); // Send client avatar UID as well.
-								MessageUtils::updatePacketLengthField(scratch_packet);
+							ob->from_remote_other_dirty = true;
+							cur_world_state->addWorldObjectAsDBDirty(ob, lock);
+							cur_world_state->getDirtyFromRemoteObjects(lock).insert(ob);
 
-								enqueuePacketToBroadcast(scratch_packet, server);
-							}
+							world_state->markAsChanged();
 
-							break;
-						}
-					case Protocol::AvatarTransformUpdate:
-						{
-							//conPrint("AvatarTransformUpdate");
-							const UID avatar_uid = readUIDFromStream(msg_buffer);
-							const Vec3d pos = readVec3FromStream<double>(msg_buffer);
-							const Vec3f rotation = readVec3FromStream<float>(msg_buffer);
-							const uint32 anim_state = msg_buffer.readUInt32();
+							// Process resources
+							std::set<DependencyURL> URLs;
+							WorldObject::GetDependencyOptions options;
+							ob->getDependencyURLSetBaseLevel(options, URLs);
+							for(auto it = URLs.begin(); it != URLs.end(); ++it)
+								sendGetFileMessageIfNeeded(it->URL);
 
-							// Look up existing avatar in world state
+							// Add script evaluator if needed
+							if(hasPrefix(ob->script, "--lua") && BitUtils::isBitSet(world_state->feature_flag_info.feature_flags, ServerAllWorldsState::SERVER_SCRIPT_EXEC_FEATURE_FLAG))
 							{
-								WorldStateLock lock(world_state->mutex);
-								const ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
-								auto res = avatars.find(avatar_uid);
-								if(res != avatars.end())
+								ob->lua_script_evaluator = NULL;
+								try
 								{
-									Avatar* avatar = res->second.getPointer();
-									avatar->pos = pos;
-									avatar->rotation = rotation;
-									avatar->anim_state = anim_state;
-									avatar->transform_dirty = true;
-
-									//conPrint("updated avatar transform");
+									ob->lua_script_evaluator = new LuaScriptEvaluator(server->getLuaVMForWorld(cur_world_state.ptr(), lock), /*script output handler=*/server, ob->script, ob, cur_world_state.ptr(), lock);
+								}
+								catch(LuaScriptExcepWithLocation& e)
+								{
+									conPrint("Error creating LuaScriptEvaluator for ob " + ob->uid.toString() + ": " + e.messageWithLocations());
+									server->logLuaError("Error: " + e.messageWithLocations(), ob->uid, ob->creator_id);
+								}
+								catch(glare::Exception& e)
+								{
+									conPrint("Error creating LuaScriptEvaluator for ob " + ob->uid.toString() + ": " + e.what());
+									server->logLuaError("Error: " + e.what(), ob->uid, ob->creator_id);
 								}
 							}
-							break;
-						}
-					case Protocol::AvatarPerformGesture:
-						{
-							//conPrint("AvatarPerformGesture");
-							const UID avatar_uid = readUIDFromStream(msg_buffer);
-							const std::string gesture_name = msg_buffer.readStringLengthFirst(10000);
-
-							//conPrint("Received AvatarPerformGesture: '" + gesture_name + "'");
-
-							//if(!client_user_id.valid())
-							//{
-							//	writeErrorMessageToClient(socket, "You must be logged in to perform a gesture.");
-							//}
-							//else
-							//{
-								// Enqueue AvatarPerformGesture messages to worker threads to send
-								MessageUtils::initPacket(scratch_packet, Protocol::AvatarPerformGesture);
-								writeToStream(avatar_uid, scratch_packet);
-								scratch_packet.writeStringLengthFirst(gesture_name);
-								MessageUtils::updatePacketLengthField(scratch_packet);
-
-								enqueuePacketToBroadcast(scratch_packet, server);
-							//}
-							break;
-						}
-					case Protocol::AvatarStopGesture:
-						{
-							//conPrint("AvatarStopGesture");
-							const UID avatar_uid = readUIDFromStream(msg_buffer);
-
-							//if(!client_user_id.valid())
-							//{
-							//	writeErrorMessageToClient(socket, "You must be logged in to stop a gesture.");
-							//}
-							//else
-							//{
-								// Enqueue AvatarStopGesture messages to worker threads to send
-								MessageUtils::initPacket(scratch_packet, Protocol::AvatarStopGesture);
-								writeToStream(avatar_uid, scratch_packet);
-								MessageUtils::updatePacketLengthField(scratch_packet);
-
-								enqueuePacketToBroadcast(scratch_packet, server);
-							//}
-							break;
 						}
-					case Protocol::AvatarFullUpdate:
-						{
-							conPrintIfNotFuzzing("Protocol::AvatarFullUpdate");
-							const UID avatar_uid = readUIDFromStream(msg_buffer);
+					}
+				} // End lock scope
 
-							Avatar temp_avatar;
-							readAvatarFromNetworkStreamGivenUID(msg_buffer, temp_avatar); // Read message data before grabbing lock
+				if(send_must_be_owner_msg)
+					writeErrorMessageToClient("You must be the owner of this object to change it.");
+			}
+			break;
+		}
+	case Protocol::ObjectLightmapURLChanged:
+		{
+			//conPrint("ObjectLightmapURLChanged");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+			const std::string new_lightmap_url = msg_buffer.readStringLengthFirst(WorldObject::MAX_URL_SIZE);
 
-							// Look up existing avatar in world state
-							{
-								WorldStateLock lock(world_state->mutex);
-								const ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
-								auto res = avatars.find(avatar_uid);
-								if(res != avatars.end())
-								{
-									Avatar* avatar = res->second.getPointer();
-									avatar->copyNetworkStateFrom(temp_avatar);
-									avatar->other_dirty = true;
+			// Look up existing object in world state
+			{
+				WorldStateLock lock(world_state->mutex);
+				auto res = cur_world_state->getObjects(lock).find(object_uid);
+				if(res != cur_world_state->getObjects(lock).end())
+				{
+					WorldObject* ob = res->second.getPointer();
 
+					if(!world_state->isInReadOnlyMode())
+					{
+						ob->lightmap_url = new_lightmap_url;
+						ob->last_modified_time = TimeStamp::currentTime();
 
-									// Store avatar settings in the user data
-									if(client_user_id.valid())
-									{
-										const bool avatar_settings_changed = !(client_user_avatar_settings == avatar->avatar_settings);
+						ob->from_remote_lightmap_url_dirty = true;
+						cur_world_state->addWorldObjectAsDBDirty(ob, lock);
+						cur_world_state->getDirtyFromRemoteObjects(lock).insert(ob);
 
-										if(avatar_settings_changed && !world_state->isInReadOnlyMode())
-										{
-											client_user_avatar_settings = avatar->avatar_settings;
+						world_state->markAsChanged();
+					}
+				}
+			}
+			break;
+		}
+	case Protocol::ObjectModelURLChanged:
+		{
+			//conPrint("ObjectModelURLChanged");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+			const std::string new_model_url = msg_buffer.readStringLengthFirst(WorldObject::MAX_URL_SIZE);
 
-											auto res2 = world_state->user_id_to_users.find(client_user_id);
-											if(res2 != world_state->user_id_to_users.end())
-											{
-												Reference<User> client_user = res2->second;
-												client_user->avatar_settings = avatar->avatar_settings;
-												world_state->addUserAsDBDirty(client_user);
+			// Look up existing object in world state
+			{
+				WorldStateLock lock(world_state->mutex);
+				auto res = cur_world_state->getObjects(lock).find(object_uid);
+				if(res != cur_world_state->getObjects(lock).end())
+				{
+					WorldObject* ob = res->second.getPointer();
 
-												conPrintIfNotFuzzing("Updated user avatar settings.  model_url: " + client_user->avatar_settings.model_url);
-											}
-										}
-									}
+					if(!world_state->isInReadOnlyMode())
+					{
+						ob->model_url = new_model_url;
+						ob->last_modified_time = TimeStamp::currentTime();
 
-									//conPrint("updated avatar transform");
-								}
-							}
+						// Clients clear OPTIMISED_MODEL_FLAG when they receive ObjectModelURLChanged, so if the new model has an optimised version, send a full update instead.
+						ob->updateOptimisedModelFlag(*world_state->resource_manager);
+						if(BitUtils::isBitSet(ob->flags, WorldObject::OPTIMISED_MODEL_FLAG))
+							ob->from_remote_other_dirty = true;
+						else
+							ob->from_remote_model_url_dirty = true;
+						cur_world_state->addWorldObjectAsDBDirty(ob, lock);
+						cur_world_state->getDirtyFromRemoteObjects(lock).insert(ob);
 
-							if(!temp_avatar.avatar_settings.model_url.empty())
-								sendGetFileMessageIfNeeded(temp_avatar.avatar_settings.model_url);
+						world_state->markAsChanged();
+					}
+				}
+			}
+			break;
+		}
+	case Protocol::ObjectFlagsChanged:
+		{
+			//conPrint("ObjectFlagsChanged");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+			const uint32 flags = msg_buffer.readUInt32();
 
-							// Process resources
-							std::set<DependencyURL> URLs;
-							temp_avatar.getDependencyURLSetForAllLODLevels(URLs);
-							for(auto it = URLs.begin(); it != URLs.end(); ++it)
-								sendGetFileMessageIfNeeded(it->URL);
+			// Look up existing object in world state
+			{
+				WorldStateLock lock(world_state->mutex);
+				auto res = cur_world_state->getObjects(lock).find(object_uid);
+				if(res != cur_world_state->getObjects(lock).end())
+				{
+					WorldObject* ob = res->second.getPointer();
 
-							break;
-						}
-					case Protocol::CreateAvatar:
-						{
-							conPrintIfNotFuzzing("received Protocol::CreateAvatar");
-							// Note: name will come from user account
-							// will use the client_avatar_uid that we assigned to the client
-						
-							Avatar temp_avatar;
-							temp_avatar.uid = readUIDFromStream(msg_buffer); // Will be replaced.
-							readAvatarFromNetworkStreamGivenUID(msg_buffer, temp_avatar); // Read message data before grabbing lock
+					if(!world_state->isInReadOnlyMode())
+					{
+						ob->flags = flags; // Copy flags
+						ob->updateOptimisedModelFlag(*world_state->resource_manager); // OPTIMISED_MODEL_FLAG is set by the server, don't trust the client value.
+						ob->last_modified_time = TimeStamp::currentTime();
 
-							temp_avatar.name = client_user_id.valid() ? client_user_name : "Anonymous";
+						ob->from_remote_flags_dirty = true;
+						cur_world_state->addWorldObjectAsDBDirty(ob, lock);
+						cur_world_state->getDirtyFromRemoteObjects(lock).insert(ob);
 
-							const UID use_avatar_uid = client_avatar_uid;
-							temp_avatar.uid = use_avatar_uid;
+						world_state->markAsChanged();
+					}
+				}
+			}
+			break;
+		}
+	case Protocol::ObjectPhysicsOwnershipTaken:
+		{
+			// conPrint("ObjectPhysicsOwnershipTaken");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+			const uint32 physics_owner_id = msg_buffer.readUInt32();
+			const double client_global_time = msg_buffer.readDouble();
+			const uint32 flags = msg_buffer.readUInt32();
 
-							// Look up existing avatar in world state
-							{
-								WorldStateLock lock(world_state->mutex);
-								ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
-								auto res = avatars.find(use_avatar_uid);
-								if(res == avatars.end())
-								{
-									// Avatar for UID not already created, create it now.
-									AvatarRef avatar = new Avatar();
-									avatar->uid = use_avatar_uid;
-									avatar->copyNetworkStateFrom(temp_avatar);
-									avatar->state = Avatar::State_JustCreated;
-									avatar->other_dirty = true;
-									avatars.insert(std::make_pair(use_avatar_uid, avatar));
-
-									conPrintIfNotFuzzing("created new avatar");
-								}
-							}
+			// Look up existing object in world state
+			{
+				WorldStateLock lock(world_state->mutex);
+				auto res = cur_world_state->getObjects(lock).find(object_uid);
+				if(res != cur_world_state->getObjects(lock).end())
+				{
+					WorldObject* ob = res->second.getPointer();
 
-							if(!temp_avatar.avatar_settings.model_url.empty())
-								sendGetFileMessageIfNeeded(temp_avatar.avatar_settings.model_url);
+					if(!world_state->isInReadOnlyMode())
+					{
+						ob->physics_owner_id = physics_owner_id;
+						ob->last_physics_ownership_change_global_time = client_global_time;
+						ob->invalidateCachedNetworkMessages();
 
-							// Process resources
-							std::set<DependencyURL> URLs;
-							temp_avatar.getDependencyURLSetForAllLODLevels(URLs);
-							for(auto it = URLs.begin(); it != URLs.end(); ++it)
-								sendGetFileMessageIfNeeded(it->URL);
+						// Consider physics_owner_id ephemeral state, so doesn't need to be written to DB.
+					}
+				}
+			}
 
-							conPrintIfNotFuzzing("New Avatar creation: username: '" + temp_avatar.name + "', model_url: '" + temp_avatar.avatar_settings.model_url + "'");
+			// Enqueue ObjectPhysicsOwnershipTaken messages to worker threads to send
+			MessageUtils::initPacket(scratch_packet, Protocol::ObjectPhysicsOwnershipTaken);
+			writeToStream(object_uid, scratch_packet);
+			scratch_packet.writeUInt32(physics_owner_id);
+			scratch_packet.writeDouble(client_global_time);
+			scratch_packet.writeUInt32(flags);
+			MessageUtils::updatePacketLengthField(scratch_packet);
+			enqueuePacketToBroadcast(scratch_packet, server);
 
-							break;
-						}
-					case Protocol::AvatarDestroyed:
-						{
-							conPrintIfNotFuzzing("AvatarDestroyed");
-							const UID avatar_uid = readUIDFromStream(msg_buffer);
+			break;
+		}
+	case Protocol::CreateObject: // Client wants to create an object
+		{
+			conPrintIfNotFuzzing("CreateObject");
 
-							// Mark avatar as dead
-							{
-								WorldStateLock lock(world_state->mutex);
-								const ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
-								auto res = avatars.find(avatar_uid);
-								if(res != avatars.end())
-								{
-									Avatar* avatar = res->second.getPointer();
-									avatar->state = Avatar::State_Dead;
-									avatar->other_dirty = true;
-								}
-							}
-							break;
-						}
-					case Protocol::AvatarEnteredVehicle:
-						{
-							conPrintIfNotFuzzing("AvatarEnteredVehicle");
+			WorldObjectRef new_ob = new WorldObject();
+			new_ob->uid = readUIDFromStream(msg_buffer); // Read dummy UID
+			readWorldObjectFromNetworkStreamGivenUID(msg_buffer, *new_ob);
 
-							const UID avatar_uid = readUIDFromStream(msg_buffer);
-							const UID vehicle_ob_uid = readUIDFromStream(msg_buffer);
-							const uint32 seat_index = msg_buffer.readUInt32();
-							const uint32 flags = msg_buffer.readUInt32();
+			conPrintIfNotFuzzing("model_url: '" + new_ob->model_url + "', pos: " + new_ob->pos.toString());
 
-							// Mark avatar as in vehicle and execute any onUserEnteredVehicle event handlers.
-							{
-								WorldStateLock lock(world_state->mutex);
-								const ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
-								auto res = avatars.find(avatar_uid);
-								if(res != avatars.end())
-								{
-									Avatar* avatar = res->second.getPointer();
-									if(!avatar->vehicle_inside_uid.valid()) // If avatar wasn't in a vehicle before:
-									{
-										avatar->vehicle_inside_uid = vehicle_ob_uid;
-
-										// Execute event handlers in any scripts that are listening for the onUserEnteredVehicle event from this object.
-										auto ob_res = cur_world_state->getObjects(lock).find(vehicle_ob_uid); // Look up vehicle object
-										if(ob_res != cur_world_state->getObjects(lock).end())
-										{
-											WorldObject* vehicle_ob = ob_res->second.ptr();
-											if(vehicle_ob->event_handlers)
-												vehicle_ob->event_handlers->executeOnUserEnteredVehicleHandlers(avatar_uid, vehicle_ob_uid, lock);
-										}
-									}
-								}
-							}
-							
-							// Enqueue AvatarEnteredVehicle messages to worker threads to send
-							MessageUtils::initPacket(scratch_packet, Protocol::AvatarEnteredVehicle);
-							writeToStream(avatar_uid, scratch_packet);
-							writeToStream(vehicle_ob_uid, scratch_packet);
-							scratch_packet.writeUInt32(seat_index);
-							scratch_packet.writeUInt32(flags);
-							MessageUtils::updatePacketLengthField(scratch_packet);
-							enqueuePacketToBroadcast(scratch_packet, server);
+			// If client is not logged in, refuse object creation.
+			if(!client_user_id.valid())
+			{
+				conPrintIfNotFuzzing("Creation denied, user was not logged in.");
+				MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
+				scratch_packet.writeStringLengthFirst("You must be logged in to create an object.");
+				MessageUtils::updatePacketLengthField(scratch_packet);
+				writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+			}
+			else if(world_state->isInReadOnlyMode())
+			{
+				writeErrorMessageToClient("Server is in read-only mode, you can't create an object right now.");
+			}
+			else
+			{
+				new_ob->creator_id = client_user_id;
+				new_ob->created_time = TimeStamp::currentTime();
+				new_ob->last_modified_time = new_ob->created_time;
+				new_ob->creator_name = client_user_name;
+				new_ob->updateOptimisedModelFlag(*world_state->resource_manager); // OPTIMISED_MODEL_FLAG is set by the server, don't trust the client value.
+
+				std::set<DependencyURL> URLs;
+				WorldObject::GetDependencyOptions options;
+				new_ob->getDependencyURLSetBaseLevel(options, URLs);
+				for(auto it = URLs.begin(); it != URLs.end(); ++it)
+					sendGetFileMessageIfNeeded(it->URL);
+
+				// Insert object into world state
+				{
+					::WorldStateLock lock(world_state->mutex);
 
-							break;
-						}
-					case Protocol::AvatarExitedVehicle:
-						{
-							conPrintIfNotFuzzing("AvatarExitedVehicle");
+					new_ob->uid = world_state->getNextObjectUID();
+					new_ob->state = WorldObject::State_JustCreated;
+					new_ob->from_remote_other_dirty = true;
+					cur_world_state->addWorldObjectAsDBDirty(new_ob, lock);
+					cur_world_state->getDirtyFromRemoteObjects(lock).insert(new_ob);
+					cur_world_state->addObject(new_ob, lock);
 
-							const UID avatar_uid = readUIDFromStream(msg_buffer);
+					world_state->markAsChanged();
+				}
+			}
 
-							// Mark avatar as not in vehicle and execute any onUserExitedVehicle event handlers.
-							{
-								WorldStateLock lock(world_state->mutex);
-								const ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
-								auto res = avatars.find(avatar_uid);
-								if(res != avatars.end())
-								{
-									Avatar* avatar = res->second.getPointer();
-									if(avatar->vehicle_inside_uid.valid()) // If avatar was in a vehicle before:
-									{
-										// Execute event handlers in any scripts that are listening for the onUserExitedVehicle event from this object.
-										auto ob_res = cur_world_state->getObjects(lock).find(avatar->vehicle_inside_uid); // Look up vehicle object
-										if(ob_res != cur_world_state->getObjects(lock).end())
-										{
-											WorldObject* vehicle_ob = ob_res->second.ptr();
-											if(vehicle_ob->event_handlers)
-												vehicle_ob->event_handlers->executeOnUserExitedVehicleHandlers(avatar_uid, avatar->vehicle_inside_uid, lock);
-										}
-
-										avatar->vehicle_inside_uid = UID::invalidUID();
-									}
-								}
-							}
+			break;
+		}
+	case Protocol::DestroyObject: // Client wants to destroy an object.
+		{
+			conPrintIfNotFuzzing("DestroyObject");
+			const UID object_uid = readUIDFromStream(msg_buffer);
 
-							// Enqueue AvatarExitedVehicle messages to worker threads to send
-							MessageUtils::initPacket(scratch_packet, Protocol::AvatarExitedVehicle);
-							writeToStream(avatar_uid, scratch_packet);
-							MessageUtils::updatePacketLengthField(scratch_packet);
-							enqueuePacketToBroadcast(scratch_packet, server);
+			// If client is not logged in, refuse object modification.
+			if(!client_user_id.valid())
+			{
+				writeErrorMessageToClient("You must be logged in to destroy an object.");
+			}
+			else if(world_state->isInReadOnlyMode())
+			{
+				writeErrorMessageToClient("Server is in read-only mode, you can't destroy an object right now.");
+			}
+			else
+			{
+				bool send_must_be_owner_msg = false;
+				{
+					WorldStateLock lock(world_state->mutex);
+					auto res = cur_world_state->getObjects(lock).find(object_uid);
+					if(res != cur_world_state->getObjects(lock).end())
+					{
+						WorldObject* ob = res->second.getPointer();
 
-							break;
-						}
-					case Protocol::ObjectTransformUpdate:
+						// See if the user has permissions to alter this object:
+						const bool have_delete_perms = userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms, lock);
+						if(!have_delete_perms)
+							send_must_be_owner_msg = true;
+						else
 						{
-							//conPrint("received ObjectTransformUpdate");
-							const UID object_uid = readUIDFromStream(msg_buffer);
-							const Vec3d pos = readVec3FromStream<double>(msg_buffer);
-							const Vec3f axis = readVec3FromStream<float>(msg_buffer);
-							const float angle = msg_buffer.readFloat();
-							const Vec3f scale = readVec3FromStream<float>(msg_buffer);
-
-							// If client is not logged in, refuse object modification.
-							if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
-							}
-							else if(world_state->isInReadOnlyMode())
-							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
-							}
-							else
-							{
-								std::string err_msg_to_client;
-								// Look up existing object in world state
-								{
-									WorldStateLock lock(world_state->mutex);
-									auto res = cur_world_state->getObjects(lock).find(object_uid);
-									if(res != cur_world_state->getObjects(lock).end())
-									{
-										WorldObject* ob = res->second.getPointer();
-
-										// See if the user has permissions to alter this object:
-										if(!userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms, lock))
-											err_msg_to_client = "You must be the owner of this object to change it.";
-										else
-										{
-											ob->pos = pos;
-											ob->axis = axis;
-											ob->angle = angle;
-											ob->scale = scale;
-											ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
-											ob->last_modified_time = TimeStamp::currentTime();
-
-											ob->from_remote_transform_dirty = true;
-											cur_world_state->addWorldObjectAsDBDirty(ob, lock);
-											cur_world_state->getDirtyFromRemoteObjects(lock).insert(ob);
-
-											world_state->markAsChanged();
-										}
-
-										//conPrint("updated object transform");
-									}
-								} // End lock scope
-
-								if(!err_msg_to_client.empty())
-									writeErrorMessageToClient(socket, err_msg_to_client);
-							}
+							// Mark object as dead
+							ob->state = WorldObject::State_Dead;
+							ob->from_remote_other_dirty = true;
+							cur_world_state->addWorldObjectAsDBDirty(ob, lock);
+							cur_world_state->getDirtyFromRemoteObjects(lock).insert(ob);
 
-							break;
+							world_state->markAsChanged();
 						}
-					case Protocol::SummonObject:
-						{
-							conPrint("received SummonObject");
-							SummonObjectMessageClientToServer summon_msg;
-							msg_buffer.readData(&summon_msg, sizeof(SummonObjectMessageClientToServer));
+					}
+				} // End lock scope
 
-							// If client is not logged in, refuse object modification.
-							if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to summon an object.");
-							}
-							else if(world_state->isInReadOnlyMode())
-							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
-							}
-							else
-							{
-								std::string err_msg_to_client;
-								bool send_summon_object_msg = false;
-								{
-									WorldStateLock lock(world_state->mutex);
-									auto res = cur_world_state->getObjects(lock).find(summon_msg.object_uid); // Look up existing object in world state
-									if(res != cur_world_state->getObjects(lock).end())
-									{
-										WorldObject* ob = res->second.getPointer();
-
-										if(client_user_id != ob->creator_id)
-											err_msg_to_client = "You must be the owner of this object to summon it.";
-										else
-										{
-											// TODO: check that this object is the only vehicle object that can be summoned.
-											if(!BitUtils::isBitSet(ob->flags, WorldObject::SUMMONED_FLAG))
-												err_msg_to_client = "Object must have summoned flag set to summon it.";
-											else
-											{
-												ob->pos   = summon_msg.pos;
-												ob->axis  = summon_msg.axis;
-												ob->angle = summon_msg.angle;
-												ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
-												ob->last_modified_time = TimeStamp::currentTime();
-
-												cur_world_state->addWorldObjectAsDBDirty(ob, lock); // Object state has changed, so save to DB.
-												world_state->markAsChanged();
-
-												send_summon_object_msg = true;
-											}
-										}
-									}
-								} // End lock scope
-
-								if(!err_msg_to_client.empty())
-									writeErrorMessageToClient(socket, err_msg_to_client);
-
-								if(send_summon_object_msg)
-								{
-									// Enqueue SummonObject messages to worker threads to send
-									conPrint("Broadcasting SummonObject message");
-									MessageUtils::initPacket(scratch_packet, Protocol::SummonObject);
-									scratch_packet.writeData(&summon_msg, sizeof(SummonObjectMessageClientToServer));
-									scratch_packet.writeUInt32((uint32)client_avatar_uid.value()); // Write last_transform_update_avatar_uid
-									MessageUtils::updatePacketLengthField(scratch_packet);
-									enqueuePacketToBroadcast(scratch_packet, server);
-								}
-							}
+				if(send_must_be_owner_msg)
+					writeErrorMessageToClient("You must be the owner of this object to destroy it.");
+			}
+			break;
+		}
+	case Protocol::GetAllObjects: // Client wants to get all objects in world
+		{
+			conPrintIfNotFuzzing("GetAllObjects");
 
-							break;
-						}
-					case Protocol::ObjectPhysicsTransformUpdate:
-						{
-							//conPrint("received ObjectPhysicsTransformUpdate");
-							const UID object_uid = readUIDFromStream(msg_buffer);
-							const Vec3d pos = readVec3FromStream<double>(msg_buffer);
-						
-							Quatf rot;
-							msg_buffer.readData(rot.v.x, sizeof(float) * 4);
-
-							Vec4f linear_vel(0.f);
-							Vec4f angular_vel(0.f);
-							msg_buffer.readData(linear_vel.x, sizeof(float) * 3);
-							msg_buffer.readData(angular_vel.x, sizeof(float) * 3);
-
-							const double client_cur_time = msg_buffer.readDouble();
-
-							// If client is not logged in, refuse object modification.
-							/*if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
-							}
-							*/
-							if(world_state->isInReadOnlyMode())
-							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
-							}
-							else
-							{
-								std::string err_msg_to_client;
-								// Look up existing object in world state
-								{
-									WorldStateLock lock(world_state->mutex);
-									auto res = cur_world_state->getObjects(lock).find(object_uid);
-									if(res != cur_world_state->getObjects(lock).end())
-									{
-										WorldObject* ob = res->second.getPointer();
-
-										// See if the user has permissions to alter this object:
-										//if(!userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms))
-										//	err_msg_to_client = "You must be the owner of this object to change it.";
-										if(ob->isDynamic()) // We will only allow clients to apply PhysicsTransformUpdates to objects it the object is a dynamic object.
-										{
-											ob->pos = pos;
-											Vec4f axis;
-											float angle;
-											rot.toAxisAndAngle(axis, angle);
-											ob->axis = Vec3f(axis);
-											ob->angle = angle;
-
-											ob->linear_vel = linear_vel;
-											ob->angular_vel = angular_vel;
-
-											ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
-											ob->last_transform_client_time = client_cur_time;
-
-											ob->last_modified_time = TimeStamp::currentTime();
-
-											ob->from_remote_physics_transform_dirty = true;
-											cur_world_state->addWorldObjectAsDBDirty(ob, lock);
-											cur_world_state->getDirtyFromRemoteObjects(lock).insert(ob);
-
-											world_state->markAsChanged();
-										}
-									}
-								} // End lock scope
-
-								if(!err_msg_to_client.empty())
-									writeErrorMessageToClient(socket, err_msg_to_client);
-							}
+			SocketBufferOutStream temp_buf(SocketBufferOutStream::DontUseNetworkByteOrder); // Will contain several messages
 
-							break;
-						}
-					case Protocol::ObjectFullUpdate:
-						{
-							//conPrint("received ObjectFullUpdate");
-							const UID object_uid = readUIDFromStream(msg_buffer);
+			{
+				WorldStateLock lock(world_state->mutex);
+				const ServerWorldState::ObjectMapType& objects = cur_world_state->getObjects(lock);
+				for(auto it = objects.begin(); it != objects.end(); ++it)
+				{
+					WorldObject* ob = it->second.getPointer();
 
-							WorldObject temp_ob;
-							readWorldObjectFromNetworkStreamGivenUID(msg_buffer, temp_ob); // Read rest of ObjectFullUpdate message.
+					writeObjectInitialSendMessage(ob, temp_buf, scratch_packet, *world_state, lock);
+				}
+			}
 
-							// If client is not logged in, refuse object modification.
-							if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
-							}
-							else if(world_state->isInReadOnlyMode())
-							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
-							}
-							else
-							{
-								// Look up existing object in world state
-								bool send_must_be_owner_msg = false;
-								{
-									WorldStateLock lock(world_state->mutex);
-									auto res = cur_world_state->getObjects(lock).find(object_uid);
-									if(res != cur_world_state->getObjects(lock).end())
-									{
-										WorldObject* ob = res->second.getPointer();
-
-										// See if the user has permissions to alter this object:
-										if(!userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms, lock))
-										{
-											send_must_be_owner_msg = true;
-										}
-										else
-										{
-											ob->copyNetworkStateFrom(temp_ob);
-											
-											// Clamp volume to the max allowed level
-											ob->audio_volume = myClamp(ob->audio_volume, 0.f, maxAudioVolumeForObject(*ob, client_user_id, client_user_name, this->connected_world_name));
-
-											ob->last_modified_time = TimeStamp::currentTime();
-
-											ob->from_remote_other_dirty = true;
-											cur_world_state->addWorldObjectAsDBDirty(ob, lock);
-											cur_world_state->getDirtyFromRemoteObjects(lock).insert(ob);
-
-											world_state->markAsChanged();
-
-											// Process resources
-											std::set<DependencyURL> URLs;
-											WorldObject::GetDependencyOptions options;
-											ob->getDependencyURLSetBaseLevel(options, URLs);
-											for(auto it = URLs.begin(); it != URLs.end(); ++it)
-												sendGetFileMessageIfNeeded(it->URL);
-
-											// Add script evaluator if needed
-											if(hasPrefix(ob->script, "--lua") && BitUtils::isBitSet(world_state->feature_flag_info.feature_flags, ServerAllWorldsState::SERVER_SCRIPT_EXEC_FEATURE_FLAG))
-											{
-												ob->lua_script_evaluator = NULL;
-												try
-												{
-													ob->lua_script_evaluator = new LuaScriptEvaluator(server->lua_vm.ptr(), /*script output handler=*/server, ob->script, ob, cur_world_state.ptr(), lock);
-												}
-												catch(LuaScriptExcepWithLocation& e)
-												{
-													conPrint("Error creating LuaScriptEvaluator for ob " + ob->uid.toString() + ": " + e.messageWithLocations());
-													server->logLuaError("Error: " + e.messageWithLocations(), ob->uid, ob->creator_id);
-												}
-												catch(glare::Exception& e)
-												{
-													conPrint("Error creating LuaScriptEvaluator for ob " + ob->uid.toString() + ": " + e.what());
-													server->logLuaError("Error: " + e.what(), ob->uid, ob->creator_id);
-												}
-											}
-										}
-									}
-								} // End lock scope
-
-								if(send_must_be_owner_msg)
-									writeErrorMessageToClient(socket, "You must be the owner of this object to change it.");
-							}
-							break;
-						}
-					case Protocol::ObjectLightmapURLChanged:
-						{
-							//conPrint("ObjectLightmapURLChanged");
-							const UID object_uid = readUIDFromStream(msg_buffer);
-							const std::string new_lightmap_url = msg_buffer.readStringLengthFirst(WorldObject::MAX_URL_SIZE);
+			MessageUtils::initPacket(scratch_packet, Protocol::AllObjectsSent); // Terminate the buffer with an AllObjectsSent message.
+			MessageUtils::updatePacketLengthField(scratch_packet);
+			temp_buf.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
 
-							// Look up existing object in world state
-							{
-								WorldStateLock lock(world_state->mutex);
-								auto res = cur_world_state->getObjects(lock).find(object_uid);
-								if(res != cur_world_state->getObjects(lock).end())
-								{
-									WorldObject* ob = res->second.getPointer();
+			writeToClient(temp_buf.buf.data(), temp_buf.buf.size());
 
-									if(!world_state->isInReadOnlyMode())
-									{
-										ob->lightmap_url = new_lightmap_url;
-										ob->last_modified_time = TimeStamp::currentTime();
+			break;
+		}
+	case Protocol::QueryObjects: // Client wants to query objects in certain grid cells
+		{
+			Vec3d cam_position;
+			if(client_protocol_version >= 36) // position was introduced in protocol version 36.
+				cam_position = readVec3FromStream<double>(msg_buffer);
+			else
+				cam_position = Vec3d(0.0);
 
-										ob->from_remote_lightmap_url_dirty = true;
-										cur_world_state->addWorldObjectAsDBDirty(ob, lock);
-										cur_world_state->getDirtyFromRemoteObjects(lock).insert(ob);
+			const uint32 num_cells = msg_buffer.readUInt32();
+			if(num_cells > 100000)
+				throw glare::Exception("QueryObjects: too many cells: " + toString(num_cells));
 
-										world_state->markAsChanged();
-									}
-								}
-							}
-							break;
-						}
-					case Protocol::ObjectModelURLChanged:
-						{
-							//conPrint("ObjectModelURLChanged");
-							const UID object_uid = readUIDFromStream(msg_buffer);
-							const std::string new_model_url = msg_buffer.readStringLengthFirst(WorldObject::MAX_URL_SIZE);
+			//conPrint("QueryObjects, num_cells=" + toString(num_cells));
+	
+			// Read cell coords from network.  Cells are the same as the cells of the server object grid, see ServerObjectGrid::CELL_WIDTH.
+			std::vector<Vec3i> cells(num_cells);
+			for(uint32 i=0; i<num_cells; ++i)
+			{
+				const int x = msg_buffer.readInt32();
+				const int y = msg_buffer.readInt32();
+				const int z = msg_buffer.readInt32();
 
-							// Look up existing object in world state
-							{
-								WorldStateLock lock(world_state->mutex);
-								auto res = cur_world_state->getObjects(lock).find(object_uid);
-								if(res != cur_world_state->getObjects(lock).end())
-								{
-									WorldObject* ob = res->second.getPointer();
+				//if(i < 10)
+				//	conPrint("cell " + toString(i) + " coords: " + toString(x) + ", " + toString(y) + ", " + toString(z));
 
-									if(!world_state->isInReadOnlyMode())
-									{
-										ob->model_url = new_model_url;
-										ob->last_modified_time = TimeStamp::currentTime();
+				cells[i] = Vec3i(x, y, z);
+			}
 
-										ob->from_remote_model_url_dirty = true;
-										cur_world_state->addWorldObjectAsDBDirty(ob, lock);
-										cur_world_state->getDirtyFromRemoteObjects(lock).insert(ob);
+			// Remove any duplicate cells, so we don't send an object more than once.
+			std::sort(cells.begin(), cells.end(), [](const Vec3i& a, const Vec3i& b) { return a.x < b.x || (a.x == b.x && (a.y < b.y || (a.y == b.y && a.z < b.z))); });
+			cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
 
-										world_state->markAsChanged();
-									}
-								}
-							}
-							break;
-						}
-					case Protocol::ObjectFlagsChanged:
-						{
-							//conPrint("ObjectFlagsChanged");
-							const UID object_uid = readUIDFromStream(msg_buffer);
-							const uint32 flags = msg_buffer.readUInt32();
 
-							// Look up existing object in world state
-							{
-								WorldStateLock lock(world_state->mutex);
-								auto res = cur_world_state->getObjects(lock).find(object_uid);
-								if(res != cur_world_state->getObjects(lock).end())
-								{
-									WorldObject* ob = res->second.getPointer();
+			SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+			int num_obs_written = 0;
 
-									if(!world_state->isInReadOnlyMode())
-									{
-										ob->flags = flags; // Copy flags
-										ob->last_modified_time = TimeStamp::currentTime();
+			{ // Lock scope
+				WorldStateLock lock(world_state->mutex);
+				const ServerObjectGrid& object_grid = cur_world_state->getObjectGrid(lock);
+				for(size_t i=0; i<cells.size(); ++i)
+				{
+					const std::vector<WorldObject*>* cell_obs = object_grid.getObjectsInCell(cells[i]);
+					if(cell_obs)
+					{
+						for(size_t z=0; z<cell_obs->size(); ++z)
+						{
+							WorldObject* ob = (*cell_obs)[z];
 
-										ob->from_remote_flags_dirty = true;
-										cur_world_state->addWorldObjectAsDBDirty(ob, lock);
-										cur_world_state->getDirtyFromRemoteObjects(lock).insert(ob);
+							writeObjectInitialSendMessage(ob, packet, scratch_packet, *world_state, lock); // Append ObjectInitialSend message to packet.
 
-										world_state->markAsChanged();
-									}
-								}
-							}
-							break;
+							num_obs_written++;
 						}
-					case Protocol::ObjectPhysicsOwnershipTaken:
-						{
-							// conPrint("ObjectPhysicsOwnershipTaken");
-							const UID object_uid = readUIDFromStream(msg_buffer);
-							const uint32 physics_owner_id = msg_buffer.readUInt32();
-							const double client_global_time = msg_buffer.readDouble();
-							const uint32 flags = msg_buffer.readUInt32();
+					}
+				}
+			} // End lock scope
 
-							// Look up existing object in world state
-							{
-								WorldStateLock lock(world_state->mutex);
-								auto res = cur_world_state->getObjects(lock).find(object_uid);
-								if(res != cur_world_state->getObjects(lock).end())
-								{
-									WorldObject* ob = res->second.getPointer();
+			if(!packet.buf.empty())
+			{
+				conPrintIfNotFuzzing("QueryObjects: Sending back info on " + toString(num_obs_written) + " object(s) (" + getNiceByteSize(packet.buf.size()) + ") ...");
 
-									if(!world_state->isInReadOnlyMode())
-									{
-										ob->physics_owner_id = physics_owner_id;
-										ob->last_physics_ownership_change_global_time = client_global_time;
+				writeToClient(packet.buf.data(), packet.buf.size()); // Write data to network
+			}
+		
+			break;
+		}
+	case Protocol::QueryObjectsInAABB: // Client wants to query objects in a particular AABB
+		{
+			// This kind of query will be done when a client connects.
+			// Because the AABB can be quite large (>= 1km on each side), the number of objects returned can be large.
+			// Therefore we first work out the objects in the AABB, then sort by distance to camera, and send back the closer objects first.
+			// This allows the client to start loading and displaying objects before all the queried objects are returned, which can take a while.
+			//
+			// For sending over websocket connections, we will also flush occasionally, which sends a websocket frame.
+			// To do this we will record the offset of the start of chunks. (~= 4096 bytes)
+
+			Vec3d cam_position;
+			if(client_protocol_version >= 36) // position was introduced in protocol version 36.
+			{
+				cam_position = readVec3FromStream<double>(msg_buffer);
+				if(!cam_position.isFinite())
+					throw glare::Exception("Invalid cam_position");
+			}
+			else
+				cam_position = Vec3d(0.0);
 
-										// Consider physics_owner_id ephemeral state, so doesn't need to be written to DB.
-									}
-								}
-							}
+			const float lower_x = msg_buffer.readFloat();
+			const float lower_y = msg_buffer.readFloat();
+			const float lower_z = msg_buffer.readFloat();
+			const float upper_x = msg_buffer.readFloat();
+			const float upper_y = msg_buffer.readFloat();
+			const float upper_z = msg_buffer.readFloat();
 
-							// Enqueue ObjectPhysicsOwnershipTaken messages to worker threads to send
-							MessageUtils::initPacket(scratch_packet, Protocol::ObjectPhysicsOwnershipTaken);
-							writeToStream(object_uid, scratch_packet);
-							scratch_packet.writeUInt32(physics_owner_id);
-							scratch_packet.writeDouble(client_global_time);
-							scratch_packet.writeUInt32(flags);
-							MessageUtils::updatePacketLengthField(scratch_packet);
-							enqueuePacketToBroadcast(scratch_packet, server);
+			const js::AABBox aabb(Vec4f(lower_x, lower_y, lower_z, 1.f), Vec4f(upper_x, upper_y, upper_z, 1.f));
+	
+			conPrintIfNotFuzzing("QueryObjectsInAABB, aabb: " + aabb.toStringNSigFigs(4) + ", cam_position: " + cam_position.toString());
 
-							break;
-						}
-					case Protocol::CreateObject: // Client wants to create an object
-						{
-							conPrintIfNotFuzzing("CreateObject");
+			SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+			std::vector<size_t> chunk_begin_offsets; // Byte index of the start of a chunk (~= 4096 bytes).
+			chunk_begin_offsets.reserve(512);
+			chunk_begin_offsets.push_back(0);
+			size_t last_chunk_begin_offset = 0;
 
-							WorldObjectRef new_ob = new WorldObject();
-							new_ob->uid = readUIDFromStream(msg_buffer); // Read dummy UID
-							readWorldObjectFromNetworkStreamGivenUID(msg_buffer, *new_ob);
+			std::vector<WorldObject*> obs;
+			obs.reserve(16384);
 
-							conPrintIfNotFuzzing("model_url: '" + new_ob->model_url + "', pos: " + new_ob->pos.toString());
+			{ // Lock scope
+				WorldStateLock lock(world_state->mutex);
+				cur_world_state->getObjectGrid(lock).getObjectsInAABB(aabb, obs); // Get objects with a valid position that are in the query AABB.
 
-							// If client is not logged in, refuse object creation.
-							if(!client_user_id.valid())
-							{
-								conPrintIfNotFuzzing("Creation denied, user was not logged in.");
-								MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
-								scratch_packet.writeStringLengthFirst("You must be logged in to create an object.");
-								MessageUtils::updatePacketLengthField(scratch_packet);
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
-							}
-							else if(world_state->isInReadOnlyMode())
-							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't create an object right now.");
-							}
-							else
-							{
-								new_ob->creator_id = client_user_id;
-								new_ob->created_time = TimeStamp::currentTime();
-								new_ob->last_modified_time = new_ob->created_time;
-								new_ob->creator_name = client_user_name;
-
-								std::set<DependencyURL> URLs;
-								WorldObject::GetDependencyOptions options;
-								new_ob->getDependencyURLSetBaseLevel(options, URLs);
-								for(auto it = URLs.begin(); it != URLs.end(); ++it)
-									sendGetFileMessageIfNeeded(it->URL);
-
-								// Insert object into world state
-								{
-									::WorldStateLock lock(world_state->mutex);
+				// Sort objects from near to far from camera.
+				struct WorldObjectDistComparator
+				{
+					bool operator () (const WorldObject* a, const WorldObject* b)
+					{
+						const double a_dist2 = a->pos.getDist2(campos);
+						const double b_dist2 = b->pos.getDist2(campos);
+						return a_dist2 < b_dist2;
+					}
+					Vec3d campos;
+				};
 
-									new_ob->uid = world_state->getNextObjectUID();
-									new_ob->state = WorldObject::State_JustCreated;
-									new_ob->from_remote_other_dirty = true;
-									cur_world_state->addWorldObjectAsDBDirty(new_ob, lock);
-									cur_world_state->getDirtyFromRemoteObjects(lock).insert(new_ob);
-									cur_world_state->getObjects(lock).insert(std::make_pair(new_ob->uid, new_ob));
+				WorldObjectDistComparator comparator;
+				comparator.campos = cam_position;
+				std::sort(obs.begin(), obs.end(), comparator);
 
-									world_state->markAsChanged();
-								}
-							}
+				for(size_t i=0; i<obs.size(); ++i)
+				{
+					WorldObject* ob = obs[i];
 
-							break;
-						}
-					case Protocol::DestroyObject: // Client wants to destroy an object.
-						{
-							conPrintIfNotFuzzing("DestroyObject");
-							const UID object_uid = readUIDFromStream(msg_buffer);
+					writeObjectInitialSendMessage(ob, packet, scratch_packet, *world_state, lock); // Append ObjectInitialSend message to packet.
 
-							// If client is not logged in, refuse object modification.
-							if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to destroy an object.");
-							}
-							else if(world_state->isInReadOnlyMode())
-							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't destroy an object right now.");
-							}
-							else
-							{
-								bool send_must_be_owner_msg = false;
-								{
-									WorldStateLock lock(world_state->mutex);
-									auto res = cur_world_state->getObjects(lock).find(object_uid);
-									if(res != cur_world_state->getObjects(lock).end())
-									{
-										WorldObject* ob = res->second.getPointer();
-
-										// See if the user has permissions to alter this object:
-										const bool have_delete_perms = userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms, lock);
-										if(!have_delete_perms)
-											send_must_be_owner_msg = true;
-										else
-										{
-											// Mark object as dead
-											ob->state = WorldObject::State_Dead;
-											ob->from_remote_other_dirty = true;
-											cur_world_state->addWorldObjectAsDBDirty(ob, lock);
-											cur_world_state->getDirtyFromRemoteObjects(lock).insert(ob);
-
-											world_state->markAsChanged();
-										}
-									}
-								} // End lock scope
-
-								if(send_must_be_owner_msg)
-									writeErrorMessageToClient(socket, "You must be the owner of this object to destroy it.");
-							}
-							break;
-						}
-					case Protocol::GetAllObjects: // Client wants to get all objects in world
-						{
-							conPrintIfNotFuzzing("GetAllObjects");
+					if(packet.buf.size() - last_chunk_begin_offset >= 4096) // If we have written more than X bytes since last chunk start:
+					{
+						last_chunk_begin_offset = packet.buf.size();
+						chunk_begin_offsets.push_back(packet.buf.size()); // Record offset of start of chunk.
+					}
+				}
+			} // End lock scope
 
-							SocketBufferOutStream temp_buf(SocketBufferOutStream::DontUseNetworkByteOrder); // Will contain several messages
+			// Send back the data, now we have released the world lock.  Send it back in chunks instead of one big write. (better for websockets)
+			if(!packet.buf.empty())
+			{
+				conPrintIfNotFuzzing("QueryObjectsInAABB: Sending back info on " + toString(obs.size()) + " object(s) (" + getNiceByteSize(packet.buf.size()) + ")...");
+				Timer timer;
 
-							{
-								WorldStateLock lock(world_state->mutex);
-								const ServerWorldState::ObjectMapType& objects = cur_world_state->getObjects(lock);
-								for(auto it = objects.begin(); it != objects.end(); ++it)
-								{
-									const WorldObject* ob = it->second.getPointer();
+				for(size_t i=0; i<chunk_begin_offsets.size(); ++i)
+				{
+					const size_t chunk_offset = chunk_begin_offsets[i];
+					if(chunk_offset < packet.buf.size())
+					{
+						const size_t chunk_end = ((i + 1) < chunk_begin_offsets.size()) ? chunk_begin_offsets[i + 1] : packet.buf.size();
+						const size_t chunk_size = chunk_end - chunk_offset;
+						runtimeCheck((chunk_offset < packet.buf.size()) && (CheckedMaths::addUnsignedInts(chunk_offset, chunk_size) <= packet.buf.size())); 
+						writeToClient(&packet.buf[chunk_offset], chunk_size); // Write data to network.  Will cause websockets to send a data frame.
+					}
+				}
 
-									// Build ObjectInitialSend message
-									MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
-									ob->writeToNetworkStream(scratch_packet);
-									MessageUtils::updatePacketLengthField(scratch_packet);
+				conPrintIfNotFuzzing("QueryObjectsInAABB: Sending back info on objects took " + timer.elapsedStringNSigFigs(4));
+			}
 
-									temp_buf.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								}
-							}
+			break;
+		}
+	case Protocol::QueryParcels:
+		{
+			conPrintIfNotFuzzing("QueryParcels");
 
-							MessageUtils::initPacket(scratch_packet, Protocol::AllObjectsSent); // Terminate the buffer with an AllObjectsSent message.
-							MessageUtils::updatePacketLengthField(scratch_packet);
-							temp_buf.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+			// Send all current parcel data to client
+			MessageUtils::initPacket(scratch_packet, Protocol::ParcelList);
+			{
+				WorldStateLock lock(world_state->mutex);
+				scratch_packet.writeUInt64(cur_world_state->getParcels(lock).size()); // Write num parcels
+				for(auto it = cur_world_state->getParcels(lock).begin(); it != cur_world_state->getParcels(lock).end(); ++it)
+					writeToNetworkStream(*it->second, scratch_packet, client_protocol_version); // Write parcel
+			}
+			MessageUtils::updatePacketLengthField(scratch_packet);
+			writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size()); // Send the data
+			break;
+		}
+	case Protocol::ParcelFullUpdate: // Client wants to update a parcel
+		{
+			conPrintIfNotFuzzing("ParcelFullUpdate");
+			const ParcelID parcel_id = readParcelIDFromStream(msg_buffer);
 
-							socket->writeData(temp_buf.buf.data(), temp_buf.buf.size());
-							socket->flush();
+			Parcel temp_parcel;
+			readFromNetworkStreamGivenID(msg_buffer, temp_parcel, client_protocol_version);
 
-							break;
+			// If client is not logged in, refuse parcel modification.
+			if(!client_user_id.valid())
+			{
+				writeErrorMessageToClient("You must be logged in to modify a parcel.");
+			}
+			else if(world_state->isInReadOnlyMode())
+			{
+				writeErrorMessageToClient("Server is in read-only mode, you can't modify a parcel right now.");
+			}
+			else
+			{
+				// Look up existing parcel in world state
+				std::string error_msg;
+				{
+					WorldStateLock lock(world_state->mutex);
+					auto res = cur_world_state->getParcels(lock).find(parcel_id);
+					if(res != cur_world_state->getParcels(lock).end())
+					{
+						Parcel* parcel = res->second.getPointer();
+
+						// See if the user has permissions to alter this object:
+						if(!userHasParcelWritePermissions(*parcel, client_user_id, this->connected_world_name, *cur_world_state))
+						{
+							error_msg = "You must be the owner of this parcel (or have write permissions) to modify it";
 						}
-					case Protocol::QueryObjects: // Client wants to query objects in certain grid cells
+						else
 						{
-							Vec3d cam_position;
-							if(client_protocol_version >= 36) // position was introduced in protocol version 36.
-								cam_position = readVec3FromStream<double>(msg_buffer);
-							else
-								cam_position = Vec3d(0.0);
+							parcel->copyNetworkStateFrom(temp_parcel, /*restrict_changes=*/true); // restrict changes to stuff clients are allowed to change
 
-							const uint32 num_cells = msg_buffer.readUInt32();
-							if(num_cells > 100000)
-								throw glare::Exception("QueryObjects: too many cells: " + toString(num_cells));
+							//parcel->from_remote_other_dirty = true;
+							cur_world_state->addParcelAsDBDirty(parcel, lock);
+							//cur_world_state->dirty_from_remote_parcels.insert(ob);
 
-							//conPrint("QueryObjects, num_cells=" + toString(num_cells));
-					
-							// Read cell coords from network and make AABBs for cells
-							js::Vector<js::AABBox, 16> cell_aabbs(num_cells);
-							for(uint32 i=0; i<num_cells; ++i)
-							{
-								const int x = msg_buffer.readInt32();
-								const int y = msg_buffer.readInt32();
-								const int z = msg_buffer.readInt32();
+							world_state->markAsChanged();
+						}
+					}
+				} // End lock scope
 
-								//if(i < 10)
-								//	conPrint("cell " + toString(i) + " coords: " + toString(x) + ", " + toString(y) + ", " + toString(z));
+				if(!error_msg.empty())
+					writeErrorMessageToClient(error_msg);
+			}
+			break;
+		}
+	case Protocol::QueryLODChunksMessage:
+		{
+			conPrintIfNotFuzzing("QueryLODChunksMessage");
 
-								const float CELL_WIDTH = 200.f; // NOTE: has to be the same value as in gui_client/ProximityLoader.cpp.
+			// Send all current LOD chunk data to client
+			SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+			{
+				WorldStateLock lock(world_state->mutex);
+				for(auto it = cur_world_state->getLODChunks(lock).begin(); it != cur_world_state->getLODChunks(lock).end(); ++it)
+				{
+					MessageUtils::initPacket(scratch_packet, Protocol::LODChunkInitialSend);
+					it->second->writeToStream(scratch_packet);
+					MessageUtils::updatePacketLengthField(scratch_packet);
 
-								cell_aabbs[i] = js::AABBox(
-									Vec4f(0,0,0,1) + Vec4f((float)x,     (float)y,     (float)z,     0)*CELL_WIDTH,
-									Vec4f(0,0,0,1) + Vec4f((float)(x+1), (float)(y+1), (float)(z+1), 0)*CELL_WIDTH
-								);
-							}
+					packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); // Append scratch_packet with LODChunkInitialSend message to packet.
+				}
+			}
+			writeToClient(packet.buf.data(), packet.buf.size()); // Send the data
+			break;
+		}
+	case Protocol::ChatMessageID:
+		{
+			//const std::string name = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+			const std::string msg = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
 
+			conPrintIfNotFuzzing("Received chat message: '" + msg + "'");
 
-							SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-							int num_obs_written = 0;
+			if(!client_user_id.valid())
+			{
+				writeErrorMessageToClient("You must be logged in to chat.");
+			}
+			else
+			{
+				// Enqueue chat messages to worker threads to send
+				// Send ChatMessageID packet
+				MessageUtils::initPacket(scratch_packet, Protocol::ChatMessageID);
+				scratch_packet.writeStringLengthFirst(client_user_name);
+				scratch_packet.writeStringLengthFirst(msg);
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-							{ // Lock scope
-								WorldStateLock lock(world_state->mutex);
-								const ServerWorldState::ObjectMapType& objects = cur_world_state->getObjects(lock);
-								for(auto it = objects.begin(); it != objects.end(); ++it)
-								{
-									const WorldObject* ob = it->second.ptr();
-
-									// See if the object is in any of the cell AABBs
-									bool in_cell = false;
-									for(uint32 i=0; i<num_cells; ++i)
-										if(cell_aabbs[i].contains(ob->pos.toVec4fPoint()))
-										{
-											in_cell = true;
-											break;
-										}
-
-									if(in_cell)
-									{
-										// Send ObjectInitialSend packet
-										MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
-										ob->writeToNetworkStream(scratch_packet);
-										MessageUtils::updatePacketLengthField(scratch_packet);
-
-										packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); 
-
-										num_obs_written++;
-									}
-								}
-							} // End lock scope
+				enqueuePacketToBroadcast(scratch_packet, server);
+			}
+			break;
+		}
+	case Protocol::UserSelectedObject:
+		{
+			//conPrint("Received UserSelectedObject msg.");
 
-							if(!packet.buf.empty())
-							{
-								conPrintIfNotFuzzing("QueryObjects: Sending back info on " + toString(num_obs_written) + " object(s) (" + getNiceByteSize(packet.buf.size()) + ") ...");
+			const UID object_uid = readUIDFromStream(msg_buffer);
 
-								socket->writeData(packet.buf.data(), packet.buf.size()); // Write data to network
-								socket->flush();
-							}
-						
-							break;
-						}
-					case Protocol::QueryObjectsInAABB: // Client wants to query objects in a particular AABB
-						{
-							// This kind of query will be done when a client connects.
-							// Because the AABB can be quite large (>= 1km on each side), the number of objects returned can be large.
-							// Therefore we first work out the objects in the AABB, then sort by distance to camera, and send back the closer objects first.
-							// This allows the client to start loading and displaying objects before all the queried objects are returned, which can take a while.
-							//
-							// For sending over websocket connections, we will also flush occasionally, which sends a websocket frame.
-							// To do this we will record the offset of the start of chunks. (~= 4096 bytes)
-
-							Vec3d cam_position;
-							if(client_protocol_version >= 36) // position was introduced in protocol version 36.
-							{
-								cam_position = readVec3FromStream<double>(msg_buffer);
-								if(!cam_position.isFinite())
-									throw glare::Exception("Invalid cam_position");
-							}
-							else
-								cam_position = Vec3d(0.0);
-
-							const float lower_x = msg_buffer.readFloat();
-							const float lower_y = msg_buffer.readFloat();
-							const float lower_z = msg_buffer.readFloat();
-							const float upper_x = msg_buffer.readFloat();
-							const float upper_y = msg_buffer.readFloat();
-							const float upper_z = msg_buffer.readFloat();
-
-							const js::AABBox aabb(Vec4f(lower_x, lower_y, lower_z, 1.f), Vec4f(upper_x, upper_y, upper_z, 1.f));
-					
-							conPrintIfNotFuzzing("QueryObjectsInAABB, aabb: " + aabb.toStringNSigFigs(4) + ", cam_position: " + cam_position.toString());
-
-							SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-							std::vector<size_t> chunk_begin_offsets; // Byte index of the start of a chunk (~= 4096 bytes).
-							chunk_begin_offsets.reserve(512);
-							chunk_begin_offsets.push_back(0);
-							size_t last_chunk_begin_offset = 0;
-
-							std::vector<const WorldObject*> obs;
-							obs.reserve(16384);
-
-							{ // Lock scope
-								WorldStateLock lock(world_state->mutex);
-								const ServerWorldState::ObjectMapType& objects = cur_world_state->getObjects(lock);
-								for(auto it = objects.begin(); it != objects.end(); ++it)
-								{
-									const WorldObject* ob = it->second.ptr();
-									const Vec4f ob_pos_vec4f = ob->pos.toVec4fPoint();
-									if(ob_pos_vec4f.isFinite() && aabb.contains(ob_pos_vec4f)) // If the object position is valid, and if it's in the query AABB:
-										obs.push_back(ob);
-								}
+			// Send message to connected clients
+			{
+				MessageUtils::initPacket(scratch_packet, Protocol::UserSelectedObject);
+				writeToStream(client_avatar_uid, scratch_packet);
+				writeToStream(object_uid, scratch_packet);
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-								// Sort objects from near to far from camera.
-								struct WorldObjectDistComparator
-								{
-									bool operator () (const WorldObject* a, const WorldObject* b)
-									{
-										const double a_dist2 = a->pos.getDist2(campos);
-										const double b_dist2 = b->pos.getDist2(campos);
-										return a_dist2 < b_dist2;
-									}
-									Vec3d campos;
-								};
-
-								WorldObjectDistComparator comparator;
-								comparator.campos = cam_position;
-								std::sort(obs.begin(), obs.end(), comparator);
-
-								for(size_t i=0; i<obs.size(); ++i)
-								{
-									const WorldObject* ob = obs[i];
+				enqueuePacketToBroadcast(scratch_packet, server);
+			}
+			break;
+		}
+	case Protocol::UserDeselectedObject:
+		{
+			//conPrint("Received UserDeselectedObject msg.");
 
-									// Create ObjectInitialSend packet
-									MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
-									ob->writeToNetworkStream(scratch_packet);
-									MessageUtils::updatePacketLengthField(scratch_packet);
+			const UID object_uid = readUIDFromStream(msg_buffer);
 
-									packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); // Append scratch_packet with ObjectInitialSend message to packet.
+			// Send message to connected clients
+			{
+				MessageUtils::initPacket(scratch_packet, Protocol::UserDeselectedObject);
+				writeToStream(client_avatar_uid, scratch_packet);
+				writeToStream(object_uid, scratch_packet);
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-									if(packet.buf.size() - last_chunk_begin_offset >= 4096) // If we have written more than X bytes since last chunk start:
-									{
-										last_chunk_begin_offset = packet.buf.size();
-										chunk_begin_offsets.push_back(packet.buf.size()); // Record offset of start of chunk.
-									}
-								}
-							} // End lock scope
+				enqueuePacketToBroadcast(scratch_packet, server);
+			}
+			break;
+		}
+	case Protocol::UserUsedObjectMessage:
+		{
+			conPrintIfNotFuzzing("Received UserUsedObjectMessage msg.");
 
-							// Send back the data, now we have released the world lock.  Send it back in chunks instead of one big write. (better for websockets)
-							if(!packet.buf.empty())
-							{
-								conPrintIfNotFuzzing("QueryObjectsInAABB: Sending back info on " + toString(obs.size()) + " object(s) (" + getNiceByteSize(packet.buf.size()) + ")...");
-								Timer timer;
+			const UID object_uid = readUIDFromStream(msg_buffer);
 
-								for(size_t i=0; i<chunk_begin_offsets.size(); ++i)
-								{
-									const size_t chunk_offset = chunk_begin_offsets[i];
-									if(chunk_offset < packet.buf.size())
-									{
-										const size_t chunk_end = ((i + 1) < chunk_begin_offsets.size()) ? chunk_begin_offsets[i + 1] : packet.buf.size();
-										const size_t chunk_size = chunk_end - chunk_offset;
-										runtimeCheck((chunk_offset < packet.buf.size()) && (CheckedMaths::addUnsignedInts(chunk_offset, chunk_size) <= packet.buf.size())); 
-										socket->writeData(&packet.buf[chunk_offset], chunk_size); // Write data to network
-										socket->flush(); // Will cause websockets to send a data frame.
-									}
-								}
+			conPrintIfNotFuzzing("object_uid: " + object_uid.toString());
 
-								conPrintIfNotFuzzing("QueryObjectsInAABB: Sending back info on objects took " + timer.elapsedStringNSigFigs(4));
-							}
+			Reference<UserUsedObjectThreadMessage> msg = new UserUsedObjectThreadMessage();
+			msg->world = cur_world_state;
+			msg->avatar_uid = client_avatar_uid;
+			msg->object_uid = object_uid;
+			server->enqueueMsg(msg);
 
-							break;
-						}
-					case Protocol::QueryParcels:
-						{
-							conPrintIfNotFuzzing("QueryParcels");
+			break;
+		}
+	case Protocol::UserTouchedObjectMessage:
+		{
+			conPrintIfNotFuzzing("Received UserTouchedObjectMessage msg.");
 
-							// Send all current parcel data to client
-							MessageUtils::initPacket(scratch_packet, Protocol::ParcelList);
-							{
-								WorldStateLock lock(world_state->mutex);
-								scratch_packet.writeUInt64(cur_world_state->getParcels(lock).size()); // Write num parcels
-								for(auto it = cur_world_state->getParcels(lock).begin(); it != cur_world_state->getParcels(lock).end(); ++it)
-									writeToNetworkStream(*it->second, scratch_packet, client_protocol_version); // Write parcel
-							}
-							MessageUtils::updatePacketLengthField(scratch_packet);
-							socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); // Send the data
-							socket->flush();
-							break;
-						}
-					case Protocol::ParcelFullUpdate: // Client wants to update a parcel
-						{
-							conPrintIfNotFuzzing("ParcelFullUpdate");
-							const ParcelID parcel_id = readParcelIDFromStream(msg_buffer);
+			const UID object_uid = readUIDFromStream(msg_buffer);
 
-							Parcel temp_parcel;
-							readFromNetworkStreamGivenID(msg_buffer, temp_parcel, client_protocol_version);
+			Reference<UserTouchedObjectThreadMessage> msg = new UserTouchedObjectThreadMessage();
+			msg->world = cur_world_state;
+			msg->avatar_uid = client_avatar_uid;
+			msg->object_uid = object_uid;
+			server->enqueueMsg(msg);
 
-							// If client is not logged in, refuse parcel modification.
-							if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify a parcel.");
-							}
-							else if(world_state->isInReadOnlyMode())
-							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify a parcel right now.");
-							}
-							else
-							{
-								// Look up existing parcel in world state
-								std::string error_msg;
-								{
-									WorldStateLock lock(world_state->mutex);
-									auto res = cur_world_state->getParcels(lock).find(parcel_id);
-									if(res != cur_world_state->getParcels(lock).end())
-									{
-										Parcel* parcel = res->second.getPointer();
-
-										// See if the user has permissions to alter this object:
-										if(!userHasParcelWritePermissions(*parcel, client_user_id, this->connected_world_name, *cur_world_state))
-										{
-											error_msg = "You must be the owner of this parcel (or have write permissions) to modify it";
-										}
-										else
-										{
-											parcel->copyNetworkStateFrom(temp_parcel, /*restrict_changes=*/true); // restrict changes to stuff clients are allowed to change
-
-											//parcel->from_remote_other_dirty = true;
-											cur_world_state->addParcelAsDBDirty(parcel, lock);
-											//cur_world_state->dirty_from_remote_parcels.insert(ob);
-
-											world_state->markAsChanged();
-										}
-									}
-								} // End lock scope
-
-								if(!error_msg.empty())
-									writeErrorMessageToClient(socket, error_msg);
-							}
-							break;
-						}
-					case Protocol::QueryLODChunksMessage:
-						{
-							conPrintIfNotFuzzing("QueryLODChunksMessage");
+			break;
+		}
+	case Protocol::UserMovedNearToObjectMessage:
+		{
+			conPrintIfNotFuzzing("Received UserMovedNearToObjectMessage msg.");
 
-							// Send all current LOD chunk data to client
-							SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-							{
-								WorldStateLock lock(world_state->mutex);
-								for(auto it = cur_world_state->getLODChunks(lock).begin(); it != cur_world_state->getLODChunks(lock).end(); ++it)
-								{
-									MessageUtils::initPacket(scratch_packet, Protocol::LODChunkInitialSend);
-									it->second->writeToStream(scratch_packet);
-									MessageUtils::updatePacketLengthField(scratch_packet);
+			const UID object_uid = readUIDFromStream(msg_buffer);
 
-									packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); // Append scratch_packet with LODChunkInitialSend message to packet.
-								}
-							}
-							socket->writeData(packet.buf.data(), packet.buf.size()); // Send the data
-							socket->flush();
-							break;
-						}
-					case Protocol::ChatMessageID:
-						{
-							//const std::string name = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-							const std::string msg = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+			Reference<UserMovedNearToObjectThreadMessage> msg = new UserMovedNearToObjectThreadMessage();
+			msg->world = cur_world_state;
+			msg->avatar_uid = client_avatar_uid;
+			msg->object_uid = object_uid;
+			server->enqueueMsg(msg);
 
-							conPrintIfNotFuzzing("Received chat message: '" + msg + "'");
+			break;
+		}
+	case Protocol::UserMovedAwayFromObjectMessage:
+		{
+			conPrintIfNotFuzzing("Received UserMovedAwayFromObjectMessage msg.");
 
-							if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to chat.");
-							}
-							else
-							{
-								// Enqueue chat messages to worker threads to send
-								// Send ChatMessageID packet
-								MessageUtils::initPacket(scratch_packet, Protocol::ChatMessageID);
-								scratch_packet.writeStringLengthFirst(client_user_name);
-								scratch_packet.writeStringLengthFirst(msg);
-								MessageUtils::updatePacketLengthField(scratch_packet);
-
-								enqueuePacketToBroadcast(scratch_packet, server);
-							}
-							break;
-						}
-					case Protocol::UserSelectedObject:
-						{
-							//conPrint("Received UserSelectedObject msg.");
+			const UID object_uid = readUIDFromStream(msg_buffer);
 
-							const UID object_uid = readUIDFromStream(msg_buffer);
+			Reference<UserMovedAwayFromObjectThreadMessage> msg = new UserMovedAwayFromObjectThreadMessage();
+			msg->world = cur_world_state;
+			msg->avatar_uid = client_avatar_uid;
+			msg->object_uid = object_uid;
+			server->enqueueMsg(msg);
 
-							// Send message to connected clients
-							{
-								MessageUtils::initPacket(scratch_packet, Protocol::UserSelectedObject);
-								writeToStream(client_avatar_uid, scratch_packet);
-								writeToStream(object_uid, scratch_packet);
-								MessageUtils::updatePacketLengthField(scratch_packet);
+			break;
+		}
+	case Protocol::UserEnteredParcelMessage:
+		{
+			conPrintIfNotFuzzing("Received UserEnteredParcelMessage msg.");
 
-								enqueuePacketToBroadcast(scratch_packet, server);
-							}
-							break;
-						}
-					case Protocol::UserDeselectedObject:
-						{
-							//conPrint("Received UserDeselectedObject msg.");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+			const ParcelID parcel_id = readParcelIDFromStream(msg_buffer);
+
+			Reference<UserEnteredParcelThreadMessage> msg = new UserEnteredParcelThreadMessage();
+			msg->world = cur_world_state;
+			msg->avatar_uid = client_avatar_uid;
+			msg->object_uid = object_uid;
+			msg->parcel_id = parcel_id;
+			server->enqueueMsg(msg);
+
+			break;
+		}
+	case Protocol::UserExitedParcelMessage:
+		{
+			conPrintIfNotFuzzing("Received UserExitedParcelMessage msg.");
 
-							const UID object_uid = readUIDFromStream(msg_buffer);
+			const UID object_uid = readUIDFromStream(msg_buffer);
+			const ParcelID parcel_id = readParcelIDFromStream(msg_buffer);
+
+			Reference<UserExitedParcelThreadMessage> msg = new UserExitedParcelThreadMessage();
+			msg->world = cur_world_state;
+			msg->avatar_uid = client_avatar_uid;
+			msg->object_uid = object_uid;
+			msg->parcel_id = parcel_id;
+			server->enqueueMsg(msg);
+
+			break;
+		}
+	case Protocol::LogInMessage: // Client wants to log in.
+		{
+			conPrintIfNotFuzzing("LogInMessage");
+
+			const std::string username = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+			const std::string password = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+
+			conPrintIfNotFuzzing("username: '" + username + "'");
+		
+			bool logged_in = false;
+			{
+				Lock lock(world_state->mutex);
+				auto res = world_state->name_to_users.find(username);
+				if(res != world_state->name_to_users.end())
+				{
+					User* user = res->second.getPointer();
+					const bool password_valid = user->isPasswordValid(password);
+					conPrintIfNotFuzzing("password_valid: " + boolToString(password_valid));
+					if(password_valid)
+					{
+						// Password is valid, log user in.
+						client_user_id = user->id;
+						client_user_name = user->name;
+						client_user_avatar_settings = user->avatar_settings;
+						client_user_flags = user->flags;
 
-							// Send message to connected clients
+						logged_in = true;
+					}
+				}
+			}
+
+			conPrintIfNotFuzzing("logged_in: " + boolToString(logged_in));
+			if(logged_in)
+			{
+				if(username == "lightmapperbot")
+					logged_in_user_is_lightmapper_bot = true;
+
+				// Send logged-in message to client
+				MessageUtils::initPacket(scratch_packet, Protocol::LoggedInMessageID);
+				writeToStream(client_user_id, scratch_packet);
+				scratch_packet.writeStringLengthFirst(username);
+				writeAvatarSettingsToStream(client_user_avatar_settings, scratch_packet);
+				scratch_packet.writeUInt32(client_user_flags);
+				MessageUtils::updatePacketLengthField(scratch_packet);
+
+				writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+			}
+			else
+			{
+				// Login failed.  Send error message back to client
+				MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
+				scratch_packet.writeStringLengthFirst("Login failed: username or password incorrect.");
+				MessageUtils::updatePacketLengthField(scratch_packet);
+
+				writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+			}
+	
+			break;
+		}
+	case Protocol::LogOutMessage: // Client wants to log out.
+		{
+			conPrintIfNotFuzzing("LogOutMessage");
+
+			client_user_id = UserID::invalidUserID(); // Mark the client as not logged in.
+			client_user_name = "";
+			client_user_flags = 0;
+
+			// Send logged-out message to client
+			MessageUtils::initPacket(scratch_packet, Protocol::LoggedOutMessageID);
+			MessageUtils::updatePacketLengthField(scratch_packet);
+
+			writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+			break;
+		}
+	case Protocol::SignUpMessage:
+		{
+			conPrintIfNotFuzzing("SignUpMessage");
+
+			const std::string username = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+			const std::string email    = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+			const std::string password = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+
+			try
+			{
+				conPrintIfNotFuzzing("username: '" + username + "', email: '" + email + "'");
+
+				bool signed_up = false;
+
+				std::string msg_to_client;
+				if(world_state->isInReadOnlyMode())
+				{
+					msg_to_client = "Server is in read-only mode, you can't sign up right now.";
+				}
+				else
+				{
+					if(username.size() < 3)
+						msg_to_client = "Username is too short, must have at least 3 characters";
+					else
+					{
+						if(password.size() < 6)
+							msg_to_client = "Password is too short, must have at least 6 characters";
+						else
+						{
+							Lock lock(world_state->mutex);
+							auto res = world_state->name_to_users.find(username);
+							if(res == world_state->name_to_users.end())
 							{
-								MessageUtils::initPacket(scratch_packet, Protocol::UserDeselectedObject);
-								writeToStream(client_avatar_uid, scratch_packet);
-								writeToStream(object_uid, scratch_packet);
-								MessageUtils::updatePacketLengthField(scratch_packet);
+								Reference<User> new_user = new User();
+								new_user->id = UserID((uint32)world_state->name_to_users.size());
+								new_user->created_time = TimeStamp::currentTime();
+								new_user->name = username;
+								new_user->email_address = email;
+
+								new_user->setNewPasswordAndSalt(password);
+
+								world_state->addUserAsDBDirty(new_user);
+
+								// Add new user to world state
+								world_state->user_id_to_users.insert(std::make_pair(new_user->id, new_user));
+								world_state->name_to_users   .insert(std::make_pair(username,     new_user));
+								world_state->markAsChanged(); // Mark as changed so gets saved to disk.
 
-								enqueuePacketToBroadcast(scratch_packet, server);
+								client_user_id = new_user->id; // Log user in as well.
+								client_user_name = new_user->name;
+								client_user_avatar_settings = new_user->avatar_settings;
+								client_user_flags = new_user->flags;
+
+								signed_up = true;
 							}
-							break;
 						}
-					case Protocol::UserUsedObjectMessage:
-						{
-							conPrintIfNotFuzzing("Received UserUsedObjectMessage msg.");
+					}
+				}
 
-							const UID object_uid = readUIDFromStream(msg_buffer);
+				conPrintIfNotFuzzing("signed_up: " + boolToString(signed_up));
+				if(signed_up)
+				{
+					conPrintIfNotFuzzing("Sign up successful");
+					// Send signed-up message to client
+					MessageUtils::initPacket(scratch_packet, Protocol::SignedUpMessageID);
+					writeToStream(client_user_id, scratch_packet);
+					scratch_packet.writeStringLengthFirst(username);
+					MessageUtils::updatePacketLengthField(scratch_packet);
+
+					writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+				}
+				else
+				{
+					conPrintIfNotFuzzing("Sign up failed.");
 
-							conPrintIfNotFuzzing("object_uid: " + object_uid.toString());
+					// signup failed.  Send error message back to client
+					MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
+					scratch_packet.writeStringLengthFirst(msg_to_client);
+					MessageUtils::updatePacketLengthField(scratch_packet);
 
-							Reference<UserUsedObjectThreadMessage> msg = new UserUsedObjectThreadMessage();
-							msg->world = cur_world_state;
-							msg->avatar_uid = client_avatar_uid;
-							msg->object_uid = object_uid;
-							server->enqueueMsg(msg);
+					writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+				}
+			}
+			catch(glare::Exception& e)
+			{
+				conPrint("Sign up failed, internal error: " + e.what());
 
-							break;
-						}
-					case Protocol::UserTouchedObjectMessage:
-						{
-							conPrintIfNotFuzzing("Received UserTouchedObjectMessage msg.");
+				// signup failed.  Send error message back to client
+				MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
+				scratch_packet.writeStringLengthFirst("Signup failed: internal error.");
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-							const UID object_uid = readUIDFromStream(msg_buffer);
+				writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+			}
 
-							Reference<UserTouchedObjectThreadMessage> msg = new UserTouchedObjectThreadMessage();
-							msg->world = cur_world_state;
-							msg->avatar_uid = client_avatar_uid;
-							msg->object_uid = object_uid;
-							server->enqueueMsg(msg);
+			break;
+		}
+	case Protocol::RequestPasswordReset:
+		{
+			conPrintIfNotFuzzing("RequestPasswordReset");
+
+			const std::string email    = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+
+			// NOTE: This stuff is done via the website now instead.
+
+			//conPrint("email: " + email);
+			//
+			//// TEMP: Send password reset email in this thread for now. 
+			//// TODO: move to another thread (make some kind of background task?)
+			//{
+			//	Lock lock(world_state->mutex);
+			//	for(auto it = world_state->user_id_to_users.begin(); it != world_state->user_id_to_users.end(); ++it)
+			//		if(it->second->email_address == email)
+			//		{
+			//			User* user = it->second.getPointer();
+			//			try
+			//			{
+			//				user->sendPasswordResetEmail();
+			//				world_state->markAsChanged(); // Mark as changed so gets saved to disk.
+			//				conPrint("Sent user password reset email to '" + email + ", username '" + user->name + "'");
+			//			}
+			//			catch(glare::Exception& e)
+			//			{
+			//				conPrint("Sending password reset email failed: " + e.what());
+			//			}
+			//		}
+			//}
+	
+			break;
+		}
+	case Protocol::ChangePasswordWithResetToken:
+		{
+			conPrintIfNotFuzzing("ChangePasswordWithResetToken");
+		
+			const std::string email			= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+			const std::string reset_token	= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+			const std::string new_password	= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
 
-							break;
-						}
-					case Protocol::UserMovedNearToObjectMessage:
-						{
-							conPrintIfNotFuzzing("Received UserMovedNearToObjectMessage msg.");
+			// NOTE: This stuff is done via the website now instead.
+	
+			//conPrint("email: " + email);
+			//conPrint("reset_token: " + reset_token);
+			////conPrint("new_password: " + new_password);
+			//
+			//{
+			//	Lock lock(world_state->mutex);
+			//
+			//	// Find user with the given email address:
+			//	for(auto it = world_state->user_id_to_users.begin(); it != world_state->user_id_to_users.end(); ++it)
+			//		if(it->second->email_address == email)
+			//		{
+			//			User* user = it->second.getPointer();
+			//			const bool reset = user->resetPasswordWithToken(reset_token, new_password);
+			//			if(reset)
+			//			{
+			//				world_state->markAsChanged(); // Mark as changed so gets saved to disk.
+			//				conPrint("User password successfully updated.");
+			//			}
+			//		}
+			//}
+
+			break;
+		}
+	case Protocol::WorldSettingsUpdate:
+		{
+			conPrintIfNotFuzzing("WorldSettingsUpdate");
+		
+			WorldSettings world_settings;
+			readWorldSettingsFromStream(msg_buffer, world_settings);
 
-							const UID object_uid = readUIDFromStream(msg_buffer);
+			if(userConnectedToTheirPersonalWorldOrGodUser(client_user_id, client_user_name, this->connected_world_name))
+			{
+				{
+					Lock lock(server->world_state->mutex);
+					cur_world_state->world_settings.copyNetworkStateFrom(world_settings);
+					cur_world_state->world_settings.db_dirty = true;
+					world_state->markAsChanged();
+				}
 
-							Reference<UserMovedNearToObjectThreadMessage> msg = new UserMovedNearToObjectThreadMessage();
-							msg->world = cur_world_state;
-							msg->avatar_uid = client_avatar_uid;
-							msg->object_uid = object_uid;
-							server->enqueueMsg(msg);
+				// Process resources
+				std::set<DependencyURL> URLs;
+				world_settings.getDependencyURLSet(URLs);
+				for(auto it = URLs.begin(); it != URLs.end(); ++it)
+					sendGetFileMessageIfNeeded(it->URL);
 
-							break;
-						}
-					case Protocol::UserMovedAwayFromObjectMessage:
-						{
-							conPrintIfNotFuzzing("Received UserMovedAwayFromObjectMessage msg.");
+				conPrintIfNotFuzzing("WorkerThread: Updated world settings.");
 
-							const UID object_uid = readUIDFromStream(msg_buffer);
+				// Send WorldSettingsUpdate message to all connected clients
+				{
+					MessageUtils::initPacket(scratch_packet, Protocol::WorldSettingsUpdate);
+					world_settings.writeToStream(scratch_packet);
+					MessageUtils::updatePacketLengthField(scratch_packet);
 
-							Reference<UserMovedAwayFromObjectThreadMessage> msg = new UserMovedAwayFromObjectThreadMessage();
-							msg->world = cur_world_state;
-							msg->avatar_uid = client_avatar_uid;
-							msg->object_uid = object_uid;
-							server->enqueueMsg(msg);
+					enqueuePacketToBroadcast(scratch_packet, server);
+				}
+			}
+			else
+			{
+				conPrintIfNotFuzzing("Client does not have pemissions to set world settings.");
 
-							break;
-						}
-					case Protocol::UserEnteredParcelMessage:
-						{
-							conPrintIfNotFuzzing("Received UserEnteredParcelMessage msg.");
+				// Send error message back to client
+				MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
+				scratch_packet.writeStringLengthFirst("You do not have permissions to set the world settings");
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-							const UID object_uid = readUIDFromStream(msg_buffer);
-							const ParcelID parcel_id = readParcelIDFromStream(msg_buffer);
+				writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+			}
 
-							Reference<UserEnteredParcelThreadMessage> msg = new UserEnteredParcelThreadMessage();
-							msg->world = cur_world_state;
-							msg->avatar_uid = client_avatar_uid;
-							msg->object_uid = object_uid;
-							msg->parcel_id = parcel_id;
-							server->enqueueMsg(msg);
+			break;
+		}
+	case Protocol::QueryMapTiles:
+		{
+			conPrintIfNotFuzzing("QueryMapTiles");
+		
+			const uint32 num_tiles = msg_buffer.readUInt32();
+			if(num_tiles > 1000)
+				throw glare::Exception("QueryMapTiles: too many tiles: " + toString(num_tiles));
 
-							break;
+			// conPrint("QueryMapTiles, num_tiles=" + toString(num_tiles));
+	
+			// Read tile coords
+			std::vector<Vec3i> tile_coords(num_tiles);
+			msg_buffer.readData(tile_coords.data(), num_tiles * sizeof(Vec3i));
+
+			std::vector<std::string> result_URLs(num_tiles);
+			{
+				Lock lock(world_state->mutex);
+
+				for(size_t i=0; i<tile_coords.size(); ++i)
+				{
+					auto res = world_state->map_tile_info.info.find(tile_coords[i]);
+					if(res != world_state->map_tile_info.info.end())
+					{
+						const TileInfo& tile_info = res->second;
+						if(tile_info.cur_tile_screenshot.nonNull())
+						{
+							result_URLs[i] = tile_info.cur_tile_screenshot->URL;
 						}
-					case Protocol::UserExitedParcelMessage:
+						else if(tile_info.prev_tile_screenshot.nonNull())
 						{
-							conPrintIfNotFuzzing("Received UserExitedParcelMessage msg.");
+							result_URLs[i] = tile_info.prev_tile_screenshot->URL;
+						}
+
+						// conPrint("QueryMapTiles: Found result_URLs[i]: " + result_URLs[i]);
+					}
+				}
+			}
+
+			// Send result URLs back
+			MessageUtils::initPacket(scratch_packet, Protocol::MapTilesResult);
+			scratch_packet.writeUInt32(num_tiles);
+
+			// Write tile coords
+			scratch_packet.writeData(tile_coords.data(), tile_coords.size() * sizeof(Vec3i));
+
+			// Write URLS
+			for(size_t i=0; i<result_URLs.size(); ++i)
+				scratch_packet.writeStringLengthFirst(result_URLs[i]);
+
+			MessageUtils::updatePacketLengthField(scratch_packet);
+
+			writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+
+			break;
+		}
+	default:
+		{
+			//conPrint("Unknown message id: " + toString(msg_type));
+			throw glare::Exception("Unknown message id: " + toString(msg_type));
+		}
+	}
+}
+
+
+void WorkerThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("WorkerThread");
+
+
+	if(CAPTURE_TRACES)
+		socket.downcastToPtr<RecordingSocket>()->clearRecordBuf();
+
+	ServerAllWorldsState* world_state = server->world_state.getPointer();
+
+	try
+	{
+		// Read hello bytes
+		const uint32 hello = socket->readUInt32();
+		if(hello != Protocol::CyberspaceHello)
+			throw glare::Exception("Received invalid hello message (" + toString(hello) + ") from client.");
+		
+		// Write hello response
+		socket->writeUInt32(Protocol::CyberspaceHello);
+
+		// Read protocol version
+		client_protocol_version = socket->readUInt32();
+		conPrintIfNotFuzzing("client protocol version: " + toString(client_protocol_version));
+		if(client_protocol_version < 38) // We can't handle protocol versions < 38
+		{
+			socket->writeUInt32(Protocol::ClientProtocolTooOld);
+			socket->writeStringLengthFirst("Sorry, your Substrata client is too old. Please download and install an updated client from https://substrata.info/.");
+
+			//socket->writeStringLengthFirst("Sorry, your client protocol version (" + toString(client_protocol_version) + ") is too old, require version " + 
+			//	toString(Protocol::CyberspaceProtocolVersion) + ".  Please install an updated client from https://substrata.info/.");
+		}
+		else
+		{
+			// For versions newer than our current version, consider them OK.  We will send back our current version below, which will then be used by the client.
+
+			socket->writeUInt32(Protocol::ClientProtocolOK);
+		}
+
+		socket->writeUInt32(Protocol::CyberspaceProtocolVersion);
+
+		const uint32 connection_type = socket->readUInt32();
+	
+		if(connection_type == Protocol::ConnectionTypeUploadResource)
+		{
+			handleResourceUploadConnection();
+		}
+		else if(connection_type == Protocol::ConnectionTypeDownloadResources)
+		{
+			handleResourceDownloadConnection();
+		}
+		else if(connection_type == Protocol::ConnectionTypeDownloadResourcesMultiplexed)
+		{
+			handleMultiplexedResourceDownloadConnection();
+		}
+		else if(connection_type == Protocol::ConnectionTypeScreenshotBot)
+		{
+			handleScreenshotBotConnection();
+		}
+		else if(connection_type == Protocol::ConnectionTypeEthBot)
+		{
+			handleEthBotConnection();
+		}
+		else if(connection_type == Protocol::ConnectionTypeUpdates)
+		{
+			if(CAPTURE_TRACES)
+				this->write_trace = true;
+
+			// Read name of world to connect to
+			const std::string world_name = socket->readStringLengthFirst(1000);
+			conPrintIfNotFuzzing("Client connecting to world '" + world_name + "'...");
+			
+
+			{
+				Lock lock(world_state->mutex);
+				// Create world if didn't exist before.
+				// For now only the main world ("") and personal worlds are allowed
+				if(world_name == "")
+				{}
+				else if(world_state->name_to_users.find(world_name) != world_state->name_to_users.end()) // Else if world_name is a user name, it's valid
+				{}
+				else
+					throw glare::Exception("Invalid world name '" + world_name + "'.");
+
+				if(world_state->world_states[world_name].isNull())
+					world_state->world_states[world_name] = new ServerWorldState();
+				cur_world_state = world_state->world_states[world_name];
+			}
+
+			this->connected_world_name = world_name;
+
+			// Write avatar UID assigned to the connected client.
+			client_avatar_uid = world_state->getNextAvatarUID();
+			writeToStream(client_avatar_uid, *socket);
+
+			{
+				Lock lock(world_state->mutex);
+				this->connected_avatar_uid = client_avatar_uid;
+			}
+
+			// If the client connected via a websocket, they can be logged in with a session cookie.
+			// Note that this may only work if the websocket connects over TLS.
+			{
+				Lock lock(world_state->mutex);
+				User* cookie_logged_in_user = LoginHandlers::getLoggedInUser(*world_state, this->websocket_request_info);
+	
+				if(cookie_logged_in_user != NULL)
+				{
+					client_user_id = cookie_logged_in_user->id;
+					client_user_name = cookie_logged_in_user->name;
+					client_user_avatar_settings = cookie_logged_in_user->avatar_settings; // TODO: clone materials?
+					client_user_flags = cookie_logged_in_user->flags;
+				}
+			}
+
+			if(client_user_id.valid())
+			{
+				// Send logged-in message to client
+				MessageUtils::initPacket(scratch_packet, Protocol::LoggedInMessageID);
+				writeToStream(client_user_id, scratch_packet);
+				scratch_packet.writeStringLengthFirst(client_user_name);
+				writeAvatarSettingsToStream(client_user_avatar_settings, scratch_packet);
+				scratch_packet.writeUInt32(client_user_flags);
+				MessageUtils::updatePacketLengthField(scratch_packet);
+
+				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+				socket->flush();
+			}
+
+			// Send TimeSyncMessage packet to client
+			{
+				MessageUtils::initPacket(scratch_packet, Protocol::TimeSyncMessage);
+				scratch_packet.writeDouble(server->getCurrentGlobalTime());
+				MessageUtils::updatePacketLengthField(scratch_packet);
+				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+			}
 
-							const UID object_uid = readUIDFromStream(msg_buffer);
-							const ParcelID parcel_id = readParcelIDFromStream(msg_buffer);
+			// Send a ServerAdminMessage to client if we have a non-empty message.
+			std::string server_admin_msg;
+			{ // Lock scope
+				Lock lock(world_state->mutex);
+				server_admin_msg = world_state->server_admin_message;
+			} // End lock scope
+			if(!server_admin_msg.empty())
+			{
+				MessageUtils::initPacket(scratch_packet, Protocol::ServerAdminMessageID);
+				scratch_packet.writeStringLengthFirst(server_admin_msg);
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-							Reference<UserExitedParcelThreadMessage> msg = new UserExitedParcelThreadMessage();
-							msg->world = cur_world_state;
-							msg->avatar_uid = client_avatar_uid;
-							msg->object_uid = object_uid;
-							msg->parcel_id = parcel_id;
-							server->enqueueMsg(msg);
+				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+				socket->flush();
+			}
 
-							break;
-						}
-					case Protocol::LogInMessage: // Client wants to log in.
-						{
-							conPrintIfNotFuzzing("LogInMessage");
+			// Send world settings to client
+			{
+				MessageUtils::initPacket(scratch_packet, Protocol::WorldSettingsInitialSendMessage);
 
-							const std::string username = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-							const std::string password = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+				{
+					Lock lock(world_state->mutex);
+					cur_world_state->world_settings.writeToStream(scratch_packet);
+				}
 
-							conPrintIfNotFuzzing("username: '" + username + "'");
-						
-							bool logged_in = false;
-							{
-								Lock lock(world_state->mutex);
-								auto res = world_state->name_to_users.find(username);
-								if(res != world_state->name_to_users.end())
-								{
-									User* user = res->second.getPointer();
-									const bool password_valid = user->isPasswordValid(password);
-									conPrintIfNotFuzzing("password_valid: " + boolToString(password_valid));
-									if(password_valid)
-									{
-										// Password is valid, log user in.
-										client_user_id = user->id;
-										client_user_name = user->name;
-										client_user_avatar_settings = user->avatar_settings;
-										client_user_flags = user->flags;
-
-										logged_in = true;
-									}
-								}
-							}
+				MessageUtils::updatePacketLengthField(scratch_packet);
+				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+			}
 
-							conPrintIfNotFuzzing("logged_in: " + boolToString(logged_in));
-							if(logged_in)
-							{
-								if(username == "lightmapperbot")
-									logged_in_user_is_lightmapper_bot = true;
-
-								// Send logged-in message to client
-								MessageUtils::initPacket(scratch_packet, Protocol::LoggedInMessageID);
-								writeToStream(client_user_id, scratch_packet);
-								scratch_packet.writeStringLengthFirst(username);
-								writeAvatarSettingsToStream(client_user_avatar_settings, scratch_packet);
-								scratch_packet.writeUInt32(client_user_flags);
-								MessageUtils::updatePacketLengthField(scratch_packet);
-
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
-							}
-							else
-							{
-								// Login failed.  Send error message back to client
-								MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
-								scratch_packet.writeStringLengthFirst("Login failed: username or password incorrect.");
-								MessageUtils::updatePacketLengthField(scratch_packet);
 
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
-							}
-					
-							break;
-						}
-					case Protocol::LogOutMessage: // Client wants to log out.
-						{
-							conPrintIfNotFuzzing("LogOutMessage");
+			// Send all current avatar state data to client
+			{
+				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 
-							client_user_id = UserID::invalidUserID(); // Mark the client as not logged in.
-							client_user_name = "";
-							client_user_flags = 0;
+				{ // Lock scope
+					WorldStateLock lock(world_state->mutex);
+					const ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
+					for(auto it = avatars.begin(); it != avatars.end(); ++it)
+					{
+						const Avatar* avatar = it->second.getPointer();
 
-							// Send logged-out message to client
-							MessageUtils::initPacket(scratch_packet, Protocol::LoggedOutMessageID);
-							MessageUtils::updatePacketLengthField(scratch_packet);
+						// Write AvatarIsHere message
+						MessageUtils::initPacket(scratch_packet, Protocol::AvatarIsHere);
+						writeAvatarToNetworkStream(*avatar, scratch_packet);
+						MessageUtils::updatePacketLengthField(scratch_packet);
 
-							socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-							socket->flush();
-							break;
-						}
-					case Protocol::SignUpMessage:
-						{
-							conPrintIfNotFuzzing("SignUpMessage");
+						packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+					}
+				} // End lock scope
 
-							const std::string username = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-							const std::string email    = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-							const std::string password = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+				socket->writeData(packet.buf.data(), packet.buf.size());
+			}
 
-							try
-							{
-								conPrintIfNotFuzzing("username: '" + username + "', email: '" + email + "'");
+			// Send all current object data to client
+			/*{
+				Lock lock(world_state->mutex);
+				for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
+				{
+					const WorldObject* ob = it->second.getPointer();
 
-								bool signed_up = false;
+					// Send ObjectCreated packet
+					SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+					packet.writeUInt32(Protocol::ObjectCreated);
+					ob->writeToNetworkStream(packet);
+					socket->writeData(packet.buf.data(), packet.buf.size());
+				}
+			}*/
 
-								std::string msg_to_client;
-								if(world_state->isInReadOnlyMode())
-								{
-									msg_to_client = "Server is in read-only mode, you can't sign up right now.";
-								}
-								else
-								{
-									if(username.size() < 3)
-										msg_to_client = "Username is too short, must have at least 3 characters";
-									else
-									{
-										if(password.size() < 6)
-											msg_to_client = "Password is too short, must have at least 6 characters";
-										else
-										{
-											Lock lock(world_state->mutex);
-											auto res = world_state->name_to_users.find(username);
-											if(res == world_state->name_to_users.end())
-											{
-												Reference<User> new_user = new User();
-												new_user->id = UserID((uint32)world_state->name_to_users.size());
-												new_user->created_time = TimeStamp::currentTime();
-												new_user->name = username;
-												new_user->email_address = email;
-
-												new_user->setNewPasswordAndSalt(password);
-
-												world_state->addUserAsDBDirty(new_user);
-
-												// Add new user to world state
-												world_state->user_id_to_users.insert(std::make_pair(new_user->id, new_user));
-												world_state->name_to_users   .insert(std::make_pair(username,     new_user));
-												world_state->markAsChanged(); // Mark as changed so gets saved to disk.
-
-												client_user_id = new_user->id; // Log user in as well.
-												client_user_name = new_user->name;
-												client_user_avatar_settings = new_user->avatar_settings;
-												client_user_flags = new_user->flags;
-
-												signed_up = true;
-											}
-										}
-									}
-								}
+			// Send all current parcel data to client
+			{
+				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 
-								conPrintIfNotFuzzing("signed_up: " + boolToString(signed_up));
-								if(signed_up)
-								{
-									conPrintIfNotFuzzing("Sign up successful");
-									// Send signed-up message to client
-									MessageUtils::initPacket(scratch_packet, Protocol::SignedUpMessageID);
-									writeToStream(client_user_id, scratch_packet);
-									scratch_packet.writeStringLengthFirst(username);
-									MessageUtils::updatePacketLengthField(scratch_packet);
-
-									socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-									socket->flush();
-								}
-								else
-								{
-									conPrintIfNotFuzzing("Sign up failed.");
+				{ // Lock scope
+					WorldStateLock lock(world_state->mutex);
+					for(auto it = cur_world_state->getParcels(lock).begin(); it != cur_world_state->getParcels(lock).end(); ++it)
+					{
+						const Parcel* parcel = it->second.getPointer();
 
-									// signup failed.  Send error message back to client
-									MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
-									scratch_packet.writeStringLengthFirst(msg_to_client);
-									MessageUtils::updatePacketLengthField(scratch_packet);
+						// Send ParcelCreated message
+						MessageUtils::initPacket(scratch_packet, Protocol::ParcelCreated);
+						writeToNetworkStream(*parcel, scratch_packet, client_protocol_version);
+						MessageUtils::updatePacketLengthField(scratch_packet);
 
-									socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-									socket->flush();
-								}
-							}
-							catch(glare::Exception& e)
-							{
-								conPrint("Sign up failed, internal error: " + e.what());
+						packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+					}
+				} // End lock scope
 
-								// signup failed.  Send error message back to client
-								MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
-								scratch_packet.writeStringLengthFirst("Signup failed: internal error.");
-								MessageUtils::updatePacketLengthField(scratch_packet);
+				socket->writeData(packet.buf.data(), packet.buf.size());
+				socket->flush();
+			}
 
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
-							}
+			// Send a message saying we have sent all initial state
+			/*{
+				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+				packet.writeUInt32(Protocol::InitialStateSent);
+				socket->writeData(packet.buf.data(), packet.buf.size());
+			}*/
 
-							break;
-						}
-					case Protocol::RequestPasswordReset:
-						{
-							conPrintIfNotFuzzing("RequestPasswordReset");
-
-							const std::string email    = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-
-							// NOTE: This stuff is done via the website now instead.
-
-							//conPrint("email: " + email);
-							//
-							//// TEMP: Send password reset email in this thread for now. 
-							//// TODO: move to another thread (make some kind of background task?)
-							//{
-							//	Lock lock(world_state->mutex);
-							//	for(auto it = world_state->user_id_to_users.begin(); it != world_state->user_id_to_users.end(); ++it)
-							//		if(it->second->email_address == email)
-							//		{
-							//			User* user = it->second.getPointer();
-							//			try
-							//			{
-							//				user->sendPasswordResetEmail();
-							//				world_state->markAsChanged(); // Mark as changed so gets saved to disk.
-							//				conPrint("Sent user password reset email to '" + email + ", username '" + user->name + "'");
-							//			}
-							//			catch(glare::Exception& e)
-							//			{
-							//				conPrint("Sending password reset email failed: " + e.what());
-							//			}
-							//		}
-							//}
-					
-							break;
-						}
-					case Protocol::ChangePasswordWithResetToken:
-						{
-							conPrintIfNotFuzzing("ChangePasswordWithResetToken");
-						
-							const std::string email			= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-							const std::string reset_token	= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-							const std::string new_password	= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-
-							// NOTE: This stuff is done via the website now instead.
-					
-							//conPrint("email: " + email);
-							//conPrint("reset_token: " + reset_token);
-							////conPrint("new_password: " + new_password);
-							//
-							//{
-							//	Lock lock(world_state->mutex);
-							//
-							//	// Find user with the given email address:
-							//	for(auto it = world_state->user_id_to_users.begin(); it != world_state->user_id_to_users.end(); ++it)
-							//		if(it->second->email_address == email)
-							//		{
-							//			User* user = it->second.getPointer();
-							//			const bool reset = user->resetPasswordWithToken(reset_token, new_password);
-							//			if(reset)
-							//			{
-							//				world_state->markAsChanged(); // Mark as changed so gets saved to disk.
-							//				conPrint("User password successfully updated.");
-							//			}
-							//		}
-							//}
 
-							break;
-						}
-					case Protocol::WorldSettingsUpdate:
-						{
-							conPrintIfNotFuzzing("WorldSettingsUpdate");
-						
-							WorldSettings world_settings;
-							readWorldSettingsFromStream(msg_buffer, world_settings);
+			assert(cur_world_state.nonNull());
 
-							if(userConnectedToTheirPersonalWorldOrGodUser(client_user_id, client_user_name, this->connected_world_name))
-							{
-								{
-									Lock lock(server->world_state->mutex);
-									cur_world_state->world_settings.copyNetworkStateFrom(world_settings);
-									cur_world_state->world_settings.db_dirty = true;
-									world_state->markAsChanged();
-								}
 
-								// Process resources
-								std::set<DependencyURL> URLs;
-								world_settings.getDependencyURLSet(URLs);
-								for(auto it = URLs.begin(); it != URLs.end(); ++it)
-									sendGetFileMessageIfNeeded(it->URL);
+			socket->setNoDelayEnabled(true); // We want to send out lots of little packets with low latency.  So disable Nagle's algorithm, e.g. send coalescing.
 
-								conPrintIfNotFuzzing("WorkerThread: Updated world settings.");
+			// If the epoll reactor is enabled, hand the connection off to it, after which this thread can terminate.
+			// Websocket connections (which don't have plain_socket set) are always handled by this thread.
+			if(server->reactor.nonNull() && plain_socket.nonNull() && !fuzzing && !write_trace)
+				server->reactor->addConnection(this); // Sets handled_by_reactor.
 
-								// Send WorldSettingsUpdate message to all connected clients
-								{
-									MessageUtils::initPacket(scratch_packet, Protocol::WorldSettingsUpdate);
-									world_settings.writeToStream(scratch_packet);
-									MessageUtils::updatePacketLengthField(scratch_packet);
+			while(!should_quit && !handled_by_reactor) // write to / read from socket loop
+			{
+				// See if we have any pending data to send in the data_to_send queue, and if so, send all pending data.
+				if(VERBOSE) conPrint("WorkerThread: checking for pending data to send...");
 
-									enqueuePacketToBroadcast(scratch_packet, server);
-								}
-							}
-							else
-							{
-								conPrintIfNotFuzzing("Client does not have pemissions to set world settings.");
+				// We don't want to do network writes while holding the data_to_send_mutex.  So copy to temp_data_to_send.
+				{
+					Lock lock(data_to_send_mutex);
+					temp_data_to_send = data_to_send;
+					data_to_send.clear();
+				}
 
-								// Send error message back to client
-								MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
-								scratch_packet.writeStringLengthFirst("You do not have permissions to set the world settings");
-								MessageUtils::updatePacketLengthField(scratch_packet);
+				if(temp_data_to_send.nonEmpty())
+				{
+					socket->writeData(temp_data_to_send.data(), temp_data_to_send.size());
+					socket->flush();
+					temp_data_to_send.clear();
+				}
 
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
-							}
 
-							break;
-						}
-					case Protocol::QueryMapTiles:
-						{
-							conPrintIfNotFuzzing("QueryMapTiles");
-						
-							const uint32 num_tiles = msg_buffer.readUInt32();
-							if(num_tiles > 1000)
-								throw glare::Exception("QueryMapTiles: too many tiles: " + toString(num_tiles));
-
-							// conPrint("QueryMapTiles, num_tiles=" + toString(num_tiles));
-					
-							// Read tile coords
-							std::vector<Vec3i> tile_coords(num_tiles);
-							msg_buffer.readData(tile_coords.data(), num_tiles * sizeof(Vec3i));
-
-							std::vector<std::string> result_URLs(num_tiles);
-							{
-								Lock lock(world_state->mutex);
+				updateBotContactTimeIfNeeded();
 
-								for(size_t i=0; i<tile_coords.size(); ++i)
-								{
-									auto res = world_state->map_tile_info.info.find(tile_coords[i]);
-									if(res != world_state->map_tile_info.info.end())
-									{
-										const TileInfo& tile_info = res->second;
-										if(tile_info.cur_tile_screenshot.nonNull())
-										{
-											result_URLs[i] = tile_info.cur_tile_screenshot->URL;
-										}
-										else if(tile_info.prev_tile_screenshot.nonNull())
-										{
-											result_URLs[i] = tile_info.prev_tile_screenshot->URL;
-										}
-
-										// conPrint("QueryMapTiles: Found result_URLs[i]: " + result_URLs[i]);
-									}
-								}
-							}
 
-							// Send result URLs back
-							MessageUtils::initPacket(scratch_packet, Protocol::MapTilesResult);
-							scratch_packet.writeUInt32(num_tiles);
+#if defined(_WIN32) || defined(OSX)
+				if(socket->readable(0.05)) // If socket has some data to read from it:
+#else
+				if(socket->readable(event_fd)) // Block until either the socket is readable or the event fd is signalled, which means we have data to write.
+#endif
+				{
+					// Read msg type and length
+					uint32 msg_type_and_len[2];
+					socket->readData(msg_type_and_len, sizeof(uint32) * 2);
+					const uint32 msg_type = msg_type_and_len[0];
+					const uint32 msg_len = msg_type_and_len[1]; // Length of message, including the message type and length fields.
 
-							// Write tile coords
-							scratch_packet.writeData(tile_coords.data(), tile_coords.size() * sizeof(Vec3i));
+					if((msg_len < sizeof(uint32) * 2) || (msg_len > 1000000))
+						throw glare::Exception("Invalid message size: " + toString(msg_len));
 
-							// Write URLS
-							for(size_t i=0; i<result_URLs.size(); ++i)
-								scratch_packet.writeStringLengthFirst(result_URLs[i]);
+					// conPrint("WorkerThread: Read message header: id: " + toString(msg_type) + ", len: " + toString(msg_len));
 
-							MessageUtils::updatePacketLengthField(scratch_packet);
+					// Read entire message
+					msg_buffer.buf.resizeNoCopy(msg_len);
+					msg_buffer.read_index = sizeof(uint32) * 2;
 
-							socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-							socket->flush();
+					socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2); // Read rest of message, store in msg_buffer.
 
-							break;
-						}
-					default:
-						{
-							//conPrint("Unknown message id: " + toString(msg_type));
-							throw glare::Exception("Unknown message id: " + toString(msg_type));
-						}
-					}
+					handleUpdatesMessage(msg_type);
 				}
 				else
 				{
@@ -2756,15 +2878,38 @@ void WorkerThread::doRun()
 	}
 
 
+	if(handled_by_reactor)
+	{
+		// The reactor owns the connection now, and will call reactorConnectionClosed() when it is closed.
+		ERR_remove_thread_state(/*thread id=*/NULL); // Set thread ID to null to use current thread.
+		return;
+	}
+
 	if(write_trace)
 		socket.downcastToPtr<RecordingSocket>()->writeRecordBufToDisk("traces/worker_thread_trace_" + ::toString(Clock::getTimeSinceInit()) + ".bin");
 
+	clientConnectionClosed();
+
+	// Remove thread-local OpenSSL error state, to avoid leaking it.
+	// NOTE: have to destroy socket first, before calling ERR_remove_thread_state(), otherwise memory will just be reallocated.
+	plain_socket = NULL;
+	if(socket.nonNull())
+	{
+		assert(socket->getRefCount() == 1);
+	}
+	socket = NULL;
+	ERR_remove_thread_state(/*thread id=*/NULL); // Set thread ID to null to use current thread.
+}
+
+
+void WorkerThread::clientConnectionClosed()
+{
 	server->clientDisconnected(this);
 	
 	// Mark avatar corresponding to client as dead.  Note that we want to do this after catching any exceptions, so avatar is removed on broken connections etc.
 	if(cur_world_state.nonNull())
 	{
-		WorldStateLock lock(world_state->mutex);
+		WorldStateLock lock(server->world_state->mutex);
 		ServerWorldState::AvatarMapType& avatars = cur_world_state->getAvatars(lock);
 		if(avatars.count(client_avatar_uid) == 1)
 		{
@@ -2772,15 +2917,100 @@ void WorkerThread::doRun()
 			avatars[client_avatar_uid]->other_dirty = true;
 		}
 	}
+}
+
+
+void WorkerThread::reactorConnectionClosed()
+{
+	assert(handled_by_reactor);
+
+	clientConnectionClosed();
 
-	// Remove thread-local OpenSSL error state, to avoid leaking it.
-	// NOTE: have to destroy socket first, before calling ERR_remove_thread_state(), otherwise memory will just be reallocated.
-	if(socket.nonNull())
 	{
-		assert(socket->getRefCount() == 1);
+		Lock lock(data_to_send_mutex);
+		reactor_io_thread = NULL;
+		data_to_send.clear();
 	}
+
 	socket = NULL;
-	ERR_remove_thread_state(/*thread id=*/NULL); // Set thread ID to null to use current thread.
+	plain_socket = NULL;
+}
+
+
+void WorkerThread::setPlainSocketAndTLSContext(const Reference<MySocket>& plain_socket_, struct tls* tls_context_)
+{
+	plain_socket = plain_socket_;
+	tls_context = tls_context_;
+}
+
+
+void WorkerThread::setReactorIOThread(EpollReactorIOThread* io_thread)
+{
+	bool have_data_to_send;
+	{
+		Lock lock(data_to_send_mutex);
+		reactor_io_thread = io_thread;
+		reactor_send_notified = true;
+		have_data_to_send = data_to_send.nonEmpty();
+	}
+
+	// Send any data that was enqueued before the connection was handed off.
+	if(have_data_to_send)
+		io_thread->connectionHasDataToSend(this);
+}
+
+
+void WorkerThread::appendDataToSend(js::Vector<uint8, 16>& buf_out)
+{
+	Lock lock(data_to_send_mutex);
+	if(data_to_send.nonEmpty())
+	{
+		const size_t write_i = buf_out.size();
+		buf_out.resize(write_i + data_to_send.size());
+		std::memcpy(&buf_out[write_i], data_to_send.data(), data_to_send.size());
+		data_to_send.clear();
+	}
+	reactor_send_notified = false;
+}
+
+
+void WorkerThread::updateBotContactTimeIfNeeded()
+{
+	if(logged_in_user_is_lightmapper_bot)
+	{
+		Lock lock(server->world_state->mutex);
+		server->world_state->last_lightmapper_bot_contact_time = TimeStamp::currentTime(); // bit of a hack
+	}
+}
+
+
+void WorkerThread::writeToClient(const void* data, size_t len)
+{
+	if(handled_by_reactor)
+	{
+		// We are being called from the reactor IO thread, which will send data_to_send after handling the message.
+		Lock lock(data_to_send_mutex);
+		const size_t write_i = data_to_send.size();
+		data_to_send.resize(write_i + len);
+		if(len > 0)
+			std::memcpy(&data_to_send[write_i], data, len);
+	}
+	else
+	{
+		socket->writeData(data, len);
+		socket->flush();
+	}
+}
+
+
+void WorkerThread::writeErrorMessageToClient(const std::string& msg)
+{
+	SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	MessageUtils::initPacket(packet, Protocol::ErrorMessageID);
+	packet.writeStringLengthFirst(msg);
+	MessageUtils::updatePacketLengthField(packet);
+
+	writeToClient(packet.buf.data(), packet.buf.size());
 }
 
 
@@ -2798,31 +3028,42 @@ void WorkerThread::enqueueDataToSend(const std::string& data)
 {
 	if(VERBOSE) conPrint("WorkerThread::enqueueDataToSend(), data: '" + data + "'");
 
-	// Append data to data_to_send
-	if(!data.empty())
-	{
-		Lock lock(data_to_send_mutex);
-		const size_t write_i = data_to_send.size();
-		data_to_send.resize(write_i + data.size());
-		std::memcpy(&data_to_send[write_i], data.data(), data.size());
-	}
-
-	event_fd.notify();
+	enqueueDataToSend((const uint8*)data.data(), data.size());
 }
 
 
 void WorkerThread::enqueueDataToSend(const SocketBufferOutStream& packet) // threadsafe
 {
+	enqueueDataToSend(packet.buf.data(), packet.buf.size());
+}
+
+
+void WorkerThread::enqueueDataToSend(const uint8* data, size_t len) // threadsafe
+{
+	EpollReactorIOThread* notify_io_thread = NULL;
+
 	// Append data to data_to_send
-	if(!packet.buf.empty())
 	{
 		Lock lock(data_to_send_mutex);
-		const size_t write_i = data_to_send.size();
-		data_to_send.resize(write_i + packet.buf.size());
-		std::memcpy(&data_to_send[write_i], packet.buf.data(), packet.buf.size());
+		if(len > 0)
+		{
+			const size_t write_i = data_to_send.size();
+			data_to_send.resize(write_i + len);
+			std::memcpy(&data_to_send[write_i], data, len);
+		}
+
+		// If the connection is handled by the reactor, only notify the IO thread once until it takes the data.
+		if(reactor_io_thread && !reactor_send_notified)
+		{
+			notify_io_thread = reactor_io_thread;
+			reactor_send_notified = true;
+		}
 	}
 
-	event_fd.notify();
+	if(notify_io_thread)
+		notify_io_thread->connectionHasDataToSend(this);
+	else
+		event_fd.notify();
 }
 
 
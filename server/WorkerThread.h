@@ -16,14 +16,26 @@ Copyright Glare Technologies Limited 2018 -
 #include <Vector.h>
 #include <BufferInStream.h>
 #include <AtomicInt.h>
+#include "../shared/UID.h"
+#include "../shared/UserID.h"
+#include "../shared/Avatar.h"
 #include <string>
 class Server;
+class ServerWorldState;
+class EpollReactorIOThread;
+class MySocket;
+struct tls;
 
 
 /*=====================================================================
 WorkerThread
 ------------
 This thread runs on the server, and handles communication with a single client.
+
+If the epoll reactor is enabled (see EpollReactor.h), then once an updates connection
+has been set up, the connection is handed off to an EpollReactorIOThread, and this thread terminates.
+The WorkerThread object is then used just to hold the connection state, and handleUpdatesMessage()
+is called from the IO thread.
 =====================================================================*/
 class WorkerThread : public MessageableThread
 {
@@ -38,15 +50,41 @@ public:
 
 	std::string connected_world_name;
 
+	UID connected_avatar_uid; // Avatar UID assigned to the connected client, used for interest management.  Protected by the world state mutex.
+
 	void enqueueDataToSend(const std::string& data); // threadsafe
 	void enqueueDataToSend(const SocketBufferOutStream& packet); // threadsafe
+	void enqueueDataToSend(const uint8* data, size_t len); // threadsafe
 
 	web::RequestInfo websocket_request_info; // If the client connected via a websocket, this the HTTP request data.  Is used for accessing the login cookie.
 
+	// Set by the ListenerThread, so that the connection can be handed off to the epoll reactor.  The TLS context (may be NULL) is owned by socket.
+	void setPlainSocketAndTLSContext(const Reference<MySocket>& plain_socket, struct tls* tls_context);
+
+	//----------------------- Used by EpollReactorIOThread -----------------------
+	Reference<MySocket> getPlainSocket() { return plain_socket; }
+	struct tls* getTLSContext() { return tls_context; }
+
+	void setReactorIOThread(EpollReactorIOThread* io_thread); // threadsafe
+	void appendDataToSend(js::Vector<uint8, 16>& buf_out); // Appends any data in data_to_send to buf_out, and clears data_to_send.  threadsafe
+	BufferInStream& getMsgBuffer() { return msg_buffer; }
+	void handleUpdatesMessage(uint32 msg_type); // Handle a message from the client, the entire message has been read into msg_buffer.
+	void updateBotContactTimeIfNeeded();
+	bool shouldCloseConnection() const { return should_quit != 0; } // Client said goodbye.
+	void reactorConnectionClosed(); // Calls clientConnectionClosed(), and releases the sockets.
+	//----------------------------------------------------------------------------
+
+	bool isHandledByReactor() const { return handled_by_reactor != 0; }
+	glare::AtomicInt handled_by_reactor; // Set by EpollReactor::addConnection(), while holding the reactor mutex.
+
 private:
+	void clientConnectionClosed();
+	void writeToClient(const void* data, size_t len); // Writes directly to the socket, or if handled by the reactor, appends to data_to_send.
+	void writeErrorMessageToClient(const std::string& msg);
 	void sendGetFileMessageIfNeeded(const std::string& resource_URL);
 	void handleResourceUploadConnection();
 	void handleResourceDownloadConnection();
+	void handleMultiplexedResourceDownloadConnection();
 	void handleScreenshotBotConnection();
 	void handleEthBotConnection();
 	void conPrintIfNotFuzzing(const std::string& msg);
@@ -58,6 +96,21 @@ private:
 	Mutex data_to_send_mutex;
 	js::Vector<uint8, 16> data_to_send			GUARDED_BY(data_to_send_mutex);
 	js::Vector<uint8, 16> temp_data_to_send;
+	EpollReactorIOThread* reactor_io_thread		GUARDED_BY(data_to_send_mutex); // Non-null if the connection has been handed off to the epoll reactor.
+	bool reactor_send_notified					GUARDED_BY(data_to_send_mutex); // Has the reactor IO thread been notified that there is data to send, since it last took the data?
+
+	Reference<MySocket> plain_socket; // Underlying socket, if this connection came from the ListenerThread.
+	struct tls* tls_context;
+
+	// Updates connection state
+	UID client_avatar_uid;
+	UserID client_user_id; // Will be invalid if client is not logged in, otherwise will refer to the user account the client is logged in to.
+	std::string client_user_name;
+	AvatarSettings client_user_avatar_settings;
+	uint32 client_user_flags;
+	Reference<ServerWorldState> cur_world_state; // World the client is connected to.
+	bool logged_in_user_is_lightmapper_bot; // Just for updating the last_lightmapper_bot_contact_time.
+	uint32 client_protocol_version;
 
 	SocketBufferOutStream scratch_packet;
 
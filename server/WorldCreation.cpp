@@ -322,7 +322,7 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			for(size_t z=0; z<new_object->materials.size(); ++z)
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
-			world_state->getRootWorldState()->getObjects(lock)[new_object->uid] = new_object; // Insert into world
+			world_state->getRootWorldState()->addObject(new_object, lock); // Insert into world
 			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object, lock);
 		}
 
@@ -359,7 +359,7 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			for(size_t z=0; z<new_object->materials.size(); ++z)
 				new_object->materials[z] = source_ob->materials[z]->clone();
 			
-			world_state->getRootWorldState()->getObjects(lock)[new_object->uid] = new_object; // Insert into world
+			world_state->getRootWorldState()->addObject(new_object, lock); // Insert into world
 			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object, lock);
 		}
 
@@ -408,7 +408,7 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			for(size_t z=0; z<new_object->materials.size(); ++z)
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
-			world_state->getRootWorldState()->getObjects(lock)[new_object->uid] = new_object; // Insert into world
+			world_state->getRootWorldState()->addObject(new_object, lock); // Insert into world
 			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object, lock);
 		}
 
@@ -444,7 +444,7 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			for(size_t z=0; z<new_object->materials.size(); ++z)
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
-			world_state->getRootWorldState()->getObjects(lock)[new_object->uid] = new_object; // Insert into world
+			world_state->getRootWorldState()->addObject(new_object, lock); // Insert into world
 			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object, lock);
 		}
 
@@ -481,7 +481,7 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			for(size_t z=0; z<new_object->materials.size(); ++z)
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
-			world_state->getRootWorldState()->getObjects(lock)[new_object->uid] = new_object; // Insert into world
+			world_state->getRootWorldState()->addObject(new_object, lock); // Insert into world
 			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object, lock);
 		}
 
@@ -520,7 +520,7 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			for(size_t z=0; z<new_object->materials.size(); ++z)
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
-			world_state->getRootWorldState()->getObjects(lock)[new_object->uid] = new_object; // Insert into world
+			world_state->getRootWorldState()->addObject(new_object, lock); // Insert into world
 			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object, lock);
 		}
 
@@ -560,7 +560,7 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			for(size_t z=0; z<new_object->materials.size(); ++z)
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
-			world_state->getRootWorldState()->getObjects(lock)[new_object->uid] = new_object; // Insert into world
+			world_state->getRootWorldState()->addObject(new_object, lock); // Insert into world
 			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object, lock);
 		}
 	}
@@ -587,7 +587,7 @@ static void makeRoad(ServerAllWorldsState& world_state, const Vec3d& pos, const
 
 	WorldStateLock lock(world_state.mutex);
 
-	world_state.getRootWorldState()->getObjects(lock)[test_object->uid] = test_object;
+	world_state.getRootWorldState()->addObject(test_object, lock);
 }
 
 
@@ -1138,7 +1138,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 			for(auto it = world_state->getRootWorldState()->getObjects(lock).begin(); it != world_state->getRootWorldState()->getObjects(lock).end();)
 			{
 				if(it->second->uid.value() >= 1000000)
-					it = world_state->getRootWorldState()->getObjects(lock).erase(it);
+					it = world_state->getRootWorldState()->removeObject(it, lock);
 				else
 					++it;
 			}
@@ -1354,7 +1354,7 @@ void WorldCreation::createPhysicsTest(ServerAllWorldsState& all_worlds_state)
 
 		//all_worlds_state.getRootWorldState()->objects[test_object->uid] = test_object;
 		WorldStateLock lock(all_worlds_state.mutex);
-		all_worlds_state.getRootWorldState()->getObjects(lock).erase(test_object->uid);
+		all_worlds_state.getRootWorldState()->removeObject(test_object->uid, lock);
 		//all_worlds_state.getRootWorldState()->addWorldObjectAsDBDirty(test_object);
 
 
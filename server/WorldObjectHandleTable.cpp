@@ -0,0 +1,136 @@
+/*=====================================================================
+WorldObjectHandleTable.cpp
+--------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "WorldObjectHandleTable.h"
+
+
+#include <assert.h>
+
+
+static const int SLOT_BITS = 24;
+static const uint64 SLOT_MASK = (1ull << SLOT_BITS) - 1;
+static const uint32 GENERATION_MASK = (1u << 29) - 1; // SLOT_BITS + 29 = 53 bits, so handles fit exactly in a double.
+
+
+static inline uint64 makeHandle(uint32 slot_index, uint32 generation)
+{
+	return ((uint64)generation << SLOT_BITS) | slot_index;
+}
+
+
+WorldObjectHandleTable::WorldObjectHandleTable()
+{}
+
+
+WorldObjectHandleTable::~WorldObjectHandleTable()
+{}
+
+
+uint64 WorldObjectHandleTable::addObject(WorldObject* ob)
+{
+	uint32 slot_index;
+	if(!free_slots.empty())
+	{
+		slot_index = free_slots.back();
+		free_slots.pop_back();
+	}
+	else
+	{
+		if(slots.size() > SLOT_MASK)
+			return INVALID_HANDLE;
+
+		slot_index = (uint32)slots.size();
+		Slot slot;
+		slot.ob = NULL;
+		slot.generation = 1; // Start at generation 1 so that handles are never INVALID_HANDLE.
+		slots.push_back(slot);
+	}
+
+	slots[slot_index].ob = ob;
+	return makeHandle(slot_index, slots[slot_index].generation);
+}
+
+
+void WorldObjectHandleTable::removeObject(uint64 handle)
+{
+	const uint64 slot_index = handle & SLOT_MASK;
+	if(slot_index >= slots.size())
+		return;
+
+	Slot& slot = slots[slot_index];
+	if((slot.ob == NULL) || (slot.generation != (uint32)(handle >> SLOT_BITS)))
+		return;
+
+	slot.ob = NULL;
+	slot.generation = (slot.generation + 1) & GENERATION_MASK;
+	if(slot.generation == 0)
+		slot.generation = 1;
+	free_slots.push_back((uint32)slot_index);
+}
+
+
+WorldObject* WorldObjectHandleTable::getObject(uint64 handle) const
+{
+	const uint64 slot_index = handle & SLOT_MASK;
+	if(slot_index >= slots.size())
+		return NULL;
+
+	const Slot& slot = slots[slot_index];
+	return (slot.generation == (handle >> SLOT_BITS)) ? slot.ob : NULL;
+}
+
+
+#if BUILD_TESTS
+
+
+#include "../shared/WorldObject.h"
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+
+
+void WorldObjectHandleTable::test()
+{
+	conPrint("WorldObjectHandleTable::test()");
+
+	{
+		WorldObjectHandleTable table;
+		WorldObjectRef ob_a = new WorldObject();
+		WorldObjectRef ob_b = new WorldObject();
+
+		testAssert(table.getObject(INVALID_HANDLE) == NULL);
+
+		const uint64 handle_a = table.addObject(ob_a.ptr());
+		const uint64 handle_b = table.addObject(ob_b.ptr());
+		testAssert(handle_a != INVALID_HANDLE && handle_b != INVALID_HANDLE && handle_a != handle_b);
+		testAssert(table.getObject(handle_a) == ob_a.ptr());
+		testAssert(table.getObject(handle_b) == ob_b.ptr());
+		testAssert(table.numObjects() == 2);
+
+		// Handles should be exactly representable as doubles, as they are stored in Lua numbers.
+		testAssert((uint64)(double)handle_a == handle_a);
+
+		// Remove a.  The stale handle should not resolve, even after the slot is reused.
+		table.removeObject(handle_a);
+		testAssert(table.getObject(handle_a) == NULL);
+		testAssert(table.numObjects() == 1);
+
+		const uint64 handle_c = table.addObject(ob_a.ptr());
+		testAssert(handle_c != handle_a);
+		testAssert(table.getObject(handle_a) == NULL);
+		testAssert(table.getObject(handle_c) == ob_a.ptr());
+
+		// Removing with a stale handle should do nothing.
+		table.removeObject(handle_a);
+		testAssert(table.getObject(handle_c) == ob_a.ptr());
+
+		// Invalid slot index
+		testAssert(table.getObject(handle_b + 1000) == NULL);
+	}
+
+	conPrint("WorldObjectHandleTable::test() done.");
+}
+
+
+#endif // BUILD_TESTS
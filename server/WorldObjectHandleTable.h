@@ -0,0 +1,62 @@
+/*=====================================================================
+WorldObjectHandleTable.h
+------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/Platform.h>
+#include <vector>
+class WorldObject;
+
+
+/*=====================================================================
+WorldObjectHandleTable
+----------------------
+Generational handles for the objects in a world.
+
+WorldObject tables pushed to Lua scripts store the handle of the object, so
+that the __index and __newindex metamethods can find the object with a handle
+table lookup, instead of reading the uid table field and looking it up in the world
+object map.
+
+A handle is a slot index combined with the generation of the slot.  The slot
+generation is incremented when an object is removed, so stale handles held by
+scripts resolve to NULL.
+
+Handles are non-zero.  They are stored in the table as light userdata under
+a light userdata key (see SubstrataLuaVM::setWorldObjectTableHandle()), so
+scripts can't see or modify them.
+
+Not threadsafe, access with the world state lock held.
+=====================================================================*/
+class WorldObjectHandleTable
+{
+public:
+	WorldObjectHandleTable();
+	~WorldObjectHandleTable();
+
+	static const uint64 INVALID_HANDLE = 0;
+
+	uint64 addObject(WorldObject* ob); // Returns INVALID_HANDLE if there are too many objects.
+	void removeObject(uint64 handle);
+
+	WorldObject* getObject(uint64 handle) const; // Returns NULL if the handle is invalid or stale.
+
+	size_t numObjects() const { return slots.size() - free_slots.size(); }
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(WorldObjectHandleTable);
+
+	struct Slot
+	{
+		WorldObject* ob;
+		uint32 generation;
+	};
+
+	std::vector<Slot> slots;
+	std::vector<uint32> free_slots;
+};
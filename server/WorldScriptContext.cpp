@@ -0,0 +1,20 @@
+/*=====================================================================
+WorldScriptContext.cpp
+----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "WorldScriptContext.h"
+
+
+#include "../shared/SubstrataLuaVM.h"
+
+
+WorldScriptContext::WorldScriptContext(Server* server)
+{
+	lua_vm.set(new SubstrataLuaVM());
+	lua_vm->server = server;
+}
+
+
+WorldScriptContext::~WorldScriptContext()
+{}
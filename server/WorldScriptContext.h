@@ -0,0 +1,63 @@
+/*=====================================================================
+WorldScriptContext.h
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/TimerQueue.h"
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/UniqueRef.h>
+#include <utils/Platform.h>
+#include <vector>
+class SubstrataLuaVM;
+class Server;
+
+
+/*=====================================================================
+WorldScriptStats
+----------------
+Script execution statistics for a single world, shown on the admin page.
+Updated by LuaScriptEvaluator while the world state lock is held.
+=====================================================================*/
+struct WorldScriptStats
+{
+	WorldScriptStats() : total_exec_time(0), max_exec_time(0), num_executions(0) {}
+
+	double total_exec_time; // Total time spent executing Lua code for objects in this world (s).
+	double max_exec_time; // Longest single script execution (event handler, timer callback etc.) (s).
+	uint64 num_executions;
+};
+
+
+/*=====================================================================
+WorldScriptContext
+------------------
+A Lua VM and timer queue for a single world.
+
+When ServerConfig::per_world_lua_vms is enabled, each world with scripted objects
+gets its own context, so a world with heavy scripts doesn't share a Lua heap and
+garbage collector with all other worlds, and its timer callbacks can be run as a
+separate batch by the main server thread.
+
+This does not isolate script latency between worlds.  Scripts for all worlds still
+run on the main server thread, holding the single ServerAllWorldsState mutex, so a
+slow script in one world still delays every other world.
+
+Otherwise all worlds use Server::lua_vm and Server::timer_queue.
+=====================================================================*/
+class WorldScriptContext : public ThreadSafeRefCounted
+{
+public:
+	WorldScriptContext(Server* server);
+	~WorldScriptContext();
+
+	UniqueRef<SubstrataLuaVM> lua_vm;
+
+	TimerQueue timer_queue;
+	std::vector<TimerQueueTimer> temp_triggered_timers;
+
+private:
+	GLARE_DISABLE_COPY(WorldScriptContext);
+};
@@ -33,6 +33,9 @@ Copyright Glare Technologies Limited 2021 -
 #include <dll/include/IndigoException.h>
 #include <dll/IndigoStringUtils.h>
 #include <dll/IndigoStringUtils.h>
+#include <meshoptimizer/src/meshoptimizer.h>
+#include <IncludeHalf.h>
+#include <limits>
 #if !GUI_CLIENT
 //#include <encoder/basisu_comp.h>
 #endif
@@ -67,6 +70,11 @@ BatchedMeshRef loadModel(const std::string& model_path)
 		GLTFLoadedData data;
 		batched_mesh = FormatDecoderGLTF::loadGLTFFile(model_path, data);
 	}
+	else if(hasExtension(model_path, "glb") || hasExtension(model_path, "vrm"))
+	{
+		GLTFLoadedData data;
+		batched_mesh = FormatDecoderGLTF::loadGLBFile(model_path, data);
+	}
 	else if(hasExtension(model_path, "igmesh"))
 	{
 		Indigo::MeshRef mesh = new Indigo::Mesh();
@@ -133,6 +141,190 @@ void generateLODModel(const std::string& model_path, int lod_level, const std::s
 }
 
 
+// Reorder the triangles in each batch for vertex cache efficiency, then for less overdraw, then reorder the vertices for vertex fetch efficiency.
+// Vertices not referenced by any triangle are removed.
+static void optimiseVertexAndIndexOrder(BatchedMesh& mesh)
+{
+	const size_t num_verts = mesh.numVerts();
+	const size_t num_indices = mesh.numIndices();
+	const size_t vert_size_B = mesh.vertexSize();
+	if(num_verts == 0 || num_indices == 0)
+		return;
+
+	const BatchedMesh::VertAttribute& pos_attr = mesh.getAttribute(BatchedMesh::VertAttribute_Position);
+	if(pos_attr.component_type != BatchedMesh::ComponentType_Float)
+		throw glare::Exception("unhandled pos component type");
+
+	js::Vector<uint32> indices;
+	indices.resizeNoCopy(num_indices);
+	for(size_t i=0; i<num_indices; ++i)
+	{
+		if(mesh.index_type == BatchedMesh::ComponentType_UInt8)
+			indices[i] = ((const uint8*)mesh.index_data.data())[i];
+		else if(mesh.index_type == BatchedMesh::ComponentType_UInt16)
+			indices[i] = ((const uint16*)mesh.index_data.data())[i];
+		else if(mesh.index_type == BatchedMesh::ComponentType_UInt32)
+			indices[i] = ((const uint32*)mesh.index_data.data())[i];
+		else
+			throw glare::Exception("unhandled index_type");
+	}
+
+	std::vector<float> positions(num_verts * 3);
+	for(size_t i=0; i<num_verts; ++i)
+		std::memcpy(&positions[i * 3], &mesh.vertex_data[vert_size_B * i + pos_attr.offset_B], sizeof(float) * 3);
+
+	// Optimise each batch separately, so that the batch index ranges stay the same.
+	std::vector<uint32> temp_indices;
+	for(size_t b=0; b<mesh.batches.size(); ++b)
+	{
+		const BatchedMesh::IndicesBatch& batch = mesh.batches[b];
+		runtimeCheck((size_t)batch.indices_start + batch.num_indices <= num_indices); // Should have been checked in checkValidAndSanitiseMesh().
+
+		uint32* const batch_indices = indices.data() + batch.indices_start;
+		temp_indices.resize(batch.num_indices);
+
+		meshopt_optimizeVertexCache(temp_indices.data(), batch_indices, batch.num_indices, num_verts);
+		meshopt_optimizeOverdraw(batch_indices, temp_indices.data(), batch.num_indices, positions.data(), num_verts, /*vertex_positions_stride=*/sizeof(float) * 3, /*threshold=*/1.05f);
+	}
+
+	std::vector<uint32> remap(num_verts);
+	const size_t new_num_verts = meshopt_optimizeVertexFetchRemap(remap.data(), indices.data(), num_indices, num_verts);
+
+	std::vector<uint8> new_vertex_data(new_num_verts * vert_size_B);
+	for(size_t i=0; i<num_verts; ++i)
+		if(remap[i] != std::numeric_limits<uint32>::max()) // Unreferenced vertices are mapped to ~0u.
+			std::memcpy(&new_vertex_data[remap[i] * vert_size_B], &mesh.vertex_data[i * vert_size_B], vert_size_B);
+
+	for(size_t i=0; i<num_indices; ++i)
+		indices[i] = remap[indices[i]];
+
+	mesh.vertex_data.resize(new_vertex_data.size());
+	if(!new_vertex_data.empty())
+		std::memcpy(mesh.vertex_data.data(), new_vertex_data.data(), new_vertex_data.size());
+
+	mesh.setIndexDataFromIndices(indices, new_num_verts);
+}
+
+
+// Convert float normals to packed normals, and float UVs in [-1, 1] to half precision, to reduce the vertex size.
+// Positions are left as floats, as half precision isn't accurate enough for them.
+static void quantiseVertexAttributes(BatchedMesh& mesh)
+{
+	const size_t num_verts = mesh.numVerts();
+	const size_t old_vert_size_B = mesh.vertexSize();
+
+	const BatchedMesh::VertAttribute* normal_attr = mesh.findAttribute(BatchedMesh::VertAttribute_Normal);
+	const BatchedMesh::VertAttribute* uv0_attr = mesh.findAttribute(BatchedMesh::VertAttribute_UV_0);
+
+	const bool quantise_normals = normal_attr && (normal_attr->component_type == BatchedMesh::ComponentType_Float);
+
+	bool quantise_uvs = uv0_attr && (uv0_attr->component_type == BatchedMesh::ComponentType_Float);
+	if(quantise_uvs)
+	{
+		for(size_t i=0; i<num_verts; ++i)
+		{
+			Vec2f uv;
+			std::memcpy(&uv, &mesh.vertex_data[old_vert_size_B * i + uv0_attr->offset_B], sizeof(Vec2f));
+			if(!(std::fabs(uv.x) <= 1.f && std::fabs(uv.y) <= 1.f)) // Half precision would lose too much precision for large (e.g. tiled) UVs.  Also catches NaNs.
+			{
+				quantise_uvs = false;
+				break;
+			}
+		}
+	}
+
+	if(!quantise_normals && !quantise_uvs)
+		return;
+
+	// Compute the new vertex layout
+	std::vector<BatchedMesh::VertAttribute> new_attributes;
+	size_t offset = 0;
+	for(size_t i=0; i<mesh.vert_attributes.size(); ++i)
+	{
+		BatchedMesh::VertAttribute attr = mesh.vert_attributes[i];
+		if(quantise_normals && (&mesh.vert_attributes[i] == normal_attr))
+			attr.component_type = BatchedMesh::ComponentType_PackedNormal;
+		else if(quantise_uvs && (&mesh.vert_attributes[i] == uv0_attr))
+			attr.component_type = BatchedMesh::ComponentType_Half;
+		attr.offset_B = offset;
+		offset += BatchedMesh::vertAttributeSize(attr);
+		new_attributes.push_back(attr);
+	}
+	const size_t new_vert_size_B = offset;
+
+	std::vector<uint8> new_vertex_data(num_verts * new_vert_size_B);
+	for(size_t i=0; i<num_verts; ++i)
+	{
+		const uint8* const src = &mesh.vertex_data[old_vert_size_B * i];
+		uint8* const dest = &new_vertex_data[new_vert_size_B * i];
+
+		for(size_t a=0; a<new_attributes.size(); ++a)
+		{
+			const BatchedMesh::VertAttribute& old_attr = mesh.vert_attributes[a];
+			const BatchedMesh::VertAttribute& new_attr = new_attributes[a];
+
+			if(quantise_normals && (&old_attr == normal_attr))
+			{
+				float n[3];
+				std::memcpy(n, src + old_attr.offset_B, sizeof(float) * 3);
+				const Vec4f normal(n[0], n[1], n[2], 0);
+				const uint32 packed_normal = batchedMeshPackNormal((dot(normal, normal) > 0) ? normalise(normal) : Vec4f(0, 0, 1, 0));
+				std::memcpy(dest + new_attr.offset_B, &packed_normal, sizeof(uint32));
+			}
+			else if(quantise_uvs && (&old_attr == uv0_attr))
+			{
+				Vec2f uv;
+				std::memcpy(&uv, src + old_attr.offset_B, sizeof(Vec2f));
+				const half half_uv[2] = { half(uv.x), half(uv.y) };
+				std::memcpy(dest + new_attr.offset_B, half_uv, sizeof(half) * 2);
+			}
+			else
+				std::memcpy(dest + new_attr.offset_B, src + old_attr.offset_B, BatchedMesh::vertAttributeSize(old_attr));
+		}
+	}
+
+	for(size_t i=0; i<new_attributes.size(); ++i)
+		mesh.vert_attributes[i] = new_attributes[i];
+
+	mesh.vertex_data.resize(new_vertex_data.size());
+	if(!new_vertex_data.empty())
+		std::memcpy(mesh.vertex_data.data(), new_vertex_data.data(), new_vertex_data.size());
+}
+
+
+BatchedMeshRef computeOptimisedModel(BatchedMeshRef batched_mesh)
+{
+	// The client rotates VRM meshes after loading them from the source model (see ModelLoading::makeGLMeshDataAndBatchedMeshForModelPath()), so an optimised bmesh would be loaded with the wrong orientation.
+	if(batched_mesh->animation_data.vrm_data.nonNull())
+		throw glare::Exception("Optimised models are not generated for VRM models.");
+
+	batched_mesh->optimise(); // Merge batches sharing the same material.
+
+	optimiseVertexAndIndexOrder(*batched_mesh);
+
+	quantiseVertexAttributes(*batched_mesh);
+
+	return batched_mesh;
+}
+
+
+bool generateOptimisedModel(const std::string& model_path, const std::string& optimised_model_path)
+{
+	BatchedMeshRef batched_mesh = loadModel(model_path);
+
+	// WorldObject::modelURLCanHaveOptimisedVersion() only excludes the .vrm extension, so check for VRM data in other formats, such as .glb, here.
+	if(batched_mesh->animation_data.vrm_data.nonNull())
+		return false;
+
+	BatchedMeshRef optimised_mesh = computeOptimisedModel(batched_mesh);
+
+	BatchedMesh::WriteOptions write_options;
+	write_options.compression_level = 9; // Use a high compression level, as this mesh will be downloaded and read many times, and only encoded here.
+	optimised_mesh->writeToFile(optimised_model_path, write_options);
+	return true;
+}
+
+
 bool textureHasAlphaChannel(const std::string& tex_path)
 {
 	if(hasExtension(tex_path, "gif") || hasExtension(tex_path, "jpg"))
@@ -511,6 +703,22 @@ void LODGeneration::test()
 			testAssert(lod_map_uint8->getN() == 4); // Should have alpha
 		}
 
+		//------------------------------------------- Test optimised model generation -------------------------------------------
+		{
+			const std::string model_path = TestUtils::getTestReposDir() + "/testfiles/gltf/2CylinderEngine.glb";
+			BatchedMeshRef original_mesh = loadModel(model_path);
+
+			const std::string optimised_model_path = PlatformUtils::getTempDirPath() + "/2CylinderEngine_opt.bmesh";
+			testAssert(generateOptimisedModel(model_path, optimised_model_path));
+
+			BatchedMeshRef optimised_mesh = loadModel(optimised_model_path);
+			testAssert(optimised_mesh->numIndices() == original_mesh->numIndices());
+			testAssert(optimised_mesh->numVerts() <= original_mesh->numVerts());
+			testAssert(optimised_mesh->numMaterialsReferenced() == original_mesh->numMaterialsReferenced());
+			testAssert(optimised_mesh->batches.size() <= optimised_mesh->numMaterialsReferenced()); // Batches should have been merged.
+			testAssert(optimised_mesh->vertexSize() <= original_mesh->vertexSize());
+		}
+
 
 #if 0 // !GUI_CLIENT  // generateKTXTexture is disabled in gui_client.
 		//------------------------------------------- Test KTX texture generation -------------------------------------------
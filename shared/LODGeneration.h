@@ -34,6 +34,15 @@ void generateLODModel(BatchedMeshRef batched_mesh, int lod_level, const std::str
 
 void generateLODModel(const std::string& model_path, int lod_level, const std::string& LOD_model_path);
 
+// Computes the version of the model that clients load instead of the source model, if present (see WorldObject::getOptimisedModelURL()).
+// Batches are merged, triangles and vertices are reordered for the vertex cache, overdraw and vertex fetch, and normals and UVs are quantised where possible.
+// Modifies batched_mesh.  Throws glare::Exception for VRM models.
+BatchedMeshRef computeOptimisedModel(BatchedMeshRef batched_mesh);
+
+// Generate and save to disk.
+// Returns false, without writing anything, if the model can't have an optimised version, e.g. a .glb file containing a VRM model.
+bool generateOptimisedModel(const std::string& model_path, const std::string& optimised_model_path);
+
 bool textureHasAlphaChannel(const std::string& tex_path, Map2DRef map);
 
 void generateLODTexture(const std::string& base_tex_path, int lod_level, const std::string& LOD_tex_path, glare::TaskManager& task_manager);
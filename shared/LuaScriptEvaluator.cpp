@@ -10,33 +10,97 @@ Copyright Glare Technologies Limited 2024 -
 #include "SubstrataLuaVM.h"
 #include "WorldStateLock.h"
 #include "WorldObject.h"
+#include "TimerQueue.h"
 #include "../server/LuaHTTPRequestManager.h" // For LuaHTTPRequestResult
+#if SERVER
+#include "../server/Server.h"
+#endif
+#include <maths/mathstypes.h>
 #include <utils/Exception.h>
 #include <utils/ConPrint.h>
 #include <utils/StringUtils.h>
 #include <utils/Lock.h>
+#include <utils/Timer.h>
 #include <lua/LuaUtils.h>
 #include <lualib.h>
 
 
+#if SERVER
+// Script execution time budget, see LuaScriptEvaluator::isOverExecTimeBudget().
+static const double EXEC_TIME_WINDOW_PERIOD = 1.0;
+static const double MAX_EXEC_TIME_PER_WINDOW = 0.05;
+
+
+// Returns the name and line number of the Lua function with the given reference, for the script profiler.
+static std::string getFunctionDescription(lua_State* state, int func_ref)
+{
+	if(func_ref == LUA_NOREF)
+		return "[script body]";
+
+	lua_getref(state, func_ref); // Pushes function onto the stack.
+
+	std::string desc = "[unknown]";
+	lua_Debug ar;
+	if(lua_isfunction(state, -1) && lua_getinfo(state, /*level (negative values are stack indices)=*/-1, "sn", &ar))
+		desc = std::string(ar.name ? ar.name : "[anonymous]") + " (line " + toString(ar.linedefined) + ")";
+
+	lua_pop(state, 1);
+	return desc;
+}
+#endif
+
+
 // Sets script_evaluator->cur_world_state_lock pointer to the world_state_lock address for the lifetime of the object.
 // This is so functions that are called from lua code can check that we hold the world state lock.
+// On the server, also times the script execution, for the script execution time budget, the script stats for the world 
+// the object is in, and the script profiler if it is enabled.
 class SetCurWorldStateLockClass
 {
 public:
-	SetCurWorldStateLockClass(LuaScriptEvaluator* script_evaluator_, WorldStateLock& world_state_lock)
+	SetCurWorldStateLockClass(LuaScriptEvaluator* script_evaluator_, WorldStateLock& world_state_lock, int func_ref)
 	:	script_evaluator(script_evaluator_)
 	{
 		script_evaluator_->cur_world_state_lock = &world_state_lock;
+
+#if SERVER
+		Server* server = script_evaluator->substrata_lua_vm->server;
+		profile = server && server->world_state->lua_script_profiler.isEnabled();
+		if(profile)
+			profile_func_desc = getFunctionDescription(script_evaluator->lua_script->thread_state, func_ref);
+#endif
 	}
 
 	~SetCurWorldStateLockClass()
 	{
+#if SERVER
+		script_evaluator->flushModifiedObjects(*script_evaluator->cur_world_state_lock);
+#endif
 		script_evaluator->cur_world_state_lock = nullptr;
+
+#if SERVER
+		const double exec_time = timer.elapsed();
+		script_evaluator->addExecTime(exec_time);
+
+		if(script_evaluator->world_state)
+		{
+			WorldScriptStats& stats = script_evaluator->world_state->script_stats;
+			stats.total_exec_time += exec_time;
+			stats.max_exec_time = myMax(stats.max_exec_time, exec_time);
+			stats.num_executions++;
+		}
+
+		if(profile)
+			script_evaluator->substrata_lua_vm->server->world_state->lua_script_profiler.addExecution(script_evaluator->world_object->uid, profile_func_desc, exec_time);
+#endif
 	}
 
 private:
 	LuaScriptEvaluator* script_evaluator;
+#if SERVER
+	Timer timer;
+	bool profile;
+	std::string profile_func_desc;
+#endif
 };
 
 
@@ -56,10 +120,17 @@ LuaScriptEvaluator::LuaScriptEvaluator(SubstrataLuaVM* substrata_lua_vm_, LuaScr
 #endif
 	next_timer_id(0),
 	num_obs_event_listening(0),
+#if SERVER
+	exec_time_in_window(0),
+	num_consecutive_over_budget_windows(0),
+#endif
 	cur_world_state_lock(nullptr)
 {
 	for(int i=0; i<MAX_NUM_TIMERS; ++i)
+	{
 		timers[i].id = -1;
+		timers[i].timer_queue = NULL;
+	}
 
 	LuaScriptOptions options;
 	options.max_num_interrupts = 10000;
@@ -90,7 +161,7 @@ LuaScriptEvaluator::LuaScriptEvaluator(SubstrataLuaVM* substrata_lua_vm_, LuaScr
 
 
 
-	SetCurWorldStateLockClass lock_setter(this, world_state_lock);
+	SetCurWorldStateLockClass lock_setter(this, world_state_lock, /*func_ref=*/LUA_NOREF);
 	lua_script->exec();
 
 	// Add any event handling functions defined in the script to the object event-handler list.
@@ -154,12 +225,12 @@ LuaScriptEvaluator::~LuaScriptEvaluator()
 void LuaScriptEvaluator::doOnUserTouchedObject(int func_ref, UID avatar_uid, UID ob_uid, WorldStateLock& world_state_lock) noexcept
 {
 	//conPrint("LuaScriptEvaluator: doOnUserTouchedObject");
-	if(hit_error || (func_ref == LUA_NOREF))
+	if(hit_error || (func_ref == LUA_NOREF) || isOverExecTimeBudget())
 		return;
 
 	try
 	{
-		SetCurWorldStateLockClass setter(this, world_state_lock);
+		SetCurWorldStateLockClass setter(this, world_state_lock, func_ref);
 
 		lua_script->resetExecutionTimeCounter();
 
@@ -192,12 +263,12 @@ void LuaScriptEvaluator::doOnUserTouchedObject(int func_ref, UID avatar_uid, UID
 void LuaScriptEvaluator::doOnUserUsedObject(int func_ref, UID avatar_uid, UID ob_uid, WorldStateLock& world_state_lock) noexcept
 {
 	//conPrint("LuaScriptEvaluator: doOnUserUsedObject");
-	if(hit_error || (func_ref == LUA_NOREF))
+	if(hit_error || (func_ref == LUA_NOREF) || isOverExecTimeBudget())
 		return;
 
 	try
 	{
-		SetCurWorldStateLockClass setter(this, world_state_lock);
+		SetCurWorldStateLockClass setter(this, world_state_lock, func_ref);
 
 		lua_script->resetExecutionTimeCounter();
 
@@ -230,12 +301,12 @@ void LuaScriptEvaluator::doOnUserUsedObject(int func_ref, UID avatar_uid, UID ob
 void LuaScriptEvaluator::doOnUserMovedNearToObject(int func_ref, UID avatar_uid, UID ob_uid, WorldStateLock& world_state_lock) noexcept
 {
 	//conPrint("LuaScriptEvaluator: doOnUserMovedNearToObject");
-	if(hit_error || (func_ref == LUA_NOREF))
+	if(hit_error || (func_ref == LUA_NOREF) || isOverExecTimeBudget())
 		return;
 
 	try
 	{
-		SetCurWorldStateLockClass setter(this, world_state_lock);
+		SetCurWorldStateLockClass setter(this, world_state_lock, func_ref);
 
 		lua_script->resetExecutionTimeCounter();
 
@@ -268,12 +339,12 @@ void LuaScriptEvaluator::doOnUserMovedNearToObject(int func_ref, UID avatar_uid,
 void LuaScriptEvaluator::doOnUserMovedAwayFromObject(int func_ref, UID avatar_uid, UID ob_uid, WorldStateLock& world_state_lock) noexcept
 {
 	//conPrint("LuaScriptEvaluator: doOnUserMovedAwayFromObject");
-	if(hit_error || (func_ref == LUA_NOREF))
+	if(hit_error || (func_ref == LUA_NOREF) || isOverExecTimeBudget())
 		return;
 
 	try
 	{
-		SetCurWorldStateLockClass setter(this, world_state_lock);
+		SetCurWorldStateLockClass setter(this, world_state_lock, func_ref);
 
 		lua_script->resetExecutionTimeCounter();
 
@@ -306,12 +377,12 @@ void LuaScriptEvaluator::doOnUserMovedAwayFromObject(int func_ref, UID avatar_ui
 void LuaScriptEvaluator::doOnUserEnteredParcel(int func_ref, UID avatar_uid, UID ob_uid, ParcelID parcel_id, WorldStateLock& world_state_lock) noexcept
 {
 	//conPrint("LuaScriptEvaluator: doOnUserEnteredParcel");
-	if(hit_error || (func_ref == LUA_NOREF))
+	if(hit_error || (func_ref == LUA_NOREF) || isOverExecTimeBudget())
 		return;
 
 	try
 	{
-		SetCurWorldStateLockClass setter(this, world_state_lock);
+		SetCurWorldStateLockClass setter(this, world_state_lock, func_ref);
 
 		lua_script->resetExecutionTimeCounter();
 
@@ -344,12 +415,12 @@ void LuaScriptEvaluator::doOnUserEnteredParcel(int func_ref, UID avatar_uid, UID
 void LuaScriptEvaluator::doOnUserExitedParcel(int func_ref, UID avatar_uid, UID ob_uid, ParcelID parcel_id, WorldStateLock& world_state_lock) noexcept
 {
 	//conPrint("LuaScriptEvaluator: doOnUserExitedParcel");
-	if(hit_error || (func_ref == LUA_NOREF))
+	if(hit_error || (func_ref == LUA_NOREF) || isOverExecTimeBudget())
 		return;
 
 	try
 	{
-		SetCurWorldStateLockClass setter(this, world_state_lock);
+		SetCurWorldStateLockClass setter(this, world_state_lock, func_ref);
 
 		lua_script->resetExecutionTimeCounter();
 
@@ -382,12 +453,12 @@ void LuaScriptEvaluator::doOnUserExitedParcel(int func_ref, UID avatar_uid, UID
 void LuaScriptEvaluator::doOnUserEnteredVehicle(int func_ref, UID avatar_uid, UID vehicle_ob_uid, WorldStateLock& world_state_lock) noexcept
 {
 	// conPrint("LuaScriptEvaluator: doOnUserEnteredVehicle");
-	if(hit_error || (func_ref == LUA_NOREF))
+	if(hit_error || (func_ref == LUA_NOREF) || isOverExecTimeBudget())
 		return;
 
 	try
 	{
-		SetCurWorldStateLockClass setter(this, world_state_lock);
+		SetCurWorldStateLockClass setter(this, world_state_lock, func_ref);
 
 		lua_script->resetExecutionTimeCounter();
 
@@ -417,12 +488,12 @@ void LuaScriptEvaluator::doOnUserEnteredVehicle(int func_ref, UID avatar_uid, UI
 void LuaScriptEvaluator::doOnUserExitedVehicle(int func_ref, UID avatar_uid, UID vehicle_ob_uid, WorldStateLock& world_state_lock) noexcept
 {
 	// conPrint("LuaScriptEvaluator: doOnUserExitedVehicle");
-	if(hit_error || (func_ref == LUA_NOREF))
+	if(hit_error || (func_ref == LUA_NOREF) || isOverExecTimeBudget())
 		return;
 
 	try
 	{
-		SetCurWorldStateLockClass setter(this, world_state_lock);
+		SetCurWorldStateLockClass setter(this, world_state_lock, func_ref);
 
 		lua_script->resetExecutionTimeCounter();
 
@@ -451,12 +522,12 @@ void LuaScriptEvaluator::doOnUserExitedVehicle(int func_ref, UID avatar_uid, UID
 
 void LuaScriptEvaluator::doOnTimerEvent(int onTimerEvent_ref, WorldStateLock& world_state_lock) noexcept
 {
-	if(hit_error)
+	if(hit_error || isOverExecTimeBudget()) // Skip timer events while the script is over its execution time budget.
 		return;
 
 	try
 	{
-		SetCurWorldStateLockClass setter(this, world_state_lock);
+		SetCurWorldStateLockClass setter(this, world_state_lock, onTimerEvent_ref);
 
 		lua_script->resetExecutionTimeCounter();
 
@@ -484,11 +555,83 @@ void LuaScriptEvaluator::doOnTimerEvent(int onTimerEvent_ref, WorldStateLock& wo
 }
 
 
+#if SERVER
+bool LuaScriptEvaluator::isOverExecTimeBudget()
+{
+	if(exec_time_window_timer.elapsed() >= EXEC_TIME_WINDOW_PERIOD)
+	{
+		// Start a new window
+		if(exec_time_in_window > MAX_EXEC_TIME_PER_WINDOW)
+			num_consecutive_over_budget_windows++;
+		else
+			num_consecutive_over_budget_windows = 0;
+
+		exec_time_in_window = 0;
+		exec_time_window_timer.reset();
+	}
+
+	return exec_time_in_window > MAX_EXEC_TIME_PER_WINDOW;
+}
+
+
+void LuaScriptEvaluator::addExecTime(double exec_time)
+{
+	exec_time_in_window += exec_time;
+
+	if(!hit_error && (exec_time_in_window > MAX_EXEC_TIME_PER_WINDOW) && (num_consecutive_over_budget_windows + 1 >= MAX_NUM_OVER_BUDGET_WINDOWS))
+	{
+		// The script has been over budget for too long, disable it.
+		if(script_output_handler)
+			script_output_handler->errorOccurredFromLuaScript(lua_script.ptr(), "Script disabled: exceeded execution time budget (" + 
+				toString((int)(MAX_EXEC_TIME_PER_WINDOW * 1000)) + " ms per " + toString((int)EXEC_TIME_WINDOW_PERIOD) + " s) for " + toString(MAX_NUM_OVER_BUDGET_WINDOWS) + " consecutive periods.");
+		hit_error = true;
+	}
+}
+
+
+void LuaScriptEvaluator::objectModified(WorldObject* ob, bool transform_changed)
+{
+	assert(cur_world_state_lock);
+
+	if(transform_changed)
+		world_state->objectTransformChanged(ob, *cur_world_state_lock);
+
+	if(modified_objects_set.insert(ob).second)
+		modified_objects.push_back(ob);
+}
+
+
+void LuaScriptEvaluator::flushModifiedObjects(WorldStateLock& world_state_lock)
+{
+	if(modified_objects.empty())
+		return;
+
+	for(size_t i=0; i<modified_objects.size(); ++i)
+	{
+		WorldObject* ob = modified_objects[i].ptr();
+		world_state->getDirtyFromRemoteObjects(world_state_lock).insert(ob);
+		world_state->addWorldObjectAsDBDirty(ob, world_state_lock);
+	}
+	modified_objects.clear();
+	modified_objects_set.clear();
+
+	substrata_lua_vm->server->world_state->markAsChanged();
+}
+#endif
+
+
 void LuaScriptEvaluator::destroyTimer(int timer_index)
 {
 	// Mark slot as free
 	timers[timer_index].id = -1;
 
+	// Remove from the timer queue, so that a destroyed repeating timer doesn't keep getting re-added.
+	if(timers[timer_index].timer_queue)
+	{
+		timers[timer_index].timer_queue->removeTimer(timers[timer_index].queue_handle);
+		timers[timer_index].timer_queue = NULL;
+	}
+
 	// Free reference to Lua onTimerEvent function, if valid
 	if(timers[timer_index].onTimerEvent_ref != LUA_NOREF)
 		lua_unref(lua_script->thread_state, timers[timer_index].onTimerEvent_ref); 
@@ -503,7 +646,7 @@ void LuaScriptEvaluator::doOnError(int onError_ref, int error_code, const std::s
 
 	try
 	{
-		SetCurWorldStateLockClass setter(this, world_state_lock);
+		SetCurWorldStateLockClass setter(this, world_state_lock, onError_ref);
 
 		lua_script->resetExecutionTimeCounter();
 
@@ -547,7 +690,7 @@ void LuaScriptEvaluator::doOnDone(int onDone_ref, Reference<LuaHTTPRequestResult
 
 	try
 	{
-		SetCurWorldStateLockClass setter(this, world_state_lock);
+		SetCurWorldStateLockClass setter(this, world_state_lock, onDone_ref);
 
 		lua_script->resetExecutionTimeCounter();
 
@@ -629,7 +772,7 @@ void LuaScriptEvaluator::pushAvatarTableOntoStack(UID avatar_uid)
 void LuaScriptEvaluator::pushWorldObjectTableOntoStack(UID ob_uid)
 {
 	// Create worldObject table
-	lua_createtable(lua_script->thread_state, /*num array elems=*/0, /*num non-array elems=*/1); // Create table
+	lua_createtable(lua_script->thread_state, /*num array elems=*/0, /*num non-array elems=*/3); // Create table
 
 	// Set metatable to worldObjectClassMetaTable
 	lua_getref(lua_script->thread_state, substrata_lua_vm->worldObjectClassMetaTable_ref); // Pushes worldObjectClassMetaTable_ref onto the stack.
@@ -637,6 +780,23 @@ void LuaScriptEvaluator::pushWorldObjectTableOntoStack(UID ob_uid)
 
 	// Set table UID field
 	LuaUtils::setNumberAsTableField(lua_script->thread_state, "uid", (double)ob_uid.value());
+
+#if SERVER
+	// Store the object handle and UID in the table, so the metamethods can find the object without a field lookup and object map lookup.
+	// See tryGetWorldObjectFromTableHandle() in SubstrataLuaVM.cpp.
+	uint64 handle = 0;
+	if(ob_uid == world_object->uid)
+		handle = world_object->script_handle;
+	else if(cur_world_state_lock)
+	{
+		auto res = world_state->getObjects(*cur_world_state_lock).find(ob_uid);
+		if(res != world_state->getObjects(*cur_world_state_lock).end())
+			handle = res->second->script_handle;
+	}
+
+	if(handle != 0)
+		SubstrataLuaVM::setWorldObjectTableHandle(lua_script->thread_state, handle, ob_uid.value());
+#endif
 }
 
 
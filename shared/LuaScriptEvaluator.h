@@ -14,12 +14,17 @@ Copyright Glare Technologies Limited 2024 -
 #include <utils/RefCounted.h>
 #include <utils/WeakRefCounted.h>
 #include <utils/UniqueRef.h>
+#include <utils/Reference.h>
+#include <utils/Timer.h>
 #include <memory>
+#include <unordered_set>
+#include <vector>
 class SubstrataLuaVM;
 class WorldObject;
 class ServerWorldState;
 class WorldStateLock;
 class LuaHTTPRequestResult;
+class TimerQueue;
 
 
 /*=====================================================================
@@ -63,6 +68,24 @@ public:
 	void doOnError(int onError_ref, int error_code, const std::string& error_description, WorldStateLock& world_state_lock) noexcept;
 	void doOnDone(int onDone_ref, Reference<LuaHTTPRequestResult> result, WorldStateLock& world_state_lock) noexcept;
 
+#if SERVER
+	// Execution time budget.  If a script executes for more than 50 ms in a one second window, its event handlers and timer callbacks
+	// are skipped for the rest of the window.  A script that goes over budget in MAX_NUM_OVER_BUDGET_WINDOWS consecutive windows is disabled.
+	// (Each individual callback is also limited by the max_num_interrupts option of the LuaScript.)
+	bool isOverExecTimeBudget();
+	void addExecTime(double exec_time);
+#else
+	bool isOverExecTimeBudget() { return false; } // The execution time budget is only applied on the server.
+#endif
+
+#if SERVER
+	// Called by the WorldObject and WorldMaterial __newindex metamethods after changing an object.
+	// If the transform changed, the object grid is updated immediately, so that spatial queries later in the same callback see the new position.
+	// Updating the dirty sets is deferred until the end of the script callback, so it is done once per object even if the script sets many properties.
+	void objectModified(WorldObject* ob, bool transform_changed);
+	void flushModifiedObjects(WorldStateLock& world_state_lock);
+#endif
+
 //private:
 	void pushUserTableOntoStack(UserID client_user_id);
 	void pushAvatarTableOntoStack(UID avatar_uid);
@@ -88,10 +111,23 @@ public:
 	{
 		int id; // -1 means no timer.
 		int onTimerEvent_ref; // Reference to Lua callback function
+		TimerQueue* timer_queue; // Timer queue the timer was added to.
+		uint64 queue_handle; // Handle of the timer in timer_queue.
 	};
 	LuaTimerInfo timers[MAX_NUM_TIMERS];
 
 	int next_timer_id;
 
 	int num_obs_event_listening; // Number of objects that this script has added an event listener to.
+
+#if SERVER
+	static const int MAX_NUM_OVER_BUDGET_WINDOWS = 10;
+
+	Timer exec_time_window_timer;
+	double exec_time_in_window; // Time spent executing in the current window (s)
+	int num_consecutive_over_budget_windows;
+
+	std::vector<Reference<WorldObject>> modified_objects; // Objects changed by the current script callback, see objectModified().
+	std::unordered_set<WorldObject*> modified_objects_set; // Set of the objects in modified_objects, to avoid duplicates.
+#endif
 };
@@ -0,0 +1,320 @@
+/*=====================================================================
+ParcelSpatialIndex.cpp
+----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ParcelSpatialIndex.h"
+
+
+#include <maths/mathstypes.h>
+#include <algorithm>
+#include <cmath>
+
+
+const float ParcelSpatialIndex::CELL_WIDTH = 64.f;
+
+static const int64 MAX_NUM_CELLS_PER_PARCEL = 256; // Parcels overlapping more cells than this are put in the large parcel list.
+
+
+static inline int cellCoord(float x)
+{
+	const float MAX_CELL_COORD = 1.0e8f;
+	return (int)myClamp(std::floor(x / ParcelSpatialIndex::CELL_WIDTH), -MAX_CELL_COORD, MAX_CELL_COORD);
+}
+
+
+ParcelSpatialIndex::ParcelSpatialIndex()
+{}
+
+
+ParcelSpatialIndex::~ParcelSpatialIndex()
+{}
+
+
+bool ParcelSpatialIndex::getCellBounds(const js::AABBox& aabb, Vec3i& min_cell_out, Vec3i& max_cell_out)
+{
+	if(!(isFinite(aabb.min_[0]) && isFinite(aabb.min_[1]) && isFinite(aabb.max_[0]) && isFinite(aabb.max_[1])))
+		return false;
+
+	min_cell_out = Vec3i(cellCoord(aabb.min_[0]), cellCoord(aabb.min_[1]), 0);
+	max_cell_out = Vec3i(cellCoord(aabb.max_[0]), cellCoord(aabb.max_[1]), 0);
+	return true;
+}
+
+
+static void removeFromVector(std::vector<Parcel*>& v, Parcel* parcel)
+{
+	for(size_t i=0; i<v.size(); ++i)
+		if(v[i] == parcel)
+		{
+			v[i] = v.back();
+			v.pop_back();
+			return;
+		}
+}
+
+
+void ParcelSpatialIndex::insertOrUpdate(const ParcelRef& parcel)
+{
+	remove(parcel->id);
+
+	Entry entry;
+	entry.parcel = parcel;
+	entry.in_grid = false;
+
+	if(getCellBounds(parcel->aabb, entry.min_cell, entry.max_cell))
+	{
+		const int64 num_cells = ((int64)entry.max_cell.x - entry.min_cell.x + 1) * ((int64)entry.max_cell.y - entry.min_cell.y + 1);
+		if(num_cells <= MAX_NUM_CELLS_PER_PARCEL)
+		{
+			entry.in_grid = true;
+			for(int y=entry.min_cell.y; y<=entry.max_cell.y; ++y)
+			for(int x=entry.min_cell.x; x<=entry.max_cell.x; ++x)
+				cells[Vec3i(x, y, 0)].push_back(parcel.ptr());
+		}
+		else
+			large_parcels.push_back(parcel.ptr());
+	}
+	// else AABB is not finite, so no point can be in the parcel.  Keep the entry so numParcels() matches the parcel map size.
+
+	entries.insert(std::make_pair(parcel->id, entry));
+}
+
+
+void ParcelSpatialIndex::remove(const ParcelID& id)
+{
+	auto res = entries.find(id);
+	if(res == entries.end())
+		return;
+
+	const Entry& entry = res->second;
+	Parcel* parcel = entry.parcel.ptr();
+	if(entry.in_grid)
+	{
+		for(int y=entry.min_cell.y; y<=entry.max_cell.y; ++y)
+		for(int x=entry.min_cell.x; x<=entry.max_cell.x; ++x)
+		{
+			auto cell_res = cells.find(Vec3i(x, y, 0));
+			if(cell_res != cells.end())
+			{
+				removeFromVector(cell_res->second, parcel);
+				if(cell_res->second.empty())
+					cells.erase(cell_res);
+			}
+		}
+	}
+	else
+		removeFromVector(large_parcels, parcel);
+
+	entries.erase(res);
+}
+
+
+void ParcelSpatialIndex::clear()
+{
+	entries.clear();
+	cells.clear();
+	large_parcels.clear();
+}
+
+
+void ParcelSpatialIndex::rebuild(const std::map<ParcelID, ParcelRef>& parcels)
+{
+	clear();
+	for(auto it = parcels.begin(); it != parcels.end(); ++it)
+		insertOrUpdate(it->second);
+}
+
+
+void ParcelSpatialIndex::getParcelsContainingPoint(const Vec4f& p, std::vector<Parcel*>& parcels_out) const
+{
+	if(!(isFinite(p[0]) && isFinite(p[1])))
+		return;
+
+	const Vec3i cell(cellCoord(p[0]), cellCoord(p[1]), 0);
+	auto res = cells.find(cell);
+	if(res != cells.end())
+	{
+		const std::vector<Parcel*>& cell_parcels = res->second;
+		for(size_t i=0; i<cell_parcels.size(); ++i)
+			if(cell_parcels[i]->aabb.contains(p))
+				parcels_out.push_back(cell_parcels[i]);
+	}
+
+	for(size_t i=0; i<large_parcels.size(); ++i)
+		if(large_parcels[i]->aabb.contains(p))
+			parcels_out.push_back(large_parcels[i]);
+}
+
+
+Parcel* ParcelSpatialIndex::getParcelPointIsIn(const Vec4f& p) const
+{
+	if(!(isFinite(p[0]) && isFinite(p[1])))
+		return NULL;
+
+	// Return the parcel with the lowest id, to match iterating over the parcel map in order.
+	Parcel* best = NULL;
+
+	const Vec3i cell(cellCoord(p[0]), cellCoord(p[1]), 0);
+	auto res = cells.find(cell);
+	if(res != cells.end())
+	{
+		const std::vector<Parcel*>& cell_parcels = res->second;
+		for(size_t i=0; i<cell_parcels.size(); ++i)
+			if(cell_parcels[i]->aabb.contains(p) && (!best || (cell_parcels[i]->id < best->id)))
+				best = cell_parcels[i];
+	}
+
+	for(size_t i=0; i<large_parcels.size(); ++i)
+		if(large_parcels[i]->aabb.contains(p) && (!best || (large_parcels[i]->id < best->id)))
+			best = large_parcels[i];
+
+	return best;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <maths/PCG32.h>
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <limits>
+
+
+static ParcelRef makeTestParcel(uint32 id, const Vec2d& min, const Vec2d& max)
+{
+	ParcelRef parcel = new Parcel();
+	parcel->id = ParcelID(id);
+	parcel->verts[0] = Vec2d(min.x, min.y);
+	parcel->verts[1] = Vec2d(max.x, min.y);
+	parcel->verts[2] = Vec2d(max.x, max.y);
+	parcel->verts[3] = Vec2d(min.x, max.y);
+	parcel->zbounds = Vec2d(-1, 10);
+	parcel->build();
+	return parcel;
+}
+
+
+// Reference implementation: linear scan over all parcels.
+static Parcel* linearScanParcelPointIsIn(const std::map<ParcelID, ParcelRef>& parcels, const Vec4f& p)
+{
+	for(auto it = parcels.begin(); it != parcels.end(); ++it)
+		if(it->second->aabb.contains(p))
+			return it->second.ptr();
+	return NULL;
+}
+
+
+void ParcelSpatialIndex::test()
+{
+	conPrint("ParcelSpatialIndex::test()");
+
+	//------------------------ Basic tests ------------------------
+	{
+		ParcelSpatialIndex index;
+		std::map<ParcelID, ParcelRef> parcels;
+		parcels[ParcelID(1)] = makeTestParcel(1, Vec2d(0, 0), Vec2d(20, 20));
+		parcels[ParcelID(2)] = makeTestParcel(2, Vec2d(-100, -100), Vec2d(-60, -70)); // Spans multiple cells
+		parcels[ParcelID(3)] = makeTestParcel(3, Vec2d(-10000, -10000), Vec2d(10000, -9000)); // Large parcel
+		parcels[ParcelID(4)] = makeTestParcel(4, Vec2d(10, 10), Vec2d(30, 30)); // Overlaps parcel 1
+		index.rebuild(parcels);
+		testAssert(index.numParcels() == 4);
+
+		testAssert(index.getParcelPointIsIn(Vec4f(5, 5, 1, 1)) == parcels[ParcelID(1)].ptr());
+		testAssert(index.getParcelPointIsIn(Vec4f(15, 15, 1, 1)) == parcels[ParcelID(1)].ptr()); // In 1 and 4, lowest id is returned.
+		testAssert(index.getParcelPointIsIn(Vec4f(25, 25, 1, 1)) == parcels[ParcelID(4)].ptr());
+		testAssert(index.getParcelPointIsIn(Vec4f(-80, -80, 1, 1)) == parcels[ParcelID(2)].ptr());
+		testAssert(index.getParcelPointIsIn(Vec4f(5000, -9500, 1, 1)) == parcels[ParcelID(3)].ptr());
+		testAssert(index.getParcelPointIsIn(Vec4f(5, 5, 100, 1)) == NULL); // Above z bounds
+		testAssert(index.getParcelPointIsIn(Vec4f(500, 500, 1, 1)) == NULL);
+		testAssert(index.getParcelPointIsIn(Vec4f(std::numeric_limits<float>::quiet_NaN(), 0, 1, 1)) == NULL);
+
+		std::vector<Parcel*> containing;
+		index.getParcelsContainingPoint(Vec4f(15, 15, 1, 1), containing);
+		testAssert(containing.size() == 2);
+
+		// Move parcel 4
+		parcels[ParcelID(4)]->verts[0] = Vec2d(200, 200);
+		parcels[ParcelID(4)]->verts[1] = Vec2d(220, 200);
+		parcels[ParcelID(4)]->verts[2] = Vec2d(220, 220);
+		parcels[ParcelID(4)]->verts[3] = Vec2d(200, 220);
+		parcels[ParcelID(4)]->build();
+		index.insertOrUpdate(parcels[ParcelID(4)]);
+		testAssert(index.numParcels() == 4);
+		testAssert(index.getParcelPointIsIn(Vec4f(25, 25, 1, 1)) == NULL);
+		testAssert(index.getParcelPointIsIn(Vec4f(210, 210, 1, 1)) == parcels[ParcelID(4)].ptr());
+
+		// Remove parcels
+		index.remove(ParcelID(1));
+		index.remove(ParcelID(3));
+		index.remove(ParcelID(100));
+		testAssert(index.numParcels() == 2);
+		testAssert(index.getParcelPointIsIn(Vec4f(5, 5, 1, 1)) == NULL);
+		testAssert(index.getParcelPointIsIn(Vec4f(5000, -9500, 1, 1)) == NULL);
+	}
+
+	//------------------------ Compare against linear scan, and benchmark replaying a stream of object transform updates ------------------------
+	{
+		// Make a grid of parcels similar to the main world.
+		std::map<ParcelID, ParcelRef> parcels;
+		uint32 next_id = 1;
+		for(int y=-30; y<30; ++y)
+		for(int x=-30; x<30; ++x)
+		{
+			parcels[ParcelID(next_id)] = makeTestParcel(next_id, Vec2d(x * 25.0, y * 25.0), Vec2d(x * 25.0 + 20.0, y * 25.0 + 20.0));
+			next_id++;
+		}
+
+		ParcelSpatialIndex index;
+		Timer build_timer;
+		index.rebuild(parcels);
+		const double build_time = build_timer.elapsed();
+
+		// Simulate a few objects being dragged around: each update moves an object a short distance from its previous position.
+		const int NUM_OBJECTS = 16;
+		const int NUM_UPDATES = 100000;
+		PCG32 rng(1);
+		std::vector<Vec4f> positions;
+		for(int i=0; i<NUM_UPDATES; ++i)
+		{
+			if(i < NUM_OBJECTS)
+				positions.push_back(Vec4f((rng.unitRandom() - 0.5f) * 1500.f, (rng.unitRandom() - 0.5f) * 1500.f, 1.f, 1.f));
+			else
+			{
+				const Vec4f prev = positions[i - NUM_OBJECTS];
+				positions.push_back(Vec4f(prev[0] + (rng.unitRandom() - 0.5f), prev[1] + (rng.unitRandom() - 0.5f), 1.f, 1.f));
+			}
+		}
+
+		size_t num_in_parcel = 0;
+		Timer index_timer;
+		for(int i=0; i<NUM_UPDATES; ++i)
+			if(index.getParcelPointIsIn(positions[i]))
+				num_in_parcel++;
+		const double index_time = index_timer.elapsed();
+
+		size_t linear_num_in_parcel = 0;
+		Timer linear_timer;
+		for(int i=0; i<NUM_UPDATES; ++i)
+			if(linearScanParcelPointIsIn(parcels, positions[i]))
+				linear_num_in_parcel++;
+		const double linear_time = linear_timer.elapsed();
+
+		testAssert(num_in_parcel == linear_num_in_parcel);
+		for(int i=0; i<NUM_UPDATES; i += 97)
+			testAssert(index.getParcelPointIsIn(positions[i]) == linearScanParcelPointIsIn(parcels, positions[i]));
+
+		conPrint(toString(parcels.size()) + " parcels, " + toString(NUM_UPDATES) + " transform updates (" + toString(num_in_parcel) + " in a parcel)");
+		conPrint("index build time: " + doubleToStringNSigFigs(build_time * 1.0e3, 4) + " ms");
+		conPrint("index lookup:  " + doubleToStringNSigFigs(index_time  * 1.0e9 / NUM_UPDATES, 4) + " ns per update");
+		conPrint("linear scan:   " + doubleToStringNSigFigs(linear_time * 1.0e9 / NUM_UPDATES, 4) + " ns per update");
+	}
+
+	conPrint("ParcelSpatialIndex::test() done.");
+}
+
+
+#endif // BUILD_TESTS
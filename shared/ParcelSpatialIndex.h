@@ -0,0 +1,81 @@
+/*=====================================================================
+ParcelSpatialIndex.h
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "Parcel.h"
+#include <maths/vec3.h>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+
+struct ParcelSpatialIndexCellHash
+{
+	size_t operator() (const Vec3i& v) const
+	{
+		return (size_t)(((uint32)v.x * 73856093u) ^ ((uint32)v.y * 19349663u));
+	}
+};
+
+
+/*=====================================================================
+ParcelSpatialIndex
+------------------
+2D grid over parcel AABBs, for finding the parcels containing a point
+without scanning every parcel in the world.
+
+Used on the server for object write permission checks, and on the client
+for WorldState::getParcelPointIsIn().
+
+Parcels are bucketed into every grid cell their AABB overlaps in x and y.
+Parcels that overlap a very large number of cells are kept in a separate
+list that is always checked instead.
+
+Call insertOrUpdate() when a parcel is added or its geometry changes, and
+remove() when a parcel is removed.
+Not threadsafe, access is guarded by the world state mutex.
+=====================================================================*/
+class ParcelSpatialIndex
+{
+public:
+	ParcelSpatialIndex();
+	~ParcelSpatialIndex();
+
+	static const float CELL_WIDTH;
+
+	void insertOrUpdate(const ParcelRef& parcel); // Replaces any existing parcel with the same id.  Parcel AABB should be built already.
+	void remove(const ParcelID& id); // Does nothing if no parcel with the given id is inserted.
+	void clear();
+
+	void rebuild(const std::map<ParcelID, ParcelRef>& parcels); // Clear and insert all parcels in the map.
+
+	size_t numParcels() const { return entries.size(); }
+
+	// Appends parcels whose AABB contains p to parcels_out.
+	void getParcelsContainingPoint(const Vec4f& p, std::vector<Parcel*>& parcels_out) const;
+
+	// Returns the parcel with the lowest id whose AABB contains p, or NULL if none.
+	Parcel* getParcelPointIsIn(const Vec4f& p) const;
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(ParcelSpatialIndex);
+
+	static bool getCellBounds(const js::AABBox& aabb, Vec3i& min_cell_out, Vec3i& max_cell_out); // Returns false if the AABB is not finite.
+
+	struct Entry
+	{
+		ParcelRef parcel;
+		Vec3i min_cell, max_cell;
+		bool in_grid; // False if parcel is in large_parcels, or has a non-finite AABB.
+	};
+
+	std::map<ParcelID, Entry> entries;
+	std::unordered_map<Vec3i, std::vector<Parcel*>, ParcelSpatialIndexCellHash> cells;
+	std::vector<Parcel*> large_parcels;
+};
@@ -33,13 +33,14 @@ CyberspaceProtocolVersion
 	Added scale to ObjectTransformUpdate message.
 38: Use length-prefixed serialisation for WorldMaterial, sending server version to client.
 39: Added QueryMapTiles, MapTilesResult
+40: Added ConnectionTypeDownloadResourcesMultiplexed
 */
 namespace Protocol
 {
 
 const uint32 CyberspaceHello = 1357924680;
 
-const uint32 CyberspaceProtocolVersion = 39;
+const uint32 CyberspaceProtocolVersion = 40;
 
 const uint32 ClientProtocolOK		= 10000;
 const uint32 ClientProtocolTooOld	= 10001;
@@ -56,6 +57,7 @@ const uint32 ConnectionTypeDownloadResources	= 502;
 //const uint32 ConnectionTypeWebsite				= 503; // A connection from the webserver.
 const uint32 ConnectionTypeScreenshotBot		= 504; // A connection from the screenshot bot.
 const uint32 ConnectionTypeEthBot				= 505; // A connection from the Ethereum bot.
+const uint32 ConnectionTypeDownloadResourcesMultiplexed = 506; // Resources are sent in chunks, interleaved by client-supplied priority.  Introduced in protocol version 40.
 
 
 const uint32 AvatarCreated			= 1000;
@@ -119,6 +121,13 @@ const uint32 LODChunkUpdatedMessage		= 3902;
 const uint32 GetFile				= 4000;
 const uint32 GetFiles				= 4001; // Client wants to download multiple resources from the server.
 
+// Messages on ConnectionTypeDownloadResourcesMultiplexed connections.  These are not framed (no length field), like GetFiles.
+const uint32 RequestResource		= 4010; // Client -> server.  request id (uint32), URL (string), start offset (uint64, for resuming a partial download), priority (float, lower values are sent first)
+const uint32 UpdateResourcePriority	= 4011; // Client -> server.  request id (uint32), priority (float)
+const uint32 CancelResourceRequest	= 4012; // Client -> server.  request id (uint32)
+const uint32 ResourceHeader			= 4013; // Server -> client.  request id (uint32), result (uint32, 0 = OK), file size (uint64), start offset (uint64).  Start offset will be 0 if the requested offset was invalid.
+const uint32 ResourceChunk			= 4014; // Server -> client.  request id (uint32), chunk size (uint32), chunk data.  Chunks for a request are sent in order, ending at the file size.
+
 const uint32 NewResourceOnServer	= 4100; // A file has been uploaded to the server
 
 
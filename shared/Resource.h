@@ -40,7 +40,7 @@ public:
 	};
 
 	Resource(const std::string& URL_, const std::string& raw_local_path_, State s, const UserID& owner_id_);
-	Resource() : state(State_NotPresent)/*, num_buffer_readers(0)*/, locally_deleted(false), file_size_B(0) {}
+	Resource() : state(State_NotPresent)/*, num_buffer_readers(0)*/, locally_deleted(false), file_size_B(0), last_access_time(0) {}
 	
 	const std::string getLocalAbsPath(const std::string& base_resource_dir) const { return base_resource_dir + "/" + local_path; }
 	const std::string getRawLocalPath() const { return local_path; } // Relative path on local disk from base_resources_dir.
@@ -76,7 +76,9 @@ private:
 public:
 	bool locally_deleted; // Has resource been deleted with ResourceManager::deleteResourceLocally().  (For Emscripten)
 
-	size_t file_size_B; // Size of resource on disk.  Just used with Emscripten.
+	size_t file_size_B; // Size of resource on disk.  Used with Emscripten, and for the client resource cache size budget.  0 if not known.
+
+	uint64 last_access_time; // Time the resource was last used, in seconds since 1970.  Just used on the client, for evicting least recently used resources.
 };
 
 typedef Reference<Resource> ResourceRef;
@@ -17,16 +17,23 @@ Generated at 2016-01-12 12:22:34 +1300
 #include <FileInStream.h>
 #include <FileOutStream.h>
 #include <IncludeXXHash.h>
+#include <Database.h>
+#include <BufferOutStream.h>
+#include <BufferViewInStream.h>
+#include <Clock.h>
+#include <maths/mathstypes.h>
+#include <algorithm>
 
 
 ResourceManager::ResourceManager(const std::string& base_resource_dir_)
-:	base_resource_dir(base_resource_dir_), changed(0), total_present_resources_size_B(0)
+:	base_resource_dir(base_resource_dir_), changed(0), total_present_resources_size_B(0), database(NULL), num_record_writes_since_compaction(0)
 {
 }
 
 
 ResourceManager::~ResourceManager()
 {
+	delete database;
 }
 
 
@@ -135,12 +142,15 @@ ResourceRef ResourceManager::getOrCreateResourceForURL(const std::string& URL) /
 			FileUtils::fileExists(abs_path) ? Resource::State_Present : Resource::State_NotPresent,
 			UserID::invalidUserID()
 		);
+		resource->last_access_time = (uint64)Clock::getSecsSince1970();
 		resource_for_url[URL] = resource;
+		addToDBDirtySet(resource);
 		this->changed = 1;
 		return resource;
 	}
 	else
 	{
+		updateLastAccessTime(res->second, (uint64)Clock::getSecsSince1970());
 		return res->second;
 	}
 }
@@ -179,7 +189,7 @@ void ResourceManager::copyLocalFileToResourceDir(const std::string& local_path,
 		res->setState(Resource::State_Present);
 
 		if(!already_exists || (prev_state != Resource::State_Present))
-			this->changed = 1;
+			markResourceAsChanged(res);
 	}
 	catch(FileUtils::FileUtilsExcep& e)
 	{
@@ -208,7 +218,7 @@ std::string ResourceManager::copyLocalFileToResourceDirIfNotPresent(const std::s
 		res->setState(Resource::State_Present);
 
 		if(!already_exists || (prev_state != Resource::State_Present))
-			this->changed = 1;
+			markResourceAsChanged(res);
 
 		return URL;
 	}
@@ -229,6 +239,7 @@ void ResourceManager::setResourceAsLocallyPresentForURL(const std::string& URL)
 		ResourceRef res = getOrCreateResourceForURL(URL);
 		res->setState(Resource::State_Present);
 
+		addToDBDirtySet(res);
 		this->changed = 1;
 	}
 	catch(FileUtils::FileUtilsExcep& e)
@@ -278,6 +289,7 @@ void ResourceManager::deleteResourceLocally(const ResourceRef& resource)
 		assert(this->total_present_resources_size_B >= (int64)resource->file_size_B);
 		this->total_present_resources_size_B -= (int64)resource->file_size_B;
 
+		addToDBDirtySet(resource);
 		this->changed = 1;
 	}
 }
@@ -289,6 +301,7 @@ void ResourceManager::addResource(ResourceRef& res)
 
 	resource_for_url[res->URL] = res;
 
+	addToDBDirtySet(res);
 	this->changed = 1;
 }
 
@@ -299,6 +312,40 @@ void ResourceManager::markAsChanged() // Thread-safe
 }
 
 
+// If the database hasn't been opened yet, the next save will write all resources, so there is no need to track changed resources.
+// (This also means we don't build up a set of changed resources on the server, which doesn't use saveToDisk())
+void ResourceManager::addToDBDirtySet(const ResourceRef& resource)
+{
+	if(database)
+		db_dirty_resources.insert(resource);
+}
+
+
+// The last access time is just used for choosing which resources to evict, which doesn't need fine time resolution.
+// Updating it at most this often means repeatedly used resources don't cause a DB record write each time they are used.
+static const uint64 ACCESS_TIME_UPDATE_PERIOD_S = 600;
+
+
+void ResourceManager::updateLastAccessTime(const ResourceRef& resource, uint64 cur_time)
+{
+	// Also update if the clock has gone backwards, so the access time doesn't get stuck in the future.
+	if((cur_time >= resource->last_access_time + ACCESS_TIME_UPDATE_PERIOD_S) || (cur_time < resource->last_access_time))
+	{
+		resource->last_access_time = cur_time;
+		addToDBDirtySet(resource);
+	}
+}
+
+
+void ResourceManager::markResourceAsChanged(const ResourceRef& resource) // Thread-safe
+{
+	Lock lock(mutex);
+
+	addToDBDirtySet(resource);
+	this->changed = 1;
+}
+
+
 void ResourceManager::addToDownloadFailedURLs(const std::string& URL)
 {
 	// conPrint("addToDownloadFailedURLs: " + URL);
@@ -360,23 +407,94 @@ std::string ResourceManager::getDiagnostics() const
 }
 
 
-static const uint32 RESOURCE_MANAGER_MAGIC_NUMBER = 587732371;
-static const uint32 RESOURCE_MANAGER_SERIALISATION_VERSION = 2;
+// The resources DB is stored in a Database, with one record per resource.  When a resource changes, just its record is written (appended to the database file).
 static const uint32 RESOURCE_CHUNK = 103;
+static const uint32 RESOURCE_RECORD_VERSION = 1;
+
+// Compact the database file when there are more out-of-date records than this, and more out-of-date records than current records.
+static const size_t MIN_NUM_RECORD_WRITES_BEFORE_COMPACTION = 100000;
+static const uint64 MIN_OUT_OF_DATE_SIZE_B_BEFORE_COMPACTION = 4 * 1024 * 1024;
+
+// Old, pre-Database resources DB format.  Just used for reading, after which the DB is converted to the Database format.
+static const uint32 RESOURCE_MANAGER_MAGIC_NUMBER = 587732371;
+static const uint32 RESOURCE_MANAGER_SERIALISATION_VERSION = 3;
 static const uint32 EOS_CHUNK = 1000;
 /*
 Version history:
 2: Serialising resource state
+3: Serialising resource file size and last access time
 */
 
-void ResourceManager::loadFromDisk(const std::string& path, bool force_check_if_resources_exist_on_disk)
+
+static void writeResourceRecord(Resource& resource, OutStream& stream)
 {
-	conPrint("Reading resource info from '" + path + "'...");
+	stream.writeUInt32(RESOURCE_CHUNK);
+	stream.writeUInt32(RESOURCE_RECORD_VERSION);
+	resource.writeToStream(stream);
+	stream.writeUInt64(resource.file_size_B);
+	stream.writeUInt64(resource.last_access_time);
+}
 
-	Lock lock(mutex);
 
-	Timer timer;
+static void readResourceRecord(InStream& stream, Resource& resource)
+{
+	const uint32 chunk = stream.readUInt32();
+	if(chunk != RESOURCE_CHUNK)
+		throw glare::Exception("Unknown chunk type '" + toString(chunk) + "'");
+
+	const uint32 version = stream.readUInt32();
+	if(version > RESOURCE_RECORD_VERSION)
+		throw glare::Exception("Unknown resource record version " + toString(version) + ", expected " + toString(RESOURCE_RECORD_VERSION) + ".");
 
+	readFromStream(stream, resource);
+	resource.file_size_B = (size_t)stream.readUInt64();
+	resource.last_access_time = stream.readUInt64();
+}
+
+
+// Inserts a resource read from the DB, and fixes up its state if needed.
+void ResourceManager::addLoadedResource(const ResourceRef& resource, bool check_resources_present_on_disk, size_t& num_resources_present)
+{
+	resource_for_url[resource->URL] = resource;
+
+	const Resource::State prev_resource_state = resource->getState();
+
+	if(check_resources_present_on_disk)
+	{
+		if(FileUtils::fileExists(resource->getLocalAbsPath(this->base_resource_dir)))
+		{
+			resource->setState(Resource::State_Present);
+			num_resources_present++;
+		}
+		else
+		{
+			resource->setState(Resource::State_NotPresent);
+		}
+	}
+	else
+	{
+		if(resource->getState() == Resource::State_Present)
+		{
+			num_resources_present++;
+		}
+		else if(resource->getState() == Resource::State_Transferring)
+		{
+			// Any resources that were transferring when the resources database was last saved, may not have been completely downloaded.
+			// Mark them as NotPresent so they will be re-downloaded.
+			resource->setState(Resource::State_NotPresent);
+		}
+	}
+
+	if(resource->getState() != prev_resource_state) // Mark resource as changed if we changed its state, so the record gets saved to disk.
+	{
+		addToDBDirtySet(resource);
+		this->changed = 1;
+	}
+}
+
+
+void ResourceManager::loadFromLegacyFormatFile(const std::string& path, bool force_check_if_resources_exist_on_disk, size_t& num_resources_present)
+{
 	FileInStream stream(path);
 
 	// Read magic number
@@ -392,7 +510,6 @@ void ResourceManager::loadFromDisk(const std::string& path, bool force_check_if_
 	// From version 2, we save the resource state with the resources, so we don't have to recompute it when loading the resources.
 	const bool check_resources_present_on_disk = (version == 1) || force_check_if_resources_exist_on_disk;
 
-	size_t num_resources_present = 0;
 	while(1)
 	{
 		const uint32 chunk = stream.readUInt32();
@@ -401,45 +518,13 @@ void ResourceManager::loadFromDisk(const std::string& path, bool force_check_if_
 			// Deserialise resource
 			ResourceRef resource = new Resource();
 			readFromStream(stream, *resource); // NOTE: for old resource versions (< 4), will convert absolute local paths to relative local paths.
-
-			// conPrint("Loaded resource:\n  URL: '" + resource->URL + "'\n  local_path: '" + resource->getLocalPath() + "'\n  owner_id: " + resource->owner_id.toString());
-
-			resource_for_url[resource->URL] = resource;
-
-			//TEMP:
-			//if(resource->getLocalPath().size() >= 260)
-			//	resource->setLocalPath(this->computeLocalPathFromURLHash(resource->URL, ::getExtension(resource->getLocalPath())));
-
-			const Resource::State prev_resource_state = resource->getState();
-
-			if(check_resources_present_on_disk)
-			{
-				if(FileUtils::fileExists(resource->getLocalAbsPath(this->base_resource_dir)))
-				{
-					resource->setState(Resource::State_Present);
-					num_resources_present++;
-				}
-				else
-				{
-					resource->setState(Resource::State_NotPresent);
-				}
-			}
-			else
+			if(version >= 3)
 			{
-				if(resource->getState() == Resource::State_Present)
-				{
-					num_resources_present++;
-				}
-				else if(resource->getState() == Resource::State_Transferring)
-				{
-					// Any resources that were transferring when the resources database was last saved, may not have been completely downloaded.
-					// Mark them as NotPresent so they will be re-downloaded.
-					resource->setState(Resource::State_NotPresent);
-				}
+				resource->file_size_B = (size_t)stream.readUInt64();
+				resource->last_access_time = stream.readUInt64();
 			}
 
-			if(resource->getState() != prev_resource_state) // Set changed flag for DB if we changed a resource state, so the DB gets saved to disk.
-				this->changed = 1;
+			addLoadedResource(resource, check_resources_present_on_disk, num_resources_present);
 		}
 		else if(chunk == EOS_CHUNK)
 		{
@@ -450,47 +535,133 @@ void ResourceManager::loadFromDisk(const std::string& path, bool force_check_if_
 			throw glare::Exception("Unknown chunk type '" + toString(chunk) + "'");
 		}
 	}
-
-	conPrint("Loaded info on " + toString(resource_for_url.size()) + " resource(s). (check_resources_present_on_disk: " + boolToString(check_resources_present_on_disk) + ", " + 
-		toString(num_resources_present) + " present on disk, changed: " + boolToString(changed) + ")  Elapsed: " + timer.elapsedStringNSigFigs(3) + "");
 }
 
 
-void ResourceManager::saveToDisk(const std::string& path)
+void ResourceManager::loadFromDisk(const std::string& path, bool force_check_if_resources_exist_on_disk)
 {
-	conPrint("Saving resources to disk...");
-	Timer timer;
+	conPrint("Reading resource info from '" + path + "'...");
 
 	Lock lock(mutex);
 
-	try
+	Timer timer;
+
+	bool is_legacy_format;
 	{
-		const std::string temp_path = path + "_temp";
+		FileInStream stream(path);
+		is_legacy_format = stream.readUInt32() == RESOURCE_MANAGER_MAGIC_NUMBER;
+	}
 
+	size_t num_resources_present = 0;
+	bool compact = false;
+	if(is_legacy_format)
+	{
+		loadFromLegacyFormatFile(path, force_check_if_resources_exist_on_disk, num_resources_present);
+		compact = true; // Convert to the Database format.
+	}
+	else
+	{
+		try
 		{
-			FileOutStream stream(temp_path);
-
-			// Write magic number
-			stream.writeUInt32(RESOURCE_MANAGER_MAGIC_NUMBER);
+			delete database;
+			database = new Database();
+			database_path = path;
 
-			// Write version
-			stream.writeUInt32(RESOURCE_MANAGER_SERIALISATION_VERSION);
+			// The database file is memory mapped while reading, and records are decoded directly from the mapped file.
+			database->startReadingFromDisk(path);
 
-			// Write resource objects
+			uint64 current_records_size_B = 0;
+			for(auto it = database->getRecordMap().begin(); it != database->getRecordMap().end(); ++it)
 			{
-				for(auto i=resource_for_url.begin(); i != resource_for_url.end(); ++i)
+				const Database::RecordInfo& record = it->second;
+				if(record.isRecordValid())
 				{
-					stream.writeUInt32(RESOURCE_CHUNK);
-					i->second->writeToStream(stream);
+					current_records_size_B += record.len;
+
+					BufferViewInStream stream(ArrayRef<uint8>(database->getInitialRecordData(record), record.len));
+					ResourceRef resource = new Resource();
+					readResourceRecord(stream, *resource);
+					resource->database_key = it->first;
+
+					addLoadedResource(resource, force_check_if_resources_exist_on_disk, num_resources_present);
 				}
 			}
 
-			stream.writeUInt32(EOS_CHUNK); // Write end-of-stream chunk
+			database->finishReadingFromDisk();
+
+			// Records for changed resources are appended to the file, so the file accumulates out-of-date records.  Compact it if they take up most of the file.
+			const uint64 file_size_B = FileUtils::getFileSize(path);
+			compact = file_size_B > current_records_size_B * 2 + MIN_OUT_OF_DATE_SIZE_B_BEFORE_COMPACTION;
 		}
+		catch(glare::Exception&)
+		{
+			// Close the database, so the next save will write a new database.
+			delete database;
+			database = NULL;
+			throw;
+		}
+	}
+
+	conPrint("Loaded info on " + toString(resource_for_url.size()) + " resource(s). (legacy format: " + boolToString(is_legacy_format) + ", force check: " + boolToString(force_check_if_resources_exist_on_disk) + ", " + 
+		toString(num_resources_present) + " present on disk, changed: " + boolToString(changed) + ")  Elapsed: " + timer.elapsedStringNSigFigs(3) + "");
+
+	if(compact)
+	{
+		this->changed = 0;
+		writeCompactedDatabase(path);
+	}
+}
+
+
+// Writes all resources to a new database file at path, replacing any existing file.  Then opens the new database for appending further changes.
+void ResourceManager::writeCompactedDatabase(const std::string& path)
+{
+	conPrint("Writing compacted resources DB...");
+	Timer timer;
+
+	try
+	{
+		const std::string temp_path = path + "_temp";
+
+		std::vector<DatabaseKey> new_keys;
+		new_keys.reserve(resource_for_url.size());
+		{
+			Database new_database;
+			new_database.openAndMakeOrClearDatabase(temp_path);
+
+			BufferOutStream temp_buf;
+			for(auto it = resource_for_url.begin(); it != resource_for_url.end(); ++it)
+			{
+				temp_buf.clear();
+				writeResourceRecord(*it->second, temp_buf);
+
+				const DatabaseKey key = new_database.allocUnusedKey();
+				new_database.updateRecord(key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				new_keys.push_back(key);
+			}
+
+			new_database.flush();
+		} // Close new database file
+
+		// Close the existing database file before replacing it.
+		delete database;
+		database = NULL;
 
 		FileUtils::moveFile(temp_path, path);
 
-		conPrint("\tDone saving resources to disk.  (Elapsed: " + timer.elapsedStringNSigFigs(3) + ")");
+		size_t i = 0;
+		for(auto it = resource_for_url.begin(); it != resource_for_url.end(); ++it)
+			it->second->database_key = new_keys[i++];
+
+		database = new Database();
+		database_path = path;
+		database->startReadingFromDisk(path);
+		database->finishReadingFromDisk();
+
+		db_dirty_resources.clear();
+		num_record_writes_since_compaction = 0;
+
+		conPrint("\tDone writing compacted resources DB.  (" + toString(new_keys.size()) + " resources, elapsed: " + timer.elapsedStringNSigFigs(3) + ")");
 	}
 	catch(FileUtils::FileUtilsExcep& e)
 	{
@@ -499,6 +670,46 @@ void ResourceManager::saveToDisk(const std::string& path)
 }
 
 
+void ResourceManager::saveToDisk(const std::string& path)
+{
+	Lock lock(mutex);
+
+	// Write all resources if we don't have the database open yet, or if enough out-of-date records have built up in the file.
+	if(!database || (database_path != path) || 
+		(num_record_writes_since_compaction > myMax(MIN_NUM_RECORD_WRITES_BEFORE_COMPACTION, resource_for_url.size())))
+	{
+		writeCompactedDatabase(path);
+		return;
+	}
+
+	if(db_dirty_resources.empty())
+		return;
+
+	Timer timer;
+
+	BufferOutStream temp_buf;
+	for(auto it = db_dirty_resources.begin(); it != db_dirty_resources.end(); ++it)
+	{
+		Resource* resource = it->ptr();
+		temp_buf.clear();
+		writeResourceRecord(*resource, temp_buf);
+
+		if(!resource->database_key.valid())
+			resource->database_key = database->allocUnusedKey(); // Get a new key
+
+		database->updateRecord(resource->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+	}
+
+	database->flush();
+
+	num_record_writes_since_compaction += db_dirty_resources.size();
+
+	conPrint("Saved " + toString(db_dirty_resources.size()) + " changed resource(s) to disk.  (Elapsed: " + timer.elapsedStringNSigFigs(3) + ")");
+
+	db_dirty_resources.clear();
+}
+
+
 void ResourceManager::addResourceSizeToTotalPresent(ResourceRef& res)
 {
 	Lock lock(mutex);
@@ -511,3 +722,317 @@ int64 ResourceManager::getTotalPresentResourcesSizeB() const
 	Lock lock(mutex);
 	return total_present_resources_size_B;
 }
+
+
+void ResourceManager::markResourcesAccessed(const std::vector<std::string>& URLs, uint64 cur_time)
+{
+	Lock lock(mutex);
+
+	for(size_t i=0; i<URLs.size(); ++i)
+	{
+		auto res = resource_for_url.find(URLs[i]);
+		if(res != resource_for_url.end())
+			updateLastAccessTime(res->second, cur_time);
+	}
+}
+
+
+ResourceManager::EvictionResults ResourceManager::evictLeastRecentlyUsedResources(uint64 max_total_size_B, uint64 min_access_age_s, uint64 cur_time, const std::string& db_path)
+{
+	EvictionResults results;
+	results.num_evicted = 0;
+	results.evicted_size_B = 0;
+	results.total_present_size_B = 0;
+
+	// Get the file sizes of any present resources whose size we don't know yet (e.g. resources downloaded since the last eviction pass).
+	// Do this without holding the mutex, as it may involve a lot of file system accesses.
+	std::vector<ResourceRef> resources_needing_size;
+	{
+		Lock lock(mutex);
+		for(auto it = resource_for_url.begin(); it != resource_for_url.end(); ++it)
+			if((it->second->getState() == Resource::State_Present) && (it->second->file_size_B == 0))
+				resources_needing_size.push_back(it->second);
+	}
+
+	std::vector<uint64> file_sizes(resources_needing_size.size());
+	for(size_t i=0; i<resources_needing_size.size(); ++i)
+	{
+		try
+		{
+			file_sizes[i] = FileUtils::getFileSize(resources_needing_size[i]->getLocalAbsPath(base_resource_dir));
+		}
+		catch(glare::Exception&)
+		{
+			file_sizes[i] = 0; // File may have been deleted externally.  Leave the size as unknown.
+		}
+	}
+
+	std::vector<ResourceRef> evicted_resources;
+	std::vector<std::string> evicted_paths;
+	{
+		Lock lock(mutex);
+
+		for(size_t i=0; i<resources_needing_size.size(); ++i)
+			if(file_sizes[i] > 0)
+			{
+				resources_needing_size[i]->file_size_B = (size_t)file_sizes[i];
+				addToDBDirtySet(resources_needing_size[i]);
+				this->changed = 1;
+			}
+
+		uint64 total_size_B = 0;
+		std::vector<Resource*> candidates;
+		for(auto it = resource_for_url.begin(); it != resource_for_url.end(); ++it)
+		{
+			Resource* resource = it->second.ptr();
+			if(resource->getState() == Resource::State_Present)
+			{
+				total_size_B += resource->file_size_B;
+				if(resource->last_access_time + min_access_age_s <= cur_time)
+					candidates.push_back(resource);
+			}
+		}
+
+		if(total_size_B > max_total_size_B)
+		{
+			// Sort candidates by last access time, oldest first.  Break ties with URL so the order is deterministic.
+			std::sort(candidates.begin(), candidates.end(), [](const Resource* a, const Resource* b) { 
+				return (a->last_access_time < b->last_access_time) || ((a->last_access_time == b->last_access_time) && (a->URL < b->URL)); 
+			});
+
+			for(size_t i=0; (i<candidates.size()) && (total_size_B > max_total_size_B); ++i)
+			{
+				Resource* resource = candidates[i];
+				// Keep evicted resources in the Transferring state until their files have been deleted, so no download is started for them in the meantime
+				// (downloads are only started for NotPresent resources).  Transferring resources are loaded from the DB as NotPresent.
+				resource->setState(Resource::State_Transferring);
+				total_size_B -= resource->file_size_B;
+				results.evicted_size_B += resource->file_size_B;
+				evicted_resources.push_back(resource);
+				addToDBDirtySet(resource);
+			}
+			results.num_evicted = evicted_resources.size();
+		}
+
+		results.total_present_size_B = total_size_B;
+		this->total_present_resources_size_B = (int64)total_size_B;
+
+		if(!evicted_resources.empty())
+		{
+			this->changed = 1;
+
+			// Save the DB before deleting any files, so that if we crash while deleting, the DB won't list deleted resources as present.
+			if(!db_path.empty())
+			{
+				clearChangedFlag();
+				try
+				{
+					saveToDisk(db_path);
+				}
+				catch(glare::Exception&)
+				{
+					this->changed = 1;
+					for(size_t i=0; i<evicted_resources.size(); ++i)
+						evicted_resources[i]->setState(Resource::State_Present);
+					throw;
+				}
+			}
+
+			evicted_paths.resize(evicted_resources.size());
+			for(size_t i=0; i<evicted_resources.size(); ++i)
+				evicted_paths[i] = evicted_resources[i]->getLocalAbsPath(base_resource_dir);
+		}
+	}
+
+	if(evicted_resources.empty())
+		return results;
+
+	// Delete the files without holding the mutex, so other threads (e.g. the main thread calling getOrCreateResourceForURL()) aren't blocked on file system accesses.
+	for(size_t i=0; i<evicted_paths.size(); ++i)
+	{
+		try
+		{
+			FileUtils::deleteFile(evicted_paths[i]);
+		}
+		catch(FileUtils::FileUtilsExcep& e)
+		{
+			conPrint("Warning: failed to delete evicted resource: " + e.what());
+		}
+	}
+
+	// Don't set the changed flag here, as Transferring resources are already loaded from the DB as NotPresent.
+	{
+		Lock lock(mutex);
+
+		for(size_t i=0; i<evicted_resources.size(); ++i)
+		{
+			Resource* resource = evicted_resources[i].ptr();
+			// The resource may have been re-added (e.g. with copyLocalFileToResourceDir()) while we were deleting files, in which case only mark it as not present if we deleted the new file.
+			if((resource->getState() == Resource::State_Transferring) || !FileUtils::fileExists(evicted_paths[i]))
+			{
+				resource->setState(Resource::State_NotPresent);
+				resource->file_size_B = 0;
+				addToDBDirtySet(resource);
+			}
+		}
+	}
+
+	return results;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <TestUtils.h>
+#include <PlatformUtils.h>
+
+
+void ResourceManager::test()
+{
+	conPrint("ResourceManager::test()");
+
+	try
+	{
+		const std::string resources_dir = PlatformUtils::getTempDirPath() + "/resource_manager_test";
+		FileUtils::createDirIfDoesNotExist(resources_dir);
+		const std::string db_path = resources_dir + "/resources_db";
+
+		ResourceManagerRef resource_manager = new ResourceManager(resources_dir);
+
+		// Make 4 resources of 1000 bytes each, accessed at times 100, 200, 300, 400.
+		const std::vector<uint8> data(1000, 1);
+		for(int i=0; i<4; ++i)
+		{
+			const std::string URL = "resource_" + toString(i) + ".bin";
+			const std::string path = resource_manager->pathForURL(URL);
+			FileUtils::writeEntireFile(path, (const char*)data.data(), data.size());
+			resource_manager->setResourceAsLocallyPresentForURL(URL);
+
+			resource_manager->markResourcesAccessed(std::vector<std::string>(1, URL), /*cur time=*/100 * (i + 1));
+		}
+
+		// Under budget: nothing should be evicted, but file sizes should be computed.
+		{
+			const EvictionResults results = resource_manager->evictLeastRecentlyUsedResources(/*max total size=*/4000, /*min access age=*/0, /*cur time=*/1000, db_path);
+			testAssert(results.num_evicted == 0);
+			testAssert(results.total_present_size_B == 4000);
+			testAssert(resource_manager->getExistingResourceForURL("resource_0.bin")->file_size_B == 1000);
+		}
+
+		// Mark resource 0 as in use by accessing it recently.  Resources 1 and 2 should then be evicted, as they are the least recently used.
+		resource_manager->markResourcesAccessed(std::vector<std::string>(1, "resource_0.bin"), /*cur time=*/950);
+		{
+			const EvictionResults results = resource_manager->evictLeastRecentlyUsedResources(/*max total size=*/2500, /*min access age=*/100, /*cur time=*/1000, db_path);
+			testAssert(results.num_evicted == 2);
+			testAssert(results.evicted_size_B == 2000);
+			testAssert(results.total_present_size_B == 2000);
+
+			testAssert(resource_manager->isFileForURLPresent("resource_0.bin"));
+			testAssert(!resource_manager->isFileForURLPresent("resource_1.bin"));
+			testAssert(!resource_manager->isFileForURLPresent("resource_2.bin"));
+			testAssert(resource_manager->isFileForURLPresent("resource_3.bin"));
+			testAssert(!FileUtils::fileExists(resource_manager->getExistingResourceForURL("resource_1.bin")->getLocalAbsPath(resources_dir)));
+			testAssert(FileUtils::fileExists(resource_manager->getExistingResourceForURL("resource_3.bin")->getLocalAbsPath(resources_dir)));
+			testAssert(!resource_manager->hasChanged()); // DB should have been saved.
+		}
+
+		// Recently accessed resources are never evicted, even if over budget.
+		{
+			const EvictionResults results = resource_manager->evictLeastRecentlyUsedResources(/*max total size=*/0, /*min access age=*/1000, /*cur time=*/1000, db_path);
+			testAssert(results.num_evicted == 0);
+		}
+
+		// Check the saved DB round-trips the file sizes and access times.
+		{
+			ResourceManagerRef loaded_manager = new ResourceManager(resources_dir);
+			loaded_manager->loadFromDisk(db_path, /*force_check_if_resources_exist_on_disk=*/false);
+			testAssert(loaded_manager->isFileForURLPresent("resource_0.bin"));
+			testAssert(!loaded_manager->isFileForURLPresent("resource_1.bin"));
+			testAssert(loaded_manager->getExistingResourceForURL("resource_3.bin")->file_size_B == 1000);
+			testAssert(loaded_manager->getExistingResourceForURL("resource_3.bin")->last_access_time == 400);
+		}
+
+		// Test incremental saving: just the changed resource record should be appended.
+		{
+			ResourceRef resource = resource_manager->getExistingResourceForURL("resource_3.bin");
+			resource->file_size_B = 1234;
+			resource_manager->markResourceAsChanged(resource);
+
+			const uint64 size_before = FileUtils::getFileSize(db_path);
+			resource_manager->saveToDisk(db_path);
+			testAssert(FileUtils::getFileSize(db_path) > size_before);
+
+			ResourceManagerRef loaded_manager = new ResourceManager(resources_dir);
+			loaded_manager->loadFromDisk(db_path, /*force_check_if_resources_exist_on_disk=*/false);
+			testAssert(loaded_manager->getResourcesForURL().size() == 4);
+			testAssert(loaded_manager->getExistingResourceForURL("resource_3.bin")->file_size_B == 1234);
+			testAssert(loaded_manager->isFileForURLPresent("resource_0.bin"));
+			testAssert(!loaded_manager->hasChanged());
+
+			// Saving with no changes shouldn't write anything.
+			const uint64 size_after = FileUtils::getFileSize(db_path);
+			loaded_manager->saveToDisk(db_path);
+			testAssert(FileUtils::getFileSize(db_path) == size_after);
+		}
+
+		// Test that access times are saved, but only when the stored access time is more than ACCESS_TIME_UPDATE_PERIOD_S old.
+		{
+			const uint64 size_before = FileUtils::getFileSize(db_path);
+			resource_manager->markResourcesAccessed(std::vector<std::string>(1, "resource_3.bin"), /*cur time=*/400 + ACCESS_TIME_UPDATE_PERIOD_S - 1);
+			resource_manager->saveToDisk(db_path);
+			testAssert(FileUtils::getFileSize(db_path) == size_before);
+			testAssert(resource_manager->getExistingResourceForURL("resource_3.bin")->last_access_time == 400);
+
+			resource_manager->markResourcesAccessed(std::vector<std::string>(1, "resource_3.bin"), /*cur time=*/400 + ACCESS_TIME_UPDATE_PERIOD_S);
+			resource_manager->saveToDisk(db_path);
+			testAssert(FileUtils::getFileSize(db_path) > size_before);
+
+			ResourceManagerRef loaded_manager = new ResourceManager(resources_dir);
+			loaded_manager->loadFromDisk(db_path, /*force_check_if_resources_exist_on_disk=*/false);
+			testAssert(loaded_manager->getExistingResourceForURL("resource_3.bin")->last_access_time == 400 + ACCESS_TIME_UPDATE_PERIOD_S);
+		}
+
+		// Test reading the old (pre-Database) format.  The file should be converted to the Database format.
+		{
+			const std::string legacy_db_path = resources_dir + "/legacy_resources_db";
+			{
+				FileOutStream stream(legacy_db_path);
+				stream.writeUInt32(RESOURCE_MANAGER_MAGIC_NUMBER);
+				stream.writeUInt32(2); // version
+				for(int i=0; i<2; ++i)
+				{
+					Resource resource("resource_" + toString(i) + ".bin", "resource_" + toString(i) + ".bin", Resource::State_Present, UserID::invalidUserID());
+					stream.writeUInt32(RESOURCE_CHUNK);
+					resource.writeToStream(stream);
+				}
+				stream.writeUInt32(EOS_CHUNK);
+			}
+
+			{
+				ResourceManagerRef loaded_manager = new ResourceManager(resources_dir);
+				loaded_manager->loadFromDisk(legacy_db_path, /*force_check_if_resources_exist_on_disk=*/false);
+				testAssert(loaded_manager->getResourcesForURL().size() == 2);
+			}
+			{
+				FileInStream stream(legacy_db_path);
+				testAssert(stream.readUInt32() != RESOURCE_MANAGER_MAGIC_NUMBER);
+			}
+			{
+				ResourceManagerRef loaded_manager = new ResourceManager(resources_dir);
+				loaded_manager->loadFromDisk(legacy_db_path, /*force_check_if_resources_exist_on_disk=*/false);
+				testAssert(loaded_manager->getResourcesForURL().size() == 2);
+				testAssert(loaded_manager->isFileForURLPresent("resource_1.bin"));
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ResourceManager::test() done.");
+}
+
+
+#endif // BUILD_TESTS
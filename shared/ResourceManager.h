@@ -16,12 +16,16 @@ Generated at 2016-01-12 12:22:34 +1300
 #include <unordered_set>
 #include <Mutex.h>
 #include <AtomicInt.h>
+class Database;
 
 
 /*=====================================================================
 ResourceManager
 -------------------
-
+On the client, the resources DB is saved with saveToDisk() into a Database
+(an append-only record store, as used by the server), with one record per
+resource.  Only resources marked as changed since the last save are written,
+and the file is compacted when enough out-of-date records have built up.
 =====================================================================*/
 class ResourceManager : public ThreadSafeRefCounted
 {
@@ -38,7 +42,7 @@ public:
 
 	static bool isValidURL(const std::string& URL);
 
-	// Will create a new Resource object if not already inserted.
+	// Will create a new Resource object if not already inserted.  Updates the resource last access time.
 	ResourceRef getOrCreateResourceForURL(const std::string& URL); // Threadsafe
 
 	// Returns null reference if no resource object for URL inserted.
@@ -80,7 +84,8 @@ public:
 
 	bool hasChanged() const { return changed != 0; }
 	void clearChangedFlag() { changed = 0; }
-	void markAsChanged(); // Thread-safe
+	void markAsChanged(); // Thread-safe.  NOTE: saveToDisk() only writes resources marked with markResourceAsChanged().
+	void markResourceAsChanged(const ResourceRef& resource); // Marks the resource as needing to be saved to the DB.  Thread-safe.
 
 	Mutex& getMutex() { return mutex; }
 
@@ -88,11 +93,38 @@ public:
 	int64 getTotalPresentResourcesSizeB() const;
 
 	// Just used on client:
-	void loadFromDisk(const std::string& path, bool force_check_if_resources_exist_on_disk);
-	void saveToDisk(const std::string& path);
+	void loadFromDisk(const std::string& path, bool force_check_if_resources_exist_on_disk); // Also reads the old (pre-Database) format, converting the file to the Database format.
+	void saveToDisk(const std::string& path); // Writes changed resources.
+
+	// Sets the last access time of the resources for the given URLs, if they exist.  Threadsafe.
+	// Access times are only updated if the stored time is more than 10 minutes old, so that access times are written to the DB at most that often per resource.
+	// Doesn't set the changed flag, so access times are saved along with the next DB save, rather than causing a save themselves.
+	void markResourcesAccessed(const std::vector<std::string>& URLs, uint64 cur_time);
+
+	struct EvictionResults
+	{
+		size_t num_evicted;
+		uint64 evicted_size_B;
+		uint64 total_present_size_B; // Total size of present resources after eviction.
+	};
+
+	// Deletes present resources from disk, least recently accessed first, until the total size of present resources is <= max_total_size_B.
+	// Resources accessed in the last min_access_age_s seconds are never deleted.
+	// The resources DB is saved to db_path (if non-empty) before any files are deleted, so the saved DB never refers to deleted files.
+	// Files are deleted without holding the mutex.  Evicted resources are in the Transferring state while their files are being deleted.
+	// Threadsafe.
+	EvictionResults evictLeastRecentlyUsedResources(uint64 max_total_size_B, uint64 min_access_age_s, uint64 cur_time, const std::string& db_path);
 
 	std::string getDiagnostics() const;
+
+	static void test();
 private:
+	void addLoadedResource(const ResourceRef& resource, bool check_resources_present_on_disk, size_t& num_resources_present) REQUIRES(mutex);
+	void loadFromLegacyFormatFile(const std::string& path, bool force_check_if_resources_exist_on_disk, size_t& num_resources_present) REQUIRES(mutex);
+	void writeCompactedDatabase(const std::string& path) REQUIRES(mutex);
+	void addToDBDirtySet(const ResourceRef& resource) REQUIRES(mutex);
+	void updateLastAccessTime(const ResourceRef& resource, uint64 cur_time) REQUIRES(mutex);
+
 	std::string base_resource_dir;
 
 	mutable Mutex mutex;
@@ -103,6 +135,12 @@ private:
 	std::unordered_set<std::string> download_failed_URLs; // Ephemeral state, used to prevent trying to download the same resource over and over again in one client execution.
 
 	int64 total_present_resources_size_B;
+
+	// Client resources DB
+	Database* database							GUARDED_BY(mutex); // NULL until loaded or first saved.
+	std::string database_path					GUARDED_BY(mutex);
+	std::unordered_set<ResourceRef, ResourceRefHash> db_dirty_resources GUARDED_BY(mutex); // Resources that have changed since the last save.
+	size_t num_record_writes_since_compaction	GUARDED_BY(mutex);
 };
 
 
@@ -307,7 +307,7 @@ static int createObject(lua_State* state)
 		//cur_world_state->addWorldObjectAsDBDirty(new_ob); // TEMP: don't add to DB
 
 		script_evaluator->world_state->getDirtyFromRemoteObjects(*script_evaluator->cur_world_state_lock).insert(ob);
-		script_evaluator->world_state->getObjects(*script_evaluator->cur_world_state_lock).insert(std::make_pair(ob->uid, ob));
+		script_evaluator->world_state->addObject(ob, *script_evaluator->cur_world_state_lock);
 	}
 
 #endif
@@ -363,6 +363,55 @@ static WorldObject* getWorldObjectForUID(LuaScriptEvaluator* script_evaluator, c
 }
 
 
+#if SERVER
+// The addresses of these are used as the light userdata keys for the object handle and UID in WorldObject and WorldMaterial tables.
+static char world_object_handle_key;
+static char world_object_uid_key;
+
+
+void SubstrataLuaVM::setWorldObjectTableHandle(lua_State* state, uint64 handle, uint64 uid)
+{
+	lua_pushlightuserdata(state, &world_object_handle_key);
+	lua_pushlightuserdata(state, (void*)handle);
+	lua_rawset(state, /*table index=*/-3);
+
+	lua_pushlightuserdata(state, &world_object_uid_key);
+	lua_pushlightuserdata(state, (void*)uid);
+	lua_rawset(state, /*table index=*/-3);
+}
+#endif
+
+
+// Tries to get the WorldObject for a WorldObject or WorldMaterial table at table_index, using the object handle stored in the table
+// (see SubstrataLuaVM::setWorldObjectTableHandle()).  This avoids a string field lookup and an object map lookup.
+// The UID stored next to the handle is checked, so a stale handle never resolves to a different object.
+// Returns NULL if the table doesn't have a valid handle, in which case the caller should look up the object by UID.
+static inline WorldObject* tryGetWorldObjectFromTableHandle(lua_State* state, LuaScriptEvaluator* script_evaluator, int table_index)
+{
+#if SERVER
+	assert(table_index > 0);
+	if(script_evaluator->cur_world_state_lock)
+	{
+		lua_pushlightuserdata(state, &world_object_handle_key);
+		lua_rawget(state, table_index); // Pushes handle (or nil) onto the stack.
+		lua_pushlightuserdata(state, &world_object_uid_key);
+		lua_rawget(state, table_index); // Pushes UID (or nil) onto the stack.
+		const uint64 handle = (uint64)lua_touserdata(state, -2); // lua_touserdata returns NULL for nil.
+		const uint64 uid    = (uint64)lua_touserdata(state, -1);
+		lua_pop(state, 2);
+
+		if(handle != 0)
+		{
+			WorldObject* ob = script_evaluator->world_state->getObjectForScriptHandle(handle, *script_evaluator->cur_world_state_lock);
+			if(ob && (ob->uid.value() == uid))
+				return ob;
+		}
+	}
+#endif
+	return NULL;
+}
+
+
 static int luaGetWorldObjectForUID(lua_State* state)
 {
 	// Expected args:
@@ -950,7 +999,9 @@ static int createTimer(lua_State* state)
 	TimerQueue& timer_queue = sub_lua_vm->gui_client->timer_queue;
 #elif SERVER
 	const double cur_time = sub_lua_vm->server->total_timer.elapsed();
-	TimerQueue& timer_queue = sub_lua_vm->server->timer_queue;
+	// Use the world's own timer queue if it has one (ServerConfig::per_world_lua_vms), otherwise the shared server timer queue.
+	WorldScriptContext* world_script_context = script_evaluator->world_state ? script_evaluator->world_state->script_context.ptr() : NULL;
+	TimerQueue& timer_queue = world_script_context ? world_script_context->timer_queue : sub_lua_vm->server->timer_queue;
 #endif
 
 	// Find free timer slot
@@ -973,7 +1024,8 @@ static int createTimer(lua_State* state)
 			timer.timer_id = timer_id;
 			//timer.lua_script_evaluator_handle = script_evaluator->generational_handle;
 			timer.lua_script_evaluator = script_evaluator;
-			timer_queue.addTimer(cur_time, timer);
+			script_evaluator->timers[i].queue_handle = timer_queue.addTimer(cur_time, timer);
+			script_evaluator->timers[i].timer_queue = &timer_queue;
 
 			lua_pushnumber(state, (double)i); // Push timer id
 			return 1; // Count of returned values
@@ -1037,8 +1089,6 @@ static int getMaterial(lua_State* state)
 
 	checkNumArgs(state, /*num_args_required*/2);
 	
-	// Get object UID
-	const UID ob_uid((uint64)LuaUtils::getTableNumberField(state, /*table index=*/1, "uid"));
 	const size_t index = (size_t)LuaUtils::getDoubleArg(state, /*index=*/2);
 
 	SubstrataLuaVM* sub_lua_vm = (SubstrataLuaVM*)lua_callbacks(state)->userdata;
@@ -1046,19 +1096,28 @@ static int getMaterial(lua_State* state)
 	LuaScript* script = (LuaScript*)lua_getthreaddata(state); // NOTE: this double pointer-chasing sucks
 	LuaScriptEvaluator* script_evaluator = (LuaScriptEvaluator*)script->userdata;
 
-	WorldObject* ob = getWorldObjectForUID(script_evaluator, ob_uid);
+	WorldObject* ob = tryGetWorldObjectFromTableHandle(state, script_evaluator, /*table index=*/1);
+	if(!ob)
+		ob = getWorldObjectForUID(script_evaluator, UID((uint64)LuaUtils::getTableNumberField(state, /*table index=*/1, "uid")));
+	const UID ob_uid = ob->uid;
 
 	if(index > ob->materials.size())
 		throw glare::Exception("Invalid material index" + errorContextString(state));
 
 	// Make a material table with object UID and material index
-	lua_createtable(state, /*num array elems=*/0, /*num non-array elems=*/2);
+	lua_createtable(state, /*num array elems=*/0, /*num non-array elems=*/4);
 
 	//LuaUtils::setNumberAsTableField(state, "uid", (double)uid.value());
 	LuaUtils::setLightUserDataAsTableField(state, "uid", (void*)ob_uid.value());
 	//LuaUtils::setNumberAsTableField(state, "idx", (double)index);
 	LuaUtils::setLightUserDataAsTableField(state, "idx", (void*)index);
 
+#if SERVER
+	// Store the object handle and UID, as for WorldObject tables.
+	if(ob->script_handle != 0)
+		SubstrataLuaVM::setWorldObjectTableHandle(state, ob->script_handle, ob_uid.value());
+#endif
+
 	// Set metatable to worldMaterialClassMetaTable_ref
 	lua_getref(state, sub_lua_vm->worldMaterialClassMetaTable_ref); // Pushes worldObjectClassMetaTable_ref onto the stack.
 	lua_setmetatable(state, -2); // "Pops a table from the stack and sets it as the new metatable for the value at the given acceptable index."
@@ -1076,13 +1135,12 @@ static int worldObjectClassIndexMetaMethod(lua_State* state)
 	assert(lua_gettop(state) == 2); // Should be 2 args.
 	checkNumArgs(state, 2);
 
-	// Get object UID
-	const UID uid((uint64)LuaUtils::getTableNumberField(state, /*table index=*/1, "uid"));
-
 	LuaScript* script = (LuaScript*)lua_getthreaddata(state); // NOTE: this double pointer-chasing sucks
 	LuaScriptEvaluator* script_evaluator = (LuaScriptEvaluator*)script->userdata;
 
-	WorldObject* ob = getWorldObjectForUID(script_evaluator, uid);
+	WorldObject* ob = tryGetWorldObjectFromTableHandle(state, script_evaluator, /*table index=*/1);
+	if(!ob)
+		ob = getWorldObjectForUID(script_evaluator, UID((uint64)LuaUtils::getTableNumberField(state, /*table index=*/1, "uid"))); // Get object UID and look up object
 
 	int atom = -1;
 	const char* key_str = LuaUtils::getStringAndAtom(state, /*index=*/2, atom);
@@ -1203,10 +1261,6 @@ static int worldObjectClassNewIndexMetaMethod(lua_State* state)
 	assert(lua_gettop(state) == 3); // Should be 3 args.
 	checkNumArgs(state, 3);
 	
-	// Get object UID
-	const UID uid((uint64)LuaUtils::getTableNumberField(state, /*table index=*/1, "uid"));
-
-	SubstrataLuaVM* sub_lua_vm = (SubstrataLuaVM*)lua_callbacks(state)->userdata;
 	LuaScript* script = (LuaScript*)lua_getthreaddata(state); // NOTE: this double pointer-chasing sucks
 	LuaScriptEvaluator* script_evaluator = (LuaScriptEvaluator*)script->userdata;
 
@@ -1216,12 +1270,14 @@ static int worldObjectClassNewIndexMetaMethod(lua_State* state)
 		throw glare::Exception("Internal error: cur_world_state_lock was null");
 	}
 
-	WorldObject* ob = getWorldObjectForUID(script_evaluator, uid);
+	WorldObject* ob = tryGetWorldObjectFromTableHandle(state, script_evaluator, /*table index=*/1);
+	if(!ob)
+		ob = getWorldObjectForUID(script_evaluator, UID((uint64)LuaUtils::getTableNumberField(state, /*table index=*/1, "uid"))); // Get object UID and look up object
 
 	// Check permissions before we update object.
 	// A script has permissions to modify an object if and only if the creator of the script is also the creator of the object.
 	if(ob->creator_id != script_evaluator->world_object->creator_id)
-		throw glare::Exception("Script does not have permissions to modifiy object (ob UID: " + uid.toString() + ")");
+		throw glare::Exception("Script does not have permissions to modifiy object (ob UID: " + ob->uid.toString() + ")");
 
 
 	bool transform_changed = false;
@@ -1236,10 +1292,6 @@ static int worldObjectClassNewIndexMetaMethod(lua_State* state)
 
 		assignStringWithSizeCheck(state, /*index=*/3, /*field=*/ob->model_url, /*field name=*/"model_url", /*max size=*/WorldObject::MAX_URL_SIZE);
 		ob->from_remote_model_url_dirty = true; // TODO: rename
-
-#if SERVER
-		script_evaluator->world_state->getDirtyFromRemoteObjects(*script_evaluator->cur_world_state_lock).insert(ob);
-#endif
 		break;
 	case Atom_pos:
 		assert(stringEqual(key_str, "pos"));
@@ -1281,7 +1333,6 @@ static int worldObjectClassNewIndexMetaMethod(lua_State* state)
 		assignStringWithSizeCheck(state, /*index=*/3, /*field=*/ob->content, /*field name=*/"content", /*max size=*/WorldObject::MAX_CONTENT_SIZE);
 
 		ob->from_remote_content_dirty = true; // TODO: rename
-		script_evaluator->world_state->getDirtyFromRemoteObjects(*script_evaluator->cur_world_state_lock).insert(ob);
 		break;
 		}
 	case Atom_video_autoplay:
@@ -1339,16 +1390,14 @@ static int worldObjectClassNewIndexMetaMethod(lua_State* state)
 	{
 		ob->last_transform_update_avatar_uid = std::numeric_limits<uint32>::max();
 		ob->from_remote_transform_dirty = true; // TODO: rename
-		script_evaluator->world_state->getDirtyFromRemoteObjects(*script_evaluator->cur_world_state_lock).insert(ob);
 	}
 	else if(other_changed)
 	{
 		ob->from_remote_other_dirty = true; // TODO: rename
-		script_evaluator->world_state->getDirtyFromRemoteObjects(*script_evaluator->cur_world_state_lock).insert(ob);
 	}
 
-	script_evaluator->world_state->addWorldObjectAsDBDirty(ob, *script_evaluator->cur_world_state_lock);
-	sub_lua_vm->server->world_state->markAsChanged();
+	// Updates the object grid now if the transform changed, and the dirty sets once at the end of the script callback.
+	script_evaluator->objectModified(ob, transform_changed);
 
 	return 0; // Count of returned values
 #endif
@@ -1365,10 +1414,6 @@ static int worldMaterialClassIndexMetaMethod(lua_State* state)
 	assert(lua_gettop(state) == 2); // Should be 2 args.
 	checkNumArgs(state, 2);
 
-	// Get object UID from the world material table
-	//const UID uid((uint64)LuaUtils::getTableNumberField(state, /*table index=*/1, "uid"));
-	const UID uid((uint64)LuaUtils::getTableLightUserDataField(state, /*table index=*/1, "uid"));
-
 	// Get material index from the world material table
 	//const size_t mat_index = (size_t)LuaUtils::getTableNumberField(state, /*table index=*/1, "idx");
 	const size_t mat_index = (size_t)LuaUtils::getTableLightUserDataField(state, /*table index=*/1, "idx");
@@ -1376,7 +1421,9 @@ static int worldMaterialClassIndexMetaMethod(lua_State* state)
 	LuaScript* script = (LuaScript*)lua_getthreaddata(state); // NOTE: this double pointer-chasing sucks
 	LuaScriptEvaluator* script_evaluator = (LuaScriptEvaluator*)script->userdata;
 
-	WorldObject* ob = getWorldObjectForUID(script_evaluator, uid);
+	WorldObject* ob = tryGetWorldObjectFromTableHandle(state, script_evaluator, /*table index=*/1);
+	if(!ob)
+		ob = getWorldObjectForUID(script_evaluator, UID((uint64)LuaUtils::getTableLightUserDataField(state, /*table index=*/1, "uid"))); // Get object UID from the world material table and look up object
 
 	if(mat_index > ob->materials.size())
 		throw glare::Exception("Invalid material index" + errorContextString(state));
@@ -1461,22 +1508,19 @@ static int worldMaterialClassNewIndexMetaMethod(lua_State* state)
 	assert(lua_gettop(state) == 3); // Should be 3 args.
 	checkNumArgs(state, 3);
 	
-	// Get object UID from the world material table
-	//const UID uid((uint64)LuaUtils::getTableNumberField(state, /*table index=*/1, "uid"));
-	const UID uid((uint64)LuaUtils::getTableLightUserDataField(state, /*table index=*/1, "uid"));
-
 	// Get material index from the world material table
 	const size_t mat_index = (size_t)LuaUtils::getTableLightUserDataField(state, /*table index=*/1, "idx");
 
-	SubstrataLuaVM* sub_lua_vm = (SubstrataLuaVM*)lua_callbacks(state)->userdata;
 	LuaScript* script = (LuaScript*)lua_getthreaddata(state); // NOTE: this double pointer-chasing sucks
 	LuaScriptEvaluator* script_evaluator = (LuaScriptEvaluator*)script->userdata;
 
-	WorldObject* ob = getWorldObjectForUID(script_evaluator, uid);
+	WorldObject* ob = tryGetWorldObjectFromTableHandle(state, script_evaluator, /*table index=*/1);
+	if(!ob)
+		ob = getWorldObjectForUID(script_evaluator, UID((uint64)LuaUtils::getTableLightUserDataField(state, /*table index=*/1, "uid"))); // Get object UID from the world material table and look up object
 
 	// Check permissions before we update object
 	if(ob->creator_id != script_evaluator->world_object->creator_id)
-		throw glare::Exception("Script does not have permissions to modifiy object (ob UID: " + uid.toString() + ")" + errorContextString(state));
+		throw glare::Exception("Script does not have permissions to modifiy object (ob UID: " + ob->uid.toString() + ")" + errorContextString(state));
 
 
 	if(mat_index > ob->materials.size())
@@ -1547,10 +1591,7 @@ static int worldMaterialClassNewIndexMetaMethod(lua_State* state)
 
 	// Mark the object as dirty, sending the updated object will send the updated material as well.
 	ob->from_remote_other_dirty = true; // TODO: rename
-	script_evaluator->world_state->getDirtyFromRemoteObjects(*script_evaluator->cur_world_state_lock).insert(ob);
-
-	script_evaluator->world_state->addWorldObjectAsDBDirty(ob, *script_evaluator->cur_world_state_lock);
-	sub_lua_vm->server->world_state->markAsChanged();
+	script_evaluator->objectModified(ob, /*transform_changed=*/false);
 
 	return 0; // Count of returned values
 #endif
@@ -15,6 +15,7 @@ class PlayerPhysics;
 class GUIClient;
 class Server;
 class LuaVM;
+struct lua_State;
 
 
 /*=====================================================================
@@ -91,4 +92,11 @@ public:
 	int avatarClassMetaTable_ref;
 
 	HashMap<uint32, int> metatable_uid_to_ref_map;
+
+#if SERVER
+	// Stores a WorldObject script handle and UID in the WorldObject or WorldMaterial table at the top of the stack, so the metamethods can find the object
+	// without a field lookup and object map lookup.
+	// They are stored as light userdata values under light userdata keys, so scripts can't access them by index or with ipairs, and can't forge them.
+	static void setWorldObjectTableHandle(lua_State* state, uint64 handle, uint64 uid);
+#endif
 };
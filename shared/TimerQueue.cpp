@@ -6,224 +6,277 @@ Copyright Glare Technologies Limited 2024 -
 #include "TimerQueue.h"
 
 
+#include <maths/mathstypes.h>
+#include <cmath>
+#include <cassert>
+
+
+static const double TICKS_PER_SECOND = 32.0;
+
+
+const uint64 TimerQueue::INVALID_HANDLE;
+
+
 TimerQueueTimer::TimerQueueTimer()
+:	tigger_time(0),
+	onTimerEvent_ref(-1),
+	repeating(false),
+	period(0),
+	timer_index(-1),
+	timer_id(-1),
+	queue_handle(TimerQueue::INVALID_HANDLE)
 {}
 
 
-TimerQueueTimer::TimerQueueTimer(double tigger_time_) : tigger_time(tigger_time_)/*, valid(true)*/ {}
+TimerQueueTimer::TimerQueueTimer(double tigger_time_)
+:	tigger_time(tigger_time_),
+	onTimerEvent_ref(-1),
+	repeating(false),
+	period(0),
+	timer_index(-1),
+	timer_id(-1),
+	queue_handle(TimerQueue::INVALID_HANDLE)
+{}
 
 
 TimerQueue::TimerQueue()
+:	next_tick(0),
+	num_timers(0)
 {
-#if 0
-	bucket_max_ttt[0] = 0.03125;
-	bucket_max_ttt[1] = 0.125;
-	bucket_max_ttt[2] = 0.5;
-	bucket_max_ttt[3] = 2;
-	bucket_max_ttt[4] = 8;
-	bucket_max_ttt[5] = 32;
-	bucket_max_ttt[6] = 128;
-	bucket_max_ttt[7] = std::numeric_limits<double>::infinity();
-
-	bucket_min_ttt[0] = 0;
-	bucket_min_ttt[1] = 0.03125;
-	bucket_min_ttt[2] = 0.125;
-	bucket_min_ttt[3] = 0.5;
-	bucket_min_ttt[4] = 2;
-	bucket_min_ttt[5] = 8;
-	bucket_min_ttt[6] = 32;
-	bucket_min_ttt[7] = 128;
-
-	// Initialise buckets
-	for(size_t b=0; b<8; ++b)
-	{
-		TimerQueueBucket& bucket = buckets[b];
+	for(int i=0; i<NUM_SLOTS; ++i)
+		slot_heads[i] = -1;
+}
 
-		const size_t initial_num = 1024;
-		bucket.timers.resize(initial_num);
-		bucket.freelist.resize(initial_num);
 
-		for(size_t i=0; i<initial_num; ++i)
-			bucket.timers[i].valid = false;
+TimerQueue::~TimerQueue()
+{
+}
+
 
-		for(size_t i=0; i<initial_num; ++i)
-			bucket.freelist[i] = (int)i;
-	}
-#endif
+int64 TimerQueue::tickForTime(double t) const
+{
+	const double tick = std::floor(t * TICKS_PER_SECOND);
+	if(!(tick >= 0)) // Handle negative times and NaNs.
+		return 0;
+	if(tick >= (double)((int64)1 << 60)) // Handle very large times and infinity.
+		return (int64)1 << 60;
+	return (int64)tick;
 }
 
 
-TimerQueue::~TimerQueue()
+// Adds the node to the slot for its tick.  Nodes with a tick before next_tick are added to the slot for next_tick.
+void TimerQueue::insertNode(int node_index)
 {
+	TimerNode& node = nodes[node_index];
+
+	const int64 tick = myMax(node.tick, next_tick);
+	const int64 delta = tick - next_tick;
+
+	int slot;
+	if(delta < NUM_SLOTS_PER_LEVEL)
+	{
+		slot = (int)(tick & (NUM_SLOTS_PER_LEVEL - 1));
+	}
+	else
+	{
+		int level = 1;
+		while((level < NUM_LEVELS - 1) && (delta >= ((int64)1 << (SLOT_BITS * (level + 1)))))
+			level++;
+
+		// If the tick is past the range of the top level, put the node in the furthest top-level slot.  It will be re-inserted when that slot is cascaded.
+		const int64 max_delta = ((int64)1 << (SLOT_BITS * NUM_LEVELS)) - 1;
+		const int64 level_tick = (delta > max_delta) ? (next_tick + max_delta) : tick;
+
+		slot = level * NUM_SLOTS_PER_LEVEL + (int)((level_tick >> (SLOT_BITS * level)) & (NUM_SLOTS_PER_LEVEL - 1));
+	}
+
+	// Add to front of slot list
+	node.slot = slot;
+	node.prev = -1;
+	node.next = slot_heads[slot];
+	if(node.next != -1)
+		nodes[node.next].prev = node_index;
+	slot_heads[slot] = node_index;
 }
 
 
-void TimerQueue::addTimer(double cur_time, const TimerQueueTimer& timer)
+void TimerQueue::unlinkNode(int node_index)
 {
-	// const double ttt = timer.tigger_time - cur_time; // time-to-trigger
-	// const size_t new_bucket_i = getBucketForTimeToTrigger(ttt);
-	// addTimerToBucket(timer, new_bucket_i);
+	TimerNode& node = nodes[node_index];
+	assert(node.slot != -1);
 
-	queue.push(timer);
+	if(node.prev != -1)
+		nodes[node.prev].next = node.next;
+	else
+		slot_heads[node.slot] = node.next;
+
+	if(node.next != -1)
+		nodes[node.next].prev = node.prev;
+
+	node.slot = -1;
+	node.next = -1;
+	node.prev = -1;
 }
 
 
-void TimerQueue::update(double cur_time, std::vector<TimerQueueTimer>& triggered_timers_out)
+void TimerQueue::freeNode(int node_index)
 {
-	triggered_timers_out.resize(0);
+	TimerNode& node = nodes[node_index];
+	node.generation++; // Invalidate any handles to this node.
+	if(node.generation == 0)
+		node.generation = 1;
+	node.timer.lua_script_evaluator = WeakReference<LuaScriptEvaluator>(); // Release the reference to the script evaluator.
+	freelist.push_back(node_index);
+
+	assert(num_timers > 0);
+	num_timers--;
+}
+
+
+// Re-inserts all nodes in the slot.  Called when next_tick reaches the range of ticks covered by the slot, so the nodes move to lower levels.
+void TimerQueue::cascadeSlot(int slot)
+{
+	int node_index = slot_heads[slot];
+	slot_heads[slot] = -1;
 
-#if 1
-	while(!queue.empty() && queue.top().tigger_time <= cur_time)
+	while(node_index != -1)
 	{
-		triggered_timers_out.push_back(queue.top());
-		queue.pop();
+		const int next = nodes[node_index].next;
+		insertNode(node_index);
+		node_index = next;
 	}
-#else
-	for(size_t b=0; b<8; ++b)
-	{
-		TimerQueueBucket& bucket = buckets[b];
+}
 
-		const double min_ttt = bucket_min_ttt[b];
 
-		const double min_trigger_time = cur_time + min_ttt; // Minimum trigger time for a timer to remain in this bucket.
+void TimerQueue::expireSlot(int slot, double cur_time, bool expire_all, std::vector<TimerQueueTimer>& triggered_timers_out)
+{
+	int node_index = slot_heads[slot];
+	while(node_index != -1)
+	{
+		TimerNode& node = nodes[node_index];
+		const int next = node.next;
 
-		for(size_t i=0; i<bucket.timers.size(); ++i)
+		if(expire_all || (node.timer.tigger_time <= cur_time))
 		{
-			TimerQueueTimer& timer = bucket.timers[i];
-			if(timer.valid)
-			{
-				const double tt = timer.tigger_time;
-				if(cur_time >= tt)
-				{
-					// Timer has triggered
-					triggered_timers_out.push_back(timer);
+			unlinkNode(node_index);
+			triggered_timers_out.push_back(node.timer);
 
-					timer.valid = false;
-
-					// Add to free list
-					bucket.freelist.push_back((int)i);
-				}
-				else
-				{
-					if(tt < min_trigger_time)
-					{
-						const double ttt = tt - cur_time;
-						const size_t new_bucket_i = getBucketForTimeToTrigger(ttt);
-						if(new_bucket_i != b) // Check we don't try and remove and add to same bucket due to numerical issues.
-						{
-							// Remove from this bucket, place in other bucket
-							timer.valid = false;
-
-							// Add to free list
-							bucket.freelist.push_back((int)i);
-
-							addTimerToBucket(timer, new_bucket_i);
-						}
-					}
-				}
-			}
+			if(node.timer.repeating)
+				temp_repeating_nodes.push_back(node_index); // Will be re-inserted at the end of update().
+			else
+				freeNode(node_index);
 		}
+
+		node_index = next;
 	}
-#endif
 }
 
-void TimerQueue::clear()
+
+uint64 TimerQueue::addTimer(double /*cur_time*/, const TimerQueueTimer& timer)
 {
-	while(!queue.empty())
-		queue.pop();
+	int node_index;
+	if(freelist.empty())
+	{
+		node_index = (int)nodes.size();
+		nodes.push_back(TimerNode());
+		nodes.back().generation = 1;
+	}
+	else
+	{
+		node_index = freelist.back();
+		freelist.pop_back();
+	}
+
+	TimerNode& node = nodes[node_index];
+	const uint64 handle = ((uint64)node.generation << 32) | (uint64)node_index;
+	node.timer = timer;
+	node.timer.queue_handle = handle;
+	node.tick = tickForTime(timer.tigger_time);
+	insertNode(node_index);
+
+	num_timers++;
+	return handle;
 }
 
-#if 0
-size_t TimerQueue::numValidTimersInBucket(size_t bucket_i)
+
+void TimerQueue::removeTimer(uint64 handle)
 {
-	const TimerQueueBucket& bucket = buckets[bucket_i];
+	const uint64 node_index = handle & 0xFFFFFFFFull;
+	const uint32 generation = (uint32)(handle >> 32);
+
+	if(node_index >= nodes.size())
+		return;
 
-	size_t num = 0;
-	for(size_t i=0; i<bucket.timers.size(); ++i)
-		if(bucket.timers[i].valid)
-			num++;
-	return num;
+	TimerNode& node = nodes[node_index];
+	if((node.generation != generation) || (node.slot == -1)) // If the timer has already been removed:
+		return;
+
+	unlinkNode((int)node_index);
+	freeNode((int)node_index);
 }
 
 
-size_t TimerQueue::getBucketForTimeToTrigger(double ttt)
+void TimerQueue::update(double cur_time, std::vector<TimerQueueTimer>& triggered_timers_out)
 {
-	/*
-	0.03125
-	0.125
-	0.5
-	2
-	8
-	32
-	128
-	inf
-	*/
-
-	if(ttt < 2.0)
+	triggered_timers_out.resize(0);
+	temp_repeating_nodes.resize(0);
+
+	const int64 target_tick = tickForTime(cur_time);
+
+	// Process all ticks before target_tick.  All timers in the level 0 slots for these ticks have triggered.
+	while(next_tick < target_tick)
 	{
-		if(ttt < 0.125)
-		{
-			if(ttt < 0.03125)
-				return 0;
-			else
-				return 1; // < 0.125
-		}
-		else
+		if(num_timers == temp_repeating_nodes.size()) // If there are no timers left in the wheel, we can just skip to the target tick.
 		{
-			if(ttt < 0.5)
-				return 2;
-			else
-				return 3; // < 2
+			next_tick = target_tick;
+			break;
 		}
+
+		expireSlot((int)(next_tick & (NUM_SLOTS_PER_LEVEL - 1)), cur_time, /*expire_all=*/true, triggered_timers_out);
+
+		next_tick++;
+
+		// If we have wrapped around level 0 (and possibly higher levels), move the timers from the next slots in the higher levels down.
+		int max_level = 0;
+		while((max_level < NUM_LEVELS - 1) && ((next_tick & (((int64)1 << (SLOT_BITS * (max_level + 1))) - 1)) == 0))
+			max_level++;
+
+		for(int level = max_level; level >= 1; --level)
+			cascadeSlot(level * NUM_SLOTS_PER_LEVEL + (int)((next_tick >> (SLOT_BITS * level)) & (NUM_SLOTS_PER_LEVEL - 1)));
 	}
-	else // ttt >= 2
+
+	// Timers in the slot for the current tick may or may not have triggered yet.
+	expireSlot((int)(next_tick & (NUM_SLOTS_PER_LEVEL - 1)), cur_time, /*expire_all=*/false, triggered_timers_out);
+
+	// Re-insert repeating timers
+	for(size_t i=0; i<temp_repeating_nodes.size(); ++i)
 	{
-		if(ttt < 32.0)
-		{
-			if(ttt < 8.0)
-				return 4;
-			else
-				return 5; // < 32
-		}
-		else
-		{
-			if(ttt < 128)
-				return 6;
-			else
-				return 7; // < inf
-		}
+		TimerNode& node = nodes[temp_repeating_nodes[i]];
+		node.timer.tigger_time = cur_time + node.timer.period;
+		node.tick = tickForTime(node.timer.tigger_time);
+		insertNode(temp_repeating_nodes[i]);
 	}
+	temp_repeating_nodes.resize(0);
 }
 
 
-void TimerQueue::addTimerToBucket(const TimerQueueTimer& timer, size_t new_bucket_i)
+void TimerQueue::clear()
 {
-	TimerQueueBucket& new_bucket = buckets[new_bucket_i];
-
-	// Query freelist of bucket
-	if(new_bucket.freelist.empty()) // If there are no free slots in bucket:
+	freelist.resize(0);
+	for(size_t i=0; i<nodes.size(); ++i)
 	{
-		// Expand bucket
-		const size_t old_size = new_bucket.timers.size();
-		const size_t new_num_items = old_size;
-		new_bucket.timers.resize(old_size + new_num_items);
-
-		// Add new slots to freelist
-		const size_t old_freelist_size = new_bucket.freelist.size();
-		new_bucket.freelist.resize(old_freelist_size + new_num_items);
-		for(size_t z=0; z<new_num_items; ++z)
-			new_bucket.freelist[old_freelist_size + z] = (int)(old_size + z);
+		nodes[i].slot = -1;
+		nodes[i].generation++; // Invalidate any handles to this node.
+		if(nodes[i].generation == 0)
+			nodes[i].generation = 1;
+		nodes[i].timer.lua_script_evaluator = WeakReference<LuaScriptEvaluator>();
+		freelist.push_back((int)i);
 	}
 
-	assert(!new_bucket.freelist.empty());
-	const int free_index = new_bucket.freelist.back();
-	new_bucket.freelist.pop_back();
-	assert(free_index < (int)new_bucket.timers.size());
-
-	new_bucket.timers[free_index] = timer;
-	new_bucket.timers[free_index].valid = true;
+	for(int i=0; i<NUM_SLOTS; ++i)
+		slot_heads[i] = -1;
+	num_timers = 0;
 }
-#endif
 
 
 #if BUILD_TESTS
@@ -234,13 +287,48 @@ void TimerQueue::addTimerToBucket(const TimerQueueTimer& timer, size_t new_bucke
 #include "../utils/TestUtils.h"
 #include "../maths/PCG32.h"
 #include <Timer.h>
+#include <queue>
+#include <algorithm>
+
+
+// The previous priority-queue based timer queue, for comparing results and performance against.
+class HeapTimerQueue
+{
+public:
+	void addTimer(const TimerQueueTimer& timer) { queue.push(timer); }
+
+	void update(double cur_time, std::vector<TimerQueueTimer>& triggered_timers_out)
+	{
+		triggered_timers_out.resize(0);
+		while(!queue.empty() && queue.top().tigger_time <= cur_time)
+		{
+			triggered_timers_out.push_back(queue.top());
+			queue.pop();
+		}
+	}
+
+	struct TimerComparator
+	{
+		bool operator() (const TimerQueueTimer& a, const TimerQueueTimer& b) const { return a.tigger_time > b.tigger_time; }
+	};
+
+	std::priority_queue<TimerQueueTimer, std::vector<TimerQueueTimer>, TimerComparator> queue;
+};
+
+
+static void getSortedTimerIDs(const std::vector<TimerQueueTimer>& timers, std::vector<int>& ids_out)
+{
+	ids_out.resize(timers.size());
+	for(size_t i=0; i<timers.size(); ++i)
+		ids_out[i] = timers[i].timer_id;
+	std::sort(ids_out.begin(), ids_out.end());
+}
 
 
 void TimerQueue::test()
 {
 	conPrint("TimerQueue::test()");
 
-#if 1
 	{
 		TimerQueue timer_queue;
 
@@ -265,6 +353,122 @@ void TimerQueue::test()
 
 		timer_queue.update(/*cur_time=*/2.5, triggered_timers);
 		testAssert(triggered_timers.size() == 1 && triggered_timers[0].timer_id == 1);
+		testAssert(timer_queue.numTimers() == 0);
+	}
+
+	// Test timers only trigger once the trigger time has been reached, even if they are in the slot for the current tick.
+	{
+		TimerQueue timer_queue;
+		timer_queue.addTimer(/*cur time=*/0.0, TimerQueueTimer(1.01));
+
+		std::vector<TimerQueueTimer> triggered_timers;
+		timer_queue.update(/*cur_time=*/1.0, triggered_timers);
+		testAssert(triggered_timers.empty());
+		timer_queue.update(/*cur_time=*/1.005, triggered_timers);
+		testAssert(triggered_timers.empty());
+		timer_queue.update(/*cur_time=*/1.01, triggered_timers);
+		testAssert(triggered_timers.size() == 1);
+
+		// A timer with a trigger time in the past should trigger on the next update.
+		timer_queue.addTimer(/*cur time=*/1.01, TimerQueueTimer(0.5));
+		timer_queue.update(/*cur_time=*/1.01, triggered_timers);
+		testAssert(triggered_timers.size() == 1);
+	}
+
+	// Test removing timers
+	{
+		TimerQueue timer_queue;
+
+		TimerQueueTimer timer_a(1.0);
+		timer_a.timer_id = 0;
+		const uint64 handle_a = timer_queue.addTimer(/*cur time=*/0.0, timer_a);
+
+		TimerQueueTimer timer_b(1.0);
+		timer_b.timer_id = 1;
+		const uint64 handle_b = timer_queue.addTimer(/*cur time=*/0.0, timer_b);
+		testAssert(handle_a != TimerQueue::INVALID_HANDLE && handle_b != TimerQueue::INVALID_HANDLE && handle_a != handle_b);
+		testAssert(timer_queue.numTimers() == 2);
+
+		timer_queue.removeTimer(handle_a);
+		timer_queue.removeTimer(handle_a); // Removing again should have no effect.
+		testAssert(timer_queue.numTimers() == 1);
+
+		// Add a new timer, which will reuse the node of timer a.  The old handle should not remove it.
+		TimerQueueTimer timer_c(1.0);
+		timer_c.timer_id = 2;
+		const uint64 handle_c = timer_queue.addTimer(/*cur time=*/0.0, timer_c);
+		testAssert(handle_c != handle_a);
+		timer_queue.removeTimer(handle_a);
+		testAssert(timer_queue.numTimers() == 2);
+
+		std::vector<TimerQueueTimer> triggered_timers;
+		timer_queue.update(/*cur_time=*/1.0, triggered_timers);
+		std::vector<int> ids;
+		getSortedTimerIDs(triggered_timers, ids);
+		testAssert(ids.size() == 2 && ids[0] == 1 && ids[1] == 2);
+		testAssert(triggered_timers[0].queue_handle == handle_b || triggered_timers[0].queue_handle == handle_c);
+
+		timer_queue.removeTimer(handle_b); // Removing a timer that has already triggered should have no effect.
+		testAssert(timer_queue.numTimers() == 0);
+
+		// Test clear() invalidates handles
+		const uint64 handle_d = timer_queue.addTimer(/*cur time=*/1.0, TimerQueueTimer(2.0));
+		timer_queue.clear();
+		testAssert(timer_queue.numTimers() == 0);
+		timer_queue.removeTimer(handle_d);
+		testAssert(timer_queue.numTimers() == 0);
+		timer_queue.update(/*cur_time=*/3.0, triggered_timers);
+		testAssert(triggered_timers.empty());
+	}
+
+	// Test repeating timers
+	{
+		TimerQueue timer_queue;
+
+		TimerQueueTimer timer_a(0.5);
+		timer_a.repeating = true;
+		timer_a.period = 0.5;
+		const uint64 handle_a = timer_queue.addTimer(/*cur time=*/0.0, timer_a);
+
+		std::vector<TimerQueueTimer> triggered_timers;
+		int num_triggered = 0;
+		for(int i=1; i<=100; ++i)
+		{
+			timer_queue.update(/*cur_time=*/i * 0.1, triggered_timers);
+			num_triggered += (int)triggered_timers.size();
+			for(size_t z=0; z<triggered_timers.size(); ++z)
+				testAssert(triggered_timers[z].queue_handle == handle_a); // Handle should stay the same.
+		}
+		testAssert(num_triggered == 20);
+		testAssert(timer_queue.numTimers() == 1);
+
+		timer_queue.removeTimer(handle_a);
+		testAssert(timer_queue.numTimers() == 0);
+		timer_queue.update(/*cur_time=*/20.0, triggered_timers);
+		testAssert(triggered_timers.empty());
+	}
+
+	// Test timers far in the future, which need to be cascaded down from higher levels, or which are beyond the range of the top level.
+	{
+		TimerQueue timer_queue;
+
+		const double trigger_times[] = { 3.0, 100.0, 1000.0, 10000.0, 1.0e6 };
+		for(int i=0; i<5; ++i)
+		{
+			TimerQueueTimer timer(trigger_times[i]);
+			timer.timer_id = i;
+			timer_queue.addTimer(/*cur time=*/0.0, timer);
+		}
+
+		std::vector<TimerQueueTimer> triggered_timers;
+		for(int i=0; i<5; ++i)
+		{
+			timer_queue.update(/*cur_time=*/trigger_times[i] - 0.001, triggered_timers);
+			testAssert(triggered_timers.empty());
+			timer_queue.update(/*cur_time=*/trigger_times[i], triggered_timers);
+			testAssert(triggered_timers.size() == 1 && triggered_timers[0].timer_id == i);
+		}
+		testAssert(timer_queue.numTimers() == 0);
 	}
 
 	{
@@ -278,6 +482,7 @@ void TimerQueue::test()
 		}
 
 		std::vector<TimerQueueTimer> triggered_timers;
+		size_t num_triggered = 0;
 		for(int t=0; t<1000; ++t)
 		{
 			timer_queue.update(/*cur_time=*/(double)t, triggered_timers);
@@ -285,9 +490,13 @@ void TimerQueue::test()
 			for(size_t z=0; z<triggered_timers.size(); ++z)
 			{
 				testAssert(triggered_timers[z].tigger_time <= (double)t);
-				printVar(triggered_timers[z].tigger_time);
+				testAssert(triggered_timers[z].tigger_time > (double)t - 1.0);
 			}
+			num_triggered += triggered_timers.size();
 		}
+		timer_queue.update(/*cur_time=*/1000.0, triggered_timers);
+		num_triggered += triggered_timers.size();
+		testAssert(num_triggered == 1000);
 
 		// Perf test
 		Timer timer;
@@ -307,26 +516,100 @@ void TimerQueue::test()
 		conPrint("Adding and removing " + toString(NUM_TIMERS) + " timers took " + doubleToStringNSigFigs(elapsed * 1.0e3, 4) + " ms");
 		const double time_per_timer = elapsed / NUM_TIMERS * 1.0e9;
 		conPrint("time_per_timer (ns): " + toString(time_per_timer));
-
 	}
 
-#else
+	// Compare against the heap-based timer queue, with a mix of one-shot and repeating timers, some of which are destroyed.
+	// The heap-based queue can't remove timers, so destroyed timers stay in the heap and are discarded when they trigger, like the old script timer processing did.
+	// Check both queues give the same results, and compare the time taken.
 	{
-		TimerQueue timer_queue;
+		const int NUM_TIMERS = 100000;
+		const double UPDATE_PERIOD = 1.0 / 60;
+		const int NUM_UPDATES = 60 * 60; // Simulate a minute of server updates.
 
-		
-		timer_queue.addTimer(/*cur time=*/0.0, TimerQueueTimer(1.0)); // Should insert in bucket 3.
-		testAssert(timer_queue.numValidTimersInBucket(/*bucket_i=*/0) == 0);
-		testAssert(timer_queue.numValidTimersInBucket(/*bucket_i=*/3) == 1);
+		std::vector<TimerQueueTimer> initial_timers(NUM_TIMERS);
+		std::vector<bool> destroyed(NUM_TIMERS, false);
+		PCG32 rng(1);
+		for(int i=0; i<NUM_TIMERS; ++i)
+		{
+			initial_timers[i].tigger_time = 0.1 + rng.unitRandom() * 10.0;
+			initial_timers[i].timer_id = i;
+			initial_timers[i].repeating = rng.unitRandom() < 0.5f;
+			initial_timers[i].period = 0.1 + rng.unitRandom() * 5.0;
+			destroyed[i] = rng.unitRandom() < 0.2f;
+		}
 
-		std::vector<TimerQueueTimer> triggered_timers;
-		timer_queue.update(/*cur_time=*/0.6, triggered_timers); // time-to-trigger will be 0.4, so should move to bucket 2.
-		testAssert(timer_queue.numValidTimersInBucket(/*bucket_i=*/2) == 1);
-		testAssert(timer_queue.numValidTimersInBucket(/*bucket_i=*/3) == 0);
+		std::vector<std::vector<int>> heap_results(NUM_UPDATES);
+		double heap_elapsed;
+		{
+			HeapTimerQueue heap_queue;
+			std::vector<TimerQueueTimer> triggered_timers;
+			std::vector<bool> heap_destroyed(NUM_TIMERS, false);
 
-		testAssert(triggered_timers.empty());
+			Timer timer;
+			for(int i=0; i<NUM_TIMERS; ++i)
+				heap_queue.addTimer(initial_timers[i]);
+
+			for(int u=0; u<NUM_UPDATES; ++u)
+			{
+				const double cur_time = (u + 1) * UPDATE_PERIOD;
+				heap_queue.update(cur_time, triggered_timers);
+				for(size_t z=0; z<triggered_timers.size(); ++z)
+				{
+					TimerQueueTimer& triggered = triggered_timers[z];
+					if(heap_destroyed[triggered.timer_id])
+						continue;
+
+					heap_results[u].push_back(triggered.timer_id);
+
+					if(destroyed[triggered.timer_id])
+						heap_destroyed[triggered.timer_id] = true; // Destroy the timer after the first time it triggers.
+					else if(triggered.repeating)
+					{
+						triggered.tigger_time = cur_time + triggered.period;
+						heap_queue.addTimer(triggered);
+					}
+				}
+			}
+			heap_elapsed = timer.elapsed();
+		}
+
+		std::vector<std::vector<int>> wheel_results(NUM_UPDATES);
+		double wheel_elapsed;
+		{
+			TimerQueue timer_queue;
+			std::vector<TimerQueueTimer> triggered_timers;
+			std::vector<uint64> handles(NUM_TIMERS);
+
+			Timer timer;
+			for(int i=0; i<NUM_TIMERS; ++i)
+				handles[i] = timer_queue.addTimer(/*cur time=*/0.0, initial_timers[i]);
+
+			for(int u=0; u<NUM_UPDATES; ++u)
+			{
+				const double cur_time = (u + 1) * UPDATE_PERIOD;
+				timer_queue.update(cur_time, triggered_timers);
+				for(size_t z=0; z<triggered_timers.size(); ++z)
+				{
+					const int timer_id = triggered_timers[z].timer_id;
+					wheel_results[u].push_back(timer_id);
+
+					if(destroyed[timer_id])
+						timer_queue.removeTimer(handles[timer_id]);
+				}
+			}
+			wheel_elapsed = timer.elapsed();
+		}
+
+		for(int u=0; u<NUM_UPDATES; ++u)
+		{
+			std::sort(heap_results[u].begin(), heap_results[u].end());
+			std::sort(wheel_results[u].begin(), wheel_results[u].end());
+			testAssert(heap_results[u] == wheel_results[u]);
+		}
+
+		conPrint("Heap timer queue:   " + doubleToStringNSigFigs(heap_elapsed * 1.0e3, 4) + " ms for " + toString(NUM_TIMERS) + " timers, " + toString(NUM_UPDATES) + " updates");
+		conPrint("Timing wheel queue: " + doubleToStringNSigFigs(wheel_elapsed * 1.0e3, 4) + " ms for " + toString(NUM_TIMERS) + " timers, " + toString(NUM_UPDATES) + " updates");
 	}
-#endif
 
 	conPrint("TimerQueue::test() done");
 }
@@ -10,9 +10,9 @@ Copyright Glare Technologies Limited 2024 -
 #include <utils/RefCounted.h>
 #include <utils/WeakReference.h>
 #include <utils/GenerationalArray.h>
+#include <utils/Platform.h>
 #include <string>
 #include <vector>
-#include <queue>
 
 
 class LuaScript;
@@ -26,32 +26,34 @@ public:
 	TimerQueueTimer(double tigger_time_);
 
 	double tigger_time;
-	//bool valid;
 
 	int onTimerEvent_ref; // Reference to Lua function
 	bool repeating;
 	double period;
 	int timer_index;
 	int timer_id;
+	uint64 queue_handle; // Set by TimerQueue::addTimer().  Can be passed to TimerQueue::removeTimer().
 	WeakReference<LuaScriptEvaluator> lua_script_evaluator;
 };
 
 
-class TimerQueueBucket
-{
-public:
-	std::vector<TimerQueueTimer> timers;
-	std::vector<int> freelist;
-};
-
-
 /*=====================================================================
 TimerQueue
 ----------
 Handles timer events for Lua scripts.
-Currently using priority_queue.
-There is also some commented-out and unfinished code for a bucket-based solution
-that may be more efficient.
+
+A hierarchical timing wheel.  Time is divided into ticks of TICK_PERIOD seconds.
+Level 0 has a slot for each of the next 64 ticks, level 1 has a slot for each of
+the next 64 level-0 rotations, and so on.  When level 0 wraps around, the timers
+in the next level-1 slot are redistributed into level 0 (and similarly for higher levels).
+
+Each slot is an intrusive doubly-linked list of timer nodes, so adding and
+removing timers are O(1).  update() removes all the timers in the slots for
+elapsed ticks in one batch.
+
+Repeating timers are re-added by update() with a trigger time of cur_time + period,
+and keep the same handle, so they can be removed with removeTimer() at any time,
+including in the timer callback.
 =====================================================================*/
 class TimerQueue
 {
@@ -59,37 +61,53 @@ public:
 	TimerQueue();
 	~TimerQueue();
 
-	void addTimer(double cur_time, const TimerQueueTimer& timer);
-	/*
-	segment 0: time to trigger < 0.03125
-	0.125
-	0.5
-	2
-	8
-	32
-	128
-	inf
-	*/
+	static const uint64 INVALID_HANDLE = 0;
+
+	// Returns a handle to the timer.  The handle is also stored in the timer returned from update().
+	uint64 addTimer(double cur_time, const TimerQueueTimer& timer);
 
+	// Removes the timer from the queue.  Does nothing if the timer has already been removed, or if it was a non-repeating timer that has triggered.
+	void removeTimer(uint64 handle);
+
+	// Appends all timers with tigger_time <= cur_time to triggered_timers_out (after clearing it).
 	void update(double cur_time, std::vector<TimerQueueTimer>& triggered_timers_out);
 
+	size_t numTimers() const { return num_timers; }
+
 	void clear(); // Just used for testing
 
 	static void test();
 
 private:
-	//size_t numValidTimersInBucket(size_t bucket_i);
-	//size_t getBucketForTimeToTrigger(double ttt);
-	//void addTimerToBucket(const TimerQueueTimer& timer, size_t new_bucket_i);
+	GLARE_DISABLE_COPY(TimerQueue);
 
-	//TimerQueueBucket buckets[8];
-	//double bucket_min_ttt[8];
-	//double bucket_max_ttt[8];
+	static const int SLOT_BITS = 6;
+	static const int NUM_SLOTS_PER_LEVEL = 1 << SLOT_BITS;
+	static const int NUM_LEVELS = 4; // With a tick period of 1/32 s, timers up to about 6 days in the future are placed directly in a slot.
+	static const int NUM_SLOTS = NUM_SLOTS_PER_LEVEL * NUM_LEVELS;
 
-	struct TimerComparator
+	struct TimerNode
 	{
-		bool operator() (const TimerQueueTimer& a, const TimerQueueTimer& b) const { return a.tigger_time > b.tigger_time; }
+		TimerQueueTimer timer;
+		int64 tick;
+		int next; // Next node in slot list, or -1
+		int prev; // Previous node in slot list, or -1
+		int slot; // Slot that the node is in, or -1 if node is free.
+		uint32 generation;
 	};
 
-	std::priority_queue<TimerQueueTimer, std::vector<TimerQueueTimer>, TimerComparator> queue;
+	int64 tickForTime(double t) const;
+	void insertNode(int node_index);
+	void unlinkNode(int node_index);
+	void freeNode(int node_index);
+	void cascadeSlot(int slot);
+	void expireSlot(int slot, double cur_time, bool expire_all, std::vector<TimerQueueTimer>& triggered_timers_out);
+
+	std::vector<TimerNode> nodes;
+	std::vector<int> freelist;
+	int slot_heads[NUM_SLOTS]; // Index of first node in each slot list, or -1 if slot is empty.
+	int64 next_tick; // First tick that has not been fully processed.
+	size_t num_timers;
+
+	std::vector<int> temp_repeating_nodes;
 };
@@ -69,6 +69,10 @@ WorldObject::WorldObject() noexcept
 	changed_flags = 0;
 	using_placeholder_model = false;
 
+#if SERVER
+	script_handle = 0;
+#endif
+
 #if GUI_CLIENT
 	is_selected = false;
 	in_proximity = false;
@@ -156,6 +160,47 @@ int WorldObject::getLODLevelForURL(const std::string& URL) // Identifies _lod1 e
 }
 
 
+bool WorldObject::modelURLCanHaveOptimisedVersion(const std::string& base_model_url)
+{
+	if(hasPrefix(base_model_url, "http:") || hasPrefix(base_model_url, "https:"))
+		return false;
+
+	// VRM models are not included, as the client rotates them after loading.  bmesh models are already in the format the client loads fastest.
+	return hasExtension(base_model_url, "obj") || hasExtension(base_model_url, "stl") || hasExtension(base_model_url, "gltf") || hasExtension(base_model_url, "glb") || hasExtension(base_model_url, "igmesh");
+}
+
+
+std::string WorldObject::getOptimisedModelURL(const std::string& base_model_url)
+{
+	return removeDotAndExtension(base_model_url) + "_opt.bmesh"; // Optimised models are always saved in BatchedMesh (bmesh) format.
+}
+
+
+std::string WorldObject::getModelURLForModelLODLevel(int model_lod_level) const
+{
+	if((model_lod_level <= 0) && BitUtils::isBitSet(flags, OPTIMISED_MODEL_FLAG) && modelURLCanHaveOptimisedVersion(model_url)) // Check the model URL as well, in case the flag is stale after a local model change.
+		return getOptimisedModelURL(model_url);
+	else
+		return getLODModelURLForLevel(model_url, model_lod_level);
+}
+
+
+bool WorldObject::updateOptimisedModelFlag(ResourceManager& resource_manager)
+{
+	bool have_optimised_model = false;
+	try
+	{
+		have_optimised_model = !model_url.empty() && modelURLCanHaveOptimisedVersion(model_url) && resource_manager.isFileForURLPresent(getOptimisedModelURL(model_url));
+	}
+	catch(glare::Exception&) // isFileForURLPresent() throws if the URL is invalid.
+	{}
+
+	const uint32 old_flags = flags;
+	BitUtils::setOrZeroBit(flags, OPTIMISED_MODEL_FLAG, have_optimised_model);
+	return flags != old_flags;
+}
+
+
 int WorldObject::getModelLODLevel(const Vec3d& campos) const // getLODLevel() clamped to max_model_lod_level
 {
 	if(max_model_lod_level == 0)
@@ -175,11 +220,11 @@ std::string WorldObject::getLODModelURL(const Vec3d& campos) const
 {
 	// Early-out for max_model_lod_level == 0: avoid computing LOD
 	if(this->max_model_lod_level == 0)
-		return this->model_url;
+		return getModelURLForModelLODLevel(0);
 
 	const int ob_lod_level = getLODLevel(campos);
 	const int ob_model_lod_level = myClamp(ob_lod_level, 0, this->max_model_lod_level);
-	return getLODModelURLForLevel(this->model_url, ob_model_lod_level);
+	return getModelURLForModelLODLevel(ob_model_lod_level);
 }
 
 
@@ -200,7 +245,7 @@ void WorldObject::appendDependencyURLs(int ob_lod_level, const GetDependencyOpti
 	if(!model_url.empty())
 	{
 		const int ob_model_lod_level =  myClamp(ob_lod_level, 0, this->max_model_lod_level);
-		URLs_out.push_back(DependencyURL(getLODModelURLForLevel(model_url, ob_model_lod_level)));
+		URLs_out.push_back(DependencyURL(getModelURLForModelLODLevel(ob_model_lod_level)));
 	}
 
 	if(options.include_lightmaps && !lightmap_url.empty())
@@ -223,6 +268,8 @@ void WorldObject::appendDependencyURLsForAllLODLevels(std::vector<DependencyURL>
 	if(!model_url.empty())
 	{
 		URLs_out.push_back(DependencyURL(model_url));
+		if(BitUtils::isBitSet(flags, OPTIMISED_MODEL_FLAG) && modelURLCanHaveOptimisedVersion(model_url))
+			URLs_out.push_back(DependencyURL(getOptimisedModelURL(model_url)));
 		if(max_model_lod_level > 0)
 		{
 			URLs_out.push_back(DependencyURL(getLODModelURLForLevel(model_url, 1)));
@@ -786,6 +833,10 @@ void WorldObject::copyNetworkStateFrom(const WorldObject& other)
 
 	physics_owner_id = other.physics_owner_id;
 	last_physics_ownership_change_global_time = other.last_physics_ownership_change_global_time;
+
+#if SERVER
+	invalidateCachedNetworkMessages();
+#endif
 }
 
 
@@ -1395,6 +1446,27 @@ void WorldObject::test()
 			readWorldObjectFromStream(instream, ob2);
 			testAssert(ob2.materials.size() == ob.materials.size());
 		}
+
+		// Test optimised model URLs
+		{
+			testAssert(WorldObject::modelURLCanHaveOptimisedVersion("car_glb_123.glb"));
+			testAssert(WorldObject::modelURLCanHaveOptimisedVersion("teapot_obj_123.obj"));
+			testAssert(!WorldObject::modelURLCanHaveOptimisedVersion("car_glb_123.bmesh"));
+			testAssert(!WorldObject::modelURLCanHaveOptimisedVersion("avatar_vrm_123.vrm"));
+			testAssert(!WorldObject::modelURLCanHaveOptimisedVersion("https://example.com/car.glb"));
+			testAssert(WorldObject::getOptimisedModelURL("car_glb_123.glb") == "car_glb_123_opt.bmesh");
+			testAssert(WorldObject::getLODLevelForURL(WorldObject::getOptimisedModelURL("car_glb_123.glb")) == 0);
+
+			WorldObject ob;
+			ob.model_url = "car_glb_123.glb";
+			ob.max_model_lod_level = 2;
+			testAssert(ob.getModelURLForModelLODLevel(0) == "car_glb_123.glb");
+			BitUtils::setBit(ob.flags, WorldObject::OPTIMISED_MODEL_FLAG);
+			testAssert(ob.getModelURLForModelLODLevel(0) == "car_glb_123_opt.bmesh");
+			testAssert(ob.getModelURLForModelLODLevel(1) == "car_glb_123_lod1.bmesh"); // LOD models are generated from the source model, so don't change.
+			ob.model_url = "car_glb_123.bmesh"; // Flag is stale after changing to a bmesh model.
+			testAssert(ob.getModelURLForModelLODLevel(0) == "car_glb_123.bmesh");
+		}
 	}
 	catch(glare::Exception& e)
 	{
@@ -154,6 +154,8 @@ public:
 
 	static std::string getLODModelURLForLevel(const std::string& base_model_url, int level);
 	static int getLODLevelForURL(const std::string& URL); // Identifies _lod1 etc. suffix.
+	static bool modelURLCanHaveOptimisedVersion(const std::string& base_model_url); // Is this a model format that the server generates an optimised bmesh version of?
+	static std::string getOptimisedModelURL(const std::string& base_model_url);
 	static std::string getLODLightmapURL(const std::string& base_lightmap_url, int level);
 
 	inline int getLODLevel(const Vec3d& campos) const;
@@ -163,6 +165,10 @@ public:
 	int getModelLODLevel(const Vec3d& campos) const; // getLODLevel() clamped to max_model_lod_level, also clamped to >= 0.
 	int getModelLODLevelForObLODLevel(int ob_lod_level) const; // getLODLevel() clamped to max_model_lod_level, also clamped to >= 0.
 	std::string getLODModelURL(const Vec3d& campos) const; // Using lod level clamped to max_model_lod_level
+	std::string getModelURLForModelLODLevel(int model_lod_level) const; // Returns the optimised model URL for level 0 if OPTIMISED_MODEL_FLAG is set.
+
+	// Sets or clears OPTIMISED_MODEL_FLAG, depending on whether the optimised version of the model is present in resource_manager.  Returns true if the flag changed.
+	bool updateOptimisedModelFlag(ResourceManager& resource_manager);
 
 	// Sometimes we are not interested in all dependencies, such as lightmaps.  So make returning those optional.
 	struct GetDependencyOptions
@@ -292,6 +298,7 @@ public:
 	static const uint32 VIDEO_LOOP                              = 64; // For video objects, should the video loop?
 	static const uint32 VIDEO_MUTED                             = 128; // For video objects, should the video be initially muted?
 	static const uint32 IS_SENSOR_FLAG                          = 256; // Is this a physics sensor?
+	static const uint32 OPTIMISED_MODEL_FLAG                    = 512; // Has the server generated an optimised bmesh version of the model?  Set by the server, see getOptimisedModelURL().
 	uint32 flags;
 
 	TimeStamp created_time;
@@ -359,6 +366,16 @@ public:
 
 	DatabaseKey database_key;
 
+#if SERVER
+	// Cached serialised ObjectInitialSend message for this object, used when answering object queries.  Empty if not valid.
+	// Must be invalidated whenever any of the network state of the object changes.
+	js::Vector<uint8, 16> cached_initial_send_msg;
+
+	void invalidateCachedNetworkMessages() { cached_initial_send_msg.clear(); }
+
+	uint64 script_handle; // Handle in the WorldObjectHandleTable of the world the object is in, for Lua scripts.  0 if not in a world.
+#endif
+
 #if GUI_CLIENT
 	std::vector<InstanceInfo> instances;
 
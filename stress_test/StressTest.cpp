@@ -27,7 +27,12 @@ Copyright Glare Technologies Limited 2021 -
 #include <StringUtils.h>
 #include <GlareProcess.h>
 #include <CryptoRNG.h>
+#include <Mutex.h>
+#include <Lock.h>
+#include <AtomicInt.h>
 #include <tls.h>
+#include <algorithm>
+#include <vector>
 
 
 // TODO: do authentication
@@ -55,6 +60,23 @@ static void initPacket(SocketBufferOutStream& scratch_packet, uint32 message_id)
 }
 
 
+// Stats shared by all bot threads, used for comparing server networking modes (e.g. thread-per-client vs the epoll reactor).
+struct StressTestStats
+{
+	StressTestStats() : num_connected(0), num_failed(0), num_msgs_received(0), num_bytes_received(0) {}
+
+	Mutex mutex;
+	int num_connected		GUARDED_BY(mutex);
+	int num_failed			GUARDED_BY(mutex);
+	uint64 num_msgs_received	GUARDED_BY(mutex);
+	uint64 num_bytes_received	GUARDED_BY(mutex);
+	std::vector<double> round_trip_times	GUARDED_BY(mutex); // In seconds
+};
+
+static StressTestStats stats;
+static glare::AtomicInt should_quit(0);
+
+
 class StressTestBotThread : public MyThread
 {
 public:
@@ -64,7 +86,6 @@ public:
 		try
 		{
 			//const std::string server_hostname = "localhost";
-			const std::string server_hostname = "substrata.info";
 			const int server_port = 7600;
 
 			conPrint("Connecting to " + server_hostname + ":" + toString(server_port) + "...");
@@ -139,8 +160,17 @@ public:
 			}
 
 			
+			{
+				Lock lock(stats.mutex);
+				stats.num_connected++;
+			}
+
 			Timer timer;
 			Timer time_since_update_packet_sent;
+			Timer time_since_probe_sent;
+			double probe_send_time = -1; // Time the current round-trip probe was sent, or -1 if there is no probe in flight.
+			uint64 num_msgs_received = 0;
+			uint64 num_bytes_received = 0;
 
 			BufferInStream msg_buffer;
 
@@ -150,7 +180,7 @@ public:
 
 			double last_think_time = Clock::getCurTimeRealSec();
 
-			while(1)
+			while(!should_quit)
 			{
 				if(socket->readable(/*timeout_s=*/0.05))
 				{
@@ -173,10 +203,26 @@ public:
 
 					//conPrint("Read msg of type " + toString(msg_type));
 
+					num_msgs_received++;
+					num_bytes_received += msg_len;
+
 					switch(msg_type)
 					{
 						case Protocol::AllObjectsSent:
 						{
+							break;
+						}
+						case Protocol::MapTilesResult:
+						{
+							// Response to our round-trip probe.
+							if(probe_send_time >= 0)
+							{
+								const double rtt = Clock::getCurTimeRealSec() - probe_send_time;
+								probe_send_time = -1;
+								Lock lock(stats.mutex);
+								stats.round_trip_times.push_back(rtt);
+							}
+							break;
 						}
 					}
 				} // end if socket was readable
@@ -216,21 +262,53 @@ public:
 					time_since_update_packet_sent.reset();
 				}
 
-			} // End while(1) loop
+				// Send a round-trip probe every second.  A QueryMapTiles message for zero tiles is cheap for the server to handle, and always gets a MapTilesResult response.
+				if((probe_send_time < 0) && (time_since_probe_sent.elapsed() > 1.0))
+				{
+					initPacket(scratch_packet, Protocol::QueryMapTiles);
+					scratch_packet.writeUInt32(0); // num tiles
+					updatePacketLengthField(scratch_packet);
+
+					probe_send_time = Clock::getCurTimeRealSec();
+					socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+
+					time_since_probe_sent.reset();
+				}
+
+				if(num_msgs_received > 0)
+				{
+					Lock lock(stats.mutex);
+					stats.num_msgs_received += num_msgs_received;
+					stats.num_bytes_received += num_bytes_received;
+					num_msgs_received = 0;
+					num_bytes_received = 0;
+				}
+			} // End while(!should_quit) loop
 		}
 		catch(glare::Exception& e)
 		{
 			// Connection failed.
 			conPrint("Error: " + e.what());
-			//PlatformUtils::Sleep(1000);
+			Lock lock(stats.mutex);
+			stats.num_failed++;
 		}
 	}
 
+	std::string server_hostname;
 	struct tls_config* client_tls_config;
 	int seed;
 };
 
 
+/*
+Usage: stress_test [server_hostname] [num_connections] [duration_s]
+
+Connects num_connections bots to the server, runs for duration_s seconds, then prints throughput and round-trip latency stats.
+To compare server networking modes, run once against a server with use_epoll_reactor set to false in the server config, and once with it set to true,
+using the same number of connections.
+*/
+
+
 int main(int argc, char* argv[])
 {
 	Clock::init();
@@ -248,25 +326,63 @@ int main(int argc, char* argv[])
 	tls_config_insecure_noverifyname(client_tls_config);
 
 
-	const int NUM_THREADS = 300;
-	std::vector<Reference<StressTestBotThread>> threads;
-	for(int i=0; i<NUM_THREADS; ++i)
+	try
 	{
-		Reference<StressTestBotThread> t = new StressTestBotThread();
-		t->client_tls_config = client_tls_config;
-		t->seed = i;
-		t->launch();
-		threads.push_back(t);
-	}
+		const std::string server_hostname = (argc >= 2) ? std::string(argv[1]) : std::string("substrata.info");
+		const int num_threads = (argc >= 3) ? stringToInt(argv[2]) : 300;
+		const double duration_s = (argc >= 4) ? stringToDouble(argv[3]) : 60.0;
+
+		conPrint("Running stress test with " + toString(num_threads) + " connections to " + server_hostname + " for " + toString(duration_s) + " s...");
+
+		std::vector<Reference<StressTestBotThread>> threads;
+		for(int i=0; i<num_threads; ++i)
+		{
+			Reference<StressTestBotThread> t = new StressTestBotThread();
+			t->server_hostname = server_hostname;
+			t->client_tls_config = client_tls_config;
+			t->seed = i;
+			t->launch();
+			threads.push_back(t);
+		}
+
+		Timer timer;
+		while(timer.elapsed() < duration_s)
+			PlatformUtils::Sleep(100);
+
+		const double elapsed = timer.elapsed();
 
-	while(1)
+		should_quit = 1;
+		for(size_t i=0; i<threads.size(); ++i)
+			threads[i]->join();
+
+		// Print results
+		{
+			Lock lock(stats.mutex);
+
+			std::vector<double> rtts = stats.round_trip_times;
+			std::sort(rtts.begin(), rtts.end());
+			double rtt_sum = 0;
+			for(size_t i=0; i<rtts.size(); ++i)
+				rtt_sum += rtts[i];
+
+			conPrint("");
+			conPrint("Connections:       " + toString(stats.num_connected) + " connected, " + toString(stats.num_failed) + " failed");
+			conPrint("Messages received: " + doubleToStringNSigFigs(stats.num_msgs_received / elapsed, 4) + " msgs/s");
+			conPrint("Data received:     " + doubleToStringNSigFigs(stats.num_bytes_received / (elapsed * 1.0e6), 4) + " MB/s");
+			if(!rtts.empty())
+			{
+				conPrint("Round trip time:   mean " + doubleToStringNSigFigs(rtt_sum / rtts.size() * 1.0e3, 4) + " ms, " +
+					"p50 " + doubleToStringNSigFigs(rtts[rtts.size() / 2] * 1.0e3, 4) + " ms, " +
+					"p99 " + doubleToStringNSigFigs(rtts[std::min(rtts.size() - 1, rtts.size() * 99 / 100)] * 1.0e3, 4) + " ms, " +
+					"max " + doubleToStringNSigFigs(rtts.back() * 1.0e3, 4) + " ms (" + toString(rtts.size()) + " samples)");
+			}
+		}
+	}
+	catch(glare::Exception& e)
 	{
-		PlatformUtils::Sleep(100);
+		conPrint("Error: " + e.what());
+		return 1;
 	}
-	//while(1) // While stress-test bot should keep running:
-	//{
-	//	
-	//} // End while screenshot bot should keep running:
 
 	return 0;
 }
@@ -18,7 +18,11 @@ Copyright Glare Technologies Limited 2021 -
 #include <Exception.h>
 #include <Lock.h>
 #include <Parser.h>
+#include <StringUtils.h>
 #include <Escaping.h>
+#include <maths/mathstypes.h>
+#include <algorithm>
+#include <functional>
 
 
 namespace AdminHandlers
@@ -116,6 +120,70 @@ void renderMainAdminPage(ServerAllWorldsState& world_state, const web::RequestIn
 		page_out += "</form>";
 	}
 
+	page_out += "<h2>Diagnostics</h2>";
+
+	{ // Lock scope
+		Lock lock(world_state.mutex);
+
+		const uint64 hits   = world_state.num_object_initial_send_cache_hits;
+		const uint64 misses = world_state.num_object_initial_send_cache_misses;
+		const double hit_fraction = (hits + misses > 0) ? ((double)hits / (double)(hits + misses)) : 0.0;
+
+		page_out += "<p>Object initial-send message cache: " + toString(hits) + " hits, " + toString(misses) + " misses (" + doubleToStringNSigFigs(hit_fraction * 100.0, 3) + "% hit rate)</p>";
+
+		const WebPageCache::Stats page_cache_stats = world_state.web_page_cache->getStats();
+		const double page_cache_hit_fraction = (page_cache_stats.hits + page_cache_stats.misses > 0) ? ((double)page_cache_stats.hits / (double)(page_cache_stats.hits + page_cache_stats.misses)) : 0.0;
+		page_out += "<p>Web page cache: " + toString(page_cache_stats.hits) + " hits, " + toString(page_cache_stats.misses) + " misses (" + doubleToStringNSigFigs(page_cache_hit_fraction * 100.0, 3) + "% hit rate), " + 
+			toString(page_cache_stats.num_pages) + " pages, " + getNiceByteSize(page_cache_stats.cache_size_B) + "</p>";
+
+		const ServerAllWorldsState::DatabaseSaveStats& save_stats = world_state.db_save_stats;
+		page_out += "<p>Database saves: " + toString(save_stats.num_saves) + " (" + toString(save_stats.num_failed_saves) + " failed), " + 
+			"last save: " + getNiceByteSize(save_stats.last_num_bytes) + ", serialise time (under lock): " + doubleToStringNSigFigs(save_stats.last_serialise_time * 1.0e3, 4) + " ms, " + 
+			"write + flush time: " + doubleToStringNSigFigs(save_stats.last_write_time * 1.0e3, 4) + " ms.  " + 
+			"Max serialise time: " + doubleToStringNSigFigs(save_stats.max_serialise_time * 1.0e3, 4) + " ms, max write + flush time: " + doubleToStringNSigFigs(save_stats.max_write_time * 1.0e3, 4) + " ms.  " + 
+			"Total written: " + getNiceByteSize(save_stats.total_num_bytes) + "</p>";
+
+		// Show the worlds that have spent the most time executing scripts.
+		std::vector<std::pair<double, std::string>> world_script_times;
+		for(auto it = world_state.world_states.begin(); it != world_state.world_states.end(); ++it)
+			if(it->second->script_stats.num_executions > 0)
+				world_script_times.push_back(std::make_pair(it->second->script_stats.total_exec_time, it->first));
+		std::sort(world_script_times.begin(), world_script_times.end(), std::greater<std::pair<double, std::string>>());
+
+		page_out += "<p>Script execution time by world (" + toString(world_script_times.size()) + " worlds with scripts):</p>";
+		for(size_t i=0; i<myMin<size_t>(world_script_times.size(), 20); ++i)
+		{
+			const std::string& world_name = world_script_times[i].second;
+			const ServerWorldState* world = world_state.world_states[world_name].ptr();
+			page_out += "<div>" + (world_name.empty() ? std::string("[Main world]") : web::Escaping::HTMLEscape(world_name)) + ": " + 
+				doubleToStringNSigFigs(world->script_stats.total_exec_time * 1.0e3, 4) + " ms total, " + toString(world->script_stats.num_executions) + " executions, max " + 
+				doubleToStringNSigFigs(world->script_stats.max_exec_time * 1.0e3, 4) + " ms" + (world->script_context.nonNull() ? ", own Lua VM" : "") + "</div>\n";
+		}
+	} // End Lock scope
+
+	// Lua script profiler
+	{
+		const bool profiler_enabled = world_state.lua_script_profiler.isEnabled();
+
+		page_out += "<p>Lua script profiler: " + (profiler_enabled ? 
+			std::string("<span class=\"feature-enabled\">enabled</span>") : std::string("<span class=\"feature-disabled\">disabled</span>")) + 
+			"</p>";
+
+		page_out += "<form action=\"/admin_set_lua_profiler_enabled_post\" method=\"post\">";
+		page_out += "<input type=\"number\" name=\"enabled\" value=\"" + toString(profiler_enabled ? 1 : 0) + "\">";
+		page_out += "<input type=\"submit\" value=\"Set Lua script profiler enabled (1 / 0).  Enabling clears the previous profile.\">";
+		page_out += "</form>";
+
+		std::vector<LuaScriptProfiler::FuncStats> func_stats;
+		world_state.lua_script_profiler.getMostExpensiveFunctions(/*max num results=*/50, func_stats);
+		for(size_t i=0; i<func_stats.size(); ++i)
+		{
+			const LuaScriptProfiler::FuncStats& stats = func_stats[i];
+			page_out += "<div>object " + stats.ob_uid.toString() + ", " + web::Escaping::HTMLEscape(stats.func_name) + ": " + 
+				doubleToStringNSigFigs(stats.total_time * 1.0e3, 4) + " ms total, " + toString(stats.num_calls) + " calls, max " + doubleToStringNSigFigs(stats.max_time * 1.0e3, 4) + " ms</div>\n";
+		}
+	}
+
 	web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, page_out);
 }
 
@@ -1949,6 +2017,33 @@ void handleForceDynTexUpdatePost(ServerAllWorldsState& world_state, const web::R
 }
 
 
+void handleSetLuaProfilerEnabledPost(ServerAllWorldsState& world_state, const web::RequestInfo& request, web::ReplyInfo& reply_info)
+{
+	if(!LoginHandlers::loggedInUserHasAdminPrivs(world_state, request))
+	{
+		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, "Access denied sorry.");
+		return;
+	}
+
+	try
+	{
+		const bool enabled = request.getPostIntField("enabled") != 0;
+
+		if(enabled && !world_state.lua_script_profiler.isEnabled())
+			world_state.lua_script_profiler.clear(); // Start a new profile.
+		world_state.lua_script_profiler.setEnabled(enabled);
+
+		web::ResponseUtils::writeRedirectTo(reply_info, "/admin");
+	}
+	catch(glare::Exception& e)
+	{
+		if(!request.fuzzing)
+			conPrint("handleSetLuaProfilerEnabledPost error: " + e.what());
+		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, "Error: " + e.what());
+	}
+}
+
+
 void handleSetUserAsWorldGardenerPost(ServerAllWorldsState& world_state, const web::RequestInfo& request, web::ReplyInfo& reply_info)
 {
 	if(!LoginHandlers::loggedInUserHasAdminPrivs(world_state, request))
@@ -33,6 +33,14 @@ void renderRootPage(ServerAllWorldsState& world_state, WebDataStore& data_store,
 	//std::string page_out = WebServerResponseUtils::standardHeader(world_state, request_info, /*page title=*/"Substrata");
 	//const bool logged_in = LoginHandlers::isLoggedInAsNick(data_store, request_info);
 
+	// Serve the page from the cache if possible, so we don't need to take the world state lock.
+	const bool use_page_cache = WebPageCache::isCacheableRequest(request_info);
+	if(use_page_cache && world_state.web_page_cache->writeCachedPage(request_info.path, request_info, reply_info))
+		return;
+
+	WebPageCache::DependencyVersions page_dependency_versions;
+	WebPageCache::getDependencyVersions(page_dependency_versions);
+
 	std::string page_out = WebServerResponseUtils::standardHTMLHeader(data_store, request_info, /*page title=*/"Substrata");
 	page_out +=
 		"	<body class=\"root-body\">\n"
@@ -185,6 +193,10 @@ void renderRootPage(ServerAllWorldsState& world_state, WebDataStore& data_store,
 	
 	page_out += WebServerResponseUtils::standardFooter(request_info, true);
 
+	if(use_page_cache)
+		world_state.web_page_cache->addPage(request_info.path, page_out, 
+			WebPageCache::Dependency_Parcels | WebPageCache::Dependency_ParcelAuctions | WebPageCache::Dependency_Screenshots | WebPageCache::Dependency_NewsPosts, page_dependency_versions);
+
 	web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, page_out);
 }
 
@@ -762,6 +774,13 @@ void renderBotStatusPage(ServerAllWorldsState& world_state, const web::RequestIn
 
 void renderMapPage(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::ReplyInfo& reply_info)
 {
+	const bool use_page_cache = WebPageCache::isCacheableRequest(request_info);
+	if(use_page_cache && world_state.web_page_cache->writeCachedPage(request_info.path, request_info, reply_info))
+		return;
+
+	WebPageCache::DependencyVersions page_dependency_versions;
+	WebPageCache::getDependencyVersions(page_dependency_versions);
+
 	const std::string extra_header_tags = WebServerResponseUtils::getMapHeaderTags();
 	std::string page = WebServerResponseUtils::standardHeader(world_state, request_info, /*page title=*/"Map", extra_header_tags);
 
@@ -769,6 +788,9 @@ void renderMapPage(ServerAllWorldsState& world_state, const web::RequestInfo& re
 
 	page += WebServerResponseUtils::standardFooter(request_info, true);
 
+	if(use_page_cache)
+		world_state.web_page_cache->addPage(request_info.path, page, WebPageCache::Dependency_Parcels | WebPageCache::Dependency_ParcelAuctions, page_dependency_versions);
+
 	web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, page);
 }
 
@@ -41,6 +41,14 @@ void renderNewsPostPage(ServerAllWorldsState& world_state, const web::RequestInf
 		if(!parser.parseUnsignedInt(post_id))
 			throw glare::Exception("Failed to parse post id");
 
+		// Serve the page from the cache if possible, so we don't need to take the world state lock.
+		const bool use_page_cache = WebPageCache::isCacheableRequest(request);
+		const std::string page_cache_key = "/news_post/" + toString(post_id);
+		if(use_page_cache && world_state.web_page_cache->writeCachedPage(page_cache_key, request, reply_info))
+			return;
+
+		WebPageCache::DependencyVersions page_dependency_versions;
+		WebPageCache::getDependencyVersions(page_dependency_versions);
 		
 		std::string page;
 
@@ -106,6 +114,9 @@ void renderNewsPostPage(ServerAllWorldsState& world_state, const web::RequestInf
 		page += "</div>   \n"; // end main div
 		page += WebServerResponseUtils::standardFooter(request, true);
 
+		if(use_page_cache)
+			world_state.web_page_cache->addPage(page_cache_key, page, WebPageCache::Dependency_NewsPosts | WebPageCache::Dependency_Users, page_dependency_versions);
+
 		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, page);
 	}
 	catch(glare::Exception& e)
@@ -119,11 +130,20 @@ void renderAllNewsPage(ServerAllWorldsState& world_state, const web::RequestInfo
 {
 	try
 	{
-		std::string page = WebServerResponseUtils::standardHeader(world_state, request, "Latest news");
-
 		// Get start post index for pagination from URL
 		const int start = request.isURLParamPresent("start") ? request.getURLIntParam("start") : 0;
 
+		// Serve the page from the cache if possible, so we don't need to take the world state lock.
+		const bool use_page_cache = WebPageCache::isCacheableRequest(request);
+		const std::string page_cache_key = "/news?start=" + toString(start);
+		if(use_page_cache && world_state.web_page_cache->writeCachedPage(page_cache_key, request, reply_info))
+			return;
+
+		WebPageCache::DependencyVersions page_dependency_versions;
+		WebPageCache::getDependencyVersions(page_dependency_versions);
+
+		std::string page = WebServerResponseUtils::standardHeader(world_state, request, "Latest news");
+
 		page += "<div class=\"main\">   \n";
 
 		const int max_num_to_display = 5;
@@ -175,6 +195,9 @@ void renderAllNewsPage(ServerAllWorldsState& world_state, const web::RequestInfo
 		page += "</div>   \n"; // end main div
 		page += WebServerResponseUtils::standardFooter(request, true);
 
+		if(use_page_cache)
+			world_state.web_page_cache->addPage(page_cache_key, page, WebPageCache::Dependency_NewsPosts | WebPageCache::Dependency_Users, page_dependency_versions);
+
 		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, page);
 	}
 	catch(glare::Exception& e)
@@ -42,6 +42,15 @@ void renderParcelPage(ServerAllWorldsState& world_state, const web::RequestInfo&
 		if(!parser.parseUnsignedInt(parcel_id))
 			throw glare::Exception("Failed to parse parcel id");
 
+		// Serve the page from the cache if possible, so we don't need to take the world state lock.
+		const bool use_page_cache = WebPageCache::isCacheableRequest(request);
+		const std::string page_cache_key = "/parcel/" + toString(parcel_id);
+		if(use_page_cache && world_state.web_page_cache->writeCachedPage(page_cache_key, request, reply_info))
+			return;
+
+		WebPageCache::DependencyVersions page_dependency_versions;
+		WebPageCache::getDependencyVersions(page_dependency_versions);
+
 		const std::string extra_header_tags = WebServerResponseUtils::getMapHeaderTags();
 
 		std::string page = WebServerResponseUtils::standardHeader(world_state, request, /*page title=*/"Parcel #" + toString(parcel_id) + "", extra_header_tags);
@@ -295,6 +304,10 @@ void renderParcelPage(ServerAllWorldsState& world_state, const web::RequestInfo&
 		page += "</div>   \n"; // end main div
 		page += WebServerResponseUtils::standardFooter(request, true);
 
+		if(use_page_cache)
+			world_state.web_page_cache->addPage(page_cache_key, page, WebPageCache::Dependency_Parcels | WebPageCache::Dependency_ParcelAuctions | WebPageCache::Dependency_Screenshots | 
+				WebPageCache::Dependency_Users | WebPageCache::Dependency_SubEthTransactions, page_dependency_versions);
+
 		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, page);
 	}
 	catch(glare::Exception& e)
@@ -21,7 +21,6 @@ Copyright Glare Technologies Limited 2021 -
 #include <Lock.h>
 #include <StringUtils.h>
 #include <PlatformUtils.h>
-#include <MemMappedFile.h>
 #include <FileUtils.h>
 #include <RuntimeCheck.h>
 
@@ -134,7 +133,8 @@ void handleResourceRequest(ServerAllWorldsState& world_state, const web::Request
 
 				const std::string content_type = web::ResponseUtils::getContentTypeForPath(local_path); // Guess content type
 
-				MemMappedFile file(local_path);
+				ResourceSendCache::OpenResource file;
+				world_state.resource_send_cache->openResource(local_path, file);
 
 				// NOTE: only handle a single range for now, because the response content types (and encoding?) get different for multiple ranges.
 				if(request.ranges.size() == 1)
@@ -142,12 +142,12 @@ void handleResourceRequest(ServerAllWorldsState& world_state, const web::Request
 					for(size_t i=0; i<request.ranges.size(); ++i)
 					{
 						const web::Range range = request.ranges[i];
-						if(range.start < 0 || range.start >= (int64)file.fileSize())
+						if(range.start < 0 || range.start >= (int64)file.size)
 							throw glare::Exception("invalid range");
 						
 						int64 range_size;
 						if(range.end_incl == -1) // if this range is just to the end:
-							range_size = (int64)file.fileSize() - range.start;
+							range_size = (int64)file.size - range.start;
 						else
 						{
 							if(range.start > range.end_incl)
@@ -156,7 +156,7 @@ void handleResourceRequest(ServerAllWorldsState& world_state, const web::Request
 						}
 
 						const int64 use_range_end = range.start + range_size;
-						if(use_range_end > (int64)file.fileSize())
+						if(use_range_end > (int64)file.size)
 							throw glare::Exception("invalid range");
 
 						//conPrint("\thandleResourceRequest: serving data range (start: " + toString(range.start) + ", range_size: " + toString(range_size) + ")");
@@ -164,7 +164,7 @@ void handleResourceRequest(ServerAllWorldsState& world_state, const web::Request
 						const std::string response = 
 							"HTTP/1.1 206 Partial Content\r\n"
 							"Content-Type: " + content_type + "\r\n"
-							"Content-Range: bytes " + toString(range.start) + "-" + toString(use_range_end - 1) + "/" + toString(file.fileSize()) + "\r\n" // Note that ranges are inclusive, hence the - 1.
+							"Content-Range: bytes " + toString(range.start) + "-" + toString(use_range_end - 1) + "/" + toString(file.size) + "\r\n" // Note that ranges are inclusive, hence the - 1.
 							"Cache-Control: max-age=1000000000, immutable\r\n"
 							"Connection: Keep-Alive\r\n"
 							"Content-Length: " + toString(range_size) + "\r\n"
@@ -173,20 +173,31 @@ void handleResourceRequest(ServerAllWorldsState& world_state, const web::Request
 						reply_info.socket->writeData(response.c_str(), response.size());
 
 						// Sanity check range.start and range_size.  Should be valid by here.
-						runtimeCheck((range.start >= 0) && (range.start <= (int64)file.fileSize()) && (range.start + range_size <= (int64)file.fileSize()));
+						runtimeCheck((range.start >= 0) && (range.start <= (int64)file.size) && (range.start + range_size <= (int64)file.size));
 
-						reply_info.socket->writeData((const uint8*)file.fileData() + range.start, range_size);
+						world_state.resource_send_cache->sendResourceData(file, /*offset=*/range.start, /*len=*/range_size, *reply_info.socket); // Uses sendfile() if this is a plain TCP connection.
 				
 						// conPrint("\thandleResourceRequest: sent data range. (len: " + toString(range_size) + ")");
 					}
 				}
 				else
 				{
-					// conPrint("handleResourceRequest: serving data for '" + resource_URL + "' (len: " + toString(file.fileSize()) + " B)");
+					// conPrint("handleResourceRequest: serving data for '" + resource_URL + "' (len: " + toString(file.size) + " B)");
 
-					web::ResponseUtils::writeHTTPOKHeaderAndDataWithCacheControl(reply_info, file.fileData(), file.fileSize(), content_type.c_str(), /*cache control=*/"max-age=1000000000, immutable");
+					// Write the header ourselves, so the data can be sent with sendResourceData().
+					const std::string response = 
+						"HTTP/1.1 200 OK\r\n"
+						"Content-Type: " + content_type + "\r\n"
+						"Cache-Control: max-age=1000000000, immutable\r\n"
+						"Connection: Keep-Alive\r\n"
+						"Content-Length: " + toString(file.size) + "\r\n"
+						"\r\n";
 
-					// conPrint("\thandleResourceRequest: sent data. (len: " + toString(file.fileSize()) + ")");
+					reply_info.socket->writeData(response.c_str(), response.size());
+
+					world_state.resource_send_cache->sendResourceData(file, /*offset=*/0, /*len=*/file.size, *reply_info.socket); // Uses sendfile() if this is a plain TCP connection.
+
+					// conPrint("\thandleResourceRequest: sent data. (len: " + toString(file.size) + ")");
 				}
 			}
 			catch(glare::Exception&)
@@ -6,6 +6,7 @@ Copyright Glare Technologies Limited 2022 -
 #include "WebDataStore.h"
 
 
+#include "../server/WebPageCache.h"
 #include <ResponseUtils.h>
 #include <utils/XMLParseUtils.h>
 #include <utils/IndigoXMLDoc.h>
@@ -226,6 +227,9 @@ void WebDataStore::loadAndCompressFiles()
 			this->main_css_hash = ::toHexString(hash).substr(0, /*count=*/8);
 		}
 	}
+
+	// Cached web pages may use the old fragments or main_css_hash.
+	WebPageCache::invalidate(WebPageCache::Dependency_WebData);
 }
 
 
@@ -209,6 +209,10 @@ void WebServerRequestHandler::handleRequest(const web::RequestInfo& request, web
 		{
 			AdminHandlers::handleForceDynTexUpdatePost(*this->world_state, request, reply_info);
 		}
+		else if(request.path == "/admin_set_lua_profiler_enabled_post")
+		{
+			AdminHandlers::handleSetLuaProfilerEnabledPost(*this->world_state, request, reply_info);
+		}
 		else if(request.path == "/admin_delete_transaction_post")
 		{
 			AdminHandlers::handleDeleteTransactionPost(*this->world_state, request, reply_info);